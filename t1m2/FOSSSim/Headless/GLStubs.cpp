@@ -0,0 +1,70 @@
+// Stand-ins for the OpenGL, GLU and GLUT entry points the base library
+// references, linked into FOSSSimHeadless in place of the real libraries.
+// The renderer, the display controller and the GLUT callbacks are compiled
+// into the base library, so they cannot be left out of the link; with these
+// the executable has no GL or X dependency at all. Headless runs (-d 0) never
+// reach them, and anything that does, such as a display or a PNG capture,
+// stops with an error instead of drawing.
+//
+// Only the symbols are provided: C linkage does not carry the signature, and
+// none of these returns.
+
+#include <cstdlib>
+#include <iostream>
+
+namespace
+{
+
+void displayUnavailable( const char* function )
+{
+  std::cerr << "\033[31;1mERROR IN HEADLESS:\033[m " << function << " needs a display, which FOSSSimHeadless is built without. Run with -d 0 and without -p, or use FOSSSim." << std::endl;
+  exit(1);
+}
+
+}
+
+#define HEADLESS_STUB( function ) extern "C" void function() { displayUnavailable( #function ); }
+
+HEADLESS_STUB( glBegin )
+HEADLESS_STUB( glClear )
+HEADLESS_STUB( glClearColor )
+HEADLESS_STUB( glColor3d )
+HEADLESS_STUB( glColor3f )
+HEADLESS_STUB( glEnd )
+HEADLESS_STUB( glFinish )
+HEADLESS_STUB( glGetError )
+HEADLESS_STUB( glLoadIdentity )
+HEADLESS_STUB( glMatrixMode )
+HEADLESS_STUB( glPixelStorei )
+HEADLESS_STUB( glPopMatrix )
+HEADLESS_STUB( glPushMatrix )
+HEADLESS_STUB( glRasterPos3f )
+HEADLESS_STUB( glReadBuffer )
+HEADLESS_STUB( glReadPixels )
+HEADLESS_STUB( glRotated )
+HEADLESS_STUB( glTranslated )
+HEADLESS_STUB( glVertex2d )
+HEADLESS_STUB( glVertex4d )
+HEADLESS_STUB( glViewport )
+
+HEADLESS_STUB( gluErrorString )
+HEADLESS_STUB( gluOrtho2D )
+
+HEADLESS_STUB( glutBitmapCharacter )
+HEADLESS_STUB( glutCreateWindow )
+HEADLESS_STUB( glutDisplayFunc )
+HEADLESS_STUB( glutIdleFunc )
+HEADLESS_STUB( glutInit )
+HEADLESS_STUB( glutInitDisplayMode )
+HEADLESS_STUB( glutInitWindowSize )
+HEADLESS_STUB( glutKeyboardFunc )
+HEADLESS_STUB( glutMainLoop )
+HEADLESS_STUB( glutMotionFunc )
+HEADLESS_STUB( glutMouseFunc )
+HEADLESS_STUB( glutPostRedisplay )
+HEADLESS_STUB( glutReshapeFunc )
+HEADLESS_STUB( glutSpecialFunc )
+HEADLESS_STUB( glutSwapBuffers )
+
+// GLUT_BITMAP_HELVETICA_18 is the address of this font object.
+extern "C" { void* glutBitmapHelvetica18 = NULL; }
@@ -0,0 +1,125 @@
+#include "AdaptiveStepper.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+
+// Bounds on how much one substep may shrink or grow the next, and the margin
+// the next one is aimed under the tolerance by.
+const scalar MIN_SCALE = 0.2;
+const scalar MAX_SCALE = 2.0;
+const scalar SAFETY = 0.9;
+
+// |p - q|_inf, without forming p - q.
+scalar maxAbsDifference( const VectorXs& p, const VectorXs& q )
+{
+  return p.size() == 0 ? 0.0 : ( p - q ).cwiseAbs().maxCoeff();
+}
+
+}
+
+AdaptiveStepper::AdaptiveStepper( Rule rule, scalar tolerance, scalar mindt )
+: m_rule(rule)
+, m_tolerance(tolerance)
+, m_mindt(mindt)
+, m_h(0.0)
+, m_accepted(0)
+, m_rejected(0)
+{
+  assert( m_tolerance > 0.0 );
+  assert( m_mindt > 0.0 );
+}
+
+void AdaptiveStepper::acceleration( TwoDScene& scene, const FixedDoFs& fixed, const VectorXs& dx, const VectorXs& dv, VectorXs& a ) const
+{
+  a.setZero(scene.getX().size());
+  scene.accumulateGradUParallel(a, dx, dv);
+  a.array() *= -fixed.getInverseMasses().array();
+}
+
+void AdaptiveStepper::substep( const FixedDoFs& fixed, const VectorXs& v, const VectorXs& a, scalar h, VectorXs& dx, VectorXs& dv )
+{
+  if( m_rule == EXPLICIT_EULER )
+  {
+    m_step = h*( v + dv );
+    fixed.zeroFixed(m_step);
+    dx += m_step;
+    dv += h*a;
+  }
+  else
+  {
+    dv += h*a;
+    dx += h*( v + dv );
+  }
+}
+
+void AdaptiveStepper::advance( TwoDScene& scene, const FixedDoFs& fixed, scalar dt )
+{
+  VectorXs& x = scene.getX();
+  VectorXs& v = scene.getV();
+  const int ndofs = (int) x.size();
+  const scalar mindt = std::min(m_mindt, dt);
+
+  scalar h = m_h > 0.0 ? std::min(m_h, dt) : dt;
+  scalar remaining = dt;
+
+  VectorXs& a0 = m_a0;
+  VectorXs& ahalf = m_ahalf;
+  acceleration(scene, fixed, VectorXs(), VectorXs(), a0);
+  VectorXs& dxwhole = m_dxwhole;
+  VectorXs& dvwhole = m_dvwhole;
+  VectorXs& dxhalves = m_dxhalves;
+  VectorXs& dvhalves = m_dvhalves;
+
+  while( remaining > 0.0 )
+  {
+    // Take what is left whole rather than leave a sliver for a last substep.
+    const bool last = h >= remaining*( 1.0 - 1.0e-9 );
+    const scalar step = last ? remaining : h;
+
+    dxwhole.setZero(ndofs);
+    dvwhole.setZero(ndofs);
+    substep(fixed, v, a0, step, dxwhole, dvwhole);
+
+    dxhalves.setZero(ndofs);
+    dvhalves.setZero(ndofs);
+    substep(fixed, v, a0, 0.5*step, dxhalves, dvhalves);
+    acceleration(scene, fixed, dxhalves, dvhalves, ahalf);
+    substep(fixed, v, ahalf, 0.5*step, dxhalves, dvhalves);
+
+    const scalar err = maxAbsDifference(dxhalves, dxwhole) + step*maxAbsDifference(dvhalves, dvwhole);
+    const bool accept = err <= m_tolerance || step <= mindt;
+    const scalar scale = err > 0.0 ? std::min(MAX_SCALE, std::max(MIN_SCALE, SAFETY*std::sqrt(m_tolerance/err))) : MAX_SCALE;
+
+    if( accept )
+    {
+      ++m_accepted;
+      x += dxhalves;
+      v += dvhalves;
+      remaining = last ? 0.0 : remaining - step;
+      // A last substep cut short by the end of dt says little about the next.
+      if( !last || step >= h ) h = step*scale;
+      if( remaining > 0.0 ) acceleration(scene, fixed, VectorXs(), VectorXs(), a0);
+    }
+    else
+    {
+      ++m_rejected;
+      h = step*scale;
+    }
+    h = std::min(dt, std::max(mindt, h));
+  }
+
+  m_h = h;
+}
+
+int AdaptiveStepper::getNumAccepted() const
+{
+  return m_accepted;
+}
+
+int AdaptiveStepper::getNumRejected() const
+{
+  return m_rejected;
+}
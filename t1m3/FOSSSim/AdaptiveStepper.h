@@ -0,0 +1,70 @@
+#ifndef __ADAPTIVE_STEPPER_H__
+#define __ADAPTIVE_STEPPER_H__
+
+#include "FixedDoFs.h"
+#include "MathDefs.h"
+#include "TwoDScene.h"
+
+// Error-controlled substepping for the explicit steppers, used when built with
+// ADAPTIVE_STEP_TOLERANCE > 0. The base library calls stepScene once per
+// XML dt, so dt is the largest step taken; advance() covers it in substeps
+// sized by step doubling. Each substep h is taken once whole and once as two
+// halves, the halves are kept, and their difference from the whole step,
+//
+//   err = |dx_halves - dx_whole|_inf + h*|dv_halves - dv_whole|_inf,
+//
+// estimates their local error in units of length. A substep is accepted when
+// err <= ADAPTIVE_STEP_TOLERANCE and retried smaller otherwise. Both rules are
+// first order, so the local error goes as h^2 and the next substep is
+// h*0.9*sqrt(tolerance/err), kept within [h/5, 2h] and within
+// [ADAPTIVE_STEP_MIN_DT, dt]. Substeps at the minimum are accepted whatever
+// their error. The step size carries over from one call to the next, so a
+// quiescent scene settles on whole steps of dt at two force evaluations per
+// step, and only stiff moments pay for smaller ones.
+class AdaptiveStepper
+{
+public:
+  enum Rule
+  {
+    // x += h*v, v += h*a(x,v)
+    EXPLICIT_EULER,
+    // v += h*a(x,v), x += h*v
+    SYMPLECTIC_EULER
+  };
+
+  AdaptiveStepper( Rule rule, scalar tolerance, scalar mindt );
+
+  // Advances the scene's positions and velocities by dt. fixed must be
+  // up to date for the scene.
+  void advance( TwoDScene& scene, const FixedDoFs& fixed, scalar dt );
+
+  // Substeps accepted and rejected over all calls so far.
+  int getNumAccepted() const;
+  int getNumRejected() const;
+
+private:
+  // a = the acceleration at (x + dx, v + dv).
+  void acceleration( TwoDScene& scene, const FixedDoFs& fixed, const VectorXs& dx, const VectorXs& dv, VectorXs& a ) const;
+
+  // Advances the displacement (dx, dv) by one step of h, with a the
+  // acceleration at the displaced state.
+  void substep( const FixedDoFs& fixed, const VectorXs& v, const VectorXs& a, scalar h, VectorXs& dx, VectorXs& dv );
+
+  Rule m_rule;
+  scalar m_tolerance;
+  scalar m_mindt;
+  // The step size to try next; 0 before the first call.
+  scalar m_h;
+  int m_accepted;
+  int m_rejected;
+  // Substep buffers, kept so that steps do not allocate.
+  VectorXs m_a0;
+  VectorXs m_ahalf;
+  VectorXs m_dxwhole;
+  VectorXs m_dvwhole;
+  VectorXs m_dxhalves;
+  VectorXs m_dvhalves;
+  VectorXs m_step;
+};
+
+#endif
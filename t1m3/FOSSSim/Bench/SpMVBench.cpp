@@ -0,0 +1,407 @@
+// Times products with the linearized implicit Euler system
+//   A = M + dt^2 d2U/dx2 + dt d2U/dxdv
+// of the spring networks in scene files, over their free DoFs, with each way
+// the solvers can hold it: a dense matrix, Eigen's scalar sparse matrix in
+// row-major (CSR) order, the 2x2 block BlockSparseMatrix2 (BSR), and no matrix
+// at all, through the scene's Hessian-vector products. It follows the shape of
+// Eigen's bench/spmv.cpp, but on the matrices the steppers build rather than
+// random ones, to show where each backend pays off.
+//
+// The asset scenes have a few dozen particles each, so that their systems sit
+// in L1 and a product is call overhead. Each scene is instead laid out in as
+// many side by side copies as reach each requested number of DoFs, which keeps
+// its Hessians' per-row structure and values while making the products move
+// their data through memory. Only the springs are read; the state is the
+// scene's initial one, and dt its integrator's.
+//
+// For each variant it reports products per second, the bandwidth those
+// imply, and conjugate gradient iterations per second on A x = A 1, where an
+// iteration is a product and the vector updates around it. The bandwidth
+// counts the least a product must move: the stored values and indices once,
+// or for the matrix-free product each spring's endpoints and parameters, and
+// positions, velocities and masses; and the input vector read and the output
+// written once. Cache reuse of the input vector is ignored, so the figure is
+// a lower bound on the traffic.
+//
+// Built with make FOSSSimSpMVBench; not built by default.
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <rapidxml.hpp>
+#include <tclap/CmdLine.h>
+
+#include "FOSSSim/MathDefs.h"
+#include "FOSSSim/TwoDScene.h"
+#include "FOSSSim/FixedDoFs.h"
+#include "FOSSSim/SpringForce.h"
+#include "FOSSSim/SpringForceBatch.h"
+#include "FOSSSim/BlockSparseMatrix.h"
+
+namespace
+{
+
+typedef Eigen::SparseMatrix<scalar,Eigen::RowMajor> SparseRowMatrixXs;
+
+// The springs of a scene file, and the particles they join.
+struct SpringScene
+{
+  scalar dt;
+  std::vector<Vector2s> x;
+  std::vector<Vector2s> v;
+  std::vector<scalar> m;
+  std::vector<bool> fixed;
+  std::vector<std::pair<int,int> > edges;
+  std::vector<int> edge;
+  std::vector<scalar> k;
+  std::vector<scalar> l0;
+  std::vector<scalar> b;
+};
+
+scalar attribute( rapidxml::xml_node<>* node, const char* name, scalar fallback )
+{
+  rapidxml::xml_attribute<>* attr = node->first_attribute(name);
+  return attr == NULL ? fallback : atof(attr->value());
+}
+
+bool loadSpringScene( const std::string& file, SpringScene& scene )
+{
+  std::ifstream ifs(file.c_str(), std::ios::binary);
+  if( !ifs ) return false;
+  std::vector<char> text( (std::istreambuf_iterator<char>(ifs)), std::istreambuf_iterator<char>() );
+  text.push_back('\0');
+  rapidxml::xml_document<> doc;
+  try
+  {
+    doc.parse<0>(&text[0]);
+  }
+  catch( const rapidxml::parse_error& )
+  {
+    return false;
+  }
+  rapidxml::xml_node<>* root = doc.first_node("scene");
+  if( root == NULL ) return false;
+
+  scene.dt = 0.01;
+  if( rapidxml::xml_node<>* integrator = root->first_node("integrator") ) scene.dt = attribute(integrator, "dt", scene.dt);
+  for( rapidxml::xml_node<>* node = root->first_node("particle"); node != NULL; node = node->next_sibling("particle") )
+  {
+    scene.x.push_back(Vector2s(attribute(node, "px", 0.0), attribute(node, "py", 0.0)));
+    scene.v.push_back(Vector2s(attribute(node, "vx", 0.0), attribute(node, "vy", 0.0)));
+    scene.m.push_back(attribute(node, "m", 1.0));
+    scene.fixed.push_back(attribute(node, "fixed", 0.0) != 0.0);
+  }
+  for( rapidxml::xml_node<>* node = root->first_node("edge"); node != NULL; node = node->next_sibling("edge") )
+    scene.edges.push_back(std::make_pair(int(attribute(node, "i", -1)), int(attribute(node, "j", -1))));
+  for( rapidxml::xml_node<>* node = root->first_node("springforce"); node != NULL; node = node->next_sibling("springforce") )
+  {
+    const int e = int(attribute(node, "edge", -1));
+    if( e < 0 || e >= int(scene.edges.size()) ) return false;
+    scene.edge.push_back(e);
+    scene.k.push_back(attribute(node, "k", 0.0));
+    scene.l0.push_back(attribute(node, "l0", 0.0));
+    scene.b.push_back(attribute(node, "b", 0.0));
+  }
+  for( std::vector<std::pair<int,int> >::size_type e = 0; e < scene.edges.size(); ++e )
+  {
+    const int n = int(scene.x.size());
+    if( scene.edges[e].first < 0 || scene.edges[e].first >= n || scene.edges[e].second < 0 || scene.edges[e].second >= n ) return false;
+  }
+  return true;
+}
+
+// Fills out with copies of source, in rows of copies offset by the source's
+// extent plus a margin, so that no two copies overlap.
+void tileScene( const SpringScene& source, int copies, TwoDScene& out )
+{
+  const int n = int(source.x.size());
+  Vector2s lo = source.x[0];
+  Vector2s hi = source.x[0];
+  for( int i = 1; i < n; ++i )
+  {
+    lo = lo.cwiseMin(source.x[i]);
+    hi = hi.cwiseMax(source.x[i]);
+  }
+  const Vector2s pitch = ( hi - lo ).array() + 1.0;
+  const int perrow = std::max(1, int(std::ceil(std::sqrt(double(copies)))));
+
+  out.resizeSystem(n*copies);
+  for( int c = 0; c < copies; ++c )
+  {
+    const Vector2s offset(pitch.x()*( c % perrow ), pitch.y()*( c / perrow ));
+    for( int i = 0; i < n; ++i )
+    {
+      out.setPosition(c*n + i, source.x[i] + offset);
+      out.setVelocity(c*n + i, source.v[i]);
+      out.setMass(c*n + i, source.m[i]);
+      out.setFixed(c*n + i, source.fixed[i]);
+    }
+    for( std::vector<int>::size_type s = 0; s < source.edge.size(); ++s )
+    {
+      const std::pair<int,int>& e = source.edges[source.edge[s]];
+      out.insertForce(new SpringForce(std::make_pair(c*n + e.first, c*n + e.second), source.k[s], source.l0[s], source.b[s]));
+    }
+  }
+  // As the steppers see them.
+  out.batchForces();
+}
+
+int numSprings( const TwoDScene& scene )
+{
+  int springs = 0;
+  for( std::vector<Force*>::size_type f = 0; f < scene.getForces().size(); ++f )
+    if( const SpringForceBatch* batch = dynamic_cast<const SpringForceBatch*>(scene.getForces()[f]) ) springs += batch->getNumSprings();
+  return springs;
+}
+
+// A over the free DoFs through the scene's Hessian-vector products, on the
+// full state: the input is scattered out and the output gathered back, as a
+// matrix-free solve over free DoFs has to.
+class MatrixFreeSystem
+{
+public:
+  MatrixFreeSystem( TwoDScene& scene, const FixedDoFs& fixed, scalar dt )
+  : m_scene(scene)
+  , m_fixed(fixed)
+  , m_dt(dt)
+  {}
+
+  void multiply( const VectorXs& pf, VectorXs& yf )
+  {
+    m_fixed.scatterFree(pf, m_p);
+    m_hx.setZero(m_p.size());
+    m_hv.setZero(m_p.size());
+    m_scene.accumulateddUdxdxProduct(m_hx, m_p);
+    m_scene.accumulateddUdxdvProduct(m_hv, m_p);
+    m_y = m_scene.getM().cwiseProduct(m_p) + m_dt*m_dt*m_hx + m_dt*m_hv;
+    m_fixed.gatherFree(m_y, yf);
+  }
+
+private:
+  TwoDScene& m_scene;
+  const FixedDoFs& m_fixed;
+  scalar m_dt;
+  VectorXs m_p;
+  VectorXs m_hx;
+  VectorXs m_hv;
+  VectorXs m_y;
+};
+
+struct DenseProduct
+{
+  const MatrixXs& A;
+  void operator()( const VectorXs& x, VectorXs& y ) const { y.noalias() = A*x; }
+};
+
+struct CSRProduct
+{
+  const SparseRowMatrixXs& A;
+  void operator()( const VectorXs& x, VectorXs& y ) const { y.noalias() = A*x; }
+};
+
+struct BSRProduct
+{
+  const BlockSparseMatrix2& A;
+  void operator()( const VectorXs& x, VectorXs& y ) const { A.multiply(x, y); }
+};
+
+struct MatrixFreeProduct
+{
+  MatrixFreeSystem& A;
+  void operator()( const VectorXs& x, VectorXs& y ) const { A.multiply(x, y); }
+};
+
+typedef std::chrono::steady_clock Clock;
+
+double secondsSince( const Clock::time_point& start )
+{
+  return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+// Products per second, over at least minseconds.
+template<class Product>
+double timeProducts( const Product& product, const VectorXs& x, VectorXs& y, double minseconds )
+{
+  product(x, y);
+  long products = 0;
+  const Clock::time_point start = Clock::now();
+  double seconds = 0.0;
+  do
+  {
+    for( int r = 0; r < 8; ++r ) product(x, y);
+    products += 8;
+    seconds = secondsSince(start);
+  } while( seconds < minseconds );
+  return products/seconds;
+}
+
+// Unpreconditioned CG on A x = b from x = 0, for at most maxiterations.
+// Returns the iterations taken.
+template<class Product>
+int solveCG( const Product& product, const VectorXs& b, VectorXs& x, VectorXs& r, VectorXs& p, VectorXs& Ap, int maxiterations )
+{
+  const scalar tolerance = 1.0e-10;
+  x.setZero(b.size());
+  r = b;
+  p = r;
+  scalar rr = r.squaredNorm();
+  const scalar stop = tolerance*tolerance*rr;
+  int itr = 0;
+  while( itr < maxiterations && rr > stop )
+  {
+    ++itr;
+    product(p, Ap);
+    const scalar pAp = p.dot(Ap);
+    if( pAp <= 0.0 ) break;
+    const scalar alpha = rr/pAp;
+    x += alpha*p;
+    r -= alpha*Ap;
+    const scalar rrnew = r.squaredNorm();
+    p = r + (rrnew/rr)*p;
+    rr = rrnew;
+  }
+  return itr;
+}
+
+// CG iterations per second, over at least minseconds of solves.
+template<class Product>
+double timeCG( const Product& product, const VectorXs& b, double minseconds )
+{
+  const int maxiterations = 200;
+  VectorXs x, r, p, Ap;
+  solveCG(product, b, x, r, p, Ap, maxiterations);
+  long iterations = 0;
+  const Clock::time_point start = Clock::now();
+  double seconds = 0.0;
+  do
+  {
+    const int taken = solveCG(product, b, x, r, p, Ap, maxiterations);
+    // A zero right-hand side would never finish.
+    if( taken == 0 ) return 0.0;
+    iterations += taken;
+    seconds = secondsSince(start);
+  } while( seconds < minseconds );
+  return iterations/seconds;
+}
+
+template<class Product>
+void report( const char* variant, const Product& product, double bytes, const VectorXs& ones, const VectorXs& reference, double minseconds )
+{
+  VectorXs y;
+  product(ones, y);
+  const scalar error = ( y - reference ).lpNorm<Eigen::Infinity>();
+  const scalar scale = std::max<scalar>(reference.lpNorm<Eigen::Infinity>(), 1.0);
+  const double rate = timeProducts(product, ones, y, minseconds);
+  const double iterations = timeCG(product, reference, minseconds);
+  printf("  %-12s %14.0f %10.2f %14.0f", variant, rate, rate*bytes*1.0e-9, iterations);
+  if( !( error <= 1.0e-10*scale ) ) printf("   differs from BSR by %g", error);
+  printf("\n");
+}
+
+void benchmark( const std::string& file, const SpringScene& source, int targetdofs, int densemax, double minseconds )
+{
+  const int copies = std::max(1, int(std::ceil(double(targetdofs)/( 2.0*source.x.size() ))));
+  TwoDScene scene;
+  tileScene(source, copies, scene);
+  const FixedDoFs fixed(scene);
+  const int n = fixed.getNumFreeDoFs();
+  const int springs = numSprings(scene);
+  printf("%s x %d: %d particles, %d springs, %d free DoFs, dt %g\n", file.c_str(), copies, scene.getNumParticles(), springs, n, source.dt);
+  if( n == 0 )
+  {
+    printf("  no free DoFs\n\n");
+    return;
+  }
+
+  TripletXs hessX, hessV;
+  scalar E = 0.0;
+  VectorXs gradE;
+  scene.evaluateForces(EVALUATE_HESSX | EVALUATE_HESSV, E, gradE, hessX, hessV);
+  BlockSparseMatrix2 bsr;
+  bsr.assemble(scene.getM(), fixed, source.dt*source.dt, hessX, source.dt, hessV);
+  SparseMatrixXs csc;
+  bsr.toSparse(csc);
+  const SparseRowMatrixXs csr(csc);
+  MatrixFreeSystem matrixfree(scene, fixed, source.dt);
+
+  const VectorXs ones = VectorXs::Ones(n);
+  VectorXs reference;
+  bsr.multiply(ones, reference);
+
+  const double vectors = 2.0*sizeof(scalar)*n;
+  printf("  %-12s %14s %10s %14s\n", "variant", "products/s", "GB/s", "CG it/s");
+  if( n <= densemax )
+  {
+    const MatrixXs dense(csc);
+    const DenseProduct product = { dense };
+    report("dense", product, sizeof(scalar)*double(n)*n + vectors, ones, reference, minseconds);
+  }
+  else
+  {
+    printf("  %-12s skipped above %d DoFs\n", "dense", densemax);
+  }
+  const CSRProduct csrproduct = { csr };
+  report("eigen-csr", csrproduct, ( sizeof(scalar) + sizeof(int) )*double(csr.nonZeros()) + sizeof(int)*( n + 1.0 ) + vectors, ones, reference, minseconds);
+  const BSRProduct bsrproduct = { bsr };
+  report("bsr-2x2", bsrproduct, ( 4*sizeof(scalar) + sizeof(int) )*double(bsr.numBlocks()) + sizeof(int)*( bsr.numBlockRows() + 1.0 ) + vectors, ones, reference, minseconds);
+  // Each spring's two endpoints and three parameters; each DoF's position,
+  // velocity and mass.
+  const MatrixFreeProduct freeproduct = { matrixfree };
+  report("matrix-free", freeproduct, ( 2*sizeof(int) + 3*sizeof(scalar) )*double(springs) + 3*sizeof(scalar)*double(scene.getX().size()) + vectors, ones, reference, minseconds);
+  printf("\n");
+}
+
+}
+
+int main( int argc, char** argv )
+{
+  std::vector<std::string> files;
+  std::vector<int> sizes;
+  int densemax = 4096;
+  double minseconds = 0.25;
+  try
+  {
+    TCLAP::CmdLine cmd("Times products with the implicit Euler systems of scenes' spring networks, stored densely, as CSR, as 2x2 BSR and matrix-free.");
+    TCLAP::MultiArg<int> dofs("n", "dofs", "DoFs to tile each scene up to; may be repeated. Default 2048 and 262144", false, "integer", cmd);
+    TCLAP::ValueArg<int> dense("D", "dense-max", "Largest system timed as a dense matrix", false, densemax, "integer", cmd);
+    TCLAP::ValueArg<double> seconds("t", "seconds", "Least time spent on each measurement", false, minseconds, "float", cmd);
+    TCLAP::UnlabeledMultiArg<std::string> scenes("scenes", "Scene files; those without springs are skipped", true, "file", cmd);
+    cmd.parse(argc, argv);
+    files = scenes.getValue();
+    sizes = dofs.getValue();
+    densemax = dense.getValue();
+    minseconds = seconds.getValue();
+  }
+  catch( TCLAP::ArgException& e )
+  {
+    std::cerr << "error: " << e.what() << std::endl;
+    return 1;
+  }
+  if( sizes.empty() )
+  {
+    sizes.push_back(2048);
+    sizes.push_back(262144);
+  }
+
+  int failures = 0;
+  for( std::vector<std::string>::size_type f = 0; f < files.size(); ++f )
+  {
+    SpringScene source;
+    if( !loadSpringScene(files[f], source) )
+    {
+      std::cerr << "\033[31;1mERROR IN SPMV BENCH:\033[m Unable to load " << files[f] << std::endl;
+      ++failures;
+      continue;
+    }
+    if( source.edge.empty() ) continue;
+    for( std::vector<int>::size_type s = 0; s < sizes.size(); ++s ) benchmark(files[f], source, sizes[s], densemax, minseconds);
+  }
+  return failures == 0 ? 0 : 1;
+}
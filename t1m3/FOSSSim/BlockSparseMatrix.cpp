@@ -0,0 +1,255 @@
+#include "BlockSparseMatrix.h"
+
+#include <algorithm>
+#include <cassert>
+
+BlockSparseMatrix2::BlockSparseMatrix2()
+: m_pattern_version(0)
+, m_row_start(1,0)
+, m_cols()
+, m_diag()
+, m_values()
+, m_free()
+, m_coords()
+, m_num_a(0)
+, m_slot()
+, m_sparse_version(-1)
+, m_sparse_values(NULL)
+, m_sparse_index()
+{}
+
+bool BlockSparseMatrix2::samePattern( const FixedDoFs& fixed, const TripletXs& hessA, const TripletXs& hessB ) const
+{
+  if( m_num_a != int(hessA.size()) || m_coords.size() != 2*( hessA.size() + hessB.size() ) ) return false;
+  if( m_free != fixed.getFreeParticles() ) return false;
+
+  const int* c = m_coords.empty() ? NULL : &m_coords[0];
+  for( TripletXs::size_type t = 0; t < hessA.size(); ++t, c += 2 ) if( c[0] != hessA[t].row() || c[1] != hessA[t].col() ) return false;
+  for( TripletXs::size_type t = 0; t < hessB.size(); ++t, c += 2 ) if( c[0] != hessB[t].row() || c[1] != hessB[t].col() ) return false;
+  return true;
+}
+
+void BlockSparseMatrix2::buildPattern( const FixedDoFs& fixed, const TripletXs& hessA, const TripletXs& hessB )
+{
+  m_free = fixed.getFreeParticles();
+  const int nb = int(m_free.size());
+  std::vector<int> block_of( fixed.getNumParticles(), -1 );
+  for( int k = 0; k < nb; ++k ) block_of[m_free[k]] = k;
+
+  m_num_a = int(hessA.size());
+  m_coords.resize( 2*( hessA.size() + hessB.size() ) );
+  for( TripletXs::size_type t = 0; t < hessA.size(); ++t ) { m_coords[2*t] = hessA[t].row(); m_coords[2*t+1] = hessA[t].col(); }
+  for( TripletXs::size_type t = 0; t < hessB.size(); ++t ) { m_coords[2*(m_num_a+t)] = hessB[t].row(); m_coords[2*(m_num_a+t)+1] = hessB[t].col(); }
+
+  // Block coordinates of every triplet that survives, plus the diagonal.
+  const int ntriplets = int(m_coords.size())/2;
+  std::vector<std::pair<int,int> > blocks;
+  blocks.reserve( ntriplets + nb );
+  for( int k = 0; k < nb; ++k ) blocks.push_back( std::make_pair(k,k) );
+  for( int t = 0; t < ntriplets; ++t )
+  {
+    const int bi = block_of[m_coords[2*t]/2];
+    const int bj = block_of[m_coords[2*t+1]/2];
+    if( bi >= 0 && bj >= 0 ) blocks.push_back( std::make_pair(bi,bj) );
+  }
+  std::sort( blocks.begin(), blocks.end() );
+  blocks.erase( std::unique( blocks.begin(), blocks.end() ), blocks.end() );
+
+  m_row_start.assign( nb+1, 0 );
+  m_cols.resize( blocks.size() );
+  m_diag.resize( nb );
+  for( std::vector<std::pair<int,int> >::size_type k = 0; k < blocks.size(); ++k )
+  {
+    ++m_row_start[blocks[k].first+1];
+    m_cols[k] = blocks[k].second;
+    if( blocks[k].first == blocks[k].second ) m_diag[blocks[k].first] = int(k);
+  }
+  for( int i = 0; i < nb; ++i ) m_row_start[i+1] += m_row_start[i];
+
+  m_slot.resize( ntriplets );
+  for( int t = 0; t < ntriplets; ++t )
+  {
+    const int r = m_coords[2*t];
+    const int c = m_coords[2*t+1];
+    const int bi = block_of[r/2];
+    const int bj = block_of[c/2];
+    if( bi < 0 || bj < 0 ) { m_slot[t] = -1; continue; }
+    const int k = int( std::lower_bound( m_cols.begin()+m_row_start[bi], m_cols.begin()+m_row_start[bi+1], bj ) - m_cols.begin() );
+    assert( m_cols[k] == bj );
+    m_slot[t] = 4*k + 2*(r%2) + c%2;
+  }
+
+  m_values.resize( 4*m_cols.size() );
+  ++m_pattern_version;
+}
+
+void BlockSparseMatrix2::assemble( const VectorXs& m, const FixedDoFs& fixed, scalar a, const TripletXs& hessA, scalar b, const TripletXs& hessB )
+{
+  if( !samePattern(fixed,hessA,hessB) ) buildPattern(fixed,hessA,hessB);
+
+  std::fill( m_values.begin(), m_values.end(), 0.0 );
+  const int nb = numBlockRows();
+  for( int k = 0; k < nb; ++k )
+  {
+    scalar* D = &m_values[4*m_diag[k]];
+    D[0] = m(2*m_free[k]);
+    D[3] = m(2*m_free[k]+1);
+  }
+
+  const int* slot = m_slot.empty() ? NULL : &m_slot[0];
+  for( TripletXs::size_type t = 0; t < hessA.size(); ++t ) if( slot[t] >= 0 ) m_values[slot[t]] += a*hessA[t].value();
+  slot += hessA.size();
+  for( TripletXs::size_type t = 0; t < hessB.size(); ++t ) if( slot[t] >= 0 ) m_values[slot[t]] += b*hessB[t].value();
+}
+
+void BlockSparseMatrix2::multiply( const VectorXs& x, VectorXs& y ) const
+{
+  const int nb = numBlockRows();
+  assert( x.size() == 2*nb );
+  y.resize( 2*nb );
+  for( int i = 0; i < nb; ++i )
+  {
+    scalar y0 = 0.0;
+    scalar y1 = 0.0;
+    for( int k = m_row_start[i]; k < m_row_start[i+1]; ++k )
+    {
+      const scalar* B = &m_values[4*k];
+      const scalar x0 = x(2*m_cols[k]);
+      const scalar x1 = x(2*m_cols[k]+1);
+      y0 += B[0]*x0 + B[1]*x1;
+      y1 += B[2]*x0 + B[3]*x1;
+    }
+    y(2*i) = y0;
+    y(2*i+1) = y1;
+  }
+}
+
+void BlockSparseMatrix2::toSparse( SparseMatrixXs& A ) const
+{
+  const int nvalues = int(m_values.size());
+  if( m_sparse_version == m_pattern_version && A.isCompressed() && A.valuePtr() == m_sparse_values && A.nonZeros() == nvalues )
+  {
+    scalar* values = A.valuePtr();
+    for( int e = 0; e < nvalues; ++e ) values[m_sparse_index[e]] = m_values[e];
+    return;
+  }
+
+  // Written column by column: block (i,j) puts two entries in each of the
+  // scalar columns 2j and 2j+1. Visiting block rows in order keeps each
+  // column's rows sorted.
+  const int nb = numBlockRows();
+  A.resize( 2*nb, 2*nb );
+  A.resizeNonZeros( nvalues );
+  int* outer = A.outerIndexPtr();
+  int* inner = A.innerIndexPtr();
+  scalar* values = A.valuePtr();
+
+  std::fill( outer, outer+2*nb+1, 0 );
+  for( int k = 0; k < numBlocks(); ++k ) { outer[2*m_cols[k]+1] += 2; outer[2*m_cols[k]+2] += 2; }
+  for( int c = 0; c < 2*nb; ++c ) outer[c+1] += outer[c];
+
+  std::vector<int> next( outer, outer+2*nb );
+  m_sparse_index.resize( nvalues );
+  for( int i = 0; i < nb; ++i )
+  {
+    for( int k = m_row_start[i]; k < m_row_start[i+1]; ++k )
+    {
+      for( int e = 0; e < 4; ++e )
+      {
+        const int pos = next[2*m_cols[k]+e%2]++;
+        inner[pos] = 2*i+e/2;
+        values[pos] = m_values[4*k+e];
+        m_sparse_index[4*k+e] = pos;
+      }
+    }
+  }
+
+  m_sparse_version = m_pattern_version;
+  m_sparse_values = A.valuePtr();
+}
+
+void BlockSparseMatrix2::coarsen( const std::vector<int>& aggregate, int naggregates, BlockSparseMatrix2& coarse ) const
+{
+  const int nb = numBlockRows();
+  assert( int(aggregate.size()) == nb );
+
+  // Block rows of each aggregate, by counting sort.
+  std::vector<int> member_start( naggregates+1, 0 );
+  for( int i = 0; i < nb; ++i ) ++member_start[aggregate[i]+1];
+  for( int a = 0; a < naggregates; ++a ) member_start[a+1] += member_start[a];
+  std::vector<int> members( nb );
+  std::vector<int> next( member_start.begin(), member_start.end()-1 );
+  for( int i = 0; i < nb; ++i ) members[next[aggregate[i]]++] = i;
+
+  coarse.m_row_start.assign( 1, 0 );
+  coarse.m_cols.clear();
+  coarse.m_values.clear();
+  coarse.m_diag.resize( naggregates );
+  coarse.m_free.clear();
+  coarse.m_coords.clear();
+  coarse.m_num_a = 0;
+  coarse.m_slot.clear();
+  ++coarse.m_pattern_version;
+
+  // Sums each coarse row's blocks in a dense scratch row, marking the
+  // columns it touches.
+  std::vector<int> position( naggregates, -1 );
+  std::vector<std::pair<int,int> > row;
+  std::vector<scalar> sums;
+  for( int a = 0; a < naggregates; ++a )
+  {
+    row.clear();
+    sums.clear();
+    for( int m = member_start[a]; m < member_start[a+1]; ++m )
+    {
+      const int i = members[m];
+      for( int k = m_row_start[i]; k < m_row_start[i+1]; ++k )
+      {
+        const int c = aggregate[m_cols[k]];
+        if( position[c] < 0 )
+        {
+          position[c] = int(row.size());
+          row.push_back( std::make_pair( c, int(row.size()) ) );
+          sums.insert( sums.end(), 4, 0.0 );
+        }
+        scalar* S = &sums[4*position[c]];
+        for( int e = 0; e < 4; ++e ) S[e] += m_values[4*k+e];
+      }
+    }
+
+    std::sort( row.begin(), row.end() );
+    for( std::vector<std::pair<int,int> >::size_type e = 0; e < row.size(); ++e )
+    {
+      if( row[e].first == a ) coarse.m_diag[a] = int(coarse.m_cols.size());
+      coarse.m_cols.push_back( row[e].first );
+      coarse.m_values.insert( coarse.m_values.end(), sums.begin()+4*row[e].second, sums.begin()+4*row[e].second+4 );
+      position[row[e].first] = -1;
+    }
+    coarse.m_row_start.push_back( int(coarse.m_cols.size()) );
+  }
+}
+
+BlockJacobiPreconditioner::BlockJacobiPreconditioner()
+: m_inverses()
+{}
+
+void BlockJacobiPreconditioner::compute( const BlockSparseMatrix2& A )
+{
+  const int nb = A.numBlockRows();
+  m_inverses.resize( nb );
+  for( int i = 0; i < nb; ++i )
+  {
+    const Matrix2s D = A.block( A.diagonalBlock(i) );
+    const scalar det = D(0,0)*D(1,1) - D(0,1)*D(1,0);
+    if( det != 0.0 ) m_inverses[i] << D(1,1)/det, -D(0,1)/det, -D(1,0)/det, D(0,0)/det;
+    else m_inverses[i].setIdentity();
+  }
+}
+
+void BlockJacobiPreconditioner::apply( const VectorXs& r, VectorXs& z ) const
+{
+  const int nb = int(m_inverses.size());
+  assert( r.size() == 2*nb );
+  z.resize( 2*nb );
+  for( int i = 0; i < nb; ++i ) z.segment<2>(2*i) = m_inverses[i]*r.segment<2>(2*i);
+}
@@ -0,0 +1,148 @@
+#ifndef __BLOCK_SPARSE_MATRIX_H__
+#define __BLOCK_SPARSE_MATRIX_H__
+
+#include <vector>
+
+#include "MathDefs.h"
+#include "FixedDoFs.h"
+
+// Square matrix of 2x2 blocks in block compressed sparse row (BSR) form, one
+// block row and column per particle. Every force Hessian is made of such
+// blocks, so this keeps one column index per block where a scalar CSR matrix
+// keeps four, and a product streams each block's four values together.
+//
+// Blocks are stored row-major, four consecutive scalars each, in the order of
+// their block columns within each block row. Every block row has a diagonal
+// block, even if only the mass contributes to it.
+class BlockSparseMatrix2
+{
+public:
+  BlockSparseMatrix2();
+
+  // Sets this to diag(m) + a hessA + b hessB over the free particles of fixed,
+  // in their order; rows and columns of fixed particles are dropped. The
+  // triplets may repeat entries, which are summed. The block pattern and each
+  // triplet's place in it are kept and reused while the triplets' coordinates
+  // and the free set stay the same, so that refilling a topology-stable
+  // system is one pass over the triplets.
+  void assemble( const VectorXs& m, const FixedDoFs& fixed, scalar a, const TripletXs& hessA, scalar b, const TripletXs& hessB );
+
+  // Scalar rows (and columns), twice the number of block rows.
+  int rows() const { return 2*numBlockRows(); }
+
+  int numBlockRows() const { return int(m_row_start.size()) - 1; }
+
+  int numBlocks() const { return int(m_cols.size()); }
+
+  // The blocks of block row i are numbered rowStart(i) to rowStart(i+1)-1.
+  int rowStart( int i ) const { return m_row_start[i]; }
+
+  int blockColumn( int k ) const { return m_cols[k]; }
+
+  int diagonalBlock( int i ) const { return m_diag[i]; }
+
+  Eigen::Map<const Eigen::Matrix<scalar,2,2,Eigen::RowMajor> > block( int k ) const
+  {
+    return Eigen::Map<const Eigen::Matrix<scalar,2,2,Eigen::RowMajor> >( &m_values[4*k] );
+  }
+
+  // y = A x.
+  void multiply( const VectorXs& x, VectorXs& y ) const;
+
+  // A = this, as a scalar sparse matrix for the direct solvers. If A was
+  // last written by this call and the block pattern has not changed since,
+  // its values are overwritten in place through a precomputed map, with no
+  // sorting or allocation.
+  void toSparse( SparseMatrixXs& A ) const;
+
+  // coarse = P^T A P, where P copies each aggregate's 2-vector to all of its
+  // block rows: aggregate[i] in [0, naggregates) is block row i's aggregate.
+  // Coarse blocks are the sums of the blocks between two aggregates.
+  void coarsen( const std::vector<int>& aggregate, int naggregates, BlockSparseMatrix2& coarse ) const;
+
+private:
+  // Returns true if hessA, hessB and the free set match those the pattern
+  // was built for.
+  bool samePattern( const FixedDoFs& fixed, const TripletXs& hessA, const TripletXs& hessB ) const;
+
+  void buildPattern( const FixedDoFs& fixed, const TripletXs& hessA, const TripletXs& hessB );
+
+  // Bumped whenever the block pattern is rebuilt.
+  int m_pattern_version;
+  std::vector<int> m_row_start;
+  std::vector<int> m_cols;
+  std::vector<int> m_diag;
+  std::vector<scalar> m_values;
+
+  // What the pattern was built from: the free particles, and the row and
+  // column of every triplet of hessA followed by hessB.
+  std::vector<int> m_free;
+  std::vector<int> m_coords;
+  int m_num_a;
+  // Each triplet's scalar index into m_values, or -1 if it touches a fixed
+  // particle.
+  std::vector<int> m_slot;
+
+  // The pattern version and value array toSparse last wrote, and the index
+  // in that array of each of m_values.
+  mutable int m_sparse_version;
+  mutable const scalar* m_sparse_values;
+  mutable std::vector<int> m_sparse_index;
+};
+
+// Block-Jacobi preconditioner: the inverses of a BlockSparseMatrix2's
+// diagonal blocks. A singular block is replaced by the identity.
+class BlockJacobiPreconditioner
+{
+public:
+  BlockJacobiPreconditioner();
+
+  void compute( const BlockSparseMatrix2& A );
+
+  // z = the block diagonal of A, inverted, times r.
+  void apply( const VectorXs& r, VectorXs& z ) const;
+
+  const Matrix2s& inverse( int i ) const { return m_inverses[i]; }
+
+private:
+  std::vector<Matrix2s> m_inverses;
+};
+
+// Solves A x = b by preconditioned conjugate gradient, from x = 0, until
+// |b - A x| <= tolerance |b|. Preconditioner needs apply( r, z ). Returns the
+// number of iterations taken.
+template<class Preconditioner>
+int solvePCG( const BlockSparseMatrix2& A, const Preconditioner& P, const VectorXs& b, VectorXs& x, scalar tolerance, int max_iterations )
+{
+  // Kept across calls, so that solves at an unchanged size allocate nothing.
+  static VectorXs r, z, p, Ap;
+
+  x.setZero( b.size() );
+  r = b;
+  const scalar bnorm = r.norm();
+  if( bnorm == 0.0 ) return 0;
+
+  P.apply(r,z);
+  p = z;
+  scalar rz = r.dot(z);
+
+  int itr = 0;
+  while( itr < max_iterations )
+  {
+    ++itr;
+    A.multiply(p,Ap);
+    const scalar pAp = p.dot(Ap);
+    if( pAp <= 0.0 ) break;
+    const scalar alpha = rz/pAp;
+    x += alpha*p;
+    r -= alpha*Ap;
+    if( r.norm() <= tolerance*bnorm ) break;
+    P.apply(r,z);
+    const scalar rznew = r.dot(z);
+    p = z + (rznew/rz)*p;
+    rz = rznew;
+  }
+  return itr;
+}
+
+#endif
@@ -19,5 +19,43 @@ void DragDampingForce::addHessVToTotal( const VectorXs& x, const VectorXs& v, co
   assert( x.size() == hessE.cols() );
   assert( x.size()%2 == 0 );
   
-  // Compute the force Jacobian here!
+  hessE.diagonal().array() += m_b;
+}
+
+void DragDampingForce::addHessXToTotal( const VectorXs& x, const VectorXs& v, const VectorXs& m, TripletXs& hessE )
+{
+  assert( x.size() == v.size() );
+  assert( x.size() == m.size() );
+  assert( x.size()%2 == 0 );
+
+  // Nothing to do.
+}
+
+void DragDampingForce::addHessVToTotal( const VectorXs& x, const VectorXs& v, const VectorXs& m, TripletXs& hessE )
+{
+  assert( x.size() == v.size() );
+  assert( x.size() == m.size() );
+  assert( x.size()%2 == 0 );
+
+  for( int i = 0; i < x.size(); ++i ) hessE.push_back( Triplet( i, i, m_b ) );
+}
+
+void DragDampingForce::addHessXVProductToTotal( const VectorXs& x, const VectorXs& v, const VectorXs& m, const VectorXs& dx, VectorXs& out )
+{
+  assert( x.size() == v.size() );
+  assert( x.size() == m.size() );
+  assert( x.size() == dx.size() );
+  assert( x.size() == out.size() );
+
+  // Nothing to do.
+}
+
+void DragDampingForce::addHessVVProductToTotal( const VectorXs& x, const VectorXs& v, const VectorXs& m, const VectorXs& dv, VectorXs& out )
+{
+  assert( x.size() == v.size() );
+  assert( x.size() == m.size() );
+  assert( x.size() == dv.size() );
+  assert( x.size() == out.size() );
+
+  out += m_b*dv;
 }
@@ -22,9 +22,21 @@ public:
   virtual void addHessXToTotal( const VectorXs& x, const VectorXs& v, const VectorXs& m, MatrixXs& hessE );
   
   virtual void addHessVToTotal( const VectorXs& x, const VectorXs& v, const VectorXs& m, MatrixXs& hessE );
+
+  // Triplet versions used by TwoDScene's sparse accumulators.
+  void addHessXToTotal( const VectorXs& x, const VectorXs& v, const VectorXs& m, TripletXs& hessE );
+
+  void addHessVToTotal( const VectorXs& x, const VectorXs& v, const VectorXs& m, TripletXs& hessE );
+
+  // Hessian-vector products, out += hessE*dx, without forming the Hessian.
+  void addHessXVProductToTotal( const VectorXs& x, const VectorXs& v, const VectorXs& m, const VectorXs& dx, VectorXs& out );
+
+  void addHessVVProductToTotal( const VectorXs& x, const VectorXs& v, const VectorXs& m, const VectorXs& dv, VectorXs& out );
   
   virtual Force* createNewCopy();
 
+  const scalar& getDamping() const { return m_b; }
+
 private:
   scalar m_b;
 };
@@ -0,0 +1,36 @@
+#include "EnergyMonitor.h"
+
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+
+EnergyMonitor::EnergyMonitor( const scalar& tolerance )
+: m_tolerance(tolerance)
+, m_initial(0.0)
+, m_scale(0.0)
+, m_drift(0.0)
+, m_steps(0)
+{
+  assert( tolerance > 0.0 );
+}
+
+bool EnergyMonitor::record( const scalar& kinetic, const scalar& potential )
+{
+  const scalar E = kinetic + potential;
+  if( m_steps++ == 0 )
+  {
+    m_initial = E;
+    m_scale = kinetic + std::fabs(potential);
+  }
+  // A scene at rest in no field has nothing to be relative to.
+  m_drift = m_scale > 0.0 ? std::fabs(E - m_initial)/m_scale : std::fabs(E - m_initial);
+  return m_drift <= m_tolerance;
+}
+
+void EnergyMonitor::watch( const TwoDScene& scene, const scalar& potential )
+{
+  if( record(scene.computeKineticEnergy(), potential) ) return;
+  std::cerr << "Total energy drifted by " << m_drift << " of its initial size " << m_scale << " by step " << m_steps
+            << ", over the tolerance of " << m_tolerance << "; stopping the run." << std::endl;
+  exit(1);
+}
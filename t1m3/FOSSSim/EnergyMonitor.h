@@ -0,0 +1,44 @@
+#ifndef __ENERGY_MONITOR_H__
+#define __ENERGY_MONITOR_H__
+
+#include "MathDefs.h"
+#include "TwoDScene.h"
+
+// Watches a scene's total energy from step to step, so that an integrator
+// going unstable on a production scene is caught rather than run to the end.
+// Explicit and symplectic Euler, built with ENERGY_DRIFT_TOLERANCE > 0, hand
+// it the energy at the start of each single step: the kinetic energy, one
+// pass over v and m, and the potential energy, which evaluateForces sums in
+// the same pass over the forces as the gradient the step needs. Watching
+// costs no extra pass over the forces, unlike computeTotalEnergy.
+//
+// The drift is |E - E0|/( T0 + |U0| ), the change in the total since the
+// first step over the size of that step's kinetic and potential parts, so it
+// does not depend on where the potential is zero. Drag takes energy out and
+// vortex forces define none, so only scenes of conservative forces should be
+// watched.
+class EnergyMonitor
+{
+public:
+  explicit EnergyMonitor( const scalar& tolerance );
+
+  // Records the energy at the start of a step. False once the drift exceeds
+  // the tolerance or the energy is no longer finite.
+  bool record( const scalar& kinetic, const scalar& potential );
+
+  // As record, with the kinetic energy of the scene, and ends the run,
+  // having said why, when record would return false.
+  void watch( const TwoDScene& scene, const scalar& potential );
+
+  scalar getDrift() const { return m_drift; }
+  int getNumSteps() const { return m_steps; }
+
+private:
+  scalar m_tolerance;
+  scalar m_initial;
+  scalar m_scale;
+  scalar m_drift;
+  int m_steps;
+};
+
+#endif
@@ -0,0 +1,94 @@
+#include "ExplicitEuler.h"
+
+#include "FixedDoFs.h"
+#include "StepKernels.h"
+#if defined(ENERGY_DRIFT_TOLERANCE)
+#include "EnergyMonitor.h"
+#endif
+#if defined(RK4)
+#include "RungeKutta4.h"
+#elif defined(ADAPTIVE_STEP_TOLERANCE)
+#include "AdaptiveStepper.h"
+#endif
+
+// Updates x += dt*v, then v += dt*a(x,v) with the old position and velocity.
+// Fixed particles neither move nor accelerate.
+//
+// Replaces the base library's stepper so that the scene's forces are batched,
+// as in SymplecticEuler, and so that it can step adaptively. Built with
+// USE_RK4 it steps by fourth order Runge-Kutta instead, as described in
+// RungeKutta4.h, and does not step adaptively. Built with
+// USE_EXPONENTIAL_DRAG, single steps integrate linear drag exactly, as
+// described in StepKernels.h; RK4 and adaptive steps keep it in the forces.
+// Built with ENERGY_DRIFT_TOLERANCE > 0, single steps sum the potential
+// energy with the gradient and stop the run once the total energy drifts by
+// more than that, as described in EnergyMonitor.h.
+
+// ExplicitEuler is constructed by the base library, so these cannot be
+// members.
+static FixedDoFs g_fixed;
+#if defined(RK4)
+static RungeKutta4 g_rk4;
+#elif defined(ADAPTIVE_STEP_TOLERANCE)
+static AdaptiveStepper g_adaptive(AdaptiveStepper::EXPLICIT_EULER, ADAPTIVE_STEP_TOLERANCE, ADAPTIVE_STEP_MIN_DT);
+#else
+// The step's workspace, reused so that steps at an unchanged size do not
+// allocate.
+static VectorXs g_gradu;
+#if defined(EXPONENTIAL_DRAG)
+static DragDecay g_drag;
+#endif
+#if defined(ENERGY_DRIFT_TOLERANCE)
+static EnergyMonitor g_energy(ENERGY_DRIFT_TOLERANCE);
+static TripletXs g_no_hessian;
+#endif
+#endif
+
+ExplicitEuler::ExplicitEuler()
+: SceneStepper()
+{}
+
+ExplicitEuler::~ExplicitEuler()
+{}
+
+bool ExplicitEuler::stepScene( TwoDScene& scene, scalar dt )
+{
+  VectorXs& x = scene.getX();
+  VectorXs& v = scene.getV();
+  const VectorXs& m = scene.getM();
+  assert(x.size() == v.size());
+  assert(x.size() == m.size());
+
+  scene.batchForces();
+  g_fixed.update(scene);
+
+#if defined(RK4)
+  g_rk4.advance(scene, g_fixed, dt);
+#elif defined(ADAPTIVE_STEP_TOLERANCE)
+  g_adaptive.advance(scene, g_fixed, dt);
+#else
+#if defined(EXPONENTIAL_DRAG)
+  g_drag.update(g_fixed, scene.excludeLinearDrag(), dt);
+#endif
+  g_gradu.setZero(x.size());
+#if defined(ENERGY_DRIFT_TOLERANCE)
+  scalar U = 0.0;
+  scene.evaluateForces(EVALUATE_ENERGY | EVALUATE_GRADIENT, U, g_gradu, g_no_hessian, g_no_hessian);
+  g_energy.watch(scene, U);
+#else
+  scene.accumulateGradUParallel(g_gradu);
+#endif
+#if defined(EXPONENTIAL_DRAG)
+  explicitEulerUpdate(g_fixed, g_gradu, g_drag, dt, x, v);
+#else
+  explicitEulerUpdate(g_fixed, g_gradu, dt, x, v);
+#endif
+#endif
+
+  return true;
+}
+
+std::string ExplicitEuler::getName() const
+{
+  return "Explicit Euler";
+}
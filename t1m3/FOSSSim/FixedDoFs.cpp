@@ -0,0 +1,156 @@
+#include "FixedDoFs.h"
+
+#include <cassert>
+
+FixedDoFs::FixedDoFs()
+: m_mask()
+, m_free()
+, m_fixed()
+, m_free_dofs()
+, m_reduced()
+, m_masses()
+, m_inverse_masses()
+{}
+
+FixedDoFs::FixedDoFs( const TwoDScene& scene )
+: m_mask()
+, m_free()
+, m_fixed()
+, m_free_dofs()
+, m_reduced()
+, m_masses()
+, m_inverse_masses()
+{
+  update(scene);
+}
+
+bool FixedDoFs::update( const TwoDScene& scene )
+{
+  const int n = scene.getNumParticles();
+  bool changed = int(m_mask.size()) != 2*n;
+  if( changed ) m_mask.assign(2*n,0xff);
+
+  for( int i = 0; i < n; ++i )
+  {
+    const unsigned char bits = scene.isFixed(i) ? 0x00 : 0xff;
+    if( m_mask[2*i] == bits ) continue;
+    m_mask[2*i] = m_mask[2*i+1] = bits;
+    changed = true;
+  }
+
+  if( changed ) rebuild();
+
+  const VectorXs& m = scene.getM();
+  assert( m.size() == 2*n );
+  if( changed || m_masses.size() != m.size() || m_masses != m )
+  {
+    m_masses = m;
+    m_inverse_masses.resize(2*n);
+    for( int dof = 0; dof < 2*n; ++dof ) m_inverse_masses(dof) = m_mask[dof] ? 1.0/m(dof) : 0.0;
+  }
+  return changed;
+}
+
+void FixedDoFs::rebuild()
+{
+  const int ndof = int(m_mask.size());
+  m_free.clear();
+  m_fixed.clear();
+  m_free_dofs.clear();
+  m_reduced.assign(ndof,-1);
+  for( int i = 0; 2*i < ndof; ++i )
+  {
+    if( m_mask[2*i] ) m_free.push_back(i);
+    else m_fixed.push_back(i);
+  }
+  for( int dof = 0; dof < ndof; ++dof )
+  {
+    if( !m_mask[dof] ) continue;
+    m_reduced[dof] = int(m_free_dofs.size());
+    m_free_dofs.push_back(dof);
+  }
+}
+
+int FixedDoFs::getNumParticles() const
+{
+  return int(m_mask.size())/2;
+}
+
+const std::vector<int>& FixedDoFs::getFreeParticles() const
+{
+  return m_free;
+}
+
+const std::vector<int>& FixedDoFs::getFixedParticles() const
+{
+  return m_fixed;
+}
+
+const std::vector<unsigned char>& FixedDoFs::getDoFMask() const
+{
+  return m_mask;
+}
+
+const VectorXs& FixedDoFs::getInverseMasses() const
+{
+  return m_inverse_masses;
+}
+
+void FixedDoFs::zeroFixed( VectorXs& q ) const
+{
+  for( std::vector<int>::size_type k = 0; k < m_fixed.size(); ++k ) q.segment<2>(2*m_fixed[k]).setZero();
+}
+
+int FixedDoFs::getNumFreeDoFs() const
+{
+  return int(m_free_dofs.size());
+}
+
+void FixedDoFs::gatherFree( const VectorXs& q, VectorXs& qf ) const
+{
+  if( m_fixed.empty() ) { qf = q; return; }
+  const int nf = getNumFreeDoFs();
+  qf.resize(nf);
+  for( int k = 0; k < nf; ++k ) qf(k) = q(m_free_dofs[k]);
+}
+
+void FixedDoFs::scatterFree( const VectorXs& qf, VectorXs& q ) const
+{
+  if( m_fixed.empty() ) { q = qf; return; }
+  const int nf = getNumFreeDoFs();
+  q.setZero(int(m_mask.size()));
+  for( int k = 0; k < nf; ++k ) q(m_free_dofs[k]) = qf(k);
+}
+
+void FixedDoFs::reduce( const SparseMatrixXs& A, SparseMatrixXs& Af ) const
+{
+  assert( A.isCompressed() );
+  if( m_fixed.empty() ) { Af = A; return; }
+
+  // The map is increasing, so each reduced column comes out sorted and can be
+  // appended in place.
+  const int nf = getNumFreeDoFs();
+  Af.resize(nf,nf);
+  Af.reserve(A.nonZeros());
+  for( int col = 0; col < nf; ++col )
+  {
+    Af.startVec(col);
+    for( SparseMatrixXs::InnerIterator it(A,m_free_dofs[col]); it; ++it )
+    {
+      const int row = m_reduced[it.row()];
+      if( row >= 0 ) Af.insertBack(row,col) = it.value();
+    }
+  }
+  Af.finalize();
+}
+
+void FixedDoFs::reduce( const MatrixXs& A, MatrixXs& Af ) const
+{
+  if( m_fixed.empty() ) { Af = A; return; }
+
+  const int nf = getNumFreeDoFs();
+  Af.resize(nf,nf);
+  for( int col = 0; col < nf; ++col )
+    for( int row = 0; row < nf; ++row )
+      Af(row,col) = A(m_free_dofs[row],m_free_dofs[col]);
+}
@@ -0,0 +1,78 @@
+#ifndef __FIXED_DOFS_H__
+#define __FIXED_DOFS_H__
+
+#include <vector>
+
+#include "MathDefs.h"
+#include "TwoDScene.h"
+
+// Snapshot of which particles of a scene are fixed, as a per-DoF byte mask and
+// as compact lists of free and fixed particle indices. TwoDScene is built into
+// the base library and keeps the flags in a std::vector<bool>; steppers update
+// one of these once per step and query it in their inner loops instead.
+//
+// It also keeps the inverse masses per DoF, zero for fixed DoFs, so that
+// explicit steppers multiply rather than divide and need no fixed test. They
+// are recomputed only when the masses or the fixed set change.
+//
+// It also maps the full system onto the free DoFs, so that implicit solves
+// can drop fixed DoFs rather than pin them with identity rows. The map is only
+// rebuilt when the fixed set changes.
+class FixedDoFs
+{
+public:
+  FixedDoFs();
+
+  explicit FixedDoFs( const TwoDScene& scene );
+
+  // Re-reads the scene's flags and masses. Returns true if the fixed set
+  // changed, so that callers can drop anything cached for the old set.
+  bool update( const TwoDScene& scene );
+
+  int getNumParticles() const;
+
+  const std::vector<int>& getFreeParticles() const;
+
+  const std::vector<int>& getFixedParticles() const;
+
+  // 0xff for each free DoF and 0 for each fixed one, usable directly as a
+  // blend mask.
+  const std::vector<unsigned char>& getDoFMask() const;
+
+  bool isFixedDoF( int dof ) const { return m_mask[dof] == 0; }
+
+  // 1/m for each free DoF and 0 for each fixed one.
+  const VectorXs& getInverseMasses() const;
+
+  // Zeros the entries of q belonging to fixed particles.
+  void zeroFixed( VectorXs& q ) const;
+
+  int getNumFreeDoFs() const;
+
+  // qf = the free entries of q, in order.
+  void gatherFree( const VectorXs& q, VectorXs& qf ) const;
+
+  // q = qf on the free DoFs and zero on the fixed ones.
+  void scatterFree( const VectorXs& qf, VectorXs& q ) const;
+
+  // Af = the rows and columns of A belonging to free DoFs. A must be
+  // compressed.
+  void reduce( const SparseMatrixXs& A, SparseMatrixXs& Af ) const;
+
+  void reduce( const MatrixXs& A, MatrixXs& Af ) const;
+
+private:
+  void rebuild();
+
+  std::vector<unsigned char> m_mask;
+  std::vector<int> m_free;
+  std::vector<int> m_fixed;
+  // Free DoF indices, and each DoF's index among them or -1 if fixed.
+  std::vector<int> m_free_dofs;
+  std::vector<int> m_reduced;
+  // The masses the inverse masses were computed from.
+  VectorXs m_masses;
+  VectorXs m_inverse_masses;
+};
+
+#endif
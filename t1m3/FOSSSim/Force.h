@@ -22,4 +22,24 @@ public:
   virtual Force* createNewCopy() = 0;
 };
 
+// What a fused force evaluation computes, combined with |. Force is compiled
+// into the base library and cannot grow a virtual for it; see
+// TwoDScene::evaluateForces and SpringForceBatch::evaluate.
+enum ForceEvaluation
+{
+  EVALUATE_ENERGY   = 1 << 0,
+  EVALUATE_GRADIENT = 1 << 1,
+  EVALUATE_HESSX    = 1 << 2,
+  EVALUATE_HESSV    = 1 << 3
+};
+
+// Halves of an implicit-explicit split of a scene's forces; see
+// TwoDScene::evaluateForceSplit. Springs are stiff and go implicit, and
+// gravity, drag and vortex forces, which limit dt far less, go explicit.
+enum ForceSplit
+{
+  IMPLICIT_FORCES,
+  EXPLICIT_FORCES
+};
+
 #endif
@@ -0,0 +1,120 @@
+#include "ForceArena.h"
+
+#include <cstdlib>
+#include <mutex>
+#include <new>
+#include <vector>
+
+namespace
+{
+
+// Objects start on cache lines, which also satisfies every Eigen alignment.
+const std::size_t ARENA_ALIGNMENT = 64;
+// Larger objects come straight from the heap; no force this tree defines
+// comes close, but a derived class may.
+const std::size_t LARGEST_POOLED = 1024;
+const std::size_t SLAB_BYTES = 1 << 16;
+const std::size_t NUM_SIZES = LARGEST_POOLED/ARENA_ALIGNMENT;
+
+void* alignedAllocate( std::size_t bytes )
+{
+  void* p = NULL;
+  if( posix_memalign(&p, ARENA_ALIGNMENT, bytes) != 0 ) throw std::bad_alloc();
+  return p;
+}
+
+#ifdef FORCE_ARENA
+// Slabs are never returned to the system: a run builds a scene's forces once
+// or a handful of times, and each size's free list takes back every object
+// freed for the next copy.
+struct Arena
+{
+  std::mutex mutex;
+  // Freed objects of each size, linked through their first bytes.
+  void* free[NUM_SIZES];
+  // The part of the latest slab not yet handed out.
+  char* next;
+  char* end;
+
+  Arena()
+  : next(NULL)
+  , end(NULL)
+  {
+    for( std::size_t s = 0; s < NUM_SIZES; ++s ) free[s] = NULL;
+  }
+};
+
+Arena& arena()
+{
+  static Arena* instance = new Arena;
+  return *instance;
+}
+
+std::size_t sizeClass( std::size_t bytes )
+{
+  return ( bytes + ARENA_ALIGNMENT - 1 )/ARENA_ALIGNMENT - 1;
+}
+#endif
+
+}
+
+namespace forcearena
+{
+
+void* allocate( std::size_t bytes )
+{
+#ifdef FORCE_ARENA
+  if( bytes == 0 || bytes > LARGEST_POOLED ) return alignedAllocate(bytes);
+  const std::size_t size = sizeClass(bytes);
+  Arena& a = arena();
+  std::lock_guard<std::mutex> lock(a.mutex);
+  if( void* p = a.free[size] )
+  {
+    a.free[size] = *static_cast<void**>(p);
+    return p;
+  }
+  const std::size_t rounded = ( size + 1 )*ARENA_ALIGNMENT;
+  if( a.next == NULL || (std::size_t) ( a.end - a.next ) < rounded )
+  {
+    a.next = static_cast<char*>(alignedAllocate(SLAB_BYTES));
+    a.end = a.next + SLAB_BYTES;
+  }
+  void* p = a.next;
+  a.next += rounded;
+  return p;
+#else
+  return alignedAllocate(bytes);
+#endif
+}
+
+void release( void* p, std::size_t bytes )
+{
+  if( p == NULL ) return;
+#ifdef FORCE_ARENA
+  if( bytes == 0 || bytes > LARGEST_POOLED )
+  {
+    std::free(p);
+    return;
+  }
+  const std::size_t size = sizeClass(bytes);
+  Arena& a = arena();
+  std::lock_guard<std::mutex> lock(a.mutex);
+  *static_cast<void**>(p) = a.free[size];
+  a.free[size] = p;
+#else
+  (void) bytes;
+  std::free(p);
+#endif
+}
+
+}
+
+void* PooledForce::operator new( std::size_t bytes )
+{
+  return forcearena::allocate(bytes);
+}
+
+void PooledForce::operator delete( void* p, std::size_t bytes )
+{
+  forcearena::release(p, bytes);
+}
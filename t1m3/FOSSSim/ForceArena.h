@@ -0,0 +1,40 @@
+#ifndef __FORCE_ARENA_H__
+#define __FORCE_ARENA_H__
+
+#include <cstddef>
+
+#include "Force.h"
+
+// A Force whose objects are allocated from the force arena, built with
+// USE_FORCE_ARENA. TwoDScene's copy constructor and destructor and the XML
+// parser are compiled into the base library, which news every force it
+// builds and deletes every force the scene holds, one at a time; those
+// allocations cannot be changed, and the parser's one SpringForce per spring
+// stays a heap object until batchForces folds it into a SpringForceBatch.
+// The forces this tree defines are created, and copied through
+// createNewCopy, here, and their deleting destructors are compiled here too,
+// so they can take their memory from anywhere as long as new and delete
+// agree. Deriving from PooledForce instead of Force makes both go through
+// the arena, which carves objects of a size out of large slabs and hands
+// freed ones straight back out: copying a scene of a few hundred batches
+// allocates them next to each other rather than wherever the heap has room,
+// and destroying it returns each to a free list. Every object starts on a
+// cache line of its own, so batches accumulated on different threads never
+// share one, and is aligned for any fixed-size Eigen member.
+class PooledForce : public Force
+{
+public:
+  static void* operator new( std::size_t bytes );
+  static void operator delete( void* p, std::size_t bytes );
+};
+
+namespace forcearena
+{
+  // Memory for an object of bytes, aligned to a cache line.
+  void* allocate( std::size_t bytes );
+
+  // Returns p, allocated for bytes, to the arena.
+  void release( void* p, std::size_t bytes );
+}
+
+#endif
@@ -0,0 +1,220 @@
+#ifndef __FORCE_BATCH_H__
+#define __FORCE_BATCH_H__
+
+#include <Eigen/Core>
+#include <vector>
+#include "ForceArena.h"
+#include "SparseUtilities.h"
+
+// Evaluates many instances of one two-particle force type as a single Force.
+// Derived holds the per-pair kernel and derives from ForceBatch<Derived,Pair>;
+// the loops below reach the kernel through a static_cast, not a virtual call,
+// so each force type gets its own loop with the kernel inlined into it. Pair
+// holds the particle indices first and second and the force's parameters.
+// The kernel works on the raw 2D coordinates and provides
+//
+//   void addPairEnergy( const Pair& p, const scalar* x, const scalar* v, const scalar* m, scalar& E ) const;
+//   void addPairGradE( const Pair& p, const scalar* x, const scalar* v, const scalar* m, scalar* gradE ) const;
+//   Matrix2s pairHessX( const Pair& p, const scalar* x, const scalar* v, const scalar* m ) const;
+//   Matrix2s pairHessV( const Pair& p, const scalar* x, const scalar* v, const scalar* m ) const;
+//   enum { HAS_HESSV = 0 or 1 };
+//
+// where the Hessians are the 2x2 blocks B of the [ B -B; -B B ] stencils.
+// Without HAS_HESSV pairHessV is never called.
+template<class Derived, class Pair>
+class ForceBatch : public PooledForce
+{
+public:
+
+  virtual ~ForceBatch();
+
+  void addPair( const Pair& pair );
+
+  int getNumPairs() const;
+
+  virtual void addEnergyToTotal( const VectorXs& x, const VectorXs& v, const VectorXs& m, scalar& E );
+
+  virtual void addGradEToTotal( const VectorXs& x, const VectorXs& v, const VectorXs& m, VectorXs& gradE );
+
+  // Both of the above in one loop over the pairs, with the two kernels
+  // inlined side by side so that each pair's distance is computed once.
+  void addEnergyAndGradEToTotal( const VectorXs& x, const VectorXs& v, const VectorXs& m, scalar& E, VectorXs& gradE );
+
+  virtual void addHessXToTotal( const VectorXs& x, const VectorXs& v, const VectorXs& m, MatrixXs& hessE );
+
+  virtual void addHessVToTotal( const VectorXs& x, const VectorXs& v, const VectorXs& m, MatrixXs& hessE );
+
+  // Triplet versions used by TwoDScene's sparse accumulators.
+  void addHessXToTotal( const VectorXs& x, const VectorXs& v, const VectorXs& m, TripletXs& hessE );
+
+  void addHessVToTotal( const VectorXs& x, const VectorXs& v, const VectorXs& m, TripletXs& hessE );
+
+  // Hessian-vector products, out += hessE*dx, without forming the Hessian.
+  void addHessXVProductToTotal( const VectorXs& x, const VectorXs& v, const VectorXs& m, const VectorXs& dx, VectorXs& out );
+
+  void addHessVVProductToTotal( const VectorXs& x, const VectorXs& v, const VectorXs& m, const VectorXs& dv, VectorXs& out );
+
+  virtual Force* createNewCopy();
+
+protected:
+
+  const Derived& kernel() const { return static_cast<const Derived&>(*this); }
+
+  std::vector<Pair> m_pairs;
+};
+
+template<class Derived, class Pair>
+ForceBatch<Derived,Pair>::~ForceBatch()
+{}
+
+template<class Derived, class Pair>
+void ForceBatch<Derived,Pair>::addPair( const Pair& pair )
+{
+  assert( pair.first >= 0 );
+  assert( pair.second >= 0 );
+  assert( pair.first != pair.second );
+  m_pairs.push_back(pair);
+}
+
+template<class Derived, class Pair>
+int ForceBatch<Derived,Pair>::getNumPairs() const
+{
+  return (int) m_pairs.size();
+}
+
+template<class Derived, class Pair>
+void ForceBatch<Derived,Pair>::addEnergyToTotal( const VectorXs& x, const VectorXs& v, const VectorXs& m, scalar& E )
+{
+  assert( x.size() == v.size() );
+  assert( x.size() == m.size() );
+  assert( x.size()%2 == 0 );
+
+  const Derived& k = kernel();
+  const int npairs = getNumPairs();
+  for( int p = 0; p < npairs; ++p ) k.addPairEnergy( m_pairs[p], x.data(), v.data(), m.data(), E );
+}
+
+template<class Derived, class Pair>
+void ForceBatch<Derived,Pair>::addGradEToTotal( const VectorXs& x, const VectorXs& v, const VectorXs& m, VectorXs& gradE )
+{
+  assert( x.size() == v.size() );
+  assert( x.size() == m.size() );
+  assert( x.size() == gradE.size() );
+  assert( x.size()%2 == 0 );
+
+  const Derived& k = kernel();
+  const scalar* xp = x.data();
+  const scalar* vp = v.data();
+  const scalar* mp = m.data();
+  scalar* gp = gradE.data();
+  const int npairs = getNumPairs();
+  for( int p = 0; p < npairs; ++p ) k.addPairGradE( m_pairs[p], xp, vp, mp, gp );
+}
+
+template<class Derived, class Pair>
+void ForceBatch<Derived,Pair>::addEnergyAndGradEToTotal( const VectorXs& x, const VectorXs& v, const VectorXs& m, scalar& E, VectorXs& gradE )
+{
+  assert( x.size() == v.size() );
+  assert( x.size() == m.size() );
+  assert( x.size() == gradE.size() );
+  assert( x.size()%2 == 0 );
+
+  const Derived& k = kernel();
+  const scalar* xp = x.data();
+  const scalar* vp = v.data();
+  const scalar* mp = m.data();
+  scalar* gp = gradE.data();
+  const int npairs = getNumPairs();
+  for( int p = 0; p < npairs; ++p )
+  {
+    k.addPairEnergy( m_pairs[p], xp, vp, mp, E );
+    k.addPairGradE( m_pairs[p], xp, vp, mp, gp );
+  }
+}
+
+template<class Derived, class Pair>
+void ForceBatch<Derived,Pair>::addHessXToTotal( const VectorXs& x, const VectorXs& v, const VectorXs& m, MatrixXs& hessE )
+{
+  assert( x.size() == v.size() );
+  assert( x.size() == m.size() );
+  assert( x.size() == hessE.rows() );
+  assert( x.size() == hessE.cols() );
+
+  const Derived& k = kernel();
+  for( int p = 0; p < getNumPairs(); ++p )
+    sparseutils::addPairBlocks( m_pairs[p].first, m_pairs[p].second, k.pairHessX( m_pairs[p], x.data(), v.data(), m.data() ), hessE );
+}
+
+template<class Derived, class Pair>
+void ForceBatch<Derived,Pair>::addHessVToTotal( const VectorXs& x, const VectorXs& v, const VectorXs& m, MatrixXs& hessE )
+{
+  assert( x.size() == v.size() );
+  assert( x.size() == m.size() );
+  assert( x.size() == hessE.rows() );
+  assert( x.size() == hessE.cols() );
+
+  if( !Derived::HAS_HESSV ) return;
+  const Derived& k = kernel();
+  for( int p = 0; p < getNumPairs(); ++p )
+    sparseutils::addPairBlocks( m_pairs[p].first, m_pairs[p].second, k.pairHessV( m_pairs[p], x.data(), v.data(), m.data() ), hessE );
+}
+
+template<class Derived, class Pair>
+void ForceBatch<Derived,Pair>::addHessXToTotal( const VectorXs& x, const VectorXs& v, const VectorXs& m, TripletXs& hessE )
+{
+  assert( x.size() == v.size() );
+  assert( x.size() == m.size() );
+
+  const Derived& k = kernel();
+  hessE.reserve( hessE.size() + 16*getNumPairs() );
+  for( int p = 0; p < getNumPairs(); ++p )
+    sparseutils::addPairBlocks( m_pairs[p].first, m_pairs[p].second, k.pairHessX( m_pairs[p], x.data(), v.data(), m.data() ), hessE );
+}
+
+template<class Derived, class Pair>
+void ForceBatch<Derived,Pair>::addHessVToTotal( const VectorXs& x, const VectorXs& v, const VectorXs& m, TripletXs& hessE )
+{
+  assert( x.size() == v.size() );
+  assert( x.size() == m.size() );
+
+  if( !Derived::HAS_HESSV ) return;
+  const Derived& k = kernel();
+  hessE.reserve( hessE.size() + 16*getNumPairs() );
+  for( int p = 0; p < getNumPairs(); ++p )
+    sparseutils::addPairBlocks( m_pairs[p].first, m_pairs[p].second, k.pairHessV( m_pairs[p], x.data(), v.data(), m.data() ), hessE );
+}
+
+template<class Derived, class Pair>
+void ForceBatch<Derived,Pair>::addHessXVProductToTotal( const VectorXs& x, const VectorXs& v, const VectorXs& m, const VectorXs& dx, VectorXs& out )
+{
+  assert( x.size() == v.size() );
+  assert( x.size() == m.size() );
+  assert( x.size() == dx.size() );
+  assert( x.size() == out.size() );
+
+  const Derived& k = kernel();
+  for( int p = 0; p < getNumPairs(); ++p )
+    sparseutils::addPairProduct( m_pairs[p].first, m_pairs[p].second, k.pairHessX( m_pairs[p], x.data(), v.data(), m.data() ), dx, out );
+}
+
+template<class Derived, class Pair>
+void ForceBatch<Derived,Pair>::addHessVVProductToTotal( const VectorXs& x, const VectorXs& v, const VectorXs& m, const VectorXs& dv, VectorXs& out )
+{
+  assert( x.size() == v.size() );
+  assert( x.size() == m.size() );
+  assert( x.size() == dv.size() );
+  assert( x.size() == out.size() );
+
+  if( !Derived::HAS_HESSV ) return;
+  const Derived& k = kernel();
+  for( int p = 0; p < getNumPairs(); ++p )
+    sparseutils::addPairProduct( m_pairs[p].first, m_pairs[p].second, k.pairHessV( m_pairs[p], x.data(), v.data(), m.data() ), dv, out );
+}
+
+template<class Derived, class Pair>
+Force* ForceBatch<Derived,Pair>::createNewCopy()
+{
+  return new Derived( kernel() );
+}
+
+#endif
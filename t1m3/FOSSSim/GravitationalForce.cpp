@@ -1,4 +1,16 @@
 #include "GravitationalForce.h"
+#include "SparseUtilities.h"
+
+static Matrix2s gravitationalHessXBlock( const VectorXs& x, const VectorXs& m, const std::pair<int,int>& particles, const scalar& G )
+{
+  Vector2s nhat = x.segment<2>(2*particles.second) - x.segment<2>(2*particles.first);
+  scalar l = nhat.norm();
+  assert( l != 0.0 );
+  nhat /= l;
+
+  scalar c = G*m(2*particles.first)*m(2*particles.second)/(l*l*l);
+  return c*( Matrix2s::Identity() - 3.0*nhat*nhat.transpose() );
+}
 
 void GravitationalForce::addHessXToTotal( const VectorXs& x, const VectorXs& v, const VectorXs& m, MatrixXs& hessE )
 {
@@ -7,8 +19,10 @@ void GravitationalForce::addHessXToTotal( const VectorXs& x, const VectorXs& v,
   assert( x.size() == hessE.rows() );
   assert( x.size() == hessE.cols() );
   assert( x.size()%2 == 0 );
+  assert( m_particles.first >= 0 );  assert( m_particles.first < x.size()/2 );
+  assert( m_particles.second >= 0 ); assert( m_particles.second < x.size()/2 );
 
-  // Compute the force Jacobian here!
+  sparseutils::addPairBlocks( m_particles.first, m_particles.second, gravitationalHessXBlock( x, m, m_particles, m_G ), hessE );
 }
 
 void GravitationalForce::addHessVToTotal( const VectorXs& x, const VectorXs& v, const VectorXs& m, MatrixXs& hessE )
@@ -21,3 +35,45 @@ void GravitationalForce::addHessVToTotal( const VectorXs& x, const VectorXs& v,
     
   // Nothing to do.
 }
+
+void GravitationalForce::addHessXToTotal( const VectorXs& x, const VectorXs& v, const VectorXs& m, TripletXs& hessE )
+{
+  assert( x.size() == v.size() );
+  assert( x.size() == m.size() );
+  assert( x.size()%2 == 0 );
+  assert( m_particles.first >= 0 );  assert( m_particles.first < x.size()/2 );
+  assert( m_particles.second >= 0 ); assert( m_particles.second < x.size()/2 );
+
+  sparseutils::addPairBlocks( m_particles.first, m_particles.second, gravitationalHessXBlock( x, m, m_particles, m_G ), hessE );
+}
+
+void GravitationalForce::addHessVToTotal( const VectorXs& x, const VectorXs& v, const VectorXs& m, TripletXs& hessE )
+{
+  assert( x.size() == v.size() );
+  assert( x.size() == m.size() );
+  assert( x.size()%2 == 0 );
+
+  // Nothing to do.
+}
+
+void GravitationalForce::addHessXVProductToTotal( const VectorXs& x, const VectorXs& v, const VectorXs& m, const VectorXs& dx, VectorXs& out )
+{
+  assert( x.size() == v.size() );
+  assert( x.size() == m.size() );
+  assert( x.size() == dx.size() );
+  assert( x.size() == out.size() );
+  assert( m_particles.first >= 0 );  assert( m_particles.first < x.size()/2 );
+  assert( m_particles.second >= 0 ); assert( m_particles.second < x.size()/2 );
+
+  sparseutils::addPairProduct( m_particles.first, m_particles.second, gravitationalHessXBlock( x, m, m_particles, m_G ), dx, out );
+}
+
+void GravitationalForce::addHessVVProductToTotal( const VectorXs& x, const VectorXs& v, const VectorXs& m, const VectorXs& dv, VectorXs& out )
+{
+  assert( x.size() == v.size() );
+  assert( x.size() == m.size() );
+  assert( x.size() == dv.size() );
+  assert( x.size() == out.size() );
+
+  // Nothing to do.
+}
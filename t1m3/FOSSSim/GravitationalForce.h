@@ -21,8 +21,21 @@ public:
 
   virtual void addHessVToTotal( const VectorXs& x, const VectorXs& v, const VectorXs& m, MatrixXs& hessE );
 
+  // Triplet versions used by TwoDScene's sparse accumulators.
+  void addHessXToTotal( const VectorXs& x, const VectorXs& v, const VectorXs& m, TripletXs& hessE );
+
+  void addHessVToTotal( const VectorXs& x, const VectorXs& v, const VectorXs& m, TripletXs& hessE );
+
+  // Hessian-vector products, out += hessE*dx, without forming the Hessian.
+  void addHessXVProductToTotal( const VectorXs& x, const VectorXs& v, const VectorXs& m, const VectorXs& dx, VectorXs& out );
+
+  void addHessVVProductToTotal( const VectorXs& x, const VectorXs& v, const VectorXs& m, const VectorXs& dv, VectorXs& out );
+
   virtual Force* createNewCopy();
 
+  const std::pair<int,int>& getParticles() const { return m_particles; }
+  const scalar& getG() const { return m_G; }
+
 private:
   std::pair<int,int> m_particles;
   // Gravitational constant
@@ -0,0 +1,10 @@
+#include "GravitationalForceBatch.h"
+
+void GravitationalForceBatch::addForce( const GravitationalForce& force )
+{
+  GravitationalPair pair;
+  pair.first = force.getParticles().first;
+  pair.second = force.getParticles().second;
+  pair.G = force.getG();
+  addPair(pair);
+}
@@ -0,0 +1,84 @@
+#ifndef __GRAVITATIONAL_FORCE_BATCH_H__
+#define __GRAVITATIONAL_FORCE_BATCH_H__
+
+#include <Eigen/Core>
+#include <cmath>
+#include "ForceBatch.h"
+#include "GravitationalForce.h"
+
+struct GravitationalPair
+{
+  int first;
+  int second;
+  scalar G;
+};
+
+// Many GravitationalForces as one force; see ForceBatch.
+class GravitationalForceBatch : public ForceBatch<GravitationalForceBatch,GravitationalPair>
+{
+public:
+
+  enum { HAS_HESSV = 0 };
+
+  void addForce( const GravitationalForce& force );
+
+  // The ForceBatch kernel.
+  void addPairEnergy( const GravitationalPair& p, const scalar* x, const scalar* v, const scalar* m, scalar& E ) const;
+
+  void addPairGradE( const GravitationalPair& p, const scalar* x, const scalar* v, const scalar* m, scalar* gradE ) const;
+
+  Matrix2s pairHessX( const GravitationalPair& p, const scalar* x, const scalar* v, const scalar* m ) const;
+
+  Matrix2s pairHessV( const GravitationalPair& p, const scalar* x, const scalar* v, const scalar* m ) const;
+};
+
+// The kernels round exactly as GravitationalForce does.
+
+inline void GravitationalForceBatch::addPairEnergy( const GravitationalPair& p, const scalar* x, const scalar* v, const scalar* m, scalar& E ) const
+{
+  const int i = 2*p.first;
+  const int j = 2*p.second;
+  const scalar rx = x[j] - x[i];
+  const scalar ry = x[j+1] - x[i+1];
+  const scalar l = std::sqrt( rx*rx + ry*ry );
+  assert( l != 0.0 );
+  E += -p.G*m[j]*m[i]/l;
+}
+
+inline void GravitationalForceBatch::addPairGradE( const GravitationalPair& p, const scalar* x, const scalar* v, const scalar* m, scalar* gradE ) const
+{
+  const int i = 2*p.first;
+  const int j = 2*p.second;
+  const scalar rx = x[j] - x[i];
+  const scalar ry = x[j+1] - x[i+1];
+  const scalar l = std::sqrt( rx*rx + ry*ry );
+  assert( l != 0.0 );
+  const scalar il = 1.0/l;
+  const scalar c = p.G*m[j]*m[i]/( l*l );
+  const scalar gx = ( rx*il )*c;
+  const scalar gy = ( ry*il )*c;
+  gradE[i]   -= gx;
+  gradE[i+1] -= gy;
+  gradE[j]   += gx;
+  gradE[j+1] += gy;
+}
+
+inline Matrix2s GravitationalForceBatch::pairHessX( const GravitationalPair& p, const scalar* x, const scalar* v, const scalar* m ) const
+{
+  const int i = 2*p.first;
+  const int j = 2*p.second;
+  Vector2s nhat( x[j] - x[i], x[j+1] - x[i+1] );
+  scalar l = nhat.norm();
+  assert( l != 0.0 );
+  nhat /= l;
+
+  scalar c = p.G*m[i]*m[j]/(l*l*l);
+  return c*( Matrix2s::Identity() - 3.0*nhat*nhat.transpose() );
+}
+
+inline Matrix2s GravitationalForceBatch::pairHessV( const GravitationalPair& p, const scalar* x, const scalar* v, const scalar* m ) const
+{
+  return Matrix2s::Zero();
+}
+
+#endif
@@ -1,5 +1,127 @@
 #include "ImplicitEuler.h"
 
+#include "SparseSystemSolver.h"
+#include "BlockSparseMatrix.h"
+#include "MultigridPreconditioner.h"
+
+#include <algorithm>
+
+// Fully implicit Euler. Newton's method solves
+//   G(dv) = M dv + dt gradU( x + dt (v + dv), v + dv ) = 0
+// for the velocity update, with Jacobian
+//   J = M + dt^2 d2U/dx2 + dt d2U/dxdv.
+//
+// Small systems factor J sparsely and reuse the factorization as a chord
+// method, across iterations and across steps, until convergence stalls.
+// Large systems assemble J in 2x2 block form (BlockSparseMatrix2) and solve
+// each Newton system by block-Jacobi-preconditioned conjugate gradient, so a
+// CG iteration is one block product rather than a pass over the forces.
+// Defining MULTIGRID_PCG (CMake option USE_MULTIGRID_PCG) preconditions with
+// a multigrid V-cycle instead, which keeps the iteration counts of long
+// spring networks at large dt from growing with the network.
+// Either way each update is globalized by a backtracking line search on |G|,
+// and the system covers free DoFs only.
+
+namespace
+{
+
+// Solver controls. The scene XML is parsed by the base library, which has no
+// hook for new integrator attributes, so these are fixed here.
+const scalar NEWTON_TOLERANCE = 1.0e-12;
+const int    NEWTON_MAX_ITERATIONS = 50;
+// Refactor once a chord iteration reduces |G| by less than this factor.
+const scalar CHORD_STALL_RATIO = 0.5;
+const int    LINE_SEARCH_MAX_ITERATIONS = 10;
+const scalar LINE_SEARCH_SUFFICIENT_DECREASE = 1.0e-4;
+// Systems with more DoFs than this use PCG.
+const int    DIRECT_SOLVER_MAX_DOFS = 20000;
+const scalar CG_TOLERANCE = 1.0e-10;
+const int    CG_MAX_ITERATIONS = 1000;
+
+// ImplicitEuler is constructed by the base library, so per-stepper state
+// cannot be a member. g_previous_dv warm starts Newton from the last step's
+// velocity update; g_chord_solver holds the reused Jacobian factorization.
+// g_fixed is the fixed set of the current step.
+VectorXs g_previous_dv;
+SparseSystemSolver g_chord_solver;
+bool g_chord_factored = false;
+FixedDoFs g_fixed;
+
+// The step's vectors, reused so that steps at an unchanged size allocate
+// nothing outside the sparse assembly and factorization.
+struct Workspace
+{
+  // Newton
+  VectorXs dv;
+  VectorXs G;
+  VectorXs rhs;
+  VectorXs delta;
+  VectorXs trial;
+  VectorXs Gtrial;
+  VectorXs Gf;
+  VectorXs deltaf;
+  // Residual and PCG
+  VectorXs dx;
+  VectorXs pcgdx;
+  VectorXs bf;
+  VectorXs slnf;
+  TripletXs hessX;
+  TripletXs hessV;
+  BlockSparseMatrix2 Jb;
+#ifdef MULTIGRID_PCG
+  MultigridPreconditioner preconditioner;
+#else
+  BlockJacobiPreconditioner preconditioner;
+#endif
+  SparseMatrixXs J;
+};
+Workspace g_work;
+
+void computeResidual( TwoDScene& scene, scalar dt, const VectorXs& dv, VectorXs& G )
+{
+  const VectorXs& v = scene.getV();
+  const VectorXs& m = scene.getM();
+
+  // Note that the system's state is passed to two d scene as a change from the last timestep's solution
+  VectorXs& dx = g_work.dx;
+  dx = dt*(v+dv);
+  G.setZero(v.size());
+  scene.accumulateGradUParallel(G,dx,dv);
+  G = m.cwiseProduct(dv) + dt*G;
+  g_fixed.zeroFixed(G);
+}
+
+// Solves J sln = b by preconditioned CG on free DoFs.
+void solvePCG( TwoDScene& scene, scalar dt, const VectorXs& dv, const VectorXs& b, VectorXs& sln )
+{
+  VectorXs& dx = g_work.pcgdx;
+  dx = dt*(scene.getV()+dv);
+
+  scalar E = 0.0;
+  VectorXs gradE;
+  g_work.hessX.clear();
+  g_work.hessV.clear();
+  scene.evaluateForces( EVALUATE_HESSX | EVALUATE_HESSV, E, gradE, g_work.hessX, g_work.hessV, dx, dv );
+  BlockSparseMatrix2& J = g_work.Jb;
+  J.assemble( scene.getM(), g_fixed, dt*dt, g_work.hessX, dt, g_work.hessV );
+  g_work.preconditioner.compute(J);
+
+  g_fixed.gatherFree(b,g_work.bf);
+  ::solvePCG( J, g_work.preconditioner, g_work.bf, g_work.slnf, CG_TOLERANCE, CG_MAX_ITERATIONS );
+  g_fixed.scatterFree(g_work.slnf,sln);
+}
+
+bool factorChord( TwoDScene& scene, scalar dt, const VectorXs& dv )
+{
+  SparseMatrixXs& J = g_work.J;
+  g_work.dx = dt*(scene.getV()+dv);
+  assembleImplicitSystem(scene,g_fixed,dt,g_work.dx,dv,J);
+  g_chord_factored = g_chord_solver.factorize(J);
+  return g_chord_factored;
+}
+
+}
+
 bool ImplicitEuler::stepScene( TwoDScene& scene, scalar dt )
 {
   VectorXs& x = scene.getX();
@@ -8,53 +130,93 @@ bool ImplicitEuler::stepScene( TwoDScene& scene, scalar dt )
   assert(x.size() == v.size());
   assert(x.size() == m.size());
 
-  // Implement implicit Euler here for extra credit!
-
-  
-  
-  /////////////
-  // Some examples of working with vectors, matrices, etc.
-  
-  // How to get the force Jacobian from two d scene
   int ndof = x.size();
   assert( ndof%2 == 0 );
-  // Note that the system's state is passed to two d scene as a change from the last timestep's solution
-  VectorXs dx = dt*v;
-  VectorXs dv = VectorXs::Zero(ndof);
-  MatrixXs A = MatrixXs::Zero(ndof,ndof);
-  scene.accumulateddUdxdx(A,dx,dv);
-  scene.accumulateddUdxdv(A,dx,dv);
-
-  // Some useful vector operations
-  Vector2s egvec(1.0,0.0);
-  // Outer product
-  Matrix2s egmat = egvec*egvec.transpose();
-
-  // Manipulating blocks of matrix
-  MatrixXs egmat2(20,20);
-  // 2x2 block that begins at position 3,4
-  egmat2.block(3,4,2,2) += egmat;
-
-  // Add a vector to a matrix's diagonal
-  VectorXs egvec2(20);
-  egvec2.setConstant(2.0);
-  egmat2.diagonal() += egvec;
-
-  // Invert a 10 x 10 matrix
-  MatrixXs B(10,10);
-  // Fill the matrix with random numbers
-  B.setRandom();
-  // Create a vector of length 10
-  VectorXs b(10);
-  // Fill the vector with random numbers
-  b.setRandom();
-  // Compute the solution to A*x = b
-  VectorXs sln = B.fullPivLu().solve(b);
-  // Verify that we computed the solution
-  //std::cout << (B*sln-b).norm() << std::endl;  
-
-  // End of example code.
-  /////////////
-  
+
+  scene.batchForces();
+  if( g_fixed.update(scene) ) g_chord_factored = false;
+
+  const bool direct = g_fixed.getNumFreeDoFs() <= DIRECT_SOLVER_MAX_DOFS;
+  if( g_previous_dv.size() != ndof ) g_chord_factored = false;
+
+  VectorXs& dv = g_work.dv;
+  if( g_previous_dv.size() == ndof ) dv = g_previous_dv;
+  else dv.setZero(ndof);
+  g_fixed.zeroFixed(dv);
+
+  VectorXs& G = g_work.G;
+  computeResidual(scene,dt,dv,G);
+  scalar Gnorm = G.norm();
+
+  bool converged = false;
+  // True if the chord factorization was computed at the current iterate.
+  bool fresh = false;
+  for( int itr = 0; itr < NEWTON_MAX_ITERATIONS && !converged; ++itr )
+  {
+    if( Gnorm == 0.0 ) { converged = true; break; }
+
+    VectorXs& delta = g_work.delta;
+    if( direct )
+    {
+      if( !g_chord_factored )
+      {
+        if( !factorChord(scene,dt,dv) )
+        {
+          std::cerr << "\033[31;1mERROR IN IMPLICITEULER:\033[m Sparse factorization failed." << std::endl;
+          return false;
+        }
+        fresh = true;
+      }
+      g_fixed.gatherFree(G,g_work.Gf);
+      g_work.Gf *= -1.0;
+      g_chord_solver.solve(g_work.Gf,g_work.deltaf);
+      g_fixed.scatterFree(g_work.deltaf,delta);
+    }
+    else
+    {
+      g_work.rhs = -G;
+      solvePCG(scene,dt,dv,g_work.rhs,delta);
+      fresh = true;
+    }
+
+    // Backtracking line search on the residual norm. The total energy is not
+    // a valid merit function here: damping forces are not conservative and
+    // DragDampingForce defines no energy at all.
+    scalar alpha = 1.0;
+    VectorXs& trial = g_work.trial;
+    VectorXs& Gtrial = g_work.Gtrial;
+    bool accepted = false;
+    for( int ls = 0; ls < LINE_SEARCH_MAX_ITERATIONS; ++ls, alpha *= 0.5 )
+    {
+      trial = dv + alpha*delta;
+      computeResidual(scene,dt,trial,Gtrial);
+      if( Gtrial.norm() <= ( 1.0 - LINE_SEARCH_SUFFICIENT_DECREASE*alpha )*Gnorm ) { accepted = true; break; }
+    }
+
+    // A stale Jacobian that yields no descent is refreshed before giving up
+    // on the full line search.
+    if( !accepted && direct && !fresh ) { g_chord_factored = false; continue; }
+
+    scalar ratio = Gtrial.norm()/Gnorm;
+    dv.swap(trial);
+    G.swap(Gtrial);
+    Gnorm = G.norm();
+    fresh = false;
+
+    // Converged once the remaining error is negligible relative to dv. Chord
+    // iterations converge only linearly, so the step underestimates the error
+    // by the contraction factor ratio/(1-ratio).
+    scalar error = alpha*delta.norm();
+    if( ratio < 1.0 ) error = std::max( error, error*ratio/(1.0-ratio) );
+    if( error <= NEWTON_TOLERANCE*( 1.0 + dv.norm() ) ) converged = true;
+    else if( direct && ratio > CHORD_STALL_RATIO ) g_chord_factored = false;
+  }
+
+  if( !converged ) std::cerr << "\033[31;1mWARNING IN IMPLICITEULER:\033[m Newton solve did not converge." << std::endl;
+
+  g_previous_dv = dv;
+  v += dv;
+  x += dt*v;
+
   return true;
 }
@@ -1,5 +1,119 @@
 #include "LinearizedImplicitEuler.h"
 
+#include "SparseSystemSolver.h"
+#include "MultigridPreconditioner.h"
+
+// Solves ( M + dt^2 d2U/dx2 + dt d2U/dxdv ) dv = -dt gradU, with all
+// derivatives evaluated at ( x + dt v, v ), then updates v += dv, x += dt v.
+// The system is built over free degrees of freedom only; fixed ones get a
+// zero dv, so they keep their velocity.
+//
+// The default backend assembles the system sparsely and factors it with
+// SimplicialLDLT, in float with refinement to double accuracy when
+// MIXED_PRECISION_LDLT (CMake option USE_MIXED_PRECISION_LDLT) is defined; see
+// SparseSystemSolver. Defining DENSE_LU_SOLVER (CMake option
+// USE_DENSE_LU_SOLVER) selects the original dense LU path instead, for scenes
+// of up to DENSE_LU_MAX_DOFS DoFs; its ndof x ndof matrix and O(n^3) LU would
+// take minutes a step on larger ones, so they go to the sparse backend, with
+// a note on stderr. Defining MULTIGRID_PCG (CMake
+// option USE_MULTIGRID_PCG) solves systems with more than
+// DIRECT_SOLVER_MAX_DOFS free DoFs by multigrid-preconditioned CG on the
+// block form of the system instead of factoring them.
+//
+// Defining IMEX_SPLIT (CMake option USE_IMEX_SPLIT) steps implicitly in the
+// springs only, the implicit half of a ForceSplit, and explicitly in the
+// rest: the explicit forces are evaluated once at ( x, v ) and join the
+// right-hand side, and the system is assembled and solved over the free DoFs
+// some spring touches. Every other free DoF takes dv = -dt gradU/m, as in
+// symplectic Euler, so free-flying particles cost no solve at all. Scenes
+// whose only non-spring forces are gravity step as without the split, up to
+// rounding.
+
+#ifndef DENSE_LU_MAX_DOFS
+#define DENSE_LU_MAX_DOFS 2000
+#endif
+
+// LinearizedImplicitEuler is constructed by the base library, so the cached
+// factorization cannot be a member. SparseSystemSolver redoes its symbolic
+// analysis whenever the pattern changes, which covers edge and force insertion
+// as well as a change of stepper or scene.
+static SparseSystemSolver g_sparse_solver;
+
+static FixedDoFs g_fixed;
+
+// The step's vectors, triplet lists and system, reused so that steps at an
+// unchanged size allocate nothing outside the sparse assembly and
+// factorization.
+static VectorXs g_dx;
+static VectorXs g_dv;
+static VectorXs g_rhs;
+static VectorXs g_rhsf;
+static VectorXs g_dvf;
+static TripletXs g_hessX;
+static TripletXs g_hessV;
+static SparseMatrixXs g_A;
+
+#if defined(MULTIGRID_PCG) && !defined(IMEX_SPLIT)
+
+static const int DIRECT_SOLVER_MAX_DOFS = 20000;
+static const scalar CG_TOLERANCE = 1.0e-10;
+static const int CG_MAX_ITERATIONS = 1000;
+
+static BlockSparseMatrix2 g_Ab;
+static MultigridPreconditioner g_multigrid;
+
+#endif
+
+#ifdef IMEX_SPLIT
+
+// The free DoFs the implicit forces touch, in order, and each DoF's index
+// among them or -1.
+static std::vector<int> g_implicit_dofs;
+static std::vector<int> g_implicit_index;
+
+static void selectImplicitDoFs( const FixedDoFs& fixed, const TripletXs& hessX, const TripletXs& hessV, int ndof )
+{
+  std::vector<unsigned char> touched(ndof,0);
+  for( TripletXs::size_type i = 0; i < hessX.size(); ++i ) touched[hessX[i].row()] = touched[hessX[i].col()] = 1;
+  for( TripletXs::size_type i = 0; i < hessV.size(); ++i ) touched[hessV[i].row()] = touched[hessV[i].col()] = 1;
+
+  g_implicit_dofs.clear();
+  g_implicit_index.assign(ndof,-1);
+  for( int i = 0; i < ndof; ++i )
+  {
+    if( !touched[i] || fixed.isFixedDoF(i) ) continue;
+    g_implicit_index[i] = (int) g_implicit_dofs.size();
+    g_implicit_dofs.push_back(i);
+  }
+}
+
+// M + dt^2 hessX + dt hessV over the implicit DoFs.
+static void assembleSplitSystem( const VectorXs& m, scalar dt, const TripletXs& hessX, const TripletXs& hessV, SparseMatrixXs& A )
+{
+  const int n = (int) g_implicit_dofs.size();
+  TripletXs triplets;
+  triplets.reserve(hessX.size() + hessV.size() + n);
+  for( TripletXs::size_type i = 0; i < hessX.size(); ++i )
+  {
+    const int r = g_implicit_index[hessX[i].row()];
+    const int c = g_implicit_index[hessX[i].col()];
+    if( r >= 0 && c >= 0 ) triplets.push_back( Triplet(r,c,dt*dt*hessX[i].value()) );
+  }
+  for( TripletXs::size_type i = 0; i < hessV.size(); ++i )
+  {
+    const int r = g_implicit_index[hessV[i].row()];
+    const int c = g_implicit_index[hessV[i].col()];
+    if( r >= 0 && c >= 0 ) triplets.push_back( Triplet(r,c,dt*hessV[i].value()) );
+  }
+  for( int i = 0; i < n; ++i ) triplets.push_back( Triplet(i,i,m(g_implicit_dofs[i])) );
+
+  A.resize(n,n);
+  A.setFromTriplets( triplets.begin(), triplets.end() );
+  A.makeCompressed();
+}
+
+#endif
+
 bool LinearizedImplicitEuler::stepScene( TwoDScene& scene, scalar dt )
 {
   VectorXs& x = scene.getX();
@@ -8,7 +122,119 @@ bool LinearizedImplicitEuler::stepScene( TwoDScene& scene, scalar dt )
   assert(x.size() == v.size());
   assert(x.size() == m.size());
 
-  // Your code goes here!
-  
+  int ndof = x.size();
+  assert( ndof%2 == 0 );
+
+  scene.batchForces();
+  g_fixed.update(scene);
+
+  // The system's state is passed to two d scene as a change from the last timestep's solution
+  VectorXs& dx = g_dx;
+  VectorXs& dv = g_dv;
+  VectorXs& rhs = g_rhs;
+  dx = dt*v;
+  dv.setZero(ndof);
+  rhs.setZero(ndof);
+
+#if defined(IMEX_SPLIT)
+  scalar E = 0.0;
+  TripletXs& hessX = g_hessX;
+  TripletXs& hessV = g_hessV;
+  hessX.clear();
+  hessV.clear();
+  scene.evaluateForceSplit(EXPLICIT_FORCES,EVALUATE_GRADIENT,E,rhs,hessX,hessV);
+  scene.evaluateForceSplit(IMPLICIT_FORCES,EVALUATE_GRADIENT | EVALUATE_HESSX | EVALUATE_HESSV,E,rhs,hessX,hessV,dx,dv);
+  rhs *= -dt;
+
+  selectImplicitDoFs(g_fixed,hessX,hessV,ndof);
+  dv = g_fixed.getInverseMasses().cwiseProduct(rhs);
+
+  if( !g_implicit_dofs.empty() )
+  {
+    SparseMatrixXs& A = g_A;
+    assembleSplitSystem(m,dt,hessX,hessV,A);
+    VectorXs& rhsi = g_rhsf;
+    rhsi.resize(g_implicit_dofs.size());
+    for( int i = 0; i < rhsi.size(); ++i ) rhsi(i) = rhs(g_implicit_dofs[i]);
+
+    if( !g_sparse_solver.factorize(A) )
+    {
+      std::cerr << "\033[31;1mERROR IN LINEARIZEDIMPLICITEULER:\033[m Sparse factorization failed." << std::endl;
+      return false;
+    }
+    VectorXs& dvi = g_dvf;
+    g_sparse_solver.solve(rhsi,dvi);
+    for( int i = 0; i < dvi.size(); ++i ) dv(g_implicit_dofs[i]) = dvi(i);
+  }
+#else
+#ifdef DENSE_LU_SOLVER
+  if( ndof <= DENSE_LU_MAX_DOFS )
+  {
+    scene.accumulateGradUParallel(rhs,dx,dv);
+    rhs *= -dt;
+
+    MatrixXs A = MatrixXs::Zero(ndof,ndof);
+    scene.accumulateddUdxdx(A,dx,dv);
+    A *= dt;
+    scene.accumulateddUdxdv(A,dx,dv);
+    A *= dt;
+    A.diagonal() += m;
+
+    MatrixXs Af;
+    g_fixed.reduce(A,Af);
+    VectorXs rhsf;
+    g_fixed.gatherFree(rhs,rhsf);
+    g_fixed.scatterFree(Af.fullPivLu().solve(rhsf),dv);
+  }
+  else
+#endif
+  {
+#ifdef DENSE_LU_SOLVER
+    static bool s_noted_too_large = false;
+    if( !s_noted_too_large )
+    {
+      std::cerr << "LinearizedImplicitEuler: " << ndof << " DoFs is more than the dense LU solver's " << DENSE_LU_MAX_DOFS
+                << "; solving with the sparse backend instead." << std::endl;
+      s_noted_too_large = true;
+    }
+#endif
+    // The gradient and both Hessians come from one pass over the forces.
+    scalar E = 0.0;
+    TripletXs& hessX = g_hessX;
+    TripletXs& hessV = g_hessV;
+    hessX.clear();
+    hessV.clear();
+    scene.evaluateForces(EVALUATE_GRADIENT | EVALUATE_HESSX | EVALUATE_HESSV,E,rhs,hessX,hessV,dx,dv);
+    rhs *= -dt;
+
+    VectorXs& rhsf = g_rhsf;
+    g_fixed.gatherFree(rhs,rhsf);
+#ifdef MULTIGRID_PCG
+    if( g_fixed.getNumFreeDoFs() > DIRECT_SOLVER_MAX_DOFS )
+    {
+      g_Ab.assemble(m,g_fixed,dt*dt,hessX,dt,hessV);
+      g_multigrid.compute(g_Ab);
+      solvePCG(g_Ab,g_multigrid,rhsf,g_dvf,CG_TOLERANCE,CG_MAX_ITERATIONS);
+    }
+    else
+#endif
+    {
+      SparseMatrixXs& A = g_A;
+      assembleImplicitSystem(m,g_fixed,dt,hessX,hessV,A);
+
+      if( !g_sparse_solver.factorize(A) )
+      {
+        std::cerr << "\033[31;1mERROR IN LINEARIZEDIMPLICITEULER:\033[m Sparse factorization failed." << std::endl;
+        return false;
+      }
+      g_sparse_solver.solve(rhsf,g_dvf);
+    }
+    g_fixed.scatterFree(g_dvf,dv);
+  }
+#endif
+
+  v += dv;
+  x += dt*v;
+
   return true;
 }
@@ -3,6 +3,7 @@
 
 #include <Eigen/Core>
 #include <Eigen/StdVector>
+#include <Eigen/Sparse>
 
 typedef double scalar;
 
@@ -12,6 +13,17 @@ typedef Eigen::Matrix<scalar, Eigen::Dynamic, 1> VectorXs;
 typedef Eigen::Matrix<scalar, 2, 2> Matrix2s;
 typedef Eigen::Matrix<scalar, Eigen::Dynamic, Eigen::Dynamic> MatrixXs;
 
+// Keeps std::vectors of fixed-size types on 16-byte boundaries, which an
+// aligned (FOSSSIM_ALIGNED_EIGEN) build needs. Harmless when unaligned.
+EIGEN_DEFINE_STL_VECTOR_SPECIALIZATION(Vector2s)
+EIGEN_DEFINE_STL_VECTOR_SPECIALIZATION(Matrix2s)
+
+// Sparse Hessians are assembled from (row, col, value) triplets. Duplicate
+// entries are summed when the matrix is built.
+typedef Eigen::SparseMatrix<scalar> SparseMatrixXs;
+typedef Eigen::Triplet<scalar> Triplet;
+typedef std::vector<Triplet> TripletXs;
+
 //typedef Matrix<int, 1, 2> RowVector2i;
 
 #endif
@@ -0,0 +1,165 @@
+#include "MultigridPreconditioner.h"
+
+#include <cmath>
+
+namespace
+{
+
+// Hierarchy controls.
+// Off-diagonal blocks at least this fraction of the geometric mean of their
+// diagonal blocks, in Frobenius norm, couple their particles strongly.
+const scalar STRENGTH_THRESHOLD = 0.08;
+// Levels this small are factored directly.
+const int COARSEST_MAX_BLOCKS = 256;
+// Coarsening stops once a level keeps more than this fraction of its rows,
+// e.g. when the masses dominate and nothing is strongly coupled.
+const scalar MIN_COARSENING_RATIO = 0.8;
+const int MAX_LEVELS = 20;
+
+bool strong( const BlockSparseMatrix2& A, const std::vector<scalar>& diagnorm, int i, int k )
+{
+  const int j = A.blockColumn(k);
+  return j != i && A.block(k).norm() >= STRENGTH_THRESHOLD*std::sqrt( diagnorm[i]*diagnorm[j] );
+}
+
+// Greedy aggregation of the strongly coupled graph of A's block rows: whole
+// untouched neighbourhoods first, then stragglers join the neighbouring
+// aggregate they couple to most strongly, and the rest aggregate among
+// themselves. Returns the number of aggregates.
+int aggregate( const BlockSparseMatrix2& A, std::vector<int>& agg )
+{
+  const int nb = A.numBlockRows();
+  std::vector<scalar> diagnorm( nb );
+  for( int i = 0; i < nb; ++i ) diagnorm[i] = A.block( A.diagonalBlock(i) ).norm();
+
+  agg.assign( nb, -1 );
+  int n = 0;
+  for( int i = 0; i < nb; ++i )
+  {
+    if( agg[i] >= 0 ) continue;
+    bool free = true;
+    for( int k = A.rowStart(i); k < A.rowStart(i+1) && free; ++k ) if( strong(A,diagnorm,i,k) && agg[A.blockColumn(k)] >= 0 ) free = false;
+    if( !free ) continue;
+    agg[i] = n;
+    for( int k = A.rowStart(i); k < A.rowStart(i+1); ++k ) if( strong(A,diagnorm,i,k) ) agg[A.blockColumn(k)] = n;
+    ++n;
+  }
+
+  const std::vector<int> first( agg );
+  for( int i = 0; i < nb; ++i )
+  {
+    if( agg[i] >= 0 ) continue;
+    scalar best = 0.0;
+    for( int k = A.rowStart(i); k < A.rowStart(i+1); ++k )
+    {
+      const int j = A.blockColumn(k);
+      if( first[j] < 0 || !strong(A,diagnorm,i,k) ) continue;
+      const scalar s = A.block(k).norm();
+      if( s > best ) { best = s; agg[i] = first[j]; }
+    }
+  }
+
+  for( int i = 0; i < nb; ++i )
+  {
+    if( agg[i] >= 0 ) continue;
+    agg[i] = n;
+    for( int k = A.rowStart(i); k < A.rowStart(i+1); ++k ) if( strong(A,diagnorm,i,k) && agg[A.blockColumn(k)] < 0 ) agg[A.blockColumn(k)] = n;
+    ++n;
+  }
+  return n;
+}
+
+// One block Gauss-Seidel sweep on A x = b, forward or backward.
+void sweep( const BlockSparseMatrix2& A, const BlockJacobiPreconditioner& D, const VectorXs& b, VectorXs& x, bool forward )
+{
+  const int nb = A.numBlockRows();
+  for( int s = 0; s < nb; ++s )
+  {
+    const int i = forward ? s : nb-1-s;
+    Vector2s r = b.segment<2>(2*i);
+    for( int k = A.rowStart(i); k < A.rowStart(i+1); ++k )
+    {
+      const int j = A.blockColumn(k);
+      if( j != i ) r -= A.block(k)*x.segment<2>(2*j);
+    }
+    x.segment<2>(2*i) = D.inverse(i)*r;
+  }
+}
+
+}
+
+MultigridPreconditioner::MultigridPreconditioner()
+: m_coarse()
+, m_levels()
+, m_coarsest()
+, m_coarsest_factored(false)
+{}
+
+void MultigridPreconditioner::compute( const BlockSparseMatrix2& A )
+{
+  // The coarse matrices are built first, so that the levels' pointers into
+  // m_coarse stay valid.
+  std::vector<std::vector<int> > aggs;
+  std::vector<int> naggs;
+  m_coarse.clear();
+  m_coarse.reserve( MAX_LEVELS );
+  const BlockSparseMatrix2* current = &A;
+  while( int(aggs.size())+1 < MAX_LEVELS && current->numBlockRows() > COARSEST_MAX_BLOCKS )
+  {
+    std::vector<int> agg;
+    const int n = aggregate( *current, agg );
+    if( n > MIN_COARSENING_RATIO*current->numBlockRows() ) break;
+    m_coarse.push_back( BlockSparseMatrix2() );
+    current->coarsen( agg, n, m_coarse.back() );
+    aggs.push_back( agg );
+    naggs.push_back( n );
+    current = &m_coarse.back();
+  }
+
+  m_levels.resize( aggs.size()+1 );
+  for( std::vector<Level>::size_type l = 0; l < m_levels.size(); ++l )
+  {
+    Level& L = m_levels[l];
+    L.A = l == 0 ? &A : &m_coarse[l-1];
+    L.diagonal.compute( *L.A );
+    if( l < aggs.size() ) { L.aggregate.swap( aggs[l] ); L.naggregates = naggs[l]; }
+    else { L.aggregate.clear(); L.naggregates = 0; }
+  }
+
+  SparseMatrixXs coarsest;
+  current->toSparse( coarsest );
+  m_coarsest.compute( coarsest );
+  m_coarsest_factored = m_coarsest.info() == Eigen::Success;
+}
+
+void MultigridPreconditioner::cycle( int level ) const
+{
+  Level& L = m_levels[level];
+  if( L.aggregate.empty() )
+  {
+    if( m_coarsest_factored ) L.x = m_coarsest.solve( L.b );
+    else L.diagonal.apply( L.b, L.x );
+    return;
+  }
+
+  const int nb = L.A->numBlockRows();
+  L.x.setZero( 2*nb );
+  sweep( *L.A, L.diagonal, L.b, L.x, true );
+
+  L.A->multiply( L.x, L.r );
+  L.r = L.b - L.r;
+  Level& C = m_levels[level+1];
+  C.b.setZero( 2*L.naggregates );
+  for( int i = 0; i < nb; ++i ) C.b.segment<2>(2*L.aggregate[i]) += L.r.segment<2>(2*i);
+  cycle( level+1 );
+  for( int i = 0; i < nb; ++i ) L.x.segment<2>(2*i) += C.x.segment<2>(2*L.aggregate[i]);
+
+  sweep( *L.A, L.diagonal, L.b, L.x, false );
+}
+
+void MultigridPreconditioner::apply( const VectorXs& r, VectorXs& z ) const
+{
+  m_levels[0].b = r;
+  cycle( 0 );
+  z = m_levels[0].x;
+}
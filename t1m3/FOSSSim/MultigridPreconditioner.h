@@ -0,0 +1,59 @@
+#ifndef __MULTIGRID_PRECONDITIONER_H__
+#define __MULTIGRID_PRECONDITIONER_H__
+
+#include <Eigen/SparseCholesky>
+#include <vector>
+
+#include "MathDefs.h"
+#include "BlockSparseMatrix.h"
+
+// Aggregation algebraic multigrid over a BlockSparseMatrix2, applied as one
+// V-cycle per preconditioner application. Each level groups strongly coupled
+// particles into aggregates, and the next level's matrix is the Galerkin
+// product BlockSparseMatrix2::coarsen. Each level smooths with one block
+// Gauss-Seidel sweep forward before the coarse correction and one backward
+// after it, so the cycle is symmetric and usable inside CG. The coarsest
+// level is factored with SimplicialLDLT.
+//
+// Jacobi-preconditioned CG needs more iterations the longer the spring
+// network, since a correction spreads one spring per iteration; the coarse
+// levels carry it across the network at once, so the iteration counts stay
+// close to flat as the network grows.
+class MultigridPreconditioner
+{
+public:
+  MultigridPreconditioner();
+
+  // Builds the hierarchy for A, which must stay alive and unchanged for as
+  // long as this is applied.
+  void compute( const BlockSparseMatrix2& A );
+
+  // z = one V-cycle on A z = r from z = 0.
+  void apply( const VectorXs& r, VectorXs& z ) const;
+
+  int getNumLevels() const { return int(m_levels.size()); }
+
+private:
+  struct Level
+  {
+    const BlockSparseMatrix2* A;
+    BlockJacobiPreconditioner diagonal;
+    // Each block row's aggregate on the next level; empty on the coarsest.
+    std::vector<int> aggregate;
+    int naggregates;
+    // V-cycle scratch.
+    VectorXs x;
+    VectorXs b;
+    VectorXs r;
+  };
+
+  void cycle( int level ) const;
+
+  // Coarse matrices, owned here; level 0 refers to the caller's matrix.
+  std::vector<BlockSparseMatrix2> m_coarse;
+  mutable std::vector<Level> m_levels;
+  Eigen::SimplicialLDLT<SparseMatrixXs> m_coarsest;
+  bool m_coarsest_factored;
+};
+
+#endif
@@ -0,0 +1,329 @@
+#include "NBodyGravityForce.h"
+#include "SparseUtilities.h"
+
+namespace
+{
+
+// The position Hessian block of the potential -G*mi*mj/|xj-xi| in xi.
+inline Matrix2s pairHessXBlock( const Vector2s& d, const scalar& c )
+{
+  const scalar l2 = d.squaredNorm();
+  assert( l2 != 0.0 );
+  const scalar l = sqrt(l2);
+  return ( c/(l2*l) )*( Matrix2s::Identity() - ( 3.0/l2 )*d*d.transpose() );
+}
+
+struct EnergyVisitor
+{
+  const Vector2s xi;
+  const scalar Gmi;
+  scalar E;
+
+  EnergyVisitor( const Vector2s& x, const scalar& c ) : xi(x), Gmi(c), E(0.0) {}
+
+  void operator()( int, const Vector2s& xj, const scalar& mj )
+  {
+    E -= Gmi*mj/( xj - xi ).norm();
+  }
+};
+
+struct GradientVisitor
+{
+  const Vector2s xi;
+  const scalar Gmi;
+  Vector2s gradE;
+
+  GradientVisitor( const Vector2s& x, const scalar& c ) : xi(x), Gmi(c), gradE(Vector2s::Zero()) {}
+
+  void operator()( int, const Vector2s& xj, const scalar& mj )
+  {
+    const Vector2s d = xj - xi;
+    const scalar l2 = d.squaredNorm();
+    assert( l2 != 0.0 );
+    gradE -= ( Gmi*mj/( l2*sqrt(l2) ) )*d;
+  }
+};
+
+template<class Hessian>
+struct HessXVisitor
+{
+  const int i;
+  const Vector2s xi;
+  const scalar Gmi;
+  Hessian& hessE;
+
+  HessXVisitor( int idx, const Vector2s& x, const scalar& c, Hessian& H ) : i(idx), xi(x), Gmi(c), hessE(H) {}
+
+  void operator()( int j, const Vector2s& xj, const scalar& mj )
+  {
+    const Matrix2s B = pairHessXBlock( xj - xi, Gmi*mj );
+    addBlock( i, B );
+    if( j >= 0 ) addBlock( j, -B );
+  }
+
+  void addBlock( int j, const Matrix2s& B );
+};
+
+template<>
+void HessXVisitor<TripletXs>::addBlock( int j, const Matrix2s& B )
+{
+  sparseutils::addBlock( i, j, B, hessE );
+}
+
+template<>
+void HessXVisitor<MatrixXs>::addBlock( int j, const Matrix2s& B )
+{
+  hessE.block<2,2>(2*i,2*j) += B;
+}
+
+struct HessXProductVisitor
+{
+  const Vector2s xi;
+  const scalar Gmi;
+  const VectorXs& p;
+  const Vector2s pi;
+  Vector2s out;
+
+  HessXProductVisitor( int i, const Vector2s& x, const scalar& c, const VectorXs& dx ) : xi(x), Gmi(c), p(dx), pi(dx.segment<2>(2*i)), out(Vector2s::Zero()) {}
+
+  void operator()( int j, const Vector2s& xj, const scalar& mj )
+  {
+    const Matrix2s B = pairHessXBlock( xj - xi, Gmi*mj );
+    out += j >= 0 ? Vector2s( B*( pi - p.segment<2>(2*j) ) ) : Vector2s( B*pi );
+  }
+};
+
+}
+
+NBodyGravityForce::NBodyGravityForce( const std::vector<int>& particles, const scalar& G, const scalar& theta )
+: PooledForce()
+, m_particles(particles)
+, m_G(G)
+, m_theta(theta)
+, m_tree()
+, m_mass()
+, m_com()
+, m_tree_x()
+{
+  assert( m_G >= 0.0 );
+  assert( m_theta >= 0.0 );
+}
+
+NBodyGravityForce::~NBodyGravityForce()
+{}
+
+void NBodyGravityForce::updateTree( const VectorXs& x, const VectorXs& m )
+{
+  if( m_tree_x.size() == x.size() && m_tree_x == x ) return;
+  m_tree_x = x;
+
+  m_tree.build( x, m_particles );
+  const int nnodes = m_tree.getNumNodes();
+  std::vector<scalar> mass( nnodes, 0.0 );
+  std::vector<Vector2s> com( nnodes, Vector2s::Zero() );
+  // Mass-weighted position sums first, divided through once all are known.
+  const std::vector<int>& order = m_tree.getOrder();
+  for( int node = nnodes-1; node >= 0; --node )
+  {
+    const QuadTree::Node& n = m_tree.getNode(node);
+    if( n.child < 0 )
+    {
+      for( int k = n.begin; k < n.end; ++k )
+      {
+        mass[node] += m(2*order[k]);
+        com[node] += m(2*order[k])*x.segment<2>(2*order[k]);
+      }
+    }
+    else
+    {
+      for( int q = 0; q < 4; ++q )
+      {
+        mass[node] += mass[n.child+q];
+        com[node] += com[n.child+q];
+      }
+    }
+  }
+  m_mass.resize(nnodes);
+  m_com.resize(nnodes);
+  for( int node = 0; node < nnodes; ++node )
+  {
+    if( mass[node] > 0.0 ) com[node] /= mass[node];
+    m_mass[node] = cellscalar( mass[node] );
+    m_com[node] = com[node].cast<cellscalar>();
+  }
+}
+
+template<class Visitor>
+void NBodyGravityForce::traverse( const VectorXs& x, const VectorXs& m, int i, Visitor& visit ) const
+{
+  if( m_tree.getNumNodes() == 0 ) return;
+
+  const std::vector<int>& order = m_tree.getOrder();
+  const Vector2s xi = x.segment<2>(2*i);
+  const scalar theta2 = m_theta*m_theta;
+  int stack[4*QuadTree::MAX_DEPTH+4];
+  int top = 0;
+  stack[top++] = 0;
+  while( top > 0 )
+  {
+    const int node = stack[--top];
+    const QuadTree::Node& n = m_tree.getNode(node);
+    if( n.begin == n.end ) continue;
+
+    if( n.child < 0 )
+    {
+      for( int k = n.begin; k < n.end; ++k )
+      {
+        const int j = order[k];
+        if( j != i ) visit( j, x.segment<2>(2*j), m(2*j) );
+      }
+      continue;
+    }
+
+    // Cells containing the particle are always opened.
+    const scalar w = 2.0*n.half;
+    const Vector2s com = m_com[node].cast<scalar>();
+    if( !m_tree.contains( node, xi ) && w*w < theta2*( com - xi ).squaredNorm() )
+      visit( -1, com, scalar( m_mass[node] ) );
+    else
+      for( int q = 0; q < 4; ++q ) stack[top++] = n.child + q;
+  }
+}
+
+void NBodyGravityForce::addEnergyToTotal( const VectorXs& x, const VectorXs& v, const VectorXs& m, scalar& E )
+{
+  assert( x.size() == v.size() );
+  assert( x.size() == m.size() );
+  assert( x.size()%2 == 0 );
+
+  updateTree( x, m );
+
+  // Every pair is seen from both ends.
+  scalar U = 0.0;
+  for( std::vector<int>::size_type k = 0; k < m_particles.size(); ++k )
+  {
+    const int i = m_particles[k];
+    EnergyVisitor visit( x.segment<2>(2*i), m_G*m(2*i) );
+    traverse( x, m, i, visit );
+    U += visit.E;
+  }
+  E += 0.5*U;
+}
+
+void NBodyGravityForce::addGradEToTotal( const VectorXs& x, const VectorXs& v, const VectorXs& m, VectorXs& gradE )
+{
+  assert( x.size() == v.size() );
+  assert( x.size() == m.size() );
+  assert( x.size() == gradE.size() );
+  assert( x.size()%2 == 0 );
+
+  updateTree( x, m );
+
+  // Each particle writes only its own gradient, so particles are independent.
+  // They are visited in the tree's order, along which consecutive particles
+  // share most of their interaction lists.
+  const std::vector<int>& order = m_tree.getOrder();
+  const int nparticles = (int) order.size();
+#ifdef _OPENMP
+  #pragma omp parallel for schedule(dynamic,64)
+#endif
+  for( int k = 0; k < nparticles; ++k )
+  {
+    const int i = order[k];
+    GradientVisitor visit( x.segment<2>(2*i), m_G*m(2*i) );
+    traverse( x, m, i, visit );
+    gradE.segment<2>(2*i) += visit.gradE;
+  }
+}
+
+void NBodyGravityForce::addHessXToTotal( const VectorXs& x, const VectorXs& v, const VectorXs& m, MatrixXs& hessE )
+{
+  assert( x.size() == v.size() );
+  assert( x.size() == m.size() );
+  assert( x.size() == hessE.rows() );
+  assert( x.size() == hessE.cols() );
+  assert( x.size()%2 == 0 );
+
+  updateTree( x, m );
+
+  for( std::vector<int>::size_type k = 0; k < m_particles.size(); ++k )
+  {
+    const int i = m_particles[k];
+    HessXVisitor<MatrixXs> visit( i, x.segment<2>(2*i), m_G*m(2*i), hessE );
+    traverse( x, m, i, visit );
+  }
+}
+
+void NBodyGravityForce::addHessVToTotal( const VectorXs& x, const VectorXs& v, const VectorXs& m, MatrixXs& hessE )
+{
+  assert( x.size() == v.size() );
+  assert( x.size() == m.size() );
+  assert( x.size() == hessE.rows() );
+  assert( x.size() == hessE.cols() );
+  assert( x.size()%2 == 0 );
+
+  // Nothing to do.
+}
+
+void NBodyGravityForce::addHessXToTotal( const VectorXs& x, const VectorXs& v, const VectorXs& m, TripletXs& hessE )
+{
+  assert( x.size() == v.size() );
+  assert( x.size() == m.size() );
+  assert( x.size()%2 == 0 );
+
+  updateTree( x, m );
+
+  for( std::vector<int>::size_type k = 0; k < m_particles.size(); ++k )
+  {
+    const int i = m_particles[k];
+    HessXVisitor<TripletXs> visit( i, x.segment<2>(2*i), m_G*m(2*i), hessE );
+    traverse( x, m, i, visit );
+  }
+}
+
+void NBodyGravityForce::addHessVToTotal( const VectorXs& x, const VectorXs& v, const VectorXs& m, TripletXs& hessE )
+{
+  assert( x.size() == v.size() );
+  assert( x.size() == m.size() );
+  assert( x.size()%2 == 0 );
+
+  // Nothing to do.
+}
+
+void NBodyGravityForce::addHessXVProductToTotal( const VectorXs& x, const VectorXs& v, const VectorXs& m, const VectorXs& dx, VectorXs& out )
+{
+  assert( x.size() == v.size() );
+  assert( x.size() == m.size() );
+  assert( x.size() == dx.size() );
+  assert( x.size() == out.size() );
+
+  updateTree( x, m );
+
+  const std::vector<int>& order = m_tree.getOrder();
+  const int nparticles = (int) order.size();
+#ifdef _OPENMP
+  #pragma omp parallel for schedule(dynamic,64)
+#endif
+  for( int k = 0; k < nparticles; ++k )
+  {
+    const int i = order[k];
+    HessXProductVisitor visit( i, x.segment<2>(2*i), m_G*m(2*i), dx );
+    traverse( x, m, i, visit );
+    out.segment<2>(2*i) += visit.out;
+  }
+}
+
+void NBodyGravityForce::addHessVVProductToTotal( const VectorXs& x, const VectorXs& v, const VectorXs& m, const VectorXs& dv, VectorXs& out )
+{
+  assert( x.size() == v.size() );
+  assert( x.size() == m.size() );
+  assert( x.size() == dv.size() );
+  assert( x.size() == out.size() );
+
+  // Nothing to do.
+}
+
+Force* NBodyGravityForce::createNewCopy()
+{
+  return new NBodyGravityForce(*this);
+}
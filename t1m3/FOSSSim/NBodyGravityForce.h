@@ -0,0 +1,73 @@
+#ifndef __NBODY_GRAVITY_FORCE_H__
+#define __NBODY_GRAVITY_FORCE_H__
+
+#include <Eigen/Core>
+#include <vector>
+#include "ForceArena.h"
+#include "QuadTree.h"
+
+// Mutual gravitation between every pair of a set of particles, evaluated with
+// a Barnes-Hut quadtree: a cell of width w at distance d from a particle is
+// treated as a point mass at its center of mass once w < theta*d, so a
+// gradient costs O(n log n) rather than the O(n^2) of one GravitationalForce
+// per pair. Particles in unopened leaves interact exactly; theta = 0 opens
+// every cell and reproduces the pairwise forces up to summation order.
+//
+// The position Hessian follows the same interaction list: nearby particles
+// get the exact pair blocks, and each far cell only the block of the
+// particle it acts on, so the matrix keeps O(n log n) nonzeros.
+class NBodyGravityForce : public PooledForce
+{
+public:
+
+  NBodyGravityForce( const std::vector<int>& particles, const scalar& G, const scalar& theta );
+
+  virtual ~NBodyGravityForce();
+
+  virtual void addEnergyToTotal( const VectorXs& x, const VectorXs& v, const VectorXs& m, scalar& E );
+
+  virtual void addGradEToTotal( const VectorXs& x, const VectorXs& v, const VectorXs& m, VectorXs& gradE );
+
+  virtual void addHessXToTotal( const VectorXs& x, const VectorXs& v, const VectorXs& m, MatrixXs& hessE );
+
+  virtual void addHessVToTotal( const VectorXs& x, const VectorXs& v, const VectorXs& m, MatrixXs& hessE );
+
+  // Triplet versions used by TwoDScene's sparse accumulators.
+  void addHessXToTotal( const VectorXs& x, const VectorXs& v, const VectorXs& m, TripletXs& hessE );
+
+  void addHessVToTotal( const VectorXs& x, const VectorXs& v, const VectorXs& m, TripletXs& hessE );
+
+  // Hessian-vector products, out += hessE*dx, without forming the Hessian.
+  void addHessXVProductToTotal( const VectorXs& x, const VectorXs& v, const VectorXs& m, const VectorXs& dx, VectorXs& out );
+
+  void addHessVVProductToTotal( const VectorXs& x, const VectorXs& v, const VectorXs& m, const VectorXs& dv, VectorXs& out );
+
+  virtual Force* createNewCopy();
+
+  const std::vector<int>& getParticles() const { return m_particles; }
+  const scalar& getG() const { return m_G; }
+  const scalar& getTheta() const { return m_theta; }
+
+private:
+
+  // Rebuilds the tree unless it was last built at x; the steppers evaluate
+  // the gradient and many Hessian products at the same positions.
+  void updateTree( const VectorXs& x, const VectorXs& m );
+
+  // Calls visit(j, xj, mj) for each particle j != i that interacts with
+  // particle i exactly, and visit(-1, com, mass) for each far cell.
+  template<class Visitor>
+  void traverse( const VectorXs& x, const VectorXs& m, int i, Visitor& visit ) const;
+
+  std::vector<int> m_particles;
+  scalar m_G;
+  scalar m_theta;
+
+  QuadTree m_tree;
+  // Mass and center of mass of each node of m_tree.
+  std::vector<cellscalar> m_mass;
+  std::vector<Vector2cs> m_com;
+  VectorXs m_tree_x;
+};
+
+#endif
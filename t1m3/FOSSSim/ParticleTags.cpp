@@ -0,0 +1,82 @@
+#include "ParticleTags.h"
+
+#include <cassert>
+
+ParticleTags::ParticleTags()
+: m_ids()
+, m_tags()
+, m_lookup()
+{}
+
+ParticleTags::ParticleTags( const TwoDScene& scene )
+: m_ids()
+, m_tags()
+, m_lookup()
+{
+  update(scene);
+}
+
+void ParticleTags::update( const TwoDScene& scene )
+{
+  const std::vector<std::string>& tags = scene.getParticleTags();
+  m_ids.resize(tags.size());
+  m_tags.clear();
+  m_lookup.clear();
+
+  // Neighbouring particles usually share a tag, so the last one is checked
+  // before the map.
+  int last = -1;
+  for( std::vector<std::string>::size_type i = 0; i < tags.size(); ++i )
+  {
+    if( last < 0 || tags[i] != m_tags[last] )
+    {
+      std::map<std::string,int>::iterator it = m_lookup.find(tags[i]);
+      if( it == m_lookup.end() )
+      {
+        it = m_lookup.insert(std::make_pair(tags[i],int(m_tags.size()))).first;
+        m_tags.push_back(tags[i]);
+      }
+      last = it->second;
+    }
+    m_ids[i] = last;
+  }
+}
+
+int ParticleTags::getNumParticles() const
+{
+  return int(m_ids.size());
+}
+
+int ParticleTags::getNumTags() const
+{
+  return int(m_tags.size());
+}
+
+int ParticleTags::getTagId( int particle ) const
+{
+  assert( particle >= 0 ); assert( particle < getNumParticles() );
+  return m_ids[particle];
+}
+
+const std::vector<int>& ParticleTags::getTagIds() const
+{
+  return m_ids;
+}
+
+const std::string& ParticleTags::getTag( int id ) const
+{
+  assert( id >= 0 ); assert( id < getNumTags() );
+  return m_tags[id];
+}
+
+int ParticleTags::findTag( const std::string& tag ) const
+{
+  std::map<std::string,int>::const_iterator it = m_lookup.find(tag);
+  return it == m_lookup.end() ? -1 : it->second;
+}
+
+void ParticleTags::getParticles( int id, std::vector<int>& particles ) const
+{
+  particles.clear();
+  for( int i = 0; i < getNumParticles(); ++i ) if( m_ids[i] == id ) particles.push_back(i);
+}
@@ -0,0 +1,50 @@
+#ifndef __PARTICLE_TAGS_H__
+#define __PARTICLE_TAGS_H__
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "TwoDScene.h"
+
+// Interned view of a scene's particle tags: each distinct tag gets a small
+// integer id, and each particle holds the id of its tag. TwoDScene is built
+// into the base library and keeps one std::string per particle; code that
+// selects particles by tag builds one of these once and then compares ints
+// in its loops rather than strings.
+class ParticleTags
+{
+public:
+  ParticleTags();
+
+  explicit ParticleTags( const TwoDScene& scene );
+
+  // Re-interns the scene's tags. Ids are assigned in order of first
+  // appearance.
+  void update( const TwoDScene& scene );
+
+  int getNumParticles() const;
+
+  int getNumTags() const;
+
+  // Id of particle i's tag.
+  int getTagId( int particle ) const;
+
+  // The particles' tag ids, indexed by particle.
+  const std::vector<int>& getTagIds() const;
+
+  const std::string& getTag( int id ) const;
+
+  // Id of tag, or -1 if no particle carries it.
+  int findTag( const std::string& tag ) const;
+
+  // The particles whose tag has the given id, in increasing order.
+  void getParticles( int id, std::vector<int>& particles ) const;
+
+private:
+  std::vector<int> m_ids;
+  std::vector<std::string> m_tags;
+  std::map<std::string,int> m_lookup;
+};
+
+#endif
@@ -0,0 +1,91 @@
+#include "QuadTree.h"
+
+#include <algorithm>
+
+// Nodes holding at most this many particles are not split further.
+static const int LEAF_SIZE = 4;
+
+QuadTree::QuadTree()
+: m_nodes()
+, m_order()
+{}
+
+void QuadTree::build( const VectorXs& x, const std::vector<int>& particles )
+{
+  m_nodes.clear();
+  m_order = particles;
+  if( particles.empty() ) return;
+
+  Vector2s lo = x.segment<2>(2*particles[0]);
+  Vector2s hi = lo;
+  for( std::vector<int>::size_type k = 1; k < particles.size(); ++k )
+  {
+    lo = lo.cwiseMin( x.segment<2>(2*particles[k]) );
+    hi = hi.cwiseMax( x.segment<2>(2*particles[k]) );
+  }
+
+  Node root;
+  root.center = 0.5*( lo + hi );
+  // Pad the root so that no particle lies on its boundary.
+  root.half = 0.5*( hi - lo ).maxCoeff()*( 1.0 + 1.0e-9 ) + 1.0e-12;
+  root.child = -1;
+  root.begin = 0;
+  root.end = (int) m_order.size();
+  m_nodes.push_back(root);
+  subdivide( x, 0, 0 );
+}
+
+void QuadTree::subdivide( const VectorXs& x, int node, int depth )
+{
+  Node& n = m_nodes[node];
+  if( n.end - n.begin <= LEAF_SIZE || depth == MAX_DEPTH ) return;
+
+  // Partition the particles into quadrants (-,-), (-,+), (+,-), (+,+).
+  const Vector2s c = n.center;
+  std::vector<int>::iterator first = m_order.begin() + n.begin;
+  std::vector<int>::iterator last = m_order.begin() + n.end;
+  std::vector<int>::iterator xsplit = first;
+  for( std::vector<int>::iterator it = first; it != last; ++it ) if( x(2*(*it)) < c.x() ) std::iter_swap( it, xsplit++ );
+  std::vector<int>::iterator ysplit[2] = { first, xsplit };
+  for( std::vector<int>::iterator it = first; it != xsplit; ++it ) if( x(2*(*it)+1) < c.y() ) std::iter_swap( it, ysplit[0]++ );
+  for( std::vector<int>::iterator it = xsplit; it != last; ++it ) if( x(2*(*it)+1) < c.y() ) std::iter_swap( it, ysplit[1]++ );
+
+  const int bounds[5] = { n.begin, (int) ( ysplit[0] - m_order.begin() ), (int) ( xsplit - m_order.begin() ), (int) ( ysplit[1] - m_order.begin() ), n.end };
+  const scalar half = 0.5*n.half;
+  const int child = (int) m_nodes.size();
+  n.child = child;
+  // n is invalidated from here on, as m_nodes grows.
+  for( int q = 0; q < 4; ++q )
+  {
+    Node cn;
+    cn.center = c + half*Vector2s( q < 2 ? -1.0 : 1.0, q%2 == 0 ? -1.0 : 1.0 );
+    cn.half = half;
+    cn.child = -1;
+    cn.begin = bounds[q];
+    cn.end = bounds[q+1];
+    m_nodes.push_back(cn);
+  }
+  for( int q = 0; q < 4; ++q ) subdivide( x, child + q, depth + 1 );
+}
+
+int QuadTree::getNumNodes() const
+{
+  return (int) m_nodes.size();
+}
+
+const QuadTree::Node& QuadTree::getNode( int node ) const
+{
+  assert( node >= 0 ); assert( node < getNumNodes() );
+  return m_nodes[node];
+}
+
+const std::vector<int>& QuadTree::getOrder() const
+{
+  return m_order;
+}
+
+bool QuadTree::contains( int node, const Vector2s& p ) const
+{
+  const Node& n = getNode(node);
+  return ( ( p - n.center ).cwiseAbs().array() <= n.half ).all();
+}
@@ -0,0 +1,67 @@
+#ifndef __QUAD_TREE_H__
+#define __QUAD_TREE_H__
+
+#include <Eigen/Core>
+#include <vector>
+#include "MathDefs.h"
+
+// Per-cell far-field data of the treecodes. With FAR_FIELD_FLOAT (CMake
+// option USE_FLOAT_FAR_FIELD) it is stored in single precision, which halves
+// the memory a traversal streams through; it is still accumulated in double,
+// and particles in opened leaves always interact in double.
+#ifdef FAR_FIELD_FLOAT
+typedef float cellscalar;
+#else
+typedef scalar cellscalar;
+#endif
+typedef Eigen::Matrix<cellscalar, 2, 1> Vector2cs;
+typedef Eigen::Matrix<cellscalar, 2, 2> Matrix2cs;
+
+// Quadtree over a subset of the particles, for the far-field approximations
+// of NBodyGravityForce and VortexFieldForce. Each node owns a contiguous
+// range of getOrder(); a split node's four children are consecutive and
+// always follow it, so a reverse sweep over the nodes visits children before
+// their parents, which is how the forces aggregate per-node moments.
+class QuadTree
+{
+public:
+
+  struct Node
+  {
+    Vector2s center;
+    scalar half;
+    // Index of the first of four consecutive children, -1 for a leaf.
+    int child;
+    // Range of the node's particles in getOrder().
+    int begin;
+    int end;
+  };
+
+  // Bounds the depth when particles (nearly) coincide, and with it the
+  // stack a traversal needs.
+  static const int MAX_DEPTH = 24;
+
+  QuadTree();
+
+  void build( const VectorXs& x, const std::vector<int>& particles );
+
+  int getNumNodes() const;
+
+  const Node& getNode( int node ) const;
+
+  // The particles, permuted so that each node's are contiguous. Children
+  // are laid out in quadrant order, so this is the order of the particles'
+  // cells along a Morton (Z-order) curve.
+  const std::vector<int>& getOrder() const;
+
+  bool contains( int node, const Vector2s& p ) const;
+
+private:
+
+  void subdivide( const VectorXs& x, int node, int depth );
+
+  std::vector<Node, Eigen::aligned_allocator<Node> > m_nodes;
+  std::vector<int> m_order;
+};
+
+#endif
@@ -0,0 +1,42 @@
+#include "RungeKutta4.h"
+
+RungeKutta4::RungeKutta4()
+{}
+
+void RungeKutta4::stage( TwoDScene& scene, const FixedDoFs& fixed, scalar weight )
+{
+  m_kx = scene.getV() + m_dv;
+  fixed.zeroFixed(m_kx);
+  m_ka.setZero(scene.getX().size());
+  scene.accumulateGradUParallel(m_ka, m_dx, m_dv);
+  m_ka.array() *= -fixed.getInverseMasses().array();
+
+  m_sumx += weight*m_kx;
+  m_sumv += weight*m_ka;
+}
+
+void RungeKutta4::advance( TwoDScene& scene, const FixedDoFs& fixed, scalar dt )
+{
+  const int ndofs = (int) scene.getX().size();
+  m_sumx.setZero(ndofs);
+  m_sumv.setZero(ndofs);
+
+  m_dx.setZero(ndofs);
+  m_dv.setZero(ndofs);
+  stage(scene, fixed, 1.0);
+
+  m_dx = (0.5*dt)*m_kx;
+  m_dv = (0.5*dt)*m_ka;
+  stage(scene, fixed, 2.0);
+
+  m_dx = (0.5*dt)*m_kx;
+  m_dv = (0.5*dt)*m_ka;
+  stage(scene, fixed, 2.0);
+
+  m_dx = dt*m_kx;
+  m_dv = dt*m_ka;
+  stage(scene, fixed, 1.0);
+
+  scene.getX() += (dt/6.0)*m_sumx;
+  scene.getV() += (dt/6.0)*m_sumv;
+}
@@ -0,0 +1,344 @@
+#include "SceneEnsemble.h"
+
+#include "SpringForce.h"
+#include "SpringForceBatch.h"
+#include "UniformFieldForce.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+namespace
+{
+
+void complain( const std::string& what )
+{
+  std::cerr << "\033[31;1mERROR IN SCENEENSEMBLE:\033[m " << what << std::endl;
+}
+
+// Splits "name:index" into its parts; index is -1 for a bare name.
+bool parseColumn( const std::string& column, std::string& name, int& index )
+{
+  const std::string::size_type colon = column.find(':');
+  name = column.substr( 0, colon );
+  index = -1;
+  if( colon == std::string::npos ) return true;
+  const char* begin = column.c_str() + colon + 1;
+  char* end = NULL;
+  const long value = strtol( begin, &end, 10 );
+  if( end == begin || *end != '\0' || value < 0 ) return false;
+  index = (int) value;
+  return true;
+}
+
+// Sets member e of every entry of values in [ begin, end ) of a
+// member-innermost array with K members.
+void setMembers( std::vector<scalar>& values, int begin, int end, int K, int e, const scalar& value )
+{
+  for( int i = begin; i < end; ++i ) values[i*K + e] = value;
+}
+
+// One spring's K members, as SpringForceBatch::evaluateSpring evaluates the
+// spring, so each member gets exactly the gradient its own scene would. The
+// four gradient rows are distinct, as a spring's endpoints are, and belong to
+// another array than the inputs, so none of the arrays alias and the loop
+// vectorizes without a run-time check of every pair.
+void accumulateSpringMembers( int K, const scalar* EIGEN_RESTRICT xi, const scalar* EIGEN_RESTRICT yi, const scalar* EIGEN_RESTRICT xj, const scalar* EIGEN_RESTRICT yj,
+                              const scalar* EIGEN_RESTRICT vxi, const scalar* EIGEN_RESTRICT vyi, const scalar* EIGEN_RESTRICT vxj, const scalar* EIGEN_RESTRICT vyj,
+                              const scalar* EIGEN_RESTRICT k, const scalar* EIGEN_RESTRICT l0, const scalar* EIGEN_RESTRICT b,
+                              scalar* EIGEN_RESTRICT gxi, scalar* EIGEN_RESTRICT gyi, scalar* EIGEN_RESTRICT gxj, scalar* EIGEN_RESTRICT gyj )
+{
+  for( int e = 0; e < K; ++e )
+  {
+    const scalar dx = xj[e] - xi[e];
+    const scalar dy = yj[e] - yi[e];
+    const scalar l = std::sqrt( dx*dx + dy*dy );
+    const scalar nx = dx/l;
+    const scalar ny = dy/l;
+    const scalar c = k[e]*( l - l0[e] ) + b[e]*( nx*( vxj[e] - vxi[e] ) + ny*( vyj[e] - vyi[e] ) );
+    gxi[e] -= c*nx;
+    gyi[e] -= c*ny;
+    gxj[e] += c*nx;
+    gyj[e] += c*ny;
+  }
+}
+
+}
+
+SceneEnsemble::SceneEnsemble()
+: m_members(0)
+, m_ndofs(0)
+, m_x()
+, m_v()
+, m_m()
+, m_inverse_masses()
+, m_first()
+, m_second()
+, m_k()
+, m_l0()
+, m_b()
+, m_gx()
+, m_gy()
+, m_drag()
+, m_terms()
+, m_gradU()
+{}
+
+bool SceneEnsemble::build( const TwoDScene& scene, const std::string& tablefile )
+{
+  std::ifstream ifs( tablefile.c_str() );
+  if( !ifs )
+  {
+    complain( "Failed to open " + tablefile + "." );
+    return false;
+  }
+  std::vector<std::string> columns;
+  std::vector<std::vector<scalar> > rows;
+  std::string line;
+  for( int number = 1; std::getline( ifs, line ); ++number )
+  {
+    std::istringstream words( line );
+    std::string word;
+    if( !( words >> word ) || word[0] == '#' ) continue;
+    words.seekg( 0 );
+    if( columns.empty() )
+    {
+      while( words >> word ) columns.push_back( word );
+      continue;
+    }
+    std::vector<scalar> row;
+    scalar value;
+    while( words >> value ) row.push_back( value );
+    if( row.size() != columns.size() || !words.eof() )
+    {
+      std::ostringstream what;
+      what << tablefile << ":" << number << " does not have a number for each of the " << columns.size() << " columns.";
+      complain( what.str() );
+      return false;
+    }
+    rows.push_back( row );
+  }
+  if( rows.empty() )
+  {
+    complain( tablefile + " has no members." );
+    return false;
+  }
+
+  const int K = m_members = (int) rows.size();
+  m_ndofs = 2*scene.getNumParticles();
+  m_first.clear();
+  m_second.clear();
+  m_k.clear();
+  m_l0.clear();
+  m_b.clear();
+  m_gx.clear();
+  m_gy.clear();
+  m_drag.clear();
+  m_terms.clear();
+
+  const std::vector<Force*>& forces = scene.getForces();
+  for( std::vector<Force*>::size_type i = 0; i < forces.size(); ++i )
+  {
+    Term term;
+    term.field = false;
+    term.begin = (int) m_first.size();
+    if( SpringForceBatch* springs = dynamic_cast<SpringForceBatch*>(forces[i]) )
+    {
+      for( int s = 0; s < springs->getNumSprings(); ++s )
+      {
+        m_first.push_back( springs->getEndpoints(s).first );
+        m_second.push_back( springs->getEndpoints(s).second );
+        m_k.insert( m_k.end(), K, springs->getStiffness(s) );
+        m_l0.insert( m_l0.end(), K, springs->getRestLength(s) );
+        m_b.insert( m_b.end(), K, springs->getDamping(s) );
+      }
+    }
+    else if( SpringForce* spring = dynamic_cast<SpringForce*>(forces[i]) )
+    {
+      m_first.push_back( spring->getEndpoints().first );
+      m_second.push_back( spring->getEndpoints().second );
+      m_k.insert( m_k.end(), K, spring->getStiffness() );
+      m_l0.insert( m_l0.end(), K, spring->getRestLength() );
+      m_b.insert( m_b.end(), K, spring->getDamping() );
+    }
+    else if( UniformFieldForce* field = dynamic_cast<UniformFieldForce*>(forces[i]) )
+    {
+      term.field = true;
+      term.begin = (int) m_drag.size()/K;
+      m_gx.insert( m_gx.end(), K, field->getGravity().x() );
+      m_gy.insert( m_gy.end(), K, field->getGravity().y() );
+      m_drag.insert( m_drag.end(), K, field->getDamping() );
+    }
+    else
+    {
+      complain( "Ensembles only evaluate springs, gravity and drag." );
+      return false;
+    }
+    term.end = term.field ? term.begin + 1 : (int) m_first.size();
+    m_terms.push_back( term );
+  }
+
+  m_x.resize( m_ndofs*K );
+  m_v.resize( m_ndofs*K );
+  m_m.resize( m_ndofs*K );
+  for( int d = 0; d < m_ndofs; ++d )
+  {
+    for( int e = 0; e < K; ++e )
+    {
+      m_x[d*K + e] = scene.getX()(d);
+      m_v[d*K + e] = scene.getV()(d);
+      m_m[d*K + e] = scene.getM()(d);
+    }
+  }
+
+  for( std::vector<std::string>::size_type c = 0; c < columns.size(); ++c )
+  {
+    for( int e = 0; e < K; ++e )
+    {
+      if( !setColumn( columns[c], e, rows[e][c] ) )
+      {
+        complain( "Column " + columns[c] + " of " + tablefile + " names nothing in the scene, or sets a mass that is not positive." );
+        return false;
+      }
+    }
+  }
+
+  m_inverse_masses.resize( m_ndofs*K );
+  for( int d = 0; d < m_ndofs; ++d )
+    for( int e = 0; e < K; ++e )
+      m_inverse_masses[d*K + e] = scene.isFixed( d/2 ) ? 0.0 : 1.0/m_m[d*K + e];
+
+  m_gradU.assign( m_ndofs*K, 0.0 );
+  return true;
+}
+
+bool SceneEnsemble::setColumn( const std::string& column, int e, const scalar& value )
+{
+  std::string name;
+  int index;
+  if( !parseColumn( column, name, index ) ) return false;
+  const int K = m_members;
+  const int nparticles = m_ndofs/2;
+  const int nsprings = (int) m_first.size();
+  const int nfields = (int) m_drag.size()/K;
+
+  if( name == "x" || name == "y" || name == "vx" || name == "vy" || name == "m" )
+  {
+    if( index < 0 || index >= nparticles ) return false;
+    const int d = 2*index + ( name == "y" || name == "vy" ? 1 : 0 );
+    if( name == "x" || name == "y" ) m_x[d*K + e] = value;
+    else if( name == "vx" || name == "vy" ) m_v[d*K + e] = value;
+    else
+    {
+      if( !( value > 0.0 ) ) return false;
+      setMembers( m_m, d, d + 2, K, e, value );
+    }
+    return true;
+  }
+
+  if( name == "k" || name == "l0" || name == "b" )
+  {
+    if( index >= nsprings ) return false;
+    std::vector<scalar>& values = name == "k" ? m_k : name == "l0" ? m_l0 : m_b;
+    if( index < 0 ) setMembers( values, 0, nsprings, K, e, value );
+    else setMembers( values, index, index + 1, K, e, value );
+    return true;
+  }
+
+  if( name == "gx" || name == "gy" || name == "drag" )
+  {
+    if( index >= 0 || nfields == 0 ) return false;
+    setMembers( name == "gx" ? m_gx : name == "gy" ? m_gy : m_drag, 0, nfields, K, e, value );
+    return true;
+  }
+
+  return false;
+}
+
+int SceneEnsemble::getNumMembers() const
+{
+  return m_members;
+}
+
+void SceneEnsemble::accumulateSprings( const Term& term )
+{
+  const int K = m_members;
+  for( int s = term.begin; s < term.end; ++s )
+  {
+    const int i = 2*m_first[s]*K;
+    const int j = 2*m_second[s]*K;
+    accumulateSpringMembers( K, &m_x[i], &m_x[i + K], &m_x[j], &m_x[j + K], &m_v[i], &m_v[i + K], &m_v[j], &m_v[j + K],
+                             &m_k[s*K], &m_l0[s*K], &m_b[s*K], &m_gradU[i], &m_gradU[i + K], &m_gradU[j], &m_gradU[j + K] );
+  }
+}
+
+// As UniformFieldForce::addGradEToTotal, gradE += b v - m g.
+void SceneEnsemble::accumulateField( const Term& term )
+{
+  const int K = m_members;
+  const scalar* gx = &m_gx[term.begin*K];
+  const scalar* gy = &m_gy[term.begin*K];
+  const scalar* drag = &m_drag[term.begin*K];
+  for( int d = 0; d < m_ndofs; d += 2 )
+  {
+    const scalar* vx = &m_v[d*K];
+    const scalar* vy = &m_v[( d + 1 )*K];
+    const scalar* mx = &m_m[d*K];
+    const scalar* my = &m_m[( d + 1 )*K];
+    scalar* g_x = &m_gradU[d*K];
+    scalar* g_y = &m_gradU[( d + 1 )*K];
+    for( int e = 0; e < K; ++e )
+    {
+      g_x[e] += drag[e]*vx[e] - mx[e]*gx[e];
+      g_y[e] += drag[e]*vy[e] - my[e]*gy[e];
+    }
+  }
+}
+
+void SceneEnsemble::step( const scalar& dt )
+{
+  std::fill( m_gradU.begin(), m_gradU.end(), 0.0 );
+  for( std::vector<Term>::size_type t = 0; t < m_terms.size(); ++t )
+  {
+    if( m_terms[t].field ) accumulateField( m_terms[t] );
+    else accumulateSprings( m_terms[t] );
+  }
+
+  const int n = (int) m_x.size();
+  for( int i = 0; i < n; ++i )
+  {
+    m_v[i] += dt*( m_gradU[i]*-m_inverse_masses[i] );
+    m_x[i] += dt*m_v[i];
+  }
+}
+
+void SceneEnsemble::copyMember( int e, TwoDScene& scene ) const
+{
+  assert( e >= 0 );
+  assert( e < m_members );
+  assert( scene.getX().size() == m_ndofs );
+
+  VectorXs& x = scene.getX();
+  VectorXs& v = scene.getV();
+  for( int d = 0; d < m_ndofs; ++d )
+  {
+    x(d) = m_x[d*m_members + e];
+    v(d) = m_v[d*m_members + e];
+  }
+}
+
+void SceneEnsemble::write( std::ostream& os ) const
+{
+  if( m_ndofs == 0 ) return;
+  std::vector<scalar> member( m_ndofs );
+  for( int e = 0; e < m_members; ++e )
+  {
+    for( int d = 0; d < m_ndofs; ++d ) member[d] = m_x[d*m_members + e];
+    os.write( reinterpret_cast<const char*>( &member[0] ), m_ndofs*sizeof(scalar) );
+    for( int d = 0; d < m_ndofs; ++d ) member[d] = m_v[d*m_members + e];
+    os.write( reinterpret_cast<const char*>( &member[0] ), m_ndofs*sizeof(scalar) );
+  }
+}
@@ -0,0 +1,99 @@
+#ifndef __SCENE_ENSEMBLE_H__
+#define __SCENE_ENSEMBLE_H__
+
+#include <iosfwd>
+#include <string>
+#include <vector>
+
+#include "MathDefs.h"
+#include "TwoDScene.h"
+
+// K copies of a scene that share its particles, springs and fixed set but
+// each have their own initial state, masses, spring constants and field, for
+// parameter sweeps. Every per-DoF and per-spring array stores the members
+// innermost, as value[index*K + member], so a spring's K copies are evaluated
+// by one loop over contiguous memory, which the compiler vectorizes, and the
+// spring's endpoints and the loop overhead are paid once for all K.
+//
+// Members are read from a parameter table, a whitespace separated text file
+// whose first line names the columns and whose every further line is one
+// member. Lines starting with # are skipped. A column is one of
+//
+//   x:i y:i vx:i vy:i m:i   position, velocity or mass of particle i
+//   k:s l0:s b:s            stiffness, rest length or damping of spring s
+//   k l0 b                  the same for every spring
+//   gx gy drag              gravity and drag of the uniform field
+//
+// and anything not in the table is as in the scene. Springs are numbered in
+// the order the scene holds them.
+//
+// The base library's parser and stepping loop handle a single TwoDScene, so
+// the ensemble is stepped in place of the scene by symplectic Euler (built
+// with USE_ENSEMBLE), which copies one member back into the scene to be
+// displayed and written out.
+class SceneEnsemble
+{
+public:
+  SceneEnsemble();
+
+  // Builds the members from a batched scene and a parameter table. Returns
+  // false, having said why, if the table cannot be read, names a particle or
+  // spring the scene does not have, or the scene has forces other than
+  // springs, gravity and drag.
+  bool build( const TwoDScene& scene, const std::string& tablefile );
+
+  int getNumMembers() const;
+
+  // One symplectic Euler step of every member, v += dt*a(x,v), x += dt*v.
+  void step( const scalar& dt );
+
+  // Copies member e's positions and velocities into a scene of the same
+  // particles.
+  void copyMember( int e, TwoDScene& scene ) const;
+
+  // Appends every member's positions and then velocities, member by member,
+  // as raw scalars.
+  void write( std::ostream& os ) const;
+
+private:
+  // A run of springs or a uniform field, in the order of the scene's forces,
+  // so that each DoF sums its forces in the same order as the scene does.
+  struct Term
+  {
+    bool field;
+    // Springs [ begin, end ), or the field's index.
+    int begin;
+    int end;
+  };
+
+  bool setColumn( const std::string& column, int member, const scalar& value );
+
+  void accumulateSprings( const Term& term );
+  void accumulateField( const Term& term );
+
+  int m_members;
+  int m_ndofs;
+
+  // Member-innermost state, with zero inverse masses on fixed DoFs.
+  std::vector<scalar> m_x;
+  std::vector<scalar> m_v;
+  std::vector<scalar> m_m;
+  std::vector<scalar> m_inverse_masses;
+
+  std::vector<int> m_first;
+  std::vector<int> m_second;
+  std::vector<scalar> m_k;
+  std::vector<scalar> m_l0;
+  std::vector<scalar> m_b;
+
+  std::vector<scalar> m_gx;
+  std::vector<scalar> m_gy;
+  std::vector<scalar> m_drag;
+
+  std::vector<Term> m_terms;
+
+  // The step's gradU, reused from step to step.
+  std::vector<scalar> m_gradU;
+};
+
+#endif
@@ -0,0 +1,69 @@
+#include "SceneState.h"
+
+#include <cassert>
+
+SceneState::SceneState()
+: m_x()
+, m_v()
+, m_m()
+, m_fixed()
+, m_radii()
+{}
+
+SceneState::SceneState( const TwoDScene& scene )
+: m_x()
+, m_v()
+, m_m()
+, m_fixed()
+, m_radii()
+{
+  capture(scene);
+}
+
+void SceneState::capture( const TwoDScene& scene )
+{
+  const int n = scene.getNumParticles();
+  m_x = scene.getX();
+  m_v = scene.getV();
+  m_m = scene.getM();
+  m_fixed.resize(n);
+  for( int i = 0; i < n; ++i ) m_fixed[i] = scene.isFixed(i);
+  m_radii = scene.getRadii();
+}
+
+void SceneState::restore( TwoDScene& scene ) const
+{
+  const int n = getNumParticles();
+  assert( scene.getNumParticles() == n );
+
+  scene.getX() = m_x;
+  scene.getV() = m_v;
+  scene.getM() = m_m;
+  // The setters are only called for what changed; most restores touch
+  // neither flags nor radii.
+  for( int i = 0; i < n; ++i )
+  {
+    if( scene.isFixed(i) != bool(m_fixed[i]) ) scene.setFixed(i,m_fixed[i]);
+    if( scene.getRadius(i) != m_radii[i] ) scene.setRadius(i,m_radii[i]);
+  }
+}
+
+int SceneState::getNumParticles() const
+{
+  return int(m_x.size())/2;
+}
+
+const VectorXs& SceneState::getX() const
+{
+  return m_x;
+}
+
+const VectorXs& SceneState::getV() const
+{
+  return m_v;
+}
+
+const VectorXs& SceneState::getM() const
+{
+  return m_m;
+}
@@ -0,0 +1,48 @@
+#ifndef __SCENE_STATE_H__
+#define __SCENE_STATE_H__
+
+#include <vector>
+
+#include "MathDefs.h"
+#include "TwoDScene.h"
+
+// Checkpoint of the parts of a scene that change while it is simulated:
+// positions, velocities, masses, fixed flags and radii. Copying a TwoDScene
+// or calling copyState deep-copies every force through createNewCopy() and
+// every particle tag; edges, forces and tags do not change during a run, so
+// a snapshot leaves them with the scene it is restored into and only copies
+// flat arrays. Capturing, copying and restoring are then plain copies of
+// O(#particles) scalars.
+//
+// restore() expects a scene with the topology the snapshot was taken from,
+// the same scene or a copy of it; the particle counts are asserted.
+class SceneState
+{
+public:
+  SceneState();
+
+  explicit SceneState( const TwoDScene& scene );
+
+  void capture( const TwoDScene& scene );
+
+  void restore( TwoDScene& scene ) const;
+
+  int getNumParticles() const;
+
+  const VectorXs& getX() const;
+
+  const VectorXs& getV() const;
+
+  const VectorXs& getM() const;
+
+private:
+  VectorXs m_x;
+  VectorXs m_v;
+  VectorXs m_m;
+  // TwoDScene keeps the flags in a std::vector<bool>; a byte per particle
+  // is cheaper to compare and copy.
+  std::vector<unsigned char> m_fixed;
+  std::vector<scalar> m_radii;
+};
+
+#endif
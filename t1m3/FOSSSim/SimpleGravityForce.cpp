@@ -21,3 +21,41 @@ void SimpleGravityForce::addHessVToTotal( const VectorXs& x, const VectorXs& v,
     
   // Nothing to do.
 }
+
+void SimpleGravityForce::addHessXToTotal( const VectorXs& x, const VectorXs& v, const VectorXs& m, TripletXs& hessE )
+{
+  assert( x.size() == v.size() );
+  assert( x.size() == m.size() );
+  assert( x.size()%2 == 0 );
+
+  // Nothing to do.
+}
+
+void SimpleGravityForce::addHessVToTotal( const VectorXs& x, const VectorXs& v, const VectorXs& m, TripletXs& hessE )
+{
+  assert( x.size() == v.size() );
+  assert( x.size() == m.size() );
+  assert( x.size()%2 == 0 );
+
+  // Nothing to do.
+}
+
+void SimpleGravityForce::addHessXVProductToTotal( const VectorXs& x, const VectorXs& v, const VectorXs& m, const VectorXs& dx, VectorXs& out )
+{
+  assert( x.size() == v.size() );
+  assert( x.size() == m.size() );
+  assert( x.size() == dx.size() );
+  assert( x.size() == out.size() );
+
+  // Nothing to do.
+}
+
+void SimpleGravityForce::addHessVVProductToTotal( const VectorXs& x, const VectorXs& v, const VectorXs& m, const VectorXs& dv, VectorXs& out )
+{
+  assert( x.size() == v.size() );
+  assert( x.size() == m.size() );
+  assert( x.size() == dv.size() );
+  assert( x.size() == out.size() );
+
+  // Nothing to do.
+}
@@ -0,0 +1,217 @@
+#include "SparseSystemSolver.h"
+
+#include <algorithm>
+#include <limits>
+#ifdef __SSE__
+#include <xmmintrin.h>
+#endif
+
+#ifdef MIXED_PRECISION_LDLT
+// Refinement stops once the residual is this small relative to b, or gives
+// up, and falls back to double, once a correction fails to shrink it by
+// MIXED_PRECISION_CONTRACTION or MIXED_PRECISION_MAX_REFINEMENTS have been
+// taken. Each correction gains about as many bits as float's 24 less the
+// log2 of A's condition number, so a well-conditioned system converges in
+// two or three.
+static const scalar MIXED_PRECISION_TOLERANCE = 1.0e-12;
+static const scalar MIXED_PRECISION_CONTRACTION = 0.5;
+static const int MIXED_PRECISION_MAX_REFINEMENTS = 10;
+
+// Flushes float denormals to zero while in scope. The fill-in of a factor
+// decays geometrically away from the diagonal and in float reaches the
+// denormal range, where x86 arithmetic is about a hundred times slower;
+// those entries are far below what float resolves anyway, and refinement
+// makes up for dropping them.
+class FlushDenormals
+{
+public:
+#ifdef __SSE__
+  FlushDenormals() : m_csr( _mm_getcsr() ) { _mm_setcsr( m_csr | 0x8040 ); }
+  ~FlushDenormals() { _mm_setcsr( m_csr ); }
+private:
+  unsigned int m_csr;
+#endif
+};
+#endif
+
+void assembleImplicitSystem( TwoDScene& scene, const FixedDoFs& fixed, scalar dt, const VectorXs& dx, const VectorXs& dv, SparseMatrixXs& A )
+{
+  // Reused across calls, so that the triplet lists keep their capacity.
+  static TripletXs hessX, hessV;
+  hessX.clear();
+  hessV.clear();
+  scalar E = 0.0;
+  VectorXs gradE;
+  scene.evaluateForces( EVALUATE_HESSX | EVALUATE_HESSV, E, gradE, hessX, hessV, dx, dv );
+  assembleImplicitSystem( scene.getM(), fixed, dt, hessX, hessV, A );
+}
+
+void assembleImplicitSystem( const VectorXs& m, const FixedDoFs& fixed, scalar dt, const TripletXs& hessX, const TripletXs& hessV, SparseMatrixXs& A )
+{
+  // Summed in block form, which drops the fixed rows and columns as it goes.
+  // While the topology holds, each triplet goes straight to its block slot
+  // and each block value to its place in A, so a step neither sorts nor
+  // allocates.
+  static BlockSparseMatrix2 block;
+  block.assemble( m, fixed, dt*dt, hessX, dt, hessV );
+  block.toSparse(A);
+}
+
+static bool isSymmetric( const SparseMatrixXs& A )
+{
+  SparseMatrixXs At = A.transpose();
+  scalar scale = A.norm();
+  return ( A - At ).norm() <= 1.0e-12*( scale > 1.0 ? scale : 1.0 );
+}
+
+SparseSystemSolver::SparseSystemSolver()
+: m_outer()
+, m_inner()
+, m_values()
+, m_factored(false)
+, m_ldlt()
+, m_lu()
+, m_ldlt_analyzed(false)
+, m_lu_analyzed(false)
+, m_use_ldlt(true)
+#ifdef MIXED_PRECISION_LDLT
+, m_ldltf()
+, m_A(NULL)
+, m_bf()
+, m_residual()
+, m_ldltf_analyzed(false)
+, m_use_float(false)
+#endif
+{}
+
+bool SparseSystemSolver::updatePattern( const SparseMatrixXs& A )
+{
+  assert( A.isCompressed() );
+  const int* outerptr = A.outerIndexPtr();
+  const int* innerptr = A.innerIndexPtr();
+  const int nouter = A.outerSize()+1;
+  const int ninner = A.nonZeros();
+
+  if( int(m_outer.size()) == nouter && int(m_inner.size()) == ninner &&
+      std::equal( m_outer.begin(), m_outer.end(), outerptr ) &&
+      std::equal( m_inner.begin(), m_inner.end(), innerptr ) ) return false;
+
+  m_outer.assign( outerptr, outerptr+nouter );
+  m_inner.assign( innerptr, innerptr+ninner );
+  m_ldlt_analyzed = false;
+  m_lu_analyzed = false;
+#ifdef MIXED_PRECISION_LDLT
+  m_ldltf_analyzed = false;
+#endif
+  m_factored = false;
+  return true;
+}
+
+bool SparseSystemSolver::sameValues( const SparseMatrixXs& A )
+{
+  const scalar* values = A.valuePtr();
+  const int nvalues = A.nonZeros();
+  if( m_factored && int(m_values.size()) == nvalues && std::equal( m_values.begin(), m_values.end(), values ) ) return true;
+  m_values.assign( values, values+nvalues );
+  return false;
+}
+
+bool SparseSystemSolver::factorizeLDLT( const SparseMatrixXs& A )
+{
+  if( !m_ldlt_analyzed ) { m_ldlt.analyzePattern(A); m_ldlt_analyzed = true; }
+  m_ldlt.factorize(A);
+  return m_ldlt.info() == Eigen::Success;
+}
+
+bool SparseSystemSolver::factorize( const SparseMatrixXs& A )
+{
+  updatePattern(A);
+#ifdef MIXED_PRECISION_LDLT
+  m_A = &A;
+#endif
+  if( sameValues(A) ) return true;
+
+  m_factored = factorizeNumeric(A);
+  return m_factored;
+}
+
+bool SparseSystemSolver::factorizeNumeric( const SparseMatrixXs& A )
+{
+  m_use_ldlt = isSymmetric(A);
+  if( m_use_ldlt )
+  {
+#ifdef MIXED_PRECISION_LDLT
+    m_use_float = A.nonZeros() == 0 || Eigen::Map<const VectorXs>( A.valuePtr(), A.nonZeros() ).cwiseAbs().maxCoeff() < std::numeric_limits<float>::max();
+    if( m_use_float )
+    {
+      FlushDenormals flush;
+      const Eigen::SparseMatrix<float> Af = A.cast<float>();
+      if( !m_ldltf_analyzed ) { m_ldltf.analyzePattern(Af); m_ldltf_analyzed = true; }
+      m_ldltf.factorize(Af);
+      m_use_float = m_ldltf.info() == Eigen::Success;
+      if( m_use_float ) return true;
+    }
+#endif
+    return factorizeLDLT(A);
+  }
+
+  if( !m_lu_analyzed ) { m_lu.analyzePattern(A); m_lu_analyzed = true; }
+  m_lu.factorize(A);
+  return m_lu.info() == Eigen::Success;
+}
+
+VectorXs SparseSystemSolver::solve( const VectorXs& b )
+{
+  VectorXs x;
+  solve(b,x);
+  return x;
+}
+
+void SparseSystemSolver::solve( const VectorXs& b, VectorXs& x )
+{
+#ifdef MIXED_PRECISION_LDLT
+  if( m_use_ldlt && m_use_float )
+  {
+    if( refine(b,x) ) return;
+    // The double factorization serves the remaining solves with this A.
+    m_use_float = false;
+    if( !factorizeLDLT(*m_A) )
+    {
+      m_factored = false;
+      x.setConstant(b.size(),std::numeric_limits<scalar>::quiet_NaN());
+      return;
+    }
+  }
+#endif
+  if( m_use_ldlt ) x = m_ldlt.solve(b);
+  else x = m_lu.solve(b);
+}
+
+#ifdef MIXED_PRECISION_LDLT
+bool SparseSystemSolver::refine( const VectorXs& b, VectorXs& x )
+{
+  const SparseMatrixXs& A = *m_A;
+  const scalar bnorm = b.norm();
+
+  if( bnorm == 0.0 ) { x.setZero(b.size()); return true; }
+  FlushDenormals flush;
+
+  // Right-hand sides are scaled into float's range before they are rounded.
+  m_bf = ( b/bnorm ).cast<float>();
+  x = bnorm*m_ldltf.solve(m_bf).cast<scalar>();
+  scalar previous = std::numeric_limits<scalar>::infinity();
+  for( int i = 0; i <= MIXED_PRECISION_MAX_REFINEMENTS; ++i )
+  {
+    m_residual = b;
+    m_residual.noalias() -= A*x;
+    const scalar rnorm = m_residual.norm();
+    if( rnorm <= MIXED_PRECISION_TOLERANCE*bnorm ) return true;
+    // Also false for a NaN residual.
+    if( !( rnorm < MIXED_PRECISION_CONTRACTION*previous ) || i == MIXED_PRECISION_MAX_REFINEMENTS ) return false;
+    previous = rnorm;
+    m_bf = ( m_residual/rnorm ).cast<float>();
+    x += rnorm*m_ldltf.solve(m_bf).cast<scalar>();
+  }
+  return false;
+}
+#endif
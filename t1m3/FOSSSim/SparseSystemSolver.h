@@ -0,0 +1,97 @@
+#ifndef __SPARSE_SYSTEM_SOLVER_H__
+#define __SPARSE_SYSTEM_SOLVER_H__
+
+#include <Eigen/SparseCholesky>
+#include <Eigen/SparseLU>
+#include <vector>
+
+#include "MathDefs.h"
+#include "TwoDScene.h"
+#include "FixedDoFs.h"
+#include "BlockSparseMatrix.h"
+
+// Assembles M + dt^2 d2U/dx2 + dt d2U/dxdv, evaluated at the scene's state
+// offset by (dx, dv), over the free DoFs of fixed only. Right-hand sides and
+// solutions go through fixed.gatherFree and fixed.scatterFree. The sparsity
+// pattern depends only on the scene's topology and fixed set.
+void assembleImplicitSystem( TwoDScene& scene, const FixedDoFs& fixed, scalar dt, const VectorXs& dx, const VectorXs& dv, SparseMatrixXs& A );
+
+// As above, from the position and velocity Hessian triplets at the offset
+// state, e.g. as evaluated by TwoDScene::evaluateForces alongside the
+// gradient.
+void assembleImplicitSystem( const VectorXs& m, const FixedDoFs& fixed, scalar dt, const TripletXs& hessX, const TripletXs& hessV, SparseMatrixXs& A );
+
+// Factors sparse systems with SimplicialLDLT, or SparseLU when the matrix is
+// not symmetric (e.g. velocity-dependent spring damping). The symbolic
+// analysis is kept and reused until the sparsity pattern changes, and the
+// numerical factorization until the values change too: a system whose forces
+// all have constant Hessians (zero rest length springs without damping,
+// linear drag, simple gravity), stepped at a constant dt with an unchanged
+// fixed set, is factored once and then costs a solve per step.
+//
+// Defining MIXED_PRECISION_LDLT (CMake option USE_MIXED_PRECISION_LDLT)
+// factors symmetric systems in float, which halves the memory of the factor
+// and the bandwidth of its solves, and brings each solution to double
+// accuracy by iterative refinement: the residual b - A x is taken in double
+// against A and corrected through the float factor, until it is within
+// MIXED_PRECISION_TOLERANCE of b. If refinement stops converging, as for a
+// system too ill-conditioned for float, or A does not fit in float or its
+// float factorization fails, A is factored in double after all and the
+// solve starts again from it. A must then outlive the solves that follow its
+// factorization, as the callers' reused systems do.
+class SparseSystemSolver
+{
+public:
+  SparseSystemSolver();
+
+  // Returns false if the numerical factorization fails. Returns at once if
+  // A is the matrix last factored, entry for entry.
+  bool factorize( const SparseMatrixXs& A );
+
+  // Not const: a mixed-precision solve that falls back factors A in double.
+  VectorXs solve( const VectorXs& b );
+
+  // As above, into x, which keeps its storage if already sized.
+  void solve( const VectorXs& b, VectorXs& x );
+
+private:
+  // Returns true if A's pattern differs from the cached one, and records it.
+  bool updatePattern( const SparseMatrixXs& A );
+
+  // Returns true if A's values are those of the current factorization, and
+  // records them otherwise.
+  bool sameValues( const SparseMatrixXs& A );
+
+  // Factors A whatever the cached state. Returns false if that fails.
+  bool factorizeNumeric( const SparseMatrixXs& A );
+
+  bool factorizeLDLT( const SparseMatrixXs& A );
+
+#ifdef MIXED_PRECISION_LDLT
+  // Returns false if refinement did not converge.
+  bool refine( const VectorXs& b, VectorXs& x );
+#endif
+
+  std::vector<int> m_outer;
+  std::vector<int> m_inner;
+  std::vector<scalar> m_values;
+  // Whether the current factorization is of m_values.
+  bool m_factored;
+  Eigen::SimplicialLDLT<SparseMatrixXs> m_ldlt;
+  Eigen::SparseLU<SparseMatrixXs> m_lu;
+  bool m_ldlt_analyzed;
+  bool m_lu_analyzed;
+  bool m_use_ldlt;
+
+#ifdef MIXED_PRECISION_LDLT
+  Eigen::SimplicialLDLT<Eigen::SparseMatrix<float> > m_ldltf;
+  const SparseMatrixXs* m_A;
+  Eigen::VectorXf m_bf;
+  VectorXs m_residual;
+  bool m_ldltf_analyzed;
+  // Whether the current factorization is m_ldltf's.
+  bool m_use_float;
+#endif
+};
+
+#endif
@@ -0,0 +1,47 @@
+#ifndef __SPARSE_UTILITIES_H__
+#define __SPARSE_UTILITIES_H__
+
+#include "MathDefs.h"
+
+namespace sparseutils
+{
+
+// Appends the 2x2 block B at particle position (i,j), i.e. at DoFs (2i,2j).
+inline void addBlock( int i, int j, const Matrix2s& B, TripletXs& triplets )
+{
+  triplets.push_back( Triplet( 2*i,   2*j,   B(0,0) ) );
+  triplets.push_back( Triplet( 2*i,   2*j+1, B(0,1) ) );
+  triplets.push_back( Triplet( 2*i+1, 2*j,   B(1,0) ) );
+  triplets.push_back( Triplet( 2*i+1, 2*j+1, B(1,1) ) );
+}
+
+// Appends the stencil [ B -B; -B B ] coupling particles i and j, the form
+// taken by every two-particle force Hessian.
+inline void addPairBlocks( int i, int j, const Matrix2s& B, TripletXs& triplets )
+{
+  addBlock( i, i,  B, triplets );
+  addBlock( j, j,  B, triplets );
+  addBlock( i, j, -B, triplets );
+  addBlock( j, i, -B, triplets );
+}
+
+// Dense counterpart of addPairBlocks.
+inline void addPairBlocks( int i, int j, const Matrix2s& B, MatrixXs& A )
+{
+  A.block<2,2>(2*i,2*i) += B;
+  A.block<2,2>(2*j,2*j) += B;
+  A.block<2,2>(2*i,2*j) -= B;
+  A.block<2,2>(2*j,2*i) -= B;
+}
+
+// Matrix-free counterpart of addPairBlocks: out += [ B -B; -B B ] p.
+inline void addPairProduct( int i, int j, const Matrix2s& B, const VectorXs& p, VectorXs& out )
+{
+  Vector2s Bp = B*( p.segment<2>(2*i) - p.segment<2>(2*j) );
+  out.segment<2>(2*i) += Bp;
+  out.segment<2>(2*j) -= Bp;
+}
+
+}
+
+#endif
@@ -1,4 +1,41 @@
 #include "SpringForce.h"
+#include "SparseUtilities.h"
+
+// Every block of the spring's Hessians has the stencil [ B -B; -B B ], so the
+// dense and sparse paths below share these helpers and differ only in how the
+// blocks are scattered.
+
+static Matrix2s springHessXBlock( const VectorXs& x, const VectorXs& v, const std::pair<int,int>& endpoints, const scalar& k, const scalar& l0, const scalar& b )
+{
+  Vector2s nhat = x.segment<2>(2*endpoints.second) - x.segment<2>(2*endpoints.first);
+  scalar l = nhat.norm();
+  assert( l != 0.0 );
+  nhat /= l;
+
+  Matrix2s P = nhat*nhat.transpose();
+  Matrix2s I = Matrix2s::Identity();
+
+  // Contribution from elastic component. A zero rest length spring's is
+  // exactly k I, constant, so that a system of such springs can keep its
+  // factorization (see SparseSystemSolver).
+  Matrix2s B = l0 == 0.0 ? Matrix2s( k*I ) : Matrix2s( k*( P + (1.0 - l0/l)*(I - P) ) );
+
+  // Contribution from damping
+  if( b != 0.0 )
+  {
+    Vector2s dv = v.segment<2>(2*endpoints.second) - v.segment<2>(2*endpoints.first);
+    B += (b/l)*( nhat.dot(dv)*I + nhat*dv.transpose() )*( I - P );
+  }
+
+  return B;
+}
+
+static Matrix2s springHessVBlock( const VectorXs& x, const std::pair<int,int>& endpoints, const scalar& b )
+{
+  Vector2s nhat = x.segment<2>(2*endpoints.second) - x.segment<2>(2*endpoints.first);
+  nhat.normalize();
+  return b*nhat*nhat.transpose();
+}
 
 void SpringForce::addHessXToTotal( const VectorXs& x, const VectorXs& v, const VectorXs& m, MatrixXs& hessE )
 {
@@ -10,11 +47,7 @@ void SpringForce::addHessXToTotal( const VectorXs& x, const VectorXs& v, const V
   assert( m_endpoints.first >= 0 );  assert( m_endpoints.first < x.size()/2 );
   assert( m_endpoints.second >= 0 ); assert( m_endpoints.second < x.size()/2 );
 
-  // Implement force Jacobian here!
-  
-  // Contribution from elastic component
-
-  // Contribution from damping
+  sparseutils::addPairBlocks( m_endpoints.first, m_endpoints.second, springHessXBlock( x, v, m_endpoints, m_k, m_l0, m_b ), hessE );
 }
 
 void SpringForce::addHessVToTotal( const VectorXs& x, const VectorXs& v, const VectorXs& m, MatrixXs& hessE )
@@ -27,7 +60,55 @@ void SpringForce::addHessVToTotal( const VectorXs& x, const VectorXs& v, const V
   assert( m_endpoints.first >= 0 );  assert( m_endpoints.first < x.size()/2 );
   assert( m_endpoints.second >= 0 ); assert( m_endpoints.second < x.size()/2 );
 
-  // Implement force Jacobian here!
-
   // Contribution from damping
+  if( m_b == 0.0 ) return;
+  sparseutils::addPairBlocks( m_endpoints.first, m_endpoints.second, springHessVBlock( x, m_endpoints, m_b ), hessE );
+}
+
+void SpringForce::addHessXToTotal( const VectorXs& x, const VectorXs& v, const VectorXs& m, TripletXs& hessE )
+{
+  assert( x.size() == v.size() );
+  assert( x.size() == m.size() );
+  assert( x.size()%2 == 0 );
+  assert( m_endpoints.first >= 0 );  assert( m_endpoints.first < x.size()/2 );
+  assert( m_endpoints.second >= 0 ); assert( m_endpoints.second < x.size()/2 );
+
+  sparseutils::addPairBlocks( m_endpoints.first, m_endpoints.second, springHessXBlock( x, v, m_endpoints, m_k, m_l0, m_b ), hessE );
+}
+
+void SpringForce::addHessVToTotal( const VectorXs& x, const VectorXs& v, const VectorXs& m, TripletXs& hessE )
+{
+  assert( x.size() == v.size() );
+  assert( x.size() == m.size() );
+  assert( x.size()%2 == 0 );
+  assert( m_endpoints.first >= 0 );  assert( m_endpoints.first < x.size()/2 );
+  assert( m_endpoints.second >= 0 ); assert( m_endpoints.second < x.size()/2 );
+
+  if( m_b == 0.0 ) return;
+  sparseutils::addPairBlocks( m_endpoints.first, m_endpoints.second, springHessVBlock( x, m_endpoints, m_b ), hessE );
+}
+
+void SpringForce::addHessXVProductToTotal( const VectorXs& x, const VectorXs& v, const VectorXs& m, const VectorXs& dx, VectorXs& out )
+{
+  assert( x.size() == v.size() );
+  assert( x.size() == m.size() );
+  assert( x.size() == dx.size() );
+  assert( x.size() == out.size() );
+  assert( m_endpoints.first >= 0 );  assert( m_endpoints.first < x.size()/2 );
+  assert( m_endpoints.second >= 0 ); assert( m_endpoints.second < x.size()/2 );
+
+  sparseutils::addPairProduct( m_endpoints.first, m_endpoints.second, springHessXBlock( x, v, m_endpoints, m_k, m_l0, m_b ), dx, out );
+}
+
+void SpringForce::addHessVVProductToTotal( const VectorXs& x, const VectorXs& v, const VectorXs& m, const VectorXs& dv, VectorXs& out )
+{
+  assert( x.size() == v.size() );
+  assert( x.size() == m.size() );
+  assert( x.size() == dv.size() );
+  assert( x.size() == out.size() );
+  assert( m_endpoints.first >= 0 );  assert( m_endpoints.first < x.size()/2 );
+  assert( m_endpoints.second >= 0 ); assert( m_endpoints.second < x.size()/2 );
+
+  if( m_b == 0.0 ) return;
+  sparseutils::addPairProduct( m_endpoints.first, m_endpoints.second, springHessVBlock( x, m_endpoints, m_b ), dv, out );
 }
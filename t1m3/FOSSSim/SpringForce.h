@@ -20,9 +20,24 @@ public:
   virtual void addHessXToTotal( const VectorXs& x, const VectorXs& v, const VectorXs& m, MatrixXs& hessE );
   
   virtual void addHessVToTotal( const VectorXs& x, const VectorXs& v, const VectorXs& m, MatrixXs& hessE );
+
+  // Triplet versions used by TwoDScene's sparse accumulators.
+  void addHessXToTotal( const VectorXs& x, const VectorXs& v, const VectorXs& m, TripletXs& hessE );
+
+  void addHessVToTotal( const VectorXs& x, const VectorXs& v, const VectorXs& m, TripletXs& hessE );
+
+  // Hessian-vector products, out += hessE*dx, without forming the Hessian.
+  void addHessXVProductToTotal( const VectorXs& x, const VectorXs& v, const VectorXs& m, const VectorXs& dx, VectorXs& out );
+
+  void addHessVVProductToTotal( const VectorXs& x, const VectorXs& v, const VectorXs& m, const VectorXs& dv, VectorXs& out );
   
   virtual Force* createNewCopy();
 
+  const std::pair<int,int>& getEndpoints() const { return m_endpoints; }
+  const scalar& getStiffness() const { return m_k; }
+  const scalar& getRestLength() const { return m_l0; }
+  const scalar& getDamping() const { return m_b; }
+
 private:
   std::pair<int,int> m_endpoints;
   scalar m_k;
@@ -0,0 +1,255 @@
+#include "SpringForceBatch.h"
+#include "SparseUtilities.h"
+
+#include <algorithm>
+#include <cmath>
+
+SpringForceBatch::SpringForceBatch()
+: PooledForce()
+, m_first()
+, m_second()
+, m_k()
+, m_l0()
+, m_b()
+, m_color_offsets()
+, m_color_order()
+, m_coloring_valid(false)
+{}
+
+SpringForceBatch::~SpringForceBatch()
+{}
+
+void SpringForceBatch::addSpring( const std::pair<int,int>& endpoints, const scalar& k, const scalar& l0, const scalar& b )
+{
+  assert( endpoints.first >= 0 );
+  assert( endpoints.second >= 0 );
+  assert( endpoints.first != endpoints.second );
+  assert( k >= 0.0 );
+  assert( l0 >= 0.0 );
+  assert( b >= 0.0 );
+
+  m_first.push_back(endpoints.first);
+  m_second.push_back(endpoints.second);
+  m_k.push_back(k);
+  m_l0.push_back(l0);
+  m_b.push_back(b);
+  m_coloring_valid = false;
+}
+
+void SpringForceBatch::addSpring( const SpringForce& spring )
+{
+  addSpring( spring.getEndpoints(), spring.getStiffness(), spring.getRestLength(), spring.getDamping() );
+}
+
+int SpringForceBatch::getNumSprings() const
+{
+  return (int) m_first.size();
+}
+
+void SpringForceBatch::addEnergyToTotal( const VectorXs& x, const VectorXs& v, const VectorXs& m, scalar& E )
+{
+  VectorXs gradE;
+  TripletXs hessX, hessV;
+  evaluate( x, v, m, EVALUATE_ENERGY, E, gradE, hessX, hessV );
+}
+
+// Adds spring s's share of the quantities in flags. Touches only the DoFs of
+// its two endpoints.
+inline void SpringForceBatch::evaluateSpring( int s, int flags, const scalar* xp, const scalar* vp, scalar& E, scalar* gp, TripletXs& hessX, TripletXs& hessV ) const
+{
+  const int i = 2*m_first[s];
+  const int j = 2*m_second[s];
+  const scalar dx = xp[j] - xp[i];
+  const scalar dy = xp[j+1] - xp[i+1];
+  const scalar l = std::sqrt( dx*dx + dy*dy );
+  if( flags & EVALUATE_ENERGY )
+  {
+    const scalar stretch = l - m_l0[s];
+    E += 0.5*m_k[s]*stretch*stretch;
+  }
+
+  const scalar nx = dx/l;
+  const scalar ny = dy/l;
+  if( flags & EVALUATE_GRADIENT )
+  {
+    // Elastic force magnitude along n, plus damping of the relative velocity along n
+    const scalar c = m_k[s]*( l - m_l0[s] ) + m_b[s]*( nx*( vp[j] - vp[i] ) + ny*( vp[j+1] - vp[i+1] ) );
+    gp[i]   -= c*nx;
+    gp[i+1] -= c*ny;
+    gp[j]   += c*nx;
+    gp[j+1] += c*ny;
+  }
+
+  // Scaled by the reciprocal, as Eigen's normalize() does, so that the blocks
+  // match hessXBlock( s, x, v ) and hessVBlock( s, x ) exactly.
+  const Vector2s nhat = ( 1.0/l )*Vector2s( dx, dy );
+  if( flags & EVALUATE_HESSX )
+    sparseutils::addPairBlocks( m_first[s], m_second[s], hessXBlock( s, nhat, l, Vector2s( vp[j] - vp[i], vp[j+1] - vp[i+1] ) ), hessX );
+  if( ( flags & EVALUATE_HESSV ) && m_b[s] != 0.0 )
+    sparseutils::addPairBlocks( m_first[s], m_second[s], m_b[s]*nhat*nhat.transpose(), hessV );
+}
+
+void SpringForceBatch::evaluate( const VectorXs& x, const VectorXs& v, const VectorXs& m, int flags, scalar& E, VectorXs& gradE, TripletXs& hessX, TripletXs& hessV )
+{
+  assert( x.size() == v.size() );
+  assert( x.size()%2 == 0 );
+  assert( !( flags & EVALUATE_GRADIENT ) || x.size() == gradE.size() );
+
+  const scalar* xp = x.data();
+  const scalar* vp = v.data();
+  scalar* gp = ( flags & EVALUATE_GRADIENT ) ? gradE.data() : NULL;
+
+#if defined(FORCE_COLORING) && defined(_OPENMP)
+  // Springs of one color share no particle, so each color scatters
+  // concurrently without atomics, and the result does not depend on the
+  // thread count. Triplets and the energy are accumulated in spring order,
+  // so only gradient-only evaluations take this path.
+  if( flags == EVALUATE_GRADIENT )
+  {
+    if( !m_coloring_valid ) computeColoring();
+    const int ncolors = (int) m_color_offsets.size()-1;
+    for( int c = 0; c < ncolors; ++c )
+    {
+      #pragma omp parallel for schedule(static)
+      for( int k = m_color_offsets[c]; k < m_color_offsets[c+1]; ++k ) evaluateSpring( m_color_order[k], flags, xp, vp, E, gp, hessX, hessV );
+    }
+    return;
+  }
+#endif
+
+  if( flags & EVALUATE_HESSX ) hessX.reserve( hessX.size() + 16*getNumSprings() );
+  if( flags & EVALUATE_HESSV ) hessV.reserve( hessV.size() + 16*getNumSprings() );
+
+  const int nsprings = getNumSprings();
+  scalar energy = 0.0;
+  for( int s = 0; s < nsprings; ++s ) evaluateSpring( s, flags, xp, vp, energy, gp, hessX, hessV );
+  if( flags & EVALUATE_ENERGY ) E += energy;
+}
+
+void SpringForceBatch::addGradEToTotal( const VectorXs& x, const VectorXs& v, const VectorXs& m, VectorXs& gradE )
+{
+  assert( x.size() == gradE.size() );
+
+  scalar E = 0.0;
+  TripletXs hessX, hessV;
+  evaluate( x, v, m, EVALUATE_GRADIENT, E, gradE, hessX, hessV );
+}
+
+void SpringForceBatch::computeColoring() const
+{
+  const int nsprings = getNumSprings();
+  int nparticles = 0;
+  for( int s = 0; s < nsprings; ++s ) nparticles = std::max( nparticles, std::max( m_first[s], m_second[s] )+1 );
+
+  // Greedy edge coloring of the spring graph: each spring takes the lowest
+  // color not yet used at either endpoint. Uses at most 2*maxdegree-1 colors.
+  std::vector<std::vector<bool> > used(nparticles);
+  std::vector<int> color(nsprings);
+  int ncolors = 0;
+  for( int s = 0; s < nsprings; ++s )
+  {
+    std::vector<bool>& ui = used[m_first[s]];
+    std::vector<bool>& uj = used[m_second[s]];
+    int c = 0;
+    while( ( c < (int) ui.size() && ui[c] ) || ( c < (int) uj.size() && uj[c] ) ) ++c;
+    if( (int) ui.size() <= c ) ui.resize(c+1,false);
+    if( (int) uj.size() <= c ) uj.resize(c+1,false);
+    ui[c] = uj[c] = true;
+    color[s] = c;
+    ncolors = std::max( ncolors, c+1 );
+  }
+
+  // Bucket springs by color, preserving their order within a color.
+  m_color_offsets.assign( ncolors+1, 0 );
+  for( int s = 0; s < nsprings; ++s ) ++m_color_offsets[color[s]+1];
+  for( int c = 0; c < ncolors; ++c ) m_color_offsets[c+1] += m_color_offsets[c];
+  m_color_order.resize(nsprings);
+  std::vector<int> fill( m_color_offsets.begin(), m_color_offsets.end()-1 );
+  for( int s = 0; s < nsprings; ++s ) m_color_order[fill[color[s]]++] = s;
+
+  m_coloring_valid = true;
+}
+
+Matrix2s SpringForceBatch::hessXBlock( int s, const Vector2s& nhat, const scalar& l, const Vector2s& dv ) const
+{
+  assert( l != 0.0 );
+
+  Matrix2s P = nhat*nhat.transpose();
+  Matrix2s I = Matrix2s::Identity();
+
+  Matrix2s B = m_k[s]*( P + (1.0 - m_l0[s]/l)*(I - P) );
+  if( m_b[s] != 0.0 ) B += (m_b[s]/l)*( nhat.dot(dv)*I + nhat*dv.transpose() )*( I - P );
+  return B;
+}
+
+Matrix2s SpringForceBatch::hessXBlock( int s, const VectorXs& x, const VectorXs& v ) const
+{
+  Vector2s nhat = x.segment<2>(2*m_second[s]) - x.segment<2>(2*m_first[s]);
+  scalar l = nhat.norm();
+  nhat /= l;
+  return hessXBlock( s, nhat, l, v.segment<2>(2*m_second[s]) - v.segment<2>(2*m_first[s]) );
+}
+
+Matrix2s SpringForceBatch::hessVBlock( int s, const VectorXs& x ) const
+{
+  Vector2s nhat = x.segment<2>(2*m_second[s]) - x.segment<2>(2*m_first[s]);
+  nhat.normalize();
+  return m_b[s]*nhat*nhat.transpose();
+}
+
+void SpringForceBatch::addHessXToTotal( const VectorXs& x, const VectorXs& v, const VectorXs& m, MatrixXs& hessE )
+{
+  assert( x.size() == v.size() );
+  assert( x.size() == hessE.rows() );
+  assert( x.size() == hessE.cols() );
+
+  for( int s = 0; s < getNumSprings(); ++s ) sparseutils::addPairBlocks( m_first[s], m_second[s], hessXBlock(s,x,v), hessE );
+}
+
+void SpringForceBatch::addHessVToTotal( const VectorXs& x, const VectorXs& v, const VectorXs& m, MatrixXs& hessE )
+{
+  assert( x.size() == v.size() );
+  assert( x.size() == hessE.rows() );
+  assert( x.size() == hessE.cols() );
+
+  for( int s = 0; s < getNumSprings(); ++s ) if( m_b[s] != 0.0 ) sparseutils::addPairBlocks( m_first[s], m_second[s], hessVBlock(s,x), hessE );
+}
+
+void SpringForceBatch::addHessXToTotal( const VectorXs& x, const VectorXs& v, const VectorXs& m, TripletXs& hessE )
+{
+  scalar E = 0.0;
+  VectorXs gradE;
+  TripletXs hessV;
+  evaluate( x, v, m, EVALUATE_HESSX, E, gradE, hessE, hessV );
+}
+
+void SpringForceBatch::addHessVToTotal( const VectorXs& x, const VectorXs& v, const VectorXs& m, TripletXs& hessE )
+{
+  scalar E = 0.0;
+  VectorXs gradE;
+  TripletXs hessX;
+  evaluate( x, v, m, EVALUATE_HESSV, E, gradE, hessX, hessE );
+}
+
+void SpringForceBatch::addHessXVProductToTotal( const VectorXs& x, const VectorXs& v, const VectorXs& m, const VectorXs& dx, VectorXs& out )
+{
+  assert( x.size() == v.size() );
+  assert( x.size() == dx.size() );
+  assert( x.size() == out.size() );
+
+  for( int s = 0; s < getNumSprings(); ++s ) sparseutils::addPairProduct( m_first[s], m_second[s], hessXBlock(s,x,v), dx, out );
+}
+
+void SpringForceBatch::addHessVVProductToTotal( const VectorXs& x, const VectorXs& v, const VectorXs& m, const VectorXs& dv, VectorXs& out )
+{
+  assert( x.size() == v.size() );
+  assert( x.size() == dv.size() );
+  assert( x.size() == out.size() );
+
+  for( int s = 0; s < getNumSprings(); ++s ) if( m_b[s] != 0.0 ) sparseutils::addPairProduct( m_first[s], m_second[s], hessVBlock(s,x), dv, out );
+}
+
+Force* SpringForceBatch::createNewCopy()
+{
+  return new SpringForceBatch(*this);
+}
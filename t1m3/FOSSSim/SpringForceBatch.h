@@ -0,0 +1,82 @@
+#ifndef __SPRING_FORCE_BATCH_H__
+#define __SPRING_FORCE_BATCH_H__
+
+#include <Eigen/Core>
+#include <vector>
+#include "ForceArena.h"
+#include "SpringForce.h"
+
+// Evaluates many springs as one force. Endpoints and parameters are stored
+// in contiguous arrays so that accumulation is a single loop over springs,
+// rather than one virtual call per SpringForce object.
+class SpringForceBatch : public PooledForce
+{
+public:
+
+  SpringForceBatch();
+
+  virtual ~SpringForceBatch();
+
+  void addSpring( const std::pair<int,int>& endpoints, const scalar& k, const scalar& l0, const scalar& b = 0.0 );
+
+  void addSpring( const SpringForce& spring );
+
+  int getNumSprings() const;
+
+  const std::pair<int,int> getEndpoints( int s ) const { return std::pair<int,int>( m_first[s], m_second[s] ); }
+  const scalar& getStiffness( int s ) const { return m_k[s]; }
+  const scalar& getRestLength( int s ) const { return m_l0[s]; }
+  const scalar& getDamping( int s ) const { return m_b[s]; }
+
+  virtual void addEnergyToTotal( const VectorXs& x, const VectorXs& v, const VectorXs& m, scalar& E );
+
+  virtual void addGradEToTotal( const VectorXs& x, const VectorXs& v, const VectorXs& m, VectorXs& gradE );
+
+  virtual void addHessXToTotal( const VectorXs& x, const VectorXs& v, const VectorXs& m, MatrixXs& hessE );
+
+  virtual void addHessVToTotal( const VectorXs& x, const VectorXs& v, const VectorXs& m, MatrixXs& hessE );
+
+  // Triplet versions used by TwoDScene's sparse accumulators.
+  void addHessXToTotal( const VectorXs& x, const VectorXs& v, const VectorXs& m, TripletXs& hessE );
+
+  void addHessVToTotal( const VectorXs& x, const VectorXs& v, const VectorXs& m, TripletXs& hessE );
+
+  // Hessian-vector products, out += hessE*dx, without forming the Hessian.
+  void addHessXVProductToTotal( const VectorXs& x, const VectorXs& v, const VectorXs& m, const VectorXs& dx, VectorXs& out );
+
+  void addHessVVProductToTotal( const VectorXs& x, const VectorXs& v, const VectorXs& m, const VectorXs& dv, VectorXs& out );
+
+  // Fused evaluation: adds whatever flags (ForceEvaluation) ask for,
+  // computing each spring's length and direction once. The energy, gradient
+  // and triplet Hessian methods above are wrappers around it. Outputs that
+  // are not asked for are not touched.
+  void evaluate( const VectorXs& x, const VectorXs& v, const VectorXs& m, int flags, scalar& E, VectorXs& gradE, TripletXs& hessX, TripletXs& hessV );
+
+  virtual Force* createNewCopy();
+
+private:
+  // Returns the 2x2 blocks B of the [ B -B; -B B ] Hessian stencils, given
+  // the unit direction nhat, length l and relative velocity dv of spring s.
+  Matrix2s hessXBlock( int s, const Vector2s& nhat, const scalar& l, const Vector2s& dv ) const;
+  Matrix2s hessXBlock( int s, const VectorXs& x, const VectorXs& v ) const;
+  Matrix2s hessVBlock( int s, const VectorXs& x ) const;
+
+  void evaluateSpring( int s, int flags, const scalar* xp, const scalar* vp, scalar& E, scalar* gp, TripletXs& hessX, TripletXs& hessV ) const;
+
+  // Partitions the springs into colors such that no two springs of a color
+  // share a particle. Rebuilt lazily after springs are added.
+  void computeColoring() const;
+
+  std::vector<int> m_first;
+  std::vector<int> m_second;
+  std::vector<scalar> m_k;
+  std::vector<scalar> m_l0;
+  std::vector<scalar> m_b;
+
+  // Springs sorted by color; color c spans [ m_color_offsets[c], m_color_offsets[c+1] ).
+  mutable std::vector<int> m_color_offsets;
+  mutable std::vector<int> m_color_order;
+  mutable bool m_coloring_valid;
+};
+
+#endif
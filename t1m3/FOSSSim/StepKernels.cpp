@@ -0,0 +1,117 @@
+#include "StepKernels.h"
+
+#include <cassert>
+#include <cmath>
+
+// The fixed mask is applied as a select rather than a branch, so that the
+// loops vectorize.
+
+void explicitEulerUpdate( const FixedDoFs& fixed, const VectorXs& gradU, scalar dt, VectorXs& x, VectorXs& v )
+{
+  const int ndofs = int(x.size());
+  assert(v.size() == ndofs && gradU.size() == ndofs);
+  if( ndofs == 0 ) return;
+  const unsigned char* mask = &fixed.getDoFMask()[0];
+  const scalar* minv = fixed.getInverseMasses().data();
+  const scalar* g = gradU.data();
+  scalar* xp = x.data();
+  scalar* vp = v.data();
+  for( int i = 0; i < ndofs; ++i )
+  {
+    const scalar a = g[i]*-minv[i];
+    xp[i] += mask[i] ? dt*vp[i] : 0.0;
+    vp[i] += dt*a;
+  }
+}
+
+void symplecticEulerUpdate( const FixedDoFs& fixed, const VectorXs& gradU, scalar dt, VectorXs& x, VectorXs& v )
+{
+  const int ndofs = int(x.size());
+  assert(v.size() == ndofs && gradU.size() == ndofs);
+  const scalar* minv = fixed.getInverseMasses().data();
+  const scalar* g = gradU.data();
+  scalar* xp = x.data();
+  scalar* vp = v.data();
+  for( int i = 0; i < ndofs; ++i )
+  {
+    vp[i] += dt*(g[i]*-minv[i]);
+    xp[i] += dt*vp[i];
+  }
+}
+
+DragDecay::DragDecay()
+: m_b(0.0)
+, m_dt(0.0)
+, m_inverse_masses()
+, m_factors()
+{}
+
+void DragDecay::update( const FixedDoFs& fixed, scalar b, scalar dt )
+{
+  const VectorXs& minv = fixed.getInverseMasses();
+  if( b == m_b && dt == m_dt && minv.size() == m_inverse_masses.size() && minv == m_inverse_masses ) return;
+  m_b = b;
+  m_dt = dt;
+  m_inverse_masses = minv;
+  m_factors.resize(minv.size());
+  for( int i = 0; i < minv.size(); ++i ) m_factors(i) = std::exp(-b*dt*minv(i));
+}
+
+const VectorXs& DragDecay::getFactors() const
+{
+  return m_factors;
+}
+
+void explicitEulerUpdate( const FixedDoFs& fixed, const VectorXs& gradU, const DragDecay& drag, scalar dt, VectorXs& x, VectorXs& v )
+{
+  const int ndofs = int(x.size());
+  assert(v.size() == ndofs && gradU.size() == ndofs && drag.getFactors().size() == ndofs);
+  if( ndofs == 0 ) return;
+  const unsigned char* mask = &fixed.getDoFMask()[0];
+  const scalar* minv = fixed.getInverseMasses().data();
+  const scalar* decay = drag.getFactors().data();
+  const scalar* g = gradU.data();
+  scalar* xp = x.data();
+  scalar* vp = v.data();
+  for( int i = 0; i < ndofs; ++i )
+  {
+    const scalar a = g[i]*-minv[i];
+    xp[i] += mask[i] ? dt*vp[i] : 0.0;
+    vp[i] = decay[i]*( vp[i] + dt*a );
+  }
+}
+
+void symplecticEulerUpdate( const FixedDoFs& fixed, const VectorXs& gradU, const DragDecay& drag, scalar dt, VectorXs& x, VectorXs& v )
+{
+  const int ndofs = int(x.size());
+  assert(v.size() == ndofs && gradU.size() == ndofs && drag.getFactors().size() == ndofs);
+  const scalar* minv = fixed.getInverseMasses().data();
+  const scalar* decay = drag.getFactors().data();
+  const scalar* g = gradU.data();
+  scalar* xp = x.data();
+  scalar* vp = v.data();
+  for( int i = 0; i < ndofs; ++i )
+  {
+    vp[i] = decay[i]*( vp[i] + dt*(g[i]*-minv[i]) );
+    xp[i] += dt*vp[i];
+  }
+}
+
+void verletPositionUpdate( const FixedDoFs& fixed, const VectorXs& a, scalar dt, VectorXs& x, const VectorXs& v, VectorXs& dv )
+{
+  const int ndofs = int(x.size());
+  assert(v.size() == ndofs && a.size() == ndofs);
+  dv.resize(ndofs);
+  if( ndofs == 0 ) return;
+  const scalar halfdt2 = 0.5*dt*dt;
+  const unsigned char* mask = &fixed.getDoFMask()[0];
+  const scalar* ap = a.data();
+  const scalar* vp = v.data();
+  scalar* xp = x.data();
+  scalar* dvp = dv.data();
+  for( int i = 0; i < ndofs; ++i )
+  {
+    xp[i] += mask[i] ? dt*vp[i] + halfdt2*ap[i] : 0.0;
+    dvp[i] = dt*ap[i];
+  }
+}
@@ -0,0 +1,59 @@
+#ifndef __STEP_KERNELS_H__
+#define __STEP_KERNELS_H__
+
+#include "FixedDoFs.h"
+#include "MathDefs.h"
+
+// The explicit steppers' updates of x and v, each one pass over the DoFs.
+// Written as whole-vector expressions they took a pass for the acceleration,
+// one for the position increment and its fixed mask and one for each of x
+// and v, through temporaries; at the sizes where stepping is bandwidth bound
+// that is about twice the traffic of reading and writing each vector once.
+//
+// gradU is the gradient of the potential as accumulateGradUParallel leaves
+// it; the acceleration -M^-1 gradU is formed inline from the inverse masses
+// of fixed, so fixed DoFs get none. The results are those of the
+// whole-vector expressions, bit for bit.
+
+// Explicit Euler: x += dt*v on the free DoFs, then v += dt*a.
+void explicitEulerUpdate( const FixedDoFs& fixed, const VectorXs& gradU, scalar dt, VectorXs& x, VectorXs& v );
+
+// Symplectic Euler: v += dt*a, then x += dt*v with the new velocity. As
+// before, fixed DoFs are held only by their zero inverse mass.
+void symplecticEulerUpdate( const FixedDoFs& fixed, const VectorXs& gradU, scalar dt, VectorXs& x, VectorXs& v );
+
+// Built with USE_EXPONENTIAL_DRAG, the single-step explicit steppers take
+// the scene's linear drag b out of the force loop and integrate it exactly,
+// as the decay v *= exp(-b*dt/m) of each free DoF after the rest of the
+// velocity update, in the same pass. Explicit Euler's drag term is only
+// stable for dt < 2m/b, and costs a pass over v in the force loop; the
+// decay is stable for any dt, and its factors cost an exp per DoF only when
+// b, dt or the masses change. Fixed DoFs, with zero inverse mass, get a
+// factor of exactly 1.
+class DragDecay
+{
+public:
+  DragDecay();
+
+  // Recomputes the factors if b, dt or fixed's inverse masses changed.
+  void update( const FixedDoFs& fixed, scalar b, scalar dt );
+
+  const VectorXs& getFactors() const;
+
+private:
+  scalar m_b;
+  scalar m_dt;
+  VectorXs m_inverse_masses;
+  VectorXs m_factors;
+};
+
+// The updates above, with drag's decay applied to each new velocity.
+void explicitEulerUpdate( const FixedDoFs& fixed, const VectorXs& gradU, const DragDecay& drag, scalar dt, VectorXs& x, VectorXs& v );
+
+void symplecticEulerUpdate( const FixedDoFs& fixed, const VectorXs& gradU, const DragDecay& drag, scalar dt, VectorXs& x, VectorXs& v );
+
+// Velocity Verlet's position half: x += dt*v + dt^2/2*a on the free DoFs,
+// with a the acceleration, and dv = dt*a for the next evaluation.
+void verletPositionUpdate( const FixedDoFs& fixed, const VectorXs& a, scalar dt, VectorXs& x, const VectorXs& v, VectorXs& dv );
+
+#endif
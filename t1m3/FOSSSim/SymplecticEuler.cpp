@@ -0,0 +1,142 @@
+#include "SymplecticEuler.h"
+
+#include "FixedDoFs.h"
+#include "StepKernels.h"
+#if defined(ENERGY_DRIFT_TOLERANCE)
+#include "EnergyMonitor.h"
+#endif
+#if defined(ENSEMBLE)
+#include "SceneEnsemble.h"
+#include <cstdlib>
+#include <fstream>
+#endif
+#if defined(VELOCITY_VERLET)
+#include "VelocityVerlet.h"
+#elif defined(ADAPTIVE_STEP_TOLERANCE)
+#include "AdaptiveStepper.h"
+#endif
+
+// Updates v += dt*a(x,v), then x += dt*v with the new velocity. Fixed
+// particles get no acceleration, through their zero inverse mass.
+//
+// Replaces the base library's stepper so that the scene's forces are batched
+// first, as the implicit steppers do, which is what lets vortex and n-body
+// scenes use the tree-based forces. Built with ADAPTIVE_STEP_TOLERANCE it
+// steps adaptively, as described in AdaptiveStepper.h. Built with
+// USE_VELOCITY_VERLET it steps by velocity Verlet instead, as described in
+// VelocityVerlet.h, and does not step adaptively. Built with
+// USE_EXPONENTIAL_DRAG, single steps integrate linear drag exactly, as
+// described in StepKernels.h; Verlet and adaptive steps keep it in the
+// forces. Built with ENERGY_DRIFT_TOLERANCE > 0, single steps sum the
+// potential energy with the gradient and stop the run once the total energy
+// drifts by more than that, as described in EnergyMonitor.h.
+//
+// Built with USE_ENSEMBLE and run with FOSSSIM_ENSEMBLE set to a parameter table,
+// it steps the ensemble of SceneEnsemble.h instead, and the scene shows its
+// first member. With FOSSSIM_ENSEMBLE_OUTPUT set to a file as well, every
+// member's state is appended to it after each step, as SceneEnsemble::write
+// lays it out.
+
+// SymplecticEuler is constructed by the base library, so these cannot be
+// members.
+static FixedDoFs g_fixed;
+#if defined(VELOCITY_VERLET)
+static VelocityVerlet g_verlet;
+#elif defined(ADAPTIVE_STEP_TOLERANCE)
+static AdaptiveStepper g_adaptive(AdaptiveStepper::SYMPLECTIC_EULER, ADAPTIVE_STEP_TOLERANCE, ADAPTIVE_STEP_MIN_DT);
+#else
+// The step's workspace, reused so that steps at an unchanged size do not
+// allocate.
+static VectorXs g_gradu;
+#if defined(EXPONENTIAL_DRAG)
+static DragDecay g_drag;
+#endif
+#if defined(ENERGY_DRIFT_TOLERANCE)
+static EnergyMonitor g_energy(ENERGY_DRIFT_TOLERANCE);
+static TripletXs g_no_hessian;
+#endif
+#endif
+#if defined(ENSEMBLE)
+static SceneEnsemble g_ensemble;
+static bool g_ensemble_read = false;
+static std::ofstream g_ensemble_output;
+
+// Builds the ensemble on the first step, if the environment names a table.
+// A table that fails to build ends the run, as a sweep that silently runs
+// the scene alone would be mistaken for its first member.
+static bool steppingEnsemble( const TwoDScene& scene )
+{
+  if( !g_ensemble_read )
+  {
+    g_ensemble_read = true;
+    const char* table = getenv("FOSSSIM_ENSEMBLE");
+    if( table == NULL ) return false;
+    if( !g_ensemble.build(scene, table) ) exit(1);
+    const char* output = getenv("FOSSSIM_ENSEMBLE_OUTPUT");
+    if( output != NULL ) g_ensemble_output.open(output, std::ios::binary);
+  }
+  return g_ensemble.getNumMembers() > 0;
+}
+#endif
+
+SymplecticEuler::SymplecticEuler()
+: SceneStepper()
+{}
+
+SymplecticEuler::~SymplecticEuler()
+{}
+
+bool SymplecticEuler::stepScene( TwoDScene& scene, scalar dt )
+{
+  VectorXs& x = scene.getX();
+  VectorXs& v = scene.getV();
+  const VectorXs& m = scene.getM();
+  assert(x.size() == v.size());
+  assert(x.size() == m.size());
+
+  scene.batchForces();
+#if defined(ENSEMBLE)
+  if( steppingEnsemble(scene) )
+  {
+    g_ensemble.step(dt);
+    g_ensemble.copyMember(0, scene);
+    if( g_ensemble_output.is_open() ) g_ensemble.write(g_ensemble_output);
+    return true;
+  }
+#endif
+#if defined(VELOCITY_VERLET)
+  const bool fixedchanged = g_fixed.update(scene);
+#else
+  g_fixed.update(scene);
+#endif
+
+#if defined(VELOCITY_VERLET)
+  g_verlet.advance(scene, g_fixed, fixedchanged, dt);
+#elif defined(ADAPTIVE_STEP_TOLERANCE)
+  g_adaptive.advance(scene, g_fixed, dt);
+#else
+#if defined(EXPONENTIAL_DRAG)
+  g_drag.update(g_fixed, scene.excludeLinearDrag(), dt);
+#endif
+  g_gradu.setZero(x.size());
+#if defined(ENERGY_DRIFT_TOLERANCE)
+  scalar U = 0.0;
+  scene.evaluateForces(EVALUATE_ENERGY | EVALUATE_GRADIENT, U, g_gradu, g_no_hessian, g_no_hessian);
+  g_energy.watch(scene, U);
+#else
+  scene.accumulateGradUParallel(g_gradu);
+#endif
+#if defined(EXPONENTIAL_DRAG)
+  symplecticEulerUpdate(g_fixed, g_gradu, g_drag, dt, x, v);
+#else
+  symplecticEulerUpdate(g_fixed, g_gradu, dt, x, v);
+#endif
+#endif
+
+  return true;
+}
+
+std::string SymplecticEuler::getName() const
+{
+  return "Symplectic Euler";
+}
@@ -37,6 +37,10 @@ public:
   
   void resizeSystem( int num_particles );
   
+  // These mutators and the non-const getters are compiled into the base
+  // library, and the class cannot grow members, so nothing records when a
+  // part of the scene changes. A cache that depends on part of it compares
+  // that part with what it was built from instead.
   void setPosition( int particle, const Vector2s& pos );
   
   void setVelocity( int particle, const Vector2s& vel );
@@ -62,13 +66,84 @@ public:
   
   void insertForce( Force* newforce );
 
+  // The scene's forces, in the order they are accumulated.
+  const std::vector<Force*>& getForces() const;
+
+  // Replaces the scene's SpringForces by SpringForceBatches of consecutive
+  // springs, and every SimpleGravityForce and DragDampingForce by a single
+  // UniformFieldForce, each at the position of the first force it absorbs.
+  // Batches are capped in size so that parallel accumulation has work to split.
+  // Built with NBODY_GRAVITY_THETA > 0, GravitationalForces sharing a G that
+  // pair up all of their particles become one Barnes-Hut NBodyGravityForce.
+  // Likewise VORTEX_FIELD_THETA > 0 turns VortexForces sharing constants that
+  // couple every one of a set of sources to every one of a set of targets
+  // into one VortexFieldForce. Remaining GravitationalForces and VortexForces
+  // become GravitationalForceBatches and VortexForceBatches.
+  // The XML parser in the base library inserts one force object per XML tag;
+  // steppers call this so that each kind is evaluated in one pass. Does
+  // nothing once the scene is batched.
+  void batchForces();
+
+  // Stops the uniform fields batchForces built from applying their linear
+  // drag, for steppers that integrate it exactly instead, and returns the
+  // total drag coefficient. Call after batchForces.
+  scalar excludeLinearDrag();
+
   void accumulateGradU( VectorXs& F, const VectorXs& dx = VectorXs(), const VectorXs& dv = VectorXs() );
 
+  // Parallel version of accumulateGradU (build with USE_OPENMP). Forces are
+  // split into one contiguous chunk per thread, each chunk accumulates into its
+  // own buffer, and the buffers are summed in thread order, so the result is
+  // bit-identical from run to run for a fixed thread count. With
+  // USE_FORCE_COLORING, spring batches instead scatter concurrently by graph
+  // color, which needs no per-thread buffers.
+  //
+  // With FOSSSIM_DETERMINISTIC=1 in the environment the forces are cut into a
+  // fixed number of blocks instead, whose buffers are summed pairwise, so the
+  // result is also the same on any number of threads, with or without
+  // OpenMP. The graph-colored scatter already is, and is kept.
+  void accumulateGradUParallel( VectorXs& F, const VectorXs& dx = VectorXs(), const VectorXs& dv = VectorXs() );
+
   void accumulateddUdxdx( MatrixXs& A, const VectorXs& dx = VectorXs(), const VectorXs& dv = VectorXs() );
 
   // Kind of a misnomer.
   void accumulateddUdxdv( MatrixXs& A, const VectorXs& dx = VectorXs(), const VectorXs& dv = VectorXs() );
-  
+
+  // Sparse versions of the above. Forces are compiled into the base library, so
+  // Force cannot grow a virtual triplet interface; instead known force types are
+  // dispatched to their triplet overloads and any other force is evaluated
+  // densely and then scattered.
+  void accumulateddUdxdx( SparseMatrixXs& A, const VectorXs& dx = VectorXs(), const VectorXs& dv = VectorXs() );
+
+  void accumulateddUdxdv( SparseMatrixXs& A, const VectorXs& dx = VectorXs(), const VectorXs& dv = VectorXs() );
+
+  // Matrix-free products with the Hessians above, out += H*p, for iterative
+  // solvers. The diagonal versions add diag(H) to d for Jacobi preconditioning.
+  void accumulateddUdxdxProduct( VectorXs& out, const VectorXs& p, const VectorXs& dx = VectorXs(), const VectorXs& dv = VectorXs() );
+
+  void accumulateddUdxdvProduct( VectorXs& out, const VectorXs& p, const VectorXs& dx = VectorXs(), const VectorXs& dv = VectorXs() );
+
+  void accumulateddUdxdxDiagonal( VectorXs& d, const VectorXs& dx = VectorXs(), const VectorXs& dv = VectorXs() );
+
+  void accumulateddUdxdvDiagonal( VectorXs& d, const VectorXs& dx = VectorXs(), const VectorXs& dv = VectorXs() );
+
+  // Adds whatever flags (ForceEvaluation) ask for to E, gradE and the
+  // position and velocity Hessian triplets, in one pass over each force that
+  // has a fused evaluate and through the separate methods otherwise. Spring
+  // lengths and directions are then computed once rather than per quantity.
+  // Built with OpenMP, or with FOSSSIM_DETERMINISTIC set, the gradient is
+  // still accumulated as in accumulateGradUParallel, together with the
+  // energy if that is asked for too, each thread or block summing its own.
+  // The spring, uniform field and gravitational pair batches fuse energy and
+  // gradient; other forces are evaluated for each in turn.
+  void evaluateForces( int flags, scalar& E, VectorXs& gradE, TripletXs& hessX, TripletXs& hessV, const VectorXs& dx = VectorXs(), const VectorXs& dv = VectorXs() );
+
+  // As evaluateForces, over only one half of the split, and serially.
+  void evaluateForceSplit( ForceSplit split, int flags, scalar& E, VectorXs& gradE, TripletXs& hessX, TripletXs& hessV, const VectorXs& dx = VectorXs(), const VectorXs& dv = VectorXs() );
+
+  // Each is a full pass over the particles or forces, on every call. Nothing
+  // in the step loop or the HUD calls them; a stepper that needs the energy
+  // alongside other quantities asks evaluateForces for EVALUATE_ENERGY.
   scalar computeKineticEnergy() const;
   scalar computePotentialEnergy() const;
   scalar computeTotalEnergy() const;
@@ -0,0 +1,587 @@
+#include "TwoDScene.h"
+
+#include "SpringForce.h"
+#include "SpringForceBatch.h"
+#include "GravitationalForce.h"
+#include "GravitationalForceBatch.h"
+#include "DragDampingForce.h"
+#include "SimpleGravityForce.h"
+#include "UniformFieldForce.h"
+#include "NBodyGravityForce.h"
+#include "VortexForce.h"
+#include "VortexForceBatch.h"
+#include "VortexFieldForce.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <map>
+#include <set>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+// Force evaluation extensions for TwoDScene: force batching, parallel
+// gradient accumulation, and sparse and matrix-free Hessian evaluation. The dense accumulators live in the base
+// library; these mirror them but never touch an ndof x ndof dense matrix
+// unless a force only provides the dense form.
+
+// Springs per SpringForceBatch created by batchForces. Large enough to
+// amortize the per-force call, small enough to split across threads. With
+// FORCE_COLORING each batch parallelizes internally, so all springs share one.
+#ifdef FORCE_COLORING
+static const int SPRINGS_PER_BATCH = std::numeric_limits<int>::max();
+#else
+static const int SPRINGS_PER_BATCH = 1024;
+#endif
+
+// Pairs per ForceBatch created by batchForces, which parallelize only
+// across batches.
+static const int PAIRS_PER_BATCH = 1024;
+
+// Blocks of forces FOSSSIM_DETERMINISTIC accumulates the gradient in, each
+// into a buffer of its own, however many threads there are. More blocks keep
+// more threads busy, but every block costs two passes over the gradient, to
+// clear its buffer and to sum it: on a 10k-particle cloth of 20k springs
+// these make a single-threaded step take about twice as long.
+static const int DETERMINISTIC_BLOCKS = 8;
+
+template<bool HESSX>
+static void addForceHessian( Force* force, const VectorXs& x, const VectorXs& v, const VectorXs& m, TripletXs& triplets )
+{
+  if( SpringForceBatch* f = dynamic_cast<SpringForceBatch*>(force) )
+    HESSX ? f->addHessXToTotal(x,v,m,triplets) : f->addHessVToTotal(x,v,m,triplets);
+  else if( SpringForce* f = dynamic_cast<SpringForce*>(force) )
+    HESSX ? f->addHessXToTotal(x,v,m,triplets) : f->addHessVToTotal(x,v,m,triplets);
+  else if( UniformFieldForce* f = dynamic_cast<UniformFieldForce*>(force) )
+    HESSX ? f->addHessXToTotal(x,v,m,triplets) : f->addHessVToTotal(x,v,m,triplets);
+  else if( GravitationalForce* f = dynamic_cast<GravitationalForce*>(force) )
+    HESSX ? f->addHessXToTotal(x,v,m,triplets) : f->addHessVToTotal(x,v,m,triplets);
+  else if( GravitationalForceBatch* f = dynamic_cast<GravitationalForceBatch*>(force) )
+    HESSX ? f->addHessXToTotal(x,v,m,triplets) : f->addHessVToTotal(x,v,m,triplets);
+  else if( NBodyGravityForce* f = dynamic_cast<NBodyGravityForce*>(force) )
+    HESSX ? f->addHessXToTotal(x,v,m,triplets) : f->addHessVToTotal(x,v,m,triplets);
+  else if( DragDampingForce* f = dynamic_cast<DragDampingForce*>(force) )
+    HESSX ? f->addHessXToTotal(x,v,m,triplets) : f->addHessVToTotal(x,v,m,triplets);
+  else if( SimpleGravityForce* f = dynamic_cast<SimpleGravityForce*>(force) )
+    HESSX ? f->addHessXToTotal(x,v,m,triplets) : f->addHessVToTotal(x,v,m,triplets);
+  else
+  {
+    // Force without a triplet overload (e.g. VortexForce): evaluate densely.
+    MatrixXs dense = MatrixXs::Zero(x.size(),x.size());
+    HESSX ? force->addHessXToTotal(x,v,m,dense) : force->addHessVToTotal(x,v,m,dense);
+    for( int j = 0; j < dense.cols(); ++j )
+      for( int i = 0; i < dense.rows(); ++i )
+        if( dense(i,j) != 0.0 ) triplets.push_back( Triplet(i,j,dense(i,j)) );
+  }
+}
+
+template<bool HESSX>
+static void addForceHessianProduct( Force* force, const VectorXs& x, const VectorXs& v, const VectorXs& m, const VectorXs& p, VectorXs& out )
+{
+  if( SpringForceBatch* f = dynamic_cast<SpringForceBatch*>(force) )
+    HESSX ? f->addHessXVProductToTotal(x,v,m,p,out) : f->addHessVVProductToTotal(x,v,m,p,out);
+  else if( SpringForce* f = dynamic_cast<SpringForce*>(force) )
+    HESSX ? f->addHessXVProductToTotal(x,v,m,p,out) : f->addHessVVProductToTotal(x,v,m,p,out);
+  else if( UniformFieldForce* f = dynamic_cast<UniformFieldForce*>(force) )
+    HESSX ? f->addHessXVProductToTotal(x,v,m,p,out) : f->addHessVVProductToTotal(x,v,m,p,out);
+  else if( GravitationalForce* f = dynamic_cast<GravitationalForce*>(force) )
+    HESSX ? f->addHessXVProductToTotal(x,v,m,p,out) : f->addHessVVProductToTotal(x,v,m,p,out);
+  else if( GravitationalForceBatch* f = dynamic_cast<GravitationalForceBatch*>(force) )
+    HESSX ? f->addHessXVProductToTotal(x,v,m,p,out) : f->addHessVVProductToTotal(x,v,m,p,out);
+  else if( NBodyGravityForce* f = dynamic_cast<NBodyGravityForce*>(force) )
+    HESSX ? f->addHessXVProductToTotal(x,v,m,p,out) : f->addHessVVProductToTotal(x,v,m,p,out);
+  else if( DragDampingForce* f = dynamic_cast<DragDampingForce*>(force) )
+    HESSX ? f->addHessXVProductToTotal(x,v,m,p,out) : f->addHessVVProductToTotal(x,v,m,p,out);
+  else if( SimpleGravityForce* f = dynamic_cast<SimpleGravityForce*>(force) )
+    HESSX ? f->addHessXVProductToTotal(x,v,m,p,out) : f->addHessVVProductToTotal(x,v,m,p,out);
+  else
+  {
+    MatrixXs dense = MatrixXs::Zero(x.size(),x.size());
+    HESSX ? force->addHessXToTotal(x,v,m,dense) : force->addHessVToTotal(x,v,m,dense);
+    out += dense*p;
+  }
+}
+
+// Adds force's gradient to gradE and, unless E is NULL, its energy to E.
+// Forces that opt in to it with a fused evaluation add both in one pass over
+// their elements, sharing each element's lengths and directions; any other
+// force is evaluated twice.
+static void addForceGradE( Force* force, const VectorXs& x, const VectorXs& v, const VectorXs& m, scalar* E, VectorXs& gradE )
+{
+  if( E == NULL )
+    force->addGradEToTotal(x,v,m,gradE);
+  else if( SpringForceBatch* f = dynamic_cast<SpringForceBatch*>(force) )
+  {
+    TripletXs unused;
+    f->evaluate(x,v,m,EVALUATE_ENERGY|EVALUATE_GRADIENT,*E,gradE,unused,unused);
+  }
+  else if( UniformFieldForce* f = dynamic_cast<UniformFieldForce*>(force) )
+    f->addEnergyAndGradEToTotal(x,v,m,*E,gradE);
+  else if( GravitationalForceBatch* f = dynamic_cast<GravitationalForceBatch*>(force) )
+    f->addEnergyAndGradEToTotal(x,v,m,*E,gradE);
+  else
+  {
+    force->addEnergyToTotal(x,v,m,*E);
+    force->addGradEToTotal(x,v,m,gradE);
+  }
+}
+
+// TwoDScene is built into the base library, so the scratch the accumulators
+// evaluate into cannot be a member. It is kept here and reused, so that
+// evaluating at an unchanged size does not allocate.
+static VectorXs g_offset_x;
+static VectorXs g_offset_v;
+static TripletXs g_scratch_triplets;
+#if defined(_OPENMP) && !defined(FORCE_COLORING)
+static std::vector<VectorXs> g_thread_buffers;
+static std::vector<scalar> g_thread_energies;
+#endif
+#ifndef FORCE_COLORING
+static std::vector<VectorXs> g_block_buffers;
+#endif
+
+// Whether FOSSSIM_DETERMINISTIC is set, to anything but 0. The base library
+// owns the command line, so the mode is read from the environment, once.
+static bool deterministicReductions()
+{
+  static const char* value = getenv("FOSSSIM_DETERMINISTIC");
+  static const bool deterministic = value != NULL && *value != '\0' && std::strcmp(value, "0") != 0;
+  return deterministic;
+}
+
+#ifndef FORCE_COLORING
+// accumulateGradUParallel's deterministic mode. The forces are cut into
+// DETERMINISTIC_BLOCKS contiguous blocks whatever the thread count, each
+// accumulated in force order into its own buffer, and the buffers are summed
+// pairwise in a fixed tree, (b0 + b1) + (b2 + b3) and so on, so every
+// addition happens in the same order on any number of threads, or without
+// OpenMP at all. The blocks' energies, if E is not NULL, are summed in the
+// same tree.
+static void accumulateGradUDeterministic( const std::vector<Force*>& forces, const VectorXs& x, const VectorXs& v, const VectorXs& m, VectorXs& F, scalar* E )
+{
+  const int nforces = (int) forces.size();
+  const int nblocks = std::min( nforces, DETERMINISTIC_BLOCKS );
+  if( nblocks == 0 ) return;
+  std::vector<VectorXs>& buffers = g_block_buffers;
+  buffers.resize(nblocks);
+  for( int b = 0; b < nblocks; ++b ) buffers[b].setZero(F.size());
+  scalar energies[DETERMINISTIC_BLOCKS] = {};
+#ifdef _OPENMP
+  #pragma omp parallel for schedule(dynamic,1)
+#endif
+  for( int b = 0; b < nblocks; ++b )
+  {
+    const int begin = (nforces*b)/nblocks;
+    const int end = (nforces*(b+1))/nblocks;
+    for( int i = begin; i < end; ++i ) addForceGradE(forces[i],x,v,m,E ? &energies[b] : NULL,buffers[b]);
+  }
+  for( int stride = 1; stride < nblocks; stride *= 2 )
+  {
+#ifdef _OPENMP
+    #pragma omp parallel for schedule(static)
+#endif
+    for( int b = 0; b < nblocks - stride; b += 2*stride )
+    {
+      buffers[b] += buffers[b+stride];
+      energies[b] += energies[b+stride];
+    }
+  }
+  F += buffers[0];
+  if( E ) *E += energies[0];
+}
+#endif
+
+// accumulateGradUParallel over forces at x and v, adding their energy to E
+// in the same pass unless E is NULL.
+static void accumulateGradient( const std::vector<Force*>& forces, const VectorXs& x, const VectorXs& v, const VectorXs& m, VectorXs& F, scalar* E )
+{
+  const int nforces = (int) forces.size();
+
+#ifndef FORCE_COLORING
+  if( deterministicReductions() )
+  {
+    accumulateGradUDeterministic( forces, x, v, m, F, E );
+    return;
+  }
+#endif
+
+#if defined(_OPENMP) && !defined(FORCE_COLORING)
+  const int nthreads = omp_get_max_threads();
+  if( nthreads > 1 && nforces > 1 )
+  {
+    std::vector<VectorXs>& buffers = g_thread_buffers;
+    buffers.resize(nthreads);
+    for( int tid = 0; tid < nthreads; ++tid ) buffers[tid].setZero(F.size());
+    std::vector<scalar>& energies = g_thread_energies;
+    energies.assign(nthreads, 0.0);
+    #pragma omp parallel num_threads(nthreads)
+    {
+      const int tid = omp_get_thread_num();
+      const int begin = (nforces*tid)/nthreads;
+      const int end = (nforces*(tid+1))/nthreads;
+      for( int i = begin; i < end; ++i ) addForceGradE(forces[i],x,v,m,E ? &energies[tid] : NULL,buffers[tid]);
+    }
+
+    for( int tid = 0; tid < nthreads; ++tid ) F += buffers[tid];
+    if( E ) for( int tid = 0; tid < nthreads; ++tid ) *E += energies[tid];
+    return;
+  }
+#endif
+
+  // Serial, or with FORCE_COLORING, forces that parallelize internally.
+  for( int i = 0; i < nforces; ++i ) addForceGradE(forces[i],x,v,m,E,F);
+}
+
+// q itself if dq is empty, and q + dq, in buffer, otherwise.
+static const VectorXs& offsetState( const VectorXs& q, const VectorXs& dq, VectorXs& buffer )
+{
+  assert( dq.size() == 0 || dq.size() == q.size() );
+  if( dq.size() == 0 ) return q;
+  buffer = q + dq;
+  return buffer;
+}
+
+template<bool HESSX>
+static void accumulateSparse( const std::vector<Force*>& forces, const VectorXs& x, const VectorXs& v, const VectorXs& m, SparseMatrixXs& A )
+{
+  assert( A.rows() == x.size() );
+  assert( A.cols() == x.size() );
+
+  TripletXs& triplets = g_scratch_triplets;
+  triplets.clear();
+  for( std::vector<Force*>::size_type i = 0; i < forces.size(); ++i )
+    addForceHessian<HESSX>( forces[i], x, v, m, triplets );
+
+  SparseMatrixXs H(A.rows(),A.cols());
+  H.setFromTriplets( triplets.begin(), triplets.end() );
+  A += H;
+}
+
+template<bool HESSX>
+static void accumulateProduct( const std::vector<Force*>& forces, const VectorXs& x, const VectorXs& v, const VectorXs& m, const VectorXs& p, VectorXs& out )
+{
+  assert( p.size() == x.size() );
+  assert( out.size() == x.size() );
+
+  for( std::vector<Force*>::size_type i = 0; i < forces.size(); ++i )
+    addForceHessianProduct<HESSX>( forces[i], x, v, m, p, out );
+}
+
+// The diagonal is read off the triplets; only O(nnz) scratch is needed and
+// no matrix is built.
+template<bool HESSX>
+static void accumulateDiagonal( const std::vector<Force*>& forces, const VectorXs& x, const VectorXs& v, const VectorXs& m, VectorXs& d )
+{
+  assert( d.size() == x.size() );
+
+  TripletXs& triplets = g_scratch_triplets;
+  triplets.clear();
+  for( std::vector<Force*>::size_type i = 0; i < forces.size(); ++i )
+    addForceHessian<HESSX>( forces[i], x, v, m, triplets );
+
+  for( TripletXs::size_type i = 0; i < triplets.size(); ++i )
+    if( triplets[i].row() == triplets[i].col() ) d(triplets[i].row()) += triplets[i].value();
+}
+
+// One force's share of evaluateForces.
+static void evaluateForce( Force* force, int flags, const VectorXs& x, const VectorXs& v, const VectorXs& m, scalar& E, VectorXs& gradE, TripletXs& hessX, TripletXs& hessV )
+{
+  if( SpringForceBatch* f = dynamic_cast<SpringForceBatch*>(force) )
+  {
+    f->evaluate(x,v,m,flags,E,gradE,hessX,hessV);
+    return;
+  }
+  if( ( flags & EVALUATE_ENERGY ) && ( flags & EVALUATE_GRADIENT ) ) addForceGradE(force,x,v,m,&E,gradE);
+  else if( flags & EVALUATE_ENERGY ) force->addEnergyToTotal(x,v,m,E);
+  else if( flags & EVALUATE_GRADIENT ) force->addGradEToTotal(x,v,m,gradE);
+  if( flags & EVALUATE_HESSX ) addForceHessian<true>(force,x,v,m,hessX);
+  if( flags & EVALUATE_HESSV ) addForceHessian<false>(force,x,v,m,hessV);
+}
+
+// The implicit half of a ForceSplit.
+static bool isImplicitForce( Force* force )
+{
+  return dynamic_cast<SpringForceBatch*>(force) != NULL || dynamic_cast<SpringForce*>(force) != NULL;
+}
+
+void TwoDScene::accumulateGradUParallel( VectorXs& F, const VectorXs& dx, const VectorXs& dv )
+{
+  assert( F.size() == m_x.size() );
+
+  accumulateGradient( m_forces, offsetState(m_x,dx,g_offset_x), offsetState(m_v,dv,g_offset_v), m_m, F, NULL );
+}
+
+void TwoDScene::accumulateddUdxdx( SparseMatrixXs& A, const VectorXs& dx, const VectorXs& dv )
+{
+  accumulateSparse<true>( m_forces, offsetState(m_x,dx,g_offset_x), offsetState(m_v,dv,g_offset_v), m_m, A );
+}
+
+void TwoDScene::accumulateddUdxdv( SparseMatrixXs& A, const VectorXs& dx, const VectorXs& dv )
+{
+  accumulateSparse<false>( m_forces, offsetState(m_x,dx,g_offset_x), offsetState(m_v,dv,g_offset_v), m_m, A );
+}
+
+void TwoDScene::accumulateddUdxdxProduct( VectorXs& out, const VectorXs& p, const VectorXs& dx, const VectorXs& dv )
+{
+  accumulateProduct<true>( m_forces, offsetState(m_x,dx,g_offset_x), offsetState(m_v,dv,g_offset_v), m_m, p, out );
+}
+
+void TwoDScene::accumulateddUdxdvProduct( VectorXs& out, const VectorXs& p, const VectorXs& dx, const VectorXs& dv )
+{
+  accumulateProduct<false>( m_forces, offsetState(m_x,dx,g_offset_x), offsetState(m_v,dv,g_offset_v), m_m, p, out );
+}
+
+void TwoDScene::accumulateddUdxdxDiagonal( VectorXs& d, const VectorXs& dx, const VectorXs& dv )
+{
+  accumulateDiagonal<true>( m_forces, offsetState(m_x,dx,g_offset_x), offsetState(m_v,dv,g_offset_v), m_m, d );
+}
+
+void TwoDScene::accumulateddUdxdvDiagonal( VectorXs& d, const VectorXs& dx, const VectorXs& dv )
+{
+  accumulateDiagonal<false>( m_forces, offsetState(m_x,dx,g_offset_x), offsetState(m_v,dv,g_offset_v), m_m, d );
+}
+
+void TwoDScene::evaluateForces( int flags, scalar& E, VectorXs& gradE, TripletXs& hessX, TripletXs& hessV, const VectorXs& dx, const VectorXs& dv )
+{
+  assert( !( flags & EVALUATE_GRADIENT ) || gradE.size() == m_x.size() );
+
+#ifdef _OPENMP
+  const bool parallelgradient = true;
+#else
+  const bool parallelgradient = deterministicReductions();
+#endif
+  const VectorXs& x = offsetState(m_x,dx,g_offset_x);
+  const VectorXs& v = offsetState(m_v,dv,g_offset_v);
+  if( parallelgradient && ( flags & EVALUATE_GRADIENT ) )
+  {
+    const bool energy = ( flags & EVALUATE_ENERGY ) != 0;
+    accumulateGradient(m_forces,x,v,m_m,gradE,energy ? &E : NULL);
+    flags &= energy ? ~( EVALUATE_GRADIENT | EVALUATE_ENERGY ) : ~EVALUATE_GRADIENT;
+  }
+  for( std::vector<Force*>::size_type i = 0; i < m_forces.size(); ++i )
+    evaluateForce(m_forces[i],flags,x,v,m_m,E,gradE,hessX,hessV);
+}
+
+void TwoDScene::evaluateForceSplit( ForceSplit split, int flags, scalar& E, VectorXs& gradE, TripletXs& hessX, TripletXs& hessV, const VectorXs& dx, const VectorXs& dv )
+{
+  assert( !( flags & EVALUATE_GRADIENT ) || gradE.size() == m_x.size() );
+
+  const VectorXs& x = offsetState(m_x,dx,g_offset_x);
+  const VectorXs& v = offsetState(m_v,dv,g_offset_v);
+  for( std::vector<Force*>::size_type i = 0; i < m_forces.size(); ++i )
+    if( isImplicitForce(m_forces[i]) == ( split == IMPLICIT_FORCES ) )
+      evaluateForce(m_forces[i],flags,x,v,m_m,E,gradE,hessX,hessV);
+}
+
+#ifdef NBODY_GRAVITY_THETA
+// Groups the GravitationalForces by G and, for every group whose pairs are
+// exactly all pairs of its particles, maps each of its forces to one
+// NBodyGravityForce over those particles. Other groups are left pairwise.
+static std::map<Force*,NBodyGravityForce*> groupGravitationalForces( const std::vector<Force*>& forces, const scalar& theta )
+{
+  typedef std::set<std::pair<int,int> > PairSet;
+  std::map<scalar,std::vector<Force*> > groups;
+  for( std::vector<Force*>::size_type i = 0; i < forces.size(); ++i )
+    if( GravitationalForce* gravity = dynamic_cast<GravitationalForce*>(forces[i]) )
+      groups[gravity->getG()].push_back(gravity);
+
+  std::map<Force*,NBodyGravityForce*> nbody;
+  for( std::map<scalar,std::vector<Force*> >::const_iterator g = groups.begin(); g != groups.end(); ++g )
+  {
+    PairSet pairs;
+    std::set<int> particles;
+    for( std::vector<Force*>::size_type i = 0; i < g->second.size(); ++i )
+    {
+      const std::pair<int,int>& p = static_cast<GravitationalForce*>(g->second[i])->getParticles();
+      pairs.insert( std::make_pair( std::min(p.first,p.second), std::max(p.first,p.second) ) );
+      particles.insert(p.first);
+      particles.insert(p.second);
+    }
+    const std::set<int>::size_type n = particles.size();
+    if( pairs.size() != g->second.size() || pairs.size() != n*(n-1)/2 ) continue;
+
+    NBodyGravityForce* force = new NBodyGravityForce( std::vector<int>(particles.begin(),particles.end()), g->first, theta );
+    for( std::vector<Force*>::size_type i = 0; i < g->second.size(); ++i ) nbody[g->second[i]] = force;
+  }
+  return nbody;
+}
+#endif
+
+#ifdef VORTEX_FIELD_THETA
+// Groups the VortexForces by ( kbs, kvc ) and, for every group whose pairs
+// are exactly all pairs of a set of sources (first particles) with a
+// disjoint set of targets (second particles), maps each of its forces to one
+// VortexFieldForce. Other groups are left pairwise.
+static std::map<Force*,VortexFieldForce*> groupVortexForces( const std::vector<Force*>& forces, const scalar& theta, int order )
+{
+  typedef std::pair<scalar,scalar> Constants;
+  std::map<Constants,std::vector<VortexForce*> > groups;
+  for( std::vector<Force*>::size_type i = 0; i < forces.size(); ++i )
+    if( VortexForce* vortex = dynamic_cast<VortexForce*>(forces[i]) )
+      groups[Constants(vortex->getBiotSavart(),vortex->getViscosity())].push_back(vortex);
+
+  std::map<Force*,VortexFieldForce*> field;
+  for( std::map<Constants,std::vector<VortexForce*> >::const_iterator g = groups.begin(); g != groups.end(); ++g )
+  {
+    std::set<std::pair<int,int> > pairs;
+    std::set<int> sources;
+    std::set<int> targets;
+    for( std::vector<VortexForce*>::size_type i = 0; i < g->second.size(); ++i )
+    {
+      const std::pair<int,int>& p = g->second[i]->getParticles();
+      pairs.insert(p);
+      sources.insert(p.first);
+      targets.insert(p.second);
+    }
+    if( pairs.size() != g->second.size() || pairs.size() != sources.size()*targets.size() ) continue;
+    bool disjoint = true;
+    for( std::set<int>::const_iterator i = sources.begin(); i != sources.end(); ++i ) disjoint = disjoint && !targets.count(*i);
+    if( !disjoint ) continue;
+
+    VortexFieldForce* force = new VortexFieldForce( std::vector<int>(sources.begin(),sources.end()), std::vector<int>(targets.begin(),targets.end()), g->first.first, g->first.second, theta, order );
+    for( std::vector<VortexForce*>::size_type i = 0; i < g->second.size(); ++i ) field[g->second[i]] = force;
+  }
+  return field;
+}
+#endif
+
+const std::vector<Force*>& TwoDScene::getForces() const
+{
+  return m_forces;
+}
+
+namespace
+{
+
+// Orders springs by their lower endpoint and then their upper one, so that
+// consecutive springs read and scatter to nearby particles.
+struct SpringEndpointOrder
+{
+  bool operator()( const SpringForce* a, const SpringForce* b ) const
+  {
+    const std::pair<int,int>& ea = a->getEndpoints();
+    const std::pair<int,int>& eb = b->getEndpoints();
+    const int mina = std::min(ea.first, ea.second);
+    const int minb = std::min(eb.first, eb.second);
+    if( mina != minb ) return mina < minb;
+    return std::max(ea.first, ea.second) < std::max(eb.first, eb.second);
+  }
+};
+
+}
+
+// True for the forces batchForces replaces.
+static bool isUnbatchedForce( Force* force )
+{
+  return dynamic_cast<SpringForce*>(force) != NULL || dynamic_cast<SimpleGravityForce*>(force) != NULL ||
+         dynamic_cast<DragDampingForce*>(force) != NULL || dynamic_cast<GravitationalForce*>(force) != NULL ||
+         dynamic_cast<VortexForce*>(force) != NULL;
+}
+
+void TwoDScene::batchForces()
+{
+  // Steppers call this every step; once batched, return before allocating.
+  bool unbatched = false;
+  for( std::vector<Force*>::size_type i = 0; i < m_forces.size() && !unbatched; ++i ) unbatched = isUnbatchedForce(m_forces[i]);
+  if( !unbatched ) return;
+
+#ifdef NBODY_GRAVITY_THETA
+  const std::map<Force*,NBodyGravityForce*> nbody = groupGravitationalForces( m_forces, NBODY_GRAVITY_THETA );
+  std::set<NBodyGravityForce*> inserted;
+#endif
+#ifdef VORTEX_FIELD_THETA
+  const std::map<Force*,VortexFieldForce*> vortices = groupVortexForces( m_forces, VORTEX_FIELD_THETA, VORTEX_FIELD_ORDER );
+  std::set<VortexFieldForce*> inserted_vortices;
+#endif
+
+  std::vector<Force*> forces;
+  forces.reserve(m_forces.size());
+  // Springs are batched after the loop, in endpoint order rather than the
+  // order the scene file lists them, where the first of them was.
+  std::vector<SpringForce*> springs;
+  std::vector<Force*>::size_type springs_at = 0;
+  UniformFieldForce* field = NULL;
+  GravitationalForceBatch* gravity_pairs = NULL;
+  VortexForceBatch* vortex_pairs = NULL;
+  bool changed = false;
+  for( std::vector<Force*>::size_type i = 0; i < m_forces.size(); ++i )
+  {
+    Force* force = m_forces[i];
+    if( SpringForce* spring = dynamic_cast<SpringForce*>(force) )
+    {
+      if( springs.empty() ) springs_at = forces.size();
+      springs.push_back(spring);
+      changed = true;
+      continue;
+    }
+    else if( SimpleGravityForce* gravity = dynamic_cast<SimpleGravityForce*>(force) )
+    {
+      if( field == NULL ) { field = new UniformFieldForce; forces.push_back(field); }
+      field->addForce(*gravity);
+    }
+    else if( DragDampingForce* drag = dynamic_cast<DragDampingForce*>(force) )
+    {
+      if( field == NULL ) { field = new UniformFieldForce; forces.push_back(field); }
+      field->addForce(*drag);
+    }
+#ifdef NBODY_GRAVITY_THETA
+    else if( nbody.count(force) )
+    {
+      NBodyGravityForce* gravity = nbody.find(force)->second;
+      if( inserted.insert(gravity).second ) forces.push_back(gravity);
+    }
+#endif
+#ifdef VORTEX_FIELD_THETA
+    else if( vortices.count(force) )
+    {
+      VortexFieldForce* vortex = vortices.find(force)->second;
+      if( inserted_vortices.insert(vortex).second ) forces.push_back(vortex);
+    }
+#endif
+    else if( GravitationalForce* pair = dynamic_cast<GravitationalForce*>(force) )
+    {
+      if( gravity_pairs == NULL || gravity_pairs->getNumPairs() == PAIRS_PER_BATCH ) { gravity_pairs = new GravitationalForceBatch; forces.push_back(gravity_pairs); }
+      gravity_pairs->addForce(*pair);
+    }
+    else if( VortexForce* pair = dynamic_cast<VortexForce*>(force) )
+    {
+      if( vortex_pairs == NULL || vortex_pairs->getNumPairs() == PAIRS_PER_BATCH ) { vortex_pairs = new VortexForceBatch; forces.push_back(vortex_pairs); }
+      vortex_pairs->addForce(*pair);
+    }
+    else
+    {
+      forces.push_back(force);
+      continue;
+    }
+    delete force;
+    changed = true;
+  }
+
+  std::stable_sort(springs.begin(), springs.end(), SpringEndpointOrder());
+  std::vector<Force*> batches;
+  for( std::vector<SpringForce*>::size_type i = 0; i < springs.size(); ++i )
+  {
+    if( batches.empty() || static_cast<SpringForceBatch*>(batches.back())->getNumSprings() == SPRINGS_PER_BATCH ) batches.push_back(new SpringForceBatch);
+    static_cast<SpringForceBatch*>(batches.back())->addSpring(*springs[i]);
+    delete springs[i];
+  }
+  forces.insert(forces.begin() + springs_at, batches.begin(), batches.end());
+
+  if( changed ) m_forces.swap(forces);
+}
+
+scalar TwoDScene::excludeLinearDrag()
+{
+  scalar b = 0.0;
+  for( std::vector<Force*>::size_type i = 0; i < m_forces.size(); ++i )
+  {
+    UniformFieldForce* field = dynamic_cast<UniformFieldForce*>(m_forces[i]);
+    if( field == NULL ) continue;
+    field->setDragExcluded(true);
+    b += field->getDamping();
+  }
+  return b;
+}
@@ -0,0 +1,157 @@
+#include "UniformFieldForce.h"
+
+// Views of a DoF vector as a 2 x nparticles matrix, one column per particle,
+// so that the per-component field broadcasts as a column-wise expression.
+typedef Eigen::Map<const Eigen::Matrix<scalar,2,Eigen::Dynamic> > ConstParticleMap;
+typedef Eigen::Map<Eigen::Matrix<scalar,2,Eigen::Dynamic> > ParticleMap;
+
+UniformFieldForce::UniformFieldForce()
+: Force()
+, m_gravity(Vector2s::Zero())
+, m_b(0.0)
+, m_drag_excluded(false)
+{}
+
+UniformFieldForce::~UniformFieldForce()
+{}
+
+void UniformFieldForce::addGravity( const Vector2s& gravity )
+{
+  m_gravity += gravity;
+}
+
+void UniformFieldForce::addDrag( const scalar& b )
+{
+  assert( b >= 0.0 );
+  m_b += b;
+}
+
+void UniformFieldForce::addForce( const SimpleGravityForce& force )
+{
+  addGravity( force.getGravity() );
+}
+
+void UniformFieldForce::addForce( const DragDampingForce& force )
+{
+  addDrag( force.getDamping() );
+}
+
+void UniformFieldForce::addEnergyToTotal( const VectorXs& x, const VectorXs& v, const VectorXs& m, scalar& E )
+{
+  assert( x.size() == v.size() );
+  assert( x.size() == m.size() );
+  assert( x.size()%2 == 0 );
+
+  const int nparticles = x.size()/2;
+  ConstParticleMap X( x.data(), 2, nparticles );
+  ConstParticleMap M( m.data(), 2, nparticles );
+  E -= m_gravity.dot( ( M.array()*X.array() ).matrix().rowwise().sum() );
+}
+
+void UniformFieldForce::addGradEToTotal( const VectorXs& x, const VectorXs& v, const VectorXs& m, VectorXs& gradE )
+{
+  assert( x.size() == v.size() );
+  assert( x.size() == m.size() );
+  assert( x.size() == gradE.size() );
+  assert( x.size()%2 == 0 );
+
+  // A single fused pass: each column is one particle, which SSE2 handles as
+  // one packet of two doubles.
+  const int nparticles = x.size()/2;
+  ConstParticleMap V( v.data(), 2, nparticles );
+  ConstParticleMap M( m.data(), 2, nparticles );
+  ParticleMap G( gradE.data(), 2, nparticles );
+  G.array() += appliedDrag()*V.array() - M.array()*m_gravity.replicate(1,nparticles).array();
+}
+
+void UniformFieldForce::addEnergyAndGradEToTotal( const VectorXs& x, const VectorXs& v, const VectorXs& m, scalar& E, VectorXs& gradE )
+{
+  assert( x.size() == v.size() );
+  assert( x.size() == m.size() );
+  assert( x.size() == gradE.size() );
+  assert( x.size()%2 == 0 );
+
+  // The gradient rounds as addGradEToTotal's does.
+  const scalar b = appliedDrag();
+  const scalar* xp = x.data();
+  const scalar* vp = v.data();
+  const scalar* mp = m.data();
+  scalar* gp = gradE.data();
+  scalar mx = 0.0;
+  scalar my = 0.0;
+  for( int i = 0; i < x.size(); i += 2 )
+  {
+    gp[i]   += b*vp[i]   - mp[i]*m_gravity.x();
+    gp[i+1] += b*vp[i+1] - mp[i+1]*m_gravity.y();
+    mx += mp[i]*xp[i];
+    my += mp[i+1]*xp[i+1];
+  }
+  E -= m_gravity.x()*mx + m_gravity.y()*my;
+}
+
+void UniformFieldForce::addHessXToTotal( const VectorXs& x, const VectorXs& v, const VectorXs& m, MatrixXs& hessE )
+{
+  assert( x.size() == v.size() );
+  assert( x.size() == m.size() );
+  assert( x.size() == hessE.rows() );
+  assert( x.size() == hessE.cols() );
+  assert( x.size()%2 == 0 );
+
+  // Nothing to do.
+}
+
+void UniformFieldForce::addHessVToTotal( const VectorXs& x, const VectorXs& v, const VectorXs& m, MatrixXs& hessE )
+{
+  assert( x.size() == v.size() );
+  assert( x.size() == m.size() );
+  assert( x.size() == hessE.rows() );
+  assert( x.size() == hessE.cols() );
+  assert( x.size()%2 == 0 );
+
+  hessE.diagonal().array() += appliedDrag();
+}
+
+void UniformFieldForce::addHessXToTotal( const VectorXs& x, const VectorXs& v, const VectorXs& m, TripletXs& hessE )
+{
+  assert( x.size() == v.size() );
+  assert( x.size() == m.size() );
+  assert( x.size()%2 == 0 );
+
+  // Nothing to do.
+}
+
+void UniformFieldForce::addHessVToTotal( const VectorXs& x, const VectorXs& v, const VectorXs& m, TripletXs& hessE )
+{
+  assert( x.size() == v.size() );
+  assert( x.size() == m.size() );
+  assert( x.size()%2 == 0 );
+
+  const scalar b = appliedDrag();
+  if( b == 0.0 ) return;
+  for( int i = 0; i < x.size(); ++i ) hessE.push_back( Triplet( i, i, b ) );
+}
+
+void UniformFieldForce::addHessXVProductToTotal( const VectorXs& x, const VectorXs& v, const VectorXs& m, const VectorXs& dx, VectorXs& out )
+{
+  assert( x.size() == v.size() );
+  assert( x.size() == m.size() );
+  assert( x.size() == dx.size() );
+  assert( x.size() == out.size() );
+
+  // Nothing to do.
+}
+
+void UniformFieldForce::addHessVVProductToTotal( const VectorXs& x, const VectorXs& v, const VectorXs& m, const VectorXs& dv, VectorXs& out )
+{
+  assert( x.size() == v.size() );
+  assert( x.size() == m.size() );
+  assert( x.size() == dv.size() );
+  assert( x.size() == out.size() );
+
+  out += appliedDrag()*dv;
+}
+
+Force* UniformFieldForce::createNewCopy()
+{
+  return new UniformFieldForce(*this);
+}
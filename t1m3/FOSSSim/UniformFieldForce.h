@@ -0,0 +1,71 @@
+#ifndef __UNIFORM_FIELD_FORCE_H__
+#define __UNIFORM_FIELD_FORCE_H__
+
+#include <Eigen/Core>
+#include "Force.h"
+#include "SimpleGravityForce.h"
+#include "DragDampingForce.h"
+
+// Fuses all forces that act identically on every particle, a uniform
+// gravitational acceleration and linear drag, into one pass over x, v and m:
+//   gradE = -m g + b v.
+class UniformFieldForce : public Force
+{
+public:
+
+  UniformFieldForce();
+
+  virtual ~UniformFieldForce();
+
+  void addGravity( const Vector2s& gravity );
+
+  void addDrag( const scalar& b );
+
+  void addForce( const SimpleGravityForce& force );
+
+  void addForce( const DragDampingForce& force );
+
+  const Vector2s& getGravity() const { return m_gravity; }
+  const scalar& getDamping() const { return m_b; }
+
+  // Leaves the drag out of the gradient, the Hessians and their products,
+  // for steppers that integrate it themselves; see DragDecay.
+  void setDragExcluded( bool excluded ) { m_drag_excluded = excluded; }
+  bool isDragExcluded() const { return m_drag_excluded; }
+
+  // Gravitational potential only; drag defines no energy.
+  virtual void addEnergyToTotal( const VectorXs& x, const VectorXs& v, const VectorXs& m, scalar& E );
+
+  virtual void addGradEToTotal( const VectorXs& x, const VectorXs& v, const VectorXs& m, VectorXs& gradE );
+
+  // Both of the above in one pass over x, v and m.
+  void addEnergyAndGradEToTotal( const VectorXs& x, const VectorXs& v, const VectorXs& m, scalar& E, VectorXs& gradE );
+
+  virtual void addHessXToTotal( const VectorXs& x, const VectorXs& v, const VectorXs& m, MatrixXs& hessE );
+
+  virtual void addHessVToTotal( const VectorXs& x, const VectorXs& v, const VectorXs& m, MatrixXs& hessE );
+
+  // Triplet versions used by TwoDScene's sparse accumulators.
+  void addHessXToTotal( const VectorXs& x, const VectorXs& v, const VectorXs& m, TripletXs& hessE );
+
+  void addHessVToTotal( const VectorXs& x, const VectorXs& v, const VectorXs& m, TripletXs& hessE );
+
+  // Hessian-vector products, out += hessE*dx, without forming the Hessian.
+  void addHessXVProductToTotal( const VectorXs& x, const VectorXs& v, const VectorXs& m, const VectorXs& dx, VectorXs& out );
+
+  void addHessVVProductToTotal( const VectorXs& x, const VectorXs& v, const VectorXs& m, const VectorXs& dv, VectorXs& out );
+
+  virtual Force* createNewCopy();
+
+  EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+private:
+  // The drag the force loop applies: none once excluded.
+  scalar appliedDrag() const { return m_drag_excluded ? 0.0 : m_b; }
+
+  Vector2s m_gravity;
+  scalar m_b;
+  bool m_drag_excluded;
+};
+
+#endif
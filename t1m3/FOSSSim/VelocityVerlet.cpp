@@ -0,0 +1,38 @@
+#include "VelocityVerlet.h"
+
+#include "StepKernels.h"
+
+VelocityVerlet::VelocityVerlet()
+: m_valid(false)
+, m_evaluations(0)
+{}
+
+void VelocityVerlet::acceleration( TwoDScene& scene, const FixedDoFs& fixed, const VectorXs& dv, VectorXs& a )
+{
+  ++m_evaluations;
+  a.setZero(scene.getX().size());
+  scene.accumulateGradUParallel(a, VectorXs(), dv);
+  a.array() *= -fixed.getInverseMasses().array();
+}
+
+void VelocityVerlet::advance( TwoDScene& scene, const FixedDoFs& fixed, bool fixedchanged, scalar dt )
+{
+  VectorXs& x = scene.getX();
+  VectorXs& v = scene.getV();
+
+  if( !m_valid || fixedchanged || m_x.size() != x.size() || m_x != x || m_v != v ) acceleration(scene, fixed, VectorXs(), m_a);
+
+  verletPositionUpdate(fixed, m_a, dt, x, v, m_dv);
+  acceleration(scene, fixed, m_dv, m_anext);
+  v += (0.5*dt)*( m_a + m_anext );
+  m_a.swap(m_anext);
+
+  m_x = x;
+  m_v = v;
+  m_valid = true;
+}
+
+int VelocityVerlet::getNumEvaluations() const
+{
+  return m_evaluations;
+}
@@ -0,0 +1,47 @@
+#ifndef __VELOCITY_VERLET_H__
+#define __VELOCITY_VERLET_H__
+
+#include "FixedDoFs.h"
+#include "MathDefs.h"
+#include "TwoDScene.h"
+
+// Velocity Verlet, used by symplectic Euler when built with
+// USE_VELOCITY_VERLET:
+//
+//   x_{n+1} = x_n + dt*v_n + dt^2/2*a_n
+//   v_{n+1} = v_n + dt/2*( a_n + a_{n+1} )
+//
+// Second order and symplectic for position-dependent forces, at one force
+// evaluation per step: a_{n+1} is kept for the next step, and only
+// recomputed when the state was changed between steps or the fixed set
+// changed. Velocity-dependent forces see the predicted velocity
+// v_n + dt*a_n in a_{n+1}, which keeps the step explicit but drops it to
+// first order in them. Fixed particles neither move nor accelerate.
+class VelocityVerlet
+{
+public:
+  VelocityVerlet();
+
+  // Advances the scene's positions and velocities by dt. fixed must be up to
+  // date for the scene, and fixedchanged what its update returned.
+  void advance( TwoDScene& scene, const FixedDoFs& fixed, bool fixedchanged, scalar dt );
+
+  // Force evaluations over all calls so far.
+  int getNumEvaluations() const;
+
+private:
+  // a = the acceleration at (x, v + dv).
+  void acceleration( TwoDScene& scene, const FixedDoFs& fixed, const VectorXs& dv, VectorXs& a );
+
+  // The acceleration at the state the last step ended on, and that state.
+  VectorXs m_a;
+  VectorXs m_x;
+  VectorXs m_v;
+  bool m_valid;
+  // Stage buffers, kept so that steps do not allocate.
+  VectorXs m_dv;
+  VectorXs m_anext;
+  int m_evaluations;
+};
+
+#endif
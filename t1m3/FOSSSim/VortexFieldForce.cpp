@@ -0,0 +1,225 @@
+#include "VortexFieldForce.h"
+
+#include <cstdlib>
+#include <iostream>
+
+// Colored console output; defined in the base library.
+namespace outputmod
+{
+  std::ostream& startred( std::ostream& stream );
+  std::ostream& endred( std::ostream& stream );
+}
+
+VortexFieldForce::VortexFieldForce( const std::vector<int>& sources, const std::vector<int>& targets, const scalar& kbs, const scalar& kvc, const scalar& theta, int order )
+: PooledForce()
+, m_sources()
+, m_targets()
+, m_kbs(kbs)
+, m_kvc(kvc)
+, m_theta(theta)
+, m_order(order)
+{
+  assert( m_kvc >= 0.0 );
+  assert( m_theta >= 0.0 );
+  assert( m_order >= 0 ); assert( m_order <= 2 );
+  m_sources.particles = sources;
+  m_targets.particles = targets;
+}
+
+VortexFieldForce::~VortexFieldForce()
+{}
+
+void VortexFieldForce::build( const VectorXs& x, const VectorXs& v, Side& side ) const
+{
+  side.tree.build( x, side.particles );
+  const int nnodes = side.tree.getNumNodes();
+  std::vector<scalar> count( nnodes, 0.0 );
+  std::vector<Vector2s> centroid( nnodes, Vector2s::Zero() );
+  std::vector<Vector2s> velocity( nnodes, Vector2s::Zero() );
+  std::vector<Matrix2s> moment( nnodes, Matrix2s::Zero() );
+  std::vector<Matrix2s> second( nnodes, Matrix2s::Zero() );
+  std::vector<Matrix2s> third[2] = { std::vector<Matrix2s>( nnodes, Matrix2s::Zero() ), std::vector<Matrix2s>( nnodes, Matrix2s::Zero() ) };
+
+  // Raw sums of x, x v^T, x x^T and x x^T v(k) first, children before
+  // parents; then centroids and central moments.
+  const std::vector<int>& order = side.tree.getOrder();
+  for( int node = nnodes-1; node >= 0; --node )
+  {
+    const QuadTree::Node& n = side.tree.getNode(node);
+    if( n.child < 0 )
+    {
+      for( int k = n.begin; k < n.end; ++k )
+      {
+        const Vector2s xp = x.segment<2>(2*order[k]);
+        const Vector2s vp = v.segment<2>(2*order[k]);
+        count[node] += 1.0;
+        centroid[node] += xp;
+        velocity[node] += vp;
+        moment[node] += xp*vp.transpose();
+        const Matrix2s xx = xp*xp.transpose();
+        second[node] += xx;
+        third[0][node] += vp.x()*xx;
+        third[1][node] += vp.y()*xx;
+      }
+    }
+    else
+    {
+      for( int q = 0; q < 4; ++q )
+      {
+        count[node] += count[n.child+q];
+        centroid[node] += centroid[n.child+q];
+        velocity[node] += velocity[n.child+q];
+        moment[node] += moment[n.child+q];
+        second[node] += second[n.child+q];
+        third[0][node] += third[0][n.child+q];
+        third[1][node] += third[1][n.child+q];
+      }
+    }
+  }
+  for( int node = 0; node < nnodes; ++node )
+  {
+    if( count[node] == 0.0 ) continue;
+    const Vector2s c = centroid[node] /= count[node];
+    const Matrix2s cc = c*c.transpose();
+    for( int k = 0; k < 2; ++k )
+    {
+      const Vector2s xv = moment[node].col(k);
+      third[k][node] += velocity[node](k)*cc - c*xv.transpose() - xv*c.transpose();
+    }
+    moment[node] -= c*velocity[node].transpose();
+    second[node] -= count[node]*cc;
+  }
+
+  // The cancellation above is why the sums are kept in double.
+  side.count.resize( nnodes );
+  side.centroid.resize( nnodes );
+  side.velocity.resize( nnodes );
+  side.moment.resize( nnodes );
+  side.second.resize( nnodes );
+  side.third[0].resize( nnodes );
+  side.third[1].resize( nnodes );
+  for( int node = 0; node < nnodes; ++node )
+  {
+    side.count[node] = cellscalar( count[node] );
+    side.centroid[node] = centroid[node].cast<cellscalar>();
+    side.velocity[node] = velocity[node].cast<cellscalar>();
+    side.moment[node] = moment[node].cast<cellscalar>();
+    side.second[node] = second[node].cast<cellscalar>();
+    side.third[0][node] = third[0][node].cast<cellscalar>();
+    side.third[1][node] = third[1][node].cast<cellscalar>();
+  }
+}
+
+Vector2s VortexFieldForce::field( const VectorXs& x, const VectorXs& v, const Side& side, const Vector2s& y, const Vector2s& u ) const
+{
+  Vector2s g = Vector2s::Zero();
+  if( side.tree.getNumNodes() == 0 ) return g;
+
+  const std::vector<int>& order = side.tree.getOrder();
+  const scalar theta2 = m_theta*m_theta;
+  int stack[4*QuadTree::MAX_DEPTH+4];
+  int top = 0;
+  stack[top++] = 0;
+  while( top > 0 )
+  {
+    const int node = stack[--top];
+    const QuadTree::Node& n = side.tree.getNode(node);
+    if( n.begin == n.end ) continue;
+
+    if( n.child < 0 )
+    {
+      for( int k = n.begin; k < n.end; ++k )
+      {
+        const Vector2s r = y - x.segment<2>(2*order[k]);
+        const scalar l2 = r.squaredNorm();
+        assert( l2 != 0.0 );
+        const scalar l = sqrt(l2);
+        g += ( m_kvc/l2 )*( ( m_kbs/l )*Vector2s( -r.y(), r.x() ) - ( u - v.segment<2>(2*order[k]) ) );
+      }
+      continue;
+    }
+
+    const Vector2s d = y - side.centroid[node].cast<scalar>();
+    const scalar l2 = d.squaredNorm();
+    const scalar w = 2.0*n.half;
+    if( side.tree.contains( node, y ) || w*w >= theta2*l2 )
+    {
+      for( int q = 0; q < 4; ++q ) stack[top++] = n.child + q;
+      continue;
+    }
+
+    // With a = kvc*kbs and b = kvc the kernel is A(d) + B(d)*dv, where
+    // A(d) = a*J d/|d|^3 for the quarter turn J, and B(d) = -b/|d|^2.
+    const scalar N = side.count[node];
+    const Vector2s V = side.velocity[node].cast<scalar>();
+    const scalar l = sqrt(l2);
+    g += ( m_kvc/l2 )*( ( N*m_kbs/l )*Vector2s( -d.y(), d.x() ) - ( N*u - V ) );
+    if( m_order < 1 ) continue;
+
+    // The first moment of A vanishes about the centroid.
+    g += ( 2.0*m_kvc/( l2*l2 ) )*( side.moment[node].cast<scalar>().transpose()*d );
+    if( m_order < 2 ) continue;
+
+    const Matrix2s Q = side.second[node].cast<scalar>();
+    const Vector2s Qd = Q*d;
+    const scalar c = -( m_kvc*m_kbs )/( l2*l2*l );
+    g += c*( 3.0*Vector2s( -Qd.y(), Qd.x() ) + 1.5*( Q.trace() - 5.0*d.dot(Qd)/l2 )*Vector2s( -d.y(), d.x() ) );
+    const Matrix2s HB = ( 2.0*m_kvc/( l2*l2 ) )*( Matrix2s::Identity() - ( 4.0/l2 )*d*d.transpose() );
+    g += 0.5*( HB.cwiseProduct(Q).sum()*u - Vector2s( HB.cwiseProduct(side.third[0][node].cast<scalar>()).sum(), HB.cwiseProduct(side.third[1][node].cast<scalar>()).sum() ) );
+  }
+  return g;
+}
+
+void VortexFieldForce::addEnergyToTotal( const VectorXs& x, const VectorXs& v, const VectorXs& m, scalar& E )
+{
+  std::cerr << outputmod::startred << "ERROR IN VORTEXFIELDFORCE: " << outputmod::endred << "No energy defined for VortexFieldForce." << std::endl;
+  exit(1);
+}
+
+void VortexFieldForce::addGradEToTotal( const VectorXs& x, const VectorXs& v, const VectorXs& m, VectorXs& gradE )
+{
+  assert( x.size() == v.size() );
+  assert( x.size() == m.size() );
+  assert( x.size() == gradE.size() );
+  assert( x.size()%2 == 0 );
+
+  build( x, v, m_sources );
+  build( x, v, m_targets );
+
+  // The pair kernel is odd in ( r, dv ), so the reactions on the sources are
+  // the same sum over the targets' tree, with the same sign. Each side is
+  // walked in its own tree's order, so consecutive evaluations open mostly
+  // the same cells of the other tree.
+  const Side* sides[2] = { &m_targets, &m_sources };
+  for( int s = 0; s < 2; ++s )
+  {
+    const std::vector<int>& particles = sides[s]->tree.getOrder();
+    const Side& other = *sides[1-s];
+    const int nparticles = (int) particles.size();
+#ifdef _OPENMP
+    #pragma omp parallel for schedule(dynamic,64)
+#endif
+    for( int k = 0; k < nparticles; ++k )
+    {
+      const int i = particles[k];
+      gradE.segment<2>(2*i) -= field( x, v, other, x.segment<2>(2*i), v.segment<2>(2*i) );
+    }
+  }
+}
+
+void VortexFieldForce::addHessXToTotal( const VectorXs& x, const VectorXs& v, const VectorXs& m, MatrixXs& hessE )
+{
+  std::cerr << outputmod::startred << "ERROR IN VORTEXFIELDFORCE: " << outputmod::endred << "No addHessXToTotal defined for VortexFieldForce." << std::endl;
+  exit(1);
+}
+
+void VortexFieldForce::addHessVToTotal( const VectorXs& x, const VectorXs& v, const VectorXs& m, MatrixXs& hessE )
+{
+  std::cerr << outputmod::startred << "ERROR IN VORTEXFIELDFORCE: " << outputmod::endred << "No addHessVToTotal defined for VortexFieldForce." << std::endl;
+  exit(1);
+}
+
+Force* VortexFieldForce::createNewCopy()
+{
+  return new VortexFieldForce(*this);
+}
@@ -0,0 +1,70 @@
+#ifndef __VORTEX_FIELD_FORCE_H__
+#define __VORTEX_FIELD_FORCE_H__
+
+#include <Eigen/Core>
+#include <vector>
+#include "ForceArena.h"
+#include "QuadTree.h"
+
+// One VortexForce from every source particle on every target particle,
+// evaluated with a treecode. The sources and the targets each get a
+// quadtree; a cell of width w at distance d from the particle being
+// evaluated is replaced by an expansion about its centroid once w < theta*d,
+// which makes a gradient O(n log n) in place of O(#sources*#targets).
+//
+// The pair kernel kvc*( kbs*t/|r| - dv )/|r|^2 is not harmonic, so complex
+// multipole expansions do not apply; cells carry Cartesian moments about
+// their centroid instead, and the far field is the kernel's Taylor expansion
+// to the given order in the offsets from the centroid. Order 0 needs each
+// cell's count and summed velocity, order 1 adds sum( dp vp^T ), and order 2
+// adds sum( dp dp^T ) and sum( dp dp^T vp ), for offsets dp. theta = 0 opens
+// every cell and recovers the pairwise forces up to summation order.
+class VortexFieldForce : public PooledForce
+{
+public:
+
+  VortexFieldForce( const std::vector<int>& sources, const std::vector<int>& targets, const scalar& kbs, const scalar& kvc, const scalar& theta, int order );
+
+  virtual ~VortexFieldForce();
+
+  virtual void addEnergyToTotal( const VectorXs& x, const VectorXs& v, const VectorXs& m, scalar& E );
+
+  virtual void addGradEToTotal( const VectorXs& x, const VectorXs& v, const VectorXs& m, VectorXs& gradE );
+
+  virtual void addHessXToTotal( const VectorXs& x, const VectorXs& v, const VectorXs& m, MatrixXs& hessE );
+
+  virtual void addHessVToTotal( const VectorXs& x, const VectorXs& v, const VectorXs& m, MatrixXs& hessE );
+
+  virtual Force* createNewCopy();
+
+private:
+
+  // A quadtree over one side of the interaction with each node's moments.
+  struct Side
+  {
+    std::vector<int> particles;
+    QuadTree tree;
+    std::vector<cellscalar> count;
+    std::vector<Vector2cs> centroid;
+    std::vector<Vector2cs> velocity;
+    // Central moments sum( dp vp^T ), sum( dp dp^T ) and, per velocity
+    // component k, sum( dp dp^T vp(k) ).
+    std::vector<Matrix2cs> moment;
+    std::vector<Matrix2cs> second;
+    std::vector<Matrix2cs> third[2];
+  };
+
+  void build( const VectorXs& x, const VectorXs& v, Side& side ) const;
+
+  // Sum of the pair kernel g( y - xp, u - vp ) over the particles p of side.
+  Vector2s field( const VectorXs& x, const VectorXs& v, const Side& side, const Vector2s& y, const Vector2s& u ) const;
+
+  Side m_sources;
+  Side m_targets;
+  scalar m_kbs;
+  scalar m_kvc;
+  scalar m_theta;
+  int m_order;
+};
+
+#endif
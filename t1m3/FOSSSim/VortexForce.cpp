@@ -0,0 +1,72 @@
+#include "VortexForce.h"
+
+#include <cstdlib>
+
+// Colored console output; defined in the base library.
+namespace outputmod
+{
+  std::ostream& startred( std::ostream& stream );
+  std::ostream& endred( std::ostream& stream );
+}
+
+VortexForce::VortexForce( const std::pair<int,int>& particles, const scalar& kbs, const scalar& kvc )
+: Force()
+, m_particles(particles)
+, m_kbs(kbs)
+, m_kvc(kvc)
+{
+  assert( m_particles.first >= 0 );
+  assert( m_particles.second >= 0 );
+  assert( m_particles.first != m_particles.second );
+  assert( m_kvc >= 0.0 );
+}
+
+VortexForce::~VortexForce()
+{}
+
+void VortexForce::addEnergyToTotal( const VectorXs& x, const VectorXs& v, const VectorXs& m, scalar& E )
+{
+  std::cerr << outputmod::startred << "ERROR IN VORTEXFORCE: " << outputmod::endred << "No energy defined for VortexForce." << std::endl;
+  exit(1);
+}
+
+void VortexForce::addGradEToTotal( const VectorXs& x, const VectorXs& v, const VectorXs& m, VectorXs& gradE )
+{
+  assert( x.size() == v.size() );
+  assert( x.size() == m.size() );
+  assert( x.size() == gradE.size() );
+  assert( x.size()%2 == 0 );
+  assert( m_particles.first >= 0 );  assert( m_particles.first < x.size()/2 );
+  assert( m_particles.second >= 0 ); assert( m_particles.second < x.size()/2 );
+
+  const Vector2s r = x.segment<2>(2*m_particles.second) - x.segment<2>(2*m_particles.first);
+  const scalar l = r.norm();
+  assert( l != 0.0 );
+  const scalar il = 1.0/l;
+  const scalar il2 = 1.0/(l*l);
+
+  // The relative velocity's deviation from the swirl kbs*t, t = ( -ry, rx )/l.
+  const Vector2s dv = v.segment<2>(2*m_particles.second) - v.segment<2>(2*m_particles.first);
+  Vector2s g( -( m_kbs*( r.y()*il ) ) - dv.x(), m_kbs*( r.x()*il ) - dv.y() );
+  g = ( g*il2 )*m_kvc;
+
+  gradE.segment<2>(2*m_particles.first) += g;
+  gradE.segment<2>(2*m_particles.second) -= g;
+}
+
+void VortexForce::addHessXToTotal( const VectorXs& x, const VectorXs& v, const VectorXs& m, MatrixXs& hessE )
+{
+  std::cerr << outputmod::startred << "ERROR IN VORTEXFORCE: " << outputmod::endred << "No addHessXToTotal defined for VortexForce." << std::endl;
+  exit(1);
+}
+
+void VortexForce::addHessVToTotal( const VectorXs& x, const VectorXs& v, const VectorXs& m, MatrixXs& hessE )
+{
+  std::cerr << outputmod::startred << "ERROR IN VORTEXFORCE: " << outputmod::endred << "No addHessVToTotal defined for VortexForce." << std::endl;
+  exit(1);
+}
+
+Force* VortexForce::createNewCopy()
+{
+  return new VortexForce(*this);
+}
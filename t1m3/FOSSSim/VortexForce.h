@@ -0,0 +1,46 @@
+#ifndef __VORTEX_FORCE_H__
+#define __VORTEX_FORCE_H__
+
+#include <Eigen/Core>
+#include "Force.h"
+#include <iostream>
+
+// Swirls particle j about particle i: with r = xj - xi and t the unit
+// tangent perpendicular to r, particle j is pushed towards the velocity
+// vi + kbs*t by kvc*( vi + kbs*t - vj )/|r|^2, and i feels the reaction.
+// The force depends on velocities and defines no energy or Hessian.
+//
+// The base library declares no header for this class; this one matches its
+// layout, and VortexForce.cpp replaces the library's definition so that
+// TwoDScene::batchForces can read the parameters.
+class VortexForce : public Force
+{
+public:
+
+  VortexForce( const std::pair<int,int>& particles, const scalar& kbs, const scalar& kvc );
+
+  virtual ~VortexForce();
+
+  virtual void addEnergyToTotal( const VectorXs& x, const VectorXs& v, const VectorXs& m, scalar& E );
+
+  virtual void addGradEToTotal( const VectorXs& x, const VectorXs& v, const VectorXs& m, VectorXs& gradE );
+
+  virtual void addHessXToTotal( const VectorXs& x, const VectorXs& v, const VectorXs& m, MatrixXs& hessE );
+
+  virtual void addHessVToTotal( const VectorXs& x, const VectorXs& v, const VectorXs& m, MatrixXs& hessE );
+
+  virtual Force* createNewCopy();
+
+  const std::pair<int,int>& getParticles() const { return m_particles; }
+  const scalar& getBiotSavart() const { return m_kbs; }
+  const scalar& getViscosity() const { return m_kvc; }
+
+private:
+  std::pair<int,int> m_particles;
+  // Biot-Savart constant
+  scalar m_kbs;
+  // Viscosity constant
+  scalar m_kvc;
+};
+
+#endif
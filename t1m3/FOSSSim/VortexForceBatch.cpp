@@ -0,0 +1,38 @@
+#include "VortexForceBatch.h"
+
+#include <cstdlib>
+
+// Colored console output; defined in the base library.
+namespace outputmod
+{
+  std::ostream& startred( std::ostream& stream );
+  std::ostream& endred( std::ostream& stream );
+}
+
+void VortexForceBatch::addForce( const VortexForce& force )
+{
+  VortexPair pair;
+  pair.first = force.getParticles().first;
+  pair.second = force.getParticles().second;
+  pair.kbs = force.getBiotSavart();
+  pair.kvc = force.getViscosity();
+  addPair(pair);
+}
+
+void VortexForceBatch::addPairEnergy( const VortexPair& p, const scalar* x, const scalar* v, const scalar* m, scalar& E ) const
+{
+  std::cerr << outputmod::startred << "ERROR IN VORTEXFORCE: " << outputmod::endred << "No energy defined for VortexForce." << std::endl;
+  exit(1);
+}
+
+Matrix2s VortexForceBatch::pairHessX( const VortexPair& p, const scalar* x, const scalar* v, const scalar* m ) const
+{
+  std::cerr << outputmod::startred << "ERROR IN VORTEXFORCE: " << outputmod::endred << "No addHessXToTotal defined for VortexForce." << std::endl;
+  exit(1);
+}
+
+Matrix2s VortexForceBatch::pairHessV( const VortexPair& p, const scalar* x, const scalar* v, const scalar* m ) const
+{
+  std::cerr << outputmod::startred << "ERROR IN VORTEXFORCE: " << outputmod::endred << "No addHessVToTotal defined for VortexForce." << std::endl;
+  exit(1);
+}
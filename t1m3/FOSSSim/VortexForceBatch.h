@@ -0,0 +1,59 @@
+#ifndef __VORTEX_FORCE_BATCH_H__
+#define __VORTEX_FORCE_BATCH_H__
+
+#include <Eigen/Core>
+#include <cmath>
+#include "ForceBatch.h"
+#include "VortexForce.h"
+
+struct VortexPair
+{
+  int first;
+  int second;
+  // Biot-Savart and viscosity constants
+  scalar kbs;
+  scalar kvc;
+};
+
+// Many VortexForces as one force; see ForceBatch. Like VortexForce, it
+// defines no energy or Hessian and exits if asked for one.
+class VortexForceBatch : public ForceBatch<VortexForceBatch,VortexPair>
+{
+public:
+
+  enum { HAS_HESSV = 1 };
+
+  void addForce( const VortexForce& force );
+
+  // The ForceBatch kernel.
+  void addPairEnergy( const VortexPair& p, const scalar* x, const scalar* v, const scalar* m, scalar& E ) const;
+
+  void addPairGradE( const VortexPair& p, const scalar* x, const scalar* v, const scalar* m, scalar* gradE ) const;
+
+  Matrix2s pairHessX( const VortexPair& p, const scalar* x, const scalar* v, const scalar* m ) const;
+
+  Matrix2s pairHessV( const VortexPair& p, const scalar* x, const scalar* v, const scalar* m ) const;
+};
+
+// Rounds exactly as VortexForce::addGradEToTotal does.
+inline void VortexForceBatch::addPairGradE( const VortexPair& p, const scalar* x, const scalar* v, const scalar* m, scalar* gradE ) const
+{
+  const int i = 2*p.first;
+  const int j = 2*p.second;
+  const scalar rx = x[j] - x[i];
+  const scalar ry = x[j+1] - x[i+1];
+  const scalar l = std::sqrt( rx*rx + ry*ry );
+  assert( l != 0.0 );
+  const scalar il = 1.0/l;
+  const scalar il2 = 1.0/(l*l);
+
+  // The relative velocity's deviation from the swirl kbs*t, t = ( -ry, rx )/l.
+  const scalar gx = ( ( -( p.kbs*( ry*il ) ) - ( v[j] - v[i] ) )*il2 )*p.kvc;
+  const scalar gy = ( ( p.kbs*( rx*il ) - ( v[j+1] - v[i+1] ) )*il2 )*p.kvc;
+  gradE[i]   += gx;
+  gradE[i+1] += gy;
+  gradE[j]   -= gx;
+  gradE[j+1] -= gy;
+}
+
+#endif
@@ -0,0 +1,98 @@
+#include "CollisionHandler.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+namespace
+{
+
+// Bytes per impulse on disk: type, both indices, the normal and the time,
+// packed without the padding CollisionInfo carries in memory.
+const std::size_t IMPULSE_RECORD_SIZE = 3*sizeof(int) + 3*sizeof(double);
+
+char *putBytes(char *p, const void *value, std::size_t size)
+{
+    memcpy(p, value, size);
+    return p + size;
+}
+
+const char *getBytes(const char *p, void *value, std::size_t size)
+{
+    memcpy(value, p, size);
+    return p + size;
+}
+
+}
+
+// The impulses of a step are one record, the count followed by the packed
+// impulses, written and read with a single call each rather than five per
+// impulse. The bytes are the same as before, so existing reference files
+// still load.
+void CollisionHandler::serializeImpulses(std::ofstream &ofs)
+{
+    const int count = (int) m_impulses.size();
+    std::vector<char> record(sizeof(count) + count*IMPULSE_RECORD_SIZE);
+    char *p = putBytes(&record[0], &count, sizeof(count));
+    for( int i = 0; i < count; ++i )
+    {
+        const CollisionInfo &info = m_impulses[i];
+        const int type = info.m_type;
+        p = putBytes(p, &type, sizeof(type));
+        p = putBytes(p, &info.m_idx1, sizeof(info.m_idx1));
+        p = putBytes(p, &info.m_idx2, sizeof(info.m_idx2));
+        p = putBytes(p, info.m_n.data(), 2*sizeof(double));
+        p = putBytes(p, &info.m_time, sizeof(info.m_time));
+    }
+    ofs.write(&record[0], record.size());
+}
+
+void CollisionHandler::loadImpulses(std::vector<CollisionInfo> &impulses, std::ifstream &ifs)
+{
+    impulses.clear();
+    int count = 0;
+    ifs.read((char *) &count, sizeof(count));
+
+    if( ifs && count > 0 )
+    {
+        std::vector<char> record(count*IMPULSE_RECORD_SIZE);
+        if( ifs.read(&record[0], record.size()) )
+        {
+            impulses.reserve(count);
+            const char *p = &record[0];
+            for( int i = 0; i < count; ++i )
+            {
+                int type, idx1, idx2;
+                Vector2s n;
+                double time;
+                p = getBytes(p, &type, sizeof(type));
+                p = getBytes(p, &idx1, sizeof(idx1));
+                p = getBytes(p, &idx2, sizeof(idx2));
+                p = getBytes(p, n.data(), 2*sizeof(double));
+                p = getBytes(p, &time, sizeof(time));
+                impulses.push_back(CollisionInfo((CollisionInfo::collisiontype) type, idx1, idx2, n, time));
+            }
+        }
+    }
+
+    if( ifs.fail() )
+    {
+        std::cout << "\033[31;1mError while trying to deserialize time step impulses. Exiting.\033[m" << std::endl;
+        exit(1);
+    }
+}
+
+void CollisionHandler::addParticleParticleImpulse(int idx1, int idx2, const Vector2s &n, double time)
+{
+    m_impulses.push_back(CollisionInfo(CollisionInfo::PP, idx1, idx2, n, time));
+}
+
+void CollisionHandler::addParticleEdgeImpulse(int vidx, int eidx, const Vector2s &n, double time)
+{
+    m_impulses.push_back(CollisionInfo(CollisionInfo::PE, vidx, eidx, n, time));
+}
+
+void CollisionHandler::addParticleHalfplaneImpulse(int vidx, int fidx, const Vector2s &n, double time)
+{
+    m_impulses.push_back(CollisionInfo(CollisionInfo::PH, vidx, fidx, n, time));
+}
@@ -22,8 +22,8 @@ void PenaltyForce::addEnergyToTotal( const VectorXs& x, const VectorXs& v, const
 //          gradient to this total gradient.
 void PenaltyForce::addParticleParticleGradEToTotal(const VectorXs &x, int idx1, int idx2, VectorXs &gradE)
 {
-    VectorXs x1 = x.segment<2>(2*idx1);
-    VectorXs x2 = x.segment<2>(2*idx2);
+    Vector2s x1 = x.segment<2>(2*idx1);
+    Vector2s x2 = x.segment<2>(2*idx2);
     
     double r1 = m_scene.getRadius(idx1);
     double r2 = m_scene.getRadius(idx2);
@@ -47,9 +47,9 @@ void PenaltyForce::addParticleParticleGradEToTotal(const VectorXs &x, int idx1,
 //          gradient to this total gradient.
 void PenaltyForce::addParticleEdgeGradEToTotal(const VectorXs &x, int vidx, int eidx, VectorXs &gradE)
 {
-    VectorXs x1 = x.segment<2>(2*vidx);
-    VectorXs x2 = x.segment<2>(2*m_scene.getEdge(eidx).first);
-    VectorXs x3 = x.segment<2>(2*m_scene.getEdge(eidx).second);
+    Vector2s x1 = x.segment<2>(2*vidx);
+    Vector2s x2 = x.segment<2>(2*m_scene.getEdge(eidx).first);
+    Vector2s x3 = x.segment<2>(2*m_scene.getEdge(eidx).second);
     
     double r1 = m_scene.getRadius(vidx);
     double r2 = m_scene.getEdgeRadii()[eidx];
@@ -72,8 +72,8 @@ void PenaltyForce::addParticleEdgeGradEToTotal(const VectorXs &x, int vidx, int
 //          half-plane gradient to this total gradient.
 void PenaltyForce::addParticleHalfplaneGradEToTotal(const VectorXs &x, int vidx, int pidx, VectorXs &gradE)
 {
-    VectorXs x1 = x.segment<2>(2*vidx);
-    VectorXs nh = m_scene.getHalfplane(pidx).second;
+    Vector2s x1 = x.segment<2>(2*vidx);
+    Vector2s nh = m_scene.getHalfplane(pidx).second;
     
     // Your code goes here!
     
@@ -21,8 +21,8 @@
 //   Returns true if the two particles overlap and are approaching.
 bool SimpleCollisionHandler::detectParticleParticle(TwoDScene &scene, int idx1, int idx2, Vector2s &n)
 {
-    VectorXs x1 = scene.getX().segment<2>(2*idx1);
-    VectorXs x2 = scene.getX().segment<2>(2*idx2);
+    Vector2s x1 = scene.getX().segment<2>(2*idx1);
+    Vector2s x2 = scene.getX().segment<2>(2*idx2);
     
     // Your code goes here!
     
@@ -43,9 +43,9 @@ bool SimpleCollisionHandler::detectParticleParticle(TwoDScene &scene, int idx1,
 //   Returns true if the two objects overlap and are approaching.
 bool SimpleCollisionHandler::detectParticleEdge(TwoDScene &scene, int vidx, int eidx, Vector2s &n)
 {
-    VectorXs x1 = scene.getX().segment<2>(2*vidx);
-    VectorXs x2 = scene.getX().segment<2>(2*scene.getEdges()[eidx].first);
-    VectorXs x3 = scene.getX().segment<2>(2*scene.getEdges()[eidx].second);
+    Vector2s x1 = scene.getX().segment<2>(2*vidx);
+    Vector2s x2 = scene.getX().segment<2>(2*scene.getEdges()[eidx].first);
+    Vector2s x3 = scene.getX().segment<2>(2*scene.getEdges()[eidx].second);
     
     // Your code goes here!
     
@@ -66,9 +66,9 @@ bool SimpleCollisionHandler::detectParticleEdge(TwoDScene &scene, int vidx, int
 //   Returns true if the two objects overlap and are approaching.
 bool SimpleCollisionHandler::detectParticleHalfplane(TwoDScene &scene, int vidx, int pidx, Vector2s &n)
 {
-    VectorXs x1 = scene.getX().segment<2>(2*vidx);
-    VectorXs px = scene.getHalfplane(pidx).first;
-    VectorXs pn = scene.getHalfplane(pidx).second;
+    Vector2s x1 = scene.getX().segment<2>(2*vidx);
+    Vector2s px = scene.getHalfplane(pidx).first;
+    Vector2s pn = scene.getHalfplane(pidx).second;
     
     // Your code goes here!
     
@@ -111,13 +111,13 @@ void SimpleCollisionHandler::respondParticleEdge(TwoDScene &scene, int vidx, int
     int eidx1 = scene.getEdges()[eidx].first;
     int eidx2 = scene.getEdges()[eidx].second;
     
-    VectorXs x1 = scene.getX().segment<2>(2*vidx);
-    VectorXs x2 = scene.getX().segment<2>(2*eidx1);
-    VectorXs x3 = scene.getX().segment<2>(2*eidx2);
+    Vector2s x1 = scene.getX().segment<2>(2*vidx);
+    Vector2s x2 = scene.getX().segment<2>(2*eidx1);
+    Vector2s x3 = scene.getX().segment<2>(2*eidx2);
     
-    VectorXs v1 = scene.getV().segment<2>(2*vidx);
-    VectorXs v2 = scene.getV().segment<2>(2*eidx1);
-    VectorXs v3 = scene.getV().segment<2>(2*eidx2);
+    Vector2s v1 = scene.getV().segment<2>(2*vidx);
+    Vector2s v2 = scene.getV().segment<2>(2*eidx1);
+    Vector2s v3 = scene.getV().segment<2>(2*eidx2);
     
     // Your code goes here!
     
@@ -135,7 +135,7 @@ void SimpleCollisionHandler::respondParticleEdge(TwoDScene &scene, int vidx, int
 //   None.
 void SimpleCollisionHandler::respondParticleHalfplane(TwoDScene &scene, int vidx, int pidx, const Vector2s &n)
 {
-    VectorXs nhat = n;
+    Vector2s nhat = n;
     
     // Your code goes here!
     
@@ -0,0 +1,43 @@
+#ifndef __TWO_D_SCENE_GRADER_H__
+#define __TWO_D_SCENE_GRADER_H__
+
+#include "TwoDScene.h"
+
+// Compares a simulated scene against the oracle's, frame by frame.
+class TwoDSceneGrader
+{
+public:
+  TwoDSceneGrader();
+
+  // Adds the position and velocity residuals of every particle of this
+  // frame to the accumulated residuals, and raises the maxima to match.
+  void addToAccumulatedResidual( const TwoDScene& oracle_scene, const TwoDScene& testing_scene );
+
+  double getAccumulatedPositionResidual() const;
+  double getAccumulatedVelocityResidual() const;
+  double getMaxPositionResidual() const;
+  double getMaxVelocityResidual() const;
+
+  bool accumulatedPositionResidualPassed() const;
+  bool accumulatedVelocityResidualPassed() const;
+  bool maxPositionResidualPassed() const;
+  bool maxVelocityResidualPassed() const;
+
+  bool collisionsPassed() const;
+  void setCollisionsFailed();
+
+private:
+  double m_accumulated_position_residual;
+  double m_accumulated_velocity_residual;
+  double m_max_position_residual;
+  double m_max_velocity_residual;
+
+  double m_accumulated_position_residual_threshold;
+  double m_accumulated_velocity_residual_threshold;
+  double m_max_position_residual_threshold;
+  double m_max_velocity_residual_threshold;
+
+  bool m_collisions_passed;
+};
+
+#endif
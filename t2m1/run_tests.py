@@ -1,13 +1,17 @@
 import os
 import subprocess
 import sys
+import argparse
+import tempfile
+import time
+from concurrent.futures import ThreadPoolExecutor
 
 
-def find_tests(theme):
+def find_tests(workspace, theme):
     """Find all of the test files in the assets directory."""
     test_files = []
 
-    for dirpath, dirnames, filenames in os.walk("/home/codio/workspace/assets/{}/" .format(theme)):
+    for dirpath, dirnames, filenames in os.walk("{}/assets/{}/" .format(workspace, theme)):
         for filename in filenames:
             if filename.endswith('.xml'):
                 test_files.append(os.path.join(dirpath, filename))
@@ -15,50 +19,94 @@ def find_tests(theme):
     return test_files
 
 
+def run_test(test, simulator, oracle):
+    """Run one scene through FOSSSim and the oracle, returning the verdict and the seconds taken.
+
+    The simulation is piped straight into the oracle, which grades each frame as it
+    arrives, so the two run side by side and nothing is written to disk.
+    """
+    start = time.time()
+    scratch = None
+    if os.path.isdir('/dev/fd'):
+        read_fd, write_fd = os.pipe()
+        output, fds = '/dev/fd/{}' .format(write_fd), (write_fd,)
+        grade, oracle_fds = '/dev/fd/{}' .format(read_fd), (read_fd,)
+    else:
+        handle, scratch = tempfile.mkstemp(suffix='.bin')
+        os.close(handle)
+        output, fds, grade, oracle_fds = scratch, (), scratch, ()
+
+    sim = subprocess.Popen([simulator, '-s', test, '-d', '0', '-o', output],
+                           stdout=subprocess.DEVNULL, pass_fds=fds)
+    if scratch is not None:
+        sim.wait()
+    grader = subprocess.Popen([oracle, '-s', test, '-d', '0', '-i', grade],
+                              stdout=subprocess.PIPE, universal_newlines=True, pass_fds=oracle_fds)
+    for fd in fds + oracle_fds:
+        os.close(fd)
+    verdict = grader.communicate()[0]
+    sim.wait()
+    if scratch is not None:
+        os.remove(scratch)
+
+    if 'Overall success: Passed.' in verdict:
+        result = 'Passed.'
+    elif 'Overall success: Failed.' in verdict:
+        result = 'Failed.'
+    else:
+        result = 'Error.'
+    return result, time.time() - start
+
+
 def main():
     """Collect the tests for the current milestone and run them against the oracle.
 
     If there are extra credit tests, they can be run independently of the other tests
     by using the --extra or -e flags. To run specific tests, one can use the --specific
-    or -s flags with the name of the test directory:
+    or -s flags with the name of the test directory. Tests run --jobs (-j) at a time, one
+    per core by default, from the --workspace (-w) holding assets/, build/ and oracle/:
 
     Examples
     --------
     $  python3 run_tests.py t4m1
         $  python3 run_tests.py t4m1 -e
     $  python3 run_tests.py t4m1 -s SpringTests
+    $  python3 run_tests.py t4m1 -j 8 -w ~/FOSSSim
     """
-    theme = sys.argv[1]
+    parser = argparse.ArgumentParser(description='Run Oracle tests')
+    parser.add_argument('-s', '--specific', type=str)
+    parser.add_argument('-e', '--extra', action='store_true')
+    parser.add_argument('-j', '--jobs', type=int, default=os.cpu_count() or 1)
+    parser.add_argument('-w', '--workspace', type=str, default='/home/codio/workspace')
+    parser.add_argument('dir', type=str, help='Name of the theme')
+    args = parser.parse_args()
+
+    theme = args.dir
     specific_tests = theme
-    if len(sys.argv) > 2:
-        if sys.argv[2] == "--extra" or sys.argv[2] == '-e':
-            specific_tests += "_extracredit"
-        if sys.argv[2] == "--specific" or sys.argv[2] == '-s':
-            specific_tests += "/{}" .format(sys.argv[3])
-
-    tests = find_tests(specific_tests)
-    successful_tests = 0
-    failed_tests = 0
-
-    for test in sorted(tests):
-        print('Running test {}: ' .format(test), end='')
-        subprocess.check_output(['/home/codio/workspace/build/FOSSSim/FOSSSim', '-s', '{}' .format(test),
-                                 '-d', '0', '-o', '/home/codio/workspace/test_output.bin'])
-
-        oracle = subprocess.check_output(['/home/codio/workspace/oracle/FOSSSimOracle{}' .format(theme.upper()),
-                                          '-s', '{}' .format(test), '-d', '0', '-i', '/home/codio/workspace/test_output.bin'],
-                                          universal_newlines=True)
-
-        if 'Overall success: Passed.' in oracle:
-            successful_tests += 1
-            print('Passed.')
-        elif 'Overall success: Failed.' in oracle:
-            failed_tests += 1
-            print('Failed.')
+    if args.extra:
+        specific_tests += "_extracredit"
+    if args.specific:
+        specific_tests += "/{}" .format(args.specific)
+
+    tests = sorted(find_tests(args.workspace, specific_tests))
+    simulator = '{}/build/FOSSSim/FOSSSim' .format(args.workspace)
+    oracle = '{}/oracle/FOSSSimOracle{}' .format(args.workspace, theme.upper())
+    counts = {'Passed.': 0, 'Failed.': 0, 'Error.': 0}
+    start = time.time()
+
+    with ThreadPoolExecutor(max_workers=max(args.jobs, 1)) as pool:
+        results = [pool.submit(run_test, test, simulator, oracle) for test in tests]
+        for test, future in zip(tests, results):
+            result, seconds = future.result()
+            counts[result] += 1
+            print('Running test {}: {} ({:.2f} s)' .format(test, result, seconds))
 
     print('------------------------------------------------')
-    print('Successful Tests: {}' .format(successful_tests))
-    print('Failed Tests: {}' .format(failed_tests))
+    print('Successful Tests: {}' .format(counts['Passed.']))
+    print('Failed Tests: {}' .format(counts['Failed.']))
+    if counts['Error.']:
+        print('Tests Without a Verdict: {}' .format(counts['Error.']))
+    print('Total Time: {:.2f} s with {} jobs' .format(time.time() - start, max(args.jobs, 1)))
     print('------------------------------------------------')
 
 
@@ -0,0 +1,356 @@
+// Per-call latency of the continuous-time detection kernels and the
+// polynomial solver under them, on recorded inputs.
+//
+// A recording made with FOSSSIM_CCD_RECORD (see CCDRecording.h) supplies the
+// detection inputs. The detectors are replayed over every pair the
+// simulation would test, and the polynomials they hand the solver are
+// collected, one list per call, on an untimed pass. Those lists are then the
+// inputs of findFirstIntersectionTimeInStep, one by one and as a batch, and
+// the polynomials in them the inputs of rpoly and RootIsolationBatch. A polynomial log written by writePolynomials can add
+// solver inputs of its own, each polynomial as a call by itself, since the
+// log does not say which polynomials were solved together.
+
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <fstream>
+#include <limits>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <tclap/CmdLine.h>
+
+#include "BenchTimer.h"
+#include "FOSSSim/CCDRecording.h"
+#include "FOSSSim/ContinuousTimeCollisionHandler.h"
+#include "FOSSSim/ContinuousTimeUtilities.h"
+#include "FOSSSim/FrameArena.h"
+#include "FOSSSim/SweptTrajectories.h"
+
+// The simulation driver publishes the scene to the display from here.
+void syncScene() {}
+
+namespace
+{
+
+// Results are summed into this so that no timed call can be optimized out.
+volatile double g_sink = 0.0;
+
+// rpoly roots with a smaller imaginary part count as real, as in the solver.
+const double IMAGINARY_TOLERANCE = 1e-8;
+
+struct Recording
+{
+    TwoDScene scene;
+    std::vector<VectorXs> qs;
+    std::vector<VectorXs> qe;
+};
+
+// PARTICLE_EDGE_SHARED is detectParticleEdge from the frame's
+// SweptTrajectories, built inside the timed pass, as the continuous-time
+// handler calls it.
+enum Kernel { PARTICLE_PARTICLE, PARTICLE_EDGE, PARTICLE_HALFPLANE, PARTICLE_EDGE_SHARED };
+
+// Runs one detector over every pair of every frame that the continuous-time
+// handler tests, and returns the number of calls. With groups, appends the
+// polynomials each call solved.
+long detect(Kernel kernel, ContinuousTimeCollisionHandler &handler, const Recording &recording, std::vector<std::vector<Polynomial> > *groups)
+{
+    const TwoDScene &scene = recording.scene;
+    std::vector<Polynomial> &log = PolynomialIntervalSolver::getPolynomials();
+    Vector2s n;
+    double time;
+    double sum = 0.0;
+    long calls = 0;
+    FrameArena arena;
+    for(int f = 0; f < (int)recording.qs.size(); f++)
+    {
+        const VectorXs &qs = recording.qs[f];
+        const VectorXs &qe = recording.qe[f];
+        PolynomialIntervalSolver::clearPolynomials();
+        arena.reset();
+        const bool edges = kernel == PARTICLE_EDGE || kernel == PARTICLE_EDGE_SHARED;
+        std::unique_ptr<SweptTrajectories> trajectories(kernel == PARTICLE_EDGE_SHARED ? new SweptTrajectories(scene, qs, qe, arena) : NULL);
+        for(int i = 0; i < scene.getNumParticles(); i++)
+        {
+            const int count = kernel == PARTICLE_PARTICLE ? scene.getNumParticles() : edges ? scene.getNumEdges() : scene.getNumHalfplanes();
+            for(int j = kernel == PARTICLE_PARTICLE ? i+1 : 0; j < count; j++)
+            {
+                if(edges && (scene.getEdge(j).first == i || scene.getEdge(j).second == i))
+                    continue;
+                const std::vector<Polynomial>::size_type logged = log.size();
+                time = 0.0;
+                bool hit = false;
+                switch(kernel)
+                {
+                    case PARTICLE_PARTICLE:
+                        hit = handler.detectParticleParticle(scene, qs, qe, i, j, n, time);
+                        break;
+                    case PARTICLE_EDGE:
+                        hit = handler.detectParticleEdge(scene, qs, qe, i, j, n, time);
+                        break;
+                    case PARTICLE_HALFPLANE:
+                        hit = handler.detectParticleHalfplane(scene, qs, qe, i, j, n, time);
+                        break;
+                    case PARTICLE_EDGE_SHARED:
+                        hit = handler.detectParticleEdge(scene, qs, qe, *trajectories, i, j, n, time);
+                        break;
+                }
+                sum += hit ? time : 0.0;
+                if(groups != NULL && log.size() > logged)
+                    groups->push_back(std::vector<Polynomial>(log.begin() + logged, log.end()));
+                calls++;
+            }
+        }
+    }
+    PolynomialIntervalSolver::clearPolynomials();
+    g_sink = g_sink + sum;
+    return calls;
+}
+
+long solve(const std::vector<std::vector<Polynomial> > &groups)
+{
+    // No log, so the solver does only its own work.
+    PolynomialSolverContext context;
+    double sum = 0.0;
+    for(int g = 0; g < (int)groups.size(); g++)
+    {
+        const double time = PolynomialIntervalSolver::findFirstIntersectionTimeInStep(groups[g], context);
+        sum += time < std::numeric_limits<double>::infinity() ? time : 0.0;
+    }
+    g_sink = g_sink + sum;
+    return (long)groups.size();
+}
+
+long solveBatch(const std::vector<std::vector<Polynomial> > &groups, std::vector<double> &times)
+{
+    PolynomialSolverContext context;
+    times.resize(groups.size());
+    if(!groups.empty())
+        PolynomialIntervalSolver::findFirstIntersectionTimesInStep(groups, &times[0], context);
+    double sum = 0.0;
+    for(int g = 0; g < (int)times.size(); g++)
+        sum += times[g] < std::numeric_limits<double>::infinity() ? times[g] : 0.0;
+    g_sink = g_sink + sum;
+    return (long)groups.size();
+}
+
+// The polynomials rpoly is given as the solver would give them, without
+// leading coefficients it drops and only of a degree it hands to rpoly.
+void collectRootFinderInputs(const std::vector<std::vector<Polynomial> > &groups, std::vector<std::vector<double> > &inputs)
+{
+    for(int g = 0; g < (int)groups.size(); g++)
+    {
+        for(int p = 0; p < (int)groups[g].size(); p++)
+        {
+            const std::vector<double> &coeffs = groups[g][p].getCoeffs();
+            int first = 0;
+            while(first < (int)coeffs.size() && fabs(coeffs[first]) < POLYNOMIAL_ZERO_COEFFICIENT)
+                first++;
+            const int degree = (int)coeffs.size() - first - 1;
+            if(degree >= 1 && degree <= PolynomialIntervalSolver::MAX_DEGREE)
+                inputs.push_back(std::vector<double>(coeffs.begin() + first, coeffs.end()));
+        }
+    }
+}
+
+long findRoots(const std::vector<std::vector<double> > &inputs)
+{
+    RootFinder rf;
+    double zeror[PolynomialIntervalSolver::MAX_DEGREE], zeroi[PolynomialIntervalSolver::MAX_DEGREE];
+    double sum = 0.0;
+    for(int i = 0; i < (int)inputs.size(); i++)
+    {
+        const int nroots = rf.rpoly(&inputs[i][0], (int)inputs[i].size() - 1, zeror, zeroi);
+        for(int r = 0; r < nroots; r++)
+            sum += zeror[r];
+    }
+    g_sink = g_sink + sum;
+    return (long)inputs.size();
+}
+
+long isolateRoots(const std::vector<std::vector<double> > &inputs, RootIsolationBatch &batch)
+{
+    batch.clear();
+    for(int i = 0; i < (int)inputs.size(); i++)
+        batch.add(&inputs[i][0], (int)inputs[i].size() - 1);
+    batch.solve();
+    double sum = 0.0;
+    for(int i = 0; i < batch.size(); i++)
+        for(int r = 0; r < batch.numRoots(i); r++)
+            sum += batch.roots(i)[r];
+    g_sink = g_sink + sum;
+    return (long)inputs.size();
+}
+
+// The inputs whose roots in [0, 1] from rpoly and the batch differ in count,
+// or by more than tolerance.
+int countRootMismatches(const std::vector<std::vector<double> > &inputs, const RootIsolationBatch &batch, double tolerance)
+{
+    RootFinder rf;
+    double zeror[PolynomialIntervalSolver::MAX_DEGREE], zeroi[PolynomialIntervalSolver::MAX_DEGREE];
+    int mismatches = 0;
+    for(int i = 0; i < (int)inputs.size(); i++)
+    {
+        const int nroots = rf.rpoly(&inputs[i][0], (int)inputs[i].size() - 1, zeror, zeroi);
+        std::vector<double> expected;
+        for(int r = 0; r < nroots; r++)
+            if(fabs(zeroi[r]) < IMAGINARY_TOLERANCE && zeror[r] >= 0.0 && zeror[r] <= 1.0)
+                expected.push_back(zeror[r]);
+        std::sort(expected.begin(), expected.end());
+        bool same = (int)expected.size() == batch.numRoots(i);
+        for(int r = 0; same && r < (int)expected.size(); r++)
+            same = fabs(expected[r] - batch.roots(i)[r]) <= tolerance;
+        mismatches += !same;
+    }
+    return mismatches;
+}
+
+void report(const std::string &name, long calls, Eigen::BenchTimer &timer)
+{
+    std::cout << std::left << std::setw(34) << name << std::right << std::setw(12) << calls;
+    if(calls > 0)
+        std::cout << std::fixed << std::setprecision(1) << std::setw(14) << 1.0e9*timer.best(Eigen::CPU_TIMER)/calls << " ns/call";
+    else
+        std::cout << std::setw(14) << "-";
+    std::cout << std::endl;
+}
+
+}
+
+int main(int argc, char **argv)
+{
+    std::string recordingfile, polynomialfile;
+    int repeats;
+    try
+    {
+        TCLAP::CmdLine cmd("Times the continuous-time detection kernels and polynomial solver on recorded inputs.", ' ', "1.0");
+        TCLAP::ValueArg<std::string> recordingArg("c", "ccd", "Recording made with FOSSSIM_CCD_RECORD", false, "", "string", cmd);
+        TCLAP::ValueArg<std::string> polynomialArg("p", "polynomials", "Polynomial log written by PolynomialIntervalSolver::writePolynomials", false, "", "string", cmd);
+        TCLAP::ValueArg<int> repeatsArg("r", "repeats", "Passes over the inputs, of which the fastest counts", false, 5, "integer", cmd);
+        cmd.parse(argc, argv);
+        recordingfile = recordingArg.getValue();
+        polynomialfile = polynomialArg.getValue();
+        repeats = repeatsArg.getValue();
+    }
+    catch(TCLAP::ArgException &e)
+    {
+        std::cerr << "error: " << e.what() << std::endl;
+        return 1;
+    }
+
+    if(recordingfile.empty() && polynomialfile.empty())
+    {
+        std::cerr << "\033[31;1mERROR IN CCDBENCH:\033[m Nothing to time; give a recording, a polynomial log or both." << std::endl;
+        return 1;
+    }
+    if(repeats < 1)
+    {
+        std::cerr << "\033[31;1mERROR IN CCDBENCH:\033[m The repeat count must be positive." << std::endl;
+        return 1;
+    }
+
+    Recording recording;
+    if(!recordingfile.empty() && !ccdrecording::loadRecording(recordingfile, recording.scene, recording.qs, recording.qe))
+        return 1;
+
+    std::vector<std::vector<Polynomial> > groups;
+    if(!polynomialfile.empty())
+    {
+        std::ifstream ifs(polynomialfile.c_str(), std::ios::binary);
+        std::vector<Polynomial> polynomials;
+        if(ifs)
+            PolynomialIntervalSolver::readPolynomials(polynomials, ifs);
+        if(!ifs)
+        {
+            std::cerr << "\033[31;1mERROR IN CCDBENCH:\033[m Failed to read " << polynomialfile << "." << std::endl;
+            return 1;
+        }
+        for(int i = 0; i < (int)polynomials.size(); i++)
+            groups.push_back(std::vector<Polynomial>(1, polynomials[i]));
+    }
+
+    ContinuousTimeCollisionHandler handler(1.0);
+    const Kernel kernels[] = { PARTICLE_PARTICLE, PARTICLE_EDGE, PARTICLE_HALFPLANE, PARTICLE_EDGE_SHARED };
+    const char *names[] = { "detectParticleParticle", "detectParticleEdge", "detectParticleHalfplane", "detectParticleEdge, shared" };
+    long calls[4];
+    // The shared kernel solves the polynomials PARTICLE_EDGE does, so its are
+    // not collected again.
+    for(int k = 0; k < 3; k++)
+        calls[k] = detect(kernels[k], handler, recording, &groups);
+    calls[3] = calls[1];
+
+    std::cout << recording.qs.size() << " frames of " << recording.scene.getNumParticles() << " particles, " << recording.scene.getNumEdges() << " edges and "
+              << recording.scene.getNumHalfplanes() << " half-planes; " << groups.size() << " solver inputs." << std::endl;
+#ifdef NO_CCD_POLYNOMIAL_LOG
+    std::cout << "Built with RECORD_CCD_POLYNOMIALS=OFF, so the detectors' polynomials are not collected." << std::endl;
+#endif
+
+    for(int k = 0; k < 4; k++)
+    {
+        Eigen::BenchTimer timer;
+        for(int r = 0; r < repeats; r++)
+        {
+            timer.start();
+            detect(kernels[k], handler, recording, NULL);
+            timer.stop();
+        }
+        report(names[k], calls[k], timer);
+    }
+
+    Eigen::BenchTimer solvetimer;
+    for(int r = 0; r < repeats; r++)
+    {
+        solvetimer.start();
+        solve(groups);
+        solvetimer.stop();
+    }
+    report("findFirstIntersectionTimeInStep", (long)groups.size(), solvetimer);
+
+    std::vector<double> times;
+    Eigen::BenchTimer batchtimer;
+    for(int r = 0; r < repeats; r++)
+    {
+        batchtimer.start();
+        solveBatch(groups, times);
+        batchtimer.stop();
+    }
+    report("findFirstIntersectionTimesInStep", (long)groups.size(), batchtimer);
+
+    std::vector<std::vector<double> > inputs;
+    collectRootFinderInputs(groups, inputs);
+    Eigen::BenchTimer roottimer;
+    for(int r = 0; r < repeats; r++)
+    {
+        roottimer.start();
+        findRoots(inputs);
+        roottimer.stop();
+    }
+    report("RootFinder::rpoly", (long)inputs.size(), roottimer);
+
+    RootIsolationBatch batch;
+    Eigen::BenchTimer isolatetimer;
+    for(int r = 0; r < repeats; r++)
+    {
+        isolatetimer.start();
+        isolateRoots(inputs, batch);
+        isolatetimer.stop();
+    }
+    report("RootIsolationBatch", (long)inputs.size(), isolatetimer);
+
+    // The batched paths are checked against the ones they replace.
+    PolynomialSolverContext context;
+    int timemismatches = 0;
+    for(int g = 0; g < (int)groups.size(); g++)
+    {
+        const double time = PolynomialIntervalSolver::findFirstIntersectionTimeInStep(groups[g], context);
+        timemismatches += !(time == times[g] || fabs(time - times[g]) <= 1.0e-9);
+    }
+    const int rootmismatches = countRootMismatches(inputs, batch, 1.0e-9);
+    std::cout << timemismatches << " of " << groups.size() << " batched times and " << rootmismatches << " of " << inputs.size()
+              << " batched root sets differ from the per-call results by more than 1e-9." << std::endl;
+
+    return 0;
+}
@@ -0,0 +1,182 @@
+#include "CCDRecording.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+namespace
+{
+
+const char CCD_MAGIC[4] = { 'C', 'C', 'D', '1' };
+
+template<class T>
+void writeValue( std::ofstream &ofs, const T &value )
+{
+    ofs.write((const char *) &value, sizeof(T));
+}
+
+template<class T>
+bool readValue( std::ifstream &ifs, T &value )
+{
+    ifs.read((char *) &value, sizeof(T));
+    return bool(ifs);
+}
+
+void complain( const std::string &what )
+{
+    std::cerr << "\033[31;1mERROR IN CCDRECORDING:\033[m " << what << std::endl;
+}
+
+// The file frames are appended to, opened with the first frame.
+class Recorder
+{
+public:
+    Recorder()
+    : m_filename()
+    , m_enabled(false)
+    , m_ofs()
+    , m_numparticles(-1)
+    {
+        const char *filename = getenv("FOSSSIM_CCD_RECORD");
+        m_enabled = filename != NULL && *filename != '\0';
+        if( m_enabled ) m_filename = filename;
+    }
+
+    bool enabled() const { return m_enabled; }
+
+    void record( const TwoDScene &scene, const VectorXs &qs, const VectorXs &qe )
+    {
+        if( !m_enabled ) return;
+        if( m_numparticles < 0 && !writeGeometry(scene) ) return;
+        if( scene.getNumParticles() != m_numparticles ) return;
+
+        m_ofs.write((const char *) qs.data(), 2*m_numparticles*sizeof(double));
+        m_ofs.write((const char *) qe.data(), 2*m_numparticles*sizeof(double));
+        if( !m_ofs )
+        {
+            complain("Failed to write " + m_filename + ".");
+            m_enabled = false;
+        }
+    }
+
+private:
+    bool writeGeometry( const TwoDScene &scene )
+    {
+        m_ofs.open(m_filename.c_str(), std::ios::binary);
+        if( !m_ofs )
+        {
+            complain("Failed to open " + m_filename + " for writing.");
+            m_enabled = false;
+            return false;
+        }
+
+        m_numparticles = scene.getNumParticles();
+        m_ofs.write(CCD_MAGIC, sizeof(CCD_MAGIC));
+        writeValue(m_ofs, m_numparticles);
+        writeValue(m_ofs, scene.getNumEdges());
+        writeValue(m_ofs, scene.getNumHalfplanes());
+        for( int i = 0; i < m_numparticles; ++i ) writeValue(m_ofs, scene.getRadius(i));
+        for( int e = 0; e < scene.getNumEdges(); ++e )
+        {
+            writeValue(m_ofs, scene.getEdge(e).first);
+            writeValue(m_ofs, scene.getEdge(e).second);
+            writeValue(m_ofs, scene.getEdgeRadii()[e]);
+        }
+        for( int p = 0; p < scene.getNumHalfplanes(); ++p )
+        {
+            const std::pair<VectorXs, VectorXs> &halfplane = scene.getHalfplane(p);
+            m_ofs.write((const char *) halfplane.first.data(), 2*sizeof(double));
+            m_ofs.write((const char *) halfplane.second.data(), 2*sizeof(double));
+        }
+        return true;
+    }
+
+    std::string m_filename;
+    bool m_enabled;
+    std::ofstream m_ofs;
+    int m_numparticles;
+};
+
+Recorder g_recorder;
+
+}
+
+bool ccdrecording::enabled()
+{
+    return g_recorder.enabled();
+}
+
+void ccdrecording::recordFrame( const TwoDScene &scene, const VectorXs &qs, const VectorXs &qe )
+{
+    g_recorder.record(scene, qs, qe);
+}
+
+bool ccdrecording::loadRecording( const std::string &filename, TwoDScene &scene, std::vector<VectorXs> &qs, std::vector<VectorXs> &qe )
+{
+    std::ifstream ifs(filename.c_str(), std::ios::binary);
+    if( !ifs )
+    {
+        complain("Failed to open " + filename + ".");
+        return false;
+    }
+
+    char magic[4];
+    int numparticles, numedges, numhalfplanes;
+    ifs.read(magic, sizeof(magic));
+    if( !ifs || memcmp(magic, CCD_MAGIC, sizeof(magic)) != 0 || !readValue(ifs, numparticles) || !readValue(ifs, numedges) || !readValue(ifs, numhalfplanes)
+        || numparticles < 0 || numedges < 0 || numhalfplanes < 0 )
+    {
+        complain(filename + " is not a CCD recording.");
+        return false;
+    }
+
+    scene.resizeSystem(numparticles);
+    scene.clearEdges();
+    scene.clearHalfplanes();
+    bool succeeded = true;
+    for( int i = 0; i < numparticles && succeeded; ++i )
+    {
+        double radius;
+        succeeded = readValue(ifs, radius);
+        if( succeeded ) scene.setRadius(i, radius);
+    }
+    for( int e = 0; e < numedges && succeeded; ++e )
+    {
+        int i, j;
+        double radius;
+        succeeded = readValue(ifs, i) && readValue(ifs, j) && readValue(ifs, radius) && i >= 0 && i < numparticles && j >= 0 && j < numparticles;
+        if( succeeded ) scene.insertEdge(std::pair<int,int>(i, j), radius);
+    }
+    for( int p = 0; p < numhalfplanes && succeeded; ++p )
+    {
+        VectorXs point(2), normal(2);
+        ifs.read((char *) point.data(), 2*sizeof(double));
+        ifs.read((char *) normal.data(), 2*sizeof(double));
+        succeeded = bool(ifs);
+        if( succeeded ) scene.insertHalfplane(std::make_pair(point, normal));
+    }
+    if( !succeeded )
+    {
+        complain(filename + " is truncated or corrupt.");
+        return false;
+    }
+
+    qs.clear();
+    qe.clear();
+    while( numparticles > 0 )
+    {
+        VectorXs start(2*numparticles), end(2*numparticles);
+        ifs.read((char *) start.data(), start.size()*sizeof(double));
+        if( ifs.gcount() == 0 ) break;
+        ifs.read((char *) end.data(), end.size()*sizeof(double));
+        if( !ifs )
+        {
+            complain(filename + " ends part of the way through a frame.");
+            return false;
+        }
+        qs.push_back(start);
+        qe.push_back(end);
+    }
+    return true;
+}
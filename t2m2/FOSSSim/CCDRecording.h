@@ -0,0 +1,36 @@
+#ifndef CCD_RECORDING_H
+#define CCD_RECORDING_H
+
+#include <string>
+#include <vector>
+
+#include "TwoDScene.h"
+#include "MathDefs.h"
+
+// Recorded inputs of continuous-time detection, for replaying the detection
+// kernels outside the simulation. Recording is on when the
+// FOSSSIM_CCD_RECORD environment variable names a file. The collision
+// handlers record the start and end positions of every step they detect
+// over. The file holds, in native byte order,
+//
+//   "CCD1", numparticles, numedges, numhalfplanes    int32s after the magic
+//   radii            numparticles doubles
+//   edges            numedges (i, j, radius) records, two int32s and a double
+//   halfplanes       numhalfplanes (px, py, nx, ny) doubles
+//   frames           qs and qe, 2*numparticles doubles each, until the end
+//
+// The geometry is taken from the first frame, so a scene whose particles or
+// edges change part of the way through is recorded only up to the change.
+namespace ccdrecording
+{
+    bool enabled();
+
+    // Appends a frame when recording; does nothing otherwise.
+    void recordFrame( const TwoDScene &scene, const VectorXs &qs, const VectorXs &qe );
+
+    // Reads a recording into a scene with its radii, edges and half-planes,
+    // and the start and end positions of every frame.
+    bool loadRecording( const std::string &filename, TwoDScene &scene, std::vector<VectorXs> &qs, std::vector<VectorXs> &qe );
+}
+
+#endif
@@ -0,0 +1,47 @@
+#include "CollisionEvents.h"
+
+#include <algorithm>
+#include <cassert>
+
+CollisionEventQueue::CollisionEventQueue( int nparticles )
+: m_heap()
+, m_touched( nparticles, 0 )
+, m_sequence( 0 )
+{}
+
+void CollisionEventQueue::push( const CollisionInfo &info, const int *particles, int count )
+{
+  assert( count >= 1 && count <= 3 );
+  Event event( info );
+  for( int k = 0; k < count; ++k ) event.particles[k] = particles[k];
+  event.count = count;
+  event.sequence = m_sequence;
+  m_heap.push_back( event );
+  std::push_heap( m_heap.begin(), m_heap.end(), Later() );
+}
+
+bool CollisionEventQueue::pop( CollisionInfo &info )
+{
+  while( !m_heap.empty() )
+  {
+    std::pop_heap( m_heap.begin(), m_heap.end(), Later() );
+    const Event event = m_heap.back();
+    m_heap.pop_back();
+    if( !valid( event ) ) continue;
+    info = event.info;
+    ++m_sequence;
+    return true;
+  }
+  return false;
+}
+
+void CollisionEventQueue::touch( int particle )
+{
+  m_touched[particle] = m_sequence;
+}
+
+bool CollisionEventQueue::valid( const Event &event ) const
+{
+  for( int k = 0; k < event.count; ++k ) if( m_touched[event.particles[k]] > event.sequence ) return false;
+  return true;
+}
@@ -0,0 +1,68 @@
+#ifndef COLLISION_EVENTS_H
+#define COLLISION_EVENTS_H
+
+#include "CollisionHandler.h"
+#include "MathDefs.h"
+#include <vector>
+
+// Continuous-time collisions of a step, ordered by their time of impact, for
+// responding to them one at a time from the earliest. A response changes the
+// end positions of the particles it involves, which invalidates every other
+// event involving them; rather than searching the heap for those, each
+// particle records the last response that moved it and an event scheduled
+// before that is dropped when it comes up.
+class CollisionEventQueue
+{
+public:
+  explicit CollisionEventQueue( int nparticles );
+
+  // Schedules a collision whose response moves the given particles, at most
+  // three: both particles, the particle and the edge's endpoints, or the
+  // particle alone.
+  void push( const CollisionInfo &info, const int *particles, int count );
+
+  // Takes the earliest event still valid, breaking ties in the order the
+  // handler's sweep would respond to them. Returns false when none is left.
+  bool pop( CollisionInfo &info );
+
+  // Marks the particle as moved by the response to the event just popped.
+  void touch( int particle );
+
+  int size() const { return (int) m_heap.size(); }
+
+  // Responses so far, one per popped event.
+  int getNumResponses() const { return m_sequence; }
+
+private:
+  struct Event
+  {
+    CollisionInfo info;
+    int particles[3];
+    int count;
+    // Responses that had happened when the event was scheduled.
+    int sequence;
+
+    Event( const CollisionInfo &info_ ) : info(info_), count(0), sequence(0) {}
+  };
+
+  // Heap order: the earliest time on top.
+  struct Later
+  {
+    bool operator()( const Event &a, const Event &b ) const
+    {
+      if( a.info.m_time != b.info.m_time ) return a.info.m_time > b.info.m_time;
+      if( a.info.m_idx1 != b.info.m_idx1 ) return a.info.m_idx1 > b.info.m_idx1;
+      if( a.info.m_type != b.info.m_type ) return a.info.m_type > b.info.m_type;
+      return a.info.m_idx2 > b.info.m_idx2;
+    }
+  };
+
+  bool valid( const Event &event ) const;
+
+  std::vector<Event> m_heap;
+  // The response that last moved each particle, 0 for none.
+  std::vector<int> m_touched;
+  int m_sequence;
+};
+
+#endif
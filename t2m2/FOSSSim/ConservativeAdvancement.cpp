@@ -0,0 +1,67 @@
+#include "ConservativeAdvancement.h"
+#include <algorithm>
+
+namespace
+{
+
+const int ADVANCEMENT_MAX_ITERATIONS = 1000;
+
+// Gap between the particle and the edge at time t, with the vector to the
+// closest point on the edge and that point's barycentric coordinate along it.
+scalar particleEdgeGap( const Vector2s &p, const Vector2s &a, const Vector2s &b, scalar radius, Vector2s &n, scalar &alpha )
+{
+  Vector2s e = b - a;
+  scalar len2 = e.squaredNorm();
+  alpha = len2 > 0.0 ? std::max( 0.0, std::min( 1.0, (p-a).dot(e)/len2 ) ) : 0.0;
+  n = a + alpha*e - p;
+  return n.norm() - radius;
+}
+
+}
+
+bool advanceParticleEdge( const TwoDScene &scene, const VectorXs &qs, const VectorXs &qe, int vidx, int eidx, scalar tol, bool &hit, Vector2s &n, double &time )
+{
+  const std::pair<int,int>& edge = scene.getEdge(eidx);
+
+  Vector2s x1 = qs.segment<2>(2*vidx);
+  Vector2s x2 = qs.segment<2>(2*edge.first);
+  Vector2s x3 = qs.segment<2>(2*edge.second);
+
+  Vector2s dx1 = qe.segment<2>(2*vidx) - x1;
+  Vector2s dx2 = qe.segment<2>(2*edge.first) - x2;
+  Vector2s dx3 = qe.segment<2>(2*edge.second) - x3;
+
+  const scalar radius = scene.getRadius(vidx) + scene.getEdgeRadii()[eidx];
+
+  // The closest point on the edge moves no faster than the faster endpoint,
+  // so the gap changes at most this fast.
+  const scalar speed = dx1.norm() + std::max( dx2.norm(), dx3.norm() );
+
+  hit = false;
+  scalar t = 0.0;
+  for( int itr = 0; itr < ADVANCEMENT_MAX_ITERATIONS; ++itr )
+  {
+    scalar alpha;
+    scalar gap = particleEdgeGap( x1 + t*dx1, x2 + t*dx2, x3 + t*dx3, radius, n, alpha );
+
+    if( gap <= tol )
+    {
+      Vector2s relvel = dx1 - ( (1.0-alpha)*dx2 + alpha*dx3 );
+      if( relvel.dot(n) > 0.0 )
+      {
+        hit = true;
+        time = t;
+        return true;
+      }
+      // In contact but separating; creep forward until the objects part or
+      // start approaching again.
+      gap = tol;
+    }
+
+    if( speed == 0.0 ) return true;
+    t += gap/speed;
+    if( t > 1.0 ) return true;
+  }
+
+  return false;
+}
@@ -0,0 +1,22 @@
+#ifndef CONSERVATIVE_ADVANCEMENT_H
+#define CONSERVATIVE_ADVANCEMENT_H
+
+#include "TwoDScene.h"
+#include "MathDefs.h"
+
+// Conservative-advancement continuous-time detection. Instead of solving for
+// the exact time of impact, time is advanced by the current gap divided by an
+// upper bound on how fast the gap can shrink, which can never step past a
+// contact. The reported time is the first at which the objects are within
+// tol of touching and approaching, so it errs early by at most about tol
+// divided by the approach speed.
+//
+// Returns false if the iteration limit is reached before the motion is
+// resolved; hit, n and time are then unspecified and the caller should fall
+// back to an exact test. Otherwise hit says whether a collision was found; if
+// so, n is the vector from the particle to the closest point on the edge and
+// time is in [0,1].
+
+bool advanceParticleEdge( const TwoDScene &scene, const VectorXs &qs, const VectorXs &qe, int vidx, int eidx, scalar tol, bool &hit, Vector2s &n, double &time );
+
+#endif
@@ -0,0 +1,263 @@
+#include "ContactComponents.h"
+#include <algorithm>
+
+namespace
+{
+
+// The free particles a collision joins, into joined; returns how many.
+int joinedParticles( const TwoDScene &scene, const CollisionInfo &info, int joined[3] )
+{
+  int count = 0;
+  if( !scene.isFixed( info.m_idx1 ) ) joined[count++] = info.m_idx1;
+  if( info.m_type == CollisionInfo::PP )
+  {
+    if( !scene.isFixed( info.m_idx2 ) ) joined[count++] = info.m_idx2;
+  }
+  else if( info.m_type == CollisionInfo::PE )
+  {
+    const std::pair<int,int> &edge = scene.getEdge( info.m_idx2 );
+    if( !scene.isFixed( edge.first ) ) joined[count++] = edge.first;
+    if( !scene.isFixed( edge.second ) ) joined[count++] = edge.second;
+  }
+  return count;
+}
+
+// The fixed particles a collision names, into named; returns how many.
+int namedFixedParticles( const TwoDScene &scene, const CollisionInfo &info, int named[3] )
+{
+  int count = 0;
+  if( scene.isFixed( info.m_idx1 ) ) named[count++] = info.m_idx1;
+  if( info.m_type == CollisionInfo::PP )
+  {
+    if( scene.isFixed( info.m_idx2 ) ) named[count++] = info.m_idx2;
+  }
+  else if( info.m_type == CollisionInfo::PE )
+  {
+    const std::pair<int,int> &edge = scene.getEdge( info.m_idx2 );
+    if( scene.isFixed( edge.first ) ) named[count++] = edge.first;
+    if( scene.isFixed( edge.second ) ) named[count++] = edge.second;
+  }
+  return count;
+}
+
+}
+
+ContactComponents::ContactComponents()
+: m_parent()
+, m_component()
+, m_offsets( 1, 0 )
+, m_particles()
+, m_nfree()
+, m_collision_offsets( 1, 0 )
+, m_collisions()
+, m_fixed()
+, m_incident_offsets()
+, m_incident()
+, m_cursor()
+{}
+
+int ContactComponents::find( int particle )
+{
+  while( m_parent[particle] != particle )
+  {
+    m_parent[particle] = m_parent[m_parent[particle]];
+    particle = m_parent[particle];
+  }
+  return particle;
+}
+
+void ContactComponents::unite( int a, int b )
+{
+  a = find( a );
+  b = find( b );
+  // The lower root wins, which keeps the roots independent of the order of
+  // the unions.
+  if( a < b ) m_parent[b] = a;
+  else if( b < a ) m_parent[a] = b;
+}
+
+void ContactComponents::build( const TwoDScene &scene, const std::vector<CollisionInfo> &collisions )
+{
+  const int nparticles = scene.getNumParticles();
+  const int ncollisions = (int) collisions.size();
+
+  m_parent.resize( nparticles );
+  for( int i = 0; i < nparticles; ++i ) m_parent[i] = i;
+  m_component.assign( nparticles, -1 );
+
+  // The particles of some collision are marked -2 until their roots are
+  // numbered, in order of their lowest particle, below.
+  int joined[3];
+  for( int k = 0; k < ncollisions; ++k )
+  {
+    const int count = joinedParticles( scene, collisions[k], joined );
+    for( int j = 1; j < count; ++j ) unite( joined[0], joined[j] );
+    for( int j = 0; j < count; ++j ) m_component[joined[j]] = -2;
+  }
+
+  m_nfree.clear();
+  m_offsets.assign( 1, 0 );
+  for( int i = 0; i < nparticles; ++i )
+  {
+    if( m_component[i] == -1 ) continue;
+    const int root = find( i );
+    if( root == i )
+    {
+      m_component[i] = (int) m_nfree.size();
+      m_nfree.push_back( 0 );
+    }
+    ++m_nfree[m_component[root]];
+  }
+  const int ncomponents = (int) m_nfree.size();
+
+  // Collisions and the fixed particles they name, by component.
+  m_collision_offsets.assign( ncomponents + 1, 0 );
+  m_fixed.clear();
+  int named[3];
+  for( int k = 0; k < ncollisions; ++k )
+  {
+    if( joinedParticles( scene, collisions[k], joined ) == 0 ) continue;
+    const int c = m_component[find( joined[0] )];
+    ++m_collision_offsets[c+1];
+    const int count = namedFixedParticles( scene, collisions[k], named );
+    for( int j = 0; j < count; ++j ) m_fixed.push_back( std::make_pair( c, named[j] ) );
+  }
+  std::sort( m_fixed.begin(), m_fixed.end() );
+  m_fixed.erase( std::unique( m_fixed.begin(), m_fixed.end() ), m_fixed.end() );
+
+  for( int c = 0; c < ncomponents; ++c ) m_collision_offsets[c+1] += m_collision_offsets[c];
+  m_collisions.resize( m_collision_offsets[ncomponents] );
+  std::vector<int> &cursor = m_cursor;
+  cursor.assign( m_collision_offsets.begin(), m_collision_offsets.end() - 1 );
+  for( int k = 0; k < ncollisions; ++k )
+  {
+    if( joinedParticles( scene, collisions[k], joined ) == 0 ) continue;
+    m_collisions[cursor[m_component[find( joined[0] )]]++] = k;
+  }
+
+  // Each component's free particles, then its fixed ones.
+  m_offsets.assign( ncomponents + 1, 0 );
+  for( int c = 0; c < ncomponents; ++c ) m_offsets[c+1] = m_nfree[c];
+  for( std::vector<std::pair<int,int> >::size_type f = 0; f < m_fixed.size(); ++f ) ++m_offsets[m_fixed[f].first + 1];
+  for( int c = 0; c < ncomponents; ++c ) m_offsets[c+1] += m_offsets[c];
+  m_particles.resize( m_offsets[ncomponents] );
+  cursor.assign( m_offsets.begin(), m_offsets.end() - 1 );
+  for( int i = 0; i < nparticles; ++i )
+    if( m_component[i] != -1 ) m_particles[cursor[m_component[find( i )]]++] = i;
+  for( std::vector<std::pair<int,int> >::size_type f = 0; f < m_fixed.size(); ++f ) m_particles[cursor[m_fixed[f].first]++] = m_fixed[f].second;
+
+  // The edges at each particle.
+  const std::vector<std::pair<int,int> > &edges = scene.getEdges();
+  m_incident_offsets.assign( nparticles + 1, 0 );
+  for( int e = 0; e < (int) edges.size(); ++e )
+  {
+    ++m_incident_offsets[edges[e].first + 1];
+    ++m_incident_offsets[edges[e].second + 1];
+  }
+  for( int i = 0; i < nparticles; ++i ) m_incident_offsets[i+1] += m_incident_offsets[i];
+  m_incident.resize( m_incident_offsets[nparticles] );
+  cursor.assign( m_incident_offsets.begin(), m_incident_offsets.end() - 1 );
+  for( int e = 0; e < (int) edges.size(); ++e )
+  {
+    m_incident[cursor[edges[e].first]++] = e;
+    m_incident[cursor[edges[e].second]++] = e;
+  }
+}
+
+size_t ContactComponents::bytesHeld() const
+{
+  return sizeof(int)*( m_parent.capacity() + m_component.capacity() + m_offsets.capacity() + m_particles.capacity() + m_nfree.capacity()
+                     + m_collision_offsets.capacity() + m_collisions.capacity() + m_incident_offsets.capacity() + m_incident.capacity() + m_cursor.capacity() )
+       + sizeof(std::pair<int,int>)*m_fixed.capacity();
+}
+
+ComponentScene::ComponentScene()
+: scene()
+, qs()
+, qe()
+, qdote()
+, qm()
+, qdotm()
+, collisions()
+, particles()
+, edges()
+, nfree( 0 )
+, m_sorted_edges()
+{}
+
+int ComponentScene::localParticle( int particle ) const
+{
+  std::vector<int>::const_iterator begin = particles.begin();
+  std::vector<int>::const_iterator found = std::lower_bound( begin, begin + nfree, particle );
+  if( found != begin + nfree && *found == particle ) return (int) ( found - begin );
+  found = std::lower_bound( begin + nfree, particles.end(), particle );
+  if( found != particles.end() && *found == particle ) return (int) ( found - begin );
+  return -1;
+}
+
+int ComponentScene::localEdge( int edge ) const
+{
+  std::vector<std::pair<int,int> >::const_iterator found = std::lower_bound( m_sorted_edges.begin(), m_sorted_edges.end(), std::make_pair( edge, -1 ) );
+  return found != m_sorted_edges.end() && found->first == edge ? found->second : -1;
+}
+
+void ComponentScene::load( const TwoDScene &whole, const ContactComponents &components, int c, const VectorXs &wholeqs, const VectorXs &wholeqe, const VectorXs &wholeqdote, const std::vector<CollisionInfo> &wholecollisions )
+{
+  particles.assign( components.particlesBegin( c ), components.particlesEnd( c ) );
+  nfree = components.numFree( c );
+  const int n = (int) particles.size();
+
+  scene.resizeSystem( n );
+  scene.clearEdges();
+  scene.clearHalfplanes();
+  qs.resize( 2*n );
+  qe.resize( 2*n );
+  qdote.resize( 2*n );
+  const VectorXs &M = whole.getM();
+  for( int l = 0; l < n; ++l )
+  {
+    const int p = particles[l];
+    scene.getM().segment<2>( 2*l ) = M.segment<2>( 2*p );
+    scene.setFixed( l, whole.isFixed( p ) );
+    scene.setRadius( l, whole.getRadius( p ) );
+    qs.segment<2>( 2*l ) = wholeqs.segment<2>( 2*p );
+    qe.segment<2>( 2*l ) = wholeqe.segment<2>( 2*p );
+    qdote.segment<2>( 2*l ) = wholeqdote.segment<2>( 2*p );
+  }
+
+  // An edge is taken from its first endpoint, once both are here.
+  const std::vector<std::pair<int,int> > &wholeedges = whole.getEdges();
+  edges.clear();
+  m_sorted_edges.clear();
+  for( int l = 0; l < n; ++l )
+  {
+    for( const int *e = components.edgesBegin( particles[l] ); e != components.edgesEnd( particles[l] ); ++e )
+    {
+      if( wholeedges[*e].first != particles[l] ) continue;
+      const int other = localParticle( wholeedges[*e].second );
+      if( other < 0 ) continue;
+      m_sorted_edges.push_back( std::make_pair( *e, (int) edges.size() ) );
+      edges.push_back( *e );
+      scene.insertEdge( std::make_pair( l, other ), whole.getEdgeRadii()[*e] );
+    }
+  }
+  std::sort( m_sorted_edges.begin(), m_sorted_edges.end() );
+  for( int h = 0; h < whole.getNumHalfplanes(); ++h ) scene.insertHalfplane( whole.getHalfplane( h ) );
+
+  collisions.clear();
+  for( const int *k = components.collisionsBegin( c ); k != components.collisionsEnd( c ); ++k )
+  {
+    const CollisionInfo &info = wholecollisions[*k];
+    const int idx2 = info.m_type == CollisionInfo::PP ? localParticle( info.m_idx2 ) : info.m_type == CollisionInfo::PE ? localEdge( info.m_idx2 ) : info.m_idx2;
+    collisions.push_back( CollisionInfo( info.m_type, localParticle( info.m_idx1 ), idx2, info.m_n, info.m_time ) );
+  }
+}
+
+void ComponentScene::store( VectorXs &wholeqe, VectorXs &wholeqdote ) const
+{
+  for( int l = 0; l < nfree; ++l )
+  {
+    wholeqe.segment<2>( 2*particles[l] ) = qe.segment<2>( 2*l );
+    wholeqdote.segment<2>( 2*particles[l] ) = qdote.segment<2>( 2*l );
+  }
+}
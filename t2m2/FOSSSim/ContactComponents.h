@@ -0,0 +1,114 @@
+#ifndef CONTACT_COMPONENTS_H
+#define CONTACT_COMPONENTS_H
+
+#include "CollisionHandler.h"
+#include "MathDefs.h"
+#include "TwoDScene.h"
+#include <vector>
+
+// The connected components of a step's contact graph, whose nodes are the
+// free particles and whose arcs are the collisions between them: a
+// particle-particle collision joins its two particles, and a particle-edge
+// one the particle and the edge's free endpoints. Fixed particles join
+// nothing, so that piles resting on the same wall stay apart, but each
+// component lists the fixed particles its collisions name.
+//
+// No response to a component's collisions moves a particle of another, so
+// HybridCollisionHandler sweeps the components independently, each to its
+// own end, and in parallel; see ComponentScene. Components are numbered by
+// their lowest free particle, so the grouping does not depend on the order
+// the collisions were found in.
+//
+// The storage is kept from call to call.
+class ContactComponents
+{
+public:
+  ContactComponents();
+
+  // Groups the particles of collisions. Collisions that name no free
+  // particle belong to no component.
+  void build( const TwoDScene &scene, const std::vector<CollisionInfo> &collisions );
+
+  int size() const { return (int) m_offsets.size() - 1; }
+
+  // The particles of component c: its free ones in increasing order, then
+  // the fixed ones its collisions name, in increasing order.
+  const int *particlesBegin( int c ) const { return &m_particles[0] + m_offsets[c]; }
+  const int *particlesEnd( int c ) const { return &m_particles[0] + m_offsets[c+1]; }
+  int numFree( int c ) const { return m_nfree[c]; }
+
+  // The indices of component c's collisions among those built from, in
+  // increasing order.
+  const int *collisionsBegin( int c ) const { return &m_collisions[0] + m_collision_offsets[c]; }
+  const int *collisionsEnd( int c ) const { return &m_collisions[0] + m_collision_offsets[c+1]; }
+
+  // The edges at each particle, for laying components out as scenes.
+  const int *edgesBegin( int particle ) const { return incident() + m_incident_offsets[particle]; }
+  const int *edgesEnd( int particle ) const { return incident() + m_incident_offsets[particle+1]; }
+
+  // Bytes held from call to call, for memory accounting.
+  size_t bytesHeld() const;
+
+private:
+  const int *incident() const { return m_incident.empty() ? NULL : &m_incident[0]; }
+  int find( int particle );
+  void unite( int a, int b );
+
+  // Union-find over the particles, and each root's component or -1.
+  std::vector<int> m_parent;
+  std::vector<int> m_component;
+  std::vector<int> m_offsets;
+  std::vector<int> m_particles;
+  std::vector<int> m_nfree;
+  std::vector<int> m_collision_offsets;
+  std::vector<int> m_collisions;
+  // The fixed particles each component's collisions name, as (component,
+  // particle) before they are laid out.
+  std::vector<std::pair<int,int> > m_fixed;
+  std::vector<int> m_incident_offsets;
+  std::vector<int> m_incident;
+  // Where the next entry of each list goes while they are filled.
+  std::vector<int> m_cursor;
+};
+
+// One component of a ContactComponents laid out as a scene of its own: its
+// particles, the edges between them, every half-plane, and its parts of a
+// step's start and end states and of its collisions, all renumbered. The
+// base library's detection and responses take whole scenes, so a component
+// is swept by running them on this one, and its results copied back with
+// store. Each thread sweeps its components in one of these.
+struct ComponentScene
+{
+  ComponentScene();
+
+  // Lays out component c of components, from a step from qs to qe and
+  // qdote with the collisions components was built from.
+  void load( const TwoDScene &scene, const ContactComponents &components, int c, const VectorXs &qs, const VectorXs &qe, const VectorXs &qdote, const std::vector<CollisionInfo> &collisions );
+
+  // Copies the component's free particles' qe and qdote back into those of
+  // the whole scene.
+  void store( VectorXs &qe, VectorXs &qdote ) const;
+
+  TwoDScene scene;
+  VectorXs qs;
+  VectorXs qe;
+  VectorXs qdote;
+  VectorXs qm;
+  VectorXs qdotm;
+  std::vector<CollisionInfo> collisions;
+
+  // The scene's particles and edges in the order they are numbered here.
+  std::vector<int> particles;
+  std::vector<int> edges;
+  int nfree;
+
+private:
+  // The local number of a particle of the component, or -1.
+  int localParticle( int particle ) const;
+  int localEdge( int edge ) const;
+
+  // The edges sorted, with where each went, for localEdge.
+  std::vector<std::pair<int,int> > m_sorted_edges;
+};
+
+#endif
@@ -0,0 +1,183 @@
+#include "ContactLCP.h"
+#include "ImpulseCache.h"
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+
+// Orders positions in a list of contacts by the contacts' keys.
+template<typename T>
+struct KeyOrder
+{
+  KeyOrder( const std::vector<T> &contacts ) : m_contacts( contacts ) {}
+  bool operator()( int a, int b ) const { return m_contacts[a] < m_contacts[b]; }
+  bool operator()( int a, const T &b ) const { return m_contacts[a] < b; }
+  const std::vector<T> &m_contacts;
+};
+
+}
+
+ContactLCP::ContactLCP()
+: m_contacts()
+, m_bykey()
+, m_previous()
+, m_invmass()
+, m_warmstarted(0)
+, m_sweeps(0)
+{}
+
+// A contact of the last step that still touches is as likely to carry its
+// load in this one, and it may not approach at all until the contacts below
+// it give way, which would take a detection pass each to find. So it joins
+// the step straight away, with its impulse.
+void ContactLCP::beginStep( ContinuousTimeCollisionHandler &handler, const TwoDScene &scene, const VectorXs &qs, double dt, VectorXs &qe, VectorXs &qdote )
+{
+  m_contacts.clear();
+  m_bykey.clear();
+  m_sweeps = 0;
+
+  const VectorXs &M = scene.getM();
+  m_invmass.resize( scene.getNumParticles() );
+  for( int i = 0; i < scene.getNumParticles(); ++i )
+    m_invmass[i] = scene.isFixed( i ) ? 0.0 : 1.0/M[2*i];
+
+  for( std::vector<Contact>::size_type c = 0; c < m_previous.size(); ++c )
+  {
+    Contact contact = m_previous[c];
+    if( !ImpulseCache::touching( scene, qs, contact.type, contact.idx1, contact.idx2 ) ) continue;
+    if( !setRow( handler.getCOR(), qs, qe, dt, contact ) ) continue;
+    m_contacts.push_back( contact );
+  }
+  m_warmstarted = (int) m_contacts.size();
+
+  // The biases are all taken from the velocities before any warm start.
+  for( std::vector<Contact>::size_type c = 0; c < m_contacts.size(); ++c )
+    apply( m_contacts[c], m_contacts[c].lambda, dt, qe, qdote );
+
+  for( int c = 0; c < (int) m_contacts.size(); ++c ) m_bykey.push_back( c );
+}
+
+bool ContactLCP::setRow( double COR, const VectorXs &qs, const VectorXs &qe, double dt, Contact &contact ) const
+{
+  double K = 0.0;
+  for( int k = 0; k < contact.count; ++k ) K += contact.weights[k]*contact.weights[k]*m_invmass[contact.particles[k]];
+  // Between fixed particles.
+  if( K == 0.0 ) return false;
+  contact.invmass = 1.0/K;
+  contact.bias = COR*std::min( velocity( contact, qs, qe, dt ), 0.0 );
+  return true;
+}
+
+double ContactLCP::velocity( const Contact &contact, const VectorXs &qs, const VectorXs &qe, double dt )
+{
+  double u = 0.0;
+  for( int k = 0; k < contact.count; ++k )
+  {
+    const int p = contact.particles[k];
+    u += contact.weights[k]*contact.nhat.dot( qe.segment<2>( 2*p ) - qs.segment<2>( 2*p ) );
+  }
+  return u/dt;
+}
+
+void ContactLCP::apply( const Contact &contact, double impulse, double dt, VectorXs &qe, VectorXs &qdote ) const
+{
+  for( int k = 0; k < contact.count; ++k )
+  {
+    const int p = contact.particles[k];
+    const Vector2s dv = m_invmass[p]*contact.weights[k]*impulse*contact.nhat;
+    qdote.segment<2>( 2*p ) += dv;
+    qe.segment<2>( 2*p ) += dt*dv;
+  }
+}
+
+// The normal of every collision points from its particle idx1 towards the
+// other object, so J v is the speed at which the two separate.
+void ContactLCP::addContacts( ContinuousTimeCollisionHandler &handler, const TwoDScene &scene, const VectorXs &qs, double dt, const std::vector<CollisionInfo> &collisions, const VectorXs &qe )
+{
+  const int first = (int) m_contacts.size();
+  for( std::vector<CollisionInfo>::size_type k = 0; k < collisions.size(); ++k )
+  {
+    const CollisionInfo &info = collisions[k];
+    if( info.m_n.squaredNorm() == 0.0 ) continue;
+
+    Contact contact;
+    contact.type = info.m_type;
+    contact.idx1 = info.m_idx1;
+    contact.idx2 = info.m_idx2;
+    contact.nhat = info.m_n.normalized();
+    contact.lambda = 0.0;
+
+    // Already a row of the step.
+    const std::vector<int>::const_iterator found = std::lower_bound( m_bykey.begin(), m_bykey.end(), contact, KeyOrder<Contact>( m_contacts ) );
+    if( found != m_bykey.end() && !( contact < m_contacts[*found] ) ) continue;
+
+    contact.particles[0] = info.m_idx1;
+    contact.weights[0] = -1.0;
+    contact.count = 1;
+    switch( info.m_type )
+    {
+      case CollisionInfo::PP:
+        contact.particles[1] = info.m_idx2;
+        contact.weights[1] = 1.0;
+        contact.count = 2;
+        break;
+      case CollisionInfo::PE:
+      {
+        // The contact point along the edge at the time of collision.
+        double alpha;
+        handler.particleEdgeImpulse( scene, qs, qe, info.m_idx1, info.m_idx2, contact.nhat, info.m_time, dt, alpha );
+        const std::pair<int,int> &edge = scene.getEdge( info.m_idx2 );
+        contact.particles[1] = edge.first;
+        contact.weights[1] = 1.0 - alpha;
+        contact.particles[2] = edge.second;
+        contact.weights[2] = alpha;
+        contact.count = 3;
+        break;
+      }
+      default:
+        break;
+    }
+
+    if( setRow( handler.getCOR(), qs, qe, dt, contact ) ) m_contacts.push_back( contact );
+  }
+
+  for( int c = first; c < (int) m_contacts.size(); ++c ) m_bykey.push_back( c );
+  std::sort( m_bykey.begin(), m_bykey.end(), KeyOrder<Contact>( m_contacts ) );
+}
+
+int ContactLCP::solve( const VectorXs &qs, double dt, int maxsweeps, double tolerance, VectorXs &qe, VectorXs &qdote )
+{
+  double scale = 0.0;
+  for( std::vector<Contact>::size_type c = 0; c < m_contacts.size(); ++c )
+    scale = std::max( scale, fabs( velocity( m_contacts[c], qs, qe, dt ) ) );
+
+  for( m_sweeps = 0; m_sweeps < maxsweeps; )
+  {
+    ++m_sweeps;
+    double largest = 0.0;
+    for( std::vector<Contact>::size_type c = 0; c < m_contacts.size(); ++c )
+    {
+      Contact &contact = m_contacts[c];
+      const double w = velocity( contact, qs, qe, dt ) + contact.bias;
+      const double lambda = std::max( 0.0, contact.lambda - w*contact.invmass );
+      const double change = lambda - contact.lambda;
+      if( change == 0.0 ) continue;
+      apply( contact, change, dt, qe, qdote );
+      contact.lambda = lambda;
+      largest = std::max( largest, fabs( change )/contact.invmass );
+    }
+    if( largest <= tolerance*scale ) break;
+  }
+  return m_sweeps;
+}
+
+void ContactLCP::endStep()
+{
+  m_previous.clear();
+  for( std::vector<Contact>::size_type c = 0; c < m_contacts.size(); ++c )
+    if( m_contacts[c].lambda > 0.0 ) m_previous.push_back( m_contacts[c] );
+  std::sort( m_previous.begin(), m_previous.end() );
+  m_contacts.clear();
+  m_bykey.clear();
+}
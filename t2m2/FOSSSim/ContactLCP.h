@@ -0,0 +1,119 @@
+#ifndef CONTACT_LCP_H
+#define CONTACT_LCP_H
+
+#include "ContinuousTimeCollisionHandler.h"
+#include "MathDefs.h"
+#include "TwoDScene.h"
+#include <vector>
+
+// The contacts of a step as one velocity-level linear complementarity
+// problem, solved by projected Gauss-Seidel. Each contact is a row of the
+// constraint Jacobian J, with an entry for each of the two or three particles
+// it involves, and carries an impulse lambda. With v the end-of-step
+// velocities, M the masses and e the coefficient of restitution, the solve
+// looks for
+//
+//   v = v* + M^-1 J^T lambda,  w = J v + e min(J v*, 0),
+//   lambda >= 0,  w >= 0,  lambda . w = 0,
+//
+// where v* are the velocities before the contact was found: every contact
+// ends up separating at no less than e times its approach speed, and only
+// contacts that would otherwise still approach push.
+//
+// An iterative impulse sweep responds to every collision from the same
+// velocities, so a pile n deep takes n sweeps, and a detection pass each, to
+// pass an impulse from top to bottom. A Gauss-Seidel sweep sees the impulses
+// already applied in it, and the impulses are carried between detection
+// passes and, as a warm start, between steps. A resting pile starts each step
+// with all of its contacts, from the impulses that held it up the step
+// before, and mostly needs a few sweeps of one detection pass.
+//
+// A contact is keyed by its CollisionInfo type and indices, as in
+// ImpulseCache, and kept for the next step while it touches by the same
+// test.
+class ContactLCP
+{
+public:
+  ContactLCP();
+
+  // Starts a step from qs. The contacts of the last step that carried an
+  // impulse and are still touching at qs join the step with that impulse,
+  // which is applied to qe and qdote.
+  void beginStep( ContinuousTimeCollisionHandler &handler, const TwoDScene &scene, const VectorXs &qs, double dt, VectorXs &qe, VectorXs &qdote );
+
+  // Adds the collisions a detection pass found from qs to qe to the step's
+  // contacts, with no impulse. A contact already in the step keeps its row
+  // and impulse.
+  void addContacts( ContinuousTimeCollisionHandler &handler, const TwoDScene &scene, const VectorXs &qs, double dt, const std::vector<CollisionInfo> &collisions, const VectorXs &qe );
+
+  // Runs up to maxsweeps projected Gauss-Seidel sweeps over the step's
+  // contacts, applying the change in impulses to qe and qdote. Stops early
+  // once a sweep changes no contact's velocity by more than tolerance times
+  // the largest normal speed of a contact at the start. Returns the sweeps
+  // taken.
+  int solve( const VectorXs &qs, double dt, int maxsweeps, double tolerance, VectorXs &qe, VectorXs &qdote );
+
+  // Keeps the step's impulses for warm starting the next step.
+  void endStep();
+
+  // Contacts in the step, those of them warm started, and the sweeps taken
+  // by the last solve.
+  int size() const { return (int) m_contacts.size(); }
+  int getNumWarmStarted() const { return m_warmstarted; }
+  int getNumSweeps() const { return m_sweeps; }
+
+  // Bytes held from step to step, for memoryaccounting.
+  size_t bytesHeld() const
+  {
+    return sizeof(Contact)*( m_contacts.capacity() + m_previous.capacity() ) + sizeof(int)*m_bykey.capacity() + sizeof(double)*m_invmass.capacity();
+  }
+
+private:
+  struct Contact
+  {
+    CollisionInfo::collisiontype type;
+    int idx1;
+    int idx2;
+    // The row of J: the particles, and the weight along nhat of each. A
+    // half-plane contact uses one particle, a particle pair two.
+    int particles[3];
+    double weights[3];
+    int count;
+    Vector2s nhat;
+    // The inverse of J M^-1 J^T for the row.
+    double invmass;
+    // e min(J v*, 0).
+    double bias;
+    double lambda;
+
+    bool operator<( const Contact &other ) const
+    {
+      if( type != other.type ) return type < other.type;
+      if( idx1 != other.idx1 ) return idx1 < other.idx1;
+      return idx2 < other.idx2;
+    }
+  };
+
+  // Sets the contact's invmass, and its bias from qs to qe. Returns false if
+  // all of its particles are fixed.
+  bool setRow( double COR, const VectorXs &qs, const VectorXs &qe, double dt, Contact &contact ) const;
+
+  // J v for the contact, with v = (qe - qs)/dt.
+  static double velocity( const Contact &contact, const VectorXs &qs, const VectorXs &qe, double dt );
+
+  // Adds impulse to the contact's particles, through their inverse masses.
+  void apply( const Contact &contact, double impulse, double dt, VectorXs &qe, VectorXs &qdote ) const;
+
+  // The contacts of the step, in the order they were found, and their
+  // positions sorted by key for finding them again.
+  std::vector<Contact> m_contacts;
+  std::vector<int> m_bykey;
+  // The last step's contacts, sorted by key.
+  std::vector<Contact> m_previous;
+  // Inverse mass of each particle, 0 for fixed ones.
+  std::vector<double> m_invmass;
+  int m_warmstarted;
+  int m_sweeps;
+};
+
+#endif
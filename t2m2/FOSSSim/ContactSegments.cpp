@@ -0,0 +1,65 @@
+#include "ContactSegments.h"
+#include <algorithm>
+#include <iterator>
+
+namespace
+{
+
+// Below this many collisions they are gathered serially.
+const int PARALLEL_MIN_GATHER = 4096;
+
+}
+
+ContactSegments::ContactSegments()
+: m_segments()
+, m_logs()
+, m_offsets()
+, m_nchunks( 0 )
+{}
+
+void ContactSegments::reset( int nchunks )
+{
+  if( (int) m_segments.size() < nchunks )
+  {
+    m_segments.resize( nchunks );
+    m_logs.resize( nchunks );
+  }
+  for( int c = 0; c < nchunks; ++c )
+  {
+    m_segments[c].clear();
+    m_logs[c].clear();
+  }
+  m_nchunks = nchunks;
+}
+
+void ContactSegments::gather( std::vector<CollisionInfo> &collisions, std::vector<Polynomial> *log )
+{
+  m_offsets.resize( m_nchunks + 1 );
+  m_offsets[0] = 0;
+  for( int c = 0; c < m_nchunks; ++c )
+    m_offsets[c+1] = m_offsets[c] + (int) m_segments[c].size();
+
+  const int total = m_offsets[m_nchunks];
+  collisions.clear();
+  collisions.resize( total, CollisionInfo( CollisionInfo::PP, 0, 0, Vector2s::Zero(), 0.0 ) );
+#ifdef _OPENMP
+  #pragma omp parallel for schedule(static) if(total >= PARALLEL_MIN_GATHER)
+#endif
+  for( int c = 0; c < m_nchunks; ++c )
+    std::copy( m_segments[c].begin(), m_segments[c].end(), collisions.begin() + m_offsets[c] );
+
+  if( log == NULL ) return;
+  for( int c = 0; c < m_nchunks; ++c )
+  {
+    log->insert( log->end(), std::make_move_iterator( m_logs[c].begin() ), std::make_move_iterator( m_logs[c].end() ) );
+    m_logs[c].clear();
+  }
+}
+
+size_t ContactSegments::bytesHeld() const
+{
+  size_t bytes = sizeof(int)*m_offsets.capacity();
+  for( std::vector<std::vector<CollisionInfo> >::size_type c = 0; c < m_segments.size(); ++c )
+    bytes += sizeof(CollisionInfo)*m_segments[c].capacity() + sizeof(Polynomial)*m_logs[c].capacity();
+  return bytes;
+}
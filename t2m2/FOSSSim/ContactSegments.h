@@ -0,0 +1,45 @@
+#ifndef CONTACT_SEGMENTS_H
+#define CONTACT_SEGMENTS_H
+
+#include "CollisionHandler.h"
+#include "ContinuousTimeUtilities.h"
+#include <vector>
+
+// The collisions a narrow phase finds when it runs in parallel, one segment
+// per chunk of its work. Each chunk appends only to its own segment, and to
+// its own log of the CCD polynomials it solves, so the threads share nothing
+// and take no locks. gather then lays the segments end to end in chunk order
+// at offsets from a prefix sum of their sizes, so with chunks in the order
+// the serial loop would take them, the collisions and the polynomial log
+// come out exactly as the serial narrow phase makes them.
+//
+// The segments are kept from call to call for their storage.
+class ContactSegments
+{
+public:
+  ContactSegments();
+
+  // Makes nchunks empty segments.
+  void reset( int nchunks );
+
+  std::vector<CollisionInfo> &segment( int chunk ) { return m_segments[chunk]; }
+
+  // The chunk's log, for its solver context if log is set, or NULL.
+  std::vector<Polynomial> *log( int chunk, bool log ) { return log ? &m_logs[chunk] : NULL; }
+
+  // Replaces the contents of collisions with the segments in chunk order,
+  // and appends the chunks' logs to log unless it is NULL.
+  void gather( std::vector<CollisionInfo> &collisions, std::vector<Polynomial> *log );
+
+  // Bytes held from call to call, for memoryaccounting.
+  size_t bytesHeld() const;
+
+private:
+  std::vector<std::vector<CollisionInfo> > m_segments;
+  std::vector<std::vector<Polynomial> > m_logs;
+  // m_offsets[c] is where segment c starts in the gathered collisions.
+  std::vector<int> m_offsets;
+  int m_nchunks;
+};
+
+#endif
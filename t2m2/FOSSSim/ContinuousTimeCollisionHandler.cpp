@@ -1,6 +1,366 @@
 #include "ContinuousTimeCollisionHandler.h"
 #include <iostream>
+#include <algorithm>
+#include <limits>
 #include "ContinuousTimeUtilities.h"
+#include "SweptBounds.h"
+#include "ConservativeAdvancement.h"
+#include "PhaseTiming.h"
+#include "CCDRecording.h"
+#include "FrameArena.h"
+#include "SweptTrajectories.h"
+#include "MemoryAccounting.h"
+#include "ImpulseKernels.h"
+#include "HalfplaneSweep.h"
+#include "ImpulseHistory.h"
+
+// Publishes the scene to the display; defined by the driver.
+void syncScene();
+
+// Tests every particle against every other particle, edge and half-plane over
+// the motion from oldpos to scene.getX(), and responds to each collision in
+// turn as it is found. With CCD_EVENT_ORDER they are responded to in order of
+// time of impact instead; see handleCollisionsInTimeOrder. With
+// SPECULATIVE_CONTACTS nothing is solved for; see handleSpeculativeContacts.
+void ContinuousTimeCollisionHandler::handleCollisions(TwoDScene &scene, const VectorXs &oldpos, VectorXs &oldvel, scalar dt)
+{
+    phasetiming::beginFrame();
+    memoryaccounting::checkIn(scene, *this);
+    impulsehistory::endStep(oldpos);
+    framearena::frame().reset();
+    ccdrecording::recordFrame(scene, oldpos, scene.getX());
+#if defined(SPECULATIVE_CONTACTS)
+    handleSpeculativeContacts(scene, oldpos, dt);
+#elif defined(CCD_EVENT_ORDER)
+    handleCollisionsInTimeOrder(scene, oldpos, dt);
+#else
+    ScopedPhaseTimer ccd(phasetiming::NARROW_PHASE);
+    VectorXs &x = scene.getX();
+    Vector2s n;
+    double time;
+    // Every particle is tested against every edge, so each edge's terms are
+    // computed once here rather than once per particle.
+    SweptTrajectories trajectories(scene, oldpos, x, framearena::frame());
+#ifdef CCD_PARTICLE_BLOCKS
+    // detectParticleParticle repeats this test; the blocks let the sweep
+    // reject most pairs from two cache lines. Over the memory budget the
+    // sweep goes without them.
+    ScopedPhaseTimer broadphase(phasetiming::BROAD_PHASE);
+    ParticleBlocks blocks(scene, oldpos, x, framearena::frame(), !memoryaccounting::overBudget());
+    broadphase.stop();
+#endif
+    
+    for(int i=0; i<scene.getNumParticles(); i++)
+    {
+        for(int j=i+1; j<scene.getNumParticles(); j++)
+        {
+#ifdef CCD_PARTICLE_BLOCKS
+            if(!blocks.empty() && !sweptParticlesMayCollide(blocks[i], blocks[j]))
+                continue;
+#endif
+            PROFILE_COUNT(phasetiming::BROAD_PHASE_CANDIDATES, 1);
+            if(detectParticleParticle(scene, oldpos, x, i, j, n, time))
+            {
+                PROFILE_COUNT(phasetiming::CONTACTS, 1);
+                addParticleParticleImpulse(i, j, n, time);
+                respondParticleParticle(scene, oldpos, x, i, j, n, time, dt, scene.getX(), scene.getV());
+                trajectories.updateEnd(x, i);
+                trajectories.updateEnd(x, j);
+#ifdef CCD_PARTICLE_BLOCKS
+                blocks.updateEnd(x, i);
+                blocks.updateEnd(x, j);
+#endif
+            }
+        }
+        
+        for(int e=0; e<scene.getNumEdges(); e++)
+        {
+            if(scene.getEdges()[e].first == i || scene.getEdges()[e].second == i)
+                continue;
+            PROFILE_COUNT(phasetiming::BROAD_PHASE_CANDIDATES, 1);
+            if(detectParticleEdge(scene, oldpos, x, trajectories, i, e, n, time))
+            {
+                PROFILE_COUNT(phasetiming::CONTACTS, 1);
+                addParticleEdgeImpulse(i, e, n, time);
+                respondParticleEdge(scene, oldpos, x, i, e, n, time, dt, scene.getX(), scene.getV());
+                trajectories.updateEnd(x, i);
+                trajectories.updateEnd(x, scene.getEdges()[e].first);
+                trajectories.updateEnd(x, scene.getEdges()[e].second);
+#ifdef CCD_PARTICLE_BLOCKS
+                blocks.updateEnd(x, i);
+                blocks.updateEnd(x, scene.getEdges()[e].first);
+                blocks.updateEnd(x, scene.getEdges()[e].second);
+#endif
+            }
+        }
+        
+        for(int p=0; p<scene.getNumHalfplanes(); p++)
+        {
+            PROFILE_COUNT(phasetiming::BROAD_PHASE_CANDIDATES, 1);
+            if(detectParticleHalfplane(scene, oldpos, x, i, p, n, time))
+            {
+                PROFILE_COUNT(phasetiming::CONTACTS, 1);
+                addParticleHalfplaneImpulse(i, p, n, time);
+                respondParticleHalfplane(scene, oldpos, x, i, p, n, time, dt, scene.getX(), scene.getV());
+                trajectories.updateEnd(x, i);
+#ifdef CCD_PARTICLE_BLOCKS
+                blocks.updateEnd(x, i);
+#endif
+            }
+        }
+    }
+#endif
+    
+    ScopedPhaseTimer rendering(phasetiming::RENDERING);
+    syncScene();
+}
+
+namespace
+{
+
+// A step responds to at most this many events per particle, in case
+// responses keep knocking the same particles back into each other.
+const int MAX_EVENTS_PER_PARTICLE = 16;
+
+// Most sweeps of the speculative contacts per step. A sweep that responds to
+// nothing ends them early.
+const int SPECULATIVE_SWEEPS = 4;
+
+// The impulse that cuts a pair's closing speed, minus its relative normal
+// velocity vn, to what closes the gap within dt and no more, or 0 if it is
+// no faster than that. A pair already overlapping is only stopped. The
+// responses below change vn by exactly minus the impulse, whatever the
+// masses, so this is the whole of it. time is when the pair would have
+// touched, as a fraction of the step.
+double speculativeImpulse(double gap, double vn, double dt, double &time)
+{
+    const double closing = -vn*dt;
+    gap = std::max(gap, 0.0);
+    if(!(closing > gap))
+        return 0.0;
+    time = gap/closing;
+    return vn + gap/dt;
+}
+
+}
+
+// Detects every collision from oldpos to scene.getX() and responds to them in
+// order of time of impact. Each response changes the end positions of the
+// particles it involves, so their events are dropped and they are tested
+// again against everything, keeping only collisions no earlier than the one
+// just responded to. Pairs a response did not touch keep their events.
+void ContinuousTimeCollisionHandler::handleCollisionsInTimeOrder(TwoDScene &scene, const VectorXs &oldpos, scalar dt)
+{
+    ScopedPhaseTimer ccd(phasetiming::NARROW_PHASE);
+    VectorXs &x = scene.getX();
+    const int nparticles = scene.getNumParticles();
+    SweptTrajectories trajectories(scene, oldpos, x, framearena::frame());
+    CollisionEventQueue events(nparticles);
+    for(int i=0; i<nparticles; i++)
+        scheduleCollisions(scene, oldpos, x, trajectories, i, false, 0.0, events);
+    
+    CollisionInfo info(CollisionInfo::PP, 0, 0, Vector2s::Zero(), 0.0);
+    while(events.getNumResponses() < MAX_EVENTS_PER_PARTICLE*nparticles && events.pop(info))
+    {
+        PROFILE_COUNT(phasetiming::CONTACTS, 1);
+        int moved[3] = {info.m_idx1, -1, -1};
+        int nmoved = 1;
+        if(info.m_type == CollisionInfo::PP)
+        {
+            addParticleParticleImpulse(info.m_idx1, info.m_idx2, info.m_n, info.m_time);
+            respondParticleParticle(scene, oldpos, x, info.m_idx1, info.m_idx2, info.m_n, info.m_time, dt, scene.getX(), scene.getV());
+            moved[nmoved++] = info.m_idx2;
+        }
+        else if(info.m_type == CollisionInfo::PE)
+        {
+            addParticleEdgeImpulse(info.m_idx1, info.m_idx2, info.m_n, info.m_time);
+            respondParticleEdge(scene, oldpos, x, info.m_idx1, info.m_idx2, info.m_n, info.m_time, dt, scene.getX(), scene.getV());
+            moved[nmoved++] = scene.getEdge(info.m_idx2).first;
+            moved[nmoved++] = scene.getEdge(info.m_idx2).second;
+        }
+        else
+        {
+            addParticleHalfplaneImpulse(info.m_idx1, info.m_idx2, info.m_n, info.m_time);
+            respondParticleHalfplane(scene, oldpos, x, info.m_idx1, info.m_idx2, info.m_n, info.m_time, dt, scene.getX(), scene.getV());
+        }
+        
+        for(int k=0; k<nmoved; k++)
+        {
+            trajectories.updateEnd(x, moved[k]);
+            events.touch(moved[k]);
+        }
+        for(int k=0; k<nmoved; k++)
+            scheduleCollisions(scene, oldpos, x, trajectories, moved[k], true, info.m_time, events);
+    }
+}
+
+// Schedules the collisions of particle idx from qs to qe at or after time
+// after: against the particles after it and the edges and half-planes, and if
+// the particle has moved, against every other particle and, as an endpoint
+// of its edges, every particle against those edges too.
+void ContinuousTimeCollisionHandler::scheduleCollisions(const TwoDScene &scene, const VectorXs &qs, const VectorXs &qe, const SweptTrajectories &trajectories, int idx, bool moved, double after, CollisionEventQueue &events)
+{
+    const std::vector<std::pair<int,int> > &edges = scene.getEdges();
+    // Not every detect writes them when it reports a collision.
+    Vector2s n = Vector2s::Zero();
+    double time = 0.0;
+    int particles[3];
+    
+    for(int j=moved ? 0 : idx+1; j<scene.getNumParticles(); j++)
+    {
+        if(j == idx)
+            continue;
+        // Lower index first, as the sweep tests them.
+        particles[0] = std::min(idx, j);
+        particles[1] = std::max(idx, j);
+        PROFILE_COUNT(phasetiming::BROAD_PHASE_CANDIDATES, 1);
+        if(detectParticleParticle(scene, qs, qe, particles[0], particles[1], n, time) && time >= after)
+            events.push(CollisionInfo(CollisionInfo::PP, particles[0], particles[1], n, time), particles, 2);
+    }
+    
+    for(int e=0; e<(int)edges.size(); e++)
+    {
+        particles[1] = edges[e].first;
+        particles[2] = edges[e].second;
+        if(edges[e].first != idx && edges[e].second != idx)
+        {
+            PROFILE_COUNT(phasetiming::BROAD_PHASE_CANDIDATES, 1);
+            particles[0] = idx;
+            if(detectParticleEdge(scene, qs, qe, trajectories, idx, e, n, time) && time >= after)
+                events.push(CollisionInfo(CollisionInfo::PE, idx, e, n, time), particles, 3);
+            continue;
+        }
+        if(!moved)
+            continue;
+        for(int v=0; v<scene.getNumParticles(); v++)
+        {
+            if(v == edges[e].first || v == edges[e].second)
+                continue;
+            PROFILE_COUNT(phasetiming::BROAD_PHASE_CANDIDATES, 1);
+            particles[0] = v;
+            if(detectParticleEdge(scene, qs, qe, trajectories, v, e, n, time) && time >= after)
+                events.push(CollisionInfo(CollisionInfo::PE, v, e, n, time), particles, 3);
+        }
+    }
+    
+    for(int p=0; p<scene.getNumHalfplanes(); p++)
+    {
+        PROFILE_COUNT(phasetiming::BROAD_PHASE_CANDIDATES, 1);
+        particles[0] = idx;
+        if(detectParticleHalfplane(scene, qs, qe, idx, p, n, time) && time >= after)
+            events.push(CollisionInfo(CollisionInfo::PH, idx, p, n, time), particles, 1);
+    }
+}
+
+// Speculative contacts: each pair's gap at the start of the step, oldpos,
+// bounds how far it may close over the step, so no pair can pass through
+// another however fast it moves, and no polynomial is solved. A pair whose
+// closing speed would take it past the gap gets the inelastic impulse along
+// their normal at oldpos that leaves it exactly enough to close it. This is
+// conservative: a fast pair that would only have grazed, or missed, stops
+// short anyway, and the coefficient of restitution is not applied. Pairs are
+// swept in the usual order, each response updating scene.getX() and
+// scene.getV() for the pairs after it, until a sweep changes nothing or
+// SPECULATIVE_SWEEPS have run. The swept-box tests still reject pairs first,
+// since a pair whose boxes do not meet cannot touch.
+void ContinuousTimeCollisionHandler::handleSpeculativeContacts(TwoDScene &scene, const VectorXs &oldpos, scalar dt)
+{
+    ScopedPhaseTimer ccd(phasetiming::NARROW_PHASE);
+    VectorXs &x = scene.getX();
+    VectorXs &v = scene.getV();
+    const std::vector<std::pair<int,int> > &edges = scene.getEdges();
+    const std::vector<scalar> &edgeradii = scene.getEdgeRadii();
+    double time = 0.0;
+    
+    for(int sweep=0; sweep<SPECULATIVE_SWEEPS; sweep++)
+    {
+        bool responded = false;
+        for(int i=0; i<scene.getNumParticles(); i++)
+        {
+            const Vector2s x1 = oldpos.segment<2>(2*i);
+            
+            for(int j=i+1; j<scene.getNumParticles(); j++)
+            {
+                PROFILE_COUNT(phasetiming::BROAD_PHASE_CANDIDATES, 1);
+                if((scene.isFixed(i) && scene.isFixed(j)) || !sweptParticlesMayCollide(scene, oldpos, x, i, j))
+                    continue;
+                Vector2s n = oldpos.segment<2>(2*j) - x1;
+                const double len = n.norm();
+                if(len < 1e-10)
+                    continue;
+                const Vector2s nhat = n/len;
+                const Vector2s v1 = (x.segment<2>(2*i) - x1)/dt;
+                const Vector2s v2 = (x.segment<2>(2*j) - oldpos.segment<2>(2*j))/dt;
+                const double I = speculativeImpulse(len - scene.getRadius(i) - scene.getRadius(j), (v2-v1).dot(nhat), dt, time);
+                if(I == 0.0)
+                    continue;
+                PROFILE_COUNT(phasetiming::CONTACTS, 1);
+                addParticleParticleImpulse(i, j, n, time);
+                applyParticleParticleImpulse(scene, i, j, nhat, I, dt, x, v);
+                responded = true;
+            }
+            
+            for(int e=0; e<(int)edges.size(); e++)
+            {
+                if(edges[e].first == i || edges[e].second == i)
+                    continue;
+                PROFILE_COUNT(phasetiming::BROAD_PHASE_CANDIDATES, 1);
+                if((scene.isFixed(i) && scene.isFixed(edges[e].first) && scene.isFixed(edges[e].second)) || !sweptParticleEdgeMayCollide(scene, oldpos, x, i, e))
+                    continue;
+                const Vector2s x2 = oldpos.segment<2>(2*edges[e].first);
+                const Vector2s x3 = oldpos.segment<2>(2*edges[e].second);
+                double alpha = (x1-x2).dot(x3-x2)/(x3-x2).squaredNorm();
+                alpha = std::min(1.0, std::max(0.0, alpha));
+                Vector2s n = x2 + alpha*(x3-x2) - x1;
+                const double len = n.norm();
+                if(len < 1e-10)
+                    continue;
+                const Vector2s nhat = n/len;
+                const Vector2s v1 = (x.segment<2>(2*i) - x1)/dt;
+                const Vector2s v2 = (x.segment<2>(2*edges[e].first) - x2)/dt;
+                const Vector2s v3 = (x.segment<2>(2*edges[e].second) - x3)/dt;
+                const Vector2s vedge = v2 + alpha*(v3-v2);
+                const double I = speculativeImpulse(len - scene.getRadius(i) - edgeradii[e], (vedge-v1).dot(nhat), dt, time);
+                if(I == 0.0)
+                    continue;
+                PROFILE_COUNT(phasetiming::CONTACTS, 1);
+                addParticleEdgeImpulse(i, e, n, time);
+                applyParticleEdgeImpulse(scene, i, e, nhat, alpha, I, dt, x, v);
+                responded = true;
+            }
+            
+            for(int p=0; p<scene.getNumHalfplanes(); p++)
+            {
+                PROFILE_COUNT(phasetiming::BROAD_PHASE_CANDIDATES, 1);
+                if(scene.isFixed(i) || !sweptParticleHalfplaneMayCollide(scene, oldpos, x, i, p))
+                    continue;
+                // From the particle into the half-plane, whose normal points
+                // out of it.
+                const Vector2s np = scene.getHalfplane(p).second;
+                const Vector2s n = (scene.getHalfplane(p).first - x1).dot(np)/np.squaredNorm()*np;
+                const Vector2s nhat = -np/np.norm();
+                const double distance = (x1 - scene.getHalfplane(p).first).dot(np)/np.norm();
+                const Vector2s v1 = (x.segment<2>(2*i) - x1)/dt;
+                // The half-plane is still, so the relative velocity is the
+                // particle's, reversed.
+                const double I = speculativeImpulse(distance - scene.getRadius(i), -v1.dot(nhat), dt, time);
+                if(I == 0.0)
+                    continue;
+                PROFILE_COUNT(phasetiming::CONTACTS, 1);
+                addParticleHalfplaneImpulse(i, p, n, time);
+                applyParticleHalfplaneImpulse(i, nhat, -I, dt, x, v);
+                responded = true;
+            }
+        }
+        if(!responded)
+            break;
+    }
+}
+
+std::string ContinuousTimeCollisionHandler::getName() const
+{
+    return "Continuous-Time Collision Handling";
+}
 
 // BEGIN STUDENT CODE //
 
@@ -28,13 +388,16 @@
 //   during the motion.
 bool ContinuousTimeCollisionHandler::detectParticleParticle(const TwoDScene &scene, const VectorXs &qs, const VectorXs &qe, int idx1, int idx2, Vector2s &n, double &time)
 {
-    VectorXs dx = qe-qs;
+    // Cheap rejection before any polynomial is built. This is called for
+    // every pair, so nothing here may touch more than the two particles.
+    if( !sweptParticlesMayCollide(scene, qs, qe, idx1, idx2) )
+        return false;
     
-    VectorXs x1 = qs.segment<2>(2*idx1);
-    VectorXs x2 = qs.segment<2>(2*idx2);
+    Vector2s x1 = qs.segment<2>(2*idx1);
+    Vector2s x2 = qs.segment<2>(2*idx2);
     
-    VectorXs dx1 = dx.segment<2>(2*idx1);
-    VectorXs dx2 = dx.segment<2>(2*idx2);
+    Vector2s dx1 = qe.segment<2>(2*idx1) - qs.segment<2>(2*idx1);
+    Vector2s dx2 = qe.segment<2>(2*idx2) - qs.segment<2>(2*idx2);
     
     double r1 = scene.getRadius(idx1);
     double r2 = scene.getRadius(idx2);
@@ -103,15 +466,183 @@ bool ContinuousTimeCollisionHandler::detectParticleParticle(const TwoDScene &sce
 // objects were overlapping and approaching at any point during that motion.
 bool ContinuousTimeCollisionHandler::detectParticleEdge(const TwoDScene &scene, const VectorXs &qs, const VectorXs &qe, int vidx, int eidx, Vector2s &n, double &time)
 {
-    VectorXs dx = qe - qs;
+    bool hit;
+    if(decideParticleEdge(scene, qs, qe, vidx, eidx, hit, n, time))
+        return hit;
     
-    VectorXs x1 = qs.segment<2>(2*vidx);
-    VectorXs x2 = qs.segment<2>(2*scene.getEdge(eidx).first);
-    VectorXs x3 = qs.segment<2>(2*scene.getEdge(eidx).second);
+    const VertexTrajectory v1 = vertexTrajectory(qs, qe, vidx);
+    const VertexTrajectory v2 = vertexTrajectory(qs, qe, scene.getEdge(eidx).first);
+    const VertexTrajectory v3 = vertexTrajectory(qs, qe, scene.getEdge(eidx).second);
+    return solveParticleEdge(scene, vidx, eidx, v1, v2, v3, edgeTrajectory(v2, v3), n, time);
+}
+
+// The same test, reading the particles' motion and the edge's terms from
+// trajectories rather than recomputing them from qs and qe.
+bool ContinuousTimeCollisionHandler::detectParticleEdge(const TwoDScene &scene, const VectorXs &qs, const VectorXs &qe, const SweptTrajectories &trajectories, int vidx, int eidx, Vector2s &n, double &time)
+{
+    bool hit;
+    if(decideParticleEdge(scene, qs, qe, vidx, eidx, hit, n, time))
+        return hit;
     
-    VectorXs dx1 = dx.segment<2>(2*vidx);
-    VectorXs dx2 = dx.segment<2>(2*scene.getEdge(eidx).first);
-    VectorXs dx3 = dx.segment<2>(2*scene.getEdge(eidx).second);
+    return solveParticleEdge(scene, vidx, eidx, trajectories.vertex(vidx), trajectories.vertex(scene.getEdge(eidx).first), trajectories.vertex(scene.getEdge(eidx).second), trajectories.edge(eidx), n, time);
+}
+
+// Whether the particle and edge can be told apart, or found in contact,
+// without the polynomials; if so, sets hit and, on a hit, n and time.
+bool ContinuousTimeCollisionHandler::decideParticleEdge(const TwoDScene &scene, const VectorXs &qs, const VectorXs &qe, int vidx, int eidx, bool &hit, Vector2s &n, double &time)
+{
+    hit = false;
+    if( !sweptParticleEdgeMayCollide(scene, qs, qe, vidx, eidx) )
+        return true;
+    
+#ifdef CCD_ADVANCEMENT
+    // Built with CCD_METHOD=advancement: skip the quintic unless conservative
+    // advancement runs out of iterations.
+    if( advanceParticleEdge(scene, qs, qe, vidx, eidx, CCD_ADVANCEMENT_TOLERANCE, hit, n, time) )
+        return true;
+#endif
+    return false;
+}
+
+namespace
+{
+
+template<typename T>
+T dot(const T x[2], const T y[2])
+{
+    return x[0]*y[0] + x[1]*y[1];
+}
+
+// The coefficients of the particle-edge velocity quintic, highest degree
+// first, from the particle's position x1 and displacement dx1, the edge's
+// first endpoint's x2 and dx2, the edge vector x3 - x2 and its change dx3 -
+// dx2, and the edge's dot products a = (x3-x2).(x3-x2), b = (x3-x2).(dx3-dx2)
+// and c = (dx3-dx2).(dx3-dx2). T is double, or a type that bounds or reduces
+// the rounding of the same arithmetic.
+template<typename T>
+void velocityQuintic(const T x1[2], const T dx1[2], const T x2[2], const T dx2[2], const T x32[2], const T dx32[2], const T &a, const T &b, const T &c, T coeffs[6])
+{
+    T x12[2], x21[2], dx12[2], dx21[2];
+    for(int k = 0; k < 2; k++)
+    {
+        x12[k] = x1[k] - x2[k];
+        x21[k] = x2[k] - x1[k];
+        dx12[k] = dx1[k] - dx2[k];
+        dx21[k] = dx2[k] - dx1[k];
+    }
+    
+    T d = dot(dx21, dx21);
+    T e = dot(dx21, x21);
+    T f = dot(x12, x32);
+    T g = dot(x12, dx32) + dot(dx12, x32);
+    T h = dot(dx12, dx32);
+    T i = dot(dx32, x21) + dot(dx21, x32);
+    T j = dot(dx32, dx21);
+    T k = a*f;
+    T l = a*g+2*b*f;
+    T m = a*h+2*b*g+c*f;
+    T n = c*g+2*b*h;
+    T o = c*h;
+    T p = b;
+    T q = c;
+    
+    coeffs[0] = -h*h*q - c*c*d - 2*o*j;
+    coeffs[1] = -h*h*p - 2*g*h*q - 4*b*c*d - c*c*e - o*i - 2*n*j;
+    coeffs[2] = -2*g*h*p - 2*f*g*q - g*g*q - 2*a*c*d - 4*b*b*d - 4*b*c*e - n*i - 2*m*j;
+    coeffs[3] = -2*f*h*p - g*g*p - 2*f*g*q - 4*a*b*d - 2*a*c*e - 4*b*b*e - m*i - 2*l*j;
+    coeffs[4] = -2*f*g*p - f*f*q - a*a*d - 4*a*b*e - l*i - 2*k*j;
+    coeffs[5] = -f*f*p - a*a*e - k*i;
+}
+
+// The particle-edge velocity quintic. The motion is taken to be exactly the
+// trajectories' x + t dx.
+//
+// Built with CCD_FILTERED_PREDICATES, the coefficients are computed with
+// a bound on their rounding. Near-degenerate configurations, such as a particle resting
+// on or sliding along an edge, cancel most of the bits of terms like h, p
+// and q, and a coefficient whose sign the rounding could have flipped is
+// recomputed, with all the others, in double-double. The doubles are the
+// same as without the filter whenever it is certain of every sign.
+void particleEdgeVelocityPolynomial(const VertexTrajectory &v1, const VertexTrajectory &v2, const VertexTrajectory &v3, const EdgeTrajectory &edge, double coeffs[6])
+{
+#ifdef CCD_FILTERED_PREDICATES
+    using filtered::Filtered;
+    using filtered::DoubleDouble;
+    
+    // The edge vector and its change carry the rounding of the subtractions
+    // that made them.
+    Filtered x1[2], dx1[2], x2[2], dx2[2], x32[2], dx32[2];
+    for(int k = 0; k < 2; k++)
+    {
+        x1[k] = v1.x[k];
+        dx1[k] = v1.dx[k];
+        x2[k] = v2.x[k];
+        dx2[k] = v2.dx[k];
+        x32[k] = Filtered(edge.x[k], 1);
+        dx32[k] = Filtered(edge.dx[k], 1);
+    }
+    Filtered fast[6];
+    velocityQuintic(x1, dx1, x2, dx2, x32, dx32, dot(x32, x32), dot(x32, dx32), dot(dx32, dx32), fast);
+    
+    bool certain = true;
+    for(int k = 0; k < 6; k++)
+    {
+        coeffs[k] = fast[k].value;
+        certain = certain && filtered::signCertain(fast[k]);
+    }
+    if(certain)
+        return;
+    
+    PROFILE_COUNT(phasetiming::FILTER_FALLBACKS, 1);
+    DoubleDouble y1[2], dy1[2], y2[2], dy2[2], y32[2], dy32[2];
+    for(int k = 0; k < 2; k++)
+    {
+        y1[k] = v1.x[k];
+        dy1[k] = v1.dx[k];
+        y2[k] = v2.x[k];
+        dy2[k] = v2.dx[k];
+        y32[k] = DoubleDouble(v3.x[k]) - DoubleDouble(v2.x[k]);
+        dy32[k] = DoubleDouble(v3.dx[k]) - DoubleDouble(v2.dx[k]);
+    }
+    DoubleDouble extended[6];
+    velocityQuintic(y1, dy1, y2, dy2, y32, dy32, dot(y32, y32), dot(y32, dy32), dot(dy32, dy32), extended);
+    for(int k = 0; k < 6; k++)
+        coeffs[k] = extended[k].toDouble();
+#else
+    (void)v3;
+    double x1[2] = {v1.x[0], v1.x[1]}, dx1[2] = {v1.dx[0], v1.dx[1]};
+    double x2[2] = {v2.x[0], v2.x[1]}, dx2[2] = {v2.dx[0], v2.dx[1]};
+    double x32[2] = {edge.x[0], edge.x[1]}, dx32[2] = {edge.dx[0], edge.dx[1]};
+    velocityQuintic(x1, dx1, x2, dx2, x32, dx32, edge.xx, edge.xdx, edge.dxdx, coeffs);
+#endif
+}
+
+}
+
+// The polynomial test of detectParticleEdge, given the particle's motion v1,
+// the edge endpoints' v2 and v3, and the edge's own terms.
+bool ContinuousTimeCollisionHandler::solveParticleEdge(const TwoDScene &scene, int vidx, int eidx, const VertexTrajectory &v1, const VertexTrajectory &v2, const VertexTrajectory &v3, const EdgeTrajectory &edge, Vector2s &n, double &time)
+{
+    std::vector<Polynomial> polynomials;
+    particleEdgePolynomials(scene, vidx, eidx, v1, v2, v3, edge, polynomials);
+    
+    // Most pairs that get this far still never touch, and the quintic is
+    // only solved when no polynomial is negative throughout the step.
+    time = PolynomialIntervalSolver::findFirstIntersectionTimeInStep(polynomials);
+    
+    return concludeParticleEdge(scene, vidx, eidx, v1, v2, v3, edge, time, n);
+}
+
+// Replaces the contents of polynomials with those of the particle-edge test.
+void ContinuousTimeCollisionHandler::particleEdgePolynomials(const TwoDScene &scene, int vidx, int eidx, const VertexTrajectory &v1, const VertexTrajectory &v2, const VertexTrajectory &v3, const EdgeTrajectory &edge, std::vector<Polynomial> &polynomials)
+{
+    Vector2s x1(v1.x[0], v1.x[1]);
+    Vector2s x2(v2.x[0], v2.x[1]);
+    Vector2s x3(v3.x[0], v3.x[1]);
+    
+    Vector2s dx1(v1.dx[0], v1.dx[1]);
+    Vector2s dx2(v2.dx[0], v2.dx[1]);
+    Vector2s dx3(v3.dx[0], v3.dx[1]);
 
     double r1 = scene.getRadius(vidx);
     double r2 = scene.getEdgeRadii()[eidx];
@@ -123,47 +654,108 @@ bool ContinuousTimeCollisionHandler::detectParticleEdge(const TwoDScene &scene,
     // Your implementation here should fill the polynomials with right coefficients
 
     // Here's the quintic velocity polynomial:
-    std::vector<double> velcity_polynomial;
-    {
-        double a = (x3-x2).dot(x3-x2);
-        double b = (x3-x2).dot(dx3-dx2);
-        double c = (dx3-dx2).dot(dx3-dx2);
-        double d = (dx2-dx1).dot(dx2-dx1);
-        double e = (dx2-dx1).dot(x2-x1);
-        double f = (x1-x2).dot(x3-x2);
-        double g = (x1-x2).dot(dx3-dx2) + (dx1-dx2).dot(x3-x2);
-        double h = (dx1-dx2).dot(dx3-dx2);
-        double i = (dx3-dx2).dot(x2-x1) + (dx2-dx1).dot(x3-x2);
-        double j = (dx3-dx2).dot(dx2-dx1);
-        double k = a*f;
-        double l = a*g+2*b*f;
-        double m = a*h+2*b*g+c*f;
-        double n = c*g+2*b*h;
-        double o = c*h;
-        double p = (dx3-dx2).dot(x3-x2);
-        double q = (dx3-dx2).dot(dx3-dx2);
-        
-        velcity_polynomial.push_back( -h*h*q - c*c*d - 2*o*j );
-        velcity_polynomial.push_back( -h*h*p - 2*g*h*q - 4*b*c*d - c*c*e - o*i - 2*n*j );
-        velcity_polynomial.push_back( -2*g*h*p - 2*f*g*q - g*g*q - 2*a*c*d - 4*b*b*d - 4*b*c*e - n*i - 2*m*j );
-        velcity_polynomial.push_back( -2*f*h*p - g*g*p - 2*f*g*q - 4*a*b*d - 2*a*c*e - 4*b*b*e - m*i - 2*l*j );
-        velcity_polynomial.push_back( -2*f*g*p - f*f*q - a*a*d - 4*a*b*e - l*i - 2*k*j );
-        velcity_polynomial.push_back( -f*f*p - a*a*e - k*i );
-    }
+    std::vector<double> velcity_polynomial(6);
+    particleEdgeVelocityPolynomial(v1, v2, v3, edge, &velcity_polynomial[0]);
 
     // Do not change the order of the polynomials here, or your program will fail the oracle
-    std::vector<Polynomial> polynomials;
+    polynomials.clear();
     polynomials.push_back(Polynomial(position_polynomial));
     polynomials.push_back(Polynomial(alpha_greater_than_zero_polynomial));
     polynomials.push_back(Polynomial(alpha_less_than_one_polynomial));
     polynomials.push_back(Polynomial(velcity_polynomial));
-    
-    time = PolynomialIntervalSolver::findFirstIntersectionTime(polynomials);
-    
+}
+
+// Given the first time the particle-edge polynomials are all satisfied, or
+// infinity, decides whether the particle and edge collide, and if so sets n.
+bool ContinuousTimeCollisionHandler::concludeParticleEdge(const TwoDScene &scene, int vidx, int eidx, const VertexTrajectory &v1, const VertexTrajectory &v2, const VertexTrajectory &v3, const EdgeTrajectory &edge, double time, Vector2s &n)
+{
     // Your implementation here should compute n, and examine time to decide the return value
     return false;
 }
 
+namespace
+{
+
+// Asks for the cache lines of an edge's terms and of its endpoints' motion.
+inline void prefetchEdge(const TwoDScene &scene, const SweptTrajectories &trajectories, int eidx)
+{
+#if defined(__GNUC__)
+    __builtin_prefetch(&trajectories.edge(eidx));
+    __builtin_prefetch(&trajectories.vertex(scene.getEdge(eidx).first));
+    __builtin_prefetch(&trajectories.vertex(scene.getEdge(eidx).second));
+#endif
+}
+
+}
+
+// Each tile is one edge's candidates. The edge's terms and its endpoints'
+// motion are copied out once per tile, and the next tile's asked for before
+// this one's particles are tested. The candidates the swept boxes do not
+// settle have their polynomials built and then solved in one batch by
+// findFirstIntersectionTimesInStep, whose roots of the quartics and quintics
+// can differ from rpoly's in the last bits. Each candidate's result, and the
+// polynomials its solve logged, are kept in tiles for gather.
+void ContinuousTimeCollisionHandler::detectParticleEdgeTiles(const TwoDScene &scene, const VectorXs &qs, const VectorXs &qe, const SweptTrajectories &trajectories, ParticleEdgeTiles &tiles)
+{
+    tiles.schedule(scene.getNumEdges());
+    PolynomialSolverContext &context = tiles.context();
+    context.setLog(PolynomialIntervalSolver::currentContext().getLog() != NULL ? &tiles.log() : NULL);
+    std::vector<std::vector<Polynomial> > &calls = tiles.calls();
+    std::vector<double> &times = tiles.times();
+    int solved[ParticleEdgeTiles::TILE_SIZE];
+    
+    if(tiles.numTiles() > 0)
+        prefetchEdge(scene, trajectories, tiles.tileEdge(0));
+    for(int t=0; t<tiles.numTiles(); t++)
+    {
+        const int eidx = tiles.tileEdge(t);
+        if(t+1 < tiles.numTiles())
+            prefetchEdge(scene, trajectories, tiles.tileEdge(t+1));
+        const EdgeTrajectory edge = trajectories.edge(eidx);
+        const VertexTrajectory v2 = trajectories.vertex(scene.getEdge(eidx).first);
+        const VertexTrajectory v3 = trajectories.vertex(scene.getEdge(eidx).second);
+        
+        int nsolved = 0;
+        calls.resize(tiles.tileEnd(t) - tiles.tileBegin(t));
+        for(int k=tiles.tileBegin(t); k<tiles.tileEnd(t); k++)
+        {
+            const int c = tiles.candidate(k);
+            const int vidx = tiles.particle(c);
+#ifdef CCD_ADVANCEMENT
+            // The candidates passed the swept boxes; see decideParticleEdge.
+            bool hit;
+            Vector2s n;
+            double time;
+            if(advanceParticleEdge(scene, qs, qe, vidx, eidx, CCD_ADVANCEMENT_TOLERANCE, hit, n, time))
+            {
+                tiles.setResult(c, hit, n, time, 0, 0);
+                continue;
+            }
+#endif
+            particleEdgePolynomials(scene, vidx, eidx, trajectories.vertex(vidx), v2, v3, edge, calls[nsolved]);
+            solved[nsolved++] = c;
+        }
+        
+        calls.resize(nsolved);
+        times.resize(nsolved);
+        const int logbegin = (int)tiles.log().size();
+        if(nsolved > 0)
+            PolynomialIntervalSolver::findFirstIntersectionTimesInStep(calls, &times[0], context);
+        
+        int logged = logbegin;
+        for(int q=0; q<nsolved; q++)
+        {
+            const int c = solved[q];
+            const int vidx = tiles.particle(c);
+            Vector2s n = Vector2s::Zero();
+            const bool hit = concludeParticleEdge(scene, vidx, eidx, trajectories.vertex(vidx), v2, v3, edge, times[q], n);
+            const int logend = context.getLog() != NULL ? logged + (int)calls[q].size() : logged;
+            tiles.setResult(c, hit, n, times[q], logged, logend);
+            logged = logend;
+        }
+    }
+}
+
 // Given start positions (oldpos) and end positions (scene.getX) of a
 // particle and a half-plane, and assuming the particle endpoints moved in 
 // a straight line between the two positions, determines whether the two 
@@ -188,15 +780,29 @@ bool ContinuousTimeCollisionHandler::detectParticleEdge(const TwoDScene &scene,
 // particle and a half-plane, and assuming the particle endpoints moved in 
 // a straight line between the two positions, determines whether the two 
 // objects were overlapping and approaching at any point during that motion.
+//
+// Built with CCD_CLOSED_FORM_HALFPLANES and while no polynomials are logged,
+// the time is found in closed form instead; see HalfplaneSweep.
 bool ContinuousTimeCollisionHandler::detectParticleHalfplane(const TwoDScene &scene, const VectorXs &qs, const VectorXs &qe, int vidx, int pidx, Vector2s &n, double &time)
 {
-    VectorXs dx = qe - qs;
+    if( !sweptParticleHalfplaneMayCollide(scene, qs, qe, vidx, pidx) )
+        return false;
+    
+    if( closedFormHalfplanes() )
+    {
+        Vector2s nhat = scene.getHalfplane(pidx).second.segment<2>(0);
+        nhat.normalize();
+        const double offset = nhat.dot(scene.getHalfplane(pidx).first.segment<2>(0));
+        const double ds = nhat.x()*qs[2*vidx] + nhat.y()*qs[2*vidx+1] - offset;
+        const double de = nhat.x()*qe[2*vidx] + nhat.y()*qe[2*vidx+1] - offset;
+        return halfplaneTimeOfImpact(ds, de, scene.getRadius(vidx), nhat, n, time);
+    }
     
-    VectorXs x1 = qs.segment<2>(2*vidx);
-    VectorXs dx1 = dx.segment<2>(2*vidx);
+    Vector2s x1 = qs.segment<2>(2*vidx);
+    Vector2s dx1 = qe.segment<2>(2*vidx) - qs.segment<2>(2*vidx);
     
-    VectorXs xp = scene.getHalfplane(pidx).first;
-    VectorXs np = scene.getHalfplane(pidx).second;
+    Vector2s xp = scene.getHalfplane(pidx).first;
+    Vector2s np = scene.getHalfplane(pidx).second;
     
     double r = scene.getRadius(vidx);
  
@@ -217,4 +823,67 @@ bool ContinuousTimeCollisionHandler::detectParticleHalfplane(const TwoDScene &sc
     return false;
 }
 
+// The responses below only read the velocities of the two or three particles
+// they touch, so each computes those from its own segments of qs and qe
+// rather than (qe-qs)/dt over the whole scene. They are the general
+// instances of ImpulseKernels, correct for any scene; sweeps that respond to
+// many collisions at once choose the instance for their scene instead.
 
+typedef ImpulseKernels<GENERAL_RESTITUTION, true> GeneralKernels;
+
+// Applies the inelastic impulse for a particle-particle collision detected by
+// detectParticleParticle, splitting it between the particles by mass, to both
+// the end-of-timestep velocities qdotm and positions qm.
+void ContinuousTimeCollisionHandler::respondParticleParticle(const TwoDScene &scene, const VectorXs &qs, const VectorXs &qe, int idx1, int idx2, const Vector2s &n, double time, double dt, VectorXs &qm, VectorXs &qdotm)
+{
+    GeneralKernels::respondParticleParticle(scene, qs, qe, idx1, idx2, n, dt, getCOR(), qm, qdotm);
+}
+
+// The relative normal velocity the particle-particle response removes, scaled
+// by the coefficient of restitution.
+double ContinuousTimeCollisionHandler::particleParticleImpulse(const TwoDScene &scene, const VectorXs &qs, const VectorXs &qe, int idx1, int idx2, const Vector2s &nhat, double dt)
+{
+    return GeneralKernels::particleParticleImpulse(scene, qs, qe, idx1, idx2, nhat, dt, getCOR());
+}
+
+void ContinuousTimeCollisionHandler::applyParticleParticleImpulse(const TwoDScene &scene, int idx1, int idx2, const Vector2s &nhat, double I, double dt, VectorXs &qm, VectorXs &qdotm)
+{
+    GeneralKernels::applyParticleParticleImpulse(scene, idx1, idx2, nhat, I, dt, qm, qdotm);
+}
+
+// As respondParticleParticle, with the edge side of the impulse shared between
+// its endpoints by the barycentric coordinate of the contact point at the
+// time of collision.
+void ContinuousTimeCollisionHandler::respondParticleEdge(const TwoDScene &scene, const VectorXs &qs, const VectorXs &qe, int vidx, int eidx, const Vector2s &n, double time, double dt, VectorXs &qm, VectorXs &qdotm)
+{
+    GeneralKernels::respondParticleEdge(scene, qs, qe, vidx, eidx, n, time, dt, getCOR(), qm, qdotm);
+}
+
+// The relative normal velocity the particle-edge response removes, and in
+// alpha the barycentric coordinate along the edge of the contact point.
+double ContinuousTimeCollisionHandler::particleEdgeImpulse(const TwoDScene &scene, const VectorXs &qs, const VectorXs &qe, int vidx, int eidx, const Vector2s &nhat, double time, double dt, double &alpha)
+{
+    return GeneralKernels::particleEdgeImpulse(scene, qs, qe, vidx, eidx, nhat, time, dt, getCOR(), alpha);
+}
+
+void ContinuousTimeCollisionHandler::applyParticleEdgeImpulse(const TwoDScene &scene, int vidx, int eidx, const Vector2s &nhat, double alpha, double I, double dt, VectorXs &qm, VectorXs &qdotm)
+{
+    GeneralKernels::applyParticleEdgeImpulse(scene, vidx, eidx, nhat, alpha, I, dt, qm, qdotm);
+}
+
+// Reflects the normal velocity of a particle that hit a half-plane, which is
+// immovable.
+void ContinuousTimeCollisionHandler::respondParticleHalfplane(const TwoDScene &scene, const VectorXs &qs, const VectorXs &qe, int vidx, int pidx, const Vector2s &n, double time, double dt, VectorXs &qm, VectorXs &qdotm)
+{
+    GeneralKernels::respondParticleHalfplane(qs, qe, vidx, n, dt, getCOR(), qm, qdotm);
+}
+
+double ContinuousTimeCollisionHandler::particleHalfplaneImpulse(const VectorXs &qs, const VectorXs &qe, int vidx, const Vector2s &nhat, double dt)
+{
+    return GeneralKernels::particleHalfplaneImpulse(qs, qe, vidx, nhat, dt, getCOR());
+}
+
+void ContinuousTimeCollisionHandler::applyParticleHalfplaneImpulse(int vidx, const Vector2s &nhat, double I, double dt, VectorXs &qm, VectorXs &qdotm)
+{
+    GeneralKernels::applyParticleHalfplaneImpulse(vidx, nhat, I, dt, qm, qdotm);
+}
@@ -2,6 +2,9 @@
 #define CONTINUOUS_TIME_COLLISION_HANDLER_H
 
 #include "CollisionHandler.h"
+#include "SweptTrajectories.h"
+#include "CollisionEvents.h"
+#include "ParticleEdgeTiles.h"
 #include <vector>
 #include <iostream>
 
@@ -19,12 +22,45 @@ public:
     
     bool detectParticleParticle     (const TwoDScene &scene, const VectorXs &qs, const VectorXs &qe, int idx1, int idx2, Vector2s &n, double &time);
     bool detectParticleEdge         (const TwoDScene &scene, const VectorXs &qs, const VectorXs &qe, int vidx, int eidx, Vector2s &n, double &time);
+    // The same test from precomputed trajectories of qs to qe, for sweeps of
+    // many particles against the same edges.
+    bool detectParticleEdge         (const TwoDScene &scene, const VectorXs &qs, const VectorXs &qe, const SweptTrajectories &trajectories, int vidx, int eidx, Vector2s &n, double &time);
     bool detectParticleHalfplane    (const TwoDScene &scene, const VectorXs &qs, const VectorXs &qe, int vidx, int pidx, Vector2s &n, double &time);
+    // detectParticleEdge for every candidate of tiles, a tile at a time, with
+    // each tile's polynomials solved together.
+    void detectParticleEdgeTiles    (const TwoDScene &scene, const VectorXs &qs, const VectorXs &qe, const SweptTrajectories &trajectories, ParticleEdgeTiles &tiles);
     
     void respondParticleParticle    (const TwoDScene &scene, const VectorXs &qs, const VectorXs &qe, int idx1, int idx2, const Vector2s &n, double time, double dt, VectorXs &qm, VectorXs &qdotm);
     void respondParticleEdge        (const TwoDScene &scene, const VectorXs &qs, const VectorXs &qe, int vidx, int eidx, const Vector2s &n, double time, double dt, VectorXs &qm, VectorXs &qdotm);
     void respondParticleHalfplane   (const TwoDScene &scene, const VectorXs &qs, const VectorXs &qe, int vidx, int pidx, const Vector2s &n, double time, double dt, VectorXs &qm, VectorXs &qdotm);
     
+    // The responses split into the size of their impulse, computed from qs
+    // and qe along the unit normal nhat, and its application to qm and
+    // qdotm, so that an impulse can be reapplied in a later step.
+    double particleParticleImpulse  (const TwoDScene &scene, const VectorXs &qs, const VectorXs &qe, int idx1, int idx2, const Vector2s &nhat, double dt);
+    double particleEdgeImpulse      (const TwoDScene &scene, const VectorXs &qs, const VectorXs &qe, int vidx, int eidx, const Vector2s &nhat, double time, double dt, double &alpha);
+    double particleHalfplaneImpulse (const VectorXs &qs, const VectorXs &qe, int vidx, const Vector2s &nhat, double dt);
+    
+    void applyParticleParticleImpulse   (const TwoDScene &scene, int idx1, int idx2, const Vector2s &nhat, double I, double dt, VectorXs &qm, VectorXs &qdotm);
+    void applyParticleEdgeImpulse       (const TwoDScene &scene, int vidx, int eidx, const Vector2s &nhat, double alpha, double I, double dt, VectorXs &qm, VectorXs &qdotm);
+    void applyParticleHalfplaneImpulse  (int vidx, const Vector2s &nhat, double I, double dt, VectorXs &qm, VectorXs &qdotm);
+    
+private:
+    
+    // With CCD_EVENT_ORDER, handleCollisions responds to the step's
+    // collisions one at a time in order of their time of impact.
+    void handleCollisionsInTimeOrder(TwoDScene &scene, const VectorXs &oldpos, scalar dt);
+    // With SPECULATIVE_CONTACTS, it limits each approaching pair's closing
+    // speed by the gap between them at the start of the step instead.
+    void handleSpeculativeContacts  (TwoDScene &scene, const VectorXs &oldpos, scalar dt);
+    void scheduleCollisions         (const TwoDScene &scene, const VectorXs &qs, const VectorXs &qe, const SweptTrajectories &trajectories, int idx, bool moved, double after, CollisionEventQueue &events);
+    
+    bool decideParticleEdge         (const TwoDScene &scene, const VectorXs &qs, const VectorXs &qe, int vidx, int eidx, bool &hit, Vector2s &n, double &time);
+    bool solveParticleEdge          (const TwoDScene &scene, int vidx, int eidx, const VertexTrajectory &v1, const VertexTrajectory &v2, const VertexTrajectory &v3, const EdgeTrajectory &edge, Vector2s &n, double &time);
+    // The two halves of solveParticleEdge, either side of the solve.
+    void particleEdgePolynomials    (const TwoDScene &scene, int vidx, int eidx, const VertexTrajectory &v1, const VertexTrajectory &v2, const VertexTrajectory &v3, const EdgeTrajectory &edge, std::vector<Polynomial> &polynomials);
+    bool concludeParticleEdge       (const TwoDScene &scene, int vidx, int eidx, const VertexTrajectory &v1, const VertexTrajectory &v2, const VertexTrajectory &v3, const EdgeTrajectory &edge, double time, Vector2s &n);
+    
 };
 
 #endif
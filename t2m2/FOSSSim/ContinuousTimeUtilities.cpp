@@ -0,0 +1,773 @@
+#include "ContinuousTimeUtilities.h"
+#include "PhaseTiming.h"
+#include "MemoryAccounting.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+std::vector<Polynomial> PolynomialIntervalSolver::s_polynomials;
+
+namespace
+{
+
+// Roots whose imaginary part is below this are treated as real, matching the
+// filter applied to rpoly's output.
+const double IMAGINARY_TOLERANCE = 1e-8;
+
+// The degree of the coefficients once the leading ones FixedPolynomial drops
+// are dropped, -1 if none is left.
+int leadingDegree(const std::vector<double> &coeffs)
+{
+    int first = 0;
+    while(first < (int)coeffs.size() && fabs(coeffs[first]) < POLYNOMIAL_ZERO_COEFFICIENT)
+        first++;
+    return (int)coeffs.size() - first - 1;
+}
+
+double evaluateCubic(const double *c, double t, double &deriv)
+{
+    deriv = (3.0*c[0]*t + 2.0*c[1])*t + c[2];
+    return ((c[0]*t + c[1])*t + c[2])*t + c[3];
+}
+
+// The upper bound on the interval count used by findFirstIntersectionTime.
+// Every finite endpoint of a consolidated intersection is a root of one of the
+// polynomials, so polynomials of total degree up to 2*(SOLVER_INTERVALS-1)
+// always fit.
+const int SOLVER_INTERVALS = 16;
+
+typedef FixedPolynomial<PolynomialIntervalSolver::MAX_DEGREE> SolverPolynomial;
+typedef FixedIntervals<SOLVER_INTERVALS> SolverIntervals;
+
+// Context behind the static interface. The base library's ParticleSimulation
+// serializes s_polynomials with the scene and checks it against reference
+// output, so the log stays on unless built with RECORD_CCD_POLYNOMIALS=OFF.
+PolynomialSolverContext createDefaultContext()
+{
+    PolynomialSolverContext context;
+#ifndef NO_CCD_POLYNOMIAL_LOG
+    context.setLog(&PolynomialIntervalSolver::getPolynomials());
+#endif
+    return context;
+}
+
+PolynomialSolverContext g_default_context = createDefaultContext();
+
+// The context a ScopedSolverContext put in place on this thread, if any.
+thread_local PolynomialSolverContext *t_context = NULL;
+
+size_t polynomialBytes()
+{
+    const std::vector<Polynomial> &polys = PolynomialIntervalSolver::getPolynomials();
+    size_t bytes = sizeof(Polynomial)*polys.capacity();
+    for(std::vector<Polynomial>::size_type i = 0; i < polys.size(); i++)
+        bytes += sizeof(double)*polys[i].getCoeffs().capacity();
+    return bytes;
+}
+
+const bool g_accounted = memoryaccounting::addSource(memoryaccounting::CCD_POLYNOMIALS, polynomialBytes);
+
+// Closed-form real roots of c[0] t + c[1]. c[0] is nonzero.
+int solveLinear(const double *c, double *roots)
+{
+    roots[0] = -c[1]/c[0];
+    return 1;
+}
+
+// Real roots of c[0] t^2 + c[1] t + c[2], c[0] nonzero. The smaller-magnitude
+// root is recovered from the product of the roots so that it does not suffer
+// cancellation when b^2 >> 4ac.
+int solveQuadratic(const double *c, double *roots)
+{
+    double a = c[0], b = c[1], k = c[2];
+    double disc = b*b - 4.0*a*k;
+    if(disc < 0.0)
+    {
+        // A nearly double root; keep it as rpoly's tolerance would.
+        if(sqrt(-disc) < 2.0*fabs(a)*IMAGINARY_TOLERANCE)
+        {
+            roots[0] = -0.5*b/a;
+            return 1;
+        }
+        return 0;
+    }
+    double q = -0.5*(b + (b < 0.0 ? -sqrt(disc) : sqrt(disc)));
+    if(q == 0.0)
+    {
+        roots[0] = 0.0;
+        return 1;
+    }
+    roots[0] = q/a;
+    roots[1] = k/q;
+    return 2;
+}
+
+// Real roots of c[0] t^3 + c[1] t^2 + c[2] t + c[3], c[0] nonzero, by the
+// trigonometric form when all three roots are real and Cardano's formula
+// otherwise. Each root is then polished by Newton's method on the original
+// coefficients.
+int solveCubic(const double *c, double *r)
+{
+    double a = c[1]/c[0], b = c[2]/c[0], k = c[3]/c[0];
+    double Q = (a*a - 3.0*b)/9.0;
+    double R = (2.0*a*a*a - 9.0*a*b + 27.0*k)/54.0;
+    double Q3 = Q*Q*Q;
+    int n;
+    if(R*R < Q3)
+    {
+        double theta = acos(std::max(-1.0, std::min(1.0, R/sqrt(Q3))));
+        double s = -2.0*sqrt(Q);
+        r[0] = s*cos(theta/3.0) - a/3.0;
+        r[1] = s*cos((theta + 2.0*M_PI)/3.0) - a/3.0;
+        r[2] = s*cos((theta - 2.0*M_PI)/3.0) - a/3.0;
+        n = 3;
+    }
+    else
+    {
+        double A = -(R < 0.0 ? -1.0 : 1.0)*cbrt(fabs(R) + sqrt(R*R - Q3));
+        double B = A == 0.0 ? 0.0 : Q/A;
+        r[0] = (A + B) - a/3.0;
+        n = 1;
+        // The remaining pair is -(A+B)/2 - a/3 +- i sqrt(3)/2 (A-B).
+        if(0.5*sqrt(3.0)*fabs(A - B) < IMAGINARY_TOLERANCE)
+            r[n++] = -0.5*(A + B) - a/3.0;
+    }
+
+    for(int i = 0; i < n; i++)
+    {
+        for(int itr = 0; itr < 2; itr++)
+        {
+            double deriv;
+            double val = evaluateCubic(c, r[i], deriv);
+            if(deriv == 0.0)
+                break;
+            double polished = r[i] - val/deriv;
+            double dummy;
+            if(fabs(evaluateCubic(c, polished, dummy)) >= fabs(val))
+                break;
+            r[i] = polished;
+        }
+    }
+    return n;
+}
+
+// The real roots of a polynomial of degree 1 to 3, in increasing order.
+int closedFormRoots(const double *coeffs, int degree, double *roots)
+{
+    int nroots = 0;
+    switch(degree)
+    {
+        case 1:
+            nroots = solveLinear(coeffs, roots);
+            break;
+        case 2:
+            nroots = solveQuadratic(coeffs, roots);
+            break;
+        case 3:
+            nroots = solveCubic(coeffs, roots);
+            break;
+    }
+    std::sort(roots, roots + nroots);
+    return nroots;
+}
+
+// Sets intervals to where poly is positive in [lo, hi], given its roots in
+// increasing order. Between consecutive roots, and the ends of the span, the
+// sign of poly is its sign at the midpoint.
+void spanIntervals(const SolverPolynomial &poly, const double *roots, int nroots, double lo, double hi, SolverIntervals &intervals)
+{
+    intervals.clear();
+    if(poly.degree() < 0)
+        return;
+    if(hi <= lo)
+    {
+        if(poly.positiveAt(lo))
+            intervals.add(lo, hi);
+        return;
+    }
+    double start = lo;
+    for(int r = 0; r <= nroots; r++)
+    {
+        const double end = r < nroots ? std::min(std::max(roots[r], lo), hi) : hi;
+        if(end > start && poly.positiveAt(0.5*(start + end)))
+            intervals.add(start, end);
+        start = std::max(start, end);
+    }
+}
+
+#ifdef CCD_STAGED_INTERVALS
+// The most polynomials a staged call has; the particle-edge test's are four.
+const int STAGED_POLYS = 8;
+
+// A call's polynomials in the order they are staged in: by increasing
+// degree, and otherwise as given.
+struct StagedOrder
+{
+    int order[STAGED_POLYS];
+    int size;
+    // How many of them are of degree at most 3.
+    int cheap;
+    
+    // False for a call not to stage: empty, or with too many polynomials,
+    // one above maxdegree, or more roots than the intervals hold.
+    bool assign(const std::vector<Polynomial> &polys, int maxdegree)
+    {
+        size = (int)polys.size();
+        if(size == 0 || size > STAGED_POLYS)
+            return false;
+        int degrees[STAGED_POLYS];
+        int total_degree = 0;
+        cheap = 0;
+        for(int i = 0; i < size; i++)
+        {
+            degrees[i] = leadingDegree(polys[i].getCoeffs());
+            if(degrees[i] > maxdegree)
+                return false;
+            total_degree += std::max(degrees[i], 0);
+            cheap += degrees[i] <= 3;
+            order[i] = i;
+            for(int j = i; j > 0 && degrees[order[j-1]] > degrees[i]; j--)
+                std::swap(order[j-1], order[j]);
+        }
+        return total_degree <= 2*(SOLVER_INTERVALS-1);
+    }
+};
+
+// Intersects inter, which starts as [0, 1], with where each of the cheap
+// polynomials of order is positive, in turn, until none of [0, 1] is left.
+void solveCheapest(const std::vector<Polynomial> &polys, const StagedOrder &order, SolverIntervals &inter)
+{
+    inter.clear();
+    inter.add(0.0, 1.0);
+    SolverIntervals intervals;
+    for(int i = 0; i < order.cheap && inter.size() > 0; i++)
+    {
+        const SolverPolynomial poly(polys[order.order[i]]);
+        double roots[3];
+        int nroots = 0;
+        if(poly.degree() > 0)
+        {
+            PROFILE_COUNT(phasetiming::Counter(phasetiming::ROOT_SOLVES_DEGREE_1 + poly.degree() - 1), 1);
+            nroots = closedFormRoots(poly.getCoeffs(), poly.degree(), roots);
+        }
+        spanIntervals(poly, roots, nroots, 0.0, 1.0, intervals);
+        inter = intersect(inter, intervals);
+    }
+}
+
+// poly(lo + (hi - lo) s) as a polynomial in s, scaled so that its largest
+// coefficient is 1 in magnitude: the roots and signs on [0, 1] are those of
+// poly on [lo, hi], and the leading coefficients FixedPolynomial drops are
+// small against the others rather than against 1.
+SolverPolynomial onSpan(const SolverPolynomial &poly, double lo, double hi)
+{
+    const int n = poly.degree();
+    const double *c = poly.getCoeffs();
+    const double w = hi - lo;
+    // Horner's rule in lo + w s; a[k] is the coefficient of s^k.
+    double a[PolynomialIntervalSolver::MAX_DEGREE+1];
+    for(int i = 0; i <= n; i++)
+    {
+        a[i] = 0.0;
+        for(int k = i; k > 0; k--)
+            a[k] = lo*a[k] + w*a[k-1];
+        a[0] = lo*a[0] + c[i];
+    }
+    double scale = 0.0;
+    for(int k = 0; k <= n; k++)
+        scale = std::max(scale, fabs(a[k]));
+    double coeffs[PolynomialIntervalSolver::MAX_DEGREE+1];
+    for(int k = 0; k <= n; k++)
+        coeffs[k] = scale > 0.0 ? a[n-k]/scale : a[n-k];
+    return SolverPolynomial(coeffs, n+1);
+}
+
+// The span of the times inter holds, which is not empty.
+inline double spanStart(const SolverIntervals &inter) {return inter[0].m_s;}
+inline double spanEnd(const SolverIntervals &inter) {return inter[inter.size()-1].m_e;}
+#endif
+
+}
+
+bool overlap(const Interval &a, const Interval &b)
+{
+    return a.m_e >= b.m_s && b.m_e >= a.m_s;
+}
+
+Interval Iunion(const Interval &a, const Interval &b)
+{
+    return Interval(std::min(a.m_s, b.m_s), std::max(a.m_e, b.m_e));
+}
+
+Interval Iintersect(const Interval &a, const Interval &b)
+{
+    return Interval(std::max(a.m_s, b.m_s), std::min(a.m_e, b.m_e));
+}
+
+Intervals::Intervals(const std::vector<Interval> &intervals)
+: m_intervals(intervals.begin(), intervals.end())
+{
+    m_intervals.sort();
+    consolidateIntervals();
+}
+
+// Returns the earliest time >= t contained in one of the intervals, or
+// infinity if there is none.
+double Intervals::findNextSatTime(double t)
+{
+    for(std::list<Interval>::iterator it = m_intervals.begin(); it != m_intervals.end(); ++it)
+    {
+        if(t >= it->m_e)
+            continue;
+        return it->m_s <= t ? t : it->m_s;
+    }
+    return std::numeric_limits<double>::infinity();
+}
+
+// Merges overlapping intervals. Assumes the list is sorted by start time.
+void Intervals::consolidateIntervals()
+{
+    std::list<Interval> result;
+    std::list<Interval>::iterator it = m_intervals.begin();
+    while(it != m_intervals.end())
+    {
+        Interval cur = *it;
+        ++it;
+        while(it != m_intervals.end() && overlap(cur, *it))
+        {
+            cur = Iunion(cur, *it);
+            ++it;
+        }
+        result.push_back(cur);
+    }
+    m_intervals = result;
+}
+
+Intervals intersect(const Intervals &i1, const Intervals &i2)
+{
+    std::vector<Interval> result;
+    for(std::list<Interval>::const_iterator it1 = i1.m_intervals.begin(); it1 != i1.m_intervals.end(); ++it1)
+        for(std::list<Interval>::const_iterator it2 = i2.m_intervals.begin(); it2 != i2.m_intervals.end(); ++it2)
+            if(overlap(*it1, *it2))
+                result.push_back(Iintersect(*it1, *it2));
+    return Intervals(result);
+}
+
+std::ostream &operator<<(std::ostream &os, const Intervals &inter)
+{
+    os << "[";
+    bool first = true;
+    for(std::list<Interval>::const_iterator it = inter.m_intervals.begin(); it != inter.m_intervals.end(); ++it)
+    {
+        if(!first)
+            os << ", ";
+        first = false;
+        os << "(" << it->m_s << ", " << it->m_e << ")";
+    }
+    os << "]";
+    return os;
+}
+
+// Coefficients are given highest degree first. Leading coefficients that are
+// numerically zero are dropped so that the degree is meaningful.
+Polynomial::Polynomial(const std::vector<double> &coeffs)
+{
+    size_t first = 0;
+    while(first < coeffs.size() && fabs(coeffs[first]) < POLYNOMIAL_ZERO_COEFFICIENT)
+        first++;
+    m_coeffs.assign(coeffs.begin()+first, coeffs.end());
+}
+
+double Polynomial::evaluate(double t) const
+{
+    double result = 0;
+    int n = (int)m_coeffs.size();
+    for(int i = 0; i < n; i++)
+        result = result*t + m_coeffs[i];
+    return result;
+}
+
+PolynomialSolverContext &PolynomialIntervalSolver::currentContext()
+{
+    return t_context != NULL ? *t_context : g_default_context;
+}
+
+ScopedSolverContext::ScopedSolverContext(PolynomialSolverContext &context)
+: m_previous(t_context)
+{
+    t_context = &context;
+}
+
+ScopedSolverContext::~ScopedSolverContext()
+{
+    t_context = m_previous;
+}
+
+double PolynomialIntervalSolver::findFirstIntersectionTime(const std::vector<Polynomial> &polys)
+{
+    return findFirstIntersectionTime(polys, currentContext());
+}
+
+double PolynomialIntervalSolver::findFirstIntersectionTime(const std::vector<Polynomial> &polys, PolynomialSolverContext &context)
+{
+    PROFILE_COUNT(phasetiming::SOLVER_CALLS, 1);
+    if(context.m_log != NULL)
+        context.m_log->insert(context.m_log->end(), polys.begin(), polys.end());
+
+    if(polys.empty())
+        return std::numeric_limits<double>::infinity();
+
+    int total_degree = 0;
+    for(int i = 0; i < (int)polys.size(); i++)
+        total_degree += std::max((int)polys[i].getCoeffs().size() - 1, 0);
+
+    if(total_degree > 2*(SOLVER_INTERVALS-1))
+    {
+        Intervals inter = findPolyIntervals(polys[0], context);
+        for(int i = 1; i < (int)polys.size(); i++)
+            inter = intersect(inter, findPolyIntervals(polys[i], context));
+        return inter.findNextSatTime(0.0);
+    }
+
+    SolverIntervals inter, next;
+    findPolyIntervals(SolverPolynomial(polys[0]), inter, context);
+    for(int i = 1; i < (int)polys.size(); i++)
+    {
+        findPolyIntervals(SolverPolynomial(polys[i]), next, context);
+        inter = intersect(inter, next);
+    }
+    return inter.findNextSatTime(0.0);
+}
+
+double PolynomialIntervalSolver::findFirstIntersectionTimeInStep(const std::vector<Polynomial> &polys)
+{
+    return findFirstIntersectionTimeInStep(polys, currentContext());
+}
+
+bool PolynomialIntervalSolver::negativeInStep(const std::vector<Polynomial> &polys)
+{
+    for(int i = 0; i < (int)polys.size(); i++)
+    {
+        const std::vector<double> &coeffs = polys[i].getCoeffs();
+        if((int)coeffs.size() > MAX_DEGREE+1)
+            continue;
+        const SolverPolynomial poly(polys[i]);
+        // An empty polynomial is positive nowhere, as findPolyIntervals has it.
+        if(poly.degree() < 0 || negativeOnUnitInterval(poly))
+            return true;
+    }
+    return false;
+}
+
+// The times outside [0, 1] a culled call would have found are of no use to
+// callers of this one, so infinity stands in for them.
+double PolynomialIntervalSolver::findFirstIntersectionTimeInStep(const std::vector<Polynomial> &polys, PolynomialSolverContext &context)
+{
+    if(negativeInStep(polys))
+    {
+        PROFILE_COUNT(phasetiming::SOLVER_CALLS, 1);
+        PROFILE_COUNT(phasetiming::SOLVER_CALLS_CULLED, 1);
+        if(context.m_log != NULL)
+            context.m_log->insert(context.m_log->end(), polys.begin(), polys.end());
+        return std::numeric_limits<double>::infinity();
+    }
+#ifdef CCD_STAGED_INTERVALS
+    double time;
+    if(solveStaged(polys, time, context))
+        return time;
+#endif
+    return findFirstIntersectionTime(polys, context);
+}
+
+// Each call is culled, or has its quintics queued, in a first pass; the
+// batch is solved; and a second pass builds each queued call's intervals on
+// [0, 1] from the roots. Between consecutive roots, and the ends of the
+// step, the sign of a polynomial is its sign at the midpoint.
+void PolynomialIntervalSolver::findFirstIntersectionTimesInStep(const std::vector<std::vector<Polynomial> > &calls, double *times, PolynomialSolverContext &context)
+{
+#ifdef CCD_STAGED_INTERVALS
+    solveStaged(calls, times, context);
+#else
+    const double inf = std::numeric_limits<double>::infinity();
+    RootIsolationBatch &batch = context.m_batch;
+    batch.clear();
+    // The batch index of each queued call's first quintic, or -1 for a call
+    // already answered.
+    std::vector<int> first(calls.size(), -1);
+    
+    for(int c = 0; c < (int)calls.size(); c++)
+    {
+        const std::vector<Polynomial> &polys = calls[c];
+        int total_degree = 0;
+        bool batched = !polys.empty();
+        for(int i = 0; i < (int)polys.size(); i++)
+        {
+            const int degree = leadingDegree(polys[i].getCoeffs());
+            batched = batched && degree <= RootIsolationBatch::MAX_DEGREE;
+            total_degree += std::max(degree, 0);
+        }
+        if(!batched || total_degree > 2*(SOLVER_INTERVALS-1))
+        {
+            times[c] = findFirstIntersectionTimeInStep(polys, context);
+            continue;
+        }
+        
+        PROFILE_COUNT(phasetiming::SOLVER_CALLS, 1);
+        if(context.m_log != NULL)
+            context.m_log->insert(context.m_log->end(), polys.begin(), polys.end());
+        if(negativeInStep(polys))
+        {
+            PROFILE_COUNT(phasetiming::SOLVER_CALLS_CULLED, 1);
+            times[c] = inf;
+            continue;
+        }
+        
+        first[c] = batch.size();
+        for(int i = 0; i < (int)polys.size(); i++)
+        {
+            const SolverPolynomial poly(polys[i]);
+            if(poly.degree() > 3)
+            {
+                PROFILE_COUNT(phasetiming::Counter(phasetiming::ROOT_SOLVES_DEGREE_1 + poly.degree() - 1), 1);
+                batch.add(poly.getCoeffs(), poly.degree());
+            }
+        }
+    }
+    
+    batch.solve();
+    
+    for(int c = 0; c < (int)calls.size(); c++)
+    {
+        if(first[c] < 0)
+            continue;
+        const std::vector<Polynomial> &polys = calls[c];
+        int next = first[c];
+        SolverIntervals inter, intervals;
+        for(int i = 0; i < (int)polys.size(); i++)
+        {
+            const SolverPolynomial poly(polys[i]);
+            double found[MAX_DEGREE];
+            const double *roots = found;
+            int nroots = 0;
+            if(poly.degree() > 3)
+            {
+                roots = batch.roots(next);
+                nroots = batch.numRoots(next++);
+            }
+            else if(poly.degree() > 0)
+            {
+                nroots = findRealRoots(poly.getCoeffs(), poly.degree(), found, context.m_rf);
+            }
+            
+            spanIntervals(poly, roots, nroots, 0.0, 1.0, intervals);
+            inter = i == 0 ? intervals : intersect(inter, intervals);
+        }
+        times[c] = inter.findNextSatTime(0.0);
+    }
+#endif
+}
+
+#ifdef CCD_STAGED_INTERVALS
+bool PolynomialIntervalSolver::solveStaged(const std::vector<Polynomial> &polys, double &time, PolynomialSolverContext &context)
+{
+    StagedOrder order;
+    if(!order.assign(polys, MAX_DEGREE))
+        return false;
+    
+    PROFILE_COUNT(phasetiming::SOLVER_CALLS, 1);
+    if(context.m_log != NULL)
+        context.m_log->insert(context.m_log->end(), polys.begin(), polys.end());
+    
+    SolverIntervals inter, intervals;
+    solveCheapest(polys, order, inter);
+    int i = order.cheap;
+    for(; i < order.size && inter.size() > 0; i++)
+    {
+        const SolverPolynomial poly(polys[order.order[i]]);
+        const double lo = spanStart(inter), hi = spanEnd(inter);
+        if(negativeOnUnitInterval(onSpan(poly, lo, hi)))
+        {
+            inter.clear();
+            break;
+        }
+        double roots[MAX_DEGREE];
+        const int nroots = findRealRoots(poly.getCoeffs(), poly.degree(), roots, context.m_rf);
+        spanIntervals(poly, roots, nroots, lo, hi, intervals);
+        inter = intersect(inter, intervals);
+    }
+    PROFILE_COUNT(phasetiming::ROOT_SOLVES_SKIPPED, order.size - std::max(i, order.cheap));
+    time = inter.findNextSatTime(0.0);
+    return true;
+}
+
+// As the unstaged batch, in two passes around the batch's solve. The first
+// stages each call up to its quartics and quintics and queues those, each
+// on the span its cheaper polynomials left; the second maps their roots
+// back from the span to the step.
+void PolynomialIntervalSolver::solveStaged(const std::vector<std::vector<Polynomial> > &calls, double *times, PolynomialSolverContext &context)
+{
+    struct Staged
+    {
+        StagedOrder order;
+        SolverIntervals inter;
+        // The batch index of the first queued polynomial, or -1 for a call
+        // already answered, and which of order were queued.
+        int first;
+        unsigned queued;
+    };
+    
+    const double inf = std::numeric_limits<double>::infinity();
+    RootIsolationBatch &batch = context.m_batch;
+    batch.clear();
+    std::vector<Staged> staged(calls.size());
+    
+    for(int c = 0; c < (int)calls.size(); c++)
+    {
+        const std::vector<Polynomial> &polys = calls[c];
+        Staged &call = staged[c];
+        call.first = -1;
+        if(!call.order.assign(polys, RootIsolationBatch::MAX_DEGREE))
+        {
+            times[c] = findFirstIntersectionTimeInStep(polys, context);
+            continue;
+        }
+        
+        PROFILE_COUNT(phasetiming::SOLVER_CALLS, 1);
+        if(context.m_log != NULL)
+            context.m_log->insert(context.m_log->end(), polys.begin(), polys.end());
+        if(negativeInStep(polys))
+        {
+            PROFILE_COUNT(phasetiming::SOLVER_CALLS_CULLED, 1);
+            times[c] = inf;
+            continue;
+        }
+        
+        const StagedOrder &order = call.order;
+        solveCheapest(polys, order, call.inter);
+        if(call.inter.size() == 0 || order.cheap == order.size)
+        {
+            PROFILE_COUNT(phasetiming::ROOT_SOLVES_SKIPPED, order.size - order.cheap);
+            times[c] = call.inter.findNextSatTime(0.0);
+            continue;
+        }
+        
+        const double lo = spanStart(call.inter), hi = spanEnd(call.inter);
+        bool ruled_out = false;
+        for(int i = order.cheap; i < order.size && !ruled_out; i++)
+            ruled_out = negativeOnUnitInterval(onSpan(SolverPolynomial(polys[order.order[i]]), lo, hi));
+        if(ruled_out)
+        {
+            PROFILE_COUNT(phasetiming::ROOT_SOLVES_SKIPPED, order.size - order.cheap);
+            times[c] = inf;
+            continue;
+        }
+        
+        call.first = batch.size();
+        call.queued = 0;
+        for(int i = order.cheap; i < order.size; i++)
+        {
+            // A span too short for the polynomial to vary over has it
+            // constant, and its sign at the midpoint settles it.
+            const SolverPolynomial span = onSpan(SolverPolynomial(polys[order.order[i]]), lo, hi);
+            if(span.degree() < 1)
+                continue;
+            PROFILE_COUNT(phasetiming::Counter(phasetiming::ROOT_SOLVES_DEGREE_1 + span.degree() - 1), 1);
+            batch.add(span.getCoeffs(), span.degree());
+            call.queued |= 1u << i;
+        }
+    }
+    
+    batch.solve();
+    
+    for(int c = 0; c < (int)calls.size(); c++)
+    {
+        const Staged &call = staged[c];
+        if(call.first < 0)
+            continue;
+        const std::vector<Polynomial> &polys = calls[c];
+        const double lo = spanStart(call.inter), hi = spanEnd(call.inter);
+        SolverIntervals inter = call.inter, intervals;
+        int next = call.first;
+        for(int i = call.order.cheap; i < call.order.size; i++)
+        {
+            const SolverPolynomial poly(polys[call.order.order[i]]);
+            double roots[MAX_DEGREE];
+            int nroots = 0;
+            if(call.queued & (1u << i))
+            {
+                const double *found = batch.roots(next);
+                nroots = batch.numRoots(next++);
+                for(int r = 0; r < nroots; r++)
+                    roots[r] = lo + (hi - lo)*found[r];
+            }
+            spanIntervals(poly, roots, nroots, lo, hi, intervals);
+            inter = intersect(inter, intervals);
+        }
+        times[c] = inter.findNextSatTime(0.0);
+    }
+}
+#endif
+
+void PolynomialIntervalSolver::writePolynomials(std::ostream & os)
+{
+    int npolys = (int)s_polynomials.size();
+    os.write((char *)&npolys, sizeof(int));
+    for(int i = 0; i < npolys; i++)
+    {
+        const std::vector<double> &coeffs = s_polynomials[i].getCoeffs();
+        int ncoeffs = (int)coeffs.size();
+        os.write((char *)&ncoeffs, sizeof(int));
+        for(int j = 0; j < ncoeffs; j++)
+            os.write((char *)&coeffs[j], sizeof(double));
+    }
+}
+
+void PolynomialIntervalSolver::readPolynomials(std::vector<Polynomial> & polynomials, std::istream & is)
+{
+    polynomials.clear();
+    int npolys;
+    is.read((char *)&npolys, sizeof(int));
+    for(int i = 0; i < npolys; i++)
+    {
+        int ncoeffs;
+        is.read((char *)&ncoeffs, sizeof(int));
+        std::vector<double> coeffs(ncoeffs);
+        for(int j = 0; j < ncoeffs; j++)
+            is.read((char *)&coeffs[j], sizeof(double));
+        polynomials.push_back(Polynomial(coeffs));
+    }
+}
+
+// Returns the set of times at which poly is strictly positive.
+Intervals PolynomialIntervalSolver::findPolyIntervals(const Polynomial &poly, PolynomialSolverContext &context)
+{
+    FixedIntervals<MAX_DEGREE/2+1> fixed;
+    findPolyIntervals(SolverPolynomial(poly), fixed, context);
+
+    std::vector<Interval> result;
+    for(int i = 0; i < fixed.size(); i++)
+        result.push_back(fixed[i]);
+    return Intervals(result);
+}
+
+// Degrees up to three, which cover the particle-particle and
+// particle-halfplane polynomials, are solved in closed form; higher degrees
+// (the particle-edge polynomials) go through the Jenkins-Traub solver.
+int PolynomialIntervalSolver::findRealRoots(const double *coeffs, int degree, double *roots, RootFinder &rf)
+{
+    assert(degree >= 1 && degree <= MAX_DEGREE);
+    PROFILE_COUNT(phasetiming::Counter(phasetiming::ROOT_SOLVES_DEGREE_1 + degree - 1), 1);
+
+    if(degree <= 3)
+        return closedFormRoots(coeffs, degree, roots);
+
+    int nroots = 0;
+    double zeror[MAX_DEGREE], zeroi[MAX_DEGREE];
+    int numroots = rf.rpoly(coeffs, degree, zeror, zeroi);
+    for(int i = 0; i < numroots; i++)
+        if(fabs(zeroi[i]) < IMAGINARY_TOLERANCE)
+            roots[nroots++] = zeror[i];
+    std::sort(roots, roots + nroots);
+    return nroots;
+}
@@ -4,8 +4,17 @@
 #include <vector>
 #include <list>
 #include <cassert>
+#include <cmath>
 #include <iostream>
+#include <limits>
 #include "rpoly.h"
+#include "RootIsolation.h"
+#ifdef CCD_FILTERED_PREDICATES
+#include "FilteredPredicates.h"
+#endif
+
+// Leading polynomial coefficients smaller than this in magnitude are dropped.
+const double POLYNOMIAL_ZERO_COEFFICIENT = 1e-12;
 
 struct Interval
 {
@@ -53,27 +62,312 @@ private:
     std::vector<double> m_coeffs;
 };
 
+// Fixed-capacity counterparts of Polynomial and Intervals. They live entirely
+// on the stack, so the solver can run without touching the heap.
+
+template<int MAX_DEGREE>
+class FixedPolynomial
+{
+public:
+    FixedPolynomial(const double *coeffs, int ncoeffs) {assign(coeffs, ncoeffs);}
+    explicit FixedPolynomial(const Polynomial &poly)
+    {
+        const std::vector<double> &coeffs = poly.getCoeffs();
+        assign(coeffs.empty() ? NULL : &coeffs[0], (int)coeffs.size());
+    }
+    
+    int degree() const {return m_ncoeffs-1;}
+    const double *getCoeffs() const {return m_coeffs;}
+    
+    double evaluate(double t) const
+    {
+        double result = 0;
+        for(int i = 0; i < m_ncoeffs; i++)
+            result = result*t + m_coeffs[i];
+        return result;
+    }
+    
+    // Whether the polynomial is positive at t. Built with
+    // CCD_FILTERED_PREDICATES, a sign rounding could have flipped is settled
+    // in extended precision, and a value too close to zero to tell is not
+    // positive.
+    bool positiveAt(double t) const
+    {
+#ifdef CCD_FILTERED_PREDICATES
+        return m_ncoeffs > 0 && filtered::polynomialSign(m_coeffs, m_ncoeffs-1, t) > 0;
+#else
+        return evaluate(t) > 0;
+#endif
+    }
+    
+private:
+    void assign(const double *coeffs, int ncoeffs)
+    {
+        int first = 0;
+        while(first < ncoeffs && fabs(coeffs[first]) < POLYNOMIAL_ZERO_COEFFICIENT)
+            first++;
+        m_ncoeffs = ncoeffs-first;
+        assert(m_ncoeffs <= MAX_DEGREE+1);
+        for(int i = 0; i < m_ncoeffs; i++)
+            m_coeffs[i] = coeffs[first+i];
+    }
+    
+    double m_coeffs[MAX_DEGREE+1];
+    int m_ncoeffs;
+};
+
+// A sorted set of disjoint closed intervals.
+template<int MAX_INTERVALS>
+class FixedIntervals
+{
+public:
+    FixedIntervals(): m_size(0) {}
+    
+    int size() const {return m_size;}
+    Interval operator[](int i) const {return Interval(m_s[i], m_e[i]);}
+    
+    void clear() {m_size = 0;}
+    
+    // Adds [s, e]. Intervals must be added in order of increasing start; one
+    // that overlaps the last interval is merged into it.
+    void add(double s, double e)
+    {
+        assert(s <= e);
+        if(m_size > 0 && m_e[m_size-1] >= s)
+        {
+            if(e > m_e[m_size-1])
+                m_e[m_size-1] = e;
+            return;
+        }
+        assert(m_size < MAX_INTERVALS);
+        m_s[m_size] = s;
+        m_e[m_size] = e;
+        m_size++;
+    }
+    
+    double findNextSatTime(double t) const
+    {
+        for(int i = 0; i < m_size; i++)
+        {
+            if(t >= m_e[i])
+                continue;
+            return m_s[i] <= t ? t : m_s[i];
+        }
+        return std::numeric_limits<double>::infinity();
+    }
+    
+private:
+    double m_s[MAX_INTERVALS];
+    double m_e[MAX_INTERVALS];
+    int m_size;
+};
+
+// Intersection by a single merge pass over both sorted sets.
+template<int MAX_INTERVALS>
+FixedIntervals<MAX_INTERVALS> intersect(const FixedIntervals<MAX_INTERVALS> &i1, const FixedIntervals<MAX_INTERVALS> &i2)
+{
+    FixedIntervals<MAX_INTERVALS> result;
+    int a = 0, b = 0;
+    while(a < i1.size() && b < i2.size())
+    {
+        Interval x = i1[a], y = i2[b];
+        if(overlap(x, y))
+        {
+            Interval both = Iintersect(x, y);
+            result.add(both.m_s, both.m_e);
+        }
+        if(x.m_e < y.m_e)
+            a++;
+        else
+            b++;
+    }
+    return result;
+}
+
+// Solver state. The root finder works in member scratch arrays, so each
+// thread solving polynomials needs its own context.
+class PolynomialSolverContext
+{
+public:
+    PolynomialSolverContext(): m_log(NULL) {}
+    
+    // Debug recording is opt-in: when a log is set, every polynomial solved
+    // with this context is appended to it.
+    void setLog(std::vector<Polynomial> *log) {m_log = log;}
+    std::vector<Polynomial> *getLog() const {return m_log;}
+    
+private:
+    friend class PolynomialIntervalSolver;
+    
+    RootFinder m_rf;
+    RootIsolationBatch m_batch;
+    std::vector<Polynomial> *m_log;
+};
+
 class PolynomialIntervalSolver
 {
 public:
+    // Largest degree RootFinder can handle.
+    static const int MAX_DEGREE = 6;
+    
+    // Solves with a shared default context that records into
+    // getPolynomials(), which the simulation writes out and compares against
+    // reference runs. Not thread-safe; use the overload below to solve in
+    // parallel, or put a context of the thread's own in place of the default
+    // with ScopedSolverContext.
     static double findFirstIntersectionTime(const std::vector<Polynomial> &polys);
+    
+    static double findFirstIntersectionTime(const std::vector<Polynomial> &polys, PolynomialSolverContext &context);
+    
+    // As findFirstIntersectionTime, for callers that only take a time in
+    // [0, 1]. Some polynomial negative throughout [0, 1], by the bound its
+    // Bernstein coefficients give, rules out any time there, and infinity is
+    // returned without finding roots; otherwise the result is
+    // findFirstIntersectionTime's. Either way, polys are logged alike.
+    //
+    // Built with CCD_STAGED_INTERVALS, this and findFirstIntersectionTimesInStep
+    // solve a call's polynomials cheapest first: those up to degree 3, in
+    // closed form, leave some times of [0, 1], and a call they leave none
+    // ends there. Each quartic or quintic is then bounded by its Bernstein
+    // coefficients on the span of the times left, and only has its roots
+    // found, on that span alone when batched, if the bound does not rule it
+    // out. Times past the end of the step come out as infinity.
+    static double findFirstIntersectionTimeInStep(const std::vector<Polynomial> &polys);
+    
+    static double findFirstIntersectionTimeInStep(const std::vector<Polynomial> &polys, PolynomialSolverContext &context);
+    
+    // findFirstIntersectionTimeInStep for many calls at once: the degree 4
+    // and 5 polynomials of all of them have their roots in [0, 1] found
+    // together by a RootIsolationBatch, rather than each by rpoly, and the
+    // rest in closed form. Writes the time of call i to times[i], which is
+    // infinity if there is none in [0, 1]. A call with a polynomial of
+    // degree 6, or more polynomials than the fixed-size intervals hold, is
+    // solved by itself. Either way, polys are logged alike.
+    static void findFirstIntersectionTimesInStep(const std::vector<std::vector<Polynomial> > &calls, double *times, PolynomialSolverContext &context);
+    
+    // Whether the Bernstein coefficients of poly on [0, 1], whose convex hull
+    // holds its graph there, are all negative by more than their rounding.
+    template<int MAX_POLY_DEGREE>
+    static bool negativeOnUnitInterval(const FixedPolynomial<MAX_POLY_DEGREE> &poly);
+    
+    // Allocation-free version of findPolyIntervals. MAX_INTERVALS must be at
+    // least MAX_POLY_DEGREE/2 + 1.
+    template<int MAX_POLY_DEGREE, int MAX_INTERVALS>
+    static void findPolyIntervals(const FixedPolynomial<MAX_POLY_DEGREE> &poly, FixedIntervals<MAX_INTERVALS> &intervals, PolynomialSolverContext &context);
 
     static void writePolynomials(std::ostream & os);
     static void readPolynomials(std::vector<Polynomial> & polynomials, std::istream & is);
     
+    // The context the overloads without one solve with on the calling
+    // thread: the shared default unless a ScopedSolverContext is in place.
+    static PolynomialSolverContext & currentContext();
+    
     static std::vector<Polynomial> & getPolynomials() { return s_polynomials; }
     static void clearPolynomials() { s_polynomials.clear(); }
     
 private:
     
-    static Intervals findPolyIntervals(const Polynomial &poly);
+    static Intervals findPolyIntervals(const Polynomial &poly, PolynomialSolverContext &context);
+    
+#ifdef CCD_STAGED_INTERVALS
+    // The staged solves of findFirstIntersectionTimeInStep, past its culling,
+    // and of findFirstIntersectionTimesInStep. The first returns false,
+    // having logged nothing, for a call it does not stage.
+    static bool solveStaged(const std::vector<Polynomial> &polys, double &time, PolynomialSolverContext &context);
+    static void solveStaged(const std::vector<std::vector<Polynomial> > &calls, double *times, PolynomialSolverContext &context);
+#endif
+    
+    // Whether some polynomial rules out every time in [0, 1]: it is empty,
+    // or negative there by the bound of negativeOnUnitInterval.
+    static bool negativeInStep(const std::vector<Polynomial> &polys);
     
-    static RootFinder rf;
+    // Writes the real roots of the polynomial, in increasing order, to roots
+    // and returns how many there are. degree is between 1 and MAX_DEGREE.
+    static int findRealRoots(const double *coeffs, int degree, double *roots, RootFinder &rf);
     
 private:
     static std::vector<Polynomial> s_polynomials;
     
 };
 
+// Puts context in place of the shared default on the calling thread for the
+// life of the scope, so that code which solves without a context, such as
+// the collision handlers' detection, can run on several threads at once.
+class ScopedSolverContext
+{
+public:
+    explicit ScopedSolverContext(PolynomialSolverContext &context);
+    ~ScopedSolverContext();
+    
+private:
+    PolynomialSolverContext *m_previous;
+};
+
+// Marks where poly is strictly positive.
+template<int MAX_POLY_DEGREE, int MAX_INTERVALS>
+void PolynomialIntervalSolver::findPolyIntervals(const FixedPolynomial<MAX_POLY_DEGREE> &poly, FixedIntervals<MAX_INTERVALS> &intervals, PolynomialSolverContext &context)
+{
+    const double inf = std::numeric_limits<double>::infinity();
+    intervals.clear();
+    
+    int deg = poly.degree();
+    if(deg < 0)
+        return;
+    
+    double roots[MAX_POLY_DEGREE > 0 ? MAX_POLY_DEGREE : 1];
+    int nroots = deg == 0 ? 0 : findRealRoots(poly.getCoeffs(), deg, roots, context.m_rf);
+    if(nroots == 0)
+    {
+        if(poly.positiveAt(0))
+            intervals.add(-inf, inf);
+        return;
+    }
+    
+    if(poly.positiveAt(roots[0] - 1.0))
+        intervals.add(-inf, roots[0]);
+    for(int i = 0; i < nroots-1; i++)
+        if(poly.positiveAt(0.5*(roots[i] + roots[i+1])))
+            intervals.add(roots[i], roots[i+1]);
+    if(poly.positiveAt(roots[nroots-1] + 1.0))
+        intervals.add(roots[nroots-1], inf);
+}
+
+// With poly = sum a_k t^k of degree n, the Bernstein coefficients are
+// b_j = sum_{k<=j} C(j,k)/C(n,k) a_k, b_0 = poly(0) and b_n = poly(1). They
+// carry a rounding error around n*eps*sum |a_k|, which the margin covers.
+template<int MAX_POLY_DEGREE>
+bool PolynomialIntervalSolver::negativeOnUnitInterval(const FixedPolynomial<MAX_POLY_DEGREE> &poly)
+{
+    const int n = poly.degree();
+    if(n < 0)
+        return false;
+    const double *coeffs = poly.getCoeffs();
+    if(coeffs[n] >= 0.0)
+        return false;
+    
+    double scale = 0.0;
+    for(int k = 0; k <= n; k++)
+        scale += fabs(coeffs[k]);
+    const double margin = 1e-12*scale;
+    
+    // binomial[k] is C(n,k); row[k] is C(j,k).
+    double binomial[MAX_POLY_DEGREE+1], row[MAX_POLY_DEGREE+1];
+    binomial[0] = 1.0;
+    for(int k = 1; k <= n; k++)
+        binomial[k] = binomial[k-1]*(n-k+1)/k;
+    for(int j = 0; j <= n; j++)
+    {
+        row[j] = 1.0;
+        for(int k = j-1; k > 0; k--)
+            row[k] += row[k-1];
+        double b = 0.0;
+        for(int k = 0; k <= j; k++)
+            b += row[k]/binomial[k]*coeffs[n-k];
+        if(b >= -margin)
+            return false;
+    }
+    return true;
+}
+
 
 #endif
@@ -0,0 +1,185 @@
+// A live stats overlay for FOSSSim's display, toggled with the p key: the
+// mean milliseconds of each step phase, steps per second, and with
+// PROFILE_COUNTERS the contacts, impulse sweeps and impact zones per step,
+// over the last LIVE_FRAMES steps the collision handlers timed (see
+// PhaseTiming.h). Turning it on turns on the phase timers, which otherwise
+// cost nothing without FOSSSIM_PROFILE.
+//
+// drawHUD, the keyboard callback and main are compiled into the base library
+// and cannot be changed, so this interposes on the GLUT calls they make
+// instead: glutKeyboardFunc, to put a callback that handles the toggle in
+// front of the base library's, and glutSwapBuffers, which the display calls
+// right after drawHUD, to draw the overlay over the HUD before forwarding to
+// GLUT's own. Linked into FOSSSim only; FOSSSimHeadless has stubs for both.
+//
+// Built with IMPULSE_HISTORY_FRAMES, the same hook draws the impulse trails
+// of ImpulseHistory.h under the overlay, whether or not it is on: the base
+// library's renderer only draws the current step's impulses.
+
+#include <cstdio>
+#include <dlfcn.h>
+#include <iostream>
+#include <string>
+
+#ifdef __APPLE__
+#include <GLUT/glut.h>
+#else
+#include <GL/glut.h>
+#endif
+
+#include "FOSSSim/PhaseTiming.h"
+#ifdef IMPULSE_HISTORY_FRAMES
+#include "FOSSSim/ImpulseHistory.h"
+#endif
+
+namespace
+{
+
+const int LINE_HEIGHT = 14;
+// Below the base library's HUD, from the top left corner.
+const int FIRST_LINE = 44;
+
+typedef void (*KeyboardCallback)( unsigned char, int, int );
+
+KeyboardCallback g_base_keyboard = NULL;
+
+// GLUT's own definition of a function interposed on here.
+template<class Function>
+Function nextDefinition( const char *name )
+{
+  Function function = (Function) dlsym(RTLD_NEXT, name);
+  if( function == NULL )
+  {
+    std::cerr << "\033[31;1mERROR IN STATSOVERLAY:\033[m Unable to locate GLUT's " << name << "." << std::endl;
+    exit(1);
+  }
+  return function;
+}
+
+void keyboard( unsigned char key, int x, int y )
+{
+  if( key == 'p' || key == 'P' )
+  {
+    phasetiming::setLive(!phasetiming::live());
+    glutPostRedisplay();
+    return;
+  }
+  if( g_base_keyboard != NULL ) g_base_keyboard(key, x, y);
+}
+
+void drawLine( int line, const std::string& text )
+{
+  glRasterPos2i(8, glutGet(GLUT_WINDOW_HEIGHT) - FIRST_LINE - line*LINE_HEIGHT);
+  for( std::string::size_type c = 0; c < text.size(); ++c ) glutBitmapCharacter(GLUT_BITMAP_HELVETICA_12, text[c]);
+}
+
+std::string format( const char *format, double a, double b = 0.0, double c = 0.0 )
+{
+  char buffer[128];
+  snprintf(buffer, sizeof(buffer), format, a, b, c);
+  return buffer;
+}
+
+void drawOverlay()
+{
+  glMatrixMode(GL_PROJECTION);
+  glPushMatrix();
+  glLoadIdentity();
+  gluOrtho2D(0.0, glutGet(GLUT_WINDOW_WIDTH), 0.0, glutGet(GLUT_WINDOW_HEIGHT));
+  glMatrixMode(GL_MODELVIEW);
+  glPushMatrix();
+  glLoadIdentity();
+
+  // The inverse of the background, so that it shows on any.
+  GLfloat background[4];
+  glGetFloatv(GL_COLOR_CLEAR_VALUE, background);
+  glColor3f(1.0f - background[0], 1.0f - background[1], 1.0f - background[2]);
+
+  phasetiming::FrameSummary summary;
+  int line = 0;
+  if( !phasetiming::summarizeRecentFrames(phasetiming::LIVE_FRAMES, summary) )
+  {
+    drawLine(line++, "Waiting for timed steps");
+  }
+  else
+  {
+    drawLine(line++, format("%.1f steps/s, means of the last %.0f steps", summary.framespersecond, double(summary.frames)));
+    double total = 0.0;
+    for( int p = 0; p < phasetiming::NUM_PHASES; ++p )
+    {
+      total += summary.seconds[p];
+      drawLine(line++, std::string(phasetiming::phaseName(phasetiming::Phase(p))) + format(": %.3f ms", 1.0e3*summary.seconds[p]));
+    }
+    drawLine(line++, format("timed: %.3f ms", 1.0e3*total));
+#ifdef PROFILE_COUNTERS
+    drawLine(line++, format("contacts: %.1f   candidates: %.1f", summary.counts[phasetiming::CONTACTS], summary.counts[phasetiming::BROAD_PHASE_CANDIDATES]));
+    drawLine(line++, format("impulse iterations: %.1f", summary.counts[phasetiming::IMPULSE_ITERATIONS]));
+    drawLine(line++, format("impact zones: %.2f   of 17 or more: %.2f", summary.counts[phasetiming::IMPACT_ZONES], summary.counts[phasetiming::ZONE_SIZE_17_UP]));
+#else
+    drawLine(line++, "Build with PROFILE_COUNTERS for contact, impulse and zone counts");
+#endif
+  }
+
+  glMatrixMode(GL_MODELVIEW);
+  glPopMatrix();
+  glMatrixMode(GL_PROJECTION);
+  glPopMatrix();
+  glMatrixMode(GL_MODELVIEW);
+}
+
+#ifdef IMPULSE_HISTORY_FRAMES
+// Pixels of normal drawn from each impulse, and the colour of the last
+// step's; older steps fade into the background.
+const double TRAIL_TICK = 10.0;
+const float TRAIL_COLOR[3] = { 1.0f, 0.0f, 0.0f };
+
+// Draws each impulse of the history as its normal from where its particle
+// ended the step, oldest first, in the scene's coordinates as the display
+// leaves them: its orthographic projection, and a modelview that does not
+// scale.
+void drawImpulseTrails()
+{
+  const ImpulseHistory& history = impulsehistory::history();
+  GLdouble projection[16];
+  GLint viewport[4];
+  glGetDoublev(GL_PROJECTION_MATRIX, projection);
+  glGetIntegerv(GL_VIEWPORT, viewport);
+  if( history.numSteps() == 0 || projection[0] == 0.0 || viewport[2] == 0 ) return;
+  const double tick = TRAIL_TICK*2.0/( projection[0]*viewport[2] );
+
+  GLfloat background[4];
+  glGetFloatv(GL_COLOR_CLEAR_VALUE, background);
+  glBegin(GL_LINES);
+  for( int age = history.numSteps() - 1; age >= 0; --age )
+  {
+    const float fade = float(age)/float(history.numSteps());
+    glColor3f(TRAIL_COLOR[0] + fade*( background[0] - TRAIL_COLOR[0] ), TRAIL_COLOR[1] + fade*( background[1] - TRAIL_COLOR[1] ), TRAIL_COLOR[2] + fade*( background[2] - TRAIL_COLOR[2] ));
+    for( const ImpulseHistory::Impulse* impulse = history.stepBegin(age); impulse != history.stepEnd(age); ++impulse )
+    {
+      const Vector2s n = impulse->n();
+      glVertex2d(impulse->position[0], impulse->position[1]);
+      glVertex2d(impulse->position[0] + tick*n.x(), impulse->position[1] + tick*n.y());
+    }
+  }
+  glEnd();
+}
+#endif
+
+}
+
+extern "C" void glutKeyboardFunc( KeyboardCallback callback )
+{
+  static void (*const next)( KeyboardCallback ) = nextDefinition<void (*)( KeyboardCallback )>("glutKeyboardFunc");
+  g_base_keyboard = callback;
+  next(callback == NULL ? NULL : keyboard);
+}
+
+extern "C" void glutSwapBuffers()
+{
+  static void (*const next)() = nextDefinition<void (*)()>("glutSwapBuffers");
+#ifdef IMPULSE_HISTORY_FRAMES
+  drawImpulseTrails();
+#endif
+  if( phasetiming::live() ) drawOverlay();
+  next();
+}
@@ -0,0 +1,42 @@
+#include "FilteredPredicates.h"
+#include "PhaseTiming.h"
+
+namespace filtered
+{
+
+// The double Horner bound is Higham's running error bound, u (2 mu - |y|).
+// Compensated Horner's result is within u |p(t)| + gamma_2n^2 p~(|t|) of
+// p(t), p~ having the absolute values of the coefficients; a result
+// further from zero than the second term cannot have the wrong sign.
+int polynomialSign( const double *coeffs, int degree, double t )
+{
+  const double slack = 1.0 + 1e-12;
+  const double at = fabs( t );
+
+  double y = coeffs[0];
+  double mu = 0.5*fabs( y );
+  for( int k = 1; k <= degree; ++k )
+  {
+    y = y*t + coeffs[k];
+    mu = mu*at + fabs( y );
+  }
+  if( fabs( y ) > slack*EPSILON*( 2.0*mu - fabs( y ) ) ) return y > 0.0 ? 1 : -1;
+
+  PROFILE_COUNT( phasetiming::FILTER_FALLBACKS, 1 );
+  double s = coeffs[0];
+  double r = 0.0;
+  double magnitude = fabs( coeffs[0] );
+  for( int k = 1; k <= degree; ++k )
+  {
+    double p, pi, sigma;
+    twoProduct( s, t, p, pi );
+    twoSum( p, coeffs[k], s, sigma );
+    r = r*t + ( pi + sigma );
+    magnitude = magnitude*at + fabs( coeffs[k] );
+  }
+  const double value = s + r;
+  if( fabs( value ) > slack*gamma( 2*degree )*gamma( 2*degree )*magnitude ) return value > 0.0 ? 1 : -1;
+  return 0;
+}
+
+}
@@ -0,0 +1,122 @@
+#ifndef FILTERED_PREDICATES_H
+#define FILTERED_PREDICATES_H
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+// Signs the continuous-time tests decide on, computed in double where the
+// rounding provably cannot flip them and in about twice the precision where
+// it might. Only the uncertain cases, which near-degenerate configurations
+// such as resting and tangential contact produce, pay for the extra work.
+//
+// Underflow is not accounted for.
+namespace filtered
+{
+  // The unit roundoff of double.
+  const double EPSILON = 0.5*std::numeric_limits<double>::epsilon();
+
+  // A double computed from inputs by + - *, alongside the same expression
+  // evaluated on the inputs' magnitudes with every - taken as + (rounded
+  // like the value; the slack in signCertain covers that) and the greatest
+  // number of roundings any term of it went through. The value is within
+  // gamma(roundings) magnitude of what exact arithmetic gives, gamma(n) being
+  // n u/(1 - n u), so a value further from zero than that has the right
+  // sign. This costs about twice the plain arithmetic: the roundings do not
+  // depend on the data and fold away, and the values are exactly those plain
+  // double arithmetic gives.
+  struct Filtered
+  {
+    Filtered() : value( 0.0 ), magnitude( 0.0 ), roundings( 0 ) {}
+    // An input, exact unless it is itself the result of roundings roundings.
+    Filtered( double v, int r = 0 ) : value( v ), magnitude( fabs( v ) ), roundings( r ) {}
+    Filtered( double v, double m, int r ) : value( v ), magnitude( m ), roundings( r ) {}
+
+    double value;
+    double magnitude;
+    int roundings;
+  };
+
+  inline Filtered operator-( const Filtered &a ) { return Filtered( -a.value, a.magnitude, a.roundings ); }
+
+  inline Filtered operator+( const Filtered &a, const Filtered &b )
+  {
+    return Filtered( a.value + b.value, a.magnitude + b.magnitude, std::max( a.roundings, b.roundings ) + 1 );
+  }
+
+  inline Filtered operator-( const Filtered &a, const Filtered &b )
+  {
+    return Filtered( a.value - b.value, a.magnitude + b.magnitude, std::max( a.roundings, b.roundings ) + 1 );
+  }
+
+  inline Filtered operator*( const Filtered &a, const Filtered &b )
+  {
+    return Filtered( a.value*b.value, a.magnitude*b.magnitude, a.roundings + b.roundings + 1 );
+  }
+
+  inline Filtered operator*( double k, const Filtered &a ) { return Filtered( k )*a; }
+
+  inline double gamma( int n ) { return n*EPSILON/( 1.0 - n*EPSILON ); }
+
+  // Whether the sign of the value is that of the exact result.
+  inline bool signCertain( const Filtered &a ) { return fabs( a.value ) > ( 1.0 + 1e-12 )*gamma( a.roundings )*a.magnitude || a.roundings == 0; }
+
+  // a + b = s + e exactly.
+  inline void twoSum( double a, double b, double &s, double &e )
+  {
+    s = a + b;
+    const double bb = s - a;
+    e = ( a - ( s - bb ) ) + ( b - bb );
+  }
+
+  // a*b = p + e exactly.
+  inline void twoProduct( double a, double b, double &p, double &e )
+  {
+    p = a*b;
+    e = std::fma( a, b, -p );
+  }
+
+  // An unevaluated sum hi + lo with |lo| at most half an ulp of hi, about
+  // 106 bits of precision. Sums and products of doubles are exact in it.
+  struct DoubleDouble
+  {
+    DoubleDouble() : hi( 0.0 ), lo( 0.0 ) {}
+    DoubleDouble( double h ) : hi( h ), lo( 0.0 ) {}
+    DoubleDouble( double h, double l ) { hi = h + l; lo = l - ( hi - h ); }
+
+    // The nearest double.
+    double toDouble() const { return hi; }
+
+    double hi;
+    double lo;
+  };
+
+  inline DoubleDouble operator-( const DoubleDouble &a ) { DoubleDouble r; r.hi = -a.hi; r.lo = -a.lo; return r; }
+
+  inline DoubleDouble operator+( const DoubleDouble &a, const DoubleDouble &b )
+  {
+    double s, e;
+    twoSum( a.hi, b.hi, s, e );
+    return DoubleDouble( s, e + ( a.lo + b.lo ) );
+  }
+
+  inline DoubleDouble operator-( const DoubleDouble &a, const DoubleDouble &b ) { return a + ( -b ); }
+
+  inline DoubleDouble operator*( const DoubleDouble &a, const DoubleDouble &b )
+  {
+    double p, e;
+    twoProduct( a.hi, b.hi, p, e );
+    return DoubleDouble( p, e + ( a.hi*b.lo + a.lo*b.hi ) );
+  }
+
+  inline DoubleDouble operator*( double k, const DoubleDouble &a ) { return DoubleDouble( k )*a; }
+
+  // The sign of coeffs[0] t^degree + ... + coeffs[degree]: 1, -1, or 0 if it
+  // is zero or too close to zero to tell. Horner's rule in double settles
+  // the sign unless the value is within its running error bound; then the
+  // polynomial is evaluated by compensated Horner, as accurate as Horner in
+  // twice the precision, against that method's bound.
+  int polynomialSign( const double *coeffs, int degree, double t );
+}
+
+#endif
@@ -0,0 +1,135 @@
+#include "FrameArena.h"
+#include "MemoryAccounting.h"
+#include <algorithm>
+#include <cassert>
+#include <stdint.h>
+
+namespace
+{
+
+// Big enough for the scratch of a few thousand particles in one block.
+const size_t INITIAL_BLOCK_SIZE = 64*1024;
+
+char* alignUp( char* p, size_t alignment )
+{
+  const uintptr_t a = alignment;
+  return reinterpret_cast<char*>( ( reinterpret_cast<uintptr_t>( p ) + a - 1 ) & ~( a - 1 ) );
+}
+
+size_t frameBytes()
+{
+  return framearena::frame().capacity();
+}
+
+const bool g_accounted = memoryaccounting::addSource( memoryaccounting::SCRATCH, frameBytes );
+
+}
+
+FrameArena::FrameArena()
+: m_blocks()
+, m_current(0)
+, m_head(NULL)
+, m_end(NULL)
+{}
+
+FrameArena::~FrameArena()
+{
+  for( size_t b = 0; b < m_blocks.size(); ++b ) delete [] m_blocks[b].data;
+}
+
+void* FrameArena::allocateBytes( size_t bytes, size_t alignment )
+{
+  assert( alignment > 0 ); assert( ( alignment & ( alignment - 1 ) ) == 0 );
+  if( bytes == 0 ) return m_head;
+  char* p = alignUp( m_head, alignment );
+  if( m_head == NULL || p + bytes > m_end )
+  {
+    nextBlock( bytes, alignment );
+    p = alignUp( m_head, alignment );
+  }
+  m_head = p + bytes;
+  return p;
+}
+
+void FrameArena::nextBlock( size_t bytes, size_t alignment )
+{
+  for( size_t b = m_blocks.empty() ? 0 : m_current + 1; b < m_blocks.size(); ++b )
+  {
+    if( alignUp( m_blocks[b].data, alignment ) + bytes <= m_blocks[b].data + m_blocks[b].size )
+    {
+      m_current = b;
+      m_head = m_blocks[b].data;
+      m_end = m_head + m_blocks[b].size;
+      return;
+    }
+  }
+
+  Block block;
+  block.size = std::max( bytes + alignment, m_blocks.empty() ? INITIAL_BLOCK_SIZE : 2*m_blocks.back().size );
+  block.data = new char[block.size];
+  m_blocks.push_back( block );
+  m_current = m_blocks.size() - 1;
+  m_head = block.data;
+  m_end = block.data + block.size;
+}
+
+// A step that chained blocks is likely to need as much again, so they are
+// merged into one that holds it all.
+void FrameArena::reset()
+{
+  if( m_blocks.size() > 1 )
+  {
+    Block merged;
+    merged.size = capacity();
+    for( size_t b = 0; b < m_blocks.size(); ++b ) delete [] m_blocks[b].data;
+    m_blocks.clear();
+    merged.data = new char[merged.size];
+    m_blocks.push_back( merged );
+  }
+  m_current = 0;
+  m_head = m_blocks.empty() ? NULL : m_blocks[0].data;
+  m_end = m_blocks.empty() ? NULL : m_blocks[0].data + m_blocks[0].size;
+}
+
+FrameArena::Mark FrameArena::mark() const
+{
+  Mark m;
+  m.block = m_current;
+  m.head = m_head;
+  return m;
+}
+
+void FrameArena::rewind( const Mark& m )
+{
+  assert( m.block <= m_current );
+  if( m.head == NULL )
+  {
+    // Taken before the first block; rewinds to its start.
+    reset();
+    return;
+  }
+  m_current = m.block;
+  m_head = m.head;
+  m_end = m_blocks[m.block].data + m_blocks[m.block].size;
+}
+
+size_t FrameArena::used() const
+{
+  if( m_blocks.empty() ) return 0;
+  size_t bytes = m_head - m_blocks[m_current].data;
+  for( size_t b = 0; b < m_current; ++b ) bytes += m_blocks[b].size;
+  return bytes;
+}
+
+size_t FrameArena::capacity() const
+{
+  size_t bytes = 0;
+  for( size_t b = 0; b < m_blocks.size(); ++b ) bytes += m_blocks[b].size;
+  return bytes;
+}
+
+FrameArena& framearena::frame()
+{
+  static FrameArena arena;
+  return arena;
+}
@@ -0,0 +1,114 @@
+#ifndef FRAME_ARENA_H
+#define FRAME_ARENA_H
+
+#include <cstddef>
+#include <vector>
+
+// Bump allocator for the scratch arrays of one collision step: impulse colors,
+// impact zone forests, moved-particle flags, particle blocks. Allocation moves
+// a pointer through the current block and nothing is freed until reset(),
+// which the collision handlers call at the start of each step. A step that
+// outgrows the block chains another one, and the next reset() replaces the
+// chain with a single block of their total size, so after the first few
+// steps a scene allocates from one block and never calls operator new.
+//
+// Only trivially destructible types belong here; their destructors are never
+// run. The arena is not thread-safe, so parallel regions may write to arrays
+// allocated before them but must not allocate.
+class FrameArena
+{
+public:
+  // Allocation is aligned to at least this many bytes, enough for Vector2s.
+  static const size_t DEFAULT_ALIGNMENT = 16;
+
+  // Where allocation has reached, for rewinding to.
+  struct Mark
+  {
+    size_t block;
+    char* head;
+  };
+
+  FrameArena();
+  ~FrameArena();
+
+  // n uninitialized objects of type T.
+  template<typename T>
+  T* allocate( int n )
+  {
+    return allocateAligned<T>( n, DEFAULT_ALIGNMENT );
+  }
+
+  // n objects of type T, each set to value.
+  template<typename T>
+  T* allocate( int n, const T& value )
+  {
+    T* p = allocate<T>( n );
+    for( int i = 0; i < n; ++i ) p[i] = value;
+    return p;
+  }
+
+  // n uninitialized objects of type T, aligned to alignment bytes, a power
+  // of two.
+  template<typename T>
+  T* allocateAligned( int n, size_t alignment )
+  {
+    return static_cast<T*>( allocateBytes( n*sizeof(T), alignment ) );
+  }
+
+  // Frees everything allocated since the last reset.
+  void reset();
+
+  Mark mark() const;
+  // Frees everything allocated since m was taken. The blocks stay for reuse.
+  void rewind( const Mark& m );
+
+  // Bytes in use and bytes held, over all blocks.
+  size_t used() const;
+  size_t capacity() const;
+
+private:
+  FrameArena( const FrameArena& );
+  FrameArena& operator=( const FrameArena& );
+
+  struct Block
+  {
+    char* data;
+    size_t size;
+  };
+
+  void* allocateBytes( size_t bytes, size_t alignment );
+  // Moves to the next block with room for bytes at alignment, chaining a new
+  // one if none has.
+  void nextBlock( size_t bytes, size_t alignment );
+
+  std::vector<Block> m_blocks;
+  size_t m_current;
+  char* m_head;
+  char* m_end;
+};
+
+// Rewinds the arena to where it was on construction, for scratch that does
+// not outlive a scope but sits in a loop that would otherwise grow the step's
+// arena once per iteration.
+class FrameArenaScope
+{
+public:
+  explicit FrameArenaScope( FrameArena& arena ) : m_arena(arena), m_mark(arena.mark()) {}
+  ~FrameArenaScope() { m_arena.rewind(m_mark); }
+
+private:
+  FrameArenaScope( const FrameArenaScope& );
+  FrameArenaScope& operator=( const FrameArenaScope& );
+
+  FrameArena& m_arena;
+  FrameArena::Mark m_mark;
+};
+
+namespace framearena
+{
+  // The arena of the current collision step. The base library constructs the
+  // handlers, so it is kept statically rather than as a member.
+  FrameArena& frame();
+}
+
+#endif
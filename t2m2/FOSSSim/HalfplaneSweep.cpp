@@ -0,0 +1,50 @@
+#include "HalfplaneSweep.h"
+
+HalfplaneSweep::HalfplaneSweep()
+: m_begin( 0 )
+, m_count( 0 )
+, m_normals()
+, m_start()
+, m_end()
+, m_radii()
+{}
+
+void HalfplaneSweep::sweep( const TwoDScene &scene, const VectorXs &qs, const VectorXs &qe, int begin, int end )
+{
+  const int nhalfplanes = scene.getNumHalfplanes();
+  m_begin = begin;
+  m_count = end - begin;
+  m_normals.resize( 2*nhalfplanes );
+  m_start.resize( nhalfplanes*m_count );
+  m_end.resize( nhalfplanes*m_count );
+  m_radii.resize( m_count );
+
+  for( int i = 0; i < m_count; ++i )
+    m_radii[i] = scene.getRadius( begin + i );
+
+  const scalar *xs = qs.data() + 2*begin;
+  const scalar *xe = qe.data() + 2*begin;
+  for( int p = 0; p < nhalfplanes; ++p )
+  {
+    const std::pair<VectorXs,VectorXs> &halfplane = scene.getHalfplane( p );
+    Vector2s nhat = halfplane.second.segment<2>( 0 );
+    nhat.normalize();
+    m_normals[2*p] = nhat.x();
+    m_normals[2*p+1] = nhat.y();
+    const scalar nx = nhat.x(), ny = nhat.y();
+    const scalar offset = nhat.dot( halfplane.first.segment<2>( 0 ) );
+
+    scalar *ds = &m_start[p*m_count];
+    scalar *de = &m_end[p*m_count];
+    for( int i = 0; i < m_count; ++i )
+    {
+      ds[i] = nx*xs[2*i] + ny*xs[2*i+1] - offset;
+      de[i] = nx*xe[2*i] + ny*xe[2*i+1] - offset;
+    }
+  }
+}
+
+size_t HalfplaneSweep::bytesHeld() const
+{
+  return sizeof(scalar)*( m_normals.capacity() + m_start.capacity() + m_end.capacity() + m_radii.capacity() );
+}
@@ -0,0 +1,85 @@
+#ifndef HALFPLANE_SWEEP_H
+#define HALFPLANE_SWEEP_H
+
+#include "MathDefs.h"
+#include "TwoDScene.h"
+#include "ContinuousTimeUtilities.h"
+#include <vector>
+
+// The half-plane tests of continuous-time detection in closed form. A
+// particle moves in a straight line over the step, so its signed distance
+// from a half-plane is linear in time, and the first time it comes within
+// its radius while approaching is one division rather than the roots of the
+// degree-one polynomials detectParticleHalfplane hands the interval solver.
+//
+// Built with CCD_CLOSED_FORM_HALFPLANES, detection takes the closed form
+// whenever the current solver context keeps no log. With a log, as the base
+// library keeps by default to write the polynomials out and compare them
+// against reference runs, the polynomials are built and solved as before,
+// so that they are logged.
+inline bool closedFormHalfplanes()
+{
+#ifdef CCD_CLOSED_FORM_HALFPLANES
+  return PolynomialIntervalSolver::currentContext().getLog() == NULL;
+#else
+  return false;
+#endif
+}
+
+// Whether a particle of radius r whose signed distance from a half-plane goes
+// from ds to de over the step overlaps it while approaching, and if so sets
+// time to the first time it does, in [0, 1], and n to the vector from the
+// particle to the half-plane, of unit normal nhat, at that time.
+inline bool halfplaneTimeOfImpact( scalar ds, scalar de, scalar r, const Vector2s &nhat, Vector2s &n, double &time )
+{
+  // Moving away or along it throughout.
+  if( !( de <= ds ) )
+    return false;
+  if( ds <= r )
+    time = 0.0;
+  else if( de <= r )
+    time = ( ds - r )/( ds - de );
+  else
+    return false;
+  n = -( ds + time*( de - ds ) )*nhat;
+  return true;
+}
+
+// The signed distances of a range of particles from every half-plane, at the
+// start and end of the step, each half-plane's computed in one sweep over
+// the particles into arrays of their own, for detection that tests many
+// particles against the same half-planes from the same qs and qe.
+//
+// The storage is kept from call to call.
+class HalfplaneSweep
+{
+public:
+  HalfplaneSweep();
+
+  // Measures particles begin up to end against every half-plane of scene.
+  void sweep( const TwoDScene &scene, const VectorXs &qs, const VectorXs &qe, int begin, int end );
+
+  // halfplaneTimeOfImpact for particle vidx, in the range swept, and
+  // half-plane pidx.
+  bool detect( int vidx, int pidx, Vector2s &n, double &time ) const
+  {
+    const int k = pidx*m_count + vidx - m_begin;
+    return halfplaneTimeOfImpact( m_start[k], m_end[k], m_radii[vidx - m_begin], Vector2s( m_normals[2*pidx], m_normals[2*pidx+1] ), n, time );
+  }
+
+  // Bytes held from call to call, for memory accounting.
+  size_t bytesHeld() const;
+
+private:
+  int m_begin;
+  int m_count;
+  // The half-planes' unit normals, x and y interleaved.
+  std::vector<scalar> m_normals;
+  // Signed distances of particle i from half-plane p at qs and qe, at
+  // p*m_count + i - m_begin.
+  std::vector<scalar> m_start;
+  std::vector<scalar> m_end;
+  std::vector<scalar> m_radii;
+};
+
+#endif
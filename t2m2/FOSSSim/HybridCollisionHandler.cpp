@@ -3,7 +3,18 @@
 #include <iostream>
 #include <set>
 #include <algorithm>
+#include <limits>
 #include "HybridCollisionComparison.h"
+#include "PhaseTiming.h"
+#include "CCDRecording.h"
+#include "HybridRecording.h"
+#include "ImpulseHistory.h"
+#include "FrameArena.h"
+#include "ImpulseCache.h"
+#include "ContactLCP.h"
+#include "MemoryAccounting.h"
+#include "ImpulseKernels.h"
+#include "SweptBounds.h"
 
 ////////////////////////////////////////////////////////////////////////////////////////////////
 ////////////////////////////////////////////////////////////////////////////////////////////////
@@ -33,99 +44,322 @@ ImpactZone mergeZones(const ImpactZone &z1, const ImpactZone &z2)
 }
 
 
-void mergeAllZones(ImpactZones &zones)
+// Disjoint-set forest over particle indices. Zones and collisions are merged
+// in as they are added, so building disjoint impact zones is a single pass
+// instead of repeated pairwise set intersections. A component involves a
+// half-plane if anything merged into it did. The arrays come from the step's
+// arena, so the forest only lives as long as the scope it was built in.
+class ImpactZoneForest
 {
-    ImpactZones result;
+public:
+    ImpactZoneForest(FrameArena &arena, int nparticles)
+    : m_arena(arena)
+    , m_nparticles(nparticles)
+    , m_parent(arena.allocate<int>(nparticles, -1))
+    , m_rank(arena.allocate<int>(nparticles, 0))
+    , m_halfplane(arena.allocate<char>(nparticles, 0))
+    , m_touched(arena.allocate<int>(nparticles))
+    , m_ntouched(0)
+    , m_empty()
+    {}
     
-    ImpactZones *src = &zones;
-    ImpactZones *dst = &result;
-    do
+    void addZone(const ImpactZone &zone)
     {
-        dst->clear();
-        for(int i=0; i<(int)src->size(); i++)
+        if(zone.m_verts.empty())
         {
-            bool merged = false;
-            for(int j=0; j<(int)dst->size(); j++)
-            {
-                if(intersects((*dst)[j], (*src)[i]))
-                {
-                    ImpactZone newzone = mergeZones((*dst)[j], (*src)[i]);
-                    (*dst)[j] = newzone;
-                    merged = true;
-                    
-                    break;
-                }
-            }
-            if(!merged)
-            {
-                dst->push_back((*src)[i]);
-            }
+            m_empty.push_back(zone);
+            return;
+        }
+        int first = *zone.m_verts.begin();
+        for(std::set<int>::const_iterator it = zone.m_verts.begin(); it != zone.m_verts.end(); ++it)
+        {
+            touch(*it);
+            unite(first, *it);
         }
-        std::swap(src, dst);
+        if(zone.m_halfplane)
+            m_halfplane[find(first)] = true;
     }
-    while(src->size() < dst->size());
     
-    zones = *dst;
-}
-
-void growImpactZones(const TwoDScene &scene, ImpactZones &zones, const std::vector<CollisionInfo> &impulses)
-{
-    for(int i=0; i<(int)impulses.size(); i++)
+    void addCollision(const TwoDScene &scene, const CollisionInfo &info)
     {
-        switch(impulses[i].m_type)
+        int v = info.m_idx1;
+        touch(v);
+        switch(info.m_type)
         {
             case CollisionInfo::PP:
-            {
-                std::set<int> verts;
-                verts.insert(impulses[i].m_idx1);
-                verts.insert(impulses[i].m_idx2);
-                zones.push_back(ImpactZone(verts, false));
+                touch(info.m_idx2);
+                unite(v, info.m_idx2);
                 break;
-            }
             case CollisionInfo::PE:
             {
-                std::set<int> verts;
-                verts.insert(impulses[i].m_idx1);
-                verts.insert(scene.getEdge(impulses[i].m_idx2).first);
-                verts.insert(scene.getEdge(impulses[i].m_idx2).second);
-                zones.push_back(ImpactZone(verts, false));
+                const std::pair<int,int> &edge = scene.getEdge(info.m_idx2);
+                touch(edge.first);
+                touch(edge.second);
+                unite(v, edge.first);
+                unite(v, edge.second);
                 break;
             }
             case CollisionInfo::PH:
-            {
-                std::set<int> verts;
-                verts.insert(impulses[i].m_idx1);
-                zones.push_back(ImpactZone(verts, true));
+                m_halfplane[find(v)] = true;
                 break;
+        }
+    }
+    
+    // The components as impact zones, ordered by the first vertex added to
+    // each. The members are bucketed by a counting sort over the components.
+    void getZones(ImpactZones &zones)
+    {
+        zones.clear();
+        FrameArenaScope scope(m_arena);
+        int *slot = m_arena.allocate<int>(m_nparticles, -1);
+        int *roots = m_arena.allocate<int>(m_ntouched);
+        int *offsets = m_arena.allocate<int>(m_ntouched + 1, 0);
+        int nzones = 0;
+        for(int i = 0; i < m_ntouched; i++)
+        {
+            int root = find(m_touched[i]);
+            if(slot[root] < 0)
+            {
+                slot[root] = nzones;
+                roots[nzones++] = root;
             }
+            offsets[slot[root] + 1]++;
+        }
+        for(int z = 0; z < nzones; z++)
+            offsets[z + 1] += offsets[z];
+        int *next = m_arena.allocate<int>(nzones);
+        std::copy(offsets, offsets + nzones, next);
+        int *members = m_arena.allocate<int>(m_ntouched);
+        for(int i = 0; i < m_ntouched; i++)
+            members[next[slot[find(m_touched[i])]]++] = m_touched[i];
+        
+        zones.reserve(nzones + m_empty.size());
+        for(int z = 0; z < nzones; z++)
+        {
+            std::sort(members + offsets[z], members + offsets[z + 1]);
+            zones.push_back(ImpactZone(std::set<int>(members + offsets[z], members + offsets[z + 1]), m_halfplane[roots[z]] != 0));
+        }
+        zones.insert(zones.end(), m_empty.begin(), m_empty.end());
+    }
+    
+private:
+    ImpactZoneForest(const ImpactZoneForest &);
+    ImpactZoneForest &operator=(const ImpactZoneForest &);
+    
+    // Adds v as a singleton if it is not yet in the forest.
+    void touch(int v)
+    {
+        assert(v >= 0 && v < m_nparticles);
+        if(m_parent[v] < 0)
+        {
+            m_parent[v] = v;
+            m_touched[m_ntouched++] = v;
+        }
+    }
+    
+    int find(int v)
+    {
+        while(m_parent[v] != v)
+        {
+            m_parent[v] = m_parent[m_parent[v]];
+            v = m_parent[v];
         }
+        return v;
     }
-    mergeAllZones(zones);
+    
+    void unite(int a, int b)
+    {
+        a = find(a);
+        b = find(b);
+        if(a == b)
+            return;
+        if(m_rank[a] < m_rank[b])
+            std::swap(a, b);
+        m_parent[b] = a;
+        if(m_rank[a] == m_rank[b])
+            m_rank[a]++;
+        m_halfplane[a] = m_halfplane[a] || m_halfplane[b];
+    }
+    
+    FrameArena &m_arena;
+    int m_nparticles;
+    // Parent of each particle, or -1 for particles in no zone.
+    int *m_parent;
+    int *m_rank;
+    char *m_halfplane;
+    // Particles in the order they were first added.
+    int *m_touched;
+    int m_ntouched;
+    // Zones without vertices overlap nothing and are passed through.
+    ImpactZones m_empty;
+};
+
+// One past the largest vertex in any of the zones.
+int zoneVertexBound(const ImpactZones &zones)
+{
+    int bound = 0;
+    for(int i=0; i<(int)zones.size(); i++)
+        if(!zones[i].m_verts.empty())
+            bound = std::max(bound, *zones[i].m_verts.rbegin() + 1);
+    return bound;
 }
 
-bool zonesEqual(const ImpactZones &zones1, const ImpactZones &zones2)
+void mergeAllZones(ImpactZones &zones)
 {
-    if(zones1.size() != zones2.size())
+    FrameArenaScope scope(framearena::frame());
+    ImpactZoneForest forest(framearena::frame(), zoneVertexBound(zones));
+    for(int i=0; i<(int)zones.size(); i++)
+        forest.addZone(zones[i]);
+    forest.getZones(zones);
+}
+
+// Adds one zone per collision to zones and merges the result into disjoint
+// zones. Existing zones are merged into the forest as they are, so the cost
+// is linear in the number of zone vertices and collisions.
+void growImpactZones(const TwoDScene &scene, ImpactZones &zones, const std::vector<CollisionInfo> &impulses)
+{
+    FrameArenaScope scope(framearena::frame());
+    ImpactZoneForest forest(framearena::frame(), std::max(scene.getNumParticles(), zoneVertexBound(zones)));
+    for(int i=0; i<(int)zones.size(); i++)
+        forest.addZone(zones[i]);
+    for(int i=0; i<(int)impulses.size(); i++)
+        forest.addCollision(scene, impulses[i]);
+    forest.getZones(zones);
+}
+
+namespace
+{
+
+size_t hashZone(const int *begin, const int *end, bool halfplane)
+{
+    // FNV-1a over the vertex indices, seeded by the half-plane flag.
+    size_t h = halfplane ? 2166136261u ^ 0x9e3779b9u : 2166136261u;
+    for(const int *v = begin; v != end; ++v)
+    {
+        h ^= (size_t)(unsigned int)*v;
+        h *= 16777619u;
+    }
+    return h;
+}
+
+struct HashOrder
+{
+    HashOrder(const std::vector<size_t> &hash) : m_hash(hash) {}
+    bool operator()(int a, int b) const { return m_hash[a] < m_hash[b]; }
+    const std::vector<size_t> &m_hash;
+};
+
+}
+
+FlatImpactZones::FlatImpactZones()
+: m_verts()
+, m_offsets(1, 0)
+, m_halfplane()
+, m_hash()
+, m_byhash()
+, m_listhash(0)
+{}
+
+FlatImpactZones::FlatImpactZones(const ImpactZones &zones)
+{
+    assign(zones);
+}
+
+void FlatImpactZones::assign(const ImpactZones &zones)
+{
+    int nverts = 0;
+    for(int i=0; i<(int)zones.size(); i++)
+        nverts += (int)zones[i].m_verts.size();
+    
+    m_verts.resize(nverts);
+    m_offsets.resize(zones.size()+1);
+    m_halfplane.resize(zones.size());
+    m_hash.resize(zones.size());
+    m_listhash = 0;
+    
+    int k = 0;
+    m_offsets[0] = 0;
+    for(int i=0; i<(int)zones.size(); i++)
+    {
+        for(std::set<int>::const_iterator it = zones[i].m_verts.begin(); it != zones[i].m_verts.end(); ++it)
+            m_verts[k++] = *it;
+        m_offsets[i+1] = k;
+        m_halfplane[i] = zones[i].m_halfplane;
+        m_hash[i] = hashZone(begin(i), end(i), zones[i].m_halfplane);
+        m_listhash += m_hash[i];
+    }
+    
+    m_byhash.resize(zones.size());
+    for(int i=0; i<(int)zones.size(); i++)
+        m_byhash[i] = i;
+    std::sort(m_byhash.begin(), m_byhash.end(), HashOrder(m_hash));
+}
+
+void FlatImpactZones::toImpactZones(ImpactZones &zones) const
+{
+    zones.clear();
+    for(int i=0; i<size(); i++)
+        zones.push_back(ImpactZone(std::set<int>(begin(i), end(i)), halfplane(i)));
+}
+
+bool FlatImpactZones::zoneEquals(int zone, const FlatImpactZones &other, int otherzone) const
+{
+    if(m_hash[zone] != other.m_hash[otherzone] || m_halfplane[zone] != other.m_halfplane[otherzone] || numVerts(zone) != other.numVerts(otherzone))
+        return false;
+    return std::equal(begin(zone), end(zone), other.begin(otherzone));
+}
+
+// Both lists are walked in hash order. Zones with distinct hashes are told
+// apart without touching their vertices; only zones whose hashes collide are
+// matched pairwise.
+bool FlatImpactZones::operator==(const FlatImpactZones &other) const
+{
+    if(size() != other.size() || m_listhash != other.m_listhash || m_verts.size() != other.m_verts.size())
         return false;
     
-    for(int i=0; i<(int)zones1.size(); i++)
+    std::vector<bool> matched(size(), false);
+    int i = 0;
+    while(i < size())
     {
-        bool found = false;
-        for(int j=0; j<(int)zones2.size(); j++)
+        size_t h = m_hash[m_byhash[i]];
+        int iend = i;
+        while(iend < size() && m_hash[m_byhash[iend]] == h)
+            iend++;
+        if(other.m_hash[other.m_byhash[i]] != h || (iend < size() && other.m_hash[other.m_byhash[iend]] == h) || other.m_hash[other.m_byhash[iend-1]] != h)
+            return false;
+        
+        for(int a = i; a < iend; a++)
         {
-            if(zones1[i] == zones2[j])
+            bool found = false;
+            for(int b = i; b < iend && !found; b++)
             {
-                found = true;
-                
-                break;
+                if(!matched[b] && zoneEquals(m_byhash[a], other, other.m_byhash[b]))
+                {
+                    matched[b] = true;
+                    found = true;
+                }
             }
+            if(!found)
+                return false;
         }
-        if(!found)
-            return false;
+        i = iend;
     }
     return true;
 }
 
+// Compares the zones through their flat form, in time linear in the number of
+// zone vertices. The flat forms are kept between calls so that comparing
+// reuses their buffers.
+bool zonesEqual(const ImpactZones &zones1, const ImpactZones &zones2)
+{
+    if(zones1.size() != zones2.size())
+        return false;
+    static FlatImpactZones flat1, flat2;
+    flat1.assign(zones1);
+    flat2.assign(zones2);
+    return flat1 == flat2;
+}
+
 
 
 
@@ -142,6 +376,77 @@ bool zonesEqual(const ImpactZones &zones1, const ImpactZones &zones2)
 
 
 
+#ifndef IMPULSE_STALL_LIMIT
+#define IMPULSE_STALL_LIMIT 0
+#endif
+
+#ifndef PGS_ITERATIONS
+#define PGS_ITERATIONS 20
+#endif
+
+std::vector<ImpulseIterationStats> HybridCollisionHandler::s_impulse_stats;
+ImpulseCache HybridCollisionHandler::s_impulse_cache;
+ContactLCP HybridCollisionHandler::s_contact_lcp;
+SharedStageDetection HybridCollisionHandler::s_shared_detection;
+ContactSegments HybridCollisionHandler::s_contact_segments;
+ParticleEdgeTiles HybridCollisionHandler::s_edge_tiles;
+HalfplaneSweep HybridCollisionHandler::s_halfplane_sweep;
+HybridScratch HybridCollisionHandler::s_scratch;
+ContactComponents HybridCollisionHandler::s_contact_components;
+
+size_t HybridScratch::bytesHeld() const
+{
+    return sizeof(scalar)*(qm.size() + qdotm.size() + qprev.size()) + sizeof(CollisionInfo)*collisions.capacity();
+}
+
+namespace
+{
+
+size_t stepCacheBytes()
+{
+    return HybridCollisionHandler::getImpulseCache().bytesHeld() + HybridCollisionHandler::getContactLCP().bytesHeld()
+         + HybridCollisionHandler::getSharedStageDetection().bytesHeld() + HybridCollisionHandler::getContactSegments().bytesHeld()
+         + HybridCollisionHandler::getEdgeTiles().bytesHeld() + HybridCollisionHandler::getHalfplaneSweep().bytesHeld()
+         + HybridCollisionHandler::getScratch().bytesHeld() + HybridCollisionHandler::getContactComponents().bytesHeld();
+}
+
+const bool g_accounted = memoryaccounting::addSource(memoryaccounting::STEP_CACHES, stepCacheBytes);
+
+// A projected Gauss-Seidel solve stops once a sweep changes no contact's
+// normal speed by more than this fraction of the largest.
+const double PGS_TOLERANCE = 1e-6;
+
+// Speed along the collision normal at which the colliding objects move
+// relative to each other between qs and qe.
+double approachSpeed(const TwoDScene &scene, const VectorXs &qs, const VectorXs &qe, double dt, const CollisionInfo &info)
+{
+    double norm = info.m_n.norm();
+    if(norm == 0.0)
+        return 0.0;
+    
+    int v = info.m_idx1;
+    Vector2s relvel = qe.segment<2>(2*v) - qs.segment<2>(2*v);
+    if(info.m_type == CollisionInfo::PP)
+    {
+        relvel -= qe.segment<2>(2*info.m_idx2) - qs.segment<2>(2*info.m_idx2);
+    }
+    else if(info.m_type == CollisionInfo::PE)
+    {
+        // Edge velocity at the point closest to the particle at impact.
+        const std::pair<int,int> &edge = scene.getEdge(info.m_idx2);
+        Vector2s da = qe.segment<2>(2*edge.first) - qs.segment<2>(2*edge.first);
+        Vector2s db = qe.segment<2>(2*edge.second) - qs.segment<2>(2*edge.second);
+        Vector2s x = qs.segment<2>(2*v) + info.m_time*relvel;
+        Vector2s a = qs.segment<2>(2*edge.first) + info.m_time*da;
+        Vector2s e = qs.segment<2>(2*edge.second) + info.m_time*db - a;
+        double alpha = e.squaredNorm() > 0.0 ? std::max(0.0, std::min(1.0, (x-a).dot(e)/e.squaredNorm())) : 0.0;
+        relvel -= (1.0-alpha)*da + alpha*db;
+    }
+    return fabs(relvel.dot(info.m_n))/(norm*dt);
+}
+
+}
+
 // Iteratively performs collision detection and interative impulse response until either there are no more detected collisions, or the maximum number of
 // iterations has been reached. See the assignment instructions for more details.
 // The maximum number of iterations is stored in the member variable m_maxiters.
@@ -160,9 +465,485 @@ bool zonesEqual(const ImpactZones &zones1, const ImpactZones &zones2)
 // Possibly useful functions: detectCollisions, applyImpulses.
 bool HybridCollisionHandler::applyIterativeImpulses(const TwoDScene &scene, const VectorXs &qs, const VectorXs &qe, const VectorXs &qdote, double dt, VectorXs &qefinal, VectorXs &qdotefinal)
 {	
-    // Your code goes here!
+    phasetiming::beginFrame();
+    memoryaccounting::checkIn(scene, *this);
+    impulsehistory::endStep(qs);
+    framearena::frame().reset();
+    ccdrecording::recordFrame(scene, qs, qe);
+    ScopedPhaseTimer impulses(phasetiming::IMPULSES);
+    qefinal = qe;
+    qdotefinal = qdote;
+    s_impulse_stats.clear();
+    
+#ifdef CONTACT_COMPONENTS
+    // The components are swept in parallel, which would reorder the CCD
+    // polynomials logged, so they are only split while none are.
+    if(PolynomialIntervalSolver::currentContext().getLog() == NULL)
+    {
+        const bool collisionfree = applyImpulsesByComponent(scene, qs, dt, qefinal, qdotefinal);
+        hybridrecording::recordPostImpulses(qefinal, qdotefinal);
+        return collisionfree;
+    }
+#endif
+    
+#if defined(PGS_CONTACTS)
+    // The contacts still touching from the last step are solved before the
+    // first pass, which then only finds what they leave.
+    s_contact_lcp.beginStep(*this, scene, qs, dt, qefinal, qdotefinal);
+    s_contact_lcp.solve(qs, dt, PGS_ITERATIONS, PGS_TOLERANCE, qefinal, qdotefinal);
+#elif defined(IMPULSE_WARM_START)
+    // Contacts that carried an impulse last step and still press together
+    // start from IMPULSE_WARM_START of it; the sweeps add what is missing.
+    // Over the memory budget the cache is dropped and every step starts
+    // from nothing.
+    const bool warmstart = !memoryaccounting::overBudget();
+    if(warmstart)
+        s_impulse_cache.warmStart(*this, scene, qs, dt, IMPULSE_WARM_START, qefinal, qdotefinal);
+    else if(s_impulse_cache.bytesHeld() > 0)
+        s_impulse_cache.release();
+#endif
+    
+    // With IMPULSE_STALL_LIMIT > 0, hand over to the failsafe once that many
+    // sweeps in a row have failed to bring the collision count below its
+    // lowest so far.
+    int fewest = std::numeric_limits<int>::max();
+    int stalled = 0;
+    bool collisionfree = false;
+    
+    // Each sweep writes into the scratch states and swaps them with the
+    // current ones, so the scratch holds the scene's two spare buffers from
+    // one call to the next.
+    VectorXs &qm = s_scratch.qm;
+    VectorXs &qdotm = s_scratch.qdotm;
+    for(int itr=0; itr<m_maxiters; itr++)
+    {
+        ScopedPhaseTimer detection(phasetiming::NARROW_PHASE);
+#ifdef SHARED_STAGE_DETECTION
+        // Each sweep after the first re-detects only around the particles the
+        // previous one moved.
+        if(itr == 0)
+            s_shared_detection.detect(*this, scene, qs, qefinal);
+        else
+            s_shared_detection.update(*this, scene, qefinal);
+        const std::vector<CollisionInfo> &collisions = s_shared_detection.getCollisions();
+#else
+        std::vector<CollisionInfo> collisions = detectCollisions(scene, qs, qefinal);
+#endif
+        detection.stop();
+        PROFILE_COUNT(phasetiming::IMPULSE_ITERATIONS, 1);
+        PROFILE_COUNT(phasetiming::CONTACTS, collisions.size());
+        
+        double max_approach = 0.0;
+        for(int i=0; i<(int)collisions.size(); i++)
+            max_approach = std::max(max_approach, approachSpeed(scene, qs, qefinal, dt, collisions[i]));
+        s_impulse_stats.push_back(ImpulseIterationStats((int)collisions.size(), max_approach));
+        
+        if(collisions.empty())
+        {
+            collisionfree = true;
+            break;
+        }
+        
+        if((int)collisions.size() < fewest)
+        {
+            fewest = (int)collisions.size();
+            stalled = 0;
+        }
+        else if(IMPULSE_STALL_LIMIT > 0 && ++stalled >= IMPULSE_STALL_LIMIT)
+            break;
+        
+#if defined(PGS_CONTACTS)
+        // The pass's contacts join those of earlier passes in one solve, so
+        // a pass only has to find the contacts the last solve made.
+        s_contact_lcp.addContacts(*this, scene, qs, dt, collisions, qefinal);
+        s_contact_lcp.solve(qs, dt, PGS_ITERATIONS, PGS_TOLERANCE, qefinal, qdotefinal);
+#else
+#ifdef IMPULSE_WARM_START
+        if(warmstart)
+            s_impulse_cache.addSweep(*this, scene, qs, qefinal, dt, collisions);
+#endif
+#ifdef COLORED_IMPULSES
+        applyImpulsesByColor(scene, collisions, qs, qefinal, qdotefinal, dt, qm, qdotm);
+#else
+        applySpecializedImpulses(scene, collisions, qs, qefinal, qdotefinal, dt, qm, qdotm);
+#endif
+        qefinal.swap(qm);
+        qdotefinal.swap(qdotm);
+#endif
+    }
+    
+#if defined(PGS_CONTACTS)
+    s_contact_lcp.endStep();
+#elif defined(IMPULSE_WARM_START)
+    if(warmstart)
+        s_impulse_cache.endStep();
+#endif
+    hybridrecording::recordPostImpulses(qefinal, qdotefinal);
+    return collisionfree;
+}
 
-    return false;
+namespace
+{
+
+// Tests every pair of the component laid out in sub from sub.qs to sub.qe, as
+// detectCollisions does a whole scene, into sub.collisions. Pairs of fixed
+// particles alone are left out, as no response moves them.
+void detectComponent(HybridCollisionHandler &handler, ComponentScene &sub)
+{
+    const TwoDScene &scene = sub.scene;
+    const int nparticles = scene.getNumParticles();
+    const std::vector<std::pair<int,int> > &edges = scene.getEdges();
+    Vector2s n;
+    double time;
+    
+    sub.collisions.clear();
+    for(int i=0; i<sub.nfree; i++)
+    {
+        for(int j=i+1; j<nparticles; j++)
+        {
+            PROFILE_COUNT(phasetiming::BROAD_PHASE_CANDIDATES, 1);
+            if(handler.detectParticleParticle(scene, sub.qs, sub.qe, i, j, n, time))
+                sub.collisions.push_back(CollisionInfo(CollisionInfo::PP, i, j, n, time));
+        }
+    }
+    for(int i=0; i<nparticles; i++)
+    {
+        for(int e=0; e<(int)edges.size(); e++)
+        {
+            if(edges[e].first == i || edges[e].second == i)
+                continue;
+            if(i >= sub.nfree && scene.isFixed(edges[e].first) && scene.isFixed(edges[e].second))
+                continue;
+            PROFILE_COUNT(phasetiming::BROAD_PHASE_CANDIDATES, 1);
+            if(handler.detectParticleEdge(scene, sub.qs, sub.qe, i, e, n, time))
+                sub.collisions.push_back(CollisionInfo(CollisionInfo::PE, i, e, n, time));
+        }
+        if(i >= sub.nfree)
+            continue;
+        for(int h=0; h<scene.getNumHalfplanes(); h++)
+        {
+            PROFILE_COUNT(phasetiming::BROAD_PHASE_CANDIDATES, 1);
+            if(handler.detectParticleHalfplane(scene, sub.qs, sub.qe, i, h, n, time))
+                sub.collisions.push_back(CollisionInfo(CollisionInfo::PH, i, h, n, time));
+        }
+    }
+}
+
+// Sweeps the component laid out in sub, starting from the collisions it was
+// loaded with, until it is collision-free or maxsweeps have run. Returns the
+// sweeps run, and sets stalled if IMPULSE_STALL_LIMIT ended them.
+int sweepComponent(HybridCollisionHandler &handler, ComponentScene &sub, double dt, int maxsweeps, bool &stalled)
+{
+    int fewest = std::numeric_limits<int>::max();
+    int unchanged = 0;
+    for(int sweep=0; sweep<maxsweeps; sweep++)
+    {
+        if(sweep > 0)
+            detectComponent(handler, sub);
+        if(sub.collisions.empty())
+            return sweep;
+        
+        if((int)sub.collisions.size() < fewest)
+        {
+            fewest = (int)sub.collisions.size();
+            unchanged = 0;
+        }
+        else if(IMPULSE_STALL_LIMIT > 0 && ++unchanged >= IMPULSE_STALL_LIMIT)
+        {
+            stalled = true;
+            return sweep;
+        }
+        
+        handler.applySpecializedImpulses(sub.scene, sub.collisions, sub.qs, sub.qe, sub.qdote, dt, sub.qm, sub.qdotm);
+        sub.qe.swap(sub.qm);
+        sub.qdote.swap(sub.qdotm);
+    }
+    return maxsweeps;
+}
+
+}
+
+// applyIterativeImpulses by rounds. Each round detects the whole scene and
+// splits its collisions into the components of the contact graph; no
+// response to one component's collisions moves a particle of another, so each
+// is swept to its own end, or to the sweeps left, independently of the rest
+// and with OpenMP in parallel, each thread solving with its own solver
+// context. A component's sweeps after its first only test the pairs within
+// it, so the round closes with the next one's detection of the whole scene,
+// which finds any collisions the sweeps made between components. A round
+// spends as many of m_maxiters as its longest component took.
+//
+// The components are swept from the same state whichever thread takes them
+// and their results are written to disjoint particles, so the outcome does
+// not depend on the number of threads. s_impulse_stats has an entry per round
+// rather than per sweep.
+bool HybridCollisionHandler::applyImpulsesByComponent(const TwoDScene &scene, const VectorXs &qs, double dt, VectorXs &qefinal, VectorXs &qdotefinal)
+{
+    std::vector<CollisionInfo> &collisions = s_scratch.collisions;
+    int spent = 0;
+    bool stalled = false;
+    for(;;)
+    {
+        ScopedPhaseTimer detection(phasetiming::NARROW_PHASE);
+        collisions = detectCollisions(scene, qs, qefinal);
+        detection.stop();
+        PROFILE_COUNT(phasetiming::CONTACTS, collisions.size());
+        
+        double max_approach = 0.0;
+        for(int i=0; i<(int)collisions.size(); i++)
+            max_approach = std::max(max_approach, approachSpeed(scene, qs, qefinal, dt, collisions[i]));
+        s_impulse_stats.push_back(ImpulseIterationStats((int)collisions.size(), max_approach));
+        
+        if(collisions.empty())
+            return true;
+        if(stalled || spent >= m_maxiters)
+            return false;
+        
+        s_contact_components.build(scene, collisions);
+        const int ncomponents = s_contact_components.size();
+        const int budget = m_maxiters - spent;
+        int taken = 0;
+        
+#ifdef _OPENMP
+        #pragma omp parallel if(ncomponents > 1)
+#endif
+        {
+            PolynomialSolverContext context;
+            ScopedSolverContext current(context);
+            ComponentScene sub;
+#ifdef _OPENMP
+            #pragma omp for schedule(dynamic,1) reduction(max:taken) reduction(||:stalled)
+#endif
+            for(int c=0; c<ncomponents; c++)
+            {
+                ScopedTraceEvent span("impulse_component");
+                sub.load(scene, s_contact_components, c, qs, qefinal, qdotefinal, collisions);
+                bool componentstalled = false;
+                taken = std::max(taken, sweepComponent(*this, sub, dt, budget, componentstalled));
+                stalled = stalled || componentstalled;
+                sub.store(qefinal, qdotefinal);
+            }
+        }
+        
+        // A round in which no component swept, as when the only collisions
+        // left are between fixed particles, still spends one.
+        taken = std::max(taken, 1);
+        PROFILE_COUNT(phasetiming::IMPULSE_ITERATIONS, taken);
+        spent += taken;
+    }
+}
+
+namespace
+{
+
+// Below this many collisions a color is responded to serially.
+const int PARALLEL_MIN_COLLISIONS = 64;
+
+// The particles whose positions and velocities a response to the collision
+// changes.
+int collisionParticles(const TwoDScene &scene, const CollisionInfo &info, int *particles)
+{
+    particles[0] = info.m_idx1;
+    if(info.m_type == CollisionInfo::PP)
+    {
+        particles[1] = info.m_idx2;
+        return 2;
+    }
+    if(info.m_type == CollisionInfo::PE)
+    {
+        const std::pair<int,int> &edge = scene.getEdge(info.m_idx2);
+        particles[1] = edge.first;
+        particles[2] = edge.second;
+        return 3;
+    }
+    return 1;
+}
+
+// Partitions the collisions into colors, no two of which in the same color
+// share a particle, and returns the number of colors. order lists the
+// collisions color by color, each color in list order, and color c is
+// order[begin[c]] to order[begin[c+1]-1]. Both are allocated from arena.
+//
+// By default each collision gets the color after the last one used by any of
+// its particles, so every particle sees its collisions in list order. With
+// GREEDY_IMPULSE_COLORS each takes the lowest color its particles leave free,
+// which needs fewer colors but changes the order impulses are summed in.
+int colorCollisions(const TwoDScene &scene, const std::vector<CollisionInfo> &collisions, FrameArena &arena, int *&order, int *&begin)
+{
+    const int ncollisions = (int)collisions.size();
+    int *color = arena.allocate<int>(ncollisions);
+    int ncolors = 0;
+    
+#ifdef GREEDY_IMPULSE_COLORS
+    std::vector<std::vector<int> > used(scene.getNumParticles());
+#else
+    int *last = arena.allocate<int>(scene.getNumParticles(), -1);
+#endif
+    
+    for(int k=0; k<ncollisions; k++)
+    {
+        int particles[3];
+        int np = collisionParticles(scene, collisions[k], particles);
+#ifdef GREEDY_IMPULSE_COLORS
+        int c = 0;
+        for(bool taken = true; taken; )
+        {
+            taken = false;
+            for(int i=0; i<np && !taken; i++)
+                taken = std::find(used[particles[i]].begin(), used[particles[i]].end(), c) != used[particles[i]].end();
+            if(taken)
+                c++;
+        }
+        for(int i=0; i<np; i++)
+            used[particles[i]].push_back(c);
+#else
+        int c = 0;
+        for(int i=0; i<np; i++)
+            c = std::max(c, last[particles[i]] + 1);
+        for(int i=0; i<np; i++)
+            last[particles[i]] = c;
+#endif
+        color[k] = c;
+        ncolors = std::max(ncolors, c + 1);
+    }
+    
+    // Counting sort by color, stable so each color stays in list order.
+    begin = arena.allocate<int>(ncolors + 1, 0);
+    for(int k=0; k<ncollisions; k++)
+        begin[color[k] + 1]++;
+    for(int c=0; c<ncolors; c++)
+        begin[c + 1] += begin[c];
+    int *next = arena.allocate<int>(ncolors);
+    std::copy(begin, begin + ncolors, next);
+    order = arena.allocate<int>(ncollisions);
+    for(int k=0; k<ncollisions; k++)
+        order[next[color[k]]++] = k;
+    return ncolors;
+}
+
+}
+
+namespace
+{
+
+// Responds to each collision in list order, from qs and qe, into qm and
+// qdotm, as applyImpulses does.
+struct ImpulseSweep
+{
+    const TwoDScene &scene;
+    const std::vector<CollisionInfo> &collisions;
+    const VectorXs &qs;
+    const VectorXs &qe;
+    double dt;
+    double COR;
+    VectorXs &qm;
+    VectorXs &qdotm;
+    
+    template<class Kernels>
+    void run() const
+    {
+        for(int k=0; k<(int)collisions.size(); k++)
+        {
+            const CollisionInfo &info = collisions[k];
+            switch(info.m_type)
+            {
+                case CollisionInfo::PP:
+                    Kernels::respondParticleParticle(scene, qs, qe, info.m_idx1, info.m_idx2, info.m_n, dt, COR, qm, qdotm);
+                    break;
+                case CollisionInfo::PE:
+                    Kernels::respondParticleEdge(scene, qs, qe, info.m_idx1, info.m_idx2, info.m_n, info.m_time, dt, COR, qm, qdotm);
+                    break;
+                case CollisionInfo::PH:
+                    Kernels::respondParticleHalfplane(qs, qe, info.m_idx1, info.m_n, dt, COR, qm, qdotm);
+                    break;
+            }
+        }
+    }
+};
+
+// As ImpulseSweep, color by color, with the responses within a color
+// applied concurrently.
+struct ColoredImpulseSweep
+{
+    const TwoDScene &scene;
+    const std::vector<CollisionInfo> &collisions;
+    const int *order;
+    const int *begin;
+    int ncolors;
+    const VectorXs &qs;
+    const VectorXs &qe;
+    double dt;
+    double COR;
+    VectorXs &qm;
+    VectorXs &qdotm;
+    
+    template<class Kernels>
+    void run() const
+    {
+        for(int c=0; c<ncolors; c++)
+        {
+#ifdef _OPENMP
+            #pragma omp parallel if(begin[c+1] - begin[c] >= PARALLEL_MIN_COLLISIONS)
+#endif
+            {
+                // Each thread's share of the color, for the trace.
+                ScopedTraceEvent share("impulse_color");
+#ifdef _OPENMP
+                #pragma omp for schedule(static)
+#endif
+                for(int k=begin[c]; k<begin[c+1]; k++)
+                {
+                    const CollisionInfo &info = collisions[order[k]];
+                    switch(info.m_type)
+                    {
+                        case CollisionInfo::PP:
+                            Kernels::respondParticleParticle(scene, qs, qe, info.m_idx1, info.m_idx2, info.m_n, dt, COR, qm, qdotm);
+                            break;
+                        case CollisionInfo::PE:
+                            Kernels::respondParticleEdge(scene, qs, qe, info.m_idx1, info.m_idx2, info.m_n, info.m_time, dt, COR, qm, qdotm);
+                            break;
+                        case CollisionInfo::PH:
+                            Kernels::respondParticleHalfplane(qs, qe, info.m_idx1, info.m_n, dt, COR, qm, qdotm);
+                            break;
+                    }
+                }
+            }
+        }
+    }
+};
+
+}
+
+// Same as applyImpulses, with the response kernels specialised on the
+// scene's coefficient of restitution and on whether it has fixed particles,
+// chosen once for the sweep. applyImpulses is the base library's, whose
+// responses decide both for every collision.
+void HybridCollisionHandler::applySpecializedImpulses(const TwoDScene &scene, const std::vector<CollisionInfo> &collisions, const VectorXs &qs, const VectorXs &qe, const VectorXs &qdote, double dt, VectorXs &qm, VectorXs &qdotm)
+{
+    qm = qe;
+    qdotm = qdote;
+    
+    const ImpulseSweep sweep = {scene, collisions, qs, qe, dt, getCOR(), qm, qdotm};
+    dispatchResponse(ResponseMode(scene, getCOR()), sweep);
+}
+
+// Same as applySpecializedImpulses, but the collisions are split into colors
+// that share no particles and the responses within a color are applied
+// concurrently. Each response adds an impulse computed from qs and qe alone,
+// so this is a Jacobi sweep whatever the schedule, and colors only keep the
+// writes apart. The result does not depend on the number of threads; with
+// the default coloring it is also identical to applyImpulses.
+void HybridCollisionHandler::applyImpulsesByColor(const TwoDScene &scene, const std::vector<CollisionInfo> &collisions, const VectorXs &qs, const VectorXs &qe, const VectorXs &qdote, double dt, VectorXs &qm, VectorXs &qdotm)
+{
+    qm = qe;
+    qdotm = qdote;
+    
+    FrameArenaScope scope(framearena::frame());
+    int *order, *begin;
+    const int ncolors = colorCollisions(scene, collisions, framearena::frame(), order, begin);
+    
+    const ColoredImpulseSweep sweep = {scene, collisions, order, begin, ncolors, qs, qe, dt, getCOR(), qm, qdotm};
+    dispatchResponse(ResponseMode(scene, getCOR()), sweep);
 }
 
 
@@ -202,6 +983,242 @@ void HybridCollisionHandler::performFailsafe(const TwoDScene &scene, const Vecto
 }
 
 
+namespace
+{
+
+struct LargerZone
+{
+    const ImpactZones &zones;
+    LargerZone(const ImpactZones &z) : zones(z) {}
+    bool operator()(int a, int b) const {return zones[a].m_verts.size() > zones[b].m_verts.size();}
+};
+
+}
+
+// Applies performFailsafe to every zone. The zones are disjoint and the
+// failsafe only writes the entries of qe and qdote that belong to its zone,
+// so with OpenMP the zones run in parallel without locking. They are handed
+// out largest first so that one big pile-up does not finish last.
+void HybridCollisionHandler::performFailsafeOnZones(const TwoDScene &scene, const VectorXs &oldpos, const ImpactZones &zones, double dt, VectorXs &qe, VectorXs &qdote)
+{
+    FrameArenaScope scope(framearena::frame());
+    const int nzones = (int)zones.size();
+    int *order = framearena::frame().allocate<int>(nzones);
+    for(int i=0; i<nzones; i++)
+        order[i] = i;
+    std::stable_sort(order, order + nzones, LargerZone(zones));
+    
+#ifdef _OPENMP
+    #pragma omp parallel for schedule(dynamic,1) if(nzones > 1)
+#endif
+    for(int i=0; i<nzones; i++)
+    {
+        ScopedTraceEvent span("failsafe_zone");
+        performFailsafe(scene, oldpos, zones[order[i]], dt, qe, qdote);
+    }
+}
+
+
+namespace
+{
+
+// Particles, and edges, per chunk of the parallel detection.
+const int DETECTION_CHUNK = 64;
+
+// Below this many candidate pairs touching moved particles, detection runs
+// serially.
+const int PARALLEL_MIN_CANDIDATES = 16384;
+
+// The pairs of the moved particles from begin to end, as
+// detectCollisionsTouching takes them.
+//
+// Built with CCD_EDGE_TILES, the particle-edge pairs that pass the swept
+// boxes are detected first, an edge at a time through tiles, and their
+// collisions and logged polynomials put back below where the loop over the
+// edges would have found them.
+//
+// Where closedFormHalfplanes allows, the particles are measured against every
+// half-plane in one sweep first, and their half-plane tests read the
+// distances from halfplanes.
+void detectMovedParticles(HybridCollisionHandler &handler, const TwoDScene &scene, const VectorXs &qs, const VectorXs &qe, const SweptTrajectories &trajectories, const bool *moved, int begin, int end, ParticleEdgeTiles &tiles, HalfplaneSweep &halfplanes, std::vector<CollisionInfo> &collisions)
+{
+    const int nparticles = scene.getNumParticles();
+    const std::vector<std::pair<int,int> > &edges = scene.getEdges();
+    Vector2s n;
+    double time;
+    
+#ifdef CCD_EDGE_TILES
+    tiles.clear();
+    for(int i=begin; i<end; i++)
+    {
+        if(!moved[i])
+            continue;
+        for(int e=0; e<(int)edges.size(); e++)
+        {
+            if(edges[e].first == i || edges[e].second == i)
+                continue;
+            PROFILE_COUNT(phasetiming::BROAD_PHASE_CANDIDATES, 1);
+            if(sweptParticleEdgeMayCollide(scene, qs, qe, i, e))
+                tiles.add(i, e);
+        }
+    }
+    handler.detectParticleEdgeTiles(scene, qs, qe, trajectories, tiles);
+    std::vector<Polynomial> *log = PolynomialIntervalSolver::currentContext().getLog();
+    int next = 0;
+#else
+    (void)tiles;
+#endif
+    const bool closedform = closedFormHalfplanes() && scene.getNumHalfplanes() > 0;
+    if(closedform)
+        halfplanes.sweep(scene, qs, qe, begin, end);
+    
+    for(int i=begin; i<end; i++)
+    {
+        if(!moved[i])
+            continue;
+        
+        // Pairs of moved particles are tested once, from the lower index.
+        for(int j=0; j<nparticles; j++)
+        {
+            if(j == i || (moved[j] && j < i))
+                continue;
+            int a = std::min(i,j), b = std::max(i,j);
+            PROFILE_COUNT(phasetiming::BROAD_PHASE_CANDIDATES, 1);
+            if(handler.detectParticleParticle(scene, qs, qe, a, b, n, time))
+                collisions.push_back(CollisionInfo(CollisionInfo::PP, a, b, n, time));
+        }
+        
+#ifdef CCD_EDGE_TILES
+        int run = next;
+        while(run < tiles.size() && tiles.particle(run) == i)
+            run++;
+        tiles.gather(next, run, collisions, log);
+        next = run;
+#else
+        for(int e=0; e<(int)edges.size(); e++)
+        {
+            if(edges[e].first == i || edges[e].second == i)
+                continue;
+            PROFILE_COUNT(phasetiming::BROAD_PHASE_CANDIDATES, 1);
+            if(handler.detectParticleEdge(scene, qs, qe, trajectories, i, e, n, time))
+                collisions.push_back(CollisionInfo(CollisionInfo::PE, i, e, n, time));
+        }
+#endif
+        
+        for(int h=0; h<scene.getNumHalfplanes(); h++)
+        {
+            PROFILE_COUNT(phasetiming::BROAD_PHASE_CANDIDATES, 1);
+            if(closedform ? halfplanes.detect(i, h, n, time) : handler.detectParticleHalfplane(scene, qs, qe, i, h, n, time))
+                collisions.push_back(CollisionInfo(CollisionInfo::PH, i, h, n, time));
+        }
+    }
+}
+
+// Edges from begin to end that moved against particles that did not; the
+// rest are covered by detectMovedParticles. The loop is by edge already, so
+// with CCD_EDGE_TILES the tiles come out in the order the pairs were added.
+void detectMovedEdges(HybridCollisionHandler &handler, const TwoDScene &scene, const VectorXs &qs, const VectorXs &qe, const SweptTrajectories &trajectories, const bool *moved, int begin, int end, ParticleEdgeTiles &tiles, std::vector<CollisionInfo> &collisions)
+{
+    const int nparticles = scene.getNumParticles();
+    const std::vector<std::pair<int,int> > &edges = scene.getEdges();
+#ifdef CCD_EDGE_TILES
+    tiles.clear();
+#else
+    (void)tiles;
+    Vector2s n;
+    double time;
+#endif
+    
+    for(int e=begin; e<end; e++)
+    {
+        if(!moved[edges[e].first] && !moved[edges[e].second])
+            continue;
+        for(int i=0; i<nparticles; i++)
+        {
+            if(moved[i] || edges[e].first == i || edges[e].second == i)
+                continue;
+            PROFILE_COUNT(phasetiming::BROAD_PHASE_CANDIDATES, 1);
+#ifdef CCD_EDGE_TILES
+            if(sweptParticleEdgeMayCollide(scene, qs, qe, i, e))
+                tiles.add(i, e);
+#else
+            if(handler.detectParticleEdge(scene, qs, qe, trajectories, i, e, n, time))
+                collisions.push_back(CollisionInfo(CollisionInfo::PE, i, e, n, time));
+#endif
+        }
+    }
+#ifdef CCD_EDGE_TILES
+    handler.detectParticleEdgeTiles(scene, qs, qe, trajectories, tiles);
+    tiles.gather(0, tiles.size(), collisions, PolynomialIntervalSolver::currentContext().getLog());
+#endif
+}
+
+}
+
+// Same as detectCollisions, but only tests pairs that involve at least one
+// particle flagged in moved, at a cost proportional to the number of such
+// particles rather than to the number of pairs in the scene. The collisions
+// replace the contents of collisions, whose storage is reused.
+//
+// With OpenMP and enough candidates, the moved particles and then the edges
+// are split into chunks detected in parallel, each thread solving with its
+// own solver context, into the per-chunk lists of s_contact_segments. Those
+// are gathered in chunk order, so the collisions, and the CCD polynomials
+// logged, are the same as serial detection's, in the same order.
+void HybridCollisionHandler::detectCollisionsTouching(const TwoDScene &scene, const VectorXs &qs, const VectorXs &qe, const bool *moved, std::vector<CollisionInfo> &collisions)
+{
+    collisions.clear();
+    const int nparticles = scene.getNumParticles();
+    const int nedges = scene.getNumEdges();
+    FrameArenaScope scratch(framearena::frame());
+    SweptTrajectories trajectories(scene, qs, qe, framearena::frame());
+    
+#ifdef _OPENMP
+    long long nmoved = 0;
+    for(int i=0; i<nparticles; i++)
+        nmoved += moved[i];
+    if(nmoved*(nparticles + nedges + scene.getNumHalfplanes()) >= PARALLEL_MIN_CANDIDATES)
+    {
+        const int particlechunks = (nparticles + DETECTION_CHUNK - 1)/DETECTION_CHUNK;
+        const int edgechunks = (nedges + DETECTION_CHUNK - 1)/DETECTION_CHUNK;
+        std::vector<Polynomial> *log = PolynomialIntervalSolver::currentContext().getLog();
+        s_contact_segments.reset(particlechunks + edgechunks);
+        
+#ifdef _OPENMP
+        #pragma omp parallel
+#endif
+        {
+            PolynomialSolverContext context;
+            ScopedSolverContext current(context);
+            ParticleEdgeTiles tiles;
+            HalfplaneSweep halfplanes;
+#ifdef _OPENMP
+            #pragma omp for schedule(dynamic,1)
+#endif
+            for(int c=0; c<particlechunks + edgechunks; c++)
+            {
+                ScopedTraceEvent span("detect_chunk");
+                context.setLog(s_contact_segments.log(c, log != NULL));
+                if(c < particlechunks)
+                    detectMovedParticles(*this, scene, qs, qe, trajectories, moved, c*DETECTION_CHUNK, std::min(nparticles, (c+1)*DETECTION_CHUNK), tiles, halfplanes, s_contact_segments.segment(c));
+                else
+                {
+                    const int e = (c - particlechunks)*DETECTION_CHUNK;
+                    detectMovedEdges(*this, scene, qs, qe, trajectories, moved, e, std::min(nedges, e + DETECTION_CHUNK), tiles, s_contact_segments.segment(c));
+                }
+            }
+        }
+        
+        s_contact_segments.gather(collisions, log);
+        return;
+    }
+#endif
+    
+    detectMovedParticles(*this, scene, qs, qe, trajectories, moved, 0, nparticles, s_edge_tiles, s_halfplane_sweep, collisions);
+    detectMovedEdges(*this, scene, qs, qe, trajectories, moved, 0, nedges, s_edge_tiles, collisions);
+}
+
+
 // Performs iterative geometric collision response until collision-free end-of-time-step positions and velocities are found. See the assignment
 // instructions for details.
 // Inputs:
@@ -241,7 +1258,64 @@ void HybridCollisionHandler::applyGeometricCollisionHandling(const TwoDScene &sc
     // 9. Set Z=Z' and goto step4.
     //
     
-    // Your code goes here!
-
+    ScopedPhaseTimer failsafe(phasetiming::FAILSAFE);
+    ScopedPhaseTimer detection(phasetiming::NARROW_PHASE);
+    std::vector<CollisionInfo> &collisions = s_scratch.collisions;
+#ifdef SHARED_STAGE_DETECTION
+    // The impulse sweeps usually leave off at or one response short of qe.
+    if(s_shared_detection.covers(qs, qe))
+        s_shared_detection.update(*this, scene, qe);
+    else
+        s_shared_detection.detect(*this, scene, qs, qe);
+    collisions.assign(s_shared_detection.getCollisions().begin(), s_shared_detection.getCollisions().end());
+#else
+    collisions = detectCollisions(scene, qs, qe);
+#endif
+    detection.stop();
+    PROFILE_COUNT(phasetiming::CONTACTS, collisions.size());
+    qm = qe;
+    qdotm = qdote;
+    hybridrecording::recordFailsafeStart(qm, qdotm);
+    growImpactZones(scene, Z, collisions);
+    
+#ifdef INCREMENTAL_ZONE_DETECTION
+    VectorXs &qprev = s_scratch.qprev;
+#endif
+    
+    // Zones only ever grow, so this terminates.
+    for(int iter=0; !Z.empty(); iter++)
+    {
+#ifdef INCREMENTAL_ZONE_DETECTION
+        // Pairs whose particles the failsafe left alone give the same result
+        // as in the previous detection, which is already part of Z.
+        qprev = qm;
+#endif
+        performFailsafeOnZones(scene, qs, Z, dt, qm, qdotm);
+        hybridrecording::recordImpactZones(Z, qm, qdotm, iter);
+        
+#ifdef INCREMENTAL_ZONE_DETECTION
+        FrameArenaScope scope(framearena::frame());
+        bool *moved = framearena::frame().allocate<bool>(scene.getNumParticles());
+        for(int i=0; i<scene.getNumParticles(); i++)
+            moved[i] = qm.segment<2>(2*i) != qprev.segment<2>(2*i);
+        ScopedPhaseTimer redetection(phasetiming::NARROW_PHASE);
+        detectCollisionsTouching(scene, qs, qm, moved, collisions);
+#else
+        ScopedPhaseTimer redetection(phasetiming::NARROW_PHASE);
+        collisions = detectCollisions(scene, qs, qm);
+#endif
+        redetection.stop();
+        PROFILE_COUNT(phasetiming::CONTACTS, collisions.size());
+        Zprime = Z;
+        growImpactZones(scene, Zprime, collisions);
+        if(zonesEqual(Z, Zprime))
+            break;
+        Z.swap(Zprime);
+    }
+    
+#ifdef PROFILE_COUNTERS
+    for(int i=0; i<(int)Z.size(); i++)
+        phasetiming::countImpactZone((int)Z[i].m_verts.size());
+#endif
 }
 
@@ -6,6 +6,12 @@
 #include <set>
 #include <list>
 #include "ContinuousTimeCollisionHandler.h"
+#include "ImpulseCache.h"
+#include "ContactLCP.h"
+#include "SharedStageDetection.h"
+#include "ContactSegments.h"
+#include "HalfplaneSweep.h"
+#include "ContactComponents.h"
 
 struct ImpactZone
 {
@@ -38,6 +44,68 @@ struct ImpactZone
 
 typedef std::vector<ImpactZone> ImpactZones;
 
+// Compact, read-only form of a list of impact zones. The sorted vertices of
+// all zones share one buffer and each zone is a span into it, with its
+// half-plane flag and a hash of both cached so that most comparisons between
+// zones are decided without looking at their vertices. ImpactZone itself is
+// serialized by the base library and keeps its layout.
+class FlatImpactZones
+{
+public:
+    FlatImpactZones();
+    explicit FlatImpactZones(const ImpactZones &zones);
+    
+    void assign(const ImpactZones &zones);
+    void toImpactZones(ImpactZones &zones) const;
+    
+    int size() const { return (int)m_hash.size(); }
+    const int *begin(int zone) const { return data() + m_offsets[zone]; }
+    const int *end(int zone) const { return data() + m_offsets[zone+1]; }
+    int numVerts(int zone) const { return m_offsets[zone+1] - m_offsets[zone]; }
+    bool halfplane(int zone) const { return m_halfplane[zone] != 0; }
+    size_t hash(int zone) const { return m_hash[zone]; }
+    
+    // True if both lists contain the same zones, in any order.
+    bool operator==(const FlatImpactZones &other) const;
+    
+private:
+    const int *data() const { return m_verts.empty() ? NULL : &m_verts[0]; }
+    bool zoneEquals(int zone, const FlatImpactZones &other, int otherzone) const;
+    
+    std::vector<int> m_verts;
+    std::vector<int> m_offsets;
+    std::vector<char> m_halfplane;
+    std::vector<size_t> m_hash;
+    // Zones ordered by hash, for comparing lists without regard to order.
+    std::vector<int> m_byhash;
+    // Order-independent hash of the whole list.
+    size_t m_listhash;
+};
+
+// One detect-and-respond sweep of HybridCollisionHandler::applyIterativeImpulses.
+struct ImpulseIterationStats
+{
+    ImpulseIterationStats(int collisions, double max_approach) : m_collisions(collisions), m_max_approach(max_approach) {}
+    int m_collisions;
+    // Largest normal relative speed over the step among the colliding pairs.
+    double m_max_approach;
+};
+
+// The states HybridCollisionHandler works in during a step, kept from step
+// to step so that once they have grown to the scene its iterations allocate
+// nothing; successive states are swapped through them rather than copied.
+struct HybridScratch
+{
+    VectorXs qm;
+    VectorXs qdotm;
+    // The state before the failsafe's last pass, with INCREMENTAL_ZONE_DETECTION.
+    VectorXs qprev;
+    // The collisions the failsafe grows its impact zones from.
+    std::vector<CollisionInfo> collisions;
+    
+    size_t bytesHeld() const;
+};
+
 class HybridCollisionHandler : public ContinuousTimeCollisionHandler
 {
 public:
@@ -48,18 +116,79 @@ public:
     
     bool applyIterativeImpulses(const TwoDScene &scene, const VectorXs &qs, const VectorXs &qe, const VectorXs &qdote, double dt, VectorXs &qefinal, VectorXs &qdotefinal);
     
+    // The sweeps of applyIterativeImpulses run on each component of the
+    // contact graph of qefinal on its own; see ContactComponents.
+    bool applyImpulsesByComponent(const TwoDScene &scene, const VectorXs &qs, double dt, VectorXs &qefinal, VectorXs &qdotefinal);
+    
     std::vector<CollisionInfo> detectCollisions(const TwoDScene &scene, const VectorXs &qs, const VectorXs &qe);
     
+    void detectCollisionsTouching(const TwoDScene &scene, const VectorXs &qs, const VectorXs &qe, const bool *moved, std::vector<CollisionInfo> &collisions);
+    
     void applyImpulses(const TwoDScene &scene, const std::vector<CollisionInfo> &collisions, const VectorXs &qs, const VectorXs &qe, const VectorXs &qdote, double dt, VectorXs &qm, VectorXs &qdotm);
     
+    // applyImpulses with response kernels chosen for the scene; see
+    // ImpulseKernels.h.
+    void applySpecializedImpulses(const TwoDScene &scene, const std::vector<CollisionInfo> &collisions, const VectorXs &qs, const VectorXs &qe, const VectorXs &qdote, double dt, VectorXs &qm, VectorXs &qdotm);
+    
+    void applyImpulsesByColor(const TwoDScene &scene, const std::vector<CollisionInfo> &collisions, const VectorXs &qs, const VectorXs &qe, const VectorXs &qdote, double dt, VectorXs &qm, VectorXs &qdotm);
+    
     void applyGeometricCollisionHandling(const TwoDScene &scene, const VectorXs &qs, const VectorXs &qe, const VectorXs &qdote, double dt, VectorXs &qefinal, VectorXs &qdotefinal);
     
     void performFailsafe(const TwoDScene &scene, const VectorXs &oldpos, const ImpactZone &zone, double dt, VectorXs &qe, VectorXs &qdote);
     
+    void performFailsafeOnZones(const TwoDScene &scene, const VectorXs &oldpos, const ImpactZones &zones, double dt, VectorXs &qe, VectorXs &qdote);
+    
     virtual std::string getName() const;
     
+    // The sweeps of the last call to applyIterativeImpulses, for tuning
+    // maxiters. The base library constructs this handler, so these are kept
+    // statically like the CCD polynomial log.
+    static const std::vector<ImpulseIterationStats> & getImpulseStats() { return s_impulse_stats; }
+    
+    // The contact impulses carried from one call to applyIterativeImpulses
+    // to the next when built with IMPULSE_WARM_START.
+    static const ImpulseCache & getImpulseCache() { return s_impulse_cache; }
+    
+    // The contacts of the last call to applyIterativeImpulses when built
+    // with PGS_CONTACTS, which solves them together rather than sweeping.
+    static const ContactLCP & getContactLCP() { return s_contact_lcp; }
+    
+    // The collisions kept between sweeps when built with
+    // SHARED_STAGE_DETECTION.
+    static const SharedStageDetection & getSharedStageDetection() { return s_shared_detection; }
+    
+    // The per-chunk collision lists of detectCollisionsTouching when it runs
+    // in parallel.
+    static const ContactSegments & getContactSegments() { return s_contact_segments; }
+    
+    // The particle-edge tiles of detectCollisionsTouching when built with
+    // CCD_EDGE_TILES.
+    static const ParticleEdgeTiles & getEdgeTiles() { return s_edge_tiles; }
+    
+    // The half-plane distances of detectCollisionsTouching when built with
+    // CCD_CLOSED_FORM_HALFPLANES.
+    static const HalfplaneSweep & getHalfplaneSweep() { return s_halfplane_sweep; }
+    
+    // The states and collisions of applyIterativeImpulses and
+    // applyGeometricCollisionHandling.
+    static const HybridScratch & getScratch() { return s_scratch; }
+    
+    // The contact graph's components of applyImpulsesByComponent's last
+    // round.
+    static const ContactComponents & getContactComponents() { return s_contact_components; }
+    
 private:
     
+    static std::vector<ImpulseIterationStats> s_impulse_stats;
+    static ImpulseCache s_impulse_cache;
+    static ContactLCP s_contact_lcp;
+    static SharedStageDetection s_shared_detection;
+    static ContactSegments s_contact_segments;
+    static ParticleEdgeTiles s_edge_tiles;
+    static HalfplaneSweep s_halfplane_sweep;
+    static HybridScratch s_scratch;
+    static ContactComponents s_contact_components;
+    
     const int m_maxiters;
     
 };
@@ -0,0 +1,267 @@
+#include "HybridRecording.h"
+#include "MemoryAccounting.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+namespace
+{
+
+const char HYBRID_MAGIC[4] = { 'H', 'Z', 'R', '1' };
+
+template<class T>
+void writeValue( std::ofstream &ofs, const T &value )
+{
+    ofs.write((const char *) &value, sizeof(T));
+}
+
+template<class T>
+bool readValue( std::ifstream &ifs, T &value )
+{
+    ifs.read((char *) &value, sizeof(T));
+    return bool(ifs);
+}
+
+void complain( const std::string &what )
+{
+    std::cerr << "\033[31;1mERROR IN HYBRIDRECORDING:\033[m " << what << std::endl;
+}
+
+bool readParticle( std::ifstream &ifs, int i, VectorXs &q, VectorXs &qdot )
+{
+    if( i < 0 || 2*i+1 >= q.size() ) return false;
+    return readValue(ifs, q(2*i)) && readValue(ifs, q(2*i+1)) && readValue(ifs, qdot(2*i)) && readValue(ifs, qdot(2*i+1));
+}
+
+#ifdef RECORD_HYBRID_ZONES
+
+// The file records are appended to, opened with the first step. Keeps the
+// last recorded state, against which the failsafe's start is compared.
+class Recorder
+{
+public:
+    Recorder()
+    : m_filename()
+    , m_enabled(false)
+    , m_ofs()
+    , m_numdofs(-1)
+    , m_q()
+    , m_qdot()
+    {
+        const char *filename = getenv("FOSSSIM_HYBRID_RECORD");
+        m_enabled = filename != NULL && *filename != '\0';
+        if( m_enabled ) m_filename = filename;
+    }
+
+    bool enabled() const { return m_enabled; }
+
+    size_t bytesHeld() const { return sizeof(scalar)*( m_q.size() + m_qdot.size() ); }
+
+    void recordPostImpulses( const VectorXs &q, const VectorXs &qdot )
+    {
+        if( !m_enabled ) return;
+        if( m_numdofs < 0 && !open((int) q.size()) ) return;
+        if( q.size() != m_numdofs ) return;
+
+        m_q = q;
+        m_qdot = qdot;
+        m_ofs.put('P');
+        m_ofs.write((const char *) q.data(), m_numdofs*sizeof(double));
+        m_ofs.write((const char *) qdot.data(), m_numdofs*sizeof(double));
+        check();
+    }
+
+    void recordFailsafeStart( const VectorXs &q, const VectorXs &qdot )
+    {
+        if( !m_enabled || m_numdofs < 0 || q.size() != m_numdofs ) return;
+
+        std::vector<int> changed;
+        for( int i = 0; i < m_numdofs/2; ++i )
+            if( q.segment<2>(2*i) != m_q.segment<2>(2*i) || qdot.segment<2>(2*i) != m_qdot.segment<2>(2*i) ) changed.push_back(i);
+        m_ofs.put('S');
+        writeValue(m_ofs, (int) changed.size());
+        for( std::vector<int>::size_type k = 0; k < changed.size(); ++k )
+        {
+            writeValue(m_ofs, changed[k]);
+            writeParticle(changed[k], q, qdot);
+        }
+        check();
+    }
+
+    void recordImpactZones( const ImpactZones &Z, const VectorXs &q, const VectorXs &qdot, int iter )
+    {
+        if( !m_enabled || m_numdofs < 0 || q.size() != m_numdofs ) return;
+
+        m_ofs.put('Z');
+        writeValue(m_ofs, iter);
+        writeValue(m_ofs, (int) Z.size());
+        for( std::vector<ImpactZone>::size_type z = 0; z < Z.size(); ++z )
+        {
+            writeValue(m_ofs, (int) Z[z].m_halfplane);
+            writeValue(m_ofs, (int) Z[z].m_verts.size());
+            for( std::set<int>::const_iterator it = Z[z].m_verts.begin(); it != Z[z].m_verts.end(); ++it ) writeValue(m_ofs, *it);
+        }
+        for( std::vector<ImpactZone>::size_type z = 0; z < Z.size(); ++z )
+            for( std::set<int>::const_iterator it = Z[z].m_verts.begin(); it != Z[z].m_verts.end(); ++it ) writeParticle(*it, q, qdot);
+        check();
+    }
+
+private:
+    bool open( int numdofs )
+    {
+        m_ofs.open(m_filename.c_str(), std::ios::binary);
+        if( !m_ofs )
+        {
+            complain("Failed to open " + m_filename + " for writing.");
+            m_enabled = false;
+            return false;
+        }
+        m_numdofs = numdofs;
+        m_ofs.write(HYBRID_MAGIC, sizeof(HYBRID_MAGIC));
+        writeValue(m_ofs, m_numdofs);
+        return true;
+    }
+
+    // Writes particle i's state and takes it into the shadow state.
+    void writeParticle( int i, const VectorXs &q, const VectorXs &qdot )
+    {
+        m_q.segment<2>(2*i) = q.segment<2>(2*i);
+        m_qdot.segment<2>(2*i) = qdot.segment<2>(2*i);
+        m_ofs.write((const char *) &q(2*i), 2*sizeof(double));
+        m_ofs.write((const char *) &qdot(2*i), 2*sizeof(double));
+    }
+
+    void check()
+    {
+        if( m_ofs ) return;
+        complain("Failed to write " + m_filename + ".");
+        m_enabled = false;
+    }
+
+    std::string m_filename;
+    bool m_enabled;
+    std::ofstream m_ofs;
+    int m_numdofs;
+    VectorXs m_q;
+    VectorXs m_qdot;
+};
+
+Recorder g_recorder;
+
+size_t recorderBytes()
+{
+    return g_recorder.bytesHeld();
+}
+
+const bool g_accounted = memoryaccounting::addSource( memoryaccounting::OUTPUT_BUFFERS, recorderBytes );
+
+#endif
+
+}
+
+#ifdef RECORD_HYBRID_ZONES
+
+bool hybridrecording::enabled()
+{
+    return g_recorder.enabled();
+}
+
+void hybridrecording::recordPostImpulses( const VectorXs &q, const VectorXs &qdot )
+{
+    g_recorder.recordPostImpulses(q, qdot);
+}
+
+void hybridrecording::recordFailsafeStart( const VectorXs &q, const VectorXs &qdot )
+{
+    g_recorder.recordFailsafeStart(q, qdot);
+}
+
+void hybridrecording::recordImpactZones( const ImpactZones &Z, const VectorXs &q, const VectorXs &qdot, int iter )
+{
+    g_recorder.recordImpactZones(Z, q, qdot, iter);
+}
+
+#endif
+
+bool hybridrecording::loadRecording( const std::string &filename, std::vector<HybridCollisionComparison> &steps )
+{
+    std::ifstream ifs(filename.c_str(), std::ios::binary);
+    if( !ifs )
+    {
+        complain("Failed to open " + filename + ".");
+        return false;
+    }
+
+    char magic[4];
+    int numdofs;
+    ifs.read(magic, sizeof(magic));
+    if( !ifs || memcmp(magic, HYBRID_MAGIC, sizeof(magic)) != 0 || !readValue(ifs, numdofs) || numdofs < 0 || numdofs % 2 != 0 )
+    {
+        complain(filename + " is not a hybrid recording.");
+        return false;
+    }
+
+    steps.clear();
+    VectorXs q(numdofs), qdot(numdofs);
+    char tag;
+    while( ifs.get(tag) )
+    {
+        bool succeeded = true;
+        if( tag == 'P' )
+        {
+            ifs.read((char *) q.data(), numdofs*sizeof(double));
+            ifs.read((char *) qdot.data(), numdofs*sizeof(double));
+            succeeded = bool(ifs);
+            if( succeeded )
+            {
+                steps.push_back(HybridCollisionComparison());
+                steps.back().reset();
+                steps.back().serializePostImpulses(q, qdot);
+            }
+        }
+        else if( tag == 'S' && !steps.empty() )
+        {
+            int count;
+            succeeded = readValue(ifs, count) && count >= 0;
+            for( int k = 0; k < count && succeeded; ++k )
+            {
+                int i;
+                succeeded = readValue(ifs, i) && readParticle(ifs, i, q, qdot);
+            }
+        }
+        else if( tag == 'Z' && !steps.empty() )
+        {
+            int iter, numzones;
+            succeeded = readValue(ifs, iter) && readValue(ifs, numzones) && numzones >= 0;
+            ImpactZones Z;
+            for( int z = 0; z < numzones && succeeded; ++z )
+            {
+                int halfplane, nverts;
+                succeeded = readValue(ifs, halfplane) && readValue(ifs, nverts) && nverts >= 0;
+                std::set<int> verts;
+                for( int k = 0; k < nverts && succeeded; ++k )
+                {
+                    int i;
+                    succeeded = readValue(ifs, i);
+                    verts.insert(verts.end(), i);
+                }
+                Z.push_back(ImpactZone(verts, halfplane != 0));
+            }
+            for( ImpactZones::size_type z = 0; z < Z.size() && succeeded; ++z )
+                for( std::set<int>::const_iterator it = Z[z].m_verts.begin(); it != Z[z].m_verts.end() && succeeded; ++it )
+                    succeeded = readParticle(ifs, *it, q, qdot);
+            if( succeeded ) steps.back().serializeImpactZones(Z, q, qdot, iter);
+        }
+        else
+            succeeded = false;
+
+        if( !succeeded )
+        {
+            complain(filename + " is truncated or corrupt.");
+            return false;
+        }
+    }
+    return true;
+}
@@ -0,0 +1,57 @@
+#ifndef HYBRID_RECORDING_H
+#define HYBRID_RECORDING_H
+
+#include <string>
+#include <vector>
+
+#include "MathDefs.h"
+#include "HybridCollisionHandler.h"
+#include "HybridCollisionComparison.h"
+
+// Recorded states of the hybrid handler, for replaying them into
+// HybridCollisionComparison outside the simulation. Compiled in with
+// RECORD_HYBRID_ZONES and on when the FOSSSIM_HYBRID_RECORD environment
+// variable names a file; otherwise every call is an inline no-op, so the
+// normal path keeps no copies of the state at all.
+//
+// HybridCollisionComparison keeps the whole q and qdot for every zone
+// iteration. The failsafe only ever moves the particles of the zones it is
+// given, so the recording keeps the whole state once per step, after the
+// impulses, and for each zone iteration only the zones and the new states of
+// their particles. The file holds, in native byte order,
+//
+//   "HZR1", numdofs                      int32 after the magic
+//   steps, each of
+//     'P', q, qdot                       numdofs doubles each, after the impulses
+//     'S', count, count (i, x, y, vx, vy) particles the failsafe starts from
+//                                        that differ from the impulses' result
+//     'Z', iter, numzones, then per zone its half-plane flag (int32), its
+//          particle count and particles, then (x, y, vx, vy) of every
+//          particle of every zone in the same order
+//
+// loadRecording expands the steps back into full states, one
+// HybridCollisionComparison per step.
+namespace hybridrecording
+{
+#ifdef RECORD_HYBRID_ZONES
+    bool enabled();
+
+    // Starts a step with the state the impulses leave.
+    void recordPostImpulses( const VectorXs &q, const VectorXs &qdot );
+
+    // The state the failsafe starts from, usually the impulses' result.
+    void recordFailsafeStart( const VectorXs &q, const VectorXs &qdot );
+
+    // The zones and state after iteration iter of the failsafe.
+    void recordImpactZones( const ImpactZones &Z, const VectorXs &q, const VectorXs &qdot, int iter );
+#else
+    inline bool enabled() { return false; }
+    inline void recordPostImpulses( const VectorXs &, const VectorXs & ) {}
+    inline void recordFailsafeStart( const VectorXs &, const VectorXs & ) {}
+    inline void recordImpactZones( const ImpactZones &, const VectorXs &, const VectorXs &, int ) {}
+#endif
+
+    bool loadRecording( const std::string &filename, std::vector<HybridCollisionComparison> &steps );
+}
+
+#endif
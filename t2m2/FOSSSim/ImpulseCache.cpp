@@ -0,0 +1,183 @@
+#include "ImpulseCache.h"
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+
+// How far apart, relative to the sum of their radii, two objects may be at the
+// start of a step and still count as the contact they were in the last.
+const double CONTACT_MARGIN = 0.05;
+
+// Gauss-Seidel passes over the warm started contacts that take back impulse
+// from those it pushes apart.
+const int RELAXATION_PASSES = 8;
+
+}
+
+ImpulseCache::ImpulseCache()
+: m_contacts()
+, m_step()
+, m_warmstarted(0)
+{}
+
+bool ImpulseCache::touching( const TwoDScene &scene, const VectorXs &qs, CollisionInfo::collisiontype type, int idx1, int idx2 )
+{
+  if( idx1 >= scene.getNumParticles() ) return false;
+  const Vector2s x = qs.segment<2>( 2*idx1 );
+  const double r = scene.getRadius( idx1 );
+
+  switch( type )
+  {
+    case CollisionInfo::PP:
+    {
+      if( idx2 >= scene.getNumParticles() ) return false;
+      const double reach = ( r + scene.getRadius( idx2 ) )*( 1.0 + CONTACT_MARGIN );
+      return ( qs.segment<2>( 2*idx2 ) - x ).squaredNorm() <= reach*reach;
+    }
+    case CollisionInfo::PE:
+    {
+      if( idx2 >= scene.getNumEdges() ) return false;
+      const std::pair<int,int> &edge = scene.getEdge( idx2 );
+      const Vector2s a = qs.segment<2>( 2*edge.first );
+      const Vector2s e = qs.segment<2>( 2*edge.second ) - a;
+      const double alpha = e.squaredNorm() > 0.0 ? std::max( 0.0, std::min( 1.0, ( x - a ).dot( e )/e.squaredNorm() ) ) : 0.0;
+      const double reach = ( r + scene.getEdgeRadii()[idx2] )*( 1.0 + CONTACT_MARGIN );
+      return ( a + alpha*e - x ).squaredNorm() <= reach*reach;
+    }
+    case CollisionInfo::PH:
+    {
+      if( idx2 >= scene.getNumHalfplanes() ) return false;
+      const Vector2s px = scene.getHalfplane( idx2 ).first;
+      const Vector2s pn = scene.getHalfplane( idx2 ).second.normalized();
+      return ( x - px ).dot( pn ) <= r*( 1.0 + CONTACT_MARGIN );
+    }
+  }
+  return false;
+}
+
+// The contacts are all tested against the predicted qe before any impulse is
+// applied, so the order of the cache does not change which are warm started.
+void ImpulseCache::warmStart( ContinuousTimeCollisionHandler &handler, const TwoDScene &scene, const VectorXs &qs, double dt, double fraction, VectorXs &qe, VectorXs &qdote )
+{
+  m_step.clear();
+  for( std::vector<Contact>::size_type c = 0; c < m_contacts.size(); ++c )
+  {
+    Contact contact = m_contacts[c];
+    if( !touching( scene, qs, contact.type, contact.idx1, contact.idx2 ) ) continue;
+
+    // Separating along the normal, so the contact has opened.
+    if( impulseNow( handler, scene, qs, qe, dt, contact )*contact.impulse <= 0.0 ) continue;
+
+    contact.impulse *= fraction;
+    m_step.push_back( contact );
+  }
+
+  for( std::vector<Contact>::size_type c = 0; c < m_step.size(); ++c )
+    apply( handler, scene, dt, m_step[c], m_step[c].impulse, qe, qdote );
+
+  // The sweeps only ever push, and a Jacobi sweep pushes a pile apart by more
+  // than it needs, so the last step's impulses overshoot. An impulse that
+  // leaves its contact separating is taken back until the contact just stops
+  // separating, but never past none at all.
+  const double restitution = 1.0 + handler.getCOR();
+  for( int pass = 0; pass < RELAXATION_PASSES; ++pass )
+  {
+    for( std::vector<Contact>::size_type c = 0; c < m_step.size(); ++c )
+    {
+      Contact &contact = m_step[c];
+      double correction = impulseNow( handler, scene, qs, qe, dt, contact )/restitution;
+      if( correction*contact.impulse >= 0.0 ) continue;
+      if( fabs( correction ) > fabs( contact.impulse ) ) correction = -contact.impulse;
+      apply( handler, scene, dt, contact, correction, qe, qdote );
+      contact.impulse += correction;
+    }
+  }
+  m_warmstarted = (int) m_step.size();
+}
+
+double ImpulseCache::impulseNow( ContinuousTimeCollisionHandler &handler, const TwoDScene &scene, const VectorXs &qs, const VectorXs &qe, double dt, Contact &contact ) const
+{
+  switch( contact.type )
+  {
+    case CollisionInfo::PP:
+      return handler.particleParticleImpulse( scene, qs, qe, contact.idx1, contact.idx2, contact.nhat, dt );
+    case CollisionInfo::PE:
+      return handler.particleEdgeImpulse( scene, qs, qe, contact.idx1, contact.idx2, contact.nhat, 0.0, dt, contact.alpha );
+    case CollisionInfo::PH:
+      return handler.particleHalfplaneImpulse( qs, qe, contact.idx1, contact.nhat, dt );
+  }
+  return 0.0;
+}
+
+void ImpulseCache::apply( ContinuousTimeCollisionHandler &handler, const TwoDScene &scene, double dt, const Contact &contact, double impulse, VectorXs &qe, VectorXs &qdote ) const
+{
+  switch( contact.type )
+  {
+    case CollisionInfo::PP:
+      handler.applyParticleParticleImpulse( scene, contact.idx1, contact.idx2, contact.nhat, impulse, dt, qe, qdote );
+      break;
+    case CollisionInfo::PE:
+      handler.applyParticleEdgeImpulse( scene, contact.idx1, contact.idx2, contact.nhat, contact.alpha, impulse, dt, qe, qdote );
+      break;
+    case CollisionInfo::PH:
+      handler.applyParticleHalfplaneImpulse( contact.idx1, contact.nhat, impulse, dt, qe, qdote );
+      break;
+  }
+}
+
+void ImpulseCache::addSweep( ContinuousTimeCollisionHandler &handler, const TwoDScene &scene, const VectorXs &qs, const VectorXs &qe, double dt, const std::vector<CollisionInfo> &collisions )
+{
+  for( std::vector<CollisionInfo>::size_type k = 0; k < collisions.size(); ++k )
+  {
+    const CollisionInfo &info = collisions[k];
+    Contact contact;
+    contact.type = info.m_type;
+    contact.idx1 = info.m_idx1;
+    contact.idx2 = info.m_idx2;
+    contact.nhat = info.m_n.normalized();
+    contact.alpha = 0.0;
+    switch( info.m_type )
+    {
+      case CollisionInfo::PP:
+        contact.impulse = handler.particleParticleImpulse( scene, qs, qe, info.m_idx1, info.m_idx2, contact.nhat, dt );
+        break;
+      case CollisionInfo::PE:
+        contact.impulse = handler.particleEdgeImpulse( scene, qs, qe, info.m_idx1, info.m_idx2, contact.nhat, info.m_time, dt, contact.alpha );
+        break;
+      case CollisionInfo::PH:
+        contact.impulse = handler.particleHalfplaneImpulse( qs, qe, info.m_idx1, contact.nhat, dt );
+        break;
+    }
+    m_step.push_back( contact );
+  }
+}
+
+// Records of one contact keep the order they were made in, so the merged
+// contact takes the normal and contact point of its last collision.
+void ImpulseCache::endStep()
+{
+  std::stable_sort( m_step.begin(), m_step.end() );
+  m_contacts.clear();
+  for( std::vector<Contact>::size_type c = 0; c < m_step.size(); ++c )
+  {
+    if( !m_contacts.empty() && !( m_contacts.back() < m_step[c] ) )
+    {
+      const double impulse = m_contacts.back().impulse + m_step[c].impulse;
+      m_contacts.back() = m_step[c];
+      m_contacts.back().impulse = impulse;
+    }
+    else
+    {
+      m_contacts.push_back( m_step[c] );
+    }
+  }
+  m_step.clear();
+}
+
+void ImpulseCache::release()
+{
+  std::vector<Contact>().swap( m_contacts );
+  std::vector<Contact>().swap( m_step );
+  m_warmstarted = 0;
+}
@@ -0,0 +1,82 @@
+#ifndef IMPULSE_CACHE_H
+#define IMPULSE_CACHE_H
+
+#include "ContinuousTimeCollisionHandler.h"
+#include "MathDefs.h"
+#include "TwoDScene.h"
+#include <vector>
+
+// Impulses of the contacts in the last step's iterative impulse sweeps, for
+// warm starting the next step with them. In a resting pile the same contacts
+// carry about the same impulse every step, and the sweeps of a step only
+// pass it one contact further down the pile each, so a pile n deep takes n
+// sweeps to settle from nothing. Starting from the last step's impulses they
+// mostly find nothing left to do.
+//
+// A contact is keyed by its CollisionInfo type and indices. Its impulse is
+// the sum over the sweeps of the response's I, along the normal and, for an
+// edge, at the contact point of its last collision.
+class ImpulseCache
+{
+public:
+  ImpulseCache();
+
+  // Applies fraction of each cached impulse to qe and qdote, for the contacts
+  // still touching at qs and still approaching along their cached normal
+  // between qs and qe, then takes back what leaves a contact separating.
+  // Begins recording the step, with the impulses applied.
+  void warmStart( ContinuousTimeCollisionHandler &handler, const TwoDScene &scene, const VectorXs &qs, double dt, double fraction, VectorXs &qe, VectorXs &qdote );
+
+  // Records the impulses a sweep responding to collisions from qs to qe
+  // applies.
+  void addSweep( ContinuousTimeCollisionHandler &handler, const TwoDScene &scene, const VectorXs &qs, const VectorXs &qe, double dt, const std::vector<CollisionInfo> &collisions );
+
+  // Sums the step's impulses per contact into the cache for the next step.
+  void endStep();
+
+  // Contacts in the cache, and the number warm started in the last step.
+  int size() const { return (int) m_contacts.size(); }
+  int getNumWarmStarted() const { return m_warmstarted; }
+
+  // Empties the cache and gives its memory back.
+  void release();
+
+  // Bytes the cache holds, for memoryaccounting.
+  size_t bytesHeld() const { return sizeof(Contact)*( m_contacts.capacity() + m_step.capacity() ); }
+
+  // True if the contact's objects exist in the scene and are within
+  // CONTACT_MARGIN of touching at qs.
+  static bool touching( const TwoDScene &scene, const VectorXs &qs, CollisionInfo::collisiontype type, int idx1, int idx2 );
+
+private:
+  struct Contact
+  {
+    CollisionInfo::collisiontype type;
+    int idx1;
+    int idx2;
+    Vector2s nhat;
+    // Barycentric coordinate of the contact point along an edge.
+    double alpha;
+    double impulse;
+
+    bool operator<( const Contact &other ) const
+    {
+      if( type != other.type ) return type < other.type;
+      if( idx1 != other.idx1 ) return idx1 < other.idx1;
+      return idx2 < other.idx2;
+    }
+  };
+
+  // The response's impulse on the contact from qs to qe, along its normal.
+  // Updates an edge contact's point to the closest at qs.
+  double impulseNow( ContinuousTimeCollisionHandler &handler, const TwoDScene &scene, const VectorXs &qs, const VectorXs &qe, double dt, Contact &contact ) const;
+
+  void apply( ContinuousTimeCollisionHandler &handler, const TwoDScene &scene, double dt, const Contact &contact, double impulse, VectorXs &qe, VectorXs &qdote ) const;
+
+  std::vector<Contact> m_contacts;
+  // The step being recorded, in the order recorded.
+  std::vector<Contact> m_step;
+  int m_warmstarted;
+};
+
+#endif
@@ -0,0 +1,88 @@
+#include "ImpulseHistory.h"
+#include "MemoryAccounting.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+ImpulseHistory::ImpulseHistory( int frames )
+: m_frames( std::max( frames, 1 ) + 1 )
+, m_current( 0 )
+, m_steps( 0 )
+{}
+
+void ImpulseHistory::add( CollisionInfo::collisiontype type, int particle, int other, const Vector2s &n )
+{
+  assert( particle >= 0 && other >= 0 && uint32_t( other ) <= INDEX_MASK );
+  Impulse impulse;
+  impulse.particle = particle;
+  impulse.other = ( uint32_t( type ) << INDEX_BITS ) | uint32_t( other );
+  const scalar length = n.norm();
+  for( int k = 0; k < 2; ++k ) impulse.normal[k] = length > 0.0 ? (int16_t) lround( NORMAL_SCALE*n[k]/length ) : 0;
+  impulse.position[0] = impulse.position[1] = 0.0f;
+  m_frames[m_current].push_back( impulse );
+}
+
+void ImpulseHistory::endStep( const VectorXs &q )
+{
+  std::vector<Impulse> &frame = m_frames[m_current];
+  for( std::vector<Impulse>::size_type i = 0; i < frame.size(); ++i )
+  {
+    if( 2*frame[i].particle + 1 >= (uint32_t) q.size() ) continue;
+    frame[i].position[0] = (float) q( 2*frame[i].particle );
+    frame[i].position[1] = (float) q( 2*frame[i].particle + 1 );
+  }
+  m_steps = std::min( m_steps + 1, (int) m_frames.size() - 1 );
+  m_current = ( m_current + 1 ) % (int) m_frames.size();
+  m_frames[m_current].clear();
+}
+
+int ImpulseHistory::frame( int age ) const
+{
+  assert( age >= 0 && age < m_steps );
+  const int nframes = (int) m_frames.size();
+  return ( m_current - 1 - age + 2*nframes ) % nframes;
+}
+
+size_t ImpulseHistory::bytesHeld() const
+{
+  size_t bytes = sizeof(std::vector<Impulse>)*m_frames.capacity();
+  for( std::vector<std::vector<Impulse> >::size_type f = 0; f < m_frames.size(); ++f ) bytes += sizeof(Impulse)*m_frames[f].capacity();
+  return bytes;
+}
+
+#ifdef IMPULSE_HISTORY_FRAMES
+
+namespace
+{
+
+ImpulseHistory g_history( IMPULSE_HISTORY_FRAMES );
+// Whether a handler has ended a step, after which impulses are recorded.
+bool g_recording = false;
+
+size_t historyBytes()
+{
+  return g_history.bytesHeld();
+}
+
+const bool g_accounted = memoryaccounting::addSource( memoryaccounting::OUTPUT_BUFFERS, historyBytes );
+
+}
+
+void impulsehistory::record( CollisionInfo::collisiontype type, int particle, int other, const Vector2s &n )
+{
+  if( g_recording ) g_history.add( type, particle, other, n );
+}
+
+void impulsehistory::endStep( const VectorXs &q )
+{
+  if( g_recording ) g_history.endStep( q );
+  g_recording = true;
+}
+
+const ImpulseHistory &impulsehistory::history()
+{
+  return g_history;
+}
+
+#endif
@@ -0,0 +1,90 @@
+#ifndef IMPULSE_HISTORY_H
+#define IMPULSE_HISTORY_H
+
+#include <stdint.h>
+#include <vector>
+
+#include "CollisionHandler.h"
+#include "MathDefs.h"
+
+// The impulses of the last few steps, for drawing impulse trails over long
+// runs in bounded memory. A CollisionInfo is 48 bytes, with a double normal
+// and time; an impulse here is 20, with 32-bit indices, the type in the top
+// bits of the second, the unit normal quantized to 16 bits a component, and
+// where the particle ended the step in floats. The time of impact is not
+// kept.
+//
+// The steps are a ring of a fixed number of frames, and one more for the
+// step being recorded. Each frame keeps its storage when it is reused, so a
+// run holds at most that many times its busiest step's impulses.
+class ImpulseHistory
+{
+public:
+  struct Impulse
+  {
+    uint32_t particle;
+    // The other particle, edge or half-plane, with the type above it.
+    uint32_t other;
+    // The unit normal times NORMAL_SCALE.
+    int16_t normal[2];
+    float position[2];
+
+    CollisionInfo::collisiontype type() const { return (CollisionInfo::collisiontype) ( other >> INDEX_BITS ); }
+    uint32_t otherIndex() const { return other & INDEX_MASK; }
+    Vector2s n() const { return Vector2s( scalar( normal[0] ), scalar( normal[1] ) )/scalar( NORMAL_SCALE ); }
+  };
+
+  static const int INDEX_BITS = 30;
+  static const uint32_t INDEX_MASK = ( 1u << INDEX_BITS ) - 1;
+  static const int NORMAL_SCALE = 32767;
+
+  explicit ImpulseHistory( int frames );
+
+  // Adds an impulse to the step being recorded. A zero normal is kept as
+  // zero.
+  void add( CollisionInfo::collisiontype type, int particle, int other, const Vector2s &n );
+
+  // Ends the step being recorded, placing its impulses at their particles'
+  // positions in q, and starts the next, in place of the oldest step once
+  // the ring is full.
+  void endStep( const VectorXs &q );
+
+  // The steps ended, up to the number of frames.
+  int numSteps() const { return m_steps; }
+
+  // The impulses of the step age steps before the last one ended.
+  const Impulse *stepBegin( int age ) const { return impulses( frame( age ) ); }
+  const Impulse *stepEnd( int age ) const { return impulses( frame( age ) ) + m_frames[frame( age )].size(); }
+
+  // Bytes held, for memory accounting.
+  size_t bytesHeld() const;
+
+private:
+  int frame( int age ) const;
+  const Impulse *impulses( int f ) const { return m_frames[f].empty() ? NULL : &m_frames[f][0]; }
+
+  std::vector<std::vector<Impulse> > m_frames;
+  // The frame being recorded.
+  int m_current;
+  int m_steps;
+};
+
+// The history the collision handlers record into. Compiled in when
+// IMPULSE_HISTORY_FRAMES is set, and kept for that many steps; otherwise
+// every call is an inline no-op. The continuous-time and hybrid handlers end
+// a step each time they start one, at the start positions of the new one,
+// and until the first of them does nothing is recorded, so a run with any
+// other handler holds nothing.
+namespace impulsehistory
+{
+#ifdef IMPULSE_HISTORY_FRAMES
+  void record( CollisionInfo::collisiontype type, int particle, int other, const Vector2s &n );
+  void endStep( const VectorXs &q );
+  const ImpulseHistory &history();
+#else
+  inline void record( CollisionInfo::collisiontype, int, int, const Vector2s & ) {}
+  inline void endStep( const VectorXs & ) {}
+#endif
+}
+
+#endif
@@ -0,0 +1,201 @@
+#ifndef IMPULSE_KERNELS_H
+#define IMPULSE_KERNELS_H
+
+#include <algorithm>
+#include <limits>
+#include "MathDefs.h"
+#include "TwoDScene.h"
+
+// The coefficients of restitution the response kernels are specialised on.
+enum Restitution { ELASTIC, INELASTIC, GENERAL_RESTITUTION };
+
+// The configuration of a scene the response kernels are specialised on: its
+// coefficient of restitution, and whether any of its particles are fixed.
+// Without fixed particles no response has to ask whether its particles are.
+struct ResponseMode
+{
+    ResponseMode(const TwoDScene &scene, double COR)
+    : restitution(COR == 1.0 ? ELASTIC : COR == 0.0 ? INELASTIC : GENERAL_RESTITUTION)
+    , fixed(false)
+    {
+        for(int i=0; i<scene.getNumParticles() && !fixed; i++)
+            fixed = scene.isFixed(i);
+    }
+
+    Restitution restitution;
+    bool fixed;
+};
+
+// 1 + COR, which scales the relative normal velocity a response removes.
+template<Restitution R> inline double restitutionFactor(double COR) { return 1.0 + COR; }
+template<> inline double restitutionFactor<ELASTIC>(double) { return 2.0; }
+template<> inline double restitutionFactor<INELASTIC>(double) { return 1.0; }
+
+// The impulse responses of ContinuousTimeCollisionHandler, with the
+// coefficient of restitution R and whether the scene has fixed particles,
+// FIXED, known at compile time. Every instance computes bit for bit what the
+// general one, ImpulseKernels<GENERAL_RESTITUTION, true>, does on the scenes
+// it is chosen for; see ContinuousTimeCollisionHandler for what each does.
+template<Restitution R, bool FIXED>
+struct ImpulseKernels
+{
+    static bool isFixed(const TwoDScene &scene, int idx)
+    {
+        return FIXED && scene.isFixed(idx);
+    }
+
+    static double mass(const TwoDScene &scene, const VectorXs &M, int idx)
+    {
+        return isFixed(scene, idx) ? std::numeric_limits<double>::infinity() : M[2*idx];
+    }
+
+    static double particleParticleImpulse(const TwoDScene &scene, const VectorXs &qs, const VectorXs &qe, int idx1, int idx2, const Vector2s &nhat, double dt, double COR)
+    {
+        Vector2s v1 = (qe.segment<2>(2*idx1) - qs.segment<2>(2*idx1))/dt;
+        Vector2s v2 = (qe.segment<2>(2*idx2) - qs.segment<2>(2*idx2))/dt;
+        return (v2-v1).dot(nhat)*restitutionFactor<R>(COR);
+    }
+
+    static void applyParticleParticleImpulse(const TwoDScene &scene, int idx1, int idx2, const Vector2s &nhat, double I, double dt, VectorXs &qm, VectorXs &qdotm)
+    {
+        const VectorXs &M = scene.getM();
+
+        double m1 = mass(scene, M, idx1);
+        double m2 = mass(scene, M, idx2);
+
+        if(!isFixed(scene, idx1))
+        {
+            qdotm.segment<2>(2*idx1) += I/(m1/m2+1.0)*nhat;
+            qm.segment<2>(2*idx1) += dt*I/(m1/m2+1.0)*nhat;
+        }
+        if(!isFixed(scene, idx2))
+        {
+            qdotm.segment<2>(2*idx2) -= I/(m2/m1+1.0)*nhat;
+            qm.segment<2>(2*idx2) -= dt*I/(m2/m1+1.0)*nhat;
+        }
+    }
+
+    static double particleEdgeImpulse(const TwoDScene &scene, const VectorXs &qs, const VectorXs &qe, int vidx, int eidx, const Vector2s &nhat, double time, double dt, double COR, double &alpha)
+    {
+        int eidx1 = scene.getEdges()[eidx].first;
+        int eidx2 = scene.getEdges()[eidx].second;
+
+        Vector2s v1 = (qe.segment<2>(2*vidx) - qs.segment<2>(2*vidx))/dt;
+        Vector2s v2 = (qe.segment<2>(2*eidx1) - qs.segment<2>(2*eidx1))/dt;
+        Vector2s v3 = (qe.segment<2>(2*eidx2) - qs.segment<2>(2*eidx2))/dt;
+
+        double tdt = time*dt;
+        Vector2s x1 = qs.segment<2>(2*vidx) + tdt*v1;
+        Vector2s x2 = qs.segment<2>(2*eidx1) + tdt*v2;
+        Vector2s x3 = qs.segment<2>(2*eidx2) + tdt*v3;
+
+        alpha = (x1-x2).dot(x3-x2)/(x3-x2).dot(x3-x2);
+        alpha = std::min(1.0, std::max(0.0, alpha));
+
+        Vector2s vedge = v2 + alpha*(v3-v2);
+        return (vedge-v1).dot(nhat)*restitutionFactor<R>(COR);
+    }
+
+    static void applyParticleEdgeImpulse(const TwoDScene &scene, int vidx, int eidx, const Vector2s &nhat, double alpha, double I, double dt, VectorXs &qm, VectorXs &qdotm)
+    {
+        const VectorXs &M = scene.getM();
+
+        int eidx1 = scene.getEdges()[eidx].first;
+        int eidx2 = scene.getEdges()[eidx].second;
+
+        double m1 = mass(scene, M, vidx);
+        double m2 = mass(scene, M, eidx1);
+        double m3 = mass(scene, M, eidx2);
+
+        double alpha2 = alpha*alpha;
+        double beta = 1.0-alpha;
+        double beta2 = beta*beta;
+
+        if(!isFixed(scene, vidx))
+        {
+            double denom = m1*beta2/m2 + 1.0 + m1*alpha2/m3;
+            qdotm.segment<2>(2*vidx) += I/denom*nhat;
+            qm.segment<2>(2*vidx) += dt*I/denom*nhat;
+        }
+        if(!isFixed(scene, eidx1))
+        {
+            double denom = m2/m1 + beta2 + m2*alpha2/m3;
+            qdotm.segment<2>(2*eidx1) -= beta*I/denom*nhat;
+            qm.segment<2>(2*eidx1) -= dt*beta*I/denom*nhat;
+        }
+        if(!isFixed(scene, eidx2))
+        {
+            double denom = m3/m1 + m3*beta2/m2 + alpha2;
+            qdotm.segment<2>(2*eidx2) -= alpha*I/denom*nhat;
+            qm.segment<2>(2*eidx2) -= dt*alpha*I/denom*nhat;
+        }
+    }
+
+    static double particleHalfplaneImpulse(const VectorXs &qs, const VectorXs &qe, int vidx, const Vector2s &nhat, double dt, double COR)
+    {
+        Vector2s v = (qe.segment<2>(2*vidx) - qs.segment<2>(2*vidx))/dt;
+        return v.dot(nhat)*restitutionFactor<R>(COR);
+    }
+
+    static void applyParticleHalfplaneImpulse(int vidx, const Vector2s &nhat, double I, double dt, VectorXs &qm, VectorXs &qdotm)
+    {
+        qdotm.segment<2>(2*vidx) -= I*nhat;
+        qm.segment<2>(2*vidx) -= dt*I*nhat;
+    }
+
+    static void respondParticleParticle(const TwoDScene &scene, const VectorXs &qs, const VectorXs &qe, int idx1, int idx2, const Vector2s &n, double dt, double COR, VectorXs &qm, VectorXs &qdotm)
+    {
+        Vector2s nhat = n;
+        nhat.normalize();
+
+        double I = particleParticleImpulse(scene, qs, qe, idx1, idx2, nhat, dt, COR);
+        applyParticleParticleImpulse(scene, idx1, idx2, nhat, I, dt, qm, qdotm);
+    }
+
+    static void respondParticleEdge(const TwoDScene &scene, const VectorXs &qs, const VectorXs &qe, int vidx, int eidx, const Vector2s &n, double time, double dt, double COR, VectorXs &qm, VectorXs &qdotm)
+    {
+        Vector2s nhat = n;
+        nhat.normalize();
+
+        double alpha;
+        double I = particleEdgeImpulse(scene, qs, qe, vidx, eidx, nhat, time, dt, COR, alpha);
+        applyParticleEdgeImpulse(scene, vidx, eidx, nhat, alpha, I, dt, qm, qdotm);
+    }
+
+    static void respondParticleHalfplane(const VectorXs &qs, const VectorXs &qe, int vidx, const Vector2s &n, double dt, double COR, VectorXs &qm, VectorXs &qdotm)
+    {
+        Vector2s nhat = n;
+        nhat.normalize();
+
+        double I = particleHalfplaneImpulse(qs, qe, vidx, nhat, dt, COR);
+        applyParticleHalfplaneImpulse(vidx, nhat, I, dt, qm, qdotm);
+    }
+};
+
+// Calls sweep.run<Kernels>() with the kernels specialised on mode, so that
+// the choice is made once for a whole sweep of responses rather than once
+// per response.
+template<class Sweep>
+void dispatchResponse(const ResponseMode &mode, const Sweep &sweep)
+{
+    if(mode.fixed)
+    {
+        switch(mode.restitution)
+        {
+            case ELASTIC: sweep.template run<ImpulseKernels<ELASTIC, true> >(); return;
+            case INELASTIC: sweep.template run<ImpulseKernels<INELASTIC, true> >(); return;
+            case GENERAL_RESTITUTION: sweep.template run<ImpulseKernels<GENERAL_RESTITUTION, true> >(); return;
+        }
+    }
+    else
+    {
+        switch(mode.restitution)
+        {
+            case ELASTIC: sweep.template run<ImpulseKernels<ELASTIC, false> >(); return;
+            case INELASTIC: sweep.template run<ImpulseKernels<INELASTIC, false> >(); return;
+            case GENERAL_RESTITUTION: sweep.template run<ImpulseKernels<GENERAL_RESTITUTION, false> >(); return;
+        }
+    }
+}
+
+#endif
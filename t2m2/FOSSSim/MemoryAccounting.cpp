@@ -0,0 +1,252 @@
+#include "MemoryAccounting.h"
+
+#include <algorithm>
+#include <csignal>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "CollisionHandler.h"
+#include "TwoDScene.h"
+
+namespace
+{
+
+const char *SUBSYSTEM_NAMES[memoryaccounting::NUM_SUBSYSTEMS] =
+{
+  "scene",
+  "forces",
+  "broad_phase",
+  "hessian",
+  "impulse_log",
+  "ccd_polynomials",
+  "step_caches",
+  "scratch",
+  "output_buffers"
+};
+
+bool measured( memoryaccounting::Subsystem subsystem )
+{
+  return subsystem != memoryaccounting::FORCES && subsystem != memoryaccounting::HESSIAN;
+}
+
+volatile sig_atomic_t g_requested = 0;
+
+void requestReport( int )
+{
+  g_requested = 1;
+}
+
+// Parses a byte count with an optional K, M or G suffix. Returns false if
+// text is not one.
+bool parseBytes( const std::string &text, size_t &bytes )
+{
+  char *end = NULL;
+  const double value = strtod(text.c_str(), &end);
+  if( end == text.c_str() || !( value > 0.0 ) ) return false;
+  const std::string suffix(end);
+  double scale = 1.0;
+  if( suffix == "K" || suffix == "k" ) scale = 1024.0;
+  else if( suffix == "M" || suffix == "m" ) scale = 1024.0*1024.0;
+  else if( suffix == "G" || suffix == "g" ) scale = 1024.0*1024.0*1024.0;
+  else if( !suffix.empty() ) return false;
+  bytes = (size_t) ( value*scale );
+  return true;
+}
+
+size_t sceneBytes( const TwoDScene &scene )
+{
+  size_t bytes = sizeof(scalar)*( scene.getX().size() + scene.getV().size() + scene.getM().size() );
+  bytes += ( scene.getNumParticles() + 7 )/8;
+  bytes += sizeof(scalar)*( scene.getRadii().capacity() + scene.getEdgeRadii().capacity() );
+  bytes += sizeof(std::pair<int,int>)*scene.getEdges().capacity();
+  const std::vector<std::pair<VectorXs, VectorXs> > &halfplanes = scene.getHalfplanes();
+  bytes += sizeof(std::pair<VectorXs, VectorXs>)*halfplanes.capacity();
+  for( std::vector<std::pair<VectorXs, VectorXs> >::size_type h = 0; h < halfplanes.size(); ++h )
+    bytes += sizeof(scalar)*( halfplanes[h].first.size() + halfplanes[h].second.size() );
+  const std::vector<std::string> &tags = scene.getParticleTags();
+  bytes += sizeof(std::string)*tags.capacity();
+  for( std::vector<std::string>::size_type t = 0; t < tags.size(); ++t ) bytes += tags[t].capacity();
+  return bytes;
+}
+
+struct Registration
+{
+  memoryaccounting::Subsystem subsystem;
+  memoryaccounting::Source source;
+};
+
+// Sources register from other files' static initializers, so the list is
+// built on first use rather than being a static of its own.
+std::vector<Registration> &sources()
+{
+  static std::vector<Registration> list;
+  return list;
+}
+
+class Accounts
+{
+public:
+  Accounts()
+  : m_filename()
+  , m_enabled(false)
+  , m_budget(0)
+  , m_over(false)
+  , m_step(0)
+  , m_total(0)
+  , m_peak(0)
+  {
+    for( int s = 0; s < memoryaccounting::NUM_SUBSYSTEMS; ++s ) m_bytes[s] = m_noted[s] = 0;
+
+    const char *filename = getenv("FOSSSIM_MEMORY");
+    m_enabled = filename != NULL && *filename != '\0';
+    if( m_enabled )
+    {
+      m_filename = filename;
+      // Truncated here, so that every report of the run can be appended.
+      std::ofstream ofs(m_filename.c_str());
+      signal(SIGUSR1, requestReport);
+    }
+
+    const char *budget = getenv("FOSSSIM_MEM_BUDGET");
+    if( budget != NULL && *budget != '\0' && !parseBytes(budget, m_budget) )
+      std::cerr << "\033[31;1mERROR IN MEMORYACCOUNTING:\033[m Ignoring FOSSSIM_MEM_BUDGET=" << budget << ", which is not a byte count." << std::endl;
+  }
+
+  ~Accounts()
+  {
+    if( m_enabled && m_step > 0 ) append("exit");
+  }
+
+  bool enabled() const { return m_enabled; }
+  size_t budget() const { return m_budget; }
+  bool overBudget() const { return m_over; }
+  size_t bytes( int subsystem ) const { return m_bytes[subsystem]; }
+  size_t total() const { return m_total; }
+
+  void noteArenaBytes( int subsystem, size_t bytes ) { m_noted[subsystem] += bytes; }
+
+  void checkIn( const TwoDScene &scene, const CollisionHandler &handler )
+  {
+    ++m_step;
+    for( int s = 0; s < memoryaccounting::NUM_SUBSYSTEMS; ++s ) m_bytes[s] = 0;
+    m_bytes[memoryaccounting::SCENE] = sceneBytes(scene);
+    m_bytes[memoryaccounting::IMPULSE_LOG] = sizeof(CollisionInfo)*handler.getImpulses().capacity();
+    const std::vector<Registration> &list = sources();
+    for( std::vector<Registration>::size_type r = 0; r < list.size(); ++r ) m_bytes[list[r].subsystem] += list[r].source();
+    for( int s = 0; s < memoryaccounting::NUM_SUBSYSTEMS; ++s )
+    {
+      const size_t moved = std::min(m_noted[s], m_bytes[memoryaccounting::SCRATCH]);
+      m_bytes[memoryaccounting::SCRATCH] -= moved;
+      m_bytes[s] += moved;
+      m_noted[s] = 0;
+    }
+    m_total = 0;
+    for( int s = 0; s < memoryaccounting::NUM_SUBSYSTEMS; ++s ) m_total += m_bytes[s];
+    m_peak = std::max(m_peak, m_total);
+
+    if( m_budget > 0 && m_total > m_budget && !m_over )
+    {
+      m_over = true;
+      std::cerr << "FOSSSim holds " << m_total << " bytes at step " << m_step << ", over its budget of " << m_budget
+                << "; dropping the particle blocks and the warm-start impulse cache." << std::endl;
+    }
+
+    if( !m_enabled ) return;
+    if( m_step == 1 ) append("startup");
+    if( g_requested )
+    {
+      g_requested = 0;
+      append("requested");
+    }
+  }
+
+  void write( std::ostream &os ) const
+  {
+    os << "step " << m_step << ", total " << m_total << " bytes, peak " << m_peak;
+    if( m_budget > 0 ) os << ", budget " << m_budget << ( m_over ? " (exceeded)" : "" );
+    os << '\n';
+    for( int s = 0; s < memoryaccounting::NUM_SUBSYSTEMS; ++s )
+    {
+      os << "  " << SUBSYSTEM_NAMES[s] << ' ';
+      if( measured(memoryaccounting::Subsystem(s)) ) os << m_bytes[s];
+      else os << "unmeasured";
+      os << '\n';
+    }
+  }
+
+private:
+  void append( const char *when )
+  {
+    std::ofstream ofs(m_filename.c_str(), std::ios::app);
+    ofs << "# " << when << '\n';
+    write(ofs);
+    if( !ofs ) std::cerr << "\033[31;1mERROR IN MEMORYACCOUNTING:\033[m Failed to write " << m_filename << "." << std::endl;
+  }
+
+  std::string m_filename;
+  bool m_enabled;
+  size_t m_budget;
+  bool m_over;
+  int m_step;
+  size_t m_bytes[memoryaccounting::NUM_SUBSYSTEMS];
+  // Arena bytes noted since the last check-in.
+  size_t m_noted[memoryaccounting::NUM_SUBSYSTEMS];
+  size_t m_total;
+  size_t m_peak;
+};
+
+Accounts g_accounts;
+
+}
+
+bool memoryaccounting::addSource( Subsystem subsystem, Source source )
+{
+  Registration registration;
+  registration.subsystem = subsystem;
+  registration.source = source;
+  sources().push_back(registration);
+  return true;
+}
+
+void memoryaccounting::noteArenaBytes( Subsystem subsystem, size_t bytes )
+{
+  g_accounts.noteArenaBytes(subsystem, bytes);
+}
+
+bool memoryaccounting::enabled()
+{
+  return g_accounts.enabled();
+}
+
+size_t memoryaccounting::budget()
+{
+  return g_accounts.budget();
+}
+
+bool memoryaccounting::overBudget()
+{
+  return g_accounts.overBudget();
+}
+
+void memoryaccounting::checkIn( const TwoDScene& scene, const CollisionHandler& handler )
+{
+  g_accounts.checkIn(scene, handler);
+}
+
+size_t memoryaccounting::bytes( Subsystem subsystem )
+{
+  return g_accounts.bytes(subsystem);
+}
+
+size_t memoryaccounting::total()
+{
+  return g_accounts.total();
+}
+
+void memoryaccounting::writeReport( std::ostream& os )
+{
+  g_accounts.write(os);
+}
@@ -0,0 +1,81 @@
+#ifndef MEMORY_ACCOUNTING_H
+#define MEMORY_ACCOUNTING_H
+
+#include <cstddef>
+#include <ostream>
+
+class TwoDScene;
+class CollisionHandler;
+
+// Bytes held by the simulation, by subsystem. When the FOSSSIM_MEMORY
+// environment variable names a report file, a report is appended to it at
+// the first step, at every step after the process receives SIGUSR1, and at
+// exit, with the peak total. The collision handlers check in at the start of
+// each step, which is when the scene and the impulse log are measured and
+// every other subsystem's sources are asked for their bytes.
+//
+// FOSSSIM_MEM_BUDGET sets a budget, in bytes or with a K, M or G suffix
+// (powers of 1024). The base library parses the command line, so this is
+// where FOSSSim takes it; FOSSSimBatch's --mem-budget sets it for every
+// scene. Once a check-in finds the total over the budget, overBudget()
+// holds for the rest of the run, and the subsystems that can do without
+// memory they keep for speed give it up: the continuous-time handler stops
+// building particle blocks and the hybrid handler drops its warm-start
+// impulse cache. A note goes to stderr when that happens.
+namespace memoryaccounting
+{
+  enum Subsystem
+  {
+    // Positions, velocities, masses, radii, edges, halfplanes and tags.
+    SCENE,
+    // Forces and the implicit steppers' Hessians live in the base library,
+    // which exposes neither, so they are listed but never measured.
+    FORCES,
+    // The particle blocks of the last step; see noteArenaBytes.
+    BROAD_PHASE,
+    HESSIAN,
+    // The impulses of the current step, which the base library writes out.
+    IMPULSE_LOG,
+    // PolynomialIntervalSolver::s_polynomials, also written out each step.
+    CCD_POLYNOMIALS,
+    // Caches kept from step to step, such as warm-start impulses.
+    STEP_CACHES,
+    // The rest of the per-step scratch arena.
+    SCRATCH,
+    // Recordings and reports held until they are written, and the impulse
+    // history kept for the display.
+    OUTPUT_BUFFERS,
+    NUM_SUBSYSTEMS
+  };
+
+  // Reports the bytes something of subsystem holds.
+  typedef size_t (*Source)();
+
+  // Adds source to subsystem's total. Returns true, so that a file can
+  // register its sources when its statics are initialized.
+  bool addSource( Subsystem subsystem, Source source );
+
+  // Notes that a structure of subsystem built during this step took bytes
+  // of the scratch arena. The next check-in counts them under subsystem
+  // rather than SCRATCH. Not thread-safe.
+  void noteArenaBytes( Subsystem subsystem, size_t bytes );
+
+  bool enabled();
+
+  // The budget in bytes, or 0 for none.
+  size_t budget();
+
+  bool overBudget();
+
+  // Measures everything at the start of a step, then reports or switches to
+  // the lower-memory options as described above.
+  void checkIn( const TwoDScene& scene, const CollisionHandler& handler );
+
+  // Bytes per subsystem at the last check-in, and their total.
+  size_t bytes( Subsystem subsystem );
+  size_t total();
+
+  void writeReport( std::ostream& os );
+}
+
+#endif
@@ -0,0 +1,428 @@
+#include "MetricsExporter.h"
+
+#ifdef METRICS_EXPORTER
+#include <netdb.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+
+#include "MemoryAccounting.h"
+#include "TimingUtilities.h"
+#endif
+
+#ifdef METRICS_EXPORTER
+namespace
+{
+
+// Upper bounds of the histogram buckets, in seconds. One more bucket takes
+// the rest.
+const double BUCKET_BOUNDS[] = { 1.0e-5, 3.0e-5, 1.0e-4, 3.0e-4, 1.0e-3, 3.0e-3, 1.0e-2, 3.0e-2, 0.1, 0.3, 1.0, 3.0 };
+const int NUM_BUCKETS = sizeof(BUCKET_BOUNDS)/sizeof(BUCKET_BOUNDS[0]) + 1;
+const double DEFAULT_INTERVAL = 10.0;
+// Longest the exporter's thread waits before it looks for the end of the
+// run again.
+const int POLL_MILLISECONDS = 200;
+// Longest StatsD datagram, within a typical MTU.
+const std::string::size_type STATSD_DATAGRAM_BYTES = 1400;
+// Most of a request the Prometheus endpoint reads.
+const int REQUEST_BYTES = 4096;
+
+typedef unsigned long long Count;
+
+// The step thread is the only writer, so a relaxed load and store add
+// without a locked instruction, and a reader sees either total.
+inline void add( std::atomic<Count>& total, Count n )
+{
+  total.store(total.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+}
+
+struct Histogram
+{
+  std::atomic<Count> buckets[NUM_BUCKETS];
+  std::atomic<Count> nanoseconds;
+
+  void record( double seconds )
+  {
+    int b = 0;
+    while( b < NUM_BUCKETS - 1 && seconds > BUCKET_BOUNDS[b] ) ++b;
+    add(buckets[b], 1);
+    add(nanoseconds, Count(seconds*1.0e9 + 0.5));
+  }
+};
+
+// Everything published, as the step thread adds to it. Zeroed before any
+// constructor runs.
+struct Totals
+{
+  Histogram step;
+  Histogram phases[phasetiming::NUM_PHASES];
+  std::atomic<Count> counts[phasetiming::NUM_COUNTERS];
+  std::atomic<Count> memory;
+};
+
+Totals g_totals;
+
+// A copy of a Histogram, whose count is the sum of its buckets so that the
+// two agree even if the copy caught a step half added.
+struct HistogramValues
+{
+  Count buckets[NUM_BUCKETS];
+  Count nanoseconds;
+
+  void read( const Histogram& histogram )
+  {
+    for( int b = 0; b < NUM_BUCKETS; ++b ) buckets[b] = histogram.buckets[b].load(std::memory_order_relaxed);
+    nanoseconds = histogram.nanoseconds.load(std::memory_order_relaxed);
+  }
+
+  Count count() const
+  {
+    Count n = 0;
+    for( int b = 0; b < NUM_BUCKETS; ++b ) n += buckets[b];
+    return n;
+  }
+};
+
+struct Values
+{
+  HistogramValues step;
+  HistogramValues phases[phasetiming::NUM_PHASES];
+  Count counts[phasetiming::NUM_COUNTERS];
+  Count memory;
+
+  void read()
+  {
+    step.read(g_totals.step);
+    for( int p = 0; p < phasetiming::NUM_PHASES; ++p ) phases[p].read(g_totals.phases[p]);
+    for( int c = 0; c < phasetiming::NUM_COUNTERS; ++c ) counts[c] = g_totals.counts[c].load(std::memory_order_relaxed);
+    memory = g_totals.memory.load(std::memory_order_relaxed);
+  }
+};
+
+// Splits [host:]port. Returns false if there is no port.
+bool splitAddress( const std::string& address, std::string& host, std::string& port )
+{
+  const std::string::size_type colon = address.rfind(':');
+  host = colon == std::string::npos ? "" : address.substr(0, colon);
+  port = colon == std::string::npos ? address : address.substr(colon + 1);
+  return !port.empty();
+}
+
+void reportError( const std::string& message )
+{
+  std::cerr << "\033[31;1mERROR IN METRICSEXPORTER:\033[m " << message << std::endl;
+}
+
+// The endpoints named in the environment, and the thread that serves them.
+class Exporter
+{
+public:
+  Exporter()
+  : m_statsd_address()
+  , m_prometheus_address()
+  , m_interval(DEFAULT_INTERVAL)
+  , m_enabled(false)
+  , m_started(false)
+  , m_stop(false)
+  , m_thread()
+  , m_statsd(-1)
+  , m_prometheus(-1)
+  , m_steps_per_second(0.0)
+  {
+    const char *statsd = getenv("FOSSSIM_STATSD");
+    const char *prometheus = getenv("FOSSSIM_PROMETHEUS");
+    const char *interval = getenv("FOSSSIM_METRICS_INTERVAL");
+    if( statsd != NULL ) m_statsd_address = statsd;
+    if( prometheus != NULL ) m_prometheus_address = prometheus;
+    if( interval != NULL && atof(interval) > 0.0 ) m_interval = atof(interval);
+    m_enabled = !m_statsd_address.empty() || !m_prometheus_address.empty();
+  }
+
+  ~Exporter()
+  {
+    if( !m_started ) return;
+    m_stop = true;
+    m_thread.join();
+    if( m_statsd >= 0 ) close(m_statsd);
+    if( m_prometheus >= 0 ) close(m_prometheus);
+  }
+
+  bool enabled() const { return m_enabled; }
+
+  // Called on the step thread, which is the only one to touch m_started.
+  void start()
+  {
+    if( m_started ) return;
+    m_started = true;
+    if( !m_statsd_address.empty() ) m_statsd = openStatsD(m_statsd_address);
+    if( !m_prometheus_address.empty() ) m_prometheus = openPrometheus(m_prometheus_address);
+    m_thread = std::thread(&Exporter::run, this);
+  }
+
+private:
+  static int openStatsD( const std::string& address )
+  {
+    std::string host, port;
+    addrinfo hints = {};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_DGRAM;
+    addrinfo *found = NULL;
+    if( !splitAddress(address, host, port) || getaddrinfo(host.empty() ? "localhost" : host.c_str(), port.c_str(), &hints, &found) != 0 )
+    {
+      reportError("Unable to resolve StatsD address " + address + ".");
+      return -1;
+    }
+    int fd = socket(found->ai_family, found->ai_socktype, found->ai_protocol);
+    if( fd >= 0 && connect(fd, found->ai_addr, found->ai_addrlen) != 0 )
+    {
+      close(fd);
+      fd = -1;
+    }
+    freeaddrinfo(found);
+    if( fd < 0 ) reportError("Unable to open a socket to StatsD at " + address + ".");
+    return fd;
+  }
+
+  static int openPrometheus( const std::string& address )
+  {
+    std::string host, port;
+    addrinfo hints = {};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = AI_PASSIVE;
+    addrinfo *found = NULL;
+    if( !splitAddress(address, host, port) || getaddrinfo(host.empty() ? NULL : host.c_str(), port.c_str(), &hints, &found) != 0 )
+    {
+      reportError("Unable to resolve Prometheus address " + address + ".");
+      return -1;
+    }
+    int fd = socket(found->ai_family, found->ai_socktype, found->ai_protocol);
+    const int yes = 1;
+    if( fd >= 0 && ( setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes)) != 0 || bind(fd, found->ai_addr, found->ai_addrlen) != 0 || listen(fd, 8) != 0 ) )
+    {
+      close(fd);
+      fd = -1;
+    }
+    freeaddrinfo(found);
+    if( fd < 0 ) reportError("Unable to serve Prometheus metrics on " + address + ".");
+    return fd;
+  }
+
+  void run()
+  {
+    Values last;
+    last.read();
+    double lasttime = timingutils::seconds();
+    while( true )
+    {
+      const bool stopping = m_stop;
+      const double now = timingutils::seconds();
+      if( stopping || now >= lasttime + m_interval )
+      {
+        Values current;
+        current.read();
+        m_steps_per_second = ( current.step.count() - last.step.count() )/( now - lasttime );
+        if( m_statsd >= 0 ) pushStatsD(current, last);
+        last = current;
+        lasttime = now;
+      }
+      if( stopping ) return;
+
+      const int wait = std::max(1, std::min(POLL_MILLISECONDS, int(( lasttime + m_interval - now )*1.0e3)));
+      if( m_prometheus < 0 )
+      {
+        std::this_thread::sleep_for(std::chrono::milliseconds(wait));
+        continue;
+      }
+      pollfd listening = { m_prometheus, POLLIN, 0 };
+      if( poll(&listening, 1, wait) > 0 && ( listening.revents & POLLIN ) )
+      {
+        const int client = accept(m_prometheus, NULL, NULL);
+        if( client >= 0 )
+        {
+          serve(client);
+          close(client);
+        }
+      }
+    }
+  }
+
+  // The interval's StatsD lines, in datagrams of whole lines.
+  void pushStatsD( const Values& current, const Values& last ) const
+  {
+    std::ostringstream lines;
+    lines.precision(9);
+    lines << "fosssim.steps:" << current.step.count() - last.step.count() << "|c\n";
+    lines << "fosssim.steps_per_second:" << m_steps_per_second << "|g\n";
+    lines << "fosssim.memory_bytes:" << current.memory << "|g\n";
+    statsDHistogram(lines, "fosssim.step", current.step, last.step);
+    for( int p = 0; p < phasetiming::NUM_PHASES; ++p )
+      statsDHistogram(lines, std::string("fosssim.phase.") + phasetiming::phaseName(phasetiming::Phase(p)), current.phases[p], last.phases[p]);
+#ifdef PROFILE_COUNTERS
+    for( int c = 0; c < phasetiming::NUM_COUNTERS; ++c )
+      if( current.counts[c] != last.counts[c] ) lines << "fosssim.events." << phasetiming::counterName(phasetiming::Counter(c)) << ':' << current.counts[c] - last.counts[c] << "|c\n";
+#endif
+
+    const std::string text = lines.str();
+    std::string::size_type begin = 0;
+    while( begin < text.size() )
+    {
+      std::string::size_type end = begin;
+      while( end < text.size() )
+      {
+        const std::string::size_type next = text.find('\n', end) + 1;
+        if( next - begin > STATSD_DATAGRAM_BYTES && end > begin ) break;
+        end = next;
+      }
+      // Without its last newline; a lost datagram is not retried.
+      send(m_statsd, text.data() + begin, end - begin - 1, 0);
+      begin = end;
+    }
+  }
+
+  static void statsDHistogram( std::ostream& lines, const std::string& name, const HistogramValues& current, const HistogramValues& last )
+  {
+    const Count steps = current.count() - last.count();
+    if( steps == 0 ) return;
+    lines << name << ".mean_ms:" << 1.0e-6*( current.nanoseconds - last.nanoseconds )/steps << "|g\n";
+    for( int b = 0; b < NUM_BUCKETS; ++b )
+    {
+      if( current.buckets[b] == last.buckets[b] ) continue;
+      lines << name << ".le_";
+      if( b < NUM_BUCKETS - 1 ) lines << Count(BUCKET_BOUNDS[b]*1.0e6 + 0.5) << "us";
+      else lines << "inf";
+      lines << ':' << current.buckets[b] - last.buckets[b] << "|c\n";
+    }
+  }
+
+  // Answers one request, /metrics or not found, and closes the connection.
+  void serve( int client ) const
+  {
+    timeval timeout = { 1, 0 };
+    setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    std::string request;
+    char buffer[512];
+    while( request.find("\r\n\r\n") == std::string::npos && request.size() < (std::string::size_type) REQUEST_BYTES )
+    {
+      const ssize_t n = recv(client, buffer, sizeof(buffer), 0);
+      if( n <= 0 ) break;
+      request.append(buffer, n);
+    }
+
+    std::string status = "404 Not Found";
+    std::string body = "Not found; metrics are at /metrics\n";
+    if( request.compare(0, 13, "GET /metrics ") == 0 || request.compare(0, 13, "GET /metrics?") == 0 )
+    {
+      status = "200 OK";
+      body = prometheusText();
+    }
+    std::ostringstream response;
+    response << "HTTP/1.0 " << status << "\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: " << body.size() << "\r\nConnection: close\r\n\r\n" << body;
+    const std::string text = response.str();
+    std::string::size_type sent = 0;
+    while( sent < text.size() )
+    {
+      const ssize_t n = send(client, text.data() + sent, text.size() - sent, MSG_NOSIGNAL);
+      if( n <= 0 ) break;
+      sent += n;
+    }
+  }
+
+  std::string prometheusText() const
+  {
+    Values current;
+    current.read();
+    std::ostringstream text;
+    text.precision(9);
+    text << "# HELP fosssim_steps_total Steps taken.\n# TYPE fosssim_steps_total counter\n";
+    text << "fosssim_steps_total " << current.step.count() << "\n";
+    text << "# HELP fosssim_steps_per_second Steps per second over the last interval.\n# TYPE fosssim_steps_per_second gauge\n";
+    text << "fosssim_steps_per_second " << m_steps_per_second << "\n";
+    text << "# HELP fosssim_step_seconds Wall-clock time of each step.\n# TYPE fosssim_step_seconds histogram\n";
+    prometheusHistogram(text, "fosssim_step_seconds", "", current.step);
+    text << "# HELP fosssim_phase_seconds Wall-clock time of each phase per step.\n# TYPE fosssim_phase_seconds histogram\n";
+    for( int p = 0; p < phasetiming::NUM_PHASES; ++p )
+      prometheusHistogram(text, "fosssim_phase_seconds", std::string("phase=\"") + phasetiming::phaseName(phasetiming::Phase(p)) + "\",", current.phases[p]);
+    text << "# HELP fosssim_memory_bytes Bytes held at the last memory check-in.\n# TYPE fosssim_memory_bytes gauge\n";
+    text << "fosssim_memory_bytes " << current.memory << "\n";
+#ifdef PROFILE_COUNTERS
+    text << "# HELP fosssim_events_total Events counted by the profile counters.\n# TYPE fosssim_events_total counter\n";
+    for( int c = 0; c < phasetiming::NUM_COUNTERS; ++c )
+      text << "fosssim_events_total{counter=\"" << phasetiming::counterName(phasetiming::Counter(c)) << "\"} " << current.counts[c] << "\n";
+#endif
+    return text.str();
+  }
+
+  // labels is empty or ends in a comma, to go before le.
+  static void prometheusHistogram( std::ostream& text, const std::string& name, const std::string& labels, const HistogramValues& values )
+  {
+    Count cumulative = 0;
+    for( int b = 0; b < NUM_BUCKETS; ++b )
+    {
+      cumulative += values.buckets[b];
+      text << name << "_bucket{" << labels << "le=\"";
+      if( b < NUM_BUCKETS - 1 ) text << BUCKET_BOUNDS[b];
+      else text << "+Inf";
+      text << "\"} " << cumulative << "\n";
+    }
+    const std::string selector = labels.empty() ? "" : "{" + labels.substr(0, labels.size() - 1) + "}";
+    text << name << "_sum" << selector << ' ' << 1.0e-9*values.nanoseconds << "\n";
+    text << name << "_count" << selector << ' ' << cumulative << "\n";
+  }
+
+  std::string m_statsd_address;
+  std::string m_prometheus_address;
+  double m_interval;
+  bool m_enabled;
+  bool m_started;
+  std::atomic<bool> m_stop;
+  std::thread m_thread;
+  int m_statsd;
+  int m_prometheus;
+  // Written and read by the exporter's thread only.
+  double m_steps_per_second;
+};
+
+// Destroyed before g_totals, which its thread reads until it is joined.
+Exporter g_exporter;
+
+}
+#endif
+
+bool metrics::enabled()
+{
+#ifdef METRICS_EXPORTER
+  return g_exporter.enabled();
+#else
+  return false;
+#endif
+}
+
+void metrics::recordFrame( double wallseconds, const double *seconds, const long long *counts )
+{
+#ifdef METRICS_EXPORTER
+  if( !g_exporter.enabled() ) return;
+  g_exporter.start();
+  g_totals.step.record(wallseconds);
+  for( int p = 0; p < phasetiming::NUM_PHASES; ++p ) g_totals.phases[p].record(seconds[p]);
+  if( counts != NULL )
+    for( int c = 0; c < phasetiming::NUM_COUNTERS; ++c ) add(g_totals.counts[c], Count(counts[c]));
+  g_totals.memory.store(memoryaccounting::total(), std::memory_order_relaxed);
+#else
+  (void) wallseconds;
+  (void) seconds;
+  (void) counts;
+#endif
+}
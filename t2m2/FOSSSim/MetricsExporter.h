@@ -0,0 +1,40 @@
+#ifndef METRICS_EXPORTER_H
+#define METRICS_EXPORTER_H
+
+#include "PhaseTiming.h"
+
+// Built with METRICS_EXPORTER, publishes the instrumentation of a long run
+// to a metrics system from a background thread:
+//
+//   FOSSSIM_STATSD=host:port       pushes StatsD lines over UDP every interval
+//   FOSSSIM_PROMETHEUS=[host:]port serves the Prometheus text format at
+//                                  /metrics, on all interfaces without a host
+//
+// FOSSSIM_METRICS_INTERVAL sets the interval in seconds, 10 by default, over
+// which steps per second are measured and StatsD is pushed to. Either
+// endpoint turns the phase timers on, as a report does.
+//
+// Published are the steps taken and steps per second; histograms of the
+// wall-clock time of each step and of each phase per step; the bytes held at
+// the last memory check-in (MemoryAccounting.h); and with PROFILE_COUNTERS
+// every counter, such as contacts, impulse iterations and solver calls. In
+// Prometheus these are fosssim_steps_total, fosssim_steps_per_second,
+// fosssim_step_seconds, fosssim_phase_seconds{phase}, fosssim_memory_bytes
+// and fosssim_events_total{counter}. StatsD has no histograms, so it gets
+// the count of each bucket as a counter, fosssim.phase.<phase>.le_<us>us,
+// and the mean as a gauge, fosssim.phase.<phase>.mean_ms.
+//
+// The step thread adds each completed frame to plain atomics, with no locks
+// and no read-modify-write instructions, as it is their only writer, and the
+// exporter's thread reads them. A scrape may see part of a step.
+namespace metrics
+{
+  bool enabled();
+
+  // Adds a completed frame of wallseconds, with seconds per phase and, with
+  // PROFILE_COUNTERS, counts per counter, or NULL. Called by phasetiming on
+  // the step thread.
+  void recordFrame( double wallseconds, const double *seconds, const long long *counts );
+}
+
+#endif
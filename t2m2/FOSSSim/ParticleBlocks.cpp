@@ -0,0 +1,40 @@
+#include "ParticleBlocks.h"
+#include "MemoryAccounting.h"
+
+namespace
+{
+
+const size_t CACHE_LINE = 64;
+
+}
+
+ParticleBlocks::ParticleBlocks( const TwoDScene &scene, const VectorXs &qs, const VectorXs &qe, FrameArena &arena, bool build )
+: m_blocks( NULL )
+, m_size( build ? scene.getNumParticles() : 0 )
+{
+  assert( sizeof(ParticleBlock) == CACHE_LINE );
+  if( m_size == 0 ) return;
+  assert( qs.size() == 2*m_size );
+  assert( qe.size() == 2*m_size );
+  m_blocks = arena.allocateAligned<ParticleBlock>( m_size, CACHE_LINE );
+  memoryaccounting::noteArenaBytes( memoryaccounting::BROAD_PHASE, m_size*sizeof(ParticleBlock) );
+
+  for( int i = 0; i < m_size; ++i )
+  {
+    ParticleBlock& block = m_blocks[i];
+    block.xs[0] = qs(2*i);
+    block.xs[1] = qs(2*i+1);
+    block.xe[0] = qe(2*i);
+    block.xe[1] = qe(2*i+1);
+    block.radius = scene.getRadius(i);
+    block.padding[0] = block.padding[1] = block.padding[2] = 0.0;
+  }
+}
+
+void ParticleBlocks::updateEnd( const VectorXs &qe, int particle )
+{
+  if( m_size == 0 ) return;
+  assert( particle >= 0 ); assert( particle < m_size );
+  m_blocks[particle].xe[0] = qe(2*particle);
+  m_blocks[particle].xe[1] = qe(2*particle+1);
+}
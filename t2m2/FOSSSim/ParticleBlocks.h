@@ -0,0 +1,45 @@
+#ifndef PARTICLE_BLOCKS_H
+#define PARTICLE_BLOCKS_H
+
+#include "TwoDScene.h"
+#include "MathDefs.h"
+#include "FrameArena.h"
+
+// What a swept test reads of one particle, in one cache line: its start and
+// end positions over the step and its radius. TwoDScene keeps these in two
+// VectorXs and a std::vector behind an out-of-line getRadius, so an all-pairs
+// sweep would otherwise touch three arrays and make two library calls per pair.
+struct ParticleBlock
+{
+  scalar xs[2];
+  scalar xe[2];
+  scalar radius;
+  scalar padding[3];
+};
+
+// Cache-line aligned ParticleBlocks of every particle in a scene, in storage
+// taken from the step's arena. With build false there are none, for a sweep
+// that has to do without their memory.
+class ParticleBlocks
+{
+public:
+  ParticleBlocks( const TwoDScene &scene, const VectorXs &qs, const VectorXs &qe, FrameArena &arena, bool build = true );
+
+  int size() const { return m_size; }
+  bool empty() const { return m_size == 0; }
+
+  const ParticleBlock& operator[]( int particle ) const { return m_blocks[particle]; }
+
+  // Refreshes one particle's end position, after a response moved it. Does
+  // nothing if the blocks were not built.
+  void updateEnd( const VectorXs &qe, int particle );
+
+private:
+  ParticleBlocks( const ParticleBlocks& );
+  ParticleBlocks& operator=( const ParticleBlocks& );
+
+  ParticleBlock* m_blocks;
+  int m_size;
+};
+
+#endif
@@ -0,0 +1,89 @@
+#include "ParticleEdgeTiles.h"
+
+ParticleEdgeTiles::ParticleEdgeTiles()
+: m_particles()
+, m_edges()
+, m_results()
+, m_order()
+, m_tiles()
+, m_counts()
+, m_context()
+, m_log()
+, m_calls()
+, m_times()
+{}
+
+void ParticleEdgeTiles::clear()
+{
+  m_particles.clear();
+  m_edges.clear();
+  m_order.clear();
+  m_tiles.clear();
+  m_log.clear();
+}
+
+void ParticleEdgeTiles::add( int particle, int edge )
+{
+  m_particles.push_back( particle );
+  m_edges.push_back( edge );
+}
+
+void ParticleEdgeTiles::schedule( int nedges )
+{
+  const int ncandidates = size();
+  m_results.resize( ncandidates );
+
+  m_counts.assign( nedges + 1, 0 );
+  for( int c = 0; c < ncandidates; ++c )
+    ++m_counts[m_edges[c] + 1];
+  for( int e = 0; e < nedges; ++e )
+    m_counts[e+1] += m_counts[e];
+
+  m_order.resize( ncandidates );
+  for( int c = 0; c < ncandidates; ++c )
+    m_order[m_counts[m_edges[c]]++] = c;
+
+  // m_counts[e] is now where edge e's candidates end, and so where edge
+  // e+1's start.
+  m_tiles.clear();
+  int start = 0;
+  for( int e = 0; e < nedges; ++e )
+  {
+    for( int k = start; k < m_counts[e]; k += TILE_SIZE )
+      m_tiles.push_back( k );
+    start = m_counts[e];
+  }
+  m_tiles.push_back( ncandidates );
+}
+
+void ParticleEdgeTiles::setResult( int candidate, bool hit, const Vector2s &n, double time, int logbegin, int logend )
+{
+  Result &result = m_results[candidate];
+  result.n[0] = n.x();
+  result.n[1] = n.y();
+  result.time = time;
+  result.logbegin = logbegin;
+  result.logend = logend;
+  result.hit = hit;
+}
+
+void ParticleEdgeTiles::gather( int begin, int end, std::vector<CollisionInfo> &collisions, std::vector<Polynomial> *log ) const
+{
+  for( int c = begin; c < end; ++c )
+  {
+    const Result &result = m_results[c];
+    if( log != NULL )
+      log->insert( log->end(), m_log.begin() + result.logbegin, m_log.begin() + result.logend );
+    if( result.hit )
+      collisions.push_back( CollisionInfo( CollisionInfo::PE, m_particles[c], m_edges[c], Vector2s( result.n[0], result.n[1] ), result.time ) );
+  }
+}
+
+size_t ParticleEdgeTiles::bytesHeld() const
+{
+  size_t bytes = sizeof(int)*( m_particles.capacity() + m_edges.capacity() + m_order.capacity() + m_tiles.capacity() + m_counts.capacity() )
+               + sizeof(Result)*m_results.capacity() + sizeof(Polynomial)*m_log.capacity() + sizeof(double)*m_times.capacity();
+  for( std::vector<std::vector<Polynomial> >::size_type c = 0; c < m_calls.size(); ++c )
+    bytes += sizeof(Polynomial)*m_calls[c].capacity();
+  return bytes;
+}
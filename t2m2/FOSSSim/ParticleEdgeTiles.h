@@ -0,0 +1,95 @@
+#ifndef PARTICLE_EDGE_TILES_H
+#define PARTICLE_EDGE_TILES_H
+
+#include "CollisionHandler.h"
+#include "ContinuousTimeUtilities.h"
+#include <vector>
+
+// The particle-edge pairs a narrow phase has left after its broad phase,
+// grouped by edge into tiles, so that
+// ContinuousTimeCollisionHandler::detectParticleEdgeTiles tests every
+// particle against an edge while that edge's trajectory terms are in
+// registers, prefetching the next edge's as it goes, and solves the
+// polynomials of a whole tile in one batch.
+//
+// Candidates are numbered in the order they are added, which is the order a
+// sweep would test them in, and their results are kept by that number. gather
+// then hands them back in it: the collisions, and the CCD polynomials each
+// solve logged, come out as the sweep would have made them.
+//
+// The storage is kept from call to call.
+class ParticleEdgeTiles
+{
+public:
+  // Most candidates per tile; an edge with more is split across tiles.
+  static const int TILE_SIZE = 32;
+
+  ParticleEdgeTiles();
+
+  void clear();
+
+  void add( int particle, int edge );
+
+  int size() const { return (int) m_particles.size(); }
+  int particle( int candidate ) const { return m_particles[candidate]; }
+  int edge( int candidate ) const { return m_edges[candidate]; }
+
+  // Groups the candidates into tiles by a counting sort on their edges, in
+  // increasing order of edge and, within an edge, in the order added.
+  void schedule( int nedges );
+
+  int numTiles() const { return (int) m_tiles.size() - 1; }
+  int tileEdge( int tile ) const { return m_edges[m_order[m_tiles[tile]]]; }
+  // The candidates of tile t are candidate(k) for k from m_tiles[t] up to
+  // m_tiles[t+1].
+  int tileBegin( int tile ) const { return m_tiles[tile]; }
+  int tileEnd( int tile ) const { return m_tiles[tile+1]; }
+  int candidate( int k ) const { return m_order[k]; }
+
+  // Records whether the candidate hit, and if so where and when, and that
+  // its solve logged log()[logbegin] up to log()[logend].
+  void setResult( int candidate, bool hit, const Vector2s &n, double time, int logbegin, int logend );
+
+  // The context the tiles are solved with, logging into log() when the
+  // collisions are gathered into a log.
+  PolynomialSolverContext &context() { return m_context; }
+  std::vector<Polynomial> &log() { return m_log; }
+
+  // Storage for the polynomials of the calls of one tile.
+  std::vector<std::vector<Polynomial> > &calls() { return m_calls; }
+  std::vector<double> &times() { return m_times; }
+
+  // Appends the collisions among candidates begin up to end to collisions
+  // and, unless log is NULL, the polynomials their solves logged to log.
+  void gather( int begin, int end, std::vector<CollisionInfo> &collisions, std::vector<Polynomial> *log ) const;
+
+  // Bytes held from call to call, for memory accounting.
+  size_t bytesHeld() const;
+
+private:
+  struct Result
+  {
+    scalar n[2];
+    double time;
+    int logbegin;
+    int logend;
+    bool hit;
+  };
+
+  std::vector<int> m_particles;
+  std::vector<int> m_edges;
+  std::vector<Result> m_results;
+  // Candidates in tile order, and where each tile starts in it.
+  std::vector<int> m_order;
+  std::vector<int> m_tiles;
+  // Candidates per edge, then where each edge's candidates start in
+  // m_order.
+  std::vector<int> m_counts;
+
+  PolynomialSolverContext m_context;
+  std::vector<Polynomial> m_log;
+  std::vector<std::vector<Polynomial> > m_calls;
+  std::vector<double> m_times;
+};
+
+#endif
@@ -0,0 +1,488 @@
+#include "PhaseTiming.h"
+#include "MemoryAccounting.h"
+#include "MetricsExporter.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <vector>
+
+#ifdef PROFILE_COUNTERS
+#include <atomic>
+#include <new>
+#endif
+
+#include "TimingUtilities.h"
+
+#ifdef PROFILE_COUNTERS
+thread_local long long phasetiming::t_counts[phasetiming::NUM_COUNTERS];
+thread_local bool phasetiming::t_registered = false;
+#endif
+
+namespace
+{
+
+const char *PHASE_NAMES[phasetiming::NUM_PHASES] =
+{
+  "forces",
+  "linear_solve",
+  "broad_phase",
+  "narrow_phase",
+  "impulses",
+  "failsafe",
+  "serialization",
+  "rendering"
+};
+
+#ifdef PROFILE_COUNTERS
+const char *COUNTER_NAMES[phasetiming::NUM_COUNTERS] =
+{
+  "solver_calls",
+  "solver_calls_culled",
+  "root_solves_degree_1",
+  "root_solves_degree_2",
+  "root_solves_degree_3",
+  "root_solves_degree_4",
+  "root_solves_degree_5",
+  "root_solves_degree_6",
+  "root_solves_skipped",
+  "filter_fallbacks",
+  "broad_phase_candidates",
+  "contacts",
+  "impulse_iterations",
+  "impact_zones",
+  "zone_size_1",
+  "zone_size_2",
+  "zone_size_3_4",
+  "zone_size_5_8",
+  "zone_size_9_16",
+  "zone_size_17_up",
+  "allocations"
+};
+
+// Every thread's counter block. The array is filled in as threads first
+// count, from inside operator new among others, so it has to be usable
+// before any constructor runs and must not allocate.
+const int MAX_COUNTING_THREADS = 256;
+long long *g_thread_counts[MAX_COUNTING_THREADS];
+std::atomic<int> g_num_counting_threads(0);
+#endif
+
+struct FrameTimes
+{
+  // When the frame began.
+  double start;
+  double seconds[phasetiming::NUM_PHASES];
+#ifdef PROFILE_COUNTERS
+  long long counts[phasetiming::NUM_COUNTERS];
+#endif
+};
+
+// The record every timer charges, and the report it leaves at exit.
+class Profile
+{
+public:
+  Profile()
+  : m_filename()
+  , m_enabled(false)
+  , m_live(false)
+  , m_frames()
+  , m_current(-1)
+  , m_mark(0.0)
+  {
+    const char *filename = getenv("FOSSSIM_PROFILE");
+    m_enabled = filename != NULL && *filename != '\0';
+    if( m_enabled ) m_filename = filename;
+  }
+
+  ~Profile()
+  {
+    if( m_enabled && !write(m_filename) )
+      std::cerr << "\033[31;1mERROR IN PHASETIMING:\033[m Failed to write profile " << m_filename << "." << std::endl;
+  }
+
+  bool enabled() const { return m_enabled; }
+
+  bool live() const { return m_live; }
+
+  bool recording() const { return m_enabled || m_live || metrics::enabled(); }
+
+  // Called between steps, when no timer runs. Without a report, a live
+  // display starts from a clean record and leaves nothing behind.
+  void setLive( bool live )
+  {
+    if( live == m_live ) return;
+    m_live = live;
+    if( m_enabled ) return;
+    collectCounts();
+    m_frames.clear();
+  }
+
+  bool summarize( int maxframes, phasetiming::FrameSummary& summary ) const
+  {
+    const int completed = int(m_frames.size()) - 1;
+    const int n = std::min(maxframes, completed);
+    if( n <= 0 ) return false;
+    summary = phasetiming::FrameSummary();
+    summary.frames = n;
+    for( int f = completed - n; f < completed; ++f )
+    {
+      for( int p = 0; p < phasetiming::NUM_PHASES; ++p ) summary.seconds[p] += m_frames[f].seconds[p]/n;
+#ifdef PROFILE_COUNTERS
+      for( int c = 0; c < phasetiming::NUM_COUNTERS; ++c ) summary.counts[c] += double(m_frames[f].counts[c])/n;
+#endif
+    }
+    const double elapsed = m_frames.back().start - m_frames[completed - n].start;
+    summary.framespersecond = elapsed > 0.0 ? n/elapsed : 0.0;
+    return true;
+  }
+
+  size_t bytesHeld() const { return sizeof(FrameTimes)*m_frames.capacity(); }
+
+  // Time a running timer has spent so far stays with the frame it ends.
+  void beginFrame()
+  {
+    if( m_current >= 0 ) switchTo(m_current);
+    const bool completed = !m_frames.empty();
+    collectCounts();
+    if( completed && metrics::enabled() ) publish(m_frames.back());
+    pushFrame();
+  }
+
+  // Charges the time since the last switch to the running phase, then makes
+  // phase the running one. Returns the phase it replaced.
+  int switchTo( int phase )
+  {
+    const double now = timingutils::seconds();
+    if( m_current >= 0 )
+    {
+      if( m_frames.empty() ) pushFrame();
+      m_frames.back().seconds[m_current] += now - m_mark;
+    }
+    m_mark = now;
+    const int previous = m_current;
+    m_current = phase;
+    return previous;
+  }
+
+  bool write( const std::string &filename )
+  {
+    collectCounts();
+    std::ofstream ofs(filename.c_str());
+    if( !ofs ) return false;
+    const bool json = filename.size() >= 5 && filename.compare(filename.size() - 5, 5, ".json") == 0;
+    ofs.precision(9);
+
+    if( json )
+    {
+      ofs << "{\n  \"phases\": [";
+      for( int p = 0; p < phasetiming::NUM_PHASES; ++p ) ofs << ( p ? ", " : "" ) << '"' << PHASE_NAMES[p] << '"';
+#ifdef PROFILE_COUNTERS
+      ofs << "],\n  \"counters\": [";
+      for( int c = 0; c < phasetiming::NUM_COUNTERS; ++c ) ofs << ( c ? ", " : "" ) << '"' << COUNTER_NAMES[c] << '"';
+#endif
+      ofs << "],\n  \"frames\": [";
+      for( std::vector<FrameTimes>::size_type f = 0; f < m_frames.size(); ++f )
+      {
+        ofs << ( f ? ",\n    [" : "\n    [" );
+        for( int p = 0; p < phasetiming::NUM_PHASES; ++p ) ofs << ( p ? ", " : "" ) << m_frames[f].seconds[p];
+#ifdef PROFILE_COUNTERS
+        for( int c = 0; c < phasetiming::NUM_COUNTERS; ++c ) ofs << ", " << m_frames[f].counts[c];
+#endif
+        ofs << "]";
+      }
+      ofs << "\n  ]\n}\n";
+    }
+    else
+    {
+      ofs << "frame";
+      for( int p = 0; p < phasetiming::NUM_PHASES; ++p ) ofs << "," << PHASE_NAMES[p];
+#ifdef PROFILE_COUNTERS
+      for( int c = 0; c < phasetiming::NUM_COUNTERS; ++c ) ofs << "," << COUNTER_NAMES[c];
+#endif
+      ofs << "\n";
+      for( std::vector<FrameTimes>::size_type f = 0; f < m_frames.size(); ++f )
+      {
+        ofs << f;
+        for( int p = 0; p < phasetiming::NUM_PHASES; ++p ) ofs << "," << m_frames[f].seconds[p];
+#ifdef PROFILE_COUNTERS
+        for( int c = 0; c < phasetiming::NUM_COUNTERS; ++c ) ofs << "," << m_frames[f].counts[c];
+#endif
+        ofs << "\n";
+      }
+    }
+    return bool(ofs);
+  }
+
+private:
+  static void publish( const FrameTimes& frame )
+  {
+#ifdef PROFILE_COUNTERS
+    const long long *counts = frame.counts;
+#else
+    const long long *counts = NULL;
+#endif
+    metrics::recordFrame(timingutils::seconds() - frame.start, frame.seconds, counts);
+  }
+
+  void pushFrame()
+  {
+    if( !m_enabled && m_frames.size() >= (size_t) phasetiming::LIVE_FRAMES ) m_frames.erase(m_frames.begin());
+    FrameTimes frame = {};
+    frame.start = timingutils::seconds();
+    m_frames.push_back(frame);
+  }
+
+  // Moves what the threads counted since the last call into the last frame.
+  // The other threads are idle between parallel regions, when this runs.
+  void collectCounts()
+  {
+#ifdef PROFILE_COUNTERS
+    if( m_frames.empty() ) pushFrame();
+    const int nthreads = std::min(g_num_counting_threads.load(), MAX_COUNTING_THREADS);
+    for( int t = 0; t < nthreads; ++t )
+    {
+      for( int c = 0; c < phasetiming::NUM_COUNTERS; ++c )
+      {
+        m_frames.back().counts[c] += g_thread_counts[t][c];
+        g_thread_counts[t][c] = 0;
+      }
+    }
+#endif
+  }
+
+  std::string m_filename;
+  bool m_enabled;
+  bool m_live;
+  std::vector<FrameTimes> m_frames;
+  // The phase of the innermost running timer, or -1.
+  int m_current;
+  double m_mark;
+};
+
+Profile g_profile;
+
+struct TraceEvent
+{
+  const char *name;
+  double time;
+  char type;
+};
+
+// The events of one thread, in the order they happened.
+struct TraceBuffer
+{
+  int tid;
+  std::vector<TraceEvent> events;
+};
+
+thread_local TraceBuffer *t_trace_buffer = NULL;
+
+// Every thread's events, written out at exit. Buffers are never freed, so
+// that threads which exit first keep theirs.
+class Trace
+{
+public:
+  Trace()
+  : m_filename()
+  , m_enabled(false)
+  , m_origin(timingutils::seconds())
+  , m_mutex()
+  , m_buffers()
+  {
+    const char *filename = getenv("FOSSSIM_TRACE");
+    m_enabled = filename != NULL && *filename != '\0';
+    if( m_enabled ) m_filename = filename;
+  }
+
+  ~Trace()
+  {
+    if( m_enabled && !write() )
+      std::cerr << "\033[31;1mERROR IN PHASETIMING:\033[m Failed to write trace " << m_filename << "." << std::endl;
+  }
+
+  bool enabled() const { return m_enabled; }
+
+  void record( const char *name, char type )
+  {
+    if( t_trace_buffer == NULL )
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      t_trace_buffer = new TraceBuffer();
+      t_trace_buffer->tid = (int) m_buffers.size();
+      m_buffers.push_back(t_trace_buffer);
+    }
+    const TraceEvent event = { name, timingutils::seconds(), type };
+    t_trace_buffer->events.push_back(event);
+  }
+
+  // Read between steps, while the pool's threads record nothing.
+  size_t bytesHeld()
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    size_t bytes = sizeof(TraceBuffer*)*m_buffers.capacity();
+    for( std::vector<TraceBuffer*>::size_type b = 0; b < m_buffers.size(); ++b )
+      bytes += sizeof(TraceBuffer) + sizeof(TraceEvent)*m_buffers[b]->events.capacity();
+    return bytes;
+  }
+
+private:
+  bool write()
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    std::ofstream ofs(m_filename.c_str());
+    if( !ofs ) return false;
+    ofs.precision(15);
+    ofs << "{\"traceEvents\": [";
+    for( std::vector<TraceBuffer*>::size_type b = 0; b < m_buffers.size(); ++b )
+    {
+      const TraceBuffer &buffer = *m_buffers[b];
+      // The first thread to record is the one running the simulation loop.
+      ofs << ( b ? ",\n" : "\n" ) << "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": " << buffer.tid
+          << ", \"args\": {\"name\": \"";
+      if( buffer.tid == 0 ) ofs << "main";
+      else ofs << "worker " << buffer.tid;
+      ofs << "\"}}";
+      for( std::vector<TraceEvent>::size_type e = 0; e < buffer.events.size(); ++e )
+      {
+        const TraceEvent &event = buffer.events[e];
+        ofs << ",\n{\"name\": \"" << event.name << "\", \"ph\": \"" << event.type << "\", \"ts\": " << ( event.time - m_origin )*1.0e6
+            << ", \"pid\": 1, \"tid\": " << buffer.tid << "}";
+      }
+    }
+    ofs << "\n]}\n";
+    return bool(ofs);
+  }
+
+  std::string m_filename;
+  bool m_enabled;
+  double m_origin;
+  std::mutex m_mutex;
+  std::vector<TraceBuffer*> m_buffers;
+};
+
+Trace g_trace;
+
+size_t outputBytes()
+{
+  return g_profile.bytesHeld() + g_trace.bytesHeld();
+}
+
+const bool g_accounted = memoryaccounting::addSource( memoryaccounting::OUTPUT_BUFFERS, outputBytes );
+
+}
+
+bool phasetiming::enabled()
+{
+  return g_profile.enabled();
+}
+
+bool phasetiming::tracing()
+{
+  return g_trace.enabled();
+}
+
+void phasetiming::setLive( bool live )
+{
+  g_profile.setLive(live);
+}
+
+bool phasetiming::live()
+{
+  return g_profile.live();
+}
+
+void phasetiming::beginFrame()
+{
+  if( g_profile.recording() ) g_profile.beginFrame();
+}
+
+const char *phasetiming::phaseName( Phase phase )
+{
+  return PHASE_NAMES[phase];
+}
+
+#ifdef PROFILE_COUNTERS
+const char *phasetiming::counterName( Counter counter )
+{
+  return COUNTER_NAMES[counter];
+}
+#endif
+
+bool phasetiming::summarizeRecentFrames( int maxframes, FrameSummary& summary )
+{
+  return g_profile.summarize(maxframes, summary);
+}
+
+bool phasetiming::writeReport( const std::string& filename )
+{
+  return g_profile.write(filename);
+}
+
+#ifdef PROFILE_COUNTERS
+void phasetiming::registerThread()
+{
+  t_registered = true;
+  const int slot = g_num_counting_threads++;
+  // Threads past the last slot count into blocks nobody reads.
+  if( slot < MAX_COUNTING_THREADS ) g_thread_counts[slot] = t_counts;
+}
+
+void phasetiming::countImpactZone( int size )
+{
+  count(IMPACT_ZONES, 1);
+  int bucket = 0;
+  for( int limit = 1; size > limit && bucket < ZONE_SIZE_17_UP - ZONE_SIZE_1; limit *= 2 ) ++bucket;
+  count(Counter(ZONE_SIZE_1 + bucket), 1);
+}
+
+void *operator new( std::size_t size )
+{
+  PROFILE_COUNT(phasetiming::ALLOCATIONS, 1);
+  void *p = malloc(size ? size : 1);
+  if( p == NULL ) throw std::bad_alloc();
+  return p;
+}
+
+void operator delete( void *p ) noexcept
+{
+  free(p);
+}
+#endif
+
+ScopedPhaseTimer::ScopedPhaseTimer( phasetiming::Phase phase )
+: m_phase(phase)
+, m_running(g_profile.recording())
+, m_traced(g_trace.enabled())
+, m_outer(-1)
+{
+  if( m_running ) m_outer = g_profile.switchTo(phase);
+  if( m_traced ) g_trace.record(PHASE_NAMES[phase], 'B');
+}
+
+ScopedPhaseTimer::~ScopedPhaseTimer()
+{
+  stop();
+}
+
+void ScopedPhaseTimer::stop()
+{
+  if( m_running ) g_profile.switchTo(m_outer);
+  if( m_traced ) g_trace.record(PHASE_NAMES[m_phase], 'E');
+  m_running = false;
+  m_traced = false;
+}
+
+ScopedTraceEvent::ScopedTraceEvent( const char *name )
+: m_name(name)
+, m_traced(g_trace.enabled())
+{
+  if( m_traced ) g_trace.record(m_name, 'B');
+}
+
+ScopedTraceEvent::~ScopedTraceEvent()
+{
+  if( m_traced ) g_trace.record(m_name, 'E');
+}
@@ -0,0 +1,184 @@
+#ifndef PHASE_TIMING_H
+#define PHASE_TIMING_H
+
+#include <string>
+
+// Per-frame wall-clock time of the phases of a step. Profiling is on when
+// the FOSSSIM_PROFILE environment variable names a report file; the report
+// is written there when the program exits, as JSON if the name ends in
+// .json and as CSV otherwise, with one row of seconds per frame. A frame
+// runs from one beginFrame() to the next, and the collision handlers begin
+// one at the start of each step. Time outside every timer is not counted.
+//
+// Built with PROFILE_COUNTERS the report also counts, per frame, the events
+// below. Each thread counts into its own block, so PROFILE_COUNT is an
+// unsynchronized add and may be used in parallel regions; the blocks are
+// summed when a frame begins. Without PROFILE_COUNTERS it compiles to
+// nothing.
+//
+// The FOSSSim display's stats overlay (Display/StatsOverlay.cpp) records
+// frames live instead, whether or not there is a report, keeping only the
+// last LIVE_FRAMES of them if there is not, and shows their means.
+//
+// Built with METRICS_EXPORTER, a StatsD or Prometheus endpoint also records
+// them, and gets each frame as it completes; see MetricsExporter.h.
+//
+// Independently, FOSSSIM_TRACE names a Chrome trace JSON file, for
+// chrome://tracing or Perfetto, that gets a begin and an end event for
+// every phase timer and ScopedTraceEvent, on a track per thread.
+namespace phasetiming
+{
+  enum Phase
+  {
+    FORCES,
+    LINEAR_SOLVE,
+    BROAD_PHASE,
+    NARROW_PHASE,
+    IMPULSES,
+    FAILSAFE,
+    SERIALIZATION,
+    RENDERING,
+    NUM_PHASES
+  };
+
+  enum Counter
+  {
+    SOLVER_CALLS,
+    // Of those, the ones a Bernstein bound answered without finding roots.
+    SOLVER_CALLS_CULLED,
+    // Real-root solves of a polynomial of degree ROOT_SOLVES_DEGREE_1 + d - 1;
+    // degrees above 3 go to rpoly.
+    ROOT_SOLVES_DEGREE_1,
+    ROOT_SOLVES_DEGREE_2,
+    ROOT_SOLVES_DEGREE_3,
+    ROOT_SOLVES_DEGREE_4,
+    ROOT_SOLVES_DEGREE_5,
+    ROOT_SOLVES_DEGREE_6,
+    // Solves of degree above 3 that CCD_STAGED_INTERVALS skipped, since the
+    // cheaper polynomials of their call left no time, or a bound on the time
+    // they left ruled the solve out.
+    ROOT_SOLVES_SKIPPED,
+    // Signs the double filters of FilteredPredicates.h left open, decided
+    // again in extended precision.
+    FILTER_FALLBACKS,
+    // Pairs given to a narrow-phase test, and those found in contact.
+    BROAD_PHASE_CANDIDATES,
+    CONTACTS,
+    IMPULSE_ITERATIONS,
+    // The final impact zones of each failsafe, by number of particles.
+    IMPACT_ZONES,
+    ZONE_SIZE_1,
+    ZONE_SIZE_2,
+    ZONE_SIZE_3_4,
+    ZONE_SIZE_5_8,
+    ZONE_SIZE_9_16,
+    ZONE_SIZE_17_UP,
+    // Calls to operator new.
+    ALLOCATIONS,
+    NUM_COUNTERS
+  };
+
+  // Frames kept for a live display without a report.
+  const int LIVE_FRAMES = 120;
+
+  // Whether there is a report.
+  bool enabled();
+
+  bool tracing();
+
+  void setLive( bool live );
+
+  bool live();
+
+  void beginFrame();
+
+  const char *phaseName( Phase phase );
+
+#ifdef PROFILE_COUNTERS
+  const char *counterName( Counter counter );
+#endif
+
+  // Means per frame over the last completed frames, at most maxframes of
+  // them, and the frames begun per second over them. The counts are zero
+  // without PROFILE_COUNTERS.
+  struct FrameSummary
+  {
+    int frames;
+    double framespersecond;
+    double seconds[NUM_PHASES];
+    double counts[NUM_COUNTERS];
+  };
+
+  // Returns false if no frame has been completed since recording started.
+  bool summarizeRecentFrames( int maxframes, FrameSummary& summary );
+
+  // Writes the frames so far to filename. Returns false if it cannot be written.
+  bool writeReport( const std::string& filename );
+
+#ifdef PROFILE_COUNTERS
+  extern thread_local long long t_counts[NUM_COUNTERS];
+  extern thread_local bool t_registered;
+
+  // Makes this thread's block part of the frames' sums.
+  void registerThread();
+
+  inline void count( Counter counter, long long n )
+  {
+    if( !t_registered ) registerThread();
+    t_counts[counter] += n;
+  }
+
+  // Adds a zone of size particles to IMPACT_ZONES and its ZONE_SIZE bucket.
+  void countImpactZone( int size );
+#endif
+}
+
+#ifdef PROFILE_COUNTERS
+#define PROFILE_COUNT( counter, n ) phasetiming::count(( counter ), ( n ))
+#else
+#define PROFILE_COUNT( counter, n ) ( (void) 0 )
+#endif
+
+// Charges the wall-clock time of its scope to phase. Timers nest, and the
+// time of an inner timer goes to its phase alone, so the phases of a frame
+// add up to the time spent under timers. Timers keep one global record and
+// must not run inside parallel regions.
+class ScopedPhaseTimer
+{
+public:
+  explicit ScopedPhaseTimer( phasetiming::Phase phase );
+
+  ~ScopedPhaseTimer();
+
+  // Ends the timer before its scope does.
+  void stop();
+
+private:
+  ScopedPhaseTimer( const ScopedPhaseTimer& );
+  ScopedPhaseTimer& operator=( const ScopedPhaseTimer& );
+
+  phasetiming::Phase m_phase;
+  bool m_running;
+  bool m_traced;
+  int m_outer;
+};
+
+// A span on the calling thread's track of the trace, named by a string
+// literal. Unlike the phase timers these may run on any thread, so they mark
+// the work of each thread in a parallel region.
+class ScopedTraceEvent
+{
+public:
+  explicit ScopedTraceEvent( const char *name );
+
+  ~ScopedTraceEvent();
+
+private:
+  ScopedTraceEvent( const ScopedTraceEvent& );
+  ScopedTraceEvent& operator=( const ScopedTraceEvent& );
+
+  const char *m_name;
+  bool m_traced;
+};
+
+#endif
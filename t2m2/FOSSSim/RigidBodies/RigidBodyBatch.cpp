@@ -0,0 +1,118 @@
+#include "RigidBodyBatch.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "../ZoneMoments.h"
+
+RigidBodyBatch::RigidBodyBatch()
+: m_cx()
+, m_cy()
+, m_theta()
+, m_vx()
+, m_vy()
+, m_omega()
+, m_mass()
+, m_inertia()
+, m_radius()
+, m_first( 1, 0 )
+, m_lx()
+, m_ly()
+, m_wx()
+, m_wy()
+, m_particle()
+{}
+
+void RigidBodyBatch::clear()
+{
+  m_cx.clear();
+  m_cy.clear();
+  m_theta.clear();
+  m_vx.clear();
+  m_vy.clear();
+  m_omega.clear();
+  m_mass.clear();
+  m_inertia.clear();
+  m_radius.clear();
+  m_first.assign( 1, 0 );
+  m_lx.clear();
+  m_ly.clear();
+  m_wx.clear();
+  m_wy.clear();
+  m_particle.clear();
+}
+
+int RigidBodyBatch::addBody( const VectorXs &q, const VectorXs &qdot, const VectorXs &m, const int *particles, int count, bool fixed )
+{
+  ZoneMoments zone;
+  computeZoneMoments( q, qdot, m, particles, count, zone );
+  const Vector2s c = zone.center;
+
+  scalar R2 = 0.0;
+  for( int k = 0; k < count; ++k )
+  {
+    const int i = particles[k];
+    const Vector2s r = q.segment<2>(2*i) - c;
+    R2 = std::max( R2, r.squaredNorm() );
+    m_lx.push_back( r.x() );
+    m_ly.push_back( r.y() );
+    m_wx.push_back( q(2*i) );
+    m_wy.push_back( q(2*i+1) );
+    m_particle.push_back( i );
+  }
+  m_first.push_back( (int) m_particle.size() );
+
+  m_cx.push_back( c.x() );
+  m_cy.push_back( c.y() );
+  m_theta.push_back( 0.0 );
+  m_vx.push_back( fixed ? 0.0 : zone.velocity().x() );
+  m_vy.push_back( fixed ? 0.0 : zone.velocity().y() );
+  m_omega.push_back( fixed ? 0.0 : zone.angularVelocity() );
+  m_mass.push_back( zone.mass );
+  m_inertia.push_back( zone.inertia );
+  m_radius.push_back( std::sqrt( R2 ) );
+  return getNumBodies() - 1;
+}
+
+void RigidBodyBatch::step( scalar dt )
+{
+  const int nbodies = getNumBodies();
+  for( int b = 0; b < nbodies; ++b )
+  {
+    m_cx[b] += dt*m_vx[b];
+    m_cy[b] += dt*m_vy[b];
+    m_theta[b] += dt*m_omega[b];
+  }
+}
+
+void RigidBodyBatch::updateWorldVertices()
+{
+  const int nbodies = getNumBodies();
+  const scalar *lx = m_lx.empty() ? NULL : &m_lx[0];
+  const scalar *ly = m_ly.empty() ? NULL : &m_ly[0];
+  scalar *wx = m_wx.empty() ? NULL : &m_wx[0];
+  scalar *wy = m_wy.empty() ? NULL : &m_wy[0];
+  for( int b = 0; b < nbodies; ++b )
+  {
+    const scalar cs = std::cos( m_theta[b] );
+    const scalar sn = std::sin( m_theta[b] );
+    const scalar cx = m_cx[b];
+    const scalar cy = m_cy[b];
+    const int end = m_first[b+1];
+    for( int v = m_first[b]; v < end; ++v )
+    {
+      wx[v] = cx + cs*lx[v] - sn*ly[v];
+      wy[v] = cy + sn*lx[v] + cs*ly[v];
+    }
+  }
+}
+
+void RigidBodyBatch::scatterWorldVertices( VectorXs &q ) const
+{
+  const int nvertices = getNumVertices();
+  for( int v = 0; v < nvertices; ++v )
+  {
+    q(2*m_particle[v]) = m_wx[v];
+    q(2*m_particle[v]+1) = m_wy[v];
+  }
+}
@@ -0,0 +1,87 @@
+#ifndef RIGID_BODY_BATCH_H
+#define RIGID_BODY_BATCH_H
+
+#include <vector>
+
+#include "../MathDefs.h"
+
+// Rigid bodies stored as their state alone: center of mass, angle, linear and
+// angular velocity, mass and moment of inertia, one array per quantity. Each
+// body's vertices are kept in body coordinates, contiguously, so a step only
+// advances the state and the world-space vertices are produced in one pass:
+// a cosine and sine per body, then a rotation and translation per vertex in
+// a loop the compiler vectorizes. The base library's RigidBody instead
+// recomputes every vertex from the particles on each getWorldSpaceVertex call.
+//
+// A body is made from a set of particles, as the failsafe does with an impact
+// zone: its velocities carry the particles' linear and angular momentum.
+class RigidBodyBatch
+{
+public:
+  RigidBodyBatch();
+
+  void clear();
+
+  // Adds the body made of the given particles of (q, qdot), with per-DoF
+  // masses m. A fixed body keeps zero velocity. Returns the body's index.
+  int addBody( const VectorXs &q, const VectorXs &qdot, const VectorXs &m, const int *particles, int count, bool fixed );
+
+  int getNumBodies() const { return (int) m_mass.size(); }
+  int getNumVertices() const { return (int) m_particle.size(); }
+
+  // Body b's vertices are firstVertex(b) up to firstVertex(b+1).
+  int firstVertex( int b ) const { return m_first[b]; }
+
+  // The scene particle vertex v was made from.
+  int particle( int v ) const { return m_particle[v]; }
+
+  Vector2s getCenterOfMass( int b ) const { return Vector2s( m_cx[b], m_cy[b] ); }
+  scalar getAngle( int b ) const { return m_theta[b]; }
+  Vector2s getVelocity( int b ) const { return Vector2s( m_vx[b], m_vy[b] ); }
+  scalar getAngularVelocity( int b ) const { return m_omega[b]; }
+  scalar getMass( int b ) const { return m_mass[b]; }
+  scalar getMomentOfInertia( int b ) const { return m_inertia[b]; }
+
+  // Distance from the center of mass to the farthest vertex, so that the
+  // body lies in the circle of this radius about its center at any angle.
+  scalar getRadius( int b ) const { return m_radius[b]; }
+
+  // Vertex v in body coordinates.
+  Vector2s getLocalVertex( int v ) const { return Vector2s( m_lx[v], m_ly[v] ); }
+
+  // Advances every body by free rigid motion over dt.
+  void step( scalar dt );
+
+  // Recomputes every vertex's world-space position from its body's state.
+  void updateWorldVertices();
+
+  // As of the last updateWorldVertices.
+  Vector2s getWorldSpaceVertex( int v ) const { return Vector2s( m_wx[v], m_wy[v] ); }
+
+  // Writes each vertex's world-space position into its particle's entries
+  // of q, as of the last updateWorldVertices.
+  void scatterWorldVertices( VectorXs &q ) const;
+
+private:
+  // Body state.
+  std::vector<scalar> m_cx;
+  std::vector<scalar> m_cy;
+  std::vector<scalar> m_theta;
+  std::vector<scalar> m_vx;
+  std::vector<scalar> m_vy;
+  std::vector<scalar> m_omega;
+  std::vector<scalar> m_mass;
+  std::vector<scalar> m_inertia;
+  std::vector<scalar> m_radius;
+  // Vertex ranges, one more entry than there are bodies.
+  std::vector<int> m_first;
+
+  // Vertex data: body coordinates, world coordinates and source particle.
+  std::vector<scalar> m_lx;
+  std::vector<scalar> m_ly;
+  std::vector<scalar> m_wx;
+  std::vector<scalar> m_wy;
+  std::vector<int> m_particle;
+};
+
+#endif
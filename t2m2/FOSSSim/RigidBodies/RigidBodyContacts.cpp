@@ -0,0 +1,217 @@
+#include "RigidBodyContacts.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+namespace
+{
+
+// Vertices per leaf of a LocalVertexTree.
+const int LEAF_SIZE = 4;
+
+struct ByCoordinate
+{
+  const std::vector<scalar> &x;
+  const std::vector<scalar> &y;
+  int axis;
+  ByCoordinate( const std::vector<scalar> &x_, const std::vector<scalar> &y_, int axis_ ) : x(x_), y(y_), axis(axis_) {}
+  bool operator()( int a, int b ) const { return axis == 0 ? x[a] < x[b] : y[a] < y[b]; }
+};
+
+// A body's circle's x extent, padded by half the contact distance.
+struct Extent
+{
+  scalar min;
+  scalar max;
+  int body;
+  bool operator<( const Extent &other ) const { return min < other.min; }
+};
+
+}
+
+LocalVertexTree::LocalVertexTree()
+: m_nodes()
+, m_order()
+, m_x()
+, m_y()
+{}
+
+void LocalVertexTree::build( const RigidBodyBatch &bodies, int body )
+{
+  const int first = bodies.firstVertex(body);
+  const int count = bodies.firstVertex(body+1) - first;
+
+  // Sorted through a permutation of 0..count-1 and stored by it.
+  std::vector<scalar> x( count );
+  std::vector<scalar> y( count );
+  m_order.resize( count );
+  for( int k = 0; k < count; ++k )
+  {
+    const Vector2s p = bodies.getLocalVertex( first+k );
+    x[k] = p.x();
+    y[k] = p.y();
+    m_order[k] = k;
+  }
+  m_x.swap( x );
+  m_y.swap( y );
+
+  m_nodes.clear();
+  if( count > 0 ) buildRange( 0, count );
+
+  // Leaves address m_order; store the coordinates in its order and turn
+  // its entries into batch vertex indices.
+  std::vector<scalar> sx( count );
+  std::vector<scalar> sy( count );
+  for( int k = 0; k < count; ++k )
+  {
+    sx[k] = m_x[m_order[k]];
+    sy[k] = m_y[m_order[k]];
+    m_order[k] += first;
+  }
+  m_x.swap( sx );
+  m_y.swap( sy );
+}
+
+int LocalVertexTree::buildRange( int first, int last )
+{
+  const int index = (int) m_nodes.size();
+  m_nodes.push_back( Node() );
+
+  Node node;
+  node.min[0] = node.min[1] = HUGE_VAL;
+  node.max[0] = node.max[1] = -HUGE_VAL;
+  for( int k = first; k < last; ++k )
+  {
+    const int v = m_order[k];
+    node.min[0] = std::min( node.min[0], m_x[v] );
+    node.max[0] = std::max( node.max[0], m_x[v] );
+    node.min[1] = std::min( node.min[1], m_y[v] );
+    node.max[1] = std::max( node.max[1], m_y[v] );
+  }
+  node.left = node.right = -1;
+  node.first = first;
+  node.count = last - first;
+
+  if( last - first > LEAF_SIZE )
+  {
+    const int axis = node.max[0] - node.min[0] >= node.max[1] - node.min[1] ? 0 : 1;
+    const int mid = ( first + last )/2;
+    std::nth_element( m_order.begin()+first, m_order.begin()+mid, m_order.begin()+last, ByCoordinate( m_x, m_y, axis ) );
+    node.count = 0;
+    node.left = buildRange( first, mid );
+    node.right = buildRange( mid, last );
+  }
+
+  m_nodes[index] = node;
+  return index;
+}
+
+void LocalVertexTree::query( const Vector2s &p, scalar distance, std::vector<int> &near ) const
+{
+  if( m_nodes.empty() ) return;
+  const scalar d2 = distance*distance;
+
+  int stack[64];
+  int top = 0;
+  stack[top++] = 0;
+  while( top > 0 )
+  {
+    const Node &node = m_nodes[stack[--top]];
+    // Squared distance from p to the node's box.
+    const scalar dx = std::max( 0.0, std::max( node.min[0] - p.x(), p.x() - node.max[0] ) );
+    const scalar dy = std::max( 0.0, std::max( node.min[1] - p.y(), p.y() - node.max[1] ) );
+    if( dx*dx + dy*dy > d2 ) continue;
+
+    if( node.left < 0 )
+    {
+      for( int k = node.first; k < node.first + node.count; ++k )
+      {
+        const scalar ex = m_x[k] - p.x();
+        const scalar ey = m_y[k] - p.y();
+        if( ex*ex + ey*ey <= d2 ) near.push_back( m_order[k] );
+      }
+      continue;
+    }
+    stack[top++] = node.left;
+    stack[top++] = node.right;
+  }
+}
+
+RigidBodyContacts::RigidBodyContacts()
+: m_trees()
+{}
+
+void RigidBodyContacts::build( const RigidBodyBatch &bodies )
+{
+  m_trees.resize( bodies.getNumBodies() );
+  for( int b = 0; b < bodies.getNumBodies(); ++b ) m_trees[b].build( bodies, b );
+}
+
+void RigidBodyContacts::findBodyPairs( const RigidBodyBatch &bodies, scalar distance, std::vector<std::pair<int,int> > &pairs ) const
+{
+  pairs.clear();
+  const int nbodies = bodies.getNumBodies();
+  std::vector<Extent> extents( nbodies );
+  for( int b = 0; b < nbodies; ++b )
+  {
+    const scalar r = bodies.getRadius(b) + 0.5*distance;
+    extents[b].min = bodies.getCenterOfMass(b).x() - r;
+    extents[b].max = bodies.getCenterOfMass(b).x() + r;
+    extents[b].body = b;
+  }
+  std::sort( extents.begin(), extents.end() );
+
+  for( int i = 0; i < nbodies; ++i )
+  {
+    const int a = extents[i].body;
+    for( int j = i+1; j < nbodies && extents[j].min <= extents[i].max; ++j )
+    {
+      const int b = extents[j].body;
+      const scalar reach = bodies.getRadius(a) + bodies.getRadius(b) + distance;
+      if( ( bodies.getCenterOfMass(a) - bodies.getCenterOfMass(b) ).squaredNorm() > reach*reach ) continue;
+      pairs.push_back( std::make_pair( std::min(a,b), std::max(a,b) ) );
+    }
+  }
+  std::sort( pairs.begin(), pairs.end() );
+}
+
+void RigidBodyContacts::findContacts( const RigidBodyBatch &bodies, scalar distance, std::vector<RigidBodyContact> &contacts ) const
+{
+  assert( (int) m_trees.size() == bodies.getNumBodies() );
+  contacts.clear();
+  std::vector<std::pair<int,int> > pairs;
+  findBodyPairs( bodies, distance, pairs );
+
+  std::vector<int> near;
+  for( std::vector<std::pair<int,int> >::size_type k = 0; k < pairs.size(); ++k )
+  {
+    // The smaller body's vertices are looked up in the larger one's tree.
+    int tree = pairs[k].first;
+    int other = pairs[k].second;
+    if( bodies.firstVertex(other+1) - bodies.firstVertex(other) > bodies.firstVertex(tree+1) - bodies.firstVertex(tree) ) std::swap( tree, other );
+
+    const Vector2s c = bodies.getCenterOfMass(tree);
+    const scalar cs = std::cos( bodies.getAngle(tree) );
+    const scalar sn = std::sin( bodies.getAngle(tree) );
+    const scalar reach = bodies.getRadius(tree) + distance;
+    for( int v = bodies.firstVertex(other); v < bodies.firstVertex(other+1); ++v )
+    {
+      const Vector2s w = bodies.getWorldSpaceVertex(v) - c;
+      if( w.squaredNorm() > reach*reach ) continue;
+      const Vector2s local( cs*w.x() + sn*w.y(), -sn*w.x() + cs*w.y() );
+      near.clear();
+      m_trees[tree].query( local, distance, near );
+      for( std::vector<int>::size_type n = 0; n < near.size(); ++n )
+      {
+        RigidBodyContact contact;
+        const bool treefirst = tree < other;
+        contact.body1 = treefirst ? tree : other;
+        contact.body2 = treefirst ? other : tree;
+        contact.vertex1 = treefirst ? near[n] : v;
+        contact.vertex2 = treefirst ? v : near[n];
+        contacts.push_back( contact );
+      }
+    }
+  }
+}
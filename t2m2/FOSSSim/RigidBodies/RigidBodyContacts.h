@@ -0,0 +1,83 @@
+#ifndef RIGID_BODY_CONTACTS_H
+#define RIGID_BODY_CONTACTS_H
+
+#include <utility>
+#include <vector>
+
+#include "RigidBodyBatch.h"
+
+// Contact detection between the bodies of a RigidBodyBatch, in two stages.
+// The broad phase bounds each body by its circle of getRadius() about its
+// center, which holds at any angle, and sweeps the circles' x extents for
+// overlapping pairs. The narrow phase then looks up the vertices of one body
+// near each vertex of the other in a tree over the first body's vertices.
+// The tree is built in body coordinates, so it never changes as the body
+// moves; the query point is moved into the body's frame instead.
+
+// A bounding volume hierarchy over one body's vertices in body coordinates,
+// stored as a flat array with every node preceding its children.
+class LocalVertexTree
+{
+public:
+  LocalVertexTree();
+
+  void build( const RigidBodyBatch &bodies, int body );
+
+  // Appends to near the vertices, as RigidBodyBatch vertex indices, within
+  // distance of the point p given in body coordinates.
+  void query( const Vector2s &p, scalar distance, std::vector<int> &near ) const;
+
+private:
+  struct Node
+  {
+    scalar min[2];
+    scalar max[2];
+    // Children of an internal node; both -1 for a leaf.
+    int left;
+    int right;
+    // The leaf's range of m_order.
+    int first;
+    int count;
+  };
+
+  int buildRange( int first, int last );
+
+  std::vector<Node> m_nodes;
+  // Vertex indices, reordered so each leaf's are contiguous, and their
+  // body coordinates in the same order.
+  std::vector<int> m_order;
+  std::vector<scalar> m_x;
+  std::vector<scalar> m_y;
+};
+
+// A vertex of one body within the contact distance of a vertex of another.
+struct RigidBodyContact
+{
+  int body1;
+  int body2;
+  int vertex1;
+  int vertex2;
+};
+
+class RigidBodyContacts
+{
+public:
+  RigidBodyContacts();
+
+  // Rebuilds the vertex trees. Only needed when bodies are added or removed,
+  // not when they move.
+  void build( const RigidBodyBatch &bodies );
+
+  // Pairs of bodies, lower index first, whose bounding circles come within
+  // distance of each other at their current states. Sorted.
+  void findBodyPairs( const RigidBodyBatch &bodies, scalar distance, std::vector<std::pair<int,int> > &pairs ) const;
+
+  // Every pair of vertices of different bodies within distance of each
+  // other, as of the bodies' last updateWorldVertices.
+  void findContacts( const RigidBodyBatch &bodies, scalar distance, std::vector<RigidBodyContact> &contacts ) const;
+
+private:
+  std::vector<LocalVertexTree> m_trees;
+};
+
+#endif
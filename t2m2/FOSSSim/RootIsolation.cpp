@@ -0,0 +1,271 @@
+#include "RootIsolation.h"
+
+#include <algorithm>
+
+namespace
+{
+
+const int N = RootIsolationBatch::MAX_DEGREE;
+
+// Bisection takes an isolating interval down to 2^-BISECTION_STEPS of the
+// step, close enough to a simple root for Newton's method to double the
+// correct bits with each of the NEWTON_STEPS that follow.
+const int BISECTION_STEPS = 24;
+const int NEWTON_STEPS = 3;
+
+// Intervals bisected together.
+const int BLOCK = 8;
+
+// The Bernstein coefficients of sum a_k t^k of degree N on [0, 1] are
+// b_j = sum_{k<=j} C(j,k)/C(N,k) a_k.
+struct BernsteinWeights
+{
+    double w[N+1][N+1];
+
+    BernsteinWeights()
+    {
+        double binomial[N+1][N+1] = {};
+        for(int j = 0; j <= N; j++)
+        {
+            binomial[j][0] = 1.0;
+            for(int k = 1; k <= j; k++)
+                binomial[j][k] = binomial[j-1][k-1] + (k < j ? binomial[j-1][k] : 0.0);
+        }
+        for(int j = 0; j <= N; j++)
+            for(int k = 0; k <= N; k++)
+                w[j][k] = k <= j ? binomial[j][k]/binomial[N][k] : 0.0;
+    }
+};
+
+const BernsteinWeights BERNSTEIN;
+
+inline int sign(double x)
+{
+    return (x > 0.0) - (x < 0.0);
+}
+
+}
+
+void RootIsolationBatch::Intervals::clear()
+{
+    resize(0);
+}
+
+void RootIsolationBatch::Intervals::resize(int n)
+{
+    poly.resize(n);
+    lo.resize(n);
+    width.resize(n);
+    for(int k = 0; k <= N; k++)
+        b[k].resize(n);
+}
+
+RootIsolationBatch::RootIsolationBatch()
+{}
+
+void RootIsolationBatch::clear()
+{
+    for(int k = 0; k <= N; k++)
+        m_coeffs[k].clear();
+    m_numroots.clear();
+    m_roots.clear();
+}
+
+int RootIsolationBatch::add(const double *coeffs, int degree)
+{
+    const int index = size();
+    for(int k = 0; k <= N; k++)
+        m_coeffs[k].push_back(k < N-degree ? 0.0 : coeffs[k-(N-degree)]);
+    m_numroots.push_back(0);
+    m_roots.resize(N*(index+1));
+    return index;
+}
+
+void RootIsolationBatch::addRoot(int poly, double root)
+{
+    if(m_numroots[poly] < N)
+        m_roots[N*poly + m_numroots[poly]++] = root;
+}
+
+void RootIsolationBatch::solve()
+{
+    const int n = size();
+    std::fill(m_numroots.begin(), m_numroots.end(), 0);
+
+    m_current.resize(n);
+    for(int j = 0; j <= N; j++)
+    {
+        double *b = &m_current.b[j][0];
+        std::fill(b, b + n, 0.0);
+        for(int k = 0; k <= j; k++)
+        {
+            const double w = BERNSTEIN.w[j][k];
+            const double *a = &m_coeffs[N-k][0];
+            for(int i = 0; i < n; i++)
+                b[i] += w*a[i];
+        }
+    }
+    for(int i = 0; i < n; i++)
+    {
+        m_current.poly[i] = i;
+        m_current.lo[i] = 0.0;
+        m_current.width[i] = 1.0;
+        // The ends of the step, which no interval's inside covers.
+        if(m_current.b[0][i] == 0.0)
+            addRoot(i, 0.0);
+        if(m_current.b[N][i] == 0.0)
+            addRoot(i, 1.0);
+    }
+
+    m_isolated.clear();
+    m_isolatedlo.clear();
+    m_isolatedhi.clear();
+    m_isolatedsign.clear();
+    isolate();
+    refine();
+
+    for(int i = 0; i < n; i++)
+        std::sort(&m_roots[N*i], &m_roots[N*i] + m_numroots[i]);
+}
+
+// Splits the intervals level by level until each holds one root or none.
+void RootIsolationBatch::isolate()
+{
+    for(int depth = 0; m_current.size() > 0; depth++)
+    {
+        const int n = m_current.size();
+
+        // Sign changes of each interval's coefficients, skipping zeros.
+        m_variations.resize(n);
+        for(int i = 0; i < n; i++)
+        {
+            int last = sign(m_current.b[0][i]);
+            int variations = 0;
+            for(int k = 1; k <= N; k++)
+            {
+                const int s = sign(m_current.b[k][i]);
+                variations += s*last < 0;
+                last = s != 0 ? s : last;
+            }
+            m_variations[i] = variations;
+        }
+
+        int nsplit = 0;
+        for(int i = 0; i < n; i++)
+        {
+            const int poly = m_current.poly[i];
+            if(m_variations[i] == 0)
+                continue;
+            if(m_variations[i] == 1)
+            {
+                int s = 0;
+                for(int k = 0; k <= N && s == 0; k++)
+                    s = sign(m_current.b[k][i]);
+                m_isolated.push_back(poly);
+                m_isolatedlo.push_back(m_current.lo[i]);
+                m_isolatedhi.push_back(m_current.lo[i] + m_current.width[i]);
+                m_isolatedsign.push_back(s);
+            }
+            else if(depth == MAX_DEPTH)
+                addRoot(poly, m_current.lo[i] + 0.5*m_current.width[i]);
+            else
+                m_variations[nsplit++] = i;
+        }
+
+        // Each split interval becomes its halves, by de Casteljau's algorithm
+        // at 1/2: the left half takes the first coefficient of every level,
+        // the right half the last.
+        m_next.resize(2*nsplit);
+        for(int s = 0; s < nsplit; s++)
+        {
+            const int i = m_variations[s];
+            double level[N+1];
+            for(int k = 0; k <= N; k++)
+                level[k] = m_current.b[k][i];
+            m_next.b[0][2*s] = level[0];
+            m_next.b[N][2*s+1] = level[N];
+            for(int j = 1; j <= N; j++)
+            {
+                for(int k = 0; k <= N-j; k++)
+                    level[k] = 0.5*(level[k] + level[k+1]);
+                m_next.b[j][2*s] = level[0];
+                m_next.b[N-j][2*s+1] = level[N-j];
+            }
+
+            const double half = 0.5*m_current.width[i];
+            m_next.poly[2*s] = m_next.poly[2*s+1] = m_current.poly[i];
+            m_next.lo[2*s] = m_current.lo[i];
+            m_next.lo[2*s+1] = m_current.lo[i] + half;
+            m_next.width[2*s] = m_next.width[2*s+1] = half;
+            // A root right at the split is inside neither half.
+            if(level[0] == 0.0)
+                addRoot(m_current.poly[i], m_current.lo[i] + half);
+        }
+        std::swap(m_current, m_next);
+    }
+}
+
+// Bisects the isolating intervals in blocks of BLOCK, all of a block's
+// together, keeping the polynomial's sign just after lo at lo, then polishes
+// each root by Newton's method. A midpoint where the polynomial vanishes
+// becomes hi, so the interval closes on it. The block lives
+// in local arrays, so that the step is a loop of selects the compiler can
+// vectorize rather than a branch per interval that goes either way.
+void RootIsolationBatch::refine()
+{
+    const int n = (int)m_isolated.size();
+    for(int first = 0; first < n; first += BLOCK)
+    {
+        const int count = std::min(BLOCK, n - first);
+        double coeffs[N+1][BLOCK];
+        double lo[BLOCK], hi[BLOCK], s[BLOCK];
+        // Lanes past count repeat the first interval.
+        for(int i = 0; i < BLOCK; i++)
+        {
+            const int from = first + (i < count ? i : 0);
+            for(int k = 0; k <= N; k++)
+                coeffs[k][i] = m_coeffs[k][m_isolated[from]];
+            lo[i] = m_isolatedlo[from];
+            hi[i] = m_isolatedhi[from];
+            s[i] = m_isolatedsign[from];
+        }
+
+        for(int step = 0; step < BISECTION_STEPS; step++)
+        {
+            for(int i = 0; i < BLOCK; i++)
+            {
+                const double mid = 0.5*(lo[i] + hi[i]);
+                double value = coeffs[0][i];
+                for(int k = 1; k <= N; k++)
+                    value = value*mid + coeffs[k][i];
+                const bool before = value*s[i] > 0.0;
+                lo[i] = before ? mid : lo[i];
+                hi[i] = before ? hi[i] : mid;
+            }
+        }
+
+        // A Newton step that leaves the interval, as near a multiple root it
+        // may, is not taken.
+        double x[BLOCK];
+        for(int i = 0; i < BLOCK; i++)
+            x[i] = 0.5*(lo[i] + hi[i]);
+        for(int step = 0; step < NEWTON_STEPS; step++)
+        {
+            for(int i = 0; i < BLOCK; i++)
+            {
+                double value = coeffs[0][i];
+                double slope = 0.0;
+                for(int k = 1; k <= N; k++)
+                {
+                    slope = slope*x[i] + value;
+                    value = value*x[i] + coeffs[k][i];
+                }
+                const double next = x[i] - value/slope;
+                x[i] = next >= lo[i] && next <= hi[i] ? next : x[i];
+            }
+        }
+
+        for(int i = 0; i < count; i++)
+            addRoot(m_isolated[first + i], x[i]);
+    }
+}
@@ -0,0 +1,85 @@
+#ifndef ROOT_ISOLATION_H
+#define ROOT_ISOLATION_H
+
+#include <vector>
+
+// Real roots in [0, 1] of many polynomials of degree up to 5 at once, for
+// the particle-edge quintics that would otherwise each go through rpoly.
+//
+// Every polynomial is taken to its Bernstein coefficients on [0, 1], as a
+// quintic, and isolated by Descartes' rule of signs: an interval whose
+// coefficients change sign once holds one root, one whose coefficients do
+// not change sign holds none, and any other is split in half by de
+// Casteljau's algorithm. The isolated roots are then bisected to the last
+// bit. All of it works on structure-of-arrays lists of intervals, one pass
+// per level of splitting and one per bisection step, with the same
+// arithmetic for every interval, so the passes are loops the compiler can
+// vectorize and there is no per-polynomial branching as in rpoly.
+//
+// Roots closer together than 2^-MAX_DEPTH cannot be told apart and are
+// reported once, at the middle of their interval; like rpoly's output after
+// IMAGINARY_TOLERANCE filtering, that includes the real parts of complex
+// pairs that nearly touch the axis.
+class RootIsolationBatch
+{
+public:
+    static const int MAX_DEGREE = 5;
+    static const int MAX_DEPTH = 40;
+
+    RootIsolationBatch();
+
+    void clear();
+
+    // Adds coeffs[0] t^degree + ... + coeffs[degree], with 1 <= degree <=
+    // MAX_DEGREE, and returns its index in the batch.
+    int add(const double *coeffs, int degree);
+
+    int size() const {return (int)m_numroots.size();}
+
+    // Finds the roots of every polynomial added since the last clear.
+    void solve();
+
+    // The roots in [0, 1] of polynomial i, in increasing order.
+    int numRoots(int i) const {return m_numroots[i];}
+    const double *roots(int i) const {return &m_roots[MAX_DEGREE*i];}
+
+private:
+    typedef std::vector<double> Lane;
+
+    // Intervals being isolated: the polynomial of each, its start and width,
+    // and its Bernstein coefficients over it.
+    struct Intervals
+    {
+        std::vector<int> poly;
+        Lane lo;
+        Lane width;
+        Lane b[MAX_DEGREE+1];
+
+        int size() const {return (int)poly.size();}
+        void clear();
+        void resize(int n);
+    };
+
+    void addRoot(int poly, double root);
+    void isolate();
+    void refine();
+
+    // Power coefficients of each polynomial, highest degree first, padded to
+    // MAX_DEGREE with leading zeros.
+    Lane m_coeffs[MAX_DEGREE+1];
+
+    std::vector<int> m_numroots;
+    std::vector<double> m_roots;
+
+    Intervals m_current;
+    Intervals m_next;
+    std::vector<int> m_variations;
+    // Intervals holding one root each, and the sign of the polynomial just
+    // after lo.
+    std::vector<int> m_isolated;
+    Lane m_isolatedlo;
+    Lane m_isolatedhi;
+    Lane m_isolatedsign;
+};
+
+#endif
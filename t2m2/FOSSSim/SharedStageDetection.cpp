@@ -0,0 +1,75 @@
+#include "SharedStageDetection.h"
+#include "HybridCollisionHandler.h"
+#include "FrameArena.h"
+#include <algorithm>
+
+namespace
+{
+
+// The order detectCollisions reports collisions in: by particle, then
+// particle-particle before particle-edge before particle-halfplane, then by
+// the other index. Impulses are summed in list order, so an updated list
+// sorted this way responds exactly as a fresh one.
+bool detectionOrder( const CollisionInfo &a, const CollisionInfo &b )
+{
+  if( a.m_idx1 != b.m_idx1 ) return a.m_idx1 < b.m_idx1;
+  if( a.m_type != b.m_type ) return a.m_type < b.m_type;
+  return a.m_idx2 < b.m_idx2;
+}
+
+bool involves( const TwoDScene &scene, const CollisionInfo &info, const bool *moved )
+{
+  if( moved[info.m_idx1] ) return true;
+  if( info.m_type == CollisionInfo::PP ) return moved[info.m_idx2];
+  if( info.m_type == CollisionInfo::PE )
+  {
+    const std::pair<int,int> &edge = scene.getEdge( info.m_idx2 );
+    return moved[edge.first] || moved[edge.second];
+  }
+  return false;
+}
+
+}
+
+SharedStageDetection::SharedStageDetection()
+: m_qs()
+, m_qe()
+, m_collisions()
+, m_touching()
+{}
+
+void SharedStageDetection::detect( HybridCollisionHandler &handler, const TwoDScene &scene, const VectorXs &qs, const VectorXs &qe )
+{
+  m_qs = qs;
+  m_qe = qe;
+  m_collisions = handler.detectCollisions( scene, qs, qe );
+}
+
+void SharedStageDetection::update( HybridCollisionHandler &handler, const TwoDScene &scene, const VectorXs &qe )
+{
+  const int nparticles = scene.getNumParticles();
+  FrameArenaScope scope( framearena::frame() );
+  bool *moved = framearena::frame().allocate<bool>( nparticles );
+  bool anymoved = false;
+  for( int i = 0; i < nparticles; ++i )
+  {
+    moved[i] = qe.segment<2>( 2*i ) != m_qe.segment<2>( 2*i );
+    anymoved = anymoved || moved[i];
+  }
+  if( !anymoved ) return;
+
+  std::vector<CollisionInfo>::size_type kept = 0;
+  for( std::vector<CollisionInfo>::size_type k = 0; k < m_collisions.size(); ++k )
+    if( !involves( scene, m_collisions[k], moved ) ) m_collisions[kept++] = m_collisions[k];
+  m_collisions.erase( m_collisions.begin() + kept, m_collisions.end() );
+
+  handler.detectCollisionsTouching( scene, m_qs, qe, moved, m_touching );
+  m_collisions.insert( m_collisions.end(), m_touching.begin(), m_touching.end() );
+  std::sort( m_collisions.begin(), m_collisions.end(), detectionOrder );
+  m_qe = qe;
+}
+
+bool SharedStageDetection::covers( const VectorXs &qs, const VectorXs &qe ) const
+{
+  return m_qs.size() == qs.size() && m_qe.size() == qe.size() && m_qs == qs;
+}
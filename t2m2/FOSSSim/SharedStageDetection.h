@@ -0,0 +1,55 @@
+#ifndef SHARED_STAGE_DETECTION_H
+#define SHARED_STAGE_DETECTION_H
+
+#include "CollisionHandler.h"
+#include "MathDefs.h"
+#include "TwoDScene.h"
+#include <vector>
+
+class HybridCollisionHandler;
+
+// The collisions of a step from qs to the latest end positions, carried from
+// one stage of HybridCollisionHandler to the next. The impulse sweeps and the
+// failsafe each respond to collisions and detect again, and between two
+// detections only the particles a response moved can change the result: a
+// pair none of whose particles moved gives the collision it gave before.
+// Each detection after the first keeps those and tests only the pairs
+// touching a moved particle, so a step is detected in full once rather than
+// once per sweep and again for the failsafe.
+//
+// The base library builds the handler from the scene XML and runs its stages
+// itself, so this is kept statically by the handler and used when built with
+// SHARED_STAGE_DETECTION.
+class SharedStageDetection
+{
+public:
+  SharedStageDetection();
+
+  // Detects every pair from qs to qe afresh.
+  void detect( HybridCollisionHandler &handler, const TwoDScene &scene, const VectorXs &qs, const VectorXs &qe );
+
+  // Moves the detection on to end positions qe, from the same qs. The
+  // collisions are those detect would find, in the same order.
+  void update( HybridCollisionHandler &handler, const TwoDScene &scene, const VectorXs &qe );
+
+  // True if the last detection was from qs, so that update can move it on
+  // to qe.
+  bool covers( const VectorXs &qs, const VectorXs &qe ) const;
+
+  const std::vector<CollisionInfo> &getCollisions() const { return m_collisions; }
+
+  // Bytes held from sweep to sweep, for memoryaccounting.
+  size_t bytesHeld() const
+  {
+    return sizeof(scalar)*( m_qs.size() + m_qe.size() ) + sizeof(CollisionInfo)*( m_collisions.capacity() + m_touching.capacity() );
+  }
+
+private:
+  VectorXs m_qs;
+  VectorXs m_qe;
+  std::vector<CollisionInfo> m_collisions;
+  // Scratch for the re-detected pairs, kept for its storage.
+  std::vector<CollisionInfo> m_touching;
+};
+
+#endif
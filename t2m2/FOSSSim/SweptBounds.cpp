@@ -0,0 +1,77 @@
+#include "SweptBounds.h"
+#include <algorithm>
+
+namespace
+{
+
+// Absolute padding so that grazing contacts found by the polynomial solver
+// are never rejected by rounding in the box test.
+const scalar SWEPT_BOX_SLACK = 1.0e-9;
+
+struct SweptBox
+{
+  Vector2s min;
+  Vector2s max;
+
+  void extend( const SweptBox& other )
+  {
+    min = min.cwiseMin(other.min);
+    max = max.cwiseMax(other.max);
+  }
+
+  bool overlaps( const SweptBox& other ) const
+  {
+    return min.x() <= other.max.x() && other.min.x() <= max.x() &&
+           min.y() <= other.max.y() && other.min.y() <= max.y();
+  }
+};
+
+SweptBox particleBox( const Vector2s& a, const Vector2s& b, scalar radius )
+{
+  SweptBox box;
+  box.min = a.cwiseMin(b).array() - ( radius + SWEPT_BOX_SLACK );
+  box.max = a.cwiseMax(b).array() + ( radius + SWEPT_BOX_SLACK );
+  return box;
+}
+
+SweptBox particleBox( const VectorXs& qs, const VectorXs& qe, int particle, scalar radius )
+{
+  return particleBox( qs.segment<2>(2*particle), qe.segment<2>(2*particle), radius );
+}
+
+SweptBox particleBox( const ParticleBlock& p )
+{
+  return particleBox( Vector2s( p.xs[0], p.xs[1] ), Vector2s( p.xe[0], p.xe[1] ), p.radius );
+}
+
+}
+
+bool sweptParticlesMayCollide( const TwoDScene &scene, const VectorXs &qs, const VectorXs &qe, int idx1, int idx2 )
+{
+  return particleBox( qs, qe, idx1, scene.getRadius(idx1) ).overlaps( particleBox( qs, qe, idx2, scene.getRadius(idx2) ) );
+}
+
+bool sweptParticlesMayCollide( const ParticleBlock &p1, const ParticleBlock &p2 )
+{
+  return particleBox( p1 ).overlaps( particleBox( p2 ) );
+}
+
+bool sweptParticleEdgeMayCollide( const TwoDScene &scene, const VectorXs &qs, const VectorXs &qe, int vidx, int eidx )
+{
+  const std::pair<int,int>& edge = scene.getEdge(eidx);
+  const scalar r = scene.getEdgeRadii()[eidx];
+  SweptBox edgebox = particleBox( qs, qe, edge.first, r );
+  edgebox.extend( particleBox( qs, qe, edge.second, r ) );
+  return particleBox( qs, qe, vidx, scene.getRadius(vidx) ).overlaps( edgebox );
+}
+
+bool sweptParticleHalfplaneMayCollide( const TwoDScene &scene, const VectorXs &qs, const VectorXs &qe, int vidx, int pidx )
+{
+  const std::pair<VectorXs,VectorXs>& halfplane = scene.getHalfplane(pidx);
+  Vector2s n = halfplane.second.segment<2>(0);
+  n.normalize();
+  // The signed distance is linear along the motion, so its minimum is at an end.
+  scalar ds = n.dot( qs.segment<2>(2*vidx) - halfplane.first.segment<2>(0) );
+  scalar de = n.dot( qe.segment<2>(2*vidx) - halfplane.first.segment<2>(0) );
+  return std::min(ds,de) <= scene.getRadius(vidx) + SWEPT_BOX_SLACK;
+}
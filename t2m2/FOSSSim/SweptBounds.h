@@ -0,0 +1,23 @@
+#ifndef SWEPT_BOUNDS_H
+#define SWEPT_BOUNDS_H
+
+#include "TwoDScene.h"
+#include "MathDefs.h"
+#include "ParticleBlocks.h"
+
+// Conservative rejection tests for continuous-time collision detection.
+// Each object is bounded by the axis-aligned box swept by its motion from qs
+// to qe, padded by its radius. Objects whose swept boxes do not overlap
+// cannot come into contact during the step, so the polynomial solve can be
+// skipped. All tests are O(1) and read only the DoFs of the objects involved.
+
+bool sweptParticlesMayCollide( const TwoDScene &scene, const VectorXs &qs, const VectorXs &qe, int idx1, int idx2 );
+
+// The same test from the particles' ParticleBlocks.
+bool sweptParticlesMayCollide( const ParticleBlock &p1, const ParticleBlock &p2 );
+
+bool sweptParticleEdgeMayCollide( const TwoDScene &scene, const VectorXs &qs, const VectorXs &qe, int vidx, int eidx );
+
+bool sweptParticleHalfplaneMayCollide( const TwoDScene &scene, const VectorXs &qs, const VectorXs &qe, int vidx, int pidx );
+
+#endif
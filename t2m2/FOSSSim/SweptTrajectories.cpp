@@ -0,0 +1,78 @@
+#include "SweptTrajectories.h"
+
+VertexTrajectory vertexTrajectory( const VectorXs &qs, const VectorXs &qe, int particle )
+{
+  VertexTrajectory vertex;
+  vertex.x[0] = qs(2*particle);
+  vertex.x[1] = qs(2*particle+1);
+  vertex.dx[0] = qe(2*particle) - qs(2*particle);
+  vertex.dx[1] = qe(2*particle+1) - qs(2*particle+1);
+  return vertex;
+}
+
+// The products are taken in the order Vector2s::dot takes them, so that the
+// polynomials built from these match those built from the positions.
+EdgeTrajectory edgeTrajectory( const VertexTrajectory &v2, const VertexTrajectory &v3 )
+{
+  EdgeTrajectory edge;
+  for( int k = 0; k < 2; ++k )
+  {
+    edge.x[k] = v3.x[k] - v2.x[k];
+    edge.dx[k] = v3.dx[k] - v2.dx[k];
+  }
+  const Vector2s x( edge.x[0], edge.x[1] );
+  const Vector2s dx( edge.dx[0], edge.dx[1] );
+  edge.xx = x.dot(x);
+  edge.xdx = x.dot(dx);
+  edge.dxdx = dx.dot(dx);
+  edge.padding = 0.0;
+  return edge;
+}
+
+SweptTrajectories::SweptTrajectories( const TwoDScene &scene, const VectorXs &qs, const VectorXs &qe, FrameArena &arena )
+: m_scene( scene )
+, m_vertices( arena.allocate<VertexTrajectory>( scene.getNumParticles() ) )
+, m_edges( arena.allocate<EdgeTrajectory>( scene.getNumEdges() ) )
+, m_firstincident( arena.allocate<int>( scene.getNumParticles() + 1, 0 ) )
+, m_incident( arena.allocate<int>( 2*scene.getNumEdges() ) )
+{
+  const int nparticles = scene.getNumParticles();
+  const int nedges = scene.getNumEdges();
+  assert( qs.size() == 2*nparticles );
+  assert( qe.size() == 2*nparticles );
+
+  for( int i = 0; i < nparticles; ++i ) m_vertices[i] = vertexTrajectory( qs, qe, i );
+
+  const std::vector<std::pair<int,int> > &edges = scene.getEdges();
+  for( int e = 0; e < nedges; ++e )
+  {
+    m_edges[e] = edgeTrajectory( m_vertices[edges[e].first], m_vertices[edges[e].second] );
+    ++m_firstincident[edges[e].first + 1];
+    ++m_firstincident[edges[e].second + 1];
+  }
+  for( int i = 0; i < nparticles; ++i ) m_firstincident[i+1] += m_firstincident[i];
+
+  FrameArenaScope scratch( arena );
+  int* next = arena.allocate<int>( nparticles );
+  for( int i = 0; i < nparticles; ++i ) next[i] = m_firstincident[i];
+  for( int e = 0; e < nedges; ++e )
+  {
+    m_incident[next[edges[e].first]++] = e;
+    m_incident[next[edges[e].second]++] = e;
+  }
+}
+
+void SweptTrajectories::updateEnd( const VectorXs &qe, int particle )
+{
+  assert( particle >= 0 ); assert( particle < m_scene.getNumParticles() );
+  VertexTrajectory &vertex = m_vertices[particle];
+  vertex.dx[0] = qe(2*particle) - vertex.x[0];
+  vertex.dx[1] = qe(2*particle+1) - vertex.x[1];
+
+  const std::vector<std::pair<int,int> > &edges = m_scene.getEdges();
+  for( int k = m_firstincident[particle]; k < m_firstincident[particle+1]; ++k )
+  {
+    const int e = m_incident[k];
+    m_edges[e] = edgeTrajectory( m_vertices[edges[e].first], m_vertices[edges[e].second] );
+  }
+}
@@ -0,0 +1,64 @@
+#ifndef SWEPT_TRAJECTORIES_H
+#define SWEPT_TRAJECTORIES_H
+
+#include "TwoDScene.h"
+#include "MathDefs.h"
+#include "FrameArena.h"
+
+// The linear motion of a particle over the step: its start position and its
+// displacement qe - qs.
+struct VertexTrajectory
+{
+  scalar x[2];
+  scalar dx[2];
+};
+
+// What the particle-edge polynomials need of an edge alone, the same for
+// every particle tested against it: the edge vector x3 - x2 at the start of
+// the step, its change dx3 - dx2 over the step, and their dot products.
+struct EdgeTrajectory
+{
+  scalar x[2];
+  scalar dx[2];
+  // (x3-x2).(x3-x2), (x3-x2).(dx3-dx2) and (dx3-dx2).(dx3-dx2).
+  scalar xx;
+  scalar xdx;
+  scalar dxdx;
+  scalar padding;
+};
+
+VertexTrajectory vertexTrajectory( const VectorXs &qs, const VectorXs &qe, int particle );
+
+// The edge from v2 to v3.
+EdgeTrajectory edgeTrajectory( const VertexTrajectory &v2, const VertexTrajectory &v3 );
+
+// The VertexTrajectory of every particle and the EdgeTrajectory of every edge
+// in a scene, in storage taken from the step's arena, so that a sweep of
+// every particle against every edge computes each edge's terms once rather
+// than once per particle.
+class SweptTrajectories
+{
+public:
+  SweptTrajectories( const TwoDScene &scene, const VectorXs &qs, const VectorXs &qe, FrameArena &arena );
+
+  const VertexTrajectory& vertex( int particle ) const { return m_vertices[particle]; }
+  const EdgeTrajectory& edge( int e ) const { return m_edges[e]; }
+
+  // Refreshes one particle's displacement, and the edges it ends, after a
+  // response moved it.
+  void updateEnd( const VectorXs &qe, int particle );
+
+private:
+  SweptTrajectories( const SweptTrajectories& );
+  SweptTrajectories& operator=( const SweptTrajectories& );
+
+  const TwoDScene &m_scene;
+  VertexTrajectory* m_vertices;
+  EdgeTrajectory* m_edges;
+  // The edges ending at particle i are m_incident[m_firstincident[i]] up to
+  // m_incident[m_firstincident[i+1]].
+  int* m_firstincident;
+  int* m_incident;
+};
+
+#endif
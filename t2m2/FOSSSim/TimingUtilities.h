@@ -0,0 +1,10 @@
+#ifndef __TIMING_UTILITIES_H__
+#define __TIMING_UTILITIES_H__
+
+namespace timingutils
+{
+  // Wall-clock time in seconds, to the microsecond.
+  double seconds();
+}
+
+#endif
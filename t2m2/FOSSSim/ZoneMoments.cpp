@@ -0,0 +1,56 @@
+#include "ZoneMoments.h"
+
+#include <cassert>
+
+void computeZoneMoments( const VectorXs &q, const VectorXs &qdot, const VectorXs &m, const int *indices, int count, ZoneMoments &moments )
+{
+  assert( count > 0 );
+  const scalar *x = q.data();
+  const scalar *v = qdot.data();
+  const scalar *mass = m.data();
+  const scalar rx = x[2*indices[0]];
+  const scalar ry = x[2*indices[0]+1];
+
+  // Every sum in its own scalar, so that the loop body is a gather and a
+  // handful of independent multiply-adds.
+  scalar M = 0.0;
+  scalar mx = 0.0;
+  scalar my = 0.0;
+  scalar px = 0.0;
+  scalar py = 0.0;
+  scalar L = 0.0;
+  scalar J = 0.0;
+  for( int k = 0; k < count; ++k )
+  {
+    const int i = indices[k];
+    const scalar mi = mass[2*i];
+    const scalar dx = x[2*i] - rx;
+    const scalar dy = x[2*i+1] - ry;
+    const scalar vx = v[2*i];
+    const scalar vy = v[2*i+1];
+    M += mi;
+    mx += mi*dx;
+    my += mi*dy;
+    px += mi*vx;
+    py += mi*vy;
+    L += mi*( dx*vy - dy*vx );
+    J += mi*( dx*dx + dy*dy );
+  }
+
+  // Parallel axis shift from the first particle to the center of mass.
+  const scalar cx = mx/M;
+  const scalar cy = my/M;
+  moments.mass = M;
+  moments.center = Vector2s( rx + cx, ry + cy );
+  moments.momentum = Vector2s( px, py );
+  moments.angular_momentum = L - ( cx*py - cy*px );
+  const scalar I = J - M*( cx*cx + cy*cy );
+  moments.inertia = I > 0.0 ? I : 0.0;
+  moments.fixed = false;
+}
+
+void computeZoneMoments( const TwoDScene &scene, const VectorXs &q, const VectorXs &qdot, const int *indices, int count, ZoneMoments &moments )
+{
+  computeZoneMoments( q, qdot, scene.getM(), indices, count, moments );
+  for( int k = 0; k < count && !moments.fixed; ++k ) moments.fixed = scene.isFixed( indices[k] );
+}
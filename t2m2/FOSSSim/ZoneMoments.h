@@ -0,0 +1,36 @@
+#ifndef ZONE_MOMENTS_H
+#define ZONE_MOMENTS_H
+
+#include "TwoDScene.h"
+#include "MathDefs.h"
+
+// What the failsafe needs to fit a rigid motion to an impact zone: the
+// zone's mass, center of mass, linear momentum, and angular momentum and
+// moment of inertia about the center of mass.
+struct ZoneMoments
+{
+  scalar mass;
+  Vector2s center;
+  Vector2s momentum;
+  scalar angular_momentum;
+  scalar inertia;
+  // Whether any of the zone's particles is fixed, which fixes the zone.
+  bool fixed;
+
+  Vector2s velocity() const { return momentum/mass; }
+  // Zero for a zone that cannot spin: one particle, or coincident ones.
+  scalar angularVelocity() const { return inertia > 0.0 ? angular_momentum/inertia : 0.0; }
+};
+
+// Computes the moments of the particles indices[0..count) of (q, qdot), with
+// per-DoF masses m, in one pass over the zone and without allocating. The
+// sums are taken about the first particle rather than the origin and then
+// moved to the center of mass, which keeps the parallel axis shift from
+// cancelling for zones far from the origin. The index list is the flat form
+// FlatImpactZones keeps, so a zone is a span of it. Does not set fixed.
+void computeZoneMoments( const VectorXs &q, const VectorXs &qdot, const VectorXs &m, const int *indices, int count, ZoneMoments &moments );
+
+// The same, with the masses and fixed flags of the scene's particles.
+void computeZoneMoments( const TwoDScene &scene, const VectorXs &q, const VectorXs &qdot, const int *indices, int count, ZoneMoments &moments );
+
+#endif
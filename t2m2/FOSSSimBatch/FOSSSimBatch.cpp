@@ -0,0 +1,231 @@
+// Runs a list of scenes, several at a time, for parameter sweeps.
+//
+// The simulation loop, the scene loader and the state they keep between
+// steps live in the base library, which has no interface for stepping more
+// than one scene in a process. So every scene is run by the headless FOSSSim
+// executable, and up to -j of them run at once, each in its own process.
+// The headless executable links no OpenGL or GLUT, so a scene costs little
+// more to start than it does to parse.
+//
+// Each line of the scene list is a scene file followed by any further FOSSSim
+// arguments for it, separated by whitespace, as in
+//
+//   assets/t2m2/HolisticTests/test00.xml -o sweep/test00.bin
+//
+// Quotes are not understood, so neither may contain spaces. Blank lines and
+// lines starting with # are skipped.
+//
+// --mem-budget gives every scene a memory budget, through the
+// FOSSSIM_MEM_BUDGET environment variable its process inherits; see
+// MemoryAccounting.h.
+
+#include <fcntl.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <tclap/CmdLine.h>
+
+#include "BenchTimer.h"
+
+namespace
+{
+
+struct SceneRun
+{
+  // Line of the scene list it came from.
+  int line;
+  std::vector<std::string> arguments;
+};
+
+struct Running
+{
+  std::vector<SceneRun>::size_type run;
+  Eigen::BenchTimer timer;
+};
+
+void complain( const std::string& what )
+{
+  std::cerr << "\033[31;1mERROR IN FOSSSIMBATCH:\033[m " << what << std::endl;
+}
+
+bool readSceneList( const std::string& filename, std::vector<SceneRun>& runs )
+{
+  std::ifstream ifs(filename.c_str());
+  if( !ifs ) return false;
+  std::string line;
+  for( int number = 1; std::getline(ifs, line); ++number )
+  {
+    std::istringstream words(line);
+    SceneRun run;
+    run.line = number;
+    std::string word;
+    while( words >> word ) run.arguments.push_back(word);
+    if( run.arguments.empty() || run.arguments[0][0] == '#' ) continue;
+    runs.push_back(run);
+  }
+  return true;
+}
+
+// Starts the executable on a scene, headless, with its output going to
+// logfile, or nowhere if there is none. Returns the child's pid, or -1.
+pid_t startRun( const std::string& executable, const SceneRun& run, const std::string& logfile )
+{
+  std::vector<std::string> arguments;
+  arguments.push_back(executable);
+  arguments.push_back("-s");
+  arguments.push_back(run.arguments[0]);
+  arguments.push_back("-d");
+  arguments.push_back("0");
+  arguments.insert(arguments.end(), run.arguments.begin() + 1, run.arguments.end());
+
+  // Built before forking; the child only calls what is safe after fork.
+  std::vector<char*> argv;
+  for( std::vector<std::string>::size_type i = 0; i < arguments.size(); ++i ) argv.push_back(const_cast<char*>(arguments[i].c_str()));
+  argv.push_back(NULL);
+  const char* output = logfile.empty() ? "/dev/null" : logfile.c_str();
+
+  const pid_t pid = fork();
+  if( pid != 0 ) return pid;
+
+  const int fd = open(output, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if( fd < 0 ) _exit(127);
+  dup2(fd, STDOUT_FILENO);
+  dup2(fd, STDERR_FILENO);
+  close(fd);
+  execv(argv[0], &argv[0]);
+  _exit(127);
+}
+
+std::string logFileName( const std::string& logdirectory, const SceneRun& run )
+{
+  if( logdirectory.empty() ) return "";
+  std::ostringstream name;
+  name << logdirectory << "/line" << std::setw(5) << std::setfill('0') << run.line << ".log";
+  return name.str();
+}
+
+std::string describeStatus( int status )
+{
+  std::ostringstream description;
+  if( WIFEXITED(status) && WEXITSTATUS(status) == 127 ) description << "could not be started";
+  else if( WIFEXITED(status) ) description << "exited with status " << WEXITSTATUS(status);
+  else if( WIFSIGNALED(status) ) description << "killed by signal " << WTERMSIG(status);
+  else description << "failed";
+  return description.str();
+}
+
+}
+
+int main( int argc, char** argv )
+{
+  std::string executable, scenelist, logdirectory, budget;
+  int numworkers;
+  try
+  {
+    TCLAP::CmdLine cmd("Runs the scenes of a list, several at a time, with headless FOSSSim.", ' ', "1.0");
+    TCLAP::ValueArg<int> workersArg("j", "jobs", "Scenes to run at once, by default one per processor", false, 0, "integer", cmd);
+    TCLAP::ValueArg<std::string> executableArg("x", "executable", "FOSSSim executable to run the scenes with", false, FOSSSIM_EXECUTABLE, "string", cmd);
+    TCLAP::ValueArg<std::string> logArg("l", "logs", "Existing directory to write the output of every scene to, as line<n>.log", false, "", "string", cmd);
+    TCLAP::ValueArg<std::string> budgetArg("", "mem-budget", "Memory budget of every scene, in bytes or with a K, M or G suffix", false, "", "string", cmd);
+    TCLAP::UnlabeledValueArg<std::string> listArg("scenes", "Scene list, one scene and its FOSSSim arguments per line", true, "", "string", cmd);
+    cmd.parse(argc, argv);
+    numworkers = workersArg.getValue();
+    executable = executableArg.getValue();
+    logdirectory = logArg.getValue();
+    budget = budgetArg.getValue();
+    scenelist = listArg.getValue();
+  }
+  catch( TCLAP::ArgException& e )
+  {
+    std::cerr << "error: " << e.what() << std::endl;
+    return 1;
+  }
+
+  if( numworkers < 0 )
+  {
+    complain("The number of jobs must not be negative.");
+    return 1;
+  }
+  if( numworkers == 0 ) numworkers = std::max(1L, sysconf(_SC_NPROCESSORS_ONLN));
+  if( !budget.empty() && setenv("FOSSSIM_MEM_BUDGET", budget.c_str(), 1) != 0 )
+  {
+    complain("Failed to set the memory budget.");
+    return 1;
+  }
+
+  std::vector<SceneRun> runs;
+  if( !readSceneList(scenelist, runs) )
+  {
+    complain("Failed to read " + scenelist + ".");
+    return 1;
+  }
+  if( access(executable.c_str(), X_OK) != 0 )
+  {
+    complain("Cannot run " + executable + ".");
+    return 1;
+  }
+
+  Eigen::BenchTimer total;
+  total.start();
+  std::map<pid_t, Running> running;
+  std::vector<SceneRun>::size_type next = 0;
+  int failures = 0;
+  while( next < runs.size() || !running.empty() )
+  {
+    while( next < runs.size() && (int) running.size() < numworkers )
+    {
+      const pid_t pid = startRun(executable, runs[next], logFileName(logdirectory, runs[next]));
+      if( pid < 0 )
+      {
+        complain("Failed to start a process for " + runs[next].arguments[0] + ": " + strerror(errno) + ".");
+        ++failures;
+      }
+      else
+      {
+        Running& started = running[pid];
+        started.run = next;
+        started.timer.start();
+      }
+      ++next;
+    }
+    if( running.empty() ) continue;
+
+    int status;
+    const pid_t pid = waitpid(-1, &status, 0);
+    if( pid < 0 ) break;
+    std::map<pid_t, Running>::iterator finished = running.find(pid);
+    if( finished == running.end() ) continue;
+    finished->second.timer.stop();
+
+    const SceneRun& run = runs[finished->second.run];
+    std::cout << run.arguments[0] << " (line " << run.line << "): ";
+    if( WIFEXITED(status) && WEXITSTATUS(status) == 0 )
+    {
+      std::cout << std::fixed << std::setprecision(3) << finished->second.timer.value(Eigen::REAL_TIMER) << " s" << std::endl;
+    }
+    else
+    {
+      std::cout << "\033[31;1m" << describeStatus(status) << "\033[m" << std::endl;
+      ++failures;
+    }
+    running.erase(finished);
+  }
+  total.stop();
+
+  std::cout << runs.size() << " scenes in " << std::fixed << std::setprecision(3) << total.value(Eigen::REAL_TIMER) << " s on "
+            << numworkers << ( numworkers == 1 ? " job" : " jobs" ) << ", " << failures << " failed." << std::endl;
+  return failures > 0 ? 1 : 0;
+}
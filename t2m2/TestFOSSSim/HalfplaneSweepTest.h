@@ -0,0 +1,75 @@
+#ifndef __HALFPLANE_SWEEP_TEST_H__
+#define __HALFPLANE_SWEEP_TEST_H__
+
+#include <gtest/gtest.h>
+#include <cmath>
+#include <random>
+
+#include "FOSSSim/HalfplaneSweep.h"
+
+// Particles placed to touch a half-plane at a chosen time, moving in a
+// straight line over the step, have to be found at that time, with n the
+// vector of length r from the particle into the half-plane.
+TEST(HalfplaneSweep, TimeOfImpactMatchesAnalytic)
+{
+  std::mt19937 generator(7);
+  std::uniform_real_distribution<scalar> unit(0.0, 1.0);
+  std::uniform_real_distribution<scalar> coordinate(-10.0, 10.0);
+  std::uniform_real_distribution<scalar> angle(0.0, 2.0*M_PI);
+
+  for( int k = 0; k < 10000; ++k )
+  {
+    const Vector2s x0( coordinate(generator), coordinate(generator) );
+    const scalar theta = angle(generator);
+    const Vector2s nhat( cos(theta), sin(theta) );
+    const Vector2s tangent( -nhat.y(), nhat.x() );
+    const scalar r = 0.01 + unit(generator);
+    const scalar thit = 0.01 + 0.98*unit(generator);
+
+    // Approaching the half-plane, possibly sliding along it too.
+    const Vector2s v = -( 0.1 + 20.0*unit(generator) )*nhat + coordinate(generator)*tangent;
+    const Vector2s phit = x0 + r*nhat + coordinate(generator)*tangent;
+    const Vector2s ps = phit - thit*v;
+    const Vector2s pe = ps + v;
+
+    Vector2s n;
+    double time;
+    ASSERT_TRUE( halfplaneTimeOfImpact( ( ps - x0 ).dot(nhat), ( pe - x0 ).dot(nhat), r, nhat, n, time ) ) << "case " << k;
+    EXPECT_NEAR( time, thit, 1e-9 ) << "case " << k;
+    EXPECT_NEAR( ( n + r*nhat ).norm(), 0.0, 1e-9 ) << "case " << k;
+  }
+}
+
+TEST(HalfplaneSweep, TimeOfImpactEdgeCases)
+{
+  const Vector2s nhat( 0.0, 1.0 );
+  const scalar r = 0.5;
+  Vector2s n;
+  double time;
+
+  // Overlapping at the start while approaching: impact at once, at the
+  // start distance.
+  ASSERT_TRUE( halfplaneTimeOfImpact( 0.25, -1.0, r, nhat, n, time ) );
+  EXPECT_EQ( time, 0.0 );
+  EXPECT_EQ( n, Vector2s( 0.0, -0.25 ) );
+
+  // Overlapping and moving along the half-plane.
+  ASSERT_TRUE( halfplaneTimeOfImpact( 0.25, 0.25, r, nhat, n, time ) );
+  EXPECT_EQ( time, 0.0 );
+
+  // Overlapping but moving away.
+  EXPECT_FALSE( halfplaneTimeOfImpact( 0.25, 0.75, r, nhat, n, time ) );
+
+  // Approaching but still clear at the end.
+  EXPECT_FALSE( halfplaneTimeOfImpact( 3.0, 0.75, r, nhat, n, time ) );
+
+  // Moving along the half-plane clear of it.
+  EXPECT_FALSE( halfplaneTimeOfImpact( 3.0, 3.0, r, nhat, n, time ) );
+
+  // Just reaching it at the end of the step.
+  ASSERT_TRUE( halfplaneTimeOfImpact( 1.5, 0.5, r, nhat, n, time ) );
+  EXPECT_EQ( time, 1.0 );
+  EXPECT_NEAR( n.y(), -0.5, 1e-15 );
+}
+
+#endif
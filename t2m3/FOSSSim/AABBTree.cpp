@@ -0,0 +1,103 @@
+#include "AABBTree.h"
+#include <algorithm>
+
+namespace
+{
+
+// Primitives per leaf.
+const int LEAF_SIZE = 4;
+
+struct CenterLess
+{
+  const std::vector<AABB>& boxes;
+  int axis;
+
+  CenterLess( const std::vector<AABB>& b, int a ) : boxes(b), axis(a) {}
+
+  bool operator()( int a, int b ) const
+  {
+    return boxes[a].min(axis) + boxes[a].max(axis) < boxes[b].min(axis) + boxes[b].max(axis);
+  }
+};
+
+void merge( const AABB& a, const AABB& b, AABB& out )
+{
+  out.min = a.min.cwiseMin(b.min);
+  out.max = a.max.cwiseMax(b.max);
+}
+
+}
+
+AABBTree::AABBTree()
+: m_nodes()
+, m_primitives()
+{}
+
+void AABBTree::build( const std::vector<AABB>& boxes )
+{
+  const int n = (int) boxes.size();
+  m_nodes.clear();
+  m_primitives.resize( n );
+  for( int i = 0; i < n; ++i ) m_primitives[i] = i;
+  if( n == 0 ) return;
+  m_nodes.reserve( 2*( n/LEAF_SIZE+1 ) );
+  buildRange( boxes, 0, n );
+}
+
+int AABBTree::buildRange( const std::vector<AABB>& boxes, int first, int last )
+{
+  const int index = (int) m_nodes.size();
+  m_nodes.push_back( Node() );
+
+  AABB box = boxes[m_primitives[first]];
+  for( int k = first+1; k < last; ++k ) merge( box, boxes[m_primitives[k]], box );
+
+  if( last-first <= LEAF_SIZE )
+  {
+    Node& leaf = m_nodes[index];
+    leaf.box = box;
+    leaf.left = leaf.right = -1;
+    leaf.first = first;
+    leaf.count = last-first;
+    return index;
+  }
+
+  Vector2s extent = box.max-box.min;
+  const int axis = extent.x() >= extent.y() ? 0 : 1;
+  const int mid = (first+last)/2;
+  std::nth_element( m_primitives.begin()+first, m_primitives.begin()+mid, m_primitives.begin()+last, CenterLess(boxes,axis) );
+
+  // Children are appended after the parent, so m_nodes may reallocate here.
+  const int left = buildRange( boxes, first, mid );
+  const int right = buildRange( boxes, mid, last );
+
+  Node& internal = m_nodes[index];
+  internal.box = box;
+  internal.left = left;
+  internal.right = right;
+  internal.first = first;
+  internal.count = 0;
+  return index;
+}
+
+void AABBTree::refit( const std::vector<AABB>& boxes )
+{
+  // Children always follow their parent, so a reverse sweep is bottom-up.
+  for( int i = (int) m_nodes.size()-1; i >= 0; --i )
+  {
+    Node& nd = m_nodes[i];
+    if( nd.isLeaf() )
+    {
+      nd.box = boxes[m_primitives[nd.first]];
+      for( int k = nd.first+1; k < nd.first+nd.count; ++k ) merge( nd.box, boxes[m_primitives[k]], nd.box );
+    }
+    else merge( m_nodes[nd.left].box, m_nodes[nd.right].box, nd.box );
+  }
+}
+
+scalar AABBTree::cost() const
+{
+  scalar total = 0.0;
+  for( std::vector<Node>::size_type i = 0; i < m_nodes.size(); ++i ) total += 2.0*( m_nodes[i].box.max-m_nodes[i].box.min ).sum();
+  return total;
+}
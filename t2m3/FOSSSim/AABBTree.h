@@ -0,0 +1,51 @@
+#ifndef AABB_TREE_H
+#define AABB_TREE_H
+
+#include "BroadPhase.h"
+#include <vector>
+
+// Bounding volume hierarchy over a set of boxes, stored as a flat array with
+// every node preceding its children. Leaves hold short runs of primitives.
+// Built top-down by median splits along the longer axis; refit() updates the
+// bounds bottom-up for moved primitives without changing the topology.
+class AABBTree
+{
+ public:
+  struct Node
+  {
+    AABB box;
+    // Children of an internal node; both -1 for a leaf.
+    int left;
+    int right;
+    // Range of the leaf's primitives in primitive(); empty for internal nodes.
+    int first;
+    int count;
+
+    Node() : left( -1 ), right( -1 ), first( 0 ), count( 0 ) {}
+
+    bool isLeaf() const { return left < 0; }
+  };
+
+  AABBTree();
+
+  void build( const std::vector<AABB>& boxes );
+
+  void refit( const std::vector<AABB>& boxes );
+
+  // Sum of the perimeters of all nodes, the 2D analogue of the surface area
+  // heuristic. Grows as refitting loosens the tree.
+  scalar cost() const;
+
+  bool empty() const { return m_nodes.empty(); }
+  int numPrimitives() const { return (int) m_primitives.size(); }
+  const Node& node( int i ) const { return m_nodes[i]; }
+  int primitive( int k ) const { return m_primitives[k]; }
+
+ private:
+  int buildRange( const std::vector<AABB>& boxes, int first, int last );
+
+  std::vector<Node, Eigen::aligned_allocator<Node> > m_nodes;
+  std::vector<int> m_primitives;
+};
+
+#endif
@@ -0,0 +1,144 @@
+#include "AABBTreeDetector.h"
+#include "TwoDScene.h"
+#include "BroadPhaseTuning.h"
+#include <algorithm>
+
+AABBTreeDetector::AABBTreeDetector()
+: m_particle_tree()
+, m_edge_tree()
+, m_particle_boxes()
+, m_edge_boxes()
+, m_particle_built_cost(0.0)
+, m_edge_built_cost(0.0)
+, m_adjacency()
+{}
+
+void AABBTreeDetector::performCollisionDetection(const TwoDScene &scene, const VectorXs &qs, const VectorXs &qe, DetectionCallback &dc)
+{
+  PPList pppairs;
+  PEList pepairs;
+  PHList phpairs;
+
+  findCollidingPairs(scene, qs, qe, pppairs, pepairs, phpairs);
+  broadphase::reportPairs(scene, pppairs, pepairs, phpairs, dc);
+}
+
+void AABBTreeDetector::findCollidingPairs(const TwoDScene &scene, const VectorXs &qs, const VectorXs &qe, PPList &pppairs, PEList &pepairs, PHList &phpairs)
+{
+  const int nparticles = scene.getNumParticles();
+  const int nedges = scene.getNumEdges();
+
+  m_particle_boxes.resize( nparticles );
+  for( int i = 0; i < nparticles; ++i ) m_particle_boxes[i] = broadphase::particleBox( qs, qe, i, scene.getRadius(i) );
+  m_edge_boxes.resize( nedges );
+  for( int e = 0; e < nedges; ++e ) m_edge_boxes[e] = broadphase::edgeBox( qs, qe, scene.getEdge(e), scene.getEdgeRadii()[e] );
+
+  updateTree( m_particle_tree, m_particle_boxes, m_particle_built_cost );
+  updateTree( m_edge_tree, m_edge_boxes, m_edge_built_cost );
+
+  if( !m_particle_tree.empty() )
+  {
+    selfPairs( 0, pppairs );
+    if( !m_edge_tree.empty() ) edgePairs( 0, 0, pepairs );
+  }
+
+  broadphase::findHalfplanePairs( scene, qs, qe, phpairs );
+
+  // Traversal reports each pair once; sorting fixes the callback order.
+  broadphase::sortUnique( pppairs );
+  broadphase::sortUnique( pepairs );
+  m_adjacency.update( scene );
+  broadphase::excludeNeighbours( m_adjacency, broadphase::exclusionRings(), pepairs );
+}
+
+void AABBTreeDetector::updateTree( AABBTree& tree, const std::vector<AABB>& boxes, scalar& built_cost )
+{
+  if( tree.numPrimitives() == (int) boxes.size() && !tree.empty() )
+  {
+    tree.refit( boxes );
+    // Rebuilt once refitting has grown its cost by the tuned ratio.
+    if( tree.cost() <= broadphase::tuning().rebuildratio*built_cost ) return;
+  }
+  tree.build( boxes );
+  built_cost = tree.cost();
+}
+
+// Pairs of particles within the subtree rooted at node.
+void AABBTreeDetector::selfPairs( int node, PPList& pppairs ) const
+{
+  const AABBTree::Node& nd = m_particle_tree.node(node);
+  if( nd.isLeaf() )
+  {
+    for( int k = nd.first; k < nd.first+nd.count; ++k )
+      for( int l = k+1; l < nd.first+nd.count; ++l )
+      {
+        int i = m_particle_tree.primitive(k);
+        int j = m_particle_tree.primitive(l);
+        if( m_particle_boxes[i].overlaps(m_particle_boxes[j]) ) pppairs.push_back( std::make_pair( std::min(i,j), std::max(i,j) ) );
+      }
+    return;
+  }
+  selfPairs( nd.left, pppairs );
+  selfPairs( nd.right, pppairs );
+  crossPairs( nd.left, nd.right, pppairs );
+}
+
+// Pairs of particles with one in each of two disjoint subtrees. As in
+// edgePairs, the larger node is descended.
+void AABBTreeDetector::crossPairs( int a, int b, PPList& pppairs ) const
+{
+  const AABBTree::Node& na = m_particle_tree.node(a);
+  const AABBTree::Node& nb = m_particle_tree.node(b);
+  if( !na.box.overlaps(nb.box) ) return;
+
+  if( na.isLeaf() && nb.isLeaf() )
+  {
+    for( int k = na.first; k < na.first+na.count; ++k )
+      for( int l = nb.first; l < nb.first+nb.count; ++l )
+      {
+        int i = m_particle_tree.primitive(k);
+        int j = m_particle_tree.primitive(l);
+        if( m_particle_boxes[i].overlaps(m_particle_boxes[j]) ) pppairs.push_back( std::make_pair( std::min(i,j), std::max(i,j) ) );
+      }
+  }
+  else if( nb.isLeaf() || ( !na.isLeaf() && ( na.box.max-na.box.min ).sum() >= ( nb.box.max-nb.box.min ).sum() ) )
+  {
+    crossPairs( na.left, b, pppairs );
+    crossPairs( na.right, b, pppairs );
+  }
+  else
+  {
+    crossPairs( a, nb.left, pppairs );
+    crossPairs( a, nb.right, pppairs );
+  }
+}
+
+// Particle-edge pairs between a particle subtree and an edge subtree. The
+// larger node is descended first so that long edges are split early.
+void AABBTreeDetector::edgePairs( int p, int e, PEList& pepairs ) const
+{
+  const AABBTree::Node& np = m_particle_tree.node(p);
+  const AABBTree::Node& ne = m_edge_tree.node(e);
+  if( !np.box.overlaps(ne.box) ) return;
+
+  if( np.isLeaf() && ne.isLeaf() )
+  {
+    for( int k = np.first; k < np.first+np.count; ++k )
+      for( int l = ne.first; l < ne.first+ne.count; ++l )
+      {
+        int i = m_particle_tree.primitive(k);
+        int j = m_edge_tree.primitive(l);
+        if( m_particle_boxes[i].overlaps(m_edge_boxes[j]) ) pepairs.push_back( std::make_pair(i,j) );
+      }
+  }
+  else if( ne.isLeaf() || ( !np.isLeaf() && ( np.box.max-np.box.min ).sum() >= ( ne.box.max-ne.box.min ).sum() ) )
+  {
+    edgePairs( np.left, e, pepairs );
+    edgePairs( np.right, e, pepairs );
+  }
+  else
+  {
+    edgePairs( p, ne.left, pepairs );
+    edgePairs( p, ne.right, pepairs );
+  }
+}
@@ -0,0 +1,44 @@
+#ifndef AABB_TREE_DETECTOR_H
+#define AABB_TREE_DETECTOR_H
+
+#include "CollisionDetector.h"
+#include "AABBTree.h"
+#include "EdgeAdjacency.h"
+#include <vector>
+
+// Broad phase using one bounding volume hierarchy over the particles and one
+// over the edges. Particle-particle candidates come from traversing the
+// particle tree against itself and particle-edge candidates from traversing
+// it against the edge tree, so primitives of very different sizes cost
+// nothing extra. Trees are refit every call and rebuilt only when the
+// topology changes or refitting has loosened them too much. Boxes are swept
+// between qs and qe.
+class AABBTreeDetector : public CollisionDetector
+{
+ public:
+  AABBTreeDetector();
+
+  virtual void performCollisionDetection(const TwoDScene &scene, const VectorXs &qs, const VectorXs &qe, DetectionCallback &dc);
+
+  void findCollidingPairs(const TwoDScene &scene, const VectorXs &qs, const VectorXs &qe, PPList &pppairs, PEList &pepairs, PHList &phpairs);
+
+ private:
+  void updateTree( AABBTree& tree, const std::vector<AABB>& boxes, scalar& built_cost );
+
+  void selfPairs( int node, PPList& pppairs ) const;
+
+  void crossPairs( int a, int b, PPList& pppairs ) const;
+
+  void edgePairs( int p, int e, PEList& pepairs ) const;
+
+  AABBTree m_particle_tree;
+  AABBTree m_edge_tree;
+  std::vector<AABB> m_particle_boxes;
+  std::vector<AABB> m_edge_boxes;
+  // Tree costs right after the last rebuild.
+  scalar m_particle_built_cost;
+  scalar m_edge_built_cost;
+  EdgeAdjacency m_adjacency;
+};
+
+#endif
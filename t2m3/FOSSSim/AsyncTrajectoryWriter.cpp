@@ -0,0 +1,99 @@
+#include "AsyncTrajectoryWriter.h"
+
+#include <cassert>
+
+AsyncTrajectoryWriter::AsyncTrajectoryWriter( int queuedframes )
+: m_writer()
+, m_frames(queuedframes < 2 ? 2 : queuedframes)
+, m_head(0)
+, m_count(0)
+, m_closing(false)
+, m_mutex()
+, m_queued()
+, m_freed()
+, m_thread()
+{}
+
+AsyncTrajectoryWriter::~AsyncTrajectoryWriter()
+{
+  if( isOpen() ) close();
+}
+
+bool AsyncTrajectoryWriter::open( const std::string& filename, scalar tolerance )
+{
+  if( isOpen() ) close();
+  if( !m_writer.open(filename, tolerance) ) return false;
+  m_head = 0;
+  m_count = 0;
+  m_closing = false;
+  m_thread = std::thread(&AsyncTrajectoryWriter::run, this);
+  return true;
+}
+
+bool AsyncTrajectoryWriter::isOpen() const
+{
+  return m_thread.joinable();
+}
+
+void AsyncTrajectoryWriter::writeFrame( const TwoDScene& scene )
+{
+  writeFrame(scene.getX(), scene.getV());
+}
+
+void AsyncTrajectoryWriter::writeFrame( const VectorXs& x, const VectorXs& v )
+{
+  assert( isOpen() );
+
+  std::size_t slot;
+  {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while( m_count == m_frames.size() ) m_freed.wait(lock);
+    slot = ( m_head + m_count )%m_frames.size();
+  }
+
+  // The I/O thread does not touch a slot until it is queued, so the copy
+  // needs no lock.
+  m_frames[slot].x = x;
+  m_frames[slot].v = v;
+
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    ++m_count;
+  }
+  m_queued.notify_one();
+}
+
+bool AsyncTrajectoryWriter::close()
+{
+  if( !isOpen() ) return false;
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_closing = true;
+  }
+  m_queued.notify_one();
+  m_thread.join();
+  return m_writer.close();
+}
+
+void AsyncTrajectoryWriter::run()
+{
+  while( true )
+  {
+    std::size_t slot;
+    {
+      std::unique_lock<std::mutex> lock(m_mutex);
+      while( m_count == 0 && !m_closing ) m_queued.wait(lock);
+      if( m_count == 0 ) return;
+      slot = m_head;
+    }
+
+    m_writer.writeFrame(m_frames[slot].x, m_frames[slot].v);
+
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_head = ( m_head + 1 )%m_frames.size();
+      --m_count;
+    }
+    m_freed.notify_one();
+  }
+}
@@ -0,0 +1,66 @@
+#ifndef ASYNC_TRAJECTORY_WRITER_H
+#define ASYNC_TRAJECTORY_WRITER_H
+
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Trajectory.h"
+
+// A TrajectoryWriter driven from its own thread, so that stepping and disk
+// I/O overlap. writeFrame copies the scene's x and v into one of a fixed
+// ring of frame buffers and returns; the I/O thread writes the buffers out
+// in order. Once every buffer is queued, writeFrame blocks until the I/O
+// thread frees one, which bounds the memory held by a slow disk. The buffers
+// are reused, so a run with a fixed particle count allocates nothing per
+// frame.
+class AsyncTrajectoryWriter
+{
+public:
+  // queuedframes is the number of frame buffers, at least 2.
+  explicit AsyncTrajectoryWriter( int queuedframes = 2 );
+
+  // Closes the trajectory if still open.
+  ~AsyncTrajectoryWriter();
+
+  // As TrajectoryWriter::open.
+  bool open( const std::string& filename, scalar tolerance = 0.0 );
+
+  bool isOpen() const;
+
+  void writeFrame( const TwoDScene& scene );
+
+  // As above, for positions and velocities gathered from elsewhere.
+  void writeFrame( const VectorXs& x, const VectorXs& v );
+
+  // Waits for the queued frames, then closes the file and writes the index
+  // as TrajectoryWriter::close does.
+  bool close();
+
+private:
+  AsyncTrajectoryWriter( const AsyncTrajectoryWriter& );
+  AsyncTrajectoryWriter& operator=( const AsyncTrajectoryWriter& );
+
+  struct Frame
+  {
+    VectorXs x;
+    VectorXs v;
+  };
+
+  void run();
+
+  TrajectoryWriter m_writer;
+  std::vector<Frame> m_frames;
+  // The queued frames are m_frames[m_head], ... in ring order.
+  std::size_t m_head;
+  std::size_t m_count;
+  bool m_closing;
+  std::mutex m_mutex;
+  std::condition_variable m_queued;
+  std::condition_variable m_freed;
+  std::thread m_thread;
+};
+
+#endif
@@ -0,0 +1,106 @@
+#include "BlockStepping.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+
+std::vector<std::pair<int,int> > g_contacts;
+// Whether each particle is active, or empty while all are.
+std::vector<unsigned char> g_active;
+
+// Raises the lower of two free particles' levels to within one of the
+// higher; true if it changed.
+bool balance( const TwoDScene& scene, std::vector<int>& levels, int i, int j )
+{
+  if( scene.isFixed(i) || scene.isFixed(j) ) return false;
+  if( levels[i] < levels[j] - 1 )
+  {
+    levels[i] = levels[j] - 1;
+    return true;
+  }
+  if( levels[j] < levels[i] - 1 )
+  {
+    levels[j] = levels[i] - 1;
+    return true;
+  }
+  return false;
+}
+
+}
+
+BlockSchedule::BlockSchedule()
+: m_levels()
+, m_finest(0)
+{}
+
+void BlockSchedule::assign( const TwoDScene& scene, const VectorXs& F, scalar dt, scalar fraction, int maxlevel, const std::vector<std::pair<int,int> >& contacts )
+{
+  const int n = scene.getNumParticles();
+  const VectorXs& v = scene.getV();
+  const VectorXs& m = scene.getM();
+  const std::vector<scalar>& radii = scene.getRadii();
+
+  m_levels.assign(n, 0);
+  for( int i = 0; i < n; ++i )
+  {
+    if( scene.isFixed(i) || !( radii[i] > 0.0 ) ) continue;
+    const Vector2s vnext = v.segment<2>(2*i) + dt*F.segment<2>(2*i).cwiseQuotient(m.segment<2>(2*i));
+    const scalar substeps = std::ceil(dt*vnext.norm()/radii[i]/fraction);
+    int level = 0;
+    while( level < maxlevel && scalar(1 << level) < substeps ) ++level;
+    m_levels[i] = level;
+  }
+
+  // Each pass lowers the gap of some pair, and no level passes maxlevel, so
+  // this ends.
+  for( bool changed = true; changed; )
+  {
+    changed = false;
+    for( int e = 0; e < scene.getNumEdges(); ++e ) changed = balance(scene, m_levels, scene.getEdge(e).first, scene.getEdge(e).second) || changed;
+    for( std::vector<std::pair<int,int> >::size_type c = 0; c < contacts.size(); ++c ) changed = balance(scene, m_levels, contacts[c].first, contacts[c].second) || changed;
+  }
+
+  m_finest = n > 0 ? *std::max_element(m_levels.begin(), m_levels.end()) : 0;
+}
+
+long BlockSchedule::countParticleSubsteps() const
+{
+  long substeps = 0;
+  for( std::vector<int>::size_type i = 0; i < m_levels.size(); ++i ) substeps += 1L << m_levels[i];
+  return substeps;
+}
+
+namespace blockstepping
+{
+
+void recordContact( int idx1, int idx2 )
+{
+  if( g_active.empty() ) g_contacts.push_back(std::make_pair(idx1, idx2));
+}
+
+void takeContacts( std::vector<std::pair<int,int> >& contacts )
+{
+  contacts.clear();
+  contacts.swap(g_contacts);
+}
+
+void activate( const BlockSchedule& schedule, int s )
+{
+  const int n = schedule.getNumParticles();
+  g_active.resize(n);
+  for( int i = 0; i < n; ++i ) g_active[i] = schedule.startsSubstep(i, s);
+}
+
+void activateAll()
+{
+  g_active.clear();
+}
+
+bool isActive( int particle )
+{
+  return g_active.empty() || g_active[particle] != 0;
+}
+
+}
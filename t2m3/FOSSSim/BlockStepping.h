@@ -0,0 +1,81 @@
+#ifndef __BLOCK_STEPPING_H__
+#define __BLOCK_STEPPING_H__
+
+#include <utility>
+#include <vector>
+
+#include "TwoDScene.h"
+
+// Block time stepping, built with USE_BLOCK_SUBSTEPS alongside
+// CFL_SUBSTEP_FRACTION. Rather than every particle taking as many substeps
+// as the fastest one needs, each free particle is binned into a level L and
+// takes 2^L substeps of dt/2^L, the fewest that keep it to
+// CFL_SUBSTEP_FRACTION of its radius in each. The finest level in use sets
+// the substeps of the step; at each of them every particle drifts, and those
+// whose own substep starts there are kicked with the force at the current
+// positions, so all are in step at every substep and together again at the
+// end of the step. In a settling pile most particles stay at the coarse
+// levels while a few fast ones take the fine substeps.
+//
+// Particles joined by an edge, or by a contact at the start of the step, are
+// raised until their levels differ by at most one, so that a fast particle's
+// neighbours answer its impacts at close to its rate. Contacts among
+// particles that take no substep at a given one are skipped by the penalty
+// force there.
+class BlockSchedule
+{
+public:
+  BlockSchedule();
+
+  // Bins the scene's free particles for a step of dt from F, the force at
+  // its start, as CFL_SUBSTEP_FRACTION counts substeps from dt*|v + dt*F/m|
+  // against each particle's radius, with fraction and up to 2^maxlevel
+  // substeps, then balances the levels across the scene's edges and
+  // contacts. Fixed particles and particles without a radius are at level
+  // 0.
+  void assign( const TwoDScene& scene, const VectorXs& F, scalar dt, scalar fraction, int maxlevel, const std::vector<std::pair<int,int> >& contacts );
+
+  int getNumParticles() const { return (int) m_levels.size(); }
+
+  // The step takes 2^getFinestLevel() substeps.
+  int getFinestLevel() const { return m_finest; }
+  int getLevel( int particle ) const { return m_levels[particle]; }
+
+  // Whether particle starts one of its own substeps at substep s of the
+  // finest level's.
+  bool startsSubstep( int particle, int s ) const
+  {
+    return ( s & ( ( 1 << ( m_finest - m_levels[particle] ) ) - 1 ) ) == 0;
+  }
+
+  // Substeps the particles take over the step between them, against
+  // getNumParticles() << getFinestLevel() for uniform ones.
+  long countParticleSubsteps() const;
+
+private:
+  std::vector<int> m_levels;
+  int m_finest;
+};
+
+// The base library constructs both the stepper and the forces, so the
+// particles active at a substep, and the contacts the levels are balanced
+// across, are kept here rather than in either.
+namespace blockstepping
+{
+  // Records a contact between two particles while every particle is active.
+  // Called by the penalty force.
+  void recordContact( int idx1, int idx2 );
+
+  // Swaps the contacts recorded since the last call into contacts.
+  void takeContacts( std::vector<std::pair<int,int> >& contacts );
+
+  // Makes active only the particles that start a substep of schedule at s.
+  void activate( const BlockSchedule& schedule, int s );
+
+  void activateAll();
+
+  // True for every particle outside a block step.
+  bool isActive( int particle );
+}
+
+#endif
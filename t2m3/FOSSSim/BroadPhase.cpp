@@ -0,0 +1,261 @@
+#include "BroadPhase.h"
+#include "TwoDScene.h"
+#include <algorithm>
+#include <cassert>
+#include "TaskPool.h"
+#include "EdgeAdjacency.h"
+#include "PhaseTimes.h"
+
+namespace
+{
+
+// Candidates per task when the callback is thread safe, tunable through
+// FOSSSIM_GRAIN as callbacks.
+const int CALLBACK_GRAIN = 1024;
+
+#ifdef EDGE_EXCLUSION_RINGS
+const int EXCLUSION_RINGS = EDGE_EXCLUSION_RINGS;
+#else
+const int EXCLUSION_RINGS = 0;
+#endif
+
+}
+
+HalfplaneArray::HalfplaneArray( const TwoDScene& scene )
+{
+  int n = scene.getNumHalfplanes();
+  points.reserve(n);
+  normals.reserve(n);
+  offsets.reserve(n);
+  for( int h = 0; h < n; ++h )
+  {
+    const std::pair<VectorXs,VectorXs>& halfplane = scene.getHalfplane(h);
+    Vector2s p = halfplane.first.segment<2>(0);
+    Vector2s nhat = halfplane.second.segment<2>(0);
+    nhat.normalize();
+    points.push_back(p);
+    normals.push_back(nhat);
+    offsets.push_back(nhat.dot(p));
+  }
+}
+
+namespace broadphase
+{
+
+AABB particleBox( const VectorXs& qs, const VectorXs& qe, int particle, scalar radius )
+{
+  Vector2s a = qs.segment<2>(2*particle);
+  Vector2s b = qe.segment<2>(2*particle);
+  AABB box;
+  box.min = a.cwiseMin(b).array() - radius;
+  box.max = a.cwiseMax(b).array() + radius;
+  return box;
+}
+
+AABB edgeBox( const VectorXs& qs, const VectorXs& qe, const std::pair<int,int>& edge, scalar radius )
+{
+  AABB box = particleBox( qs, qe, edge.first, radius );
+  AABB other = particleBox( qs, qe, edge.second, radius );
+  box.min = box.min.cwiseMin(other.min);
+  box.max = box.max.cwiseMax(other.max);
+  return box;
+}
+
+// Scenes have a handful of halfplanes and many particles, so each halfplane
+// sweeps every particle in one loop over the contiguous positions and radii,
+// which the compiler vectorizes, marking the particles it touches in a bit
+// mask per particle. The masks are then read out in particle order. Scenes
+// with more halfplanes than mask bits test each pair in turn.
+void findHalfplanePairs( const TwoDScene& scene, const VectorXs& qs, const VectorXs& qe, PHList& phpairs )
+{
+  const HalfplaneArray halfplanes( scene );
+  const int numparticles = scene.getNumParticles();
+  const int MAX_MASKED_HALFPLANES = 32;
+  if( halfplanes.size() > MAX_MASKED_HALFPLANES )
+  {
+    for( int i = 0; i < numparticles; ++i )
+    {
+      Vector2s xs = qs.segment<2>(2*i);
+      Vector2s xe = qe.segment<2>(2*i);
+      scalar r = scene.getRadius(i);
+      for( int h = 0; h < halfplanes.size(); ++h )
+      {
+        // The signed distance is linear along the motion, so its minimum is at an end.
+        if( std::min( halfplanes.signedDistance(h, xs), halfplanes.signedDistance(h, xe) ) <= r ) phpairs.push_back( std::make_pair(i,h) );
+      }
+    }
+    return;
+  }
+  if( halfplanes.size() == 0 || numparticles == 0 ) return;
+
+  const scalar* xs = qs.data();
+  const scalar* xe = qe.data();
+  const scalar* radii = &scene.getRadii()[0];
+  std::vector<unsigned> touching( numparticles, 0u );
+  for( int h = 0; h < halfplanes.size(); ++h )
+  {
+    // As signedDistance computes it.
+    const scalar nx = halfplanes.normals[h].x();
+    const scalar ny = halfplanes.normals[h].y();
+    const scalar offset = halfplanes.offsets[h];
+    const unsigned bit = 1u << h;
+    for( int i = 0; i < numparticles; ++i )
+    {
+      const scalar ds = nx*xs[2*i] + ny*xs[2*i+1] - offset;
+      const scalar de = nx*xe[2*i] + ny*xe[2*i+1] - offset;
+      touching[i] |= std::min( ds, de ) <= radii[i] ? bit : 0u;
+    }
+  }
+  for( int i = 0; i < numparticles; ++i )
+  {
+    if( touching[i] == 0u ) continue;
+    for( int h = 0; h < halfplanes.size(); ++h )
+      if( touching[i] & ( 1u << h ) ) phpairs.push_back( std::make_pair(i,h) );
+  }
+}
+
+// Pairs are packed into 64-bit keys and LSD radix sorted, 16 bits per pass,
+// which avoids the per-pair allocation and log(n) insert of a std::set.
+void sortUnique( std::vector<std::pair<int,int> >& pairs )
+{
+  typedef unsigned long long Key;
+  const std::vector<std::pair<int,int> >::size_type n = pairs.size();
+  if( n < 2 ) return;
+
+  std::vector<Key> keys(n), scratch(n);
+  for( std::vector<Key>::size_type i = 0; i < n; ++i )
+  {
+    assert( pairs[i].first >= 0 && pairs[i].second >= 0 );
+    keys[i] = ( Key(pairs[i].first) << 32 ) | Key(unsigned(pairs[i].second));
+  }
+
+  const int RADIX_BITS = 16;
+  const int NBINS = 1 << RADIX_BITS;
+  std::vector<std::vector<Key>::size_type> count(NBINS);
+  for( int shift = 0; shift < 64; shift += RADIX_BITS )
+  {
+    std::fill( count.begin(), count.end(), 0 );
+    for( std::vector<Key>::size_type i = 0; i < n; ++i ) ++count[( keys[i] >> shift ) & ( NBINS-1 )];
+    // Skip passes where every key shares this digit
+    if( count[( keys[0] >> shift ) & ( NBINS-1 )] == n ) continue;
+    std::vector<Key>::size_type total = 0;
+    for( int b = 0; b < NBINS; ++b ) { std::vector<Key>::size_type c = count[b]; count[b] = total; total += c; }
+    for( std::vector<Key>::size_type i = 0; i < n; ++i ) scratch[count[( keys[i] >> shift ) & ( NBINS-1 )]++] = keys[i];
+    keys.swap(scratch);
+  }
+
+  keys.erase( std::unique( keys.begin(), keys.end() ), keys.end() );
+  pairs.resize( keys.size() );
+  for( std::vector<Key>::size_type i = 0; i < keys.size(); ++i ) pairs[i] = std::make_pair( int( keys[i] >> 32 ), int( keys[i] & 0xffffffffu ) );
+}
+
+// The pairs are sorted by particle, so each particle's neighbourhood is
+// marked once, by a breadth-first walk out to rings edges that stamps each
+// particle it reaches with the walk's number, and then serves all its pairs.
+void excludeNeighbours( const EdgeAdjacency& adjacency, int rings, PEList& pepairs )
+{
+  PEList::size_type kept = 0;
+  if( rings <= 0 )
+  {
+    for( PEList::size_type k = 0; k < pepairs.size(); ++k )
+      if( !adjacency.isEndpoint( pepairs[k].first, pepairs[k].second ) ) pepairs[kept++] = pepairs[k];
+    pepairs.resize( kept );
+    return;
+  }
+
+  std::vector<int> stamp( adjacency.getNumParticles(), -1 );
+  std::vector<int> frontier;
+  std::vector<int> next;
+  int walk = -1;
+  for( PEList::size_type k = 0; k < pepairs.size(); ++k )
+  {
+    const int p = pepairs[k].first;
+    if( k == 0 || p != pepairs[k-1].first )
+    {
+      ++walk;
+      stamp[p] = walk;
+      frontier.assign( 1, p );
+      for( int ring = 0; ring < rings && !frontier.empty(); ++ring )
+      {
+        next.clear();
+        for( std::vector<int>::size_type f = 0; f < frontier.size(); ++f )
+        {
+          const int* edges = adjacency.edges( frontier[f] );
+          for( int d = 0; d < adjacency.degree( frontier[f] ); ++d )
+          {
+            const int q = adjacency.opposite( edges[d], frontier[f] );
+            if( stamp[q] == walk ) continue;
+            stamp[q] = walk;
+            next.push_back( q );
+          }
+        }
+        frontier.swap( next );
+      }
+    }
+    // Reaching either endpoint within rings edges excludes the edge.
+    const std::pair<int,int>& edge = adjacency.getEdge( pepairs[k].second );
+    if( stamp[edge.first] != walk && stamp[edge.second] != walk ) pepairs[kept++] = pepairs[k];
+  }
+  pepairs.resize( kept );
+}
+
+int exclusionRings()
+{
+  return EXCLUSION_RINGS;
+}
+
+void reportPairs( const TwoDScene& scene, const PPList& pppairs, const PEList& pepairs, const PHList& phpairs, DetectionCallback& dc )
+{
+  phasetimes::ScopedPhase contacts(phasetimes::CONTACTS);
+  if( PairListDetectionCallback* lists = dynamic_cast<PairListDetectionCallback*>(&dc) )
+  {
+    lists->PairListsCallback(pppairs, pepairs, phpairs);
+    return;
+  }
+
+  // Cross-cast: the callbacks are defined by the base library, so thread
+  // safety is declared by an extra base class rather than a new virtual. A
+  // thread-safe callback may still sum what it is told in the order it is
+  // told it, so FOSSSIM_DETERMINISTIC reports the sorted lists serially.
+  const bool parallel = dynamic_cast<ThreadSafeDetectionCallback*>(&dc) != NULL && !TaskPool::deterministic();
+  const int npp = (int) pppairs.size();
+  const int npe = (int) pepairs.size();
+  const int nph = (int) phpairs.size();
+
+  if( !parallel )
+  {
+    for( int k = 0; k < npp; ++k ) dc.ParticleParticleCallback(pppairs[k].first, pppairs[k].second);
+    for( int k = 0; k < npe; ++k ) dc.ParticleEdgeCallback(pepairs[k].first, pepairs[k].second);
+    for( int k = 0; k < nph; ++k ) dc.ParticleHalfplaneCallback(phpairs[k].first, phpairs[k].second);
+    return;
+  }
+
+  // The three lists are reported side by side, each split by the pool.
+  TaskPool& pool = TaskPool::shared();
+  const int grain = TaskPool::grainSize( "callbacks", CALLBACK_GRAIN );
+  TaskGraph graph( pool );
+  graph.add( [&]()
+  {
+    pool.parallelFor( 0, npp, grain, [&]( int lo, int hi )
+    {
+      for( int k = lo; k < hi; ++k ) dc.ParticleParticleCallback(pppairs[k].first, pppairs[k].second);
+    } );
+  } );
+  graph.add( [&]()
+  {
+    pool.parallelFor( 0, npe, grain, [&]( int lo, int hi )
+    {
+      for( int k = lo; k < hi; ++k ) dc.ParticleEdgeCallback(pepairs[k].first, pepairs[k].second);
+    } );
+  } );
+  graph.add( [&]()
+  {
+    pool.parallelFor( 0, nph, grain, [&]( int lo, int hi )
+    {
+      for( int k = lo; k < hi; ++k ) dc.ParticleHalfplaneCallback(phpairs[k].first, phpairs[k].second);
+    } );
+  } );
+  graph.run();
+}
+
+}
@@ -0,0 +1,89 @@
+#ifndef BROAD_PHASE_H
+#define BROAD_PHASE_H
+
+#include "CollisionDetector.h"
+#include <vector>
+
+class EdgeAdjacency;
+
+// Shared pieces of the broad-phase collision detectors.
+
+// Candidate lists are flat arrays, sorted and free of duplicates once
+// a detector's findCollidingPairs returns.
+typedef std::vector<std::pair<int, int> > PPList;
+typedef std::vector<std::pair<int, int> > PEList;
+typedef std::vector<std::pair<int, int> > PHList;
+
+struct AABB
+{
+  Vector2s min;
+  Vector2s max;
+
+  AABB() : min( Vector2s::Zero() ), max( Vector2s::Zero() ) {}
+  AABB( const Vector2s& lo, const Vector2s& hi ) : min( lo ), max( hi ) {}
+
+  bool overlaps( const AABB& other ) const
+  {
+    return min.x() <= other.max.x() && other.min.x() <= max.x() &&
+           min.y() <= other.max.y() && other.min.y() <= max.y();
+  }
+
+  EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+};
+
+EIGEN_DEFINE_STL_VECTOR_SPECIALIZATION(AABB)
+
+// A scene's halfplanes in contiguous fixed-size storage. TwoDScene keeps each
+// one as a pair of heap-allocated VectorXs; this holds its point, its unit
+// normal and the plane offset nhat.p, so a signed distance is one dot product.
+struct HalfplaneArray
+{
+  std::vector<Vector2s> points;
+  std::vector<Vector2s> normals;
+  std::vector<scalar> offsets;
+
+  explicit HalfplaneArray( const TwoDScene& scene );
+
+  int size() const { return (int) offsets.size(); }
+
+  scalar signedDistance( int h, const Vector2s& x ) const
+  {
+    return normals[h].dot(x) - offsets[h];
+  }
+};
+
+namespace broadphase
+{
+  // Boxes bounding a particle or an edge over its linear motion from qs to
+  // qe. Pass the same configuration twice for a static box.
+  AABB particleBox( const VectorXs& qs, const VectorXs& qe, int particle, scalar radius );
+
+  AABB edgeBox( const VectorXs& qs, const VectorXs& qe, const std::pair<int,int>& edge, scalar radius );
+
+  // Halfplanes are unbounded, so every particle is tested against each one.
+  // The pairs come out sorted, with no duplicates.
+  void findHalfplanePairs( const TwoDScene& scene, const VectorXs& qs, const VectorXs& qe, PHList& phpairs );
+
+  // Sorts a list of non-negative index pairs lexicographically and removes
+  // duplicates.
+  void sortUnique( std::vector<std::pair<int,int> >& pairs );
+
+  // Removes the particle-edge pairs whose particle is within rings edges of
+  // one of the edge's endpoints, keeping the rest in order. Rings 0 removes
+  // the endpoints alone, which can never collide with their own edge; more
+  // also skip a ribbon's neighbours along it, which its springs keep apart.
+  // Detectors call this with exclusionRings() before returning their lists.
+  void excludeNeighbours( const EdgeAdjacency& adjacency, int rings, PEList& pepairs );
+
+  // EDGE_EXCLUSION_RINGS as built, 0 by default.
+  int exclusionRings();
+
+  // Invokes the callbacks for every candidate, which the detector has
+  // already filtered with excludeNeighbours. Callbacks are only called
+  // concurrently if they derive from ThreadSafeDetectionCallback, and never
+  // with FOSSSIM_DETERMINISTIC set. Callbacks deriving from
+  // PairListDetectionCallback are handed the lists whole instead.
+  void reportPairs( const TwoDScene& scene, const PPList& pppairs, const PEList& pepairs, const PHList& phpairs, DetectionCallback& dc );
+}
+
+#endif
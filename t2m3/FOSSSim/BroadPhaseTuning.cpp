@@ -0,0 +1,218 @@
+#include "BroadPhaseTuning.h"
+
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <random>
+#include <sstream>
+#include <unistd.h>
+#include <vector>
+
+#include "ContestDetector.h"
+#include "SceneBinary.h"
+#include "TwoDScene.h"
+
+namespace
+{
+
+// Calls timed per candidate, after an untimed one that lets the broad phase
+// build whatever it keeps between calls.
+const int CALIBRATION_CALLS = 8;
+// How far each free particle moves, as a fraction of its radius along each
+// axis, between the calls, so that the sweep's order and the trees' fit
+// degrade as they do over steps.
+const scalar CALIBRATION_JITTER = 0.1;
+
+BroadPhaseTuning g_tuning;
+
+#ifdef TUNE_BROAD_PHASE
+// The size of the scene the broad phase was last tuned for.
+int g_tuned_particles = -1;
+int g_tuned_edges = -1;
+#endif
+
+// Takes the candidates whole and drops them.
+class IgnoreCandidates : public DetectionCallback, public PairListDetectionCallback
+{
+public:
+  virtual void ParticleParticleCallback( int, int ) {}
+  virtual void ParticleEdgeCallback( int, int ) {}
+  virtual void ParticleHalfplaneCallback( int, int ) {}
+  virtual void PairListsCallback( const PPList&, const PEList&, const PHList& ) {}
+};
+
+// The defaults first, so that a tie keeps them.
+std::vector<BroadPhaseTuning> candidateTunings()
+{
+  std::vector<BroadPhaseTuning> candidates(1);
+#if defined(SAP_BROAD_PHASE)
+  candidates.push_back(BroadPhaseTuning());
+  candidates.back().sweepaxis = 1;
+#elif defined(BVH_BROAD_PHASE)
+  static const scalar ratios[] = { 1.1, 2.0, 3.0 };
+  for( int k = 0; k < 3; ++k )
+  {
+    candidates.push_back(BroadPhaseTuning());
+    candidates.back().rebuildratio = ratios[k];
+  }
+#elif defined(HGRID_BROAD_PHASE)
+  static const scalar scales[] = { 0.5, 2.0 };
+  for( int k = 0; k < 2; ++k )
+  {
+    candidates.push_back(BroadPhaseTuning());
+    candidates.back().cellscale = scales[k];
+  }
+#elif !defined(KINETIC_BROAD_PHASE)
+  static const scalar scales[] = { 0.75, 1.5, 2.0, 3.0 };
+  for( int k = 0; k < 4; ++k )
+  {
+    candidates.push_back(BroadPhaseTuning());
+    candidates.back().cellscale = scales[k];
+  }
+#endif
+  return candidates;
+}
+
+// Seconds the timed calls of the built broad phase take on scene with the
+// current tuning.
+double timeBroadPhase( const TwoDScene& scene, ContestDetector& detector )
+{
+  typedef std::chrono::steady_clock Clock;
+  // The same walk for every candidate.
+  std::mt19937 generator(0);
+  std::uniform_real_distribution<scalar> step(-CALIBRATION_JITTER, CALIBRATION_JITTER);
+  IgnoreCandidates ignore;
+  VectorXs x = scene.getX();
+  detector.performCollisionDetection(scene, x, x, ignore);
+
+  double seconds = 0.0;
+  for( int call = 0; call < CALIBRATION_CALLS; ++call )
+  {
+    for( int i = 0; i < scene.getNumParticles(); ++i )
+    {
+      if( scene.isFixed(i) ) continue;
+      x(2*i) += step(generator)*scene.getRadius(i);
+      x(2*i+1) += step(generator)*scene.getRadius(i);
+    }
+    const Clock::time_point start = Clock::now();
+    detector.performCollisionDetection(scene, x, x, ignore);
+    seconds += std::chrono::duration<double>(Clock::now() - start).count();
+  }
+  return seconds;
+}
+
+#ifdef TUNE_BROAD_PHASE
+// The file the choice for scenefile is kept in, beside its binary copy.
+std::string tuningCacheFile( const std::string& scenefile )
+{
+  const std::string cachefile = sceneCacheFile(scenefile);
+  return cachefile.empty() ? "" : cachefile + "." + broadphase::builtBroadPhase() + ".tuning";
+}
+
+bool readTuning( const std::string& file, BroadPhaseTuning& tuning )
+{
+  std::ifstream ifs(file.c_str());
+  std::string name;
+  BroadPhaseTuning read;
+  if( !( ifs >> name >> read.cellscale >> read.sweepaxis >> read.rebuildratio ) || name != broadphase::builtBroadPhase() ) return false;
+  tuning = read;
+  return true;
+}
+
+// Written to a file of this process's own and renamed, as the scene cache's
+// copies are.
+void writeTuning( const std::string& file, const BroadPhaseTuning& tuning )
+{
+  std::ostringstream partial;
+  partial << file << "." << getpid();
+  {
+    std::ofstream ofs(partial.str().c_str());
+    ofs.precision(17);
+    ofs << broadphase::builtBroadPhase() << " " << tuning.cellscale << " " << tuning.sweepaxis << " " << tuning.rebuildratio << std::endl;
+    if( ofs && rename(partial.str().c_str(), file.c_str()) == 0 ) return;
+  }
+  remove(partial.str().c_str());
+}
+#endif
+
+}
+
+BroadPhaseTuning::BroadPhaseTuning()
+: cellscale(1.0)
+, sweepaxis(0)
+, rebuildratio(1.5)
+{}
+
+namespace broadphase
+{
+
+const BroadPhaseTuning& tuning()
+{
+  return g_tuning;
+}
+
+void setTuning( const BroadPhaseTuning& tuning )
+{
+  g_tuning = tuning;
+}
+
+const char* builtBroadPhase()
+{
+#if defined(SAP_BROAD_PHASE)
+  return "sap";
+#elif defined(BVH_BROAD_PHASE)
+  return "bvh";
+#elif defined(KINETIC_BROAD_PHASE)
+  return "kinetic";
+#elif defined(HGRID_BROAD_PHASE)
+  return "hgrid";
+#else
+  return "grid";
+#endif
+}
+
+BroadPhaseTuning calibrate( const TwoDScene& scene )
+{
+  const std::vector<BroadPhaseTuning> candidates = candidateTunings();
+  const BroadPhaseTuning previous = g_tuning;
+  if( candidates.size() < 2 || scene.getNumParticles() == 0 ) return previous;
+
+  ContestDetector detector;
+  BroadPhaseTuning best = candidates[0];
+  double fastest = 0.0;
+  for( std::vector<BroadPhaseTuning>::size_type c = 0; c < candidates.size(); ++c )
+  {
+    g_tuning = candidates[c];
+    const double seconds = timeBroadPhase(scene, detector);
+    if( c > 0 && !( seconds < fastest ) ) continue;
+    best = candidates[c];
+    fastest = seconds;
+  }
+  g_tuning = previous;
+  return best;
+}
+
+void tuneForScene( const TwoDScene& scene, const std::string& scenefile )
+{
+#ifdef TUNE_BROAD_PHASE
+  if( scene.getNumParticles() == g_tuned_particles && scene.getNumEdges() == g_tuned_edges ) return;
+  // Set first: calibrating detects, which comes back here.
+  g_tuned_particles = scene.getNumParticles();
+  g_tuned_edges = scene.getNumEdges();
+
+  const std::string cachefile = !scenefile.empty() && sceneCacheEnabled() ? tuningCacheFile(scenefile) : "";
+  BroadPhaseTuning tuning;
+  if( !cachefile.empty() && readTuning(cachefile, tuning) )
+  {
+    g_tuning = tuning;
+    return;
+  }
+  g_tuning = calibrate(scene);
+  if( !cachefile.empty() ) writeTuning(cachefile, g_tuning);
+#else
+  (void) scene;
+  (void) scenefile;
+#endif
+}
+
+}
@@ -0,0 +1,59 @@
+#ifndef BROAD_PHASE_TUNING_H
+#define BROAD_PHASE_TUNING_H
+
+#include <string>
+
+#include "MathDefs.h"
+
+class TwoDScene;
+
+// The parameters of the broad phases whose best values depend on the scene's
+// radii and density rather than on anything the broad phase can see in one
+// call. The defaults are the values the broad phases were written with. Every
+// setting finds exactly the same candidate pairs, so a tuned run simulates
+// exactly what an untuned one does, only faster or slower.
+struct BroadPhaseTuning
+{
+  BroadPhaseTuning();
+
+  // Cells of the contest detector's grid, and the finest cells of the
+  // hierarchical grid, as a multiple of the median particle's box.
+  scalar cellscale;
+  // The axis, 0 for x or 1 for y, sweep and prune sorts and sweeps along.
+  int sweepaxis;
+  // The factor by which refitting may grow a bounding volume hierarchy's
+  // cost before it is rebuilt.
+  scalar rebuildratio;
+};
+
+// Built with TUNE_BROAD_PHASE, the contest detector calibrates the broad
+// phase it was built with on each scene it is first asked about: it times a
+// few calls with each candidate setting of that broad phase's parameter, on
+// the scene's own positions jittered a little from call to call as they
+// would be by steps, and keeps the fastest. The kinetic sweep and prune has
+// nothing to tune. Tools that load a scene from a file tune it through
+// tuneForScene with the file's name, which with FOSSSIM_SCENE_CACHE set keeps
+// the choice beside the scene's binary copy, so later runs of the scene on
+// the same build skip the calibration.
+namespace broadphase
+{
+  // The parameters every broad phase reads. Defaults unless tuned.
+  const BroadPhaseTuning& tuning();
+
+  void setTuning( const BroadPhaseTuning& tuning );
+
+  // The name of the broad phase built, as CONTEST_BROAD_PHASE gives it.
+  const char* builtBroadPhase();
+
+  // Times the built broad phase's candidate settings on scene and returns
+  // the fastest.
+  BroadPhaseTuning calibrate( const TwoDScene& scene );
+
+  // Tunes the broad phase for scene, from the cached choice for scenefile if
+  // there is one and by calibrating otherwise, unless it was last tuned for
+  // a scene of as many particles and edges, such as a copy of this one. Does
+  // nothing unless built with TUNE_BROAD_PHASE.
+  void tuneForScene( const TwoDScene& scene, const std::string& scenefile = "" );
+}
+
+#endif
@@ -0,0 +1,226 @@
+#include "Checkpoint.h"
+
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+
+#include "MappedFile.h"
+
+namespace
+{
+
+const char FCK_MAGIC[4] = { 'F', 'C', 'K', '1' };
+
+void complain( const std::string& what )
+{
+  std::cerr << "\033[31;1mERROR IN CHECKPOINT:\033[m " << what << std::endl;
+}
+
+std::size_t paddedBytes( std::size_t bytes )
+{
+  return ( bytes + 7 )/8*8;
+}
+
+// The size of a file with header's counts.
+std::size_t fileBytes( const CheckpointHeader& header )
+{
+  return sizeof(CheckpointHeader) + sizeof(scalar)*( 4*(std::size_t) header.numparticles + header.numbounds + 4*(std::size_t) header.numsprings ) + paddedBytes(header.numparticles);
+}
+
+bool writeBytes( std::FILE* file, const void* data, std::size_t bytes )
+{
+  return bytes == 0 || std::fwrite(data, 1, bytes, file) == bytes;
+}
+
+}
+
+Checkpoint::Checkpoint()
+: step(0)
+, x()
+, v()
+, fixed()
+, settings()
+, bounds()
+{}
+
+bool writeCheckpoint( const std::string& filename, const Checkpoint& checkpoint )
+{
+  const int numparticles = (int) checkpoint.fixed.size();
+  const PenaltySceneSettings& settings = checkpoint.settings;
+  CheckpointHeader header;
+  std::memset(&header, 0, sizeof(header));
+  std::memcpy(header.magic, FCK_MAGIC, sizeof(FCK_MAGIC));
+  header.step = checkpoint.step;
+  header.numparticles = numparticles;
+  header.numbounds = (int) checkpoint.bounds.size();
+  header.numsprings = (int) settings.springs.size();
+  header.dt = settings.dt;
+  header.stiffness = settings.stiffness;
+  header.thickness = settings.thickness;
+  header.gravity[0] = settings.gravity[0];
+  header.gravity[1] = settings.gravity[1];
+  header.drag = settings.drag;
+
+  std::vector<scalar> springs;
+  for( std::vector<PenaltySceneSettings::Spring>::size_type s = 0; s < settings.springs.size(); ++s )
+  {
+    const PenaltySceneSettings::Spring& spring = settings.springs[s];
+    springs.push_back(spring.edge);
+    springs.push_back(spring.k);
+    springs.push_back(spring.l0);
+    springs.push_back(spring.b);
+  }
+  std::vector<unsigned char> fixed(checkpoint.fixed);
+  fixed.resize(paddedBytes(fixed.size()), 0);
+
+  const std::string temporary = filename + ".tmp";
+  std::FILE* file = std::fopen(temporary.c_str(), "wb");
+  if( file == NULL )
+  {
+    complain("Failed to create " + temporary + ".");
+    return false;
+  }
+  bool ok = writeBytes(file, &header, sizeof(header)) &&
+            writeBytes(file, checkpoint.x.data(), sizeof(scalar)*2*numparticles) &&
+            writeBytes(file, checkpoint.v.data(), sizeof(scalar)*2*numparticles) &&
+            ( checkpoint.bounds.empty() || writeBytes(file, &checkpoint.bounds[0], sizeof(scalar)*checkpoint.bounds.size()) ) &&
+            ( springs.empty() || writeBytes(file, &springs[0], sizeof(scalar)*springs.size()) ) &&
+            ( fixed.empty() || writeBytes(file, &fixed[0], fixed.size()) );
+  ok = std::fclose(file) == 0 && ok;
+  if( !ok || std::rename(temporary.c_str(), filename.c_str()) != 0 )
+  {
+    complain("Failed to write " + filename + ".");
+    std::remove(temporary.c_str());
+    return false;
+  }
+  return true;
+}
+
+bool readCheckpoint( const std::string& filename, Checkpoint& checkpoint )
+{
+  MappedFile file;
+  if( !file.open(filename) )
+  {
+    complain("Failed to open " + filename + ".");
+    return false;
+  }
+  CheckpointHeader header;
+  if( file.size() < sizeof(header) )
+  {
+    complain(filename + " is not a checkpoint.");
+    return false;
+  }
+  std::memcpy(&header, file.data(), sizeof(header));
+  if( std::memcmp(header.magic, FCK_MAGIC, sizeof(FCK_MAGIC)) != 0 || header.step < 0 || header.numparticles < 0 || header.numbounds < 0 || header.numsprings < 0 )
+  {
+    complain(filename + " is not a checkpoint.");
+    return false;
+  }
+  if( file.size() != fileBytes(header) )
+  {
+    complain(filename + " is truncated.");
+    return false;
+  }
+
+  const int numparticles = header.numparticles;
+  const char* data = file.data() + sizeof(header);
+  checkpoint.step = header.step;
+  checkpoint.x.resize(2*numparticles);
+  checkpoint.v.resize(2*numparticles);
+  std::memcpy(checkpoint.x.data(), data, sizeof(scalar)*2*numparticles);
+  data += sizeof(scalar)*2*numparticles;
+  std::memcpy(checkpoint.v.data(), data, sizeof(scalar)*2*numparticles);
+  data += sizeof(scalar)*2*numparticles;
+  checkpoint.bounds.resize(header.numbounds);
+  if( header.numbounds > 0 ) std::memcpy(&checkpoint.bounds[0], data, sizeof(scalar)*header.numbounds);
+  data += sizeof(scalar)*header.numbounds;
+
+  PenaltySceneSettings& settings = checkpoint.settings;
+  settings = PenaltySceneSettings();
+  settings.dt = header.dt;
+  settings.stiffness = header.stiffness;
+  settings.thickness = header.thickness;
+  settings.gravity[0] = header.gravity[0];
+  settings.gravity[1] = header.gravity[1];
+  settings.drag = header.drag;
+  settings.springs.resize(header.numsprings);
+  for( int s = 0; s < header.numsprings; ++s )
+  {
+    scalar values[4];
+    std::memcpy(values, data, sizeof(values));
+    data += sizeof(values);
+    settings.springs[s].edge = (int) values[0];
+    settings.springs[s].k = values[1];
+    settings.springs[s].l0 = values[2];
+    settings.springs[s].b = values[3];
+  }
+  checkpoint.fixed.assign(data, data + numparticles);
+  return true;
+}
+
+bool checkpointMatches( const Checkpoint& checkpoint, const TwoDScene& scene, const PenaltySceneSettings& settings )
+{
+  const int numparticles = scene.getNumParticles();
+  if( (int) checkpoint.fixed.size() != numparticles )
+  {
+    std::ostringstream what;
+    what << "The checkpoint has " << checkpoint.fixed.size() << " particles, the scene " << numparticles << ".";
+    complain(what.str());
+    return false;
+  }
+  for( int i = 0; i < numparticles; ++i )
+  {
+    if( ( checkpoint.fixed[i] != 0 ) != scene.isFixed(i) )
+    {
+      std::ostringstream what;
+      what << "Particle " << i << " is fixed in only one of the checkpoint and the scene.";
+      complain(what.str());
+      return false;
+    }
+  }
+
+  const PenaltySceneSettings& saved = checkpoint.settings;
+  bool same = saved.dt == settings.dt && saved.stiffness == settings.stiffness && saved.thickness == settings.thickness &&
+              saved.gravity[0] == settings.gravity[0] && saved.gravity[1] == settings.gravity[1] && saved.drag == settings.drag &&
+              saved.springs.size() == settings.springs.size();
+  for( std::vector<PenaltySceneSettings::Spring>::size_type s = 0; same && s < saved.springs.size(); ++s )
+  {
+    const PenaltySceneSettings::Spring& a = saved.springs[s];
+    const PenaltySceneSettings::Spring& b = settings.springs[s];
+    same = a.edge == b.edge && a.k == b.k && a.l0 == b.l0 && a.b == b.b;
+  }
+  if( !same ) complain("The checkpoint was run with other forces or another time step than the scene's.");
+  return same;
+}
+
+AsyncCheckpointWriter::AsyncCheckpointWriter()
+: m_filename()
+, m_checkpoint()
+, m_failed(false)
+, m_thread()
+{}
+
+AsyncCheckpointWriter::~AsyncCheckpointWriter()
+{
+  finish();
+}
+
+void AsyncCheckpointWriter::write( const std::string& filename, const Checkpoint& checkpoint )
+{
+  if( m_thread.joinable() ) m_thread.join();
+  // The thread is not running, so the copy needs no lock; assigning reuses
+  // the previous checkpoint's storage.
+  m_filename = filename;
+  m_checkpoint = checkpoint;
+  m_thread = std::thread( [this]()
+  {
+    if( !writeCheckpoint(m_filename, m_checkpoint) ) m_failed = true;
+  } );
+}
+
+bool AsyncCheckpointWriter::finish()
+{
+  if( m_thread.joinable() ) m_thread.join();
+  return !m_failed;
+}
@@ -0,0 +1,100 @@
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "PenaltySceneSettings.h"
+
+// Binary snapshots (.fck) of a run of a penalty-contact scene part way, for
+// FOSSSimMPI to resume from. A trajectory's frames hold x and v alone, and
+// nothing ties them to the scene or the step they came from. A file is
+//
+//   header    CheckpointHeader
+//   x, v      2*numparticles doubles each
+//   bounds    numbounds doubles
+//   springs   4*numsprings doubles, edge k l0 b per spring
+//   fixed     numparticles bytes, padded to a multiple of 8
+//
+// in native byte order. The scene's masses, radii, edges and halfplanes are
+// not kept, as they never change and the scene is read again on resume;
+// the fixed flags and force parameters are kept to check that it is the
+// same scene. Forward-backward Euler and the contest detector carry nothing
+// from one step to the next besides x and v, so there is no integrator or
+// detector state to keep.
+struct CheckpointHeader
+{
+  // "FCK" followed by the format version.
+  char magic[4];
+  int step;
+  int numparticles;
+  int numbounds;
+  int numsprings;
+  int padding;
+  scalar dt;
+  scalar stiffness;
+  scalar thickness;
+  scalar gravity[2];
+  scalar drag;
+};
+
+struct Checkpoint
+{
+  Checkpoint();
+
+  // The steps taken when the snapshot was, and the state they left.
+  int step;
+  VectorXs x;
+  VectorXs v;
+  std::vector<unsigned char> fixed;
+  // The scene's settings; the duration and maxsimfreq are not kept, so that
+  // a run can resume for longer than it started.
+  PenaltySceneSettings settings;
+  // FOSSSimMPI's strip bounds, so that a run resumed on as many ranks cuts
+  // the scene where it left off.
+  std::vector<scalar> bounds;
+};
+
+// Writes checkpoint to filename.tmp, then renames it over filename, so that
+// a run killed part way through a write leaves the previous checkpoint
+// whole. Returns false, after printing why, if it could not.
+bool writeCheckpoint( const std::string& filename, const Checkpoint& checkpoint );
+
+// Maps filename into memory and copies it into checkpoint. Returns false,
+// after printing why, on a missing, truncated or foreign file.
+bool readCheckpoint( const std::string& filename, Checkpoint& checkpoint );
+
+// Whether checkpoint was taken of scene, run with settings: as many
+// particles, fixed alike, under the same forces and time step. Returns
+// false, after printing why, if not.
+bool checkpointMatches( const Checkpoint& checkpoint, const TwoDScene& scene, const PenaltySceneSettings& settings );
+
+// Writes checkpoints on a thread of its own, so that the run steps on while
+// one goes to disk. A checkpoint is copied before write returns; a write
+// waits for the previous one to finish, so at most one is held at a time.
+class AsyncCheckpointWriter
+{
+public:
+  AsyncCheckpointWriter();
+
+  // Waits for the checkpoint being written.
+  ~AsyncCheckpointWriter();
+
+  void write( const std::string& filename, const Checkpoint& checkpoint );
+
+  // Waits for the checkpoint being written. Returns false if any failed to
+  // write, each having said why.
+  bool finish();
+
+private:
+  AsyncCheckpointWriter( const AsyncCheckpointWriter& );
+  AsyncCheckpointWriter& operator=( const AsyncCheckpointWriter& );
+
+  std::string m_filename;
+  Checkpoint m_checkpoint;
+  bool m_failed;
+  std::thread m_thread;
+};
+
+#endif
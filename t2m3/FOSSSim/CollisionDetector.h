@@ -3,8 +3,18 @@
 
 #include "MathDefs.h"
 
+#include <utility>
+#include <vector>
+
 class TwoDScene;
 
+// Receives a detector's candidate pairs. The simulator's detectors sort them
+// before reporting any, so unless called concurrently a callback sees every
+// particle-particle pair ( i, j ), i < j, in order of i and then j; then
+// every particle-edge pair ( particle, edge ) and every particle-halfplane
+// pair ( particle, halfplane ), each in order of the particle and then the
+// other. Walking the pairs in that order reads the particles' state from
+// front to back.
 class DetectionCallback
 {
  public:
@@ -15,6 +25,30 @@ class DetectionCallback
   virtual void ParticleHalfplaneCallback(int vidx, int hidx)=0;
 };
 
+// Mix-in for callbacks that tolerate concurrent calls. Detectors report
+// candidate pairs from the task pool's threads to callbacks that also derive
+// from this; all others are called from one thread.
+class ThreadSafeDetectionCallback
+{
+ public:
+  virtual ~ThreadSafeDetectionCallback() {}
+};
+
+// Mix-in for callbacks that take the sorted candidates as whole lists.
+// Detectors hand callbacks that also derive from this every pair at once,
+// in the order above and without the particle-edge pairs whose particle is
+// an endpoint of the edge, or near one with EDGE_EXCLUSION_RINGS, instead
+// of calling back once per pair. The base library defines
+// DetectionCallback, so this is an extra base class rather than a new
+// virtual, as ThreadSafeDetectionCallback is.
+class PairListDetectionCallback
+{
+ public:
+  virtual ~PairListDetectionCallback() {}
+
+  virtual void PairListsCallback(const std::vector<std::pair<int,int> >& pppairs, const std::vector<std::pair<int,int> >& pepairs, const std::vector<std::pair<int,int> >& phpairs)=0;
+};
+
 class CollisionDetector
 {
  public:
@@ -1,24 +1,765 @@
 #include "ContestDetector.h"
 #include <iostream>
 #include "TwoDScene.h"
-#include <set>
+#include "SweepAndPruneDetector.h"
+#include "AABBTreeDetector.h"
+#include "KineticSweepAndPruneDetector.h"
+#include "HierarchicalGridDetector.h"
+#include "EdgeAdjacency.h"
+#include "PeriodicDomain.h"
+#include "BroadPhaseTuning.h"
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include "TaskPool.h"
+
+namespace
+{
+
+// Grains of the broad phase's loops, each tunable through FOSSSIM_GRAIN by
+// the name it is looked up by. Below contest.entries grid entries binning
+// stays serial.
+const int BOX_GRAIN = 4096;
+const int ENTRY_GRAIN = 4096;
+const int BUCKET_GRAIN = 256;
+const int EDGE_GRAIN = 16;
+const int PARTICLE_GRAIN = 256;
+
+// Uniform grid over the plane, stored as a spatial hash so that its memory
+// is proportional to the number of occupied cells rather than the extent of
+// the scene. Objects are inserted into every cell their AABB covers, so two
+// objects with overlapping AABBs always share a bucket. Distinct cells can
+// hash to the same bucket; candidates are therefore always confirmed with an
+// AABB test.
+//
+// Over a PeriodicDomain the cells are sized to tile its period along each
+// periodic axis, and their coordinates wrap around, so that particles near
+// opposite sides share buckets.
+//
+// Binning is a counting sort. Each of the pool's threads histograms and then
+// scatters a contiguous chunk of the entries, so the bucket contents come out
+// in the same order as a serial build.
+class HashGrid
+{
+public:
+  HashGrid( scalar cellsize, int nbuckets )
+  : m_nbuckets(nbuckets)
+  , m_offsets( nbuckets+1, 0 )
+  , m_objects()
+  {
+    m_origin[0] = m_origin[1] = 0.0;
+    m_inv_cellsize[0] = m_inv_cellsize[1] = 1.0/cellsize;
+    m_period[0] = m_period[1] = 0;
+  }
+
+  // Cells no smaller than cellsize.
+  HashGrid( const PeriodicDomain& domain, scalar cellsize, int nbuckets )
+  : m_nbuckets(nbuckets)
+  , m_offsets( nbuckets+1, 0 )
+  , m_objects()
+  {
+    for( int d = 0; d < 2; ++d )
+    {
+      m_origin[d] = domain.min(d);
+      m_period[d] = domain.periodic[d] ? std::max( (int) std::floor( domain.extent(d)/cellsize ), 1 ) : 0;
+      m_inv_cellsize[d] = domain.periodic[d] ? m_period[d]/domain.extent(d) : 1.0/cellsize;
+    }
+  }
+
+  // Bins the objects ids[0], ids[1], ... by their boxes, boxes[ids[k]].
+  void build( const std::vector<AABB>& boxes, const std::vector<int>& ids )
+  {
+    TaskPool& pool = TaskPool::shared();
+    const int nobjects = (int) ids.size();
+    const int box_grain = TaskPool::grainSize( "contest.boxes", BOX_GRAIN );
+
+    // Entries per object, then their start in the flat entry arrays.
+    std::vector<int> first( nobjects+1, 0 );
+    pool.parallelFor( 0, nobjects, box_grain, [&]( int lo, int hi )
+    {
+      for( int i = lo; i < hi; ++i )
+      {
+        int xmin, ymin, xmax, ymax;
+        cellRange( boxes[ids[i]], xmin, ymin, xmax, ymax );
+        first[i+1] = ( xmax-xmin+1 )*( ymax-ymin+1 );
+      }
+    } );
+    for( int i = 0; i < nobjects; ++i ) first[i+1] += first[i];
+    const int nentries = first[nobjects];
+
+    std::vector<int> entry_bucket( nentries );
+    pool.parallelFor( 0, nobjects, box_grain, [&]( int lo, int hi )
+    {
+      for( int i = lo; i < hi; ++i )
+      {
+        int xmin, ymin, xmax, ymax;
+        cellRange( boxes[ids[i]], xmin, ymin, xmax, ymax );
+        int k = first[i];
+        for( int ci = xmin; ci <= xmax; ++ci )
+          for( int cj = ymin; cj <= ymax; ++cj )
+            entry_bucket[k++] = bucket(ci,cj);
+      }
+    } );
+
+    // One chunk per thread, as each chunk has a histogram of every bucket.
+    const int nthreads = nentries > TaskPool::grainSize( "contest.entries", ENTRY_GRAIN ) ? pool.getNumThreads() : 1;
+    std::vector<std::vector<int> > counts( nthreads, std::vector<int>( m_nbuckets, 0 ) );
+    std::vector<int> chunk( nthreads+1 );
+    for( int t = 0; t <= nthreads; ++t ) chunk[t] = (int) ( ( (long long) nentries*t )/nthreads );
+
+    pool.parallelFor( 0, nthreads, 1, [&]( int lo, int hi )
+    {
+      for( int t = lo; t < hi; ++t )
+        for( int k = chunk[t]; k < chunk[t+1]; ++k ) ++counts[t][entry_bucket[k]];
+    } );
+
+    // Exclusive prefix over (bucket, thread) gives each thread's write cursor.
+    m_offsets.assign( m_nbuckets+1, 0 );
+    int total = 0;
+    for( int b = 0; b < m_nbuckets; ++b )
+    {
+      m_offsets[b] = total;
+      for( int t = 0; t < nthreads; ++t ) { int c = counts[t][b]; counts[t][b] = total; total += c; }
+    }
+    m_offsets[m_nbuckets] = total;
+
+    m_objects.resize( nentries );
+    pool.parallelFor( 0, nthreads, 1, [&]( int lo, int hi )
+    {
+      for( int t = lo; t < hi; ++t )
+      {
+        int object = int( std::upper_bound( first.begin(), first.end(), chunk[t] ) - first.begin() ) - 1;
+        for( int k = chunk[t]; k < chunk[t+1]; ++k )
+        {
+          while( first[object+1] <= k ) ++object;
+          m_objects[counts[t][entry_bucket[k]]++] = ids[object];
+        }
+      }
+    } );
+  }
+
+  int numBuckets() const { return m_nbuckets; }
+  scalar cellSize() const { return 1.0/m_inv_cellsize[0]; }
+
+  // Appends the buckets of the cells the box covers, each once.
+  void buckets( const AABB& box, std::vector<int>& out ) const
+  {
+    const std::vector<int>::size_type first = out.size();
+    int xmin, ymin, xmax, ymax;
+    cellRange( box, xmin, ymin, xmax, ymax );
+    for( int i = xmin; i <= xmax; ++i )
+      for( int j = ymin; j <= ymax; ++j ) out.push_back( bucket(i,j) );
+    std::sort( out.begin()+first, out.end() );
+    out.erase( std::unique( out.begin()+first, out.end() ), out.end() );
+  }
+
+  // Cells the box covers.
+  int numCells( const AABB& box ) const
+  {
+    int xmin, ymin, xmax, ymax;
+    cellRange( box, xmin, ymin, xmax, ymax );
+    return ( xmax-xmin+1 )*( ymax-ymin+1 );
+  }
+  int bucketBegin( int b ) const { return m_offsets[b]; }
+  int bucketEnd( int b ) const { return m_offsets[b+1]; }
+  int object( int k ) const { return m_objects[k]; }
+
+  // Calls f(object) for every object in every bucket the box covers. Objects
+  // may be reported more than once.
+  template<class F>
+  void query( const AABB& box, F& f ) const
+  {
+    int xmin, ymin, xmax, ymax;
+    cellRange( box, xmin, ymin, xmax, ymax );
+    for( int i = xmin; i <= xmax; ++i )
+      for( int j = ymin; j <= ymax; ++j )
+      {
+        int b = bucket(i,j);
+        for( int k = m_offsets[b]; k < m_offsets[b+1]; ++k ) f( m_objects[k] );
+      }
+  }
+
+private:
+  void cellRange( const AABB& box, int& xmin, int& ymin, int& xmax, int& ymax ) const
+  {
+    xmin = (int) std::floor( ( box.min.x() - m_origin[0] )*m_inv_cellsize[0] );
+    ymin = (int) std::floor( ( box.min.y() - m_origin[1] )*m_inv_cellsize[1] );
+    xmax = (int) std::floor( ( box.max.x() - m_origin[0] )*m_inv_cellsize[0] );
+    ymax = (int) std::floor( ( box.max.y() - m_origin[1] )*m_inv_cellsize[1] );
+    // A box as wide as the period covers every cell across it, once.
+    if( m_period[0] > 0 && xmax-xmin+1 >= m_period[0] ) { xmin = 0; xmax = m_period[0]-1; }
+    if( m_period[1] > 0 && ymax-ymin+1 >= m_period[1] ) { ymin = 0; ymax = m_period[1]-1; }
+  }
+
+  int bucket( int i, int j ) const
+  {
+    if( m_period[0] > 0 ) i = ( i%m_period[0] + m_period[0] )%m_period[0];
+    if( m_period[1] > 0 ) j = ( j%m_period[1] + m_period[1] )%m_period[1];
+    unsigned int h = ( (unsigned int) i*73856093u ) ^ ( (unsigned int) j*19349663u );
+    return (int) ( h % (unsigned int) m_nbuckets );
+  }
+
+  scalar m_origin[2];
+  scalar m_inv_cellsize[2];
+  // Cells across each periodic axis, or 0 along an open one.
+  int m_period[2];
+  int m_nbuckets;
+  std::vector<int> m_offsets;
+  std::vector<int> m_objects;
+};
+
+// Cell size for the grid. The maximum radius is a poor choice when a few
+// large particles (e.g. the fixed corners of a box) coexist with many small
+// ones, so cells are sized from the median particle diameter, times the
+// tuned scale; larger objects simply span several cells.
+scalar chooseCellSize( const TwoDScene& scene )
+{
+  std::vector<scalar> radii = scene.getRadii();
+  if( radii.empty() ) return 1.0;
+  std::nth_element( radii.begin(), radii.begin()+radii.size()/2, radii.end() );
+  scalar r = radii[radii.size()/2];
+  if( r <= 0.0 ) r = *std::max_element( radii.begin(), radii.end() );
+  return ( r > 0.0 ? 2.0*r : 1.0 )*broadphase::tuning().cellscale;
+}
+
+// Collects particles whose boxes overlap a query edge's box.
+struct EdgeQuery
+{
+  const std::vector<AABB>& particle_boxes;
+  const AABB& edge_box;
+  int edge;
+  PEList& pepairs;
+
+  EdgeQuery( const std::vector<AABB>& pb, const AABB& eb, int e, PEList& pe )
+  : particle_boxes(pb), edge_box(eb), edge(e), pepairs(pe)
+  {}
+
+  void operator()( int particle ) const
+  {
+    if( particle_boxes[particle].overlaps(edge_box) ) pepairs.push_back( std::make_pair(particle,edge) );
+  }
+};
+
+// Collects other particles whose boxes overlap a query particle's box.
+struct ParticleQuery
+{
+  const std::vector<AABB>& particle_boxes;
+  int particle;
+  PPList& pppairs;
+
+  ParticleQuery( const std::vector<AABB>& pb, int p, PPList& pp )
+  : particle_boxes(pb), particle(p), pppairs(pp)
+  {}
+
+  void operator()( int other ) const
+  {
+    if( particle_boxes[other].overlaps(particle_boxes[particle]) ) pppairs.push_back( std::make_pair( std::min(particle,other), std::max(particle,other) ) );
+  }
+};
+
+// Collects edges whose boxes overlap a query particle's box.
+struct ParticleEdgeQuery
+{
+  const std::vector<AABB>& edge_boxes;
+  const AABB& particle_box;
+  int particle;
+  PEList& pepairs;
+
+  ParticleEdgeQuery( const std::vector<AABB>& eb, const AABB& pb, int p, PEList& pe )
+  : edge_boxes(eb), particle_box(pb), particle(p), pepairs(pe)
+  {}
+
+  void operator()( int edge ) const
+  {
+    if( edge_boxes[edge].overlaps(particle_box) ) pepairs.push_back( std::make_pair(particle,edge) );
+  }
+};
+
+// The scene's static geometry: its fixed particles, and the edges between
+// two of them, such as the walls of a box. These never move, so the
+// candidate pairs among them are found once, and each step only the moving
+// particles are binned. The base library loads the scene, so the split is
+// made on the first call and made again whenever a particle's fixed flag, a
+// fixed particle's position or radius, the edges or the tuned cell scale
+// change.
+//
+// The pairs between static and moving objects are found from whichever side
+// is cheaper. Usually that is the static side: a box's walls cover fewer
+// cells than there are particles, so each static object keeps the buckets
+// of the moving particles' grid its box covers, its footprint, and scans
+// them each step. When the footprints cover more cells than there are
+// moving particles, each moving particle looks itself up in grids of the
+// static objects instead.
+class StaticGeometry
+{
+public:
+  StaticGeometry()
+  : particles()
+  , edges()
+  , dynamic_particles()
+  , dynamic_edges()
+  , edge_boxes()
+  , pppairs()
+  , pepairs()
+  , scan_footprints(false)
+  , particle_grid( 1.0, 1 )
+  , edge_grid( 1.0, 1 )
+  , particle_footprints()
+  , edge_footprints()
+  , m_fixed()
+  , m_x()
+  , m_radii()
+  , m_edges()
+  , m_edge_radii()
+  , m_footprint_cellsize(0.0)
+  , m_footprint_nbuckets(0)
+  , m_cellscale(0.0)
+  {}
+
+  // Brings the split up to date with the scene at x; particle_boxes are the
+  // particles' boxes there. Returns true if it was rebuilt.
+  bool update( const TwoDScene& scene, const VectorXs& x, const std::vector<AABB>& particle_boxes )
+  {
+    if( !changed( scene, x ) ) return false;
+
+    const int nparticles = scene.getNumParticles();
+    const std::vector<std::pair<int,int> >& scene_edges = scene.getEdges();
+    const int nedges = (int) scene_edges.size();
+    m_fixed.resize( nparticles );
+    for( int i = 0; i < nparticles; ++i ) m_fixed[i] = scene.isFixed(i);
+    m_x = x;
+    m_radii = scene.getRadii();
+    m_edges = scene_edges;
+    m_edge_radii = scene.getEdgeRadii();
+    m_cellscale = broadphase::tuning().cellscale;
+
+    particles.clear();
+    dynamic_particles.clear();
+    for( int i = 0; i < nparticles; ++i ) ( m_fixed[i] ? particles : dynamic_particles ).push_back(i);
+    edges.clear();
+    dynamic_edges.clear();
+    edge_boxes.resize( nedges );
+    for( int e = 0; e < nedges; ++e )
+    {
+      if( !m_fixed[scene_edges[e].first] || !m_fixed[scene_edges[e].second] ) { dynamic_edges.push_back(e); continue; }
+      edges.push_back(e);
+      edge_boxes[e] = broadphase::edgeBox( x, x, scene_edges[e], m_edge_radii[e] );
+    }
+
+    // Built once, so the buckets are sized by the cells covered rather than
+    // the objects: a wall covers thousands of cells.
+    const scalar cellsize = chooseCellSize( scene );
+    const HashGrid cells( cellsize, 1 );
+    int nparticlecells = 0;
+    for( std::vector<int>::size_type k = 0; k < particles.size(); ++k ) nparticlecells += cells.numCells( particle_boxes[particles[k]] );
+    int nedgecells = 0;
+    for( std::vector<int>::size_type k = 0; k < edges.size(); ++k ) nedgecells += cells.numCells( edge_boxes[edges[k]] );
+    particle_grid = HashGrid( cellsize, std::max( 2*nparticlecells, 1 ) );
+    particle_grid.build( particle_boxes, particles );
+    edge_grid = HashGrid( cellsize, std::max( 2*nedgecells, 1 ) );
+    edge_grid.build( edge_boxes, edges );
+    scan_footprints = nparticlecells + nedgecells <= (int) dynamic_particles.size();
+    m_footprint_nbuckets = 0;
+
+    pppairs.clear();
+    for( int b = 0; b < particle_grid.numBuckets(); ++b )
+      for( int k = particle_grid.bucketBegin(b); k < particle_grid.bucketEnd(b); ++k )
+        for( int l = k+1; l < particle_grid.bucketEnd(b); ++l )
+        {
+          const int i = particle_grid.object(k);
+          const int j = particle_grid.object(l);
+          if( i == j || !particle_boxes[i].overlaps(particle_boxes[j]) ) continue;
+          pppairs.push_back( std::make_pair( std::min(i,j), std::max(i,j) ) );
+        }
+    broadphase::sortUnique( pppairs );
+
+    pepairs.clear();
+    for( std::vector<int>::size_type k = 0; k < edges.size(); ++k )
+    {
+      const int e = edges[k];
+      EdgeQuery query( particle_boxes, edge_boxes[e], e, pepairs );
+      particle_grid.query( edge_boxes[e], query );
+    }
+    broadphase::sortUnique( pepairs );
+    return true;
+  }
+
+  // Recomputes the footprints if the moving particles' grid is laid out
+  // differently from the one they were computed for.
+  void updateFootprints( const HashGrid& grid, const std::vector<AABB>& particle_boxes )
+  {
+    if( m_footprint_cellsize == grid.cellSize() && m_footprint_nbuckets == grid.numBuckets() ) return;
+    m_footprint_cellsize = grid.cellSize();
+    m_footprint_nbuckets = grid.numBuckets();
+    particle_footprints.assign( particles.size(), std::vector<int>() );
+    for( std::vector<int>::size_type k = 0; k < particles.size(); ++k ) grid.buckets( particle_boxes[particles[k]], particle_footprints[k] );
+    edge_footprints.assign( edges.size(), std::vector<int>() );
+    for( std::vector<int>::size_type k = 0; k < edges.size(); ++k ) grid.buckets( edge_boxes[edges[k]], edge_footprints[k] );
+  }
+
+  // The fixed particles and the edges between them, and the rest.
+  std::vector<int> particles;
+  std::vector<int> edges;
+  std::vector<int> dynamic_particles;
+  std::vector<int> dynamic_edges;
+  // Boxes of the static edges, indexed by edge.
+  std::vector<AABB> edge_boxes;
+  // Candidates among the static particles and edges, sorted.
+  PPList pppairs;
+  PEList pepairs;
+
+  // Whether the static objects scan their footprints, rather than the
+  // moving particles looking themselves up in the static grids.
+  bool scan_footprints;
+  HashGrid particle_grid;
+  HashGrid edge_grid;
+  // Per static particle and edge, as ordered above, when scanned.
+  std::vector<std::vector<int> > particle_footprints;
+  std::vector<std::vector<int> > edge_footprints;
+
+private:
+  bool changed( const TwoDScene& scene, const VectorXs& x ) const
+  {
+    const int nparticles = scene.getNumParticles();
+    if( (int) m_fixed.size() != nparticles || m_edges != scene.getEdges() || m_edge_radii != scene.getEdgeRadii() || m_cellscale != broadphase::tuning().cellscale ) return true;
+    const std::vector<scalar>& radii = scene.getRadii();
+    for( int i = 0; i < nparticles; ++i )
+    {
+      if( m_fixed[i] != (char) scene.isFixed(i) ) return true;
+      if( m_fixed[i] && ( m_x(2*i) != x(2*i) || m_x(2*i+1) != x(2*i+1) || m_radii[i] != radii[i] ) ) return true;
+    }
+    return false;
+  }
+
+  // The scene as of the last rebuild.
+  std::vector<char> m_fixed;
+  VectorXs m_x;
+  std::vector<scalar> m_radii;
+  std::vector<std::pair<int,int> > m_edges;
+  std::vector<scalar> m_edge_radii;
+  // The moving particles' grid the footprints were computed for.
+  scalar m_footprint_cellsize;
+  int m_footprint_nbuckets;
+  scalar m_cellscale;
+};
+
+// Whether two boxes overlap once the second is moved to its image nearest
+// the first, comparing their centres' minimum-image separation with their
+// half-widths. Along an open axis this is the plain overlap test.
+bool overlapsPeriodic( const PeriodicDomain& domain, const AABB& a, const AABB& b )
+{
+  for( int d = 0; d < 2; ++d )
+  {
+    const scalar gap = domain.minimumImage( d, 0.5*( a.min(d) + a.max(d) - b.min(d) - b.max(d) ) );
+    if( !( std::fabs(gap) <= 0.5*( a.max(d) - a.min(d) + b.max(d) - b.min(d) ) ) ) return false;
+  }
+  return true;
+}
+
+EdgeAdjacency g_periodic_adjacency;
+
+// The candidates in a scene with a PeriodicDomain, from one wrapping grid of
+// every particle. The other broad phases and the static split do not wrap,
+// so this replaces them whichever is built. Each edge's box spans its near
+// endpoint and the far one's nearest image, so an edge across a periodic
+// side does not cover the whole period.
+void findPeriodicPairs( const TwoDScene& scene, const PeriodicDomain& domain, const VectorXs& x, PPList& pppairs, PEList& pepairs, PHList& phpairs )
+{
+  TaskPool& pool = TaskPool::shared();
+  const int nparticles = scene.getNumParticles();
+  const std::vector<std::pair<int,int> >& edges = scene.getEdges();
+  const std::vector<scalar>& edge_radii = scene.getEdgeRadii();
+
+  std::vector<AABB> particle_boxes;
+  particle_boxes.reserve( nparticles );
+  std::vector<int> ids( nparticles );
+  for( int i = 0; i < nparticles; ++i )
+  {
+    particle_boxes.push_back( broadphase::particleBox( x, x, i, scene.getRadius(i) ) );
+    ids[i] = i;
+  }
+  HashGrid grid( domain, chooseCellSize(scene), std::max( 2*nparticles, 1 ) );
+  grid.build( particle_boxes, ids );
+
+  const int bucket_grain = TaskPool::grainSize( "contest.buckets", BUCKET_GRAIN );
+  const int nchunks = ( grid.numBuckets() + bucket_grain - 1 )/bucket_grain;
+  std::vector<PPList> chunk_pppairs( nchunks );
+  pool.parallelFor( 0, nchunks, 1, [&]( int lo, int hi )
+  {
+    for( int c = lo; c < hi; ++c )
+    {
+      const int end = std::min( ( c+1 )*bucket_grain, grid.numBuckets() );
+      for( int b = c*bucket_grain; b < end; ++b )
+        for( int k = grid.bucketBegin(b); k < grid.bucketEnd(b); ++k )
+          for( int l = k+1; l < grid.bucketEnd(b); ++l )
+          {
+            const int i = grid.object(k);
+            const int j = grid.object(l);
+            if( i == j || !overlapsPeriodic( domain, particle_boxes[i], particle_boxes[j] ) ) continue;
+            chunk_pppairs[c].push_back( std::make_pair( std::min(i,j), std::max(i,j) ) );
+          }
+    }
+  } );
+  pppairs.clear();
+  for( int c = 0; c < nchunks; ++c ) pppairs.insert( pppairs.end(), chunk_pppairs[c].begin(), chunk_pppairs[c].end() );
+  broadphase::sortUnique( pppairs );
+
+  pepairs.clear();
+  for( int e = 0; e < (int) edges.size(); ++e )
+  {
+    const Vector2s a = x.segment<2>( 2*edges[e].first );
+    const Vector2s b = a + domain.minimumImage( Vector2s( x.segment<2>( 2*edges[e].second ) - a ) );
+    AABB box;
+    box.min = a.cwiseMin(b).array() - edge_radii[e];
+    box.max = a.cwiseMax(b).array() + edge_radii[e];
+    auto collect = [&]( int particle )
+    {
+      if( overlapsPeriodic( domain, box, particle_boxes[particle] ) ) pepairs.push_back( std::make_pair( particle, e ) );
+    };
+    grid.query( box, collect );
+  }
+  broadphase::sortUnique( pepairs );
+  g_periodic_adjacency.update( scene );
+  broadphase::excludeNeighbours( g_periodic_adjacency, broadphase::exclusionRings(), pepairs );
+
+  broadphase::findHalfplanePairs( scene, x, x, phpairs );
+}
+
+// ContestDetector is constructed by the base library and cannot own the
+// persistent sweep order or trees, so they live in file-static detectors,
+// as does the grid's edge adjacency.
+#if defined(SAP_BROAD_PHASE)
+SweepAndPruneDetector g_sweep_and_prune;
+#elif defined(BVH_BROAD_PHASE)
+AABBTreeDetector g_aabb_tree;
+#elif defined(KINETIC_BROAD_PHASE)
+KineticSweepAndPruneDetector g_kinetic_sweep_and_prune;
+#elif defined(HGRID_BROAD_PHASE)
+HierarchicalGridDetector g_hierarchical_grid;
+#else
+EdgeAdjacency g_adjacency;
+StaticGeometry g_static;
+#endif
+
+}
+
+// Broad phase for the penalty method, which detects overlaps at a single
+// configuration: qs and qe must agree. Candidate pairs are reported once
+// each, without the particle-edge pairs broadphase::excludeNeighbours
+// removes.
+void ContestDetector::performCollisionDetection(const TwoDScene &scene, const VectorXs &qs, const VectorXs &qe, DetectionCallback &dc)
+{
+  if( (qs-qe).norm() > 1e-8)
+  {
+    std::cerr << "Contest collision detector is only designed for use with the penalty method!" << std::endl;
+    exit(1);
+  }
+
+  PPList pppairs;
+  PEList pepairs;
+  PHList phpairs;
+
+  findCollidingPairs(scene, qe, pppairs, pepairs, phpairs);
+  broadphase::reportPairs(scene, pppairs, pepairs, phpairs, dc);
+}
 
 // Given particle positions, computes lists of *potentially* overlapping object
 // pairs. How exactly to do this is up to you.
-// Inputs: 
-//   scene:  The scene object. Get edge information, radii, etc. from here. If 
+// Inputs:
+//   scene:  The scene object. Get edge information, radii, etc. from here. If
 //           for some reason you'd also like to use particle velocities in your
 //           algorithm, you can get them from here too.
 //   x:      The positions of the particle.
 // Outputs:
 //   pppairs: A list of (particle index, particle index) pairs of potentially
 //            overlapping particles. IMPORTANT: Each pair should only appear
-//            in the list at most once. (1, 2) and (2, 1) count as the same 
+//            in the list at most once. (1, 2) and (2, 1) count as the same
 //            pair.
 //   pepairs: A list of (particle index, edge index) pairs of potential
 //            particle-edge overlaps.
 //   phpairs: A list of (particle index, halfplane index) pairs of potential
 //            particle-halfplane overlaps.
+//
+// By default particles are binned into a uniform spatial hash grid by their
+// AABBs. Pairs sharing a bucket whose AABBs overlap are particle-particle
+// candidates; each edge's AABB is then queried against the grid for
+// particle-edge candidates. Fixed particles and the edges between them are
+// kept in grids of their own, built once, which the moving particles and
+// edges query instead. Building with CONTEST_BROAD_PHASE=sap, bvh,
+// kinetic or hgrid uses SweepAndPruneDetector, AABBTreeDetector,
+// KineticSweepAndPruneDetector or HierarchicalGridDetector instead. A scene
+// with a PeriodicDomain always uses the wrapping grid. Built with
+// TUNE_BROAD_PHASE, the broad phase's parameters are first calibrated for
+// a scene not seen before; see BroadPhaseTuning.h.
 void ContestDetector::findCollidingPairs(const TwoDScene &scene, const VectorXs &x, PPList &pppairs, PEList &pepairs, PHList &phpairs)
 {
+#ifdef TUNE_BROAD_PHASE
+  broadphase::tuneForScene( scene );
+#endif
+
+  if( const PeriodicDomain* domain = periodic::findDomain(scene) )
+  {
+    findPeriodicPairs( scene, *domain, x, pppairs, pepairs, phpairs );
+    return;
+  }
+
+#if defined(SAP_BROAD_PHASE)
+  g_sweep_and_prune.findCollidingPairs( scene, x, x, pppairs, pepairs, phpairs );
+#elif defined(BVH_BROAD_PHASE)
+  g_aabb_tree.findCollidingPairs( scene, x, x, pppairs, pepairs, phpairs );
+#elif defined(KINETIC_BROAD_PHASE)
+  g_kinetic_sweep_and_prune.findCollidingPairs( scene, x, x, pppairs, pepairs, phpairs );
+#elif defined(HGRID_BROAD_PHASE)
+  g_hierarchical_grid.findCollidingPairs( scene, x, x, pppairs, pepairs, phpairs );
+#else
+  TaskPool& pool = TaskPool::shared();
+  const int nparticles = scene.getNumParticles();
+  const std::vector<std::pair<int,int> >& edges = scene.getEdges();
+  const std::vector<scalar>& edge_radii = scene.getEdgeRadii();
+
+  std::vector<AABB> particle_boxes;
+  particle_boxes.reserve( nparticles );
+  for( int i = 0; i < nparticles; ++i ) particle_boxes.push_back( broadphase::particleBox( x, x, i, scene.getRadius(i) ) );
+  g_static.update( scene, x, particle_boxes );
+  const std::vector<int>& dynamic_particles = g_static.dynamic_particles;
+  const std::vector<int>& dynamic_edges = g_static.dynamic_edges;
+  const int ndynamic = (int) dynamic_particles.size();
+  const int nedges = (int) dynamic_edges.size();
+  HashGrid grid( chooseCellSize(scene), std::max( 2*ndynamic, 1 ) );
+  const bool scan = g_static.scan_footprints;
+  if( scan ) g_static.updateFootprints( grid, particle_boxes );
+
+  // Candidates go to a buffer per chunk of buckets, edges or particles,
+  // concatenated in order afterwards; the final sort makes the result
+  // independent of the chunks in any case. With one thread there is one
+  // chunk.
+  const int bucket_grain = TaskPool::grainSize( "contest.buckets", BUCKET_GRAIN );
+  const int edge_grain = TaskPool::grainSize( "contest.edges", EDGE_GRAIN );
+  const int particle_grain = TaskPool::grainSize( "contest.particles", PARTICLE_GRAIN );
+  const bool chunked = pool.getNumThreads() > 1;
+  const int nbucketchunks = chunked ? ( grid.numBuckets() + bucket_grain - 1 )/bucket_grain : 1;
+  const int nedgechunks = chunked ? std::max( ( nedges + edge_grain - 1 )/edge_grain, 1 ) : 1;
+  // The static-dynamic pairs are found by looping over the static particles
+  // and edges, or over the moving particles.
+  const int nstaticpp = scan ? (int) g_static.particles.size() : ndynamic;
+  const int nstaticpe = scan ? (int) g_static.edges.size() : ndynamic;
+  const int staticpp_chunk = chunked ? particle_grain : std::max( nstaticpp, 1 );
+  const int staticpe_chunk = chunked ? particle_grain : std::max( nstaticpe, 1 );
+  const int nstaticppchunks = std::max( ( nstaticpp + staticpp_chunk - 1 )/staticpp_chunk, 1 );
+  const int nstaticpechunks = std::max( ( nstaticpe + staticpe_chunk - 1 )/staticpe_chunk, 1 );
+  std::vector<PPList> chunk_pppairs( nbucketchunks + nstaticppchunks );
+  std::vector<PEList> chunk_pepairs( nedgechunks + nstaticpechunks );
+
+  // Only the moving particles are binned. The halfplanes need neither the
+  // grid nor the other candidates.
+  TaskGraph graph( pool );
+  const int build = graph.add( [&]()
+  {
+    grid.build( particle_boxes, dynamic_particles );
+  } );
+
+  const int particles = graph.add( [&]()
+  {
+    const int bucket_chunk = chunked ? bucket_grain : grid.numBuckets();
+    pool.parallelFor( 0, nbucketchunks, 1, [&]( int lo, int hi )
+    {
+      for( int c = lo; c < hi; ++c )
+      {
+        PPList& pp = chunk_pppairs[c];
+        const int end = std::min( ( c+1 )*bucket_chunk, grid.numBuckets() );
+        for( int b = c*bucket_chunk; b < end; ++b )
+          for( int k = grid.bucketBegin(b); k < grid.bucketEnd(b); ++k )
+            for( int l = k+1; l < grid.bucketEnd(b); ++l )
+            {
+              int i = grid.object(k);
+              int j = grid.object(l);
+              if( i == j || !particle_boxes[i].overlaps(particle_boxes[j]) ) continue;
+              pp.push_back( std::make_pair( std::min(i,j), std::max(i,j) ) );
+            }
+      }
+    } );
+    // Moving particles against the fixed ones.
+    pool.parallelFor( 0, nstaticppchunks, 1, [&]( int lo, int hi )
+    {
+      for( int c = lo; c < hi; ++c )
+      {
+        PPList& pp = chunk_pppairs[nbucketchunks+c];
+        const int end = std::min( ( c+1 )*staticpp_chunk, nstaticpp );
+        for( int k = c*staticpp_chunk; k < end; ++k )
+        {
+          if( !scan )
+          {
+            ParticleQuery query( particle_boxes, dynamic_particles[k], pp );
+            g_static.particle_grid.query( particle_boxes[dynamic_particles[k]], query );
+            continue;
+          }
+          ParticleQuery query( particle_boxes, g_static.particles[k], pp );
+          const std::vector<int>& footprint = g_static.particle_footprints[k];
+          for( std::vector<int>::size_type f = 0; f < footprint.size(); ++f )
+            for( int l = grid.bucketBegin(footprint[f]); l < grid.bucketEnd(footprint[f]); ++l ) query( grid.object(l) );
+        }
+      }
+    } );
+    pppairs = g_static.pppairs;
+    for( int c = 0; c < nbucketchunks + nstaticppchunks; ++c ) pppairs.insert( pppairs.end(), chunk_pppairs[c].begin(), chunk_pppairs[c].end() );
+    broadphase::sortUnique( pppairs );
+  } );
+
+  const int particle_edges = graph.add( [&]()
+  {
+    // Edges with a moving endpoint against every particle.
+    const int edge_chunk = chunked ? edge_grain : std::max( nedges, 1 );
+    pool.parallelFor( 0, nedgechunks, 1, [&]( int lo, int hi )
+    {
+      for( int c = lo; c < hi; ++c )
+      {
+        const int end = std::min( ( c+1 )*edge_chunk, nedges );
+        for( int k = c*edge_chunk; k < end; ++k )
+        {
+          const int e = dynamic_edges[k];
+          AABB box = broadphase::edgeBox( x, x, edges[e], edge_radii[e] );
+          EdgeQuery query( particle_boxes, box, e, chunk_pepairs[c] );
+          grid.query( box, query );
+          g_static.particle_grid.query( box, query );
+        }
+      }
+    } );
+    // Moving particles against the static edges.
+    pool.parallelFor( 0, nstaticpechunks, 1, [&]( int lo, int hi )
+    {
+      for( int c = lo; c < hi; ++c )
+      {
+        PEList& pe = chunk_pepairs[nedgechunks+c];
+        const int end = std::min( ( c+1 )*staticpe_chunk, nstaticpe );
+        for( int k = c*staticpe_chunk; k < end; ++k )
+        {
+          if( !scan )
+          {
+            const int i = dynamic_particles[k];
+            ParticleEdgeQuery query( g_static.edge_boxes, particle_boxes[i], i, pe );
+            g_static.edge_grid.query( particle_boxes[i], query );
+            continue;
+          }
+          const int e = g_static.edges[k];
+          EdgeQuery query( particle_boxes, g_static.edge_boxes[e], e, pe );
+          const std::vector<int>& footprint = g_static.edge_footprints[k];
+          for( std::vector<int>::size_type f = 0; f < footprint.size(); ++f )
+            for( int l = grid.bucketBegin(footprint[f]); l < grid.bucketEnd(footprint[f]); ++l ) query( grid.object(l) );
+        }
+      }
+    } );
+    pepairs = g_static.pepairs;
+    for( int c = 0; c < nedgechunks + nstaticpechunks; ++c ) pepairs.insert( pepairs.end(), chunk_pepairs[c].begin(), chunk_pepairs[c].end() );
+    broadphase::sortUnique( pepairs );
+    g_adjacency.update( scene );
+    broadphase::excludeNeighbours( g_adjacency, broadphase::exclusionRings(), pepairs );
+  } );
+
+  graph.add( [&]() { broadphase::findHalfplanePairs( scene, x, x, phpairs ); } );
+
+  graph.precede( build, particles );
+  graph.precede( build, particle_edges );
+  graph.run();
+#endif
 }
@@ -2,12 +2,8 @@
 #define CONTEST_DETECTOR_H
 
 #include "CollisionDetector.h"
+#include "BroadPhase.h"
 #include <vector>
-#include <set>
-
-typedef std::set<std::pair<int, int> > PPList;
-typedef std::set<std::pair<int, int> > PEList;
-typedef std::set<std::pair<int, int> > PHList;
 
 class ContestDetector : public CollisionDetector
 {
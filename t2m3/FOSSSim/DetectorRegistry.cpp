@@ -0,0 +1,75 @@
+#include "DetectorRegistry.h"
+
+#include <map>
+#include <mutex>
+
+#include "ContestDetector.h"
+
+namespace
+{
+
+CollisionDetector* createContestDetector()
+{
+  return new ContestDetector;
+}
+
+struct Registry
+{
+  std::mutex mutex;
+  std::map<std::string, detectors::Factory> factories;
+
+  Registry()
+  {
+    factories["contest"] = createContestDetector;
+  }
+};
+
+// Built on first use, so that hosts may register detectors from their own
+// static initializers.
+Registry& registry()
+{
+  static Registry instance;
+  return instance;
+}
+
+}
+
+namespace detectors
+{
+
+void registerDetector( const std::string& type, Factory factory )
+{
+  Registry& r = registry();
+  std::lock_guard<std::mutex> lock(r.mutex);
+  r.factories[type] = factory;
+}
+
+bool isRegistered( const std::string& type )
+{
+  Registry& r = registry();
+  std::lock_guard<std::mutex> lock(r.mutex);
+  return r.factories.count(type) > 0;
+}
+
+CollisionDetector* createDetector( const std::string& type )
+{
+  Factory factory = NULL;
+  {
+    Registry& r = registry();
+    std::lock_guard<std::mutex> lock(r.mutex);
+    std::map<std::string, Factory>::const_iterator found = r.factories.find(type);
+    if( found != r.factories.end() ) factory = found->second;
+  }
+  return factory == NULL ? NULL : factory();
+}
+
+std::vector<std::string> registeredTypes()
+{
+  Registry& r = registry();
+  std::lock_guard<std::mutex> lock(r.mutex);
+  std::vector<std::string> types;
+  for( std::map<std::string, Factory>::const_iterator f = r.factories.begin(); f != r.factories.end(); ++f ) types.push_back(f->first);
+  return types;
+}
+
+}
@@ -0,0 +1,34 @@
+#ifndef DETECTOR_REGISTRY_H
+#define DETECTOR_REGISTRY_H
+
+#include <string>
+#include <vector>
+
+class CollisionDetector;
+
+// The collision detectors a penalty-contact scene's <collisiondetection> may
+// name, by its type, for the tools that load such scenes without the base
+// library's parser: FOSSSimMPI, FOSSSimViewer's live mode and FOSSSimEmbed.
+// The contest detector is registered as "contest" from the start; a host
+// with a detector of its own registers it before loading the scenes that
+// name it, and gets it in every one of those tools without touching how
+// they read scenes.
+namespace detectors
+{
+  // Makes a new detector, which the caller owns.
+  typedef CollisionDetector* (*Factory)();
+
+  // Registers factory under type, in place of whatever was under it.
+  void registerDetector( const std::string& type, Factory factory );
+
+  bool isRegistered( const std::string& type );
+
+  // A new detector of type, which the caller owns, or NULL if no detector is
+  // registered under it.
+  CollisionDetector* createDetector( const std::string& type );
+
+  // The registered types, in alphabetical order.
+  std::vector<std::string> registeredTypes();
+}
+
+#endif
@@ -0,0 +1,494 @@
+#include "DeviceStepper.h"
+
+#ifdef DEVICE_STEPPING
+
+#include <omp.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <typeinfo>
+
+#include "ContestDetector.h"
+#include "PenaltyForce.h"
+
+namespace
+{
+
+// Buckets summed by each thread of the scan over the bucket counts.
+const int SCAN_BLOCK = 1024;
+
+// The base library's gravity and drag have no headers, so they are
+// recognised by the mangled names of their types.
+const char* const GRAVITY_TYPE = "18SimpleGravityForce";
+const char* const DRAG_TYPE = "16DragDampingForce";
+
+bool isType( const Force* force, const char* name )
+{
+  return std::strcmp(typeid(*force).name(), name) == 0;
+}
+
+// The gradient of a force on one particle of unit mass at the origin with
+// velocity v. Gravity and drag are constant in x and linear in v, so this
+// reads back their constants.
+Vector2s probe( Force* force, scalar vx, scalar vy )
+{
+  VectorXs x = VectorXs::Zero(2);
+  VectorXs v(2);
+  v << vx, vy;
+  VectorXs m = VectorXs::Ones(2);
+  VectorXs gradE = VectorXs::Zero(2);
+  force->addGradEToTotal(x, v, m, gradE);
+  return gradE;
+}
+
+template<class T>
+bool sameAs( const std::vector<T>& copy, const T* data, std::size_t size )
+{
+  return copy.size() == size && ( size == 0 || std::memcmp(&copy[0], data, size*sizeof(T)) == 0 );
+}
+
+}
+
+DeviceStepper::DeviceStepper()
+: m_device(omp_get_default_device())
+, m_numparticles(-1)
+, m_numbuckets(0)
+, m_cellsize(1.0)
+, m_largestbinned(0.0)
+, m_x()
+, m_v()
+, m_m()
+, m_radii()
+, m_fixed()
+, m_edges()
+, m_edgeradii()
+, m_halfplanes()
+, m_allocations()
+, d_x(NULL)
+, d_v(NULL)
+, d_m(NULL)
+, d_radii(NULL)
+, d_fixed(NULL)
+, d_edges(NULL)
+, d_edgeradii(NULL)
+, d_halfplanes(NULL)
+, d_large(NULL)
+, m_numlarge(0)
+, m_numedges(0)
+, m_numhalfplanes(0)
+, d_F(NULL)
+, d_cells(NULL)
+, d_buckets(NULL)
+, d_offsets(NULL)
+, d_cursors(NULL)
+, d_objects(NULL)
+, d_blocksums(NULL)
+, d_binned(NULL)
+, d_binnedcells(NULL)
+{}
+
+DeviceStepper::~DeviceStepper()
+{
+  release();
+}
+
+void* DeviceStepper::allocate( std::size_t bytes )
+{
+  // omp_target_alloc may return NULL for zero bytes.
+  void* pointer = omp_target_alloc(std::max<std::size_t>(bytes, 1), m_device);
+  m_allocations.push_back(pointer);
+  return pointer;
+}
+
+template<class T>
+T* DeviceStepper::allocateCopy( const std::vector<T>& host )
+{
+  T* pointer = (T*) allocate(host.size()*sizeof(T));
+  if( !host.empty() ) omp_target_memcpy(pointer, &host[0], host.size()*sizeof(T), 0, 0, m_device, omp_get_initial_device());
+  return pointer;
+}
+
+void DeviceStepper::release()
+{
+  for( std::vector<void*>::size_type a = 0; a < m_allocations.size(); ++a ) omp_target_free(m_allocations[a], m_device);
+  m_allocations.clear();
+  m_numparticles = -1;
+}
+
+bool DeviceStepper::readForces( const TwoDScene& scene, Forces& forces ) const
+{
+  forces.stiffness = forces.thickness = 0.0;
+  forces.gravity[0] = forces.gravity[1] = 0.0;
+  forces.drag[0] = forces.drag[1] = 0.0;
+
+  const std::vector<Force*>& sceneforces = scene.getForces();
+  bool penalty = false;
+  for( std::vector<Force*>::size_type f = 0; f < sceneforces.size(); ++f )
+  {
+    if( const PenaltyForce* contacts = dynamic_cast<const PenaltyForce*>(sceneforces[f]) )
+    {
+      if( penalty || dynamic_cast<const ContestDetector*>(&contacts->getDetector()) == NULL ) return false;
+      penalty = true;
+      forces.stiffness = contacts->getStiffness();
+      forces.thickness = contacts->getThickness();
+    }
+    else if( isType(sceneforces[f], GRAVITY_TYPE) )
+    {
+      const Vector2s gradE = probe(sceneforces[f], 0.0, 0.0);
+      forces.gravity[0] -= gradE.x();
+      forces.gravity[1] -= gradE.y();
+    }
+    else if( isType(sceneforces[f], DRAG_TYPE) )
+    {
+      forces.drag[0] += probe(sceneforces[f], 1.0, 0.0).x();
+      forces.drag[1] += probe(sceneforces[f], 0.0, 1.0).y();
+    }
+    else
+    {
+      return false;
+    }
+  }
+
+  // The device does not push back on edges, so their endpoints must not move.
+  for( int e = 0; e < scene.getNumEdges(); ++e )
+  {
+    if( !scene.isFixed(scene.getEdge(e).first) || !scene.isFixed(scene.getEdge(e).second) ) return false;
+  }
+  return true;
+}
+
+bool DeviceStepper::isCurrent( const TwoDScene& scene ) const
+{
+  const int n = scene.getNumParticles();
+  if( n != m_numparticles || scene.getNumEdges() != m_numedges || scene.getNumHalfplanes() != m_numhalfplanes ) return false;
+  if( !sameAs(m_x, scene.getX().data(), 2*n) || !sameAs(m_v, scene.getV().data(), 2*n) || !sameAs(m_m, scene.getM().data(), 2*n) ) return false;
+  if( n > 0 && !sameAs(m_radii, &scene.getRadii()[0], n) ) return false;
+  for( int i = 0; i < n; ++i )
+  {
+    if( m_fixed[i] != scene.isFixed(i) ) return false;
+  }
+  for( int e = 0; e < m_numedges; ++e )
+  {
+    if( m_edges[2*e] != scene.getEdge(e).first || m_edges[2*e + 1] != scene.getEdge(e).second || m_edgeradii[e] != scene.getEdgeRadii()[e] ) return false;
+  }
+  for( int h = 0; h < m_numhalfplanes; ++h )
+  {
+    const std::pair<VectorXs, VectorXs>& halfplane = scene.getHalfplane(h);
+    if( m_halfplanes[6*h] != halfplane.first(0) || m_halfplanes[6*h + 1] != halfplane.first(1) || m_halfplanes[6*h + 2] != halfplane.second(0) || m_halfplanes[6*h + 3] != halfplane.second(1) ) return false;
+  }
+  return true;
+}
+
+void DeviceStepper::upload( const TwoDScene& scene )
+{
+  release();
+  const int n = scene.getNumParticles();
+  m_numparticles = n;
+  m_numedges = scene.getNumEdges();
+  m_numhalfplanes = scene.getNumHalfplanes();
+
+  m_x.assign(scene.getX().data(), scene.getX().data() + 2*n);
+  m_v.assign(scene.getV().data(), scene.getV().data() + 2*n);
+  m_m.assign(scene.getM().data(), scene.getM().data() + 2*n);
+  m_radii = scene.getRadii();
+  m_fixed.resize(n);
+  for( int i = 0; i < n; ++i ) m_fixed[i] = scene.isFixed(i);
+  m_edges.resize(2*m_numedges);
+  m_edgeradii = scene.getEdgeRadii();
+  for( int e = 0; e < m_numedges; ++e )
+  {
+    m_edges[2*e] = scene.getEdge(e).first;
+    m_edges[2*e + 1] = scene.getEdge(e).second;
+  }
+  m_halfplanes.resize(6*m_numhalfplanes);
+  for( int h = 0; h < m_numhalfplanes; ++h )
+  {
+    const Vector2s px = scene.getHalfplane(h).first.segment<2>(0);
+    const Vector2s nh = scene.getHalfplane(h).second.segment<2>(0);
+    const Vector2s nhat = nh.normalized();
+    const scalar values[6] = { px.x(), px.y(), nh.x(), nh.y(), nhat.x(), nhat.y() };
+    std::copy(values, values + 6, &m_halfplanes[6*h]);
+  }
+
+  // Cells fit the particles up to twice the median radius, so that a few
+  // large ones do not coarsen the grid for all; the rest are tested by
+  // every particle.
+  std::vector<scalar> radii = m_radii;
+  scalar median = 0.0;
+  if( n > 0 )
+  {
+    std::nth_element(radii.begin(), radii.begin() + n/2, radii.end());
+    median = radii[n/2];
+  }
+  m_largestbinned = median > 0.0 ? 2.0*median : std::numeric_limits<scalar>::infinity();
+  std::vector<int> large;
+  scalar maxsmall = 0.0;
+  for( int i = 0; i < n; ++i )
+  {
+    if( m_radii[i] > m_largestbinned ) large.push_back(i);
+    else maxsmall = std::max(maxsmall, m_radii[i]);
+  }
+  m_numlarge = (int) large.size();
+  m_cellsize = maxsmall > 0.0 ? 2.0*maxsmall : 1.0;
+  m_numbuckets = std::max(2*( n - m_numlarge ), 1);
+  const int numblocks = ( m_numbuckets + SCAN_BLOCK - 1 )/SCAN_BLOCK;
+
+  d_x = allocateCopy(m_x);
+  d_v = allocateCopy(m_v);
+  d_m = allocateCopy(m_m);
+  d_radii = allocateCopy(m_radii);
+  d_fixed = allocateCopy(m_fixed);
+  d_edges = allocateCopy(m_edges);
+  d_edgeradii = allocateCopy(m_edgeradii);
+  d_halfplanes = allocateCopy(m_halfplanes);
+  d_large = allocateCopy(large);
+  d_F = (scalar*) allocate(2*n*sizeof(scalar));
+  d_cells = (int*) allocate(2*n*sizeof(int));
+  d_buckets = (int*) allocate(n*sizeof(int));
+  d_offsets = (int*) allocate(( m_numbuckets + 1 )*sizeof(int));
+  d_cursors = (int*) allocate(m_numbuckets*sizeof(int));
+  d_objects = (int*) allocate(n*sizeof(int));
+  d_blocksums = (int*) allocate(( numblocks + 1 )*sizeof(int));
+  d_binned = (scalar*) allocate(3*n*sizeof(scalar));
+  d_binnedcells = (int*) allocate(2*n*sizeof(int));
+}
+
+bool DeviceStepper::step( TwoDScene& scene, scalar dt )
+{
+  Forces forces;
+  if( !readForces(scene, forces) ) return false;
+  if( !isCurrent(scene) ) upload(scene);
+
+  const int n = m_numparticles;
+  const int nb = m_numbuckets;
+  const int numblocks = ( nb + SCAN_BLOCK - 1 )/SCAN_BLOCK;
+  const int numlarge = m_numlarge;
+  const int numedges = m_numedges;
+  const int numhalfplanes = m_numhalfplanes;
+  const scalar inverse = 1.0/m_cellsize;
+  const scalar halfcell = 0.5*m_cellsize;
+  const scalar largestbinned = m_largestbinned;
+  const scalar k = forces.stiffness;
+  const scalar thickness = forces.thickness;
+  const scalar gx = forces.gravity[0], gy = forces.gravity[1];
+  const scalar bx = forces.drag[0], by = forces.drag[1];
+
+  scalar* x = d_x;
+  scalar* v = d_v;
+  scalar* m = d_m;
+  scalar* radii = d_radii;
+  unsigned char* fixed = d_fixed;
+  int* edges = d_edges;
+  scalar* edgeradii = d_edgeradii;
+  scalar* halfplanes = d_halfplanes;
+  int* large = d_large;
+  scalar* F = d_F;
+  int* cells = d_cells;
+  int* buckets = d_buckets;
+  int* offsets = d_offsets;
+  int* cursors = d_cursors;
+  int* objects = d_objects;
+  int* blocksums = d_blocksums;
+  scalar* binned = d_binned;
+  int* binnedcells = d_binnedcells;
+
+  // Bins every particle but the large ones, whose bucket is -1.
+  #pragma omp target teams distribute parallel for is_device_ptr(offsets) device(m_device)
+  for( int b = 0; b <= nb; ++b ) offsets[b] = 0;
+
+  #pragma omp target teams distribute parallel for is_device_ptr(x, radii, cells, buckets, offsets) device(m_device)
+  for( int i = 0; i < n; ++i )
+  {
+    buckets[i] = -1;
+    if( radii[i] > largestbinned ) continue;
+    const int cx = (int) floor(x[2*i]*inverse);
+    const int cy = (int) floor(x[2*i + 1]*inverse);
+    cells[2*i] = cx;
+    cells[2*i + 1] = cy;
+    const unsigned int h = ( (unsigned int) cx*73856093u ) ^ ( (unsigned int) cy*19349663u );
+    const int b = (int) ( h % (unsigned int) nb );
+    buckets[i] = b;
+    #pragma omp atomic
+    offsets[b + 1] += 1;
+  }
+
+  // Inclusive scan of the counts in offsets[1..nb], a block per thread: the
+  // blocks' totals, their exclusive scan, then each block's own scan.
+  #pragma omp target teams distribute parallel for is_device_ptr(offsets, blocksums) device(m_device)
+  for( int block = 0; block < numblocks; ++block )
+  {
+    int sum = 0;
+    const int end = ( block + 1 )*SCAN_BLOCK < nb ? ( block + 1 )*SCAN_BLOCK : nb;
+    for( int b = block*SCAN_BLOCK; b < end; ++b ) sum += offsets[b + 1];
+    blocksums[block + 1] = sum;
+  }
+
+  #pragma omp target is_device_ptr(blocksums) device(m_device)
+  {
+    blocksums[0] = 0;
+    for( int block = 0; block < numblocks; ++block ) blocksums[block + 1] += blocksums[block];
+  }
+
+  #pragma omp target teams distribute parallel for is_device_ptr(offsets, cursors, blocksums) device(m_device)
+  for( int block = 0; block < numblocks; ++block )
+  {
+    int sum = blocksums[block];
+    const int end = ( block + 1 )*SCAN_BLOCK < nb ? ( block + 1 )*SCAN_BLOCK : nb;
+    for( int b = block*SCAN_BLOCK; b < end; ++b )
+    {
+      cursors[b] = sum;
+      sum += offsets[b + 1];
+      offsets[b + 1] = sum;
+    }
+  }
+
+  #pragma omp target teams distribute parallel for is_device_ptr(buckets, cursors, objects) device(m_device)
+  for( int i = 0; i < n; ++i )
+  {
+    const int b = buckets[i];
+    if( b < 0 ) continue;
+    int slot;
+    #pragma omp atomic capture
+    slot = cursors[b]++;
+    objects[slot] = i;
+  }
+
+  // The scatter fills each bucket in no particular order.
+  #pragma omp target teams distribute parallel for is_device_ptr(offsets, objects) device(m_device)
+  for( int b = 0; b < nb; ++b )
+  {
+    for( int s = offsets[b] + 1; s < offsets[b + 1]; ++s )
+    {
+      const int object = objects[s];
+      int t = s;
+      for( ; t > offsets[b] && objects[t - 1] > object; --t ) objects[t] = objects[t - 1];
+      objects[t] = object;
+    }
+  }
+
+  // The binned particles' x, y, radius and cell in bucket order, so that
+  // the contact search reads each bucket from contiguous memory.
+  #pragma omp target teams distribute parallel for is_device_ptr(x, radii, cells, objects, binned, binnedcells) device(m_device)
+  for( int s = 0; s < n - numlarge; ++s )
+  {
+    const int j = objects[s];
+    binned[3*s] = x[2*j];
+    binned[3*s + 1] = x[2*j + 1];
+    binned[3*s + 2] = radii[j];
+    binnedcells[2*s] = cells[2*j];
+    binnedcells[2*s + 1] = cells[2*j + 1];
+  }
+
+  // Forces on the free particles, each gathering its own contacts, with
+  // the penalty force's formulas with the signs of forces rather than
+  // gradients.
+  #pragma omp target teams distribute parallel for is_device_ptr(x, v, m, radii, fixed, edges, edgeradii, halfplanes, large, F, cells, offsets, objects, binned, binnedcells) device(m_device)
+  for( int i = 0; i < n; ++i )
+  {
+    if( fixed[i] ) continue;
+    const scalar xi = x[2*i], yi = x[2*i + 1];
+    const scalar ri = radii[i];
+    scalar fx = m[2*i]*gx - bx*v[2*i];
+    scalar fy = m[2*i + 1]*gy - by*v[2*i + 1];
+
+    const int xmin = (int) floor(( xi - ri - halfcell )*inverse);
+    const int xmax = (int) floor(( xi + ri + halfcell )*inverse);
+    const int ymin = (int) floor(( yi - ri - halfcell )*inverse);
+    const int ymax = (int) floor(( yi + ri + halfcell )*inverse);
+    for( int cx = xmin; cx <= xmax; ++cx )
+    {
+      for( int cy = ymin; cy <= ymax; ++cy )
+      {
+        const unsigned int h = ( (unsigned int) cx*73856093u ) ^ ( (unsigned int) cy*19349663u );
+        const int b = (int) ( h % (unsigned int) nb );
+        for( int s = offsets[b]; s < offsets[b + 1]; ++s )
+        {
+          if( objects[s] == i || binnedcells[2*s] != cx || binnedcells[2*s + 1] != cy ) continue;
+          const scalar reach = ri + binned[3*s + 2];
+          const scalar dx = binned[3*s] - xi, dy = binned[3*s + 1] - yi;
+          if( fabs(dx) > reach || fabs(dy) > reach ) continue;
+          const scalar len = sqrt(dx*dx + dy*dy);
+          if( !( len < reach + thickness ) || len < 1e-10 ) continue;
+          const scalar magnitude = k*( len - reach - thickness )/len;
+          fx += magnitude*dx;
+          fy += magnitude*dy;
+        }
+      }
+    }
+    for( int l = 0; l < numlarge; ++l )
+    {
+      const int j = large[l];
+      if( j == i ) continue;
+      const scalar reach = ri + radii[j];
+      const scalar dx = x[2*j] - xi, dy = x[2*j + 1] - yi;
+      if( fabs(dx) > reach || fabs(dy) > reach ) continue;
+      const scalar len = sqrt(dx*dx + dy*dy);
+      if( !( len < reach + thickness ) || len < 1e-10 ) continue;
+      const scalar magnitude = k*( len - reach - thickness )/len;
+      fx += magnitude*dx;
+      fy += magnitude*dy;
+    }
+
+    for( int e = 0; e < numedges; ++e )
+    {
+      const int a = edges[2*e], c = edges[2*e + 1];
+      if( a == i || c == i ) continue;
+      const scalar re = edgeradii[e];
+      const scalar ax = x[2*a], ay = x[2*a + 1], cxe = x[2*c], cye = x[2*c + 1];
+      if( xi + ri < ( ax < cxe ? ax : cxe ) - re || xi - ri > ( ax > cxe ? ax : cxe ) + re ) continue;
+      if( yi + ri < ( ay < cye ? ay : cye ) - re || yi - ri > ( ay > cye ? ay : cye ) + re ) continue;
+      const scalar ex = cxe - ax, ey = cye - ay;
+      scalar alpha = ( ( xi - ax )*ex + ( yi - ay )*ey )/( ex*ex + ey*ey );
+      if( alpha < 0.0 ) alpha = 0.0;
+      else if( alpha > 1.0 ) alpha = 1.0;
+      const scalar nx = ax + alpha*ex - xi, ny = ay + alpha*ey - yi;
+      const scalar len = sqrt(nx*nx + ny*ny);
+      if( len < 1e-10 || !( len < ri + re + thickness ) ) continue;
+      const scalar magnitude = k*( len - ri - re - thickness )/len;
+      fx += magnitude*nx;
+      fy += magnitude*ny;
+    }
+
+    for( int p = 0; p < numhalfplanes; ++p )
+    {
+      const scalar* plane = &halfplanes[6*p];
+      if( ( xi - plane[0] )*plane[4] + ( yi - plane[1] )*plane[5] > ri ) continue;
+      const scalar nn = plane[2]*plane[2] + plane[3]*plane[3];
+      const scalar t = ( ( plane[0] - xi )*plane[2] + ( plane[1] - yi )*plane[3] )/nn;
+      const scalar nx = t*plane[2], ny = t*plane[3];
+      const scalar len = sqrt(nx*nx + ny*ny);
+      if( len < 1e-10 || !( len < ri + thickness ) ) continue;
+      const scalar magnitude = k*( len - ri - thickness )*( nx/len*plane[2] + ny/len*plane[3] )/nn;
+      fx += magnitude*plane[2];
+      fy += magnitude*plane[3];
+    }
+
+    F[2*i] = fx;
+    F[2*i + 1] = fy;
+  }
+
+  #pragma omp target teams distribute parallel for is_device_ptr(x, v, m, fixed, F) device(m_device)
+  for( int i = 0; i < n; ++i )
+  {
+    if( fixed[i] ) continue;
+    for( int d = 0; d < 2; ++d )
+    {
+      v[2*i + d] += dt*F[2*i + d]/m[2*i + d];
+      x[2*i + d] += dt*v[2*i + d];
+    }
+  }
+
+  if( n > 0 )
+  {
+    const int host = omp_get_initial_device();
+    omp_target_memcpy(&m_x[0], x, 2*n*sizeof(scalar), 0, 0, host, m_device);
+    omp_target_memcpy(&m_v[0], v, 2*n*sizeof(scalar), 0, 0, host, m_device);
+    std::copy(m_x.begin(), m_x.end(), scene.getX().data());
+    std::copy(m_v.begin(), m_v.end(), scene.getV().data());
+  }
+  return true;
+}
+
+#endif
@@ -0,0 +1,125 @@
+#ifndef __DEVICE_STEPPER_H__
+#define __DEVICE_STEPPER_H__
+
+#include <vector>
+
+#include "MathDefs.h"
+#include "TwoDScene.h"
+
+// Forward-backward Euler steps on an OpenMP offload device, such as a GPU,
+// used by SemiImplicitEuler when built with USE_OPENMP_OFFLOAD. Without a
+// device the same kernels run on the host's threads.
+//
+// The device holds the scene's particles, edges and halfplanes from step to
+// step, and each step
+//
+//   - bins the particles into a spatial hash grid, as the contest detector
+//     does, with a counting sort and each bucket then sorted by index, so
+//     that every run sums each particle's forces in the same order;
+//   - sums the penalty, gravity and drag forces on each free particle, every
+//     particle gathering its own contacts rather than scattering to both;
+//   - integrates the free particles.
+//
+// Only x and v come back, after every step, as the base library's loop
+// reads them for display and output. Before each step the scene is compared
+// with what the device holds, and uploaded again if anything has changed
+// it, such as a collision handler or a new scene.
+//
+// Particles whose radius is more than twice the median, such as the corners
+// of a box, are not binned; every particle is tested against each of them
+// instead, and each of them queries the grid over its whole box.
+//
+// Contacts are the contest detector's candidates, pairs whose boxes overlap,
+// that are within the penalty thickness of touching, so forces agree with
+// the host's to rounding. A scene is stepped on the device only if its
+// forces are one penalty force using the contest detector, the base
+// library's gravity and drag, and nothing else, and every edge joins fixed
+// particles, as the walls of the timing scenes do. Each particle is tested
+// against every edge and halfplane. Any other scene is stepped on the host.
+class DeviceStepper
+{
+public:
+  DeviceStepper();
+  ~DeviceStepper();
+
+  // Takes a step of dt on the device and returns true, or returns false
+  // without changing the scene if the device cannot step it.
+  bool step( TwoDScene& scene, scalar dt );
+
+private:
+  DeviceStepper( const DeviceStepper& );
+  DeviceStepper& operator=( const DeviceStepper& );
+
+  struct Forces
+  {
+    scalar stiffness;
+    scalar thickness;
+    scalar gravity[2];
+    scalar drag[2];
+  };
+
+  // Reads the constants of the scene's forces. Returns false if the scene
+  // has a force or an edge the device does not handle.
+  bool readForces( const TwoDScene& scene, Forces& forces ) const;
+
+  // True if the device's copy of the scene is still the scene.
+  bool isCurrent( const TwoDScene& scene ) const;
+
+  void upload( const TwoDScene& scene );
+
+  void release();
+
+  // Device allocations, by omp_target_alloc.
+  void* allocate( std::size_t bytes );
+
+  template<class T>
+  T* allocateCopy( const std::vector<T>& host );
+
+  int m_device;
+  int m_numparticles;
+  int m_numbuckets;
+  scalar m_cellsize;
+  // Particles of larger radius are not binned.
+  scalar m_largestbinned;
+
+  // What was uploaded or last came back, to tell whether the scene changed.
+  std::vector<scalar> m_x;
+  std::vector<scalar> m_v;
+  std::vector<scalar> m_m;
+  std::vector<scalar> m_radii;
+  std::vector<unsigned char> m_fixed;
+  std::vector<int> m_edges;
+  std::vector<scalar> m_edgeradii;
+  std::vector<scalar> m_halfplanes;
+
+  std::vector<void*> m_allocations;
+
+  // On the device.
+  scalar* d_x;
+  scalar* d_v;
+  scalar* d_m;
+  scalar* d_radii;
+  unsigned char* d_fixed;
+  int* d_edges;
+  scalar* d_edgeradii;
+  // px py nx ny ux uy, the normal n as the scene has it and u = n/|n|.
+  scalar* d_halfplanes;
+  int* d_large;
+  int m_numlarge;
+  int m_numedges;
+  int m_numhalfplanes;
+  scalar* d_F;
+  // Each binned particle's cell and bucket, the buckets' counts and
+  // offsets, the binned particles by bucket, and partial sums for the scan.
+  int* d_cells;
+  int* d_buckets;
+  int* d_offsets;
+  int* d_cursors;
+  int* d_objects;
+  int* d_blocksums;
+  // x y radius and the cell of each binned particle, in bucket order.
+  scalar* d_binned;
+  int* d_binnedcells;
+};
+
+#endif
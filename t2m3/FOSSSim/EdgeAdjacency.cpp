@@ -0,0 +1,48 @@
+#include "EdgeAdjacency.h"
+#include "TwoDScene.h"
+
+EdgeAdjacency::EdgeAdjacency()
+: m_nparticles(0)
+, m_valid(false)
+, m_edges()
+, m_offsets(1, 0)
+, m_incident(1, -1)
+{}
+
+bool EdgeAdjacency::update( const TwoDScene& scene )
+{
+  if( m_valid && m_nparticles == scene.getNumParticles() && m_edges == scene.getEdges() ) return false;
+  m_nparticles = scene.getNumParticles();
+  m_edges = scene.getEdges();
+  build();
+  return true;
+}
+
+void EdgeAdjacency::invalidate()
+{
+  m_valid = false;
+}
+
+void EdgeAdjacency::build()
+{
+  // Count, prefix sum, then fill; edges are visited in order, so each row
+  // comes out sorted.
+  m_offsets.assign( m_nparticles+1, 0 );
+  const int nedges = (int) m_edges.size();
+  for( int e = 0; e < nedges; ++e )
+  {
+    ++m_offsets[m_edges[e].first+1];
+    if( m_edges[e].second != m_edges[e].first ) ++m_offsets[m_edges[e].second+1];
+  }
+  for( int i = 0; i < m_nparticles; ++i ) m_offsets[i+1] += m_offsets[i];
+
+  // One spare entry keeps edges() valid for a scene without edges.
+  m_incident.assign( m_offsets[m_nparticles] + 1, -1 );
+  std::vector<int> next( m_offsets.begin(), m_offsets.end()-1 );
+  for( int e = 0; e < nedges; ++e )
+  {
+    m_incident[next[m_edges[e].first]++] = e;
+    if( m_edges[e].second != m_edges[e].first ) m_incident[next[m_edges[e].second]++] = e;
+  }
+  m_valid = true;
+}
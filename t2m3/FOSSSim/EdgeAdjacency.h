@@ -0,0 +1,59 @@
+#ifndef __EDGE_ADJACENCY_H__
+#define __EDGE_ADJACENCY_H__
+
+#include <utility>
+#include <vector>
+
+class TwoDScene;
+
+// The edges incident to each particle of a scene, in compressed rows: the
+// edges of particle i are edges(i)[0], ..., edges(i)[degree(i)-1], in
+// increasing order. TwoDScene only keeps the list of edges, so without this
+// finding the edges at a particle means scanning all of them.
+//
+// TwoDScene is compiled into the base library, so insertEdge and clearEdges
+// cannot invalidate anything. Instead the adjacency keeps a copy of the edge
+// list it was built from, and update() rebuilds it only if the scene's list
+// differs, which costs one comparison of the lists.
+class EdgeAdjacency
+{
+public:
+  EdgeAdjacency();
+
+  // Rebuilds from the scene's edges if they or the number of particles
+  // changed since the last update. Returns true if it rebuilt.
+  bool update( const TwoDScene& scene );
+
+  // Forces the next update to rebuild.
+  void invalidate();
+
+  int getNumParticles() const { return m_nparticles; }
+  int getNumEdges() const { return (int) m_edges.size(); }
+
+  const std::pair<int,int>& getEdge( int edge ) const { return m_edges[edge]; }
+
+  int degree( int particle ) const { return m_offsets[particle+1] - m_offsets[particle]; }
+  const int* edges( int particle ) const { return &m_incident[0] + m_offsets[particle]; }
+
+  // The endpoint of the edge other than the particle, which must be one.
+  int opposite( int edge, int particle ) const
+  {
+    return m_edges[edge].first == particle ? m_edges[edge].second : m_edges[edge].first;
+  }
+
+  bool isEndpoint( int particle, int edge ) const
+  {
+    return m_edges[edge].first == particle || m_edges[edge].second == particle;
+  }
+
+private:
+  void build();
+
+  int m_nparticles;
+  bool m_valid;
+  std::vector<std::pair<int,int> > m_edges;
+  std::vector<int> m_offsets;
+  std::vector<int> m_incident;
+};
+
+#endif
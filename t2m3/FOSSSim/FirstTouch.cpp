@@ -0,0 +1,88 @@
+#include "FirstTouch.h"
+
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+#ifdef HUGE_PAGE_ARRAYS
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#include "TaskPool.h"
+
+namespace
+{
+
+// Per scene, the storage the last call left its positions, velocities and
+// masses in. A reallocation that happens to get the same address back is
+// missed, which only costs its placement. Scenes rarely number more than one,
+// so the list is searched in order.
+struct Placed
+{
+  const TwoDScene* scene;
+  const scalar* arrays[3];
+};
+std::vector<Placed> g_placed;
+
+#ifdef HUGE_PAGE_ARRAYS
+// Advises the whole pages within [ data, data + bytes ) onto huge pages. A
+// kernel without transparent huge pages refuses, which leaves them as they
+// were.
+void adviseHugePages( void* data, std::size_t bytes )
+{
+  const std::size_t page = (std::size_t) sysconf(_SC_PAGESIZE);
+  const std::size_t begin = ( (std::size_t) data + page - 1 )/page*page;
+  const std::size_t end = ( (std::size_t) data + bytes )/page*page;
+  if( end > begin ) madvise((void*) begin, end - begin, MADV_HUGEPAGE);
+}
+#endif
+
+// Moves array into a fresh allocation first written by the pool's threads.
+void place( VectorXs& array )
+{
+  const int size = (int) array.size();
+  // Resizing a new vector allocates without writing; large allocations are
+  // fresh pages of their own.
+  VectorXs fresh;
+  fresh.resize(size);
+#ifdef HUGE_PAGE_ARRAYS
+  adviseHugePages(fresh.data(), size*sizeof(scalar));
+#endif
+  TaskPool& pool = TaskPool::shared();
+  const int nthreads = std::max(pool.getNumThreads(), 1);
+  const int grain = TaskPool::grainSize("scene.firsttouch", std::max(( size + nthreads - 1 )/nthreads, 1));
+  const scalar* from = array.data();
+  scalar* to = fresh.data();
+  pool.parallelFor(0, size, grain, [&]( int lo, int hi )
+  {
+    std::copy(from + lo, from + hi, to + lo);
+  } );
+  array.swap(fresh);
+}
+
+}
+
+namespace firsttouch
+{
+
+void placeSceneArrays( TwoDScene& scene )
+{
+  std::vector<Placed>::size_type k = 0;
+  while( k < g_placed.size() && g_placed[k].scene != &scene ) ++k;
+  if( k == g_placed.size() )
+  {
+    const Placed none = { &scene, { NULL, NULL, NULL } };
+    g_placed.push_back(none);
+  }
+
+  VectorXs* arrays[3] = { &scene.getX(), &scene.getV(), &scene.getM() };
+  for( int a = 0; a < 3; ++a )
+  {
+    if( arrays[a]->data() == g_placed[k].arrays[a] ) continue;
+    place(*arrays[a]);
+    g_placed[k].arrays[a] = arrays[a]->data();
+  }
+}
+
+}
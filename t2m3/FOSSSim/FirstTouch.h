@@ -0,0 +1,32 @@
+#ifndef __FIRST_TOUCH_H__
+#define __FIRST_TOUCH_H__
+
+#include "TwoDScene.h"
+
+// Spreads the pages of the scene's positions, velocities and masses over the
+// NUMA nodes of the threads that work on them, built with
+// PARALLEL_FIRST_TOUCH. Linux places a page on the node of the thread that
+// first writes it, and TwoDScene, compiled into the base library, allocates
+// and zeroes its arrays on the main thread, so on a machine of several
+// sockets every page lands on the main thread's and the other sockets'
+// threads read them at a fraction of the bandwidth. placeSceneArrays moves
+// each array into a fresh allocation, whose pages no thread has written yet,
+// and copies it over in as many contiguous blocks as the task pool has
+// threads, one block per task. The pool steals work rather than fixing which
+// thread takes which block, and does not pin its threads, so the placement
+// follows the parallel loops' partitioning only roughly; it is still far
+// better than every page on one node.
+//
+// Built with HUGE_PAGE_ARRAYS too, the fresh allocations are also advised
+// onto transparent huge pages before they are written, which saves the TLB
+// misses of walking large arrays.
+namespace firsttouch
+{
+  // Re-places the arrays unless they are where the last call put them.
+  // Cheap when they are. Called by the steppers at the start of each step,
+  // so that arrays the base library or a ParticlePool reallocated are placed
+  // again, and never while the arrays are being read or written.
+  void placeSceneArrays( TwoDScene& scene );
+}
+
+#endif
@@ -0,0 +1,49 @@
+#ifndef HIERARCHICAL_GRID_DETECTOR_H
+#define HIERARCHICAL_GRID_DETECTOR_H
+
+#include "CollisionDetector.h"
+#include "BroadPhase.h"
+#include "EdgeAdjacency.h"
+#include <vector>
+
+// Broad phase over a hierarchy of uniform grids, each with cells twice the
+// size of the one below, stored together in one spatial hash. Every particle
+// and edge goes into the finest level whose cells are at least as large as
+// its box, so it covers at most two cells a side whatever its radius: a wall
+// of radius 0.5 among particles of radius 0.02 occupies a few coarse cells
+// instead of hundreds of fine ones. Each object then looks for candidates in
+// the cells its box covers at its own level and every coarser one. Boxes are
+// swept between qs and qe.
+class HierarchicalGridDetector : public CollisionDetector
+{
+ public:
+  HierarchicalGridDetector();
+
+  virtual void performCollisionDetection(const TwoDScene &scene, const VectorXs &qs, const VectorXs &qe, DetectionCallback &dc);
+
+  void findCollidingPairs(const TwoDScene &scene, const VectorXs &qs, const VectorXs &qe, PPList &pppairs, PEList &pepairs, PHList &phpairs);
+
+  // Cells occupied by all objects in the last call, counting an object once
+  // per cell it covers.
+  int getNumEntries() const { return (int) m_objects.size(); }
+
+ private:
+  void cellRange( const AABB& box, int level, int& xmin, int& ymin, int& xmax, int& ymax ) const;
+
+  int bucket( int level, int i, int j ) const;
+
+  // Object ids as in SweepAndPruneDetector: particles are [0, nparticles),
+  // edge e is nparticles+e.
+  std::vector<AABB> m_boxes;
+  std::vector<int> m_levels;
+  // Size of the finest level's cells.
+  scalar m_cellsize;
+  // Bit l set if level l holds any object.
+  unsigned m_occupied;
+  // Bucket b holds m_objects[m_offsets[b]] up to m_objects[m_offsets[b+1]].
+  std::vector<int> m_offsets;
+  std::vector<int> m_objects;
+  EdgeAdjacency m_adjacency;
+};
+
+#endif
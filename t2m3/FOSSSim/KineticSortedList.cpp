@@ -0,0 +1,123 @@
+#include "KineticSortedList.h"
+
+#include <algorithm>
+#include <cassert>
+
+namespace
+{
+
+struct ValueLess
+{
+  const std::vector<scalar>& values;
+  const std::vector<char>& tiers;
+
+  ValueLess( const std::vector<scalar>& v, const std::vector<char>& t ) : values(v), tiers(t) {}
+
+  bool operator()( int a, int b ) const
+  {
+    if( values[a] != values[b] ) return values[a] < values[b];
+    if( tiers[a] != tiers[b] ) return tiers[a] < tiers[b];
+    return a < b;
+  }
+};
+
+}
+
+KineticSortedList::KineticSortedList()
+: m_order()
+, m_rank()
+, m_value()
+, m_tier()
+, m_velocity()
+, m_heap()
+{}
+
+void KineticSortedList::reset( const std::vector<scalar>& values, const std::vector<char>& tiers )
+{
+  assert( values.size() == tiers.size() );
+  const int n = (int) values.size();
+  m_value = values;
+  m_tier = tiers;
+  m_order.resize( n );
+  for( int k = 0; k < n; ++k ) m_order[k] = k;
+  std::sort( m_order.begin(), m_order.end(), ValueLess( m_value, m_tier ) );
+  m_rank.resize( n );
+  for( int p = 0; p < n; ++p ) m_rank[m_order[p]] = p;
+}
+
+int KineticSortedList::update( const std::vector<scalar>& values, SwapCallback& callback )
+{
+  const int n = size();
+  assert( (int) values.size() == n );
+  m_velocity.resize( n );
+  for( int k = 0; k < n; ++k ) m_velocity[k] = values[k] - m_value[k];
+
+  m_heap.clear();
+  for( int p = 0; p+1 < n; ++p ) schedule( p, 0.0 );
+
+  int swaps = 0;
+  while( !m_heap.empty() )
+  {
+    std::pop_heap( m_heap.begin(), m_heap.end(), Later() );
+    const Certificate c = m_heap.back();
+    m_heap.pop_back();
+    // Stale once either key has swapped with another since.
+    if( m_order[c.position] != c.first || m_order[c.position+1] != c.second ) continue;
+    swap( c.position, callback );
+    ++swaps;
+    if( c.position > 0 ) schedule( c.position-1, c.time );
+    if( c.position+2 < n ) schedule( c.position+1, c.time );
+  }
+
+  m_value = values;
+
+  // The swap times are rounded, so keys that meet within rounding of each
+  // other may be left out of order; a last insertion pass puts them right.
+  for( int p = 1; p < n; ++p )
+    for( int q = p; q > 0 && before( m_order[q], m_order[q-1] ); --q )
+    {
+      swap( q-1, callback );
+      ++swaps;
+    }
+
+  return swaps;
+}
+
+void KineticSortedList::schedule( int position, scalar after )
+{
+  const int a = m_order[position];
+  const int b = m_order[position+1];
+  // a only overtakes b if it moves right faster.
+  if( m_velocity[a] <= m_velocity[b] ) return;
+  scalar time = ( m_value[b] - m_value[a] ) / ( m_velocity[a] - m_velocity[b] );
+  if( time < after ) time = after;
+  // Meeting at the end of the update only swaps keys whose tiers say so.
+  if( time > 1.0 || ( time == 1.0 && m_tier[a] <= m_tier[b] ) ) return;
+
+  Certificate c;
+  c.time = time;
+  c.position = position;
+  c.first = a;
+  c.second = b;
+  m_heap.push_back( c );
+  std::push_heap( m_heap.begin(), m_heap.end(), Later() );
+}
+
+void KineticSortedList::swap( int position, SwapCallback& callback )
+{
+  const int a = m_order[position];
+  const int b = m_order[position+1];
+  m_order[position] = b;
+  m_order[position+1] = a;
+  m_rank[b] = position;
+  m_rank[a] = position+1;
+  callback.swapped( a, b );
+}
+
+// Whether key a belongs before key b at the current values. Keys of equal
+// value and tier keep their order.
+bool KineticSortedList::before( int a, int b ) const
+{
+  if( m_value[a] != m_value[b] ) return m_value[a] < m_value[b];
+  return m_tier[a] < m_tier[b];
+}
@@ -0,0 +1,85 @@
+#ifndef KINETIC_SORTED_LIST_H
+#define KINETIC_SORTED_LIST_H
+
+#include "MathDefs.h"
+#include <vector>
+
+// A list of keys kept sorted by value as the values move. Between updates
+// every key moves linearly from its old value to its new one, so two
+// neighbours in the list change places at most once, at a time that is known
+// in advance. The times of the neighbours about to change places are kept in
+// a heap and the swaps are made in time order; after each swap only the two
+// new neighbour pairs need a time. An update therefore costs a pass over the
+// keys to read their motion and a heap operation per swap, where re-sorting
+// would compare every key however little it moved.
+//
+// Keys with equal values are ordered by a tier given per key, lower first,
+// and then stay in whatever order they reached them.
+class KineticSortedList
+{
+ public:
+  // Is told of every swap as it is made: key passing was just before key
+  // passed and is now just after it.
+  class SwapCallback
+  {
+   public:
+    virtual ~SwapCallback() {}
+
+    virtual void swapped( int passing, int passed ) = 0;
+  };
+
+  KineticSortedList();
+
+  // Sorts the keys 0..values.size()-1 from scratch, with no swaps reported.
+  void reset( const std::vector<scalar>& values, const std::vector<char>& tiers );
+
+  // Moves every key to its new value, reporting the swaps in time order.
+  // There must be a value for every key. Returns the number of swaps.
+  int update( const std::vector<scalar>& values, SwapCallback& callback );
+
+  int size() const { return (int) m_order.size(); }
+
+  // The keys in sorted order, and the position of each key in it.
+  const std::vector<int>& order() const { return m_order; }
+  int rank( int key ) const { return m_rank[key]; }
+
+  scalar value( int key ) const { return m_value[key]; }
+
+ private:
+  // The time at which the keys at position and position+1 swap.
+  struct Certificate
+  {
+    scalar time;
+    int position;
+    int first;
+    int second;
+  };
+
+  struct Later
+  {
+    bool operator()( const Certificate& a, const Certificate& b ) const
+    {
+      if( a.time != b.time ) return a.time > b.time;
+      return a.position > b.position;
+    }
+  };
+
+  // Schedules the swap of the keys at position and position+1, if they swap
+  // between time after and the end of the update.
+  void schedule( int position, scalar after );
+
+  void swap( int position, SwapCallback& callback );
+
+  bool before( int a, int b ) const;
+
+  std::vector<int> m_order;
+  std::vector<int> m_rank;
+  std::vector<scalar> m_value;
+  std::vector<char> m_tier;
+
+  // Motion during an update: key k is at m_value[k] + t*m_velocity[k].
+  std::vector<scalar> m_velocity;
+  std::vector<Certificate> m_heap;
+};
+
+#endif
@@ -0,0 +1,118 @@
+#include "KineticSweepAndPruneDetector.h"
+#include "TwoDScene.h"
+#include <algorithm>
+
+KineticSweepAndPruneDetector::KineticSweepAndPruneDetector()
+: m_nparticles(-1)
+, m_boxes()
+, m_keys()
+, m_list()
+, m_overlaps()
+, m_swaps(0)
+, m_adjacency()
+{}
+
+void KineticSweepAndPruneDetector::performCollisionDetection(const TwoDScene &scene, const VectorXs &qs, const VectorXs &qe, DetectionCallback &dc)
+{
+  PPList pppairs;
+  PEList pepairs;
+  PHList phpairs;
+
+  findCollidingPairs(scene, qs, qe, pppairs, pepairs, phpairs);
+  broadphase::reportPairs(scene, pppairs, pepairs, phpairs, dc);
+}
+
+void KineticSweepAndPruneDetector::findCollidingPairs(const TwoDScene &scene, const VectorXs &qs, const VectorXs &qe, PPList &pppairs, PEList &pepairs, PHList &phpairs)
+{
+  const int nparticles = scene.getNumParticles();
+  const int nedges = scene.getNumEdges();
+  const int nobjects = nparticles + nedges;
+
+  m_boxes.resize( nobjects );
+  for( int i = 0; i < nparticles; ++i ) m_boxes[i] = broadphase::particleBox( qs, qe, i, scene.getRadius(i) );
+  for( int e = 0; e < nedges; ++e ) m_boxes[nparticles+e] = broadphase::edgeBox( qs, qe, scene.getEdge(e), scene.getEdgeRadii()[e] );
+  m_keys.resize( 2*nobjects );
+  for( int o = 0; o < nobjects; ++o )
+  {
+    m_keys[2*o] = m_boxes[o].min.x();
+    m_keys[2*o+1] = m_boxes[o].max.x();
+  }
+
+  if( nparticles != m_nparticles || m_list.size() != 2*nobjects )
+  {
+    // Topology changed (or first call): sort and sweep from scratch.
+    rebuild( nparticles );
+  }
+  else
+  {
+    OverlapTracker tracker( *this );
+    m_swaps = m_list.update( m_keys, tracker );
+  }
+
+  for( std::set<std::pair<int,int> >::const_iterator it = m_overlaps.begin(); it != m_overlaps.end(); ++it )
+  {
+    const int a = it->first;
+    const int b = it->second;
+    if( !m_boxes[a].overlaps( m_boxes[b] ) ) continue;
+    if( b < nparticles ) pppairs.push_back( *it );
+    else if( a < nparticles ) pepairs.push_back( std::make_pair( a, b-nparticles ) );
+  }
+
+  broadphase::findHalfplanePairs( scene, qs, qe, phpairs );
+
+  // The set holds each pair once, in order of object id; particle-edge
+  // pairs are sorted by particle instead.
+  broadphase::sortUnique( pepairs );
+  m_adjacency.update( scene );
+  broadphase::excludeNeighbours( m_adjacency, broadphase::exclusionRings(), pepairs );
+}
+
+void KineticSweepAndPruneDetector::rebuild( int nparticles )
+{
+  m_nparticles = nparticles;
+  m_swaps = 0;
+  std::vector<char> tiers( m_keys.size() );
+  for( std::vector<char>::size_type k = 0; k < tiers.size(); ++k ) tiers[k] = k % 2;
+  m_list.reset( m_keys, tiers );
+
+  // Objects whose lower end has been passed and upper end not yet, in a
+  // vector with each object's slot so that removal is constant time.
+  m_overlaps.clear();
+  std::vector<int> active;
+  std::vector<int> slot( m_keys.size()/2, -1 );
+  const std::vector<int>& order = m_list.order();
+  for( std::vector<int>::size_type p = 0; p < order.size(); ++p )
+  {
+    const int object = order[p]/2;
+    if( order[p] % 2 == 1 )
+    {
+      const int last = active.back();
+      active[slot[object]] = last;
+      slot[last] = slot[object];
+      active.pop_back();
+      continue;
+    }
+    for( std::vector<int>::size_type k = 0; k < active.size(); ++k )
+    {
+      const int other = active[k];
+      if( object >= nparticles && other >= nparticles ) continue;
+      m_overlaps.insert( std::make_pair( std::min(object, other), std::max(object, other) ) );
+    }
+    slot[object] = (int) active.size();
+    active.push_back( object );
+  }
+}
+
+void KineticSweepAndPruneDetector::OverlapTracker::swapped( int passing, int passed )
+{
+  const int a = passing/2;
+  const int b = passed/2;
+  if( a == b ) return;
+  const int nparticles = m_detector.m_nparticles;
+  if( a >= nparticles && b >= nparticles ) return;
+  const std::pair<int,int> pair( std::min(a,b), std::max(a,b) );
+  // An upper end passing a lower end starts an overlap, a lower end passing
+  // an upper end ends one; two ends of the same kind change nothing.
+  if( passing % 2 == 1 && passed % 2 == 0 ) m_detector.m_overlaps.insert( pair );
+  else if( passing % 2 == 0 && passed % 2 == 1 ) m_detector.m_overlaps.erase( pair );
+}
@@ -0,0 +1,59 @@
+#ifndef KINETIC_SWEEP_AND_PRUNE_DETECTOR_H
+#define KINETIC_SWEEP_AND_PRUNE_DETECTOR_H
+
+#include "CollisionDetector.h"
+#include "BroadPhase.h"
+#include "KineticSortedList.h"
+#include "EdgeAdjacency.h"
+#include <set>
+#include <vector>
+
+// Sweep and prune along the x axis that keeps the pairs overlapping in x
+// from call to call. The ends of every box's x extent are the keys of a
+// KineticSortedList; a pair starts overlapping in x when the upper end of one
+// box passes the lower end of the other, and stops when a lower end passes
+// an upper end, so the set of pairs changes only where the order does. A
+// call then costs a pass to recompute the boxes, one step per swap and a
+// box test per overlapping pair, rather than a sweep over every object.
+// Like SweepAndPruneDetector, the boxes are swept between qs and qe.
+class KineticSweepAndPruneDetector : public CollisionDetector
+{
+ public:
+  KineticSweepAndPruneDetector();
+
+  virtual void performCollisionDetection(const TwoDScene &scene, const VectorXs &qs, const VectorXs &qe, DetectionCallback &dc);
+
+  void findCollidingPairs(const TwoDScene &scene, const VectorXs &qs, const VectorXs &qe, PPList &pppairs, PEList &pepairs, PHList &phpairs);
+
+  // Swaps made by the last call, 0 if it had to sort from scratch.
+  int getNumSwaps() const { return m_swaps; }
+
+ private:
+  // Keeps m_overlaps up to date as the list swaps keys.
+  class OverlapTracker : public KineticSortedList::SwapCallback
+  {
+   public:
+    OverlapTracker( KineticSweepAndPruneDetector& detector ) : m_detector(detector) {}
+
+    virtual void swapped( int passing, int passed );
+
+   private:
+    KineticSweepAndPruneDetector& m_detector;
+  };
+
+  void rebuild( int nparticles );
+
+  // Object ids as in SweepAndPruneDetector: particles are [0, nparticles),
+  // edge e is nparticles+e. Object o's lower x is key 2*o, its upper 2*o+1.
+  int m_nparticles;
+  std::vector<AABB> m_boxes;
+  std::vector<scalar> m_keys;
+  KineticSortedList m_list;
+  // Pairs of objects, lower id first, whose x extents overlap, except pairs
+  // of two edges.
+  std::set<std::pair<int,int> > m_overlaps;
+  int m_swaps;
+  EdgeAdjacency m_adjacency;
+};
+
+#endif
@@ -0,0 +1,64 @@
+#include "LockstepComparison.h"
+
+LockstepComparison::LockstepComparison( const TwoDScene& scene, SceneAdvancer& reference, SceneAdvancer& candidate )
+: m_reference_scene(scene)
+, m_candidate_scene(scene)
+, m_reference(reference)
+, m_candidate(candidate)
+, m_grader()
+, m_steps(0)
+, m_counts_match(true)
+{}
+
+bool LockstepComparison::step( scalar dt )
+{
+  m_reference.advance(m_reference_scene, dt);
+  m_candidate.advance(m_candidate_scene, dt);
+  ++m_steps;
+
+  // The grader walks the reference's particles through both scenes.
+  if( m_reference_scene.getNumParticles() != m_candidate_scene.getNumParticles() )
+  {
+    m_counts_match = false;
+    return false;
+  }
+  m_grader.addToAccumulatedResidual(m_reference_scene, m_candidate_scene);
+  return passed();
+}
+
+bool LockstepComparison::run( scalar dt, int numsteps )
+{
+  for( int i = 0; i < numsteps && passed(); ++i ) step(dt);
+  return passed();
+}
+
+bool LockstepComparison::passed() const
+{
+  return m_counts_match && m_grader.accumulatedPositionResidualPassed() && m_grader.accumulatedVelocityResidualPassed() &&
+         m_grader.maxPositionResidualPassed() && m_grader.maxVelocityResidualPassed() && m_grader.collisionsPassed();
+}
+
+int LockstepComparison::getNumSteps() const
+{
+  return m_steps;
+}
+
+const TwoDScene& LockstepComparison::getReferenceScene() const
+{
+  return m_reference_scene;
+}
+
+const TwoDScene& LockstepComparison::getCandidateScene() const
+{
+  return m_candidate_scene;
+}
+
+TwoDSceneGrader& LockstepComparison::getGrader()
+{
+  return m_grader;
+}
+
+const TwoDSceneGrader& LockstepComparison::getGrader() const
+{
+  return m_grader;
+}
@@ -0,0 +1,59 @@
+#ifndef LOCKSTEP_COMPARISON_H
+#define LOCKSTEP_COMPARISON_H
+
+#include "TwoDScene.h"
+#include "TwoDSceneGrader.h"
+
+// One way of advancing a scene by a time step: a stepper followed by a
+// collision handler and detector, say.
+class SceneAdvancer
+{
+public:
+  virtual ~SceneAdvancer() {}
+
+  virtual void advance( TwoDScene& scene, scalar dt ) = 0;
+};
+
+// Grades a candidate against a reference inside one process. Both advance
+// their own copy of the same scene, and every step the two copies go through
+// a TwoDSceneGrader as the oracle's would, so there is no trajectory to write
+// out and read back. Residuals only accumulate, so the first step that fails
+// decides the run, and run() stops there.
+class LockstepComparison
+{
+public:
+  LockstepComparison( const TwoDScene& scene, SceneAdvancer& reference, SceneAdvancer& candidate );
+
+  // Advances both scenes by dt and grades the result. Returns passed().
+  bool step( scalar dt );
+
+  // Steps until numsteps steps have been taken or one fails. Returns passed().
+  bool run( scalar dt, int numsteps );
+
+  // Every residual is within its threshold, the collisions matched and the
+  // particle counts agree.
+  bool passed() const;
+
+  int getNumSteps() const;
+
+  const TwoDScene& getReferenceScene() const;
+  const TwoDScene& getCandidateScene() const;
+
+  // Advancers that compare their collisions flag mismatches through this.
+  TwoDSceneGrader& getGrader();
+  const TwoDSceneGrader& getGrader() const;
+
+private:
+  LockstepComparison( const LockstepComparison& );
+  LockstepComparison& operator=( const LockstepComparison& );
+
+  TwoDScene m_reference_scene;
+  TwoDScene m_candidate_scene;
+  SceneAdvancer& m_reference;
+  SceneAdvancer& m_candidate;
+  TwoDSceneGrader m_grader;
+  int m_steps;
+  bool m_counts_match;
+};
+
+#endif
@@ -0,0 +1,67 @@
+#ifndef __MAPPED_FILE_H__
+#define __MAPPED_FILE_H__
+
+#include <cstddef>
+#include <string>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// A file mapped read-only into memory, so that its readers take what they
+// need of it straight from the page cache rather than copying it through a
+// stream's buffer. An empty file maps to no data at all.
+class MappedFile
+{
+public:
+  MappedFile()
+  : m_data(NULL)
+  , m_size(0)
+  {}
+
+  ~MappedFile()
+  {
+    close();
+  }
+
+  bool open( const std::string& filename )
+  {
+    close();
+    const int fd = ::open(filename.c_str(), O_RDONLY);
+    if( fd < 0 ) return false;
+    struct stat status;
+    bool ok = fstat(fd, &status) == 0;
+    if( ok && status.st_size > 0 )
+    {
+      void* data = mmap(NULL, (std::size_t) status.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+      ok = data != MAP_FAILED;
+      if( ok )
+      {
+        m_data = data;
+        m_size = (std::size_t) status.st_size;
+      }
+    }
+    ::close(fd);
+    return ok;
+  }
+
+  void close()
+  {
+    if( m_data != NULL ) munmap(m_data, m_size);
+    m_data = NULL;
+    m_size = 0;
+  }
+
+  const char* data() const { return static_cast<const char*>(m_data); }
+  std::size_t size() const { return m_size; }
+
+private:
+  MappedFile( const MappedFile& );
+  MappedFile& operator=( const MappedFile& );
+
+  void* m_data;
+  std::size_t m_size;
+};
+
+#endif
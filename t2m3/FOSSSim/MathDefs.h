@@ -12,6 +12,11 @@ typedef Eigen::Matrix<scalar, Eigen::Dynamic, 1> VectorXs;
 typedef Eigen::Matrix<scalar, 2, 2> Matrix2s;
 typedef Eigen::Matrix<scalar, Eigen::Dynamic, Eigen::Dynamic> MatrixXs;
 
+// Keeps std::vectors of fixed-size types on 16-byte boundaries, which an
+// aligned (FOSSSIM_ALIGNED_EIGEN) build needs. Harmless when unaligned.
+EIGEN_DEFINE_STL_VECTOR_SPECIALIZATION(Vector2s)
+EIGEN_DEFINE_STL_VECTOR_SPECIALIZATION(Matrix2s)
+
 //typedef Matrix<int, 1, 2> RowVector2i;
 
 #endif
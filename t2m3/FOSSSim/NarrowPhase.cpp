@@ -0,0 +1,89 @@
+#include "NarrowPhase.h"
+
+#include <algorithm>
+
+#include "PeriodicDomain.h"
+
+#if defined(__AVX__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+namespace
+{
+
+// Pairs gathered into structure-of-arrays form per block.
+const int BLOCK = 4;
+
+struct PairBlock
+{
+  scalar dx[BLOCK];
+  scalar dy[BLOCK];
+  scalar reach[BLOCK];
+};
+
+// Whether each of the block's pairs touches, as bit k of the result. The sums
+// are formed as ( x1 - x2 ).squaredNorm() and r1 + r2 + thickness are.
+int touchingMask( const PairBlock& block )
+{
+#if defined(__AVX__)
+  const __m256d dx = _mm256_loadu_pd(block.dx);
+  const __m256d dy = _mm256_loadu_pd(block.dy);
+  const __m256d reach = _mm256_loadu_pd(block.reach);
+  const __m256d d2 = _mm256_add_pd(_mm256_mul_pd(dx, dx), _mm256_mul_pd(dy, dy));
+  return _mm256_movemask_pd(_mm256_cmp_pd(d2, _mm256_mul_pd(reach, reach), _CMP_LT_OQ));
+#elif defined(__SSE2__)
+  int mask = 0;
+  for( int k = 0; k < BLOCK; k += 2 )
+  {
+    const __m128d dx = _mm_loadu_pd(block.dx + k);
+    const __m128d dy = _mm_loadu_pd(block.dy + k);
+    const __m128d reach = _mm_loadu_pd(block.reach + k);
+    const __m128d d2 = _mm_add_pd(_mm_mul_pd(dx, dx), _mm_mul_pd(dy, dy));
+    mask |= _mm_movemask_pd(_mm_cmplt_pd(d2, _mm_mul_pd(reach, reach))) << k;
+  }
+  return mask;
+#else
+  int mask = 0;
+  for( int k = 0; k < BLOCK; ++k )
+    if( block.dx[k]*block.dx[k] + block.dy[k]*block.dy[k] < block.reach[k]*block.reach[k] ) mask |= 1 << k;
+  return mask;
+#endif
+}
+
+}
+
+void narrowphase::findTouchingParticlePairs( const VectorXs& x, const std::vector<scalar>& radii, scalar thickness, const PPList& pppairs, PPList& hits, const PeriodicDomain* domain )
+{
+  hits.resize(pppairs.size());
+  const int numpairs = (int) pppairs.size();
+  int numhits = 0;
+  PairBlock block;
+  for( int first = 0; first < numpairs; first += BLOCK )
+  {
+    const int count = std::min(BLOCK, numpairs - first);
+    for( int k = 0; k < count; ++k )
+    {
+      const int i = pppairs[first + k].first;
+      const int j = pppairs[first + k].second;
+      block.dx[k] = x(2*i) - x(2*j);
+      block.dy[k] = x(2*i+1) - x(2*j+1);
+      block.reach[k] = radii[i] + radii[j] + thickness;
+    }
+    if( domain != NULL )
+      for( int k = 0; k < count; ++k )
+      {
+        block.dx[k] = domain->minimumImage(0, block.dx[k]);
+        block.dy[k] = domain->minimumImage(1, block.dy[k]);
+      }
+    // Pairs past the end of the list never touch.
+    for( int k = count; k < BLOCK; ++k )
+    {
+      block.dx[k] = block.dy[k] = 1.0;
+      block.reach[k] = 0.0;
+    }
+    const int mask = touchingMask(block);
+    for( int k = 0; k < count; ++k )
+      if( mask & ( 1 << k ) ) hits[numhits++] = pppairs[first + k];
+  }
+  hits.resize(numhits);
+}
@@ -0,0 +1,20 @@
+#ifndef NARROW_PHASE_H
+#define NARROW_PHASE_H
+
+#include "BroadPhase.h"
+#include <vector>
+
+struct PeriodicDomain;
+
+namespace narrowphase
+{
+  // Compacts pppairs, in order, to the pairs whose particles at x are closer
+  // than their radii plus thickness, which are the only ones a penalty force
+  // acts on. The test is the same squared distance against squared reach the
+  // force makes per pair, evaluated two pairs per SSE2 instruction, or four
+  // with AVX, on the pairs' positions and radii gathered a block at a time.
+  // Given a domain, separations are taken to their minimum image.
+  void findTouchingParticlePairs( const VectorXs& x, const std::vector<scalar>& radii, scalar thickness, const PPList& pppairs, PPList& hits, const PeriodicDomain* domain = NULL );
+}
+
+#endif
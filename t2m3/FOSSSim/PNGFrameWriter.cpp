@@ -0,0 +1,139 @@
+#include "PNGFrameWriter.h"
+
+#ifdef PNGOUT
+
+#include <png.h>
+
+#include <algorithm>
+#include <cassert>
+#include <cstdio>
+#include <iostream>
+
+namespace
+{
+
+void complain( const std::string& what )
+{
+  std::cerr << "\033[31;1mERROR IN PNGFRAMEWRITER:\033[m " << what << std::endl;
+}
+
+}
+
+bool writePNG( const std::string& filename, const FrameImage& image )
+{
+  FILE* file = std::fopen(filename.c_str(), "wb");
+  if( file == NULL )
+  {
+    complain("Failed to create " + filename + ".");
+    return false;
+  }
+  png_structp png = png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+  png_infop info = png == NULL ? NULL : png_create_info_struct(png);
+  std::vector<png_bytep> rows(image.height);
+  bool ok = info != NULL;
+  if( ok && setjmp(png_jmpbuf(png)) != 0 ) ok = false;
+  else if( ok )
+  {
+    png_init_io(png, file);
+    png_set_IHDR(png, info, image.width, image.height, 8, PNG_COLOR_TYPE_RGB, PNG_INTERLACE_NONE, PNG_COMPRESSION_TYPE_DEFAULT, PNG_FILTER_TYPE_DEFAULT);
+    for( int j = 0; j < image.height; ++j ) rows[j] = (png_bytep) &image.rgb[3*j*image.width];
+    png_set_rows(png, info, &rows[0]);
+    png_write_png(png, info, PNG_TRANSFORM_IDENTITY, NULL);
+  }
+  png_destroy_write_struct(png == NULL ? NULL : &png, info == NULL ? NULL : &info);
+  ok = std::fclose(file) == 0 && ok;
+  if( !ok ) complain("Failed to write " + filename + ".");
+  return ok;
+}
+
+PNGFrameWriter::PNGFrameWriter( int nthreads )
+: m_slots()
+, m_queued()
+, m_free()
+, m_drawing(-1)
+, m_encoding(0)
+, m_failed(false)
+, m_stopping(false)
+, m_mutex()
+, m_wake()
+, m_freed()
+, m_threads()
+{
+  if( nthreads <= 0 ) nthreads = std::max( (int) std::thread::hardware_concurrency(), 1 );
+  m_slots.resize(2*nthreads);
+  for( int s = (int) m_slots.size() - 1; s >= 0; --s ) m_free.push_back(s);
+  for( int t = 0; t < nthreads; ++t ) m_threads.push_back( std::thread( &PNGFrameWriter::run, this ) );
+}
+
+PNGFrameWriter::~PNGFrameWriter()
+{
+  finish();
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_stopping = true;
+  }
+  m_wake.notify_all();
+  for( std::size_t t = 0; t < m_threads.size(); ++t ) m_threads[t].join();
+}
+
+FrameImage& PNGFrameWriter::beginFrame( int width, int height )
+{
+  assert( m_drawing < 0 );
+  {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while( m_free.empty() ) m_freed.wait(lock);
+    m_drawing = m_free.back();
+    m_free.pop_back();
+  }
+  // The encoders do not touch a slot until it is queued.
+  FrameImage& image = m_slots[m_drawing].image;
+  image.resize(width, height);
+  return image;
+}
+
+void PNGFrameWriter::endFrame( const std::string& filename )
+{
+  assert( m_drawing >= 0 );
+  m_slots[m_drawing].filename = filename;
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_queued.push_back(m_drawing);
+    m_drawing = -1;
+  }
+  m_wake.notify_one();
+}
+
+bool PNGFrameWriter::finish()
+{
+  std::unique_lock<std::mutex> lock(m_mutex);
+  while( !m_queued.empty() || m_encoding > 0 ) m_freed.wait(lock);
+  return !m_failed;
+}
+
+void PNGFrameWriter::run()
+{
+  while( true )
+  {
+    int slot;
+    {
+      std::unique_lock<std::mutex> lock(m_mutex);
+      while( m_queued.empty() && !m_stopping ) m_wake.wait(lock);
+      if( m_queued.empty() ) return;
+      slot = m_queued.front();
+      m_queued.erase(m_queued.begin());
+      ++m_encoding;
+    }
+
+    const bool ok = writePNG(m_slots[slot].filename, m_slots[slot].image);
+
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_failed = m_failed || !ok;
+      m_free.push_back(slot);
+      --m_encoding;
+    }
+    m_freed.notify_all();
+  }
+}
+
+#endif
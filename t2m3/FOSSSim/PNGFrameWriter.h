@@ -0,0 +1,71 @@
+#ifndef PNG_FRAME_WRITER_H
+#define PNG_FRAME_WRITER_H
+
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "SceneRasterizer.h"
+
+// Encodes frames to PNG files on threads of its own, so that compressing one
+// frame overlaps drawing the next, and several frames compress at once. The
+// caller draws into the image beginFrame returns and hands it back with
+// endFrame; the encoders take queued frames in order and may finish them in
+// any. There are a fixed number of images, reused from frame to frame, and
+// once every one is queued beginFrame blocks until an encoder frees one,
+// which bounds the memory held by a slow disk.
+//
+// Only built with PNG support, defining PNGOUT, as FOSSSim's own -p is.
+class PNGFrameWriter
+{
+public:
+  // nthreads encoders, 0 being one per processor, with two images each.
+  explicit PNGFrameWriter( int nthreads = 0 );
+
+  // Waits for the queued frames.
+  ~PNGFrameWriter();
+
+  // An image to draw the next frame into, of width by height.
+  FrameImage& beginFrame( int width, int height );
+
+  // Queues the image beginFrame returned to be written to filename.
+  void endFrame( const std::string& filename );
+
+  // Waits for the queued frames. Returns false if any failed to write, each
+  // having said why.
+  bool finish();
+
+private:
+  PNGFrameWriter( const PNGFrameWriter& );
+  PNGFrameWriter& operator=( const PNGFrameWriter& );
+
+  struct Slot
+  {
+    FrameImage image;
+    std::string filename;
+  };
+
+  void run();
+
+  std::vector<Slot> m_slots;
+  // Slots waiting for an encoder, oldest first, and slots free to draw in.
+  std::vector<int> m_queued;
+  std::vector<int> m_free;
+  // The slot beginFrame handed out, or -1.
+  int m_drawing;
+  int m_encoding;
+  bool m_failed;
+  bool m_stopping;
+  std::mutex m_mutex;
+  std::condition_variable m_wake;
+  std::condition_variable m_freed;
+  std::vector<std::thread> m_threads;
+};
+
+// Writes image to filename at once. Returns false, after printing why, if it
+// could not be written.
+bool writePNG( const std::string& filename, const FrameImage& image );
+
+#endif
@@ -0,0 +1,225 @@
+#include "ParticlePool.h"
+
+#include <algorithm>
+#include <cassert>
+#include <string>
+
+#include "SpringForce.h"
+#include "TwoDScene.h"
+
+namespace
+{
+
+// The scene's size after its first growth.
+const int MIN_CAPACITY = 16;
+
+// Parking spots per row of the grid.
+const int PARKING_ROW = 1024;
+
+// Fewer holes than this are not worth a compaction.
+const int MIN_COMPACT_HOLES = 64;
+
+}
+
+const Vector2s ParticlePool::PARKING_ORIGIN( 1.0e4, 1.0e4 );
+
+ParticlePool::ParticlePool( TwoDScene& scene )
+: m_scene( scene )
+, m_state( scene.getNumParticles(), LIVE )
+, m_free()
+, m_numlive( scene.getNumParticles() )
+, m_attached()
+, m_attached_edges( -1 )
+, m_attached_forces( -1 )
+, m_remap()
+{
+  m_anchors[0] = m_anchors[1] = -1;
+}
+
+int ParticlePool::spawn( const Vector2s& x, const Vector2s& v, scalar m, scalar radius )
+{
+  if( m_free.empty() ) grow();
+  const int slot = m_free.back();
+  m_free.pop_back();
+  m_state[slot] = LIVE;
+  ++m_numlive;
+  if( slot < (int) m_attached.size() ) m_attached[slot] = 0;
+
+  m_scene.setPosition( slot, x );
+  m_scene.setVelocity( slot, v );
+  m_scene.setMass( slot, m );
+  m_scene.setRadius( slot, radius );
+  m_scene.setFixed( slot, false );
+  return slot;
+}
+
+void ParticlePool::kill( int particle )
+{
+  assert( particle >= 0 ); assert( particle < getCapacity() );
+  assert( isLive( particle ) );
+
+  updateAttached();
+  if( m_attached[particle] )
+  {
+    const std::vector<std::pair<int,int> > edges = m_scene.getEdges();
+    const std::vector<scalar> radii = m_scene.getEdgeRadii();
+    m_scene.clearEdges();
+    for( std::vector<std::pair<int,int> >::size_type e = 0; e < edges.size(); ++e )
+      if( edges[e].first != particle && edges[e].second != particle ) m_scene.insertEdge( edges[e], radii[e] );
+
+    const std::vector<Force*>& forces = m_scene.getForces();
+    for( std::vector<Force*>::size_type f = 0; f < forces.size(); ++f )
+    {
+      SpringForce* spring = dynamic_cast<SpringForce*>( forces[f] );
+      if( spring == NULL ) continue;
+      if( spring->getEndpoints().first != particle && spring->getEndpoints().second != particle ) continue;
+      takeAnchors();
+      *spring = SpringForce( std::make_pair( m_anchors[0], m_anchors[1] ), 0.0, 0.0, 0.0 );
+    }
+    // Other particles may have lost their last edge or spring.
+    m_attached_edges = -1;
+  }
+
+  m_state[particle] = FREE;
+  --m_numlive;
+  park( particle );
+  m_free.push_back( particle );
+}
+
+bool ParticlePool::compactIfFragmented()
+{
+  int top = getCapacity() - 1;
+  while( top >= 0 && m_state[top] == FREE ) --top;
+  const int holes = top + 1 - m_numlive - ( m_anchors[0] >= 0 ? 2 : 0 );
+  if( holes < MIN_COMPACT_HOLES || 2*holes < m_numlive ) return false;
+  return compact();
+}
+
+bool ParticlePool::compact()
+{
+  const int capacity = getCapacity();
+  VectorXs& x = m_scene.getX();
+  VectorXs& v = m_scene.getV();
+  VectorXs& m = m_scene.getM();
+  std::vector<std::string>& tags = m_scene.getParticleTags();
+
+  // Slots only move down, so each is read before anything is written over it.
+  m_remap.assign( capacity, -1 );
+  int count = 0;
+  bool moved = false;
+  for( int i = 0; i < capacity; ++i )
+  {
+    if( m_state[i] == FREE ) continue;
+    m_remap[i] = count;
+    if( count != i )
+    {
+      x.segment<2>( 2*count ) = x.segment<2>( 2*i );
+      v.segment<2>( 2*count ) = v.segment<2>( 2*i );
+      m.segment<2>( 2*count ) = m.segment<2>( 2*i );
+      m_scene.setFixed( count, m_scene.isFixed( i ) );
+      m_scene.setRadius( count, m_scene.getRadius( i ) );
+      tags[count].swap( tags[i] );
+      m_state[count] = m_state[i];
+      moved = true;
+    }
+    ++count;
+  }
+  for( int a = 0; a < 2; ++a ) if( m_anchors[a] >= 0 ) m_anchors[a] = m_remap[m_anchors[a]];
+
+  int size = capacity;
+  if( 4*count <= capacity ) size = std::min( capacity, std::max( MIN_CAPACITY, 2*count ) );
+  if( size != capacity ) resize( size, count );
+  m_state.resize( size );
+  m_free.clear();
+  for( int slot = size - 1; slot >= count; --slot )
+  {
+    m_state[slot] = FREE;
+    park( slot );
+    m_free.push_back( slot );
+  }
+
+  if( moved )
+  {
+    const std::vector<std::pair<int,int> > edges = m_scene.getEdges();
+    const std::vector<scalar> radii = m_scene.getEdgeRadii();
+    m_scene.clearEdges();
+    for( std::vector<std::pair<int,int> >::size_type e = 0; e < edges.size(); ++e )
+      m_scene.insertEdge( std::make_pair( m_remap[edges[e].first], m_remap[edges[e].second] ), radii[e] );
+
+    const std::vector<Force*>& forces = m_scene.getForces();
+    for( std::vector<Force*>::size_type f = 0; f < forces.size(); ++f )
+    {
+      SpringForce* spring = dynamic_cast<SpringForce*>( forces[f] );
+      if( spring == NULL ) continue;
+      const std::pair<int,int> endpoints( m_remap[spring->getEndpoints().first], m_remap[spring->getEndpoints().second] );
+      *spring = SpringForce( endpoints, spring->getStiffness(), spring->getRestLength(), spring->getDamping() );
+    }
+  }
+  m_attached_edges = -1;
+  return moved;
+}
+
+void ParticlePool::grow()
+{
+  const int capacity = getCapacity();
+  const int size = std::max( MIN_CAPACITY, 2*capacity );
+  resize( size, capacity );
+  m_state.resize( size, FREE );
+  if( !m_attached.empty() ) m_attached.resize( size, 0 );
+  for( int slot = size - 1; slot >= capacity; --slot )
+  {
+    park( slot );
+    m_free.push_back( slot );
+  }
+}
+
+void ParticlePool::resize( int size, int count )
+{
+  const VectorXs x = m_scene.getX().head( 2*count );
+  const VectorXs v = m_scene.getV().head( 2*count );
+  const VectorXs m = m_scene.getM().head( 2*count );
+  // Keeps the radii, fixed flags and tags, but not these.
+  m_scene.resizeSystem( size );
+  m_scene.getX().head( 2*count ) = x;
+  m_scene.getV().head( 2*count ) = v;
+  m_scene.getM().head( 2*count ) = m;
+}
+
+void ParticlePool::park( int slot )
+{
+  m_scene.setPosition( slot, PARKING_ORIGIN + Vector2s( slot%PARKING_ROW, slot/PARKING_ROW ) );
+  m_scene.setVelocity( slot, Vector2s::Zero() );
+  // A unit mass, so that nothing divides by zero over a fixed particle.
+  m_scene.setMass( slot, 1.0 );
+  m_scene.setRadius( slot, 0.0 );
+  m_scene.setFixed( slot, true );
+  m_scene.getParticleTags()[slot].clear();
+}
+
+void ParticlePool::takeAnchors()
+{
+  if( m_anchors[0] >= 0 ) return;
+  for( int a = 0; a < 2; ++a )
+  {
+    if( m_free.empty() ) grow();
+    m_anchors[a] = m_free.back();
+    m_free.pop_back();
+    m_state[m_anchors[a]] = ANCHOR;
+  }
+}
+
+void ParticlePool::updateAttached()
+{
+  const int nedges = m_scene.getNumEdges();
+  const int nforces = (int) m_scene.getForces().size();
+  if( nedges == m_attached_edges && nforces == m_attached_forces && (int) m_attached.size() == getCapacity() ) return;
+
+  m_attached.assign( getCapacity(), 0 );
+  for( int e = 0; e < nedges; ++e ) m_attached[m_scene.getEdge( e ).first] = m_attached[m_scene.getEdge( e ).second] = 1;
+  const std::vector<Force*>& forces = m_scene.getForces();
+  for( int f = 0; f < nforces; ++f )
+    if( const SpringForce* spring = dynamic_cast<const SpringForce*>( forces[f] ) )
+      m_attached[spring->getEndpoints().first] = m_attached[spring->getEndpoints().second] = 1;
+  m_attached_edges = nedges;
+  m_attached_forces = nforces;
+}
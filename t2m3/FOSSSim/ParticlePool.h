@@ -0,0 +1,92 @@
+#ifndef __PARTICLE_POOL_H__
+#define __PARTICLE_POOL_H__
+
+#include <vector>
+
+#include "MathDefs.h"
+
+class TwoDScene;
+
+// Particles that appear and disappear during a run, as from an emitter.
+// TwoDScene is compiled into the base library: resizeSystem reallocates every
+// array and zeroes the positions, velocities and masses, and nothing removes
+// a particle. So the pool keeps the scene larger than it needs, doubling it
+// when full, which makes a spawn O(1) amortised, and keeps the slots of
+// killed particles on a free list for later spawns.
+//
+// A free slot is parked: fixed, still, of zero radius, at its own spot on a
+// grid of unit spacing from PARKING_ORIGIN, far off any scene, so that it
+// neither moves nor touches anything. Killing a particle drops its edges and
+// empties its springs, which become springs of zero stiffness between two
+// parked anchors, since the base library cannot remove a force. Springs are
+// the only forces whose particles the pool knows; a scene whose other forces
+// name particles must not kill those. Killing a particle without edges or
+// springs is O(1); otherwise it is a pass over the edges and forces.
+//
+// compact() moves the live particles down over the free slots, in order,
+// remaps the edges and springs, and shrinks the scene once three quarters of
+// it is free. Indices held elsewhere, such as an emitter's list of its
+// particles, are remapped through getRemap(). Steppers and detectors notice
+// the changed scene as they do any other. Compacting only between steps,
+// from compactIfFragmented(), keeps indices stable within one.
+class ParticlePool
+{
+public:
+  // Takes the scene's particles as live.
+  explicit ParticlePool( TwoDScene& scene );
+
+  // A new particle, in a free slot, growing the scene if there is none.
+  int spawn( const Vector2s& x, const Vector2s& v, scalar m, scalar radius );
+
+  // Parks a live particle's slot for reuse.
+  void kill( int particle );
+
+  bool isLive( int particle ) const { return m_state[particle] == LIVE; }
+  int getNumLive() const { return m_numlive; }
+  int getNumFree() const { return (int) m_free.size(); }
+  int getCapacity() const { return (int) m_state.size(); }
+
+  // Compacts, returning true, if the free slots below the highest live
+  // particle are at least half as many as the live particles.
+  bool compactIfFragmented();
+
+  // Moves the live particles to the front. Returns true if any moved.
+  bool compact();
+
+  // Each slot's index after the last compaction, or -1 if it was free.
+  const std::vector<int>& getRemap() const { return m_remap; }
+
+  static const Vector2s PARKING_ORIGIN;
+
+private:
+  enum State { LIVE, FREE, ANCHOR };
+
+  // Doubles the scene, parking the new slots.
+  void grow();
+
+  // Resizes the scene, keeping the first count particles.
+  void resize( int size, int count );
+
+  void park( int slot );
+
+  // Two parked slots for emptied springs to join, taken on first use.
+  void takeAnchors();
+
+  // Whether each slot has an edge or spring, for the edge and force counts
+  // last seen.
+  void updateAttached();
+
+  TwoDScene& m_scene;
+  std::vector<char> m_state;
+  std::vector<int> m_free;
+  int m_numlive;
+  int m_anchors[2];
+
+  std::vector<char> m_attached;
+  int m_attached_edges;
+  int m_attached_forces;
+
+  std::vector<int> m_remap;
+};
+
+#endif
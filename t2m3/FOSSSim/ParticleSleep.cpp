@@ -0,0 +1,130 @@
+#include "ParticleSleep.h"
+
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+namespace
+{
+
+std::vector<std::pair<int,int> > g_contacts;
+// Consecutive quiet steps of each particle's island, and whether it sleeps.
+std::vector<int> g_quiet;
+std::vector<unsigned char> g_asleep;
+int g_num_asleep = 0;
+
+// Union-find over particles, with path halving and union by size.
+class Islands
+{
+public:
+  explicit Islands( int n )
+  : m_parent(n)
+  , m_size(n, 1)
+  {
+    for( int i = 0; i < n; ++i ) m_parent[i] = i;
+  }
+
+  int find( int i )
+  {
+    while( m_parent[i] != i )
+    {
+      m_parent[i] = m_parent[m_parent[i]];
+      i = m_parent[i];
+    }
+    return i;
+  }
+
+  void unite( int i, int j )
+  {
+    i = find(i);
+    j = find(j);
+    if( i == j ) return;
+    if( m_size[i] < m_size[j] ) std::swap(i, j);
+    m_parent[j] = i;
+    m_size[i] += m_size[j];
+  }
+
+private:
+  std::vector<int> m_parent;
+  std::vector<int> m_size;
+};
+
+}
+
+namespace sleeping
+{
+
+void recordContact( int idx1, int idx2 )
+{
+  g_contacts.push_back(std::make_pair(idx1, idx2));
+}
+
+void update( TwoDScene& scene )
+{
+#ifdef SLEEP_KINETIC_ENERGY
+  const int n = scene.getNumParticles();
+  // A scene of another size is another scene, whose contacts these are not.
+  if( (int) g_quiet.size() != n )
+  {
+    g_quiet.assign(n, 0);
+    g_asleep.assign(n, 0);
+    g_contacts.clear();
+  }
+
+  Islands islands(n);
+  for( int e = 0; e < scene.getNumEdges(); ++e )
+  {
+    const std::pair<int,int>& edge = scene.getEdge(e);
+    if( !scene.isFixed(edge.first) && !scene.isFixed(edge.second) ) islands.unite(edge.first, edge.second);
+  }
+  for( std::vector<std::pair<int,int> >::size_type c = 0; c < g_contacts.size(); ++c )
+    if( !scene.isFixed(g_contacts[c].first) && !scene.isFixed(g_contacts[c].second) ) islands.unite(g_contacts[c].first, g_contacts[c].second);
+  g_contacts.clear();
+
+  // Per island root: kinetic energy, particle count and the fewest quiet
+  // steps among its particles.
+  VectorXs& v = scene.getV();
+  const VectorXs& m = scene.getM();
+  std::vector<scalar> energy(n, 0.0);
+  std::vector<int> count(n, 0);
+  std::vector<int> quiet(n, -1);
+  for( int i = 0; i < n; ++i )
+  {
+    if( scene.isFixed(i) ) continue;
+    const int root = islands.find(i);
+    energy[root] += 0.5*m(2*i)*v.segment<2>(2*i).squaredNorm();
+    ++count[root];
+    quiet[root] = quiet[root] < 0 ? g_quiet[i] : std::min(quiet[root], g_quiet[i]);
+  }
+  for( int i = 0; i < n; ++i )
+    if( count[i] > 0 ) quiet[i] = energy[i] < SLEEP_KINETIC_ENERGY*count[i] ? quiet[i] + 1 : 0;
+
+  g_num_asleep = 0;
+  for( int i = 0; i < n; ++i )
+  {
+    if( scene.isFixed(i) )
+    {
+      g_quiet[i] = 0;
+      g_asleep[i] = 0;
+      continue;
+    }
+    g_quiet[i] = quiet[islands.find(i)];
+    g_asleep[i] = g_quiet[i] >= SLEEP_STEPS;
+    if( !g_asleep[i] ) continue;
+    v.segment<2>(2*i).setZero();
+    ++g_num_asleep;
+  }
+#endif
+}
+
+bool isAsleep( int particle )
+{
+  return particle < (int) g_asleep.size() && g_asleep[particle];
+}
+
+int getNumAsleep()
+{
+  return g_num_asleep;
+}
+
+}
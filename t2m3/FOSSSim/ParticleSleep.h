@@ -0,0 +1,37 @@
+#ifndef __PARTICLE_SLEEP_H__
+#define __PARTICLE_SLEEP_H__
+
+#include "TwoDScene.h"
+
+// Puts islands of resting particles to sleep, built with
+// SLEEP_KINETIC_ENERGY > 0. An island is a set of free particles connected
+// by edges, which carry the scene's springs, or by contacts the penalty force
+// applied during the step; fixed particles belong to none, so resting on a
+// wall joins nothing. An island whose kinetic energy per particle stays below
+// SLEEP_KINETIC_ENERGY for SLEEP_STEPS consecutive steps falls asleep: its
+// velocities are zeroed, the stepper stops integrating it and the penalty
+// force skips contacts among its particles, though it still records them to
+// keep the island whole. A contact with an awake particle puts both in one
+// island with no quiet steps, which wakes the whole island at the next
+// update.
+//
+// The base library constructs both the stepper and the forces, so the state
+// is kept here rather than in either.
+namespace sleeping
+{
+  // Records a contact between two particles, or between a particle and an
+  // edge's nearer endpoint. Called by the penalty force.
+  void recordContact( int idx1, int idx2 );
+
+  // Regroups the scene's free particles into islands from its edges and the
+  // contacts recorded since the last update, and puts quiet islands to
+  // sleep. Called by the stepper at the end of each step.
+  void update( TwoDScene& scene );
+
+  // False for every particle until the first update.
+  bool isAsleep( int particle );
+
+  int getNumAsleep();
+}
+
+#endif
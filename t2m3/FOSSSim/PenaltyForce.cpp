@@ -0,0 +1,624 @@
+#include "PenaltyForce.h"
+#include "TwoDScene.h"
+#include "CollisionDetector.h"
+#include "BroadPhase.h"
+#include "NarrowPhase.h"
+#include "PenaltyGrid.h"
+#include "PeriodicDomain.h"
+#include "PhaseTimes.h"
+#ifdef FUSED_PENALTY_GRID
+#include "ContestDetector.h"
+#endif
+#ifdef SLEEP_KINETIC_ENERGY
+#include "ParticleSleep.h"
+#endif
+#ifdef BLOCK_SUBSTEPS
+#include "BlockStepping.h"
+#endif
+#include <algorithm>
+#include <cmath>
+#include <map>
+
+namespace
+{
+
+// The pair lists a force's gradient and Hessian passes filter and walk,
+// kept from call to call so that once they have grown to the scene's
+// contacts the passes allocate nothing.
+struct PenaltyScratch
+{
+  PPList hits;
+  PEList pepairs;
+  PHList phpairs;
+};
+
+std::map<const PenaltyForce *, PenaltyScratch> g_scratch;
+
+// The penalty callbacks take the sorted candidates whole, so that each list
+// is walked in one loop rather than a virtual call per pair, and the
+// particle pairs are filtered to those touching before any force is built.
+class PenaltyCallback : public DetectionCallback, public PairListDetectionCallback
+{
+public:
+  PenaltyCallback( PenaltyForce &force, const VectorXs &x, VectorXs &gradE, PPList &hits )
+  : m_force(force)
+  , m_x(x)
+  , m_gradE(gradE)
+  , m_hits(hits)
+  {}
+
+  virtual void ParticleParticleCallback(int idx1, int idx2)
+  {
+    m_force.addParticleParticleGradEToTotal(m_x, idx1, idx2, m_gradE);
+  }
+
+  virtual void ParticleEdgeCallback(int vidx, int eidx)
+  {
+    m_force.addParticleEdgeGradEToTotal(m_x, vidx, eidx, m_gradE);
+  }
+
+  virtual void ParticleHalfplaneCallback(int vidx, int pidx)
+  {
+    m_force.addParticleHalfplaneGradEToTotal(m_x, vidx, pidx, m_gradE);
+  }
+
+  virtual void PairListsCallback(const PPList &pppairs, const PEList &pepairs, const PHList &phpairs)
+  {
+    m_force.findTouchingParticlePairs(m_x, pppairs, m_hits);
+    for( PPList::size_type k = 0; k < m_hits.size(); ++k ) m_force.addParticleParticleGradEToTotal(m_x, m_hits[k].first, m_hits[k].second, m_gradE);
+    for( PEList::size_type k = 0; k < pepairs.size(); ++k ) m_force.addParticleEdgeGradEToTotal(m_x, pepairs[k].first, pepairs[k].second, m_gradE);
+    for( PHList::size_type k = 0; k < phpairs.size(); ++k ) m_force.addParticleHalfplaneGradEToTotal(m_x, phpairs[k].first, phpairs[k].second, m_gradE);
+  }
+
+private:
+  PenaltyForce &m_force;
+  const VectorXs &m_x;
+  VectorXs &m_gradE;
+  PPList &m_hits;
+};
+
+class PenaltyHessXCallback : public DetectionCallback, public PairListDetectionCallback
+{
+public:
+  PenaltyHessXCallback( PenaltyForce &force, const VectorXs &x, MatrixXs &hessE, PPList &hits )
+  : m_force(force)
+  , m_x(x)
+  , m_hessE(hessE)
+  , m_hits(hits)
+  {}
+
+  virtual void ParticleParticleCallback(int idx1, int idx2)
+  {
+    m_force.addParticleParticleHessXToTotal(m_x, idx1, idx2, m_hessE);
+  }
+
+  virtual void ParticleEdgeCallback(int vidx, int eidx)
+  {
+    m_force.addParticleEdgeHessXToTotal(m_x, vidx, eidx, m_hessE);
+  }
+
+  virtual void ParticleHalfplaneCallback(int vidx, int pidx)
+  {
+    m_force.addParticleHalfplaneHessXToTotal(m_x, vidx, pidx, m_hessE);
+  }
+
+  virtual void PairListsCallback(const PPList &pppairs, const PEList &pepairs, const PHList &phpairs)
+  {
+    m_force.findTouchingParticlePairs(m_x, pppairs, m_hits);
+    for( PPList::size_type k = 0; k < m_hits.size(); ++k ) m_force.addParticleParticleHessXToTotal(m_x, m_hits[k].first, m_hits[k].second, m_hessE);
+    for( PEList::size_type k = 0; k < pepairs.size(); ++k ) m_force.addParticleEdgeHessXToTotal(m_x, pepairs[k].first, pepairs[k].second, m_hessE);
+    for( PHList::size_type k = 0; k < phpairs.size(); ++k ) m_force.addParticleHalfplaneHessXToTotal(m_x, phpairs[k].first, phpairs[k].second, m_hessE);
+  }
+
+private:
+  PenaltyForce &m_force;
+  const VectorXs &m_x;
+  MatrixXs &m_hessE;
+  PPList &m_hits;
+};
+
+#if defined(PENALTY_NEIGHBOUR_SKIN) || defined(CONTACT_SUBSTEPS)
+
+// Candidate pairs and the positions they were found at.
+struct NeighbourList
+{
+  VectorXs x0;
+  PPList pppairs;
+  PEList pepairs;
+  PHList phpairs;
+};
+
+class RecordingCallback : public DetectionCallback, public PairListDetectionCallback
+{
+public:
+  explicit RecordingCallback( NeighbourList &list )
+  : m_list(list)
+  {}
+
+  virtual void ParticleParticleCallback(int idx1, int idx2)
+  {
+    m_list.pppairs.push_back(std::make_pair(idx1, idx2));
+  }
+
+  virtual void ParticleEdgeCallback(int vidx, int eidx)
+  {
+    m_list.pepairs.push_back(std::make_pair(vidx, eidx));
+  }
+
+  virtual void ParticleHalfplaneCallback(int vidx, int pidx)
+  {
+    m_list.phpairs.push_back(std::make_pair(vidx, pidx));
+  }
+
+  virtual void PairListsCallback(const PPList &pppairs, const PEList &pepairs, const PHList &phpairs)
+  {
+    m_list.pppairs.assign(pppairs.begin(), pppairs.end());
+    m_list.pepairs.assign(pepairs.begin(), pepairs.end());
+    m_list.phpairs.assign(phpairs.begin(), phpairs.end());
+  }
+
+private:
+  NeighbourList &m_list;
+};
+
+// Reports the pairs of list to dc.
+void reportList( const NeighbourList &list, DetectionCallback &dc )
+{
+  phasetimes::ScopedPhase contacts(phasetimes::CONTACTS);
+  if( PairListDetectionCallback *lists = dynamic_cast<PairListDetectionCallback *>(&dc) )
+  {
+    lists->PairListsCallback(list.pppairs, list.pepairs, list.phpairs);
+    return;
+  }
+  for( int i = 0; i < (int) list.pppairs.size(); ++i ) dc.ParticleParticleCallback(list.pppairs[i].first, list.pppairs[i].second);
+  for( int i = 0; i < (int) list.pepairs.size(); ++i ) dc.ParticleEdgeCallback(list.pepairs[i].first, list.pepairs[i].second);
+  for( int i = 0; i < (int) list.phpairs.size(); ++i ) dc.ParticleHalfplaneCallback(list.phpairs[i].first, list.phpairs[i].second);
+}
+
+// Whether some particle has moved more than distance from list's positions.
+bool movedFrom( const NeighbourList &list, const VectorXs &x, scalar distance )
+{
+  if( list.x0.size() != x.size() ) return true;
+  const scalar limit = distance*distance;
+  for( int i = 0; i < x.size()/2; ++i )
+  {
+    if( ( x.segment<2>(2*i) - list.x0.segment<2>(2*i) ).squaredNorm() > limit ) return true;
+  }
+  return false;
+}
+
+#endif
+
+#ifdef PENALTY_NEIGHBOUR_SKIN
+std::map<const PenaltyForce *, NeighbourList> g_neighbours;
+#endif
+
+#ifdef CONTACT_SUBSTEPS
+// The candidates held for a step, and the margin they were found with.
+struct HeldCandidates
+{
+  NeighbourList list;
+  scalar margin;
+};
+
+std::map<const PenaltyForce *, HeldCandidates> g_held;
+#endif
+
+#ifdef FUSED_PENALTY_GRID
+std::map<const PenaltyForce *, PenaltyGrid> g_grids;
+#endif
+
+}
+
+PenaltyForce::PenaltyForce( const TwoDScene &scene, CollisionDetector &detector, const scalar stiffness, const scalar thickness )
+: Force()
+, m_scene(scene)
+, m_detector(detector)
+, m_k(stiffness)
+, m_thickness(thickness)
+{}
+
+PenaltyForce::~PenaltyForce()
+{
+  g_scratch.erase(this);
+#ifdef PENALTY_NEIGHBOUR_SKIN
+  g_neighbours.erase(this);
+#endif
+#ifdef FUSED_PENALTY_GRID
+  g_grids.erase(this);
+#endif
+#ifdef CONTACT_SUBSTEPS
+  g_held.erase(this);
+#endif
+}
+
+void PenaltyForce::addEnergyToTotal( const VectorXs& x, const VectorXs& v, const VectorXs& m, scalar& E )
+{
+}
+
+void PenaltyForce::addGradEToTotal( const VectorXs& x, const VectorXs& v, const VectorXs& m, VectorXs& gradE )
+{
+  assert( x.size() == v.size() );
+  assert( x.size() == m.size() );
+  assert( x.size() == gradE.size() );
+  assert( x.size()%2 == 0 );
+
+#ifdef FUSED_PENALTY_GRID
+#ifdef CONTACT_SUBSTEPS
+  const bool held = g_held.count(this) > 0;
+#else
+  const bool held = false;
+#endif
+  if( !held && dynamic_cast<ContestDetector *>(&m_detector) && periodic::findDomain(m_scene) == NULL )
+  {
+    addGradEToTotal(x, g_grids[this], gradE);
+    return;
+  }
+#endif
+
+  PenaltyCallback callback(*this, x, gradE, g_scratch[this].hits);
+  reportCandidates(x, callback);
+}
+
+void PenaltyForce::addGradEToTotal( const VectorXs& x, PenaltyGrid& grid, VectorXs& gradE )
+{
+  PenaltyScratch &scratch = g_scratch[this];
+  PEList &pepairs = scratch.pepairs;
+  PHList &phpairs = scratch.phpairs;
+  {
+    phasetimes::ScopedPhase search(phasetimes::BROAD_PHASE);
+    grid.build(m_scene, x);
+    grid.findParticleEdgePairs(m_scene, x, pepairs);
+    phpairs.clear();
+    broadphase::findHalfplanePairs(m_scene, x, x, phpairs);
+  }
+
+  phasetimes::ScopedPhase contacts(phasetimes::CONTACTS);
+  grid.addParticleParticleGradEToTotal(m_k, m_thickness, gradE);
+  for( PEList::size_type k = 0; k < pepairs.size(); ++k ) addParticleEdgeGradEToTotal(x, pepairs[k].first, pepairs[k].second, gradE);
+  for( PHList::size_type k = 0; k < phpairs.size(); ++k ) addParticleHalfplaneGradEToTotal(x, phpairs[k].first, phpairs[k].second, gradE);
+}
+
+void PenaltyForce::addHessXToTotal( const VectorXs& x, const VectorXs& v, const VectorXs& m, MatrixXs& hessE )
+{
+  assert( x.size() == v.size() );
+  assert( x.size() == m.size() );
+  assert( x.size() == hessE.rows() );
+  assert( x.size() == hessE.cols() );
+  assert( x.size()%2 == 0 );
+
+  PenaltyHessXCallback callback(*this, x, hessE, g_scratch[this].hits);
+  reportCandidates(x, callback);
+}
+
+void PenaltyForce::addHessVToTotal( const VectorXs& x, const VectorXs& v, const VectorXs& m, MatrixXs& hessE )
+{
+}
+
+Force* PenaltyForce::createNewCopy()
+{
+  return new PenaltyForce(*this);
+}
+
+void PenaltyForce::reportCandidates( const VectorXs &x, DetectionCallback &dc )
+{
+  // The candidates' callbacks time themselves as contacts.
+  phasetimes::ScopedPhase search(phasetimes::BROAD_PHASE);
+#ifdef CONTACT_SUBSTEPS
+  std::map<const PenaltyForce *, HeldCandidates>::iterator held = g_held.find(this);
+  if( held != g_held.end() )
+  {
+    if( movedFrom(held->second.list, x, 0.5*held->second.margin) ) findCandidates(x, m_thickness + 0.5*held->second.margin, held->second.list);
+    reportList(held->second.list, dc);
+    return;
+  }
+#endif
+#ifdef PENALTY_NEIGHBOUR_SKIN
+  updateNeighbours(x);
+  reportList(g_neighbours[this], dc);
+#else
+  m_detector.performCollisionDetection(m_scene, x, x, dc);
+#endif
+}
+
+#ifdef CONTACT_SUBSTEPS
+void PenaltyForce::holdCandidates( const VectorXs &x, scalar margin )
+{
+  HeldCandidates &held = g_held[this];
+  held.margin = margin;
+  findCandidates(x, m_thickness + 0.5*margin, held.list);
+}
+
+void PenaltyForce::releaseCandidates()
+{
+  g_held.erase(this);
+}
+#endif
+
+// Rebuilds the neighbour list if it is missing or some particle has moved
+// more than half the skin since it was built. Every pair within thickness of
+// touching stays on the list until then: the candidates are found against a
+// copy of the scene with each particle and edge padded by the thickness plus
+// half the skin, and each particle, and so each closest point on an edge, has
+// since moved at most half the skin. Unlike the plain detector pass this also
+// catches pairs within thickness that the detector's own boxes would miss.
+// The candidates held for a step are kept the same way, with their margin
+// for the skin.
+void PenaltyForce::updateNeighbours( const VectorXs &x )
+{
+#ifdef PENALTY_NEIGHBOUR_SKIN
+  const scalar skin = PENALTY_NEIGHBOUR_SKIN;
+  NeighbourList &list = g_neighbours[this];
+  if( movedFrom(list, x, 0.5*skin) ) findCandidates(x, m_thickness + 0.5*skin, list);
+#endif
+}
+
+#if defined(PENALTY_NEIGHBOUR_SKIN) || defined(CONTACT_SUBSTEPS)
+template<class List>
+void PenaltyForce::findCandidates( const VectorXs &x, scalar padding, List &list )
+{
+  TwoDScene padded;
+  padded.resizeSystem( m_scene.getNumParticles() );
+  for( int i = 0; i < m_scene.getNumParticles(); ++i ) padded.setRadius( i, m_scene.getRadius(i) + padding );
+  for( int e = 0; e < m_scene.getNumEdges(); ++e ) padded.insertEdge( m_scene.getEdge(e), m_scene.getEdgeRadii()[e] + padding );
+  for( int h = 0; h < m_scene.getNumHalfplanes(); ++h ) padded.insertHalfplane( m_scene.getHalfplane(h) );
+  const PeriodicDomain* domain = periodic::findDomain( m_scene );
+  if( domain ) periodic::setDomain( padded, *domain );
+
+  list.x0 = x;
+  list.pppairs.clear();
+  list.pepairs.clear();
+  list.phpairs.clear();
+
+  RecordingCallback callback(list);
+  m_detector.performCollisionDetection(padded, x, x, callback);
+  if( domain ) periodic::clearDomain( padded );
+}
+#endif
+
+void PenaltyForce::findTouchingParticlePairs(const VectorXs &x, const PPList &pppairs, PPList &hits) const
+{
+  narrowphase::findTouchingParticlePairs(x, m_scene.getRadii(), m_thickness, pppairs, hits, periodic::findDomain(m_scene));
+}
+
+void PenaltyForce::addParticleParticleGradEToTotal(const VectorXs &x, int idx1, int idx2, VectorXs &gradE)
+{
+#ifdef BLOCK_SUBSTEPS
+  if( !blockstepping::isActive(idx1) && !blockstepping::isActive(idx2) ) return;
+#endif
+  double r1 = m_scene.getRadius(idx1);
+  double r2 = m_scene.getRadius(idx2);
+
+  Vector2s x1 = x.segment<2>(2*idx1);
+  Vector2s x2 = x.segment<2>(2*idx2);
+  Vector2s n = x2 - x1;
+  if( const PeriodicDomain* domain = periodic::findDomain(m_scene) ) n = domain->minimumImage(n);
+
+  scalar reach = r1 + r2 + m_thickness;
+  if( !( n.squaredNorm() < reach*reach ) ) return;
+#ifdef SLEEP_KINETIC_ENERGY
+  // Recorded even when both sleep, so that their island stays whole and a
+  // wake-up spreads through it.
+  sleeping::recordContact(idx1, idx2);
+  if( sleeping::isAsleep(idx1) && sleeping::isAsleep(idx2) ) return;
+#endif
+#ifdef BLOCK_SUBSTEPS
+  blockstepping::recordContact(idx1, idx2);
+#endif
+
+  scalar len = n.norm();
+  Vector2s nhat = n/len;
+  if( len < 1e-10 ) return;
+  nhat.normalize();
+
+  gradE.segment<2>(2*idx1) -= m_k*(len - r1 - r2 - m_thickness)*nhat;
+  gradE.segment<2>(2*idx2) += m_k*(len - r1 - r2 - m_thickness)*nhat;
+}
+
+void PenaltyForce::addParticleEdgeGradEToTotal(const VectorXs &x, int vidx, int eidx, VectorXs &gradE)
+{
+  const std::pair<int,int> &edge = m_scene.getEdge(eidx);
+#ifdef BLOCK_SUBSTEPS
+  if( !blockstepping::isActive(vidx) && !blockstepping::isActive(edge.first) && !blockstepping::isActive(edge.second) ) return;
+#endif
+
+  Vector2s x1 = x.segment<2>(2*vidx);
+  Vector2s x2 = x.segment<2>(2*edge.first);
+  Vector2s x3 = x.segment<2>(2*edge.second);
+  if( const PeriodicDomain* domain = periodic::findDomain(m_scene) )
+  {
+    x1 = x2 + domain->minimumImage(x1 - x2);
+    x3 = x2 + domain->minimumImage(x3 - x2);
+  }
+
+  double r1 = m_scene.getRadius(vidx);
+  double r2 = m_scene.getEdgeRadii()[eidx];
+
+  double alpha = (x1-x2).dot(x3-x2)/(x3-x2).squaredNorm();
+  if( alpha < 0 ) alpha = 0;
+  else alpha = std::min(alpha, 1.0);
+
+  Vector2s closest = x2 + alpha*(x3-x2);
+  Vector2s n = closest - x1;
+  scalar len = n.norm();
+  if( len < 1e-10 ) return;
+  Vector2s nhat = n/len;
+  if( !( len < r1 + r2 + m_thickness ) ) return;
+#ifdef SLEEP_KINETIC_ENERGY
+  sleeping::recordContact(vidx, alpha < 0.5 ? edge.first : edge.second);
+  if( sleeping::isAsleep(vidx) && sleeping::isAsleep(edge.first) && sleeping::isAsleep(edge.second) ) return;
+#endif
+#ifdef BLOCK_SUBSTEPS
+  blockstepping::recordContact(vidx, edge.first);
+  blockstepping::recordContact(vidx, edge.second);
+#endif
+
+  gradE.segment<2>(2*vidx) -= m_k*(len - r1 - r2 - m_thickness)*nhat;
+  gradE.segment<2>(2*edge.first) += (1.0-alpha)*m_k*(len - r1 - r2 - m_thickness)*nhat;
+  gradE.segment<2>(2*edge.second) += alpha*m_k*(len - r1 - r2 - m_thickness)*nhat;
+}
+
+void PenaltyForce::addParticleHalfplaneGradEToTotal(const VectorXs &x, int vidx, int pidx, VectorXs &gradE)
+{
+#ifdef BLOCK_SUBSTEPS
+  if( !blockstepping::isActive(vidx) ) return;
+#endif
+  Vector2s x1 = x.segment<2>(2*vidx);
+  Vector2s nh = m_scene.getHalfplane(pidx).second;
+
+  double t = (m_scene.getHalfplane(pidx).first - x1).dot(nh)/nh.squaredNorm();
+  Vector2s n = t*nh;
+  Vector2s nhat = n;
+  if( n.norm() < 1e-10 ) return;
+  nhat.normalize();
+
+  double r = m_scene.getRadius(vidx);
+  if( !( n.norm() < r + m_thickness ) ) return;
+#ifdef SLEEP_KINETIC_ENERGY
+  if( sleeping::isAsleep(vidx) ) return;
+#endif
+
+  gradE.segment<2>(2*vidx) -= m_k*(n.norm() - r - m_thickness)*nhat.dot(nh)/nh.squaredNorm()*nh;
+}
+
+// The penalty energy of a contact is k/2 (d - r - h)^2 for a distance d less
+// than the combined radius r plus the thickness h, and zero beyond; the
+// gradients above are its derivatives. The Hessians below differentiate those
+// gradients once more.
+
+// Hessian of the particle-particle penalty. It has the stencil [ B -B; -B B ]
+// of a spring with rest length r1 + r2 + h and no tension limit.
+void PenaltyForce::addParticleParticleHessXToTotal(const VectorXs &x, int idx1, int idx2, MatrixXs &hessE)
+{
+  scalar r1 = m_scene.getRadius(idx1);
+  scalar r2 = m_scene.getRadius(idx2);
+
+  Vector2s n = x.segment<2>(2*idx2) - x.segment<2>(2*idx1);
+  if( const PeriodicDomain* domain = periodic::findDomain(m_scene) ) n = domain->minimumImage(n);
+  scalar len = n.norm();
+  if( len < 1e-10 || !( len < r1 + r2 + m_thickness ) ) return;
+  Vector2s nhat = n/len;
+
+  Matrix2s P = nhat*nhat.transpose();
+  Matrix2s B = m_k*( P + (len - r1 - r2 - m_thickness)/len*( Matrix2s::Identity() - P ) );
+
+  hessE.block<2,2>(2*idx1,2*idx1) += B;
+  hessE.block<2,2>(2*idx2,2*idx2) += B;
+  hessE.block<2,2>(2*idx1,2*idx2) -= B;
+  hessE.block<2,2>(2*idx2,2*idx1) -= B;
+}
+
+// Hessian of the particle-edge penalty. The distance vector is n = sum_a w_a
+// x_a over the particle and the edge endpoints, with weights w = (-1, 1-alpha,
+// alpha). While the closest point is interior alpha moves with all three
+// positions, which adds the terms in dalpha; at a clamped endpoint the
+// contact is a particle-particle one.
+void PenaltyForce::addParticleEdgeHessXToTotal(const VectorXs &x, int vidx, int eidx, MatrixXs &hessE)
+{
+  const std::pair<int,int> &edge = m_scene.getEdge(eidx);
+  const int idx[3] = { vidx, edge.first, edge.second };
+
+  Vector2s x1 = x.segment<2>(2*vidx);
+  Vector2s x2 = x.segment<2>(2*edge.first);
+  Vector2s x3 = x.segment<2>(2*edge.second);
+  if( const PeriodicDomain* domain = periodic::findDomain(m_scene) )
+  {
+    x1 = x2 + domain->minimumImage(x1 - x2);
+    x3 = x2 + domain->minimumImage(x3 - x2);
+  }
+  Vector2s e = x3 - x2;
+  scalar e2 = e.squaredNorm();
+
+  scalar alpha = (x1-x2).dot(e)/e2;
+  const bool interior = alpha > 0.0 && alpha < 1.0;
+  alpha = std::max(0.0, std::min(1.0, alpha));
+
+  Vector2s n = x2 + alpha*e - x1;
+  scalar len = n.norm();
+  scalar reach = m_scene.getRadius(vidx) + m_scene.getEdgeRadii()[eidx] + m_thickness;
+  if( len < 1e-10 || !( len < reach ) ) return;
+  Vector2s nhat = n/len;
+
+  const scalar w[3] = { -1.0, 1.0-alpha, alpha };
+  const scalar dw[3] = { 0.0, -1.0, 1.0 };
+  Vector2s dalpha[3] = { Vector2s::Zero(), Vector2s::Zero(), Vector2s::Zero() };
+  if( interior )
+  {
+    dalpha[0] = e/e2;
+    dalpha[1] = ( 2.0*alpha*e - e - (x1-x2) )/e2;
+    dalpha[2] = ( (x1-x2) - 2.0*alpha*e )/e2;
+  }
+
+  const scalar s = len - reach;
+  Matrix2s P = nhat*nhat.transpose();
+  Matrix2s Q = Matrix2s::Identity() - P;
+  for( int a = 0; a < 3; ++a )
+  {
+    for( int b = 0; b < 3; ++b )
+    {
+      Matrix2s dn = w[b]*Matrix2s::Identity() + e*dalpha[b].transpose();
+      Matrix2s B = w[a]*w[b]*P + (s/len)*w[a]*Q*dn + s*dw[a]*nhat*dalpha[b].transpose();
+      hessE.block<2,2>(2*idx[a],2*idx[b]) += m_k*B;
+    }
+  }
+}
+
+// Hessian of the particle-halfplane penalty. The distance is linear in the
+// particle's position, so only the normal direction is stiff.
+void PenaltyForce::addParticleHalfplaneHessXToTotal(const VectorXs &x, int vidx, int pidx, MatrixXs &hessE)
+{
+  Vector2s x1 = x.segment<2>(2*vidx);
+  Vector2s px = m_scene.getHalfplane(pidx).first.segment<2>(0);
+  Vector2s nh = m_scene.getHalfplane(pidx).second.segment<2>(0);
+
+  scalar len = fabs( (px - x1).dot(nh) )/nh.norm();
+  if( len < 1e-10 || !( len < m_scene.getRadius(vidx) + m_thickness ) ) return;
+
+  hessE.block<2,2>(2*vidx,2*vidx) += m_k/nh.squaredNorm()*nh*nh.transpose();
+}
+
+#ifdef CONTACT_SUBSTEPS
+void contactsubsteps::accumulateSmoothGradU( TwoDScene& scene, VectorXs& gradE )
+{
+  const std::vector<Force*>& forces = scene.getForces();
+  for( std::vector<Force*>::size_type f = 0; f < forces.size(); ++f )
+    if( dynamic_cast<PenaltyForce*>(forces[f]) == NULL ) forces[f]->addGradEToTotal(scene.getX(), scene.getV(), scene.getM(), gradE);
+}
+
+void contactsubsteps::accumulateContactGradU( TwoDScene& scene, VectorXs& gradE )
+{
+  const std::vector<Force*>& forces = scene.getForces();
+  for( std::vector<Force*>::size_type f = 0; f < forces.size(); ++f )
+    if( PenaltyForce* penalty = dynamic_cast<PenaltyForce*>(forces[f]) ) penalty->addGradEToTotal(scene.getX(), scene.getV(), scene.getM(), gradE);
+}
+
+bool contactsubsteps::holdCandidates( TwoDScene& scene, const VectorXs& F, scalar dt )
+{
+  const VectorXs& v = scene.getV();
+  const VectorXs& m = scene.getM();
+  scalar reach = 0.0;
+  for( int i = 0; i < scene.getNumParticles(); ++i )
+  {
+    if( scene.isFixed(i) ) continue;
+    const Vector2s vnext = v.segment<2>(2*i) + dt*F.segment<2>(2*i).cwiseQuotient(m.segment<2>(2*i));
+    reach = std::max(reach, dt*vnext.norm());
+  }
+
+  bool any = false;
+  const std::vector<Force*>& forces = scene.getForces();
+  for( std::vector<Force*>::size_type f = 0; f < forces.size(); ++f )
+    if( PenaltyForce* penalty = dynamic_cast<PenaltyForce*>(forces[f]) )
+    {
+      penalty->holdCandidates(scene.getX(), 2.0*reach);
+      any = true;
+    }
+  return any;
+}
+
+void contactsubsteps::releaseCandidates( TwoDScene& scene )
+{
+  const std::vector<Force*>& forces = scene.getForces();
+  for( std::vector<Force*>::size_type f = 0; f < forces.size(); ++f )
+    if( PenaltyForce* penalty = dynamic_cast<PenaltyForce*>(forces[f]) ) penalty->releaseCandidates();
+}
+#endif
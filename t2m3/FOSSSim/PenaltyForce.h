@@ -0,0 +1,137 @@
+#ifndef __PENALTY_FORCE_H__
+#define __PENALTY_FORCE_H__
+
+#include <Eigen/Core>
+#include "Force.h"
+#include <iostream>
+#include <vector>
+
+class TwoDScene;
+class CollisionDetector;
+class DetectionCallback;
+class PenaltyGrid;
+
+// Penalty forces between particles, edges and halfplanes within thickness of
+// touching. Candidate pairs come from the scene's collision detector. Each
+// contact contributes a dense block over the DoFs of its two or three
+// particles to the position Hessian, so implicit integrators can step stiff
+// contacts.
+//
+// Built with PENALTY_NEIGHBOUR_SKIN > 0 the candidates are cached in a
+// Verlet-style neighbour list of every pair within thickness plus the skin,
+// and the detector only runs again once some particle has moved more than
+// half the skin since the list was built. The base library constructs this
+// class, so the list is kept outside it, keyed by the force.
+//
+// Built with SLEEP_KINETIC_ENERGY > 0 each contact is reported to
+// ParticleSleep, and contacts among sleeping particles are then skipped.
+//
+// Built with USE_BLOCK_SUBSTEPS each contact applied while every particle is
+// active is reported to BlockStepping, and contacts among particles that
+// take no substep at the current one are skipped.
+//
+// Built with USE_FUSED_PENALTY_GRID the gradient, when the detector is the
+// contest detector, is summed over a PenaltyGrid instead, which finds the
+// same contacts without listing the particle pairs.
+//
+// Built with CONTACT_SUBSTEPS > 0, the stepper holds the candidates for a
+// whole step, found once with a margin for the step's motion; see
+// holdCandidates.
+//
+// In a scene with a PeriodicDomain the particle-particle and particle-edge
+// distances are minimum-image ones, and the fused grid, which does not wrap,
+// is not used.
+class PenaltyForce : public Force
+{
+public:
+
+  PenaltyForce( const TwoDScene &scene, CollisionDetector &detector, const scalar stiffness, const scalar thickness );
+
+  virtual ~PenaltyForce();
+
+  virtual void addEnergyToTotal( const VectorXs& x, const VectorXs& v, const VectorXs& m, scalar& E );
+
+  virtual void addGradEToTotal( const VectorXs& x, const VectorXs& v, const VectorXs& m, VectorXs& gradE );
+
+  virtual void addHessXToTotal( const VectorXs& x, const VectorXs& v, const VectorXs& m, MatrixXs& hessE );
+
+  virtual void addHessVToTotal( const VectorXs& x, const VectorXs& v, const VectorXs& m, MatrixXs& hessE );
+
+  virtual Force* createNewCopy();
+
+  // The gradient at x as addGradEToTotal sums it from the contest detector's
+  // candidates, with the particle contacts found and summed by grid.
+  void addGradEToTotal( const VectorXs& x, PenaltyGrid& grid, VectorXs& gradE );
+
+  // The particle-particle candidates within thickness of touching at x, the
+  // only ones the per-pair terms below add anything for, in order.
+  void findTouchingParticlePairs(const VectorXs &x, const std::vector<std::pair<int,int> > &pppairs, std::vector<std::pair<int,int> > &hits) const;
+
+  void addParticleParticleGradEToTotal(const VectorXs &x, int idx1, int idx2, VectorXs &gradE);
+
+  void addParticleEdgeGradEToTotal(const VectorXs &x, int vidx, int eidx, VectorXs &gradE);
+
+  void addParticleHalfplaneGradEToTotal(const VectorXs &x, int vidx, int pidx, VectorXs &gradE);
+
+  void addParticleParticleHessXToTotal(const VectorXs &x, int idx1, int idx2, MatrixXs &hessE);
+
+  void addParticleEdgeHessXToTotal(const VectorXs &x, int vidx, int eidx, MatrixXs &hessE);
+
+  void addParticleHalfplaneHessXToTotal(const VectorXs &x, int vidx, int pidx, MatrixXs &hessE);
+
+#ifdef CONTACT_SUBSTEPS
+  // Until releaseCandidates, reports the pairs within thickness plus margin
+  // of touching at x, found once, rather than running the detector or the
+  // fused grid at every evaluation. As with the neighbour list, they are
+  // found again once some particle has moved more than half the margin from
+  // x, so no contact is missed if the margin was too small.
+  void holdCandidates( const VectorXs &x, scalar margin );
+  void releaseCandidates();
+#endif
+
+  scalar getStiffness() const { return m_k; }
+  scalar getThickness() const { return m_thickness; }
+  CollisionDetector& getDetector() const { return m_detector; }
+
+private:
+  // Reports every candidate pair at x to dc, from the neighbour list if
+  // there is one and from the detector otherwise.
+  void reportCandidates( const VectorXs &x, DetectionCallback &dc );
+
+  void updateNeighbours( const VectorXs &x );
+
+  // Replaces the pairs of list with those within thickness plus padding of
+  // touching at x, and sets list's positions to x.
+  template<class List>
+  void findCandidates( const VectorXs &x, scalar padding, List &list );
+
+  const TwoDScene &m_scene;
+  CollisionDetector &m_detector;
+  const scalar m_k;
+  const scalar m_thickness;
+};
+
+#ifdef CONTACT_SUBSTEPS
+// The split of a scene's forces a stepper substeps contacts with: the
+// penalty forces, evaluated at every substep, and the rest, evaluated once
+// per step.
+namespace contactsubsteps
+{
+  // Adds the gradients at the scene's state of its forces other than its
+  // penalty forces to gradE.
+  void accumulateSmoothGradU( TwoDScene& scene, VectorXs& gradE );
+
+  // Adds the gradients at the scene's state of its penalty forces to gradE.
+  void accumulateContactGradU( TwoDScene& scene, VectorXs& gradE );
+
+  // Has each penalty force of the scene hold its candidates for a step of
+  // dt, with a margin of twice the farthest a free particle goes in it,
+  // dt*|v + dt*F/m| from the start of the step. Returns false if the scene
+  // has no penalty force.
+  bool holdCandidates( TwoDScene& scene, const VectorXs& F, scalar dt );
+
+  void releaseCandidates( TwoDScene& scene );
+}
+#endif
+
+#endif
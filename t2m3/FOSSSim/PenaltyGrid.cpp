@@ -0,0 +1,452 @@
+#include "PenaltyGrid.h"
+#include "TwoDScene.h"
+#include "TaskPool.h"
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <limits>
+
+namespace
+{
+
+// Grains, each tunable through FOSSSIM_GRAIN by the name it is looked up
+// by. Below penalty.keys binned particles the sort stays serial.
+const int KEY_GRAIN = 4096;
+const int CELL_GRAIN = 256;
+
+const int RADIX_BITS = 8;
+const int NUM_DIGITS = 1 << RADIX_BITS;
+
+// Cells are this much wider than the largest binned diameter, so that the
+// rounding of x/cellsize cannot put two particles whose boxes overlap two
+// cells apart.
+const scalar CELL_SLACK = 1.0e-6;
+
+// Cells are looked up in a table over the occupied span when it has at most
+// this many cells per binned particle, and by binary search on key beyond.
+const int TABLE_CELLS_PER_PARTICLE = 4;
+
+typedef unsigned long long Key;
+
+// The bits of v at the even positions of the result.
+Key spreadBits( unsigned int v )
+{
+  Key k = v;
+  k = ( k | ( k << 16 ) ) & 0x0000FFFF0000FFFFull;
+  k = ( k | ( k << 8 ) ) & 0x00FF00FF00FF00FFull;
+  k = ( k | ( k << 4 ) ) & 0x0F0F0F0F0F0F0F0Full;
+  k = ( k | ( k << 2 ) ) & 0x3333333333333333ull;
+  k = ( k | ( k << 1 ) ) & 0x5555555555555555ull;
+  return k;
+}
+
+// The Morton code of cell (i, j), which interleaves their bits, so that
+// cells close in the plane are mostly close in key order.
+Key morton( int i, int j )
+{
+  return spreadBits( (unsigned int) i ) | ( spreadBits( (unsigned int) j ) << 1 );
+}
+
+// Whether the boxes of two particles overlap, with the arithmetic of
+// broadphase::particleBox and AABB::overlaps.
+inline bool boxesOverlap( scalar x1, scalar y1, scalar r1, scalar x2, scalar y2, scalar r2 )
+{
+  return x1 - r1 <= x2 + r2 && x2 - r2 <= x1 + r1 && y1 - r1 <= y2 + r2 && y2 - r2 <= y1 + r1;
+}
+
+// What PenaltyForce::addParticleParticleGradEToTotal subtracts from the
+// gradient of particle 1 of the pair (1, 2) and adds to that of particle 2,
+// computed the same way. Returns false if the pair does not touch.
+inline bool pairTerm( scalar x1, scalar y1, scalar r1, scalar x2, scalar y2, scalar r2, scalar k, scalar h, Vector2s& term )
+{
+  const Vector2s p1( x1, y1 );
+  const Vector2s p2( x2, y2 );
+  const scalar reach = r1 + r2 + h;
+  if( !( ( p1 - p2 ).squaredNorm() < reach*reach ) ) return false;
+
+  const Vector2s n = p2 - p1;
+  const scalar len = n.norm();
+  Vector2s nhat = n/len;
+  if( len < 1e-10 ) return false;
+  nhat.normalize();
+  term = k*( len - r1 - r2 - h )*nhat;
+  return true;
+}
+
+// Adds particle i's share of its contact with j to g. The term is computed
+// with the lower index first, as the detector path orders pairs, so both
+// particles see the same bits.
+inline void gatherPair( int i, scalar xi, scalar yi, scalar ri, int j, scalar xj, scalar yj, scalar rj, scalar k, scalar h, Vector2s& g )
+{
+  if( !boxesOverlap( xi, yi, ri, xj, yj, rj ) ) return;
+  Vector2s term;
+  if( i < j )
+  {
+    if( pairTerm( xi, yi, ri, xj, yj, rj, k, h, term ) ) g -= term;
+  }
+  else if( pairTerm( xj, yj, rj, xi, yi, ri, k, h, term ) ) g += term;
+}
+
+// floor(v) clamped to [lo, hi], safe for values past int's range.
+int clampedFloor( scalar v, int lo, int hi )
+{
+  const scalar f = std::floor( v );
+  if( !( f > lo ) ) return lo;
+  if( !( f < hi ) ) return hi;
+  return (int) f;
+}
+
+}
+
+PenaltyGrid::PenaltyGrid()
+: m_radii()
+, m_binned()
+, m_large()
+, m_cellsize(1.0)
+, m_maxbinned(0.0)
+, m_xmin(0)
+, m_ymin(0)
+, m_xspan(0)
+, m_yspan(0)
+, m_ux()
+, m_uy()
+, m_keys()
+, m_order()
+, m_scratchkeys()
+, m_scratchorder()
+, m_index()
+, m_px()
+, m_py()
+, m_pr()
+, m_lx()
+, m_ly()
+, m_lr()
+, m_cellkeys()
+, m_cellstart()
+, m_cellx()
+, m_celly()
+, m_celltable()
+, m_adjacency()
+{}
+
+// Cells fit the particles up to twice the median radius, as DeviceStepper's
+// do, so that a few large ones do not coarsen the grid for all.
+void PenaltyGrid::split( const std::vector<scalar>& radii )
+{
+  m_radii = radii;
+  const int n = (int) radii.size();
+  scalar median = 0.0;
+  if( n > 0 )
+  {
+    std::vector<scalar> sorted = radii;
+    std::nth_element( sorted.begin(), sorted.begin() + n/2, sorted.end() );
+    median = sorted[n/2];
+  }
+  const scalar largestbinned = median > 0.0 ? 2.0*median : std::numeric_limits<scalar>::infinity();
+
+  m_binned.clear();
+  m_large.clear();
+  m_maxbinned = 0.0;
+  for( int i = 0; i < n; ++i )
+  {
+    if( radii[i] > largestbinned ) { m_large.push_back(i); continue; }
+    m_binned.push_back(i);
+    m_maxbinned = std::max( m_maxbinned, radii[i] );
+  }
+  m_cellsize = m_maxbinned > 0.0 ? 2.0*m_maxbinned*( 1.0 + CELL_SLACK ) : 1.0;
+}
+
+void PenaltyGrid::build( const TwoDScene& scene, const VectorXs& x )
+{
+  if( scene.getRadii() != m_radii ) split( scene.getRadii() );
+
+  TaskPool& pool = TaskPool::shared();
+  const int key_grain = TaskPool::grainSize( "penalty.keys", KEY_GRAIN );
+  const int nbinned = (int) m_binned.size();
+  const scalar inverse = 1.0/m_cellsize;
+
+  m_ux.resize( nbinned );
+  m_uy.resize( nbinned );
+  pool.parallelFor( 0, nbinned, key_grain, [&]( int lo, int hi )
+  {
+    for( int k = lo; k < hi; ++k )
+    {
+      const int i = m_binned[k];
+      m_ux[k] = (int) std::floor( x(2*i)*inverse );
+      m_uy[k] = (int) std::floor( x(2*i+1)*inverse );
+    }
+  } );
+
+  // Keys count cells from the lowest occupied one, so they stay small and
+  // the sort skips the digits they share.
+  int xmax = INT_MIN, ymax = INT_MIN;
+  m_xmin = m_ymin = INT_MAX;
+  for( int k = 0; k < nbinned; ++k )
+  {
+    m_xmin = std::min( m_xmin, m_ux[k] );
+    m_ymin = std::min( m_ymin, m_uy[k] );
+    xmax = std::max( xmax, m_ux[k] );
+    ymax = std::max( ymax, m_uy[k] );
+  }
+  if( nbinned == 0 ) m_xmin = m_ymin = xmax = ymax = 0;
+  m_xspan = xmax - m_xmin;
+  m_yspan = ymax - m_ymin;
+
+  m_keys.resize( nbinned );
+  m_order.resize( nbinned );
+  pool.parallelFor( 0, nbinned, key_grain, [&]( int lo, int hi )
+  {
+    for( int k = lo; k < hi; ++k )
+    {
+      m_ux[k] -= m_xmin;
+      m_uy[k] -= m_ymin;
+      m_keys[k] = morton( m_ux[k], m_uy[k] );
+      m_order[k] = k;
+    }
+  } );
+  sortByKey();
+
+  m_index.resize( nbinned );
+  m_px.resize( nbinned );
+  m_py.resize( nbinned );
+  m_pr.resize( nbinned );
+  pool.parallelFor( 0, nbinned, key_grain, [&]( int lo, int hi )
+  {
+    for( int s = lo; s < hi; ++s )
+    {
+      const int i = m_binned[m_order[s]];
+      m_index[s] = i;
+      m_px[s] = x(2*i);
+      m_py[s] = x(2*i+1);
+      m_pr[s] = m_radii[i];
+    }
+  } );
+
+  m_cellkeys.clear();
+  m_cellstart.clear();
+  m_cellx.clear();
+  m_celly.clear();
+  for( int s = 0; s < nbinned; ++s )
+  {
+    if( s > 0 && m_keys[s] == m_keys[s-1] ) continue;
+    m_cellkeys.push_back( m_keys[s] );
+    m_cellstart.push_back( s );
+    m_cellx.push_back( m_ux[m_order[s]] );
+    m_celly.push_back( m_uy[m_order[s]] );
+  }
+  m_cellstart.push_back( nbinned );
+
+  m_celltable.clear();
+  const long long spancells = (long long) ( m_xspan+1 )*( m_yspan+1 );
+  if( spancells <= (long long) TABLE_CELLS_PER_PARTICLE*nbinned )
+  {
+    m_celltable.assign( spancells, -1 );
+    for( int c = 0; c < getNumCells(); ++c ) m_celltable[m_celly[c]*( m_xspan+1 ) + m_cellx[c]] = c;
+  }
+
+  const int nlarge = (int) m_large.size();
+  m_lx.resize( nlarge );
+  m_ly.resize( nlarge );
+  m_lr.resize( nlarge );
+  for( int l = 0; l < nlarge; ++l )
+  {
+    m_lx[l] = x(2*m_large[l]);
+    m_ly[l] = x(2*m_large[l]+1);
+    m_lr[l] = m_radii[m_large[l]];
+  }
+}
+
+// Least significant digit first. Each chunk of the keys, one per thread,
+// counts its digits, and the prefix over (digit, chunk) gives each chunk its
+// write cursors, so the sort is stable whatever the chunks, as in the
+// contest detector's grid. Digits every key shares are skipped.
+void PenaltyGrid::sortByKey()
+{
+  TaskPool& pool = TaskPool::shared();
+  const int n = (int) m_keys.size();
+  if( n < 2 ) return;
+
+  Key varying = 0;
+  for( int k = 1; k < n; ++k ) varying |= m_keys[k] ^ m_keys[0];
+
+  const int nchunks = n > TaskPool::grainSize( "penalty.keys", KEY_GRAIN ) ? pool.getNumThreads() : 1;
+  std::vector<int> chunk( nchunks+1 );
+  for( int t = 0; t <= nchunks; ++t ) chunk[t] = (int) ( ( (long long) n*t )/nchunks );
+  std::vector<int> counts( nchunks*NUM_DIGITS );
+  m_scratchkeys.resize( n );
+  m_scratchorder.resize( n );
+
+  for( int shift = 0; shift < 64; shift += RADIX_BITS )
+  {
+    if( ( ( varying >> shift ) & ( NUM_DIGITS-1 ) ) == 0 ) continue;
+
+    std::fill( counts.begin(), counts.end(), 0 );
+    pool.parallelFor( 0, nchunks, 1, [&]( int lo, int hi )
+    {
+      for( int t = lo; t < hi; ++t )
+      {
+        int* count = &counts[t*NUM_DIGITS];
+        for( int k = chunk[t]; k < chunk[t+1]; ++k ) ++count[( m_keys[k] >> shift ) & ( NUM_DIGITS-1 )];
+      }
+    } );
+
+    int total = 0;
+    for( int d = 0; d < NUM_DIGITS; ++d )
+      for( int t = 0; t < nchunks; ++t ) { const int c = counts[t*NUM_DIGITS + d]; counts[t*NUM_DIGITS + d] = total; total += c; }
+
+    pool.parallelFor( 0, nchunks, 1, [&]( int lo, int hi )
+    {
+      for( int t = lo; t < hi; ++t )
+      {
+        int* cursor = &counts[t*NUM_DIGITS];
+        for( int k = chunk[t]; k < chunk[t+1]; ++k )
+        {
+          const int slot = cursor[( m_keys[k] >> shift ) & ( NUM_DIGITS-1 )]++;
+          m_scratchkeys[slot] = m_keys[k];
+          m_scratchorder[slot] = m_order[k];
+        }
+      }
+    } );
+    m_keys.swap( m_scratchkeys );
+    m_order.swap( m_scratchorder );
+  }
+}
+
+int PenaltyGrid::findCell( int cx, int cy ) const
+{
+  if( !m_celltable.empty() ) return m_celltable[cy*( m_xspan+1 ) + cx];
+  const Key key = morton( cx, cy );
+  const std::vector<Key>::const_iterator found = std::lower_bound( m_cellkeys.begin(), m_cellkeys.end(), key );
+  if( found == m_cellkeys.end() || *found != key ) return -1;
+  return int( found - m_cellkeys.begin() );
+}
+
+// Looks each cell of the range up by key, unless the range has more cells
+// than are occupied; then the occupied ones are scanned instead.
+template<class F>
+void PenaltyGrid::visitCells( int xmin, int ymin, int xmax, int ymax, const F& f ) const
+{
+  const int ncells = getNumCells();
+  if( (long long) ( xmax-xmin+1 )*( ymax-ymin+1 ) > ncells )
+  {
+    for( int c = 0; c < ncells; ++c )
+      if( m_cellx[c] >= xmin && m_cellx[c] <= xmax && m_celly[c] >= ymin && m_celly[c] <= ymax ) f(c);
+    return;
+  }
+  for( int cx = xmin; cx <= xmax; ++cx )
+    for( int cy = ymin; cy <= ymax; ++cy )
+    {
+      const int c = findCell( cx, cy );
+      if( c >= 0 ) f(c);
+    }
+}
+
+// A cell either side more than the growth needs, for the rounding of the
+// grown box.
+bool PenaltyGrid::cellRange( const AABB& box, int& xmin, int& ymin, int& xmax, int& ymax ) const
+{
+  if( m_cellkeys.empty() ) return false;
+  const scalar inverse = 1.0/m_cellsize;
+  xmin = clampedFloor( ( box.min.x() - m_maxbinned )*inverse - m_xmin, -1, m_xspan + 1 ) - 1;
+  ymin = clampedFloor( ( box.min.y() - m_maxbinned )*inverse - m_ymin, -1, m_yspan + 1 ) - 1;
+  xmax = clampedFloor( ( box.max.x() + m_maxbinned )*inverse - m_xmin, -1, m_xspan + 1 ) + 1;
+  ymax = clampedFloor( ( box.max.y() + m_maxbinned )*inverse - m_ymin, -1, m_yspan + 1 ) + 1;
+  xmin = std::max( xmin, 0 );
+  ymin = std::max( ymin, 0 );
+  xmax = std::min( xmax, m_xspan );
+  ymax = std::min( ymax, m_yspan );
+  return xmin <= xmax && ymin <= ymax;
+}
+
+void PenaltyGrid::addParticleParticleGradEToTotal( scalar k, scalar h, VectorXs& gradE ) const
+{
+  TaskPool& pool = TaskPool::shared();
+  const int ncells = getNumCells();
+  const int nlarge = (int) m_large.size();
+
+  pool.parallelFor( 0, ncells, TaskPool::grainSize( "penalty.cells", CELL_GRAIN ), [&]( int lo, int hi )
+  {
+    for( int c = lo; c < hi; ++c )
+    {
+      // The occupied cells of the 3x3 block around c.
+      int neighbours[9];
+      int nneighbours = 0;
+      for( int dx = -1; dx <= 1; ++dx )
+        for( int dy = -1; dy <= 1; ++dy )
+        {
+          const int cx = m_cellx[c] + dx;
+          const int cy = m_celly[c] + dy;
+          if( cx < 0 || cy < 0 || cx > m_xspan || cy > m_yspan ) continue;
+          const int found = dx == 0 && dy == 0 ? c : findCell( cx, cy );
+          if( found >= 0 ) neighbours[nneighbours++] = found;
+        }
+
+      for( int s = m_cellstart[c]; s < m_cellstart[c+1]; ++s )
+      {
+        const int i = m_index[s];
+        const scalar xi = m_px[s], yi = m_py[s], ri = m_pr[s];
+        Vector2s g = Vector2s::Zero();
+        for( int b = 0; b < nneighbours; ++b )
+          for( int t = m_cellstart[neighbours[b]]; t < m_cellstart[neighbours[b]+1]; ++t )
+            if( t != s ) gatherPair( i, xi, yi, ri, m_index[t], m_px[t], m_py[t], m_pr[t], k, h, g );
+        for( int l = 0; l < nlarge; ++l ) gatherPair( i, xi, yi, ri, m_large[l], m_lx[l], m_ly[l], m_lr[l], k, h, g );
+        gradE.segment<2>(2*i) += g;
+      }
+    }
+  } );
+
+  // The large particles gather from the cells their boxes cover, and from
+  // each other.
+  for( int l = 0; l < nlarge; ++l )
+  {
+    const int i = m_large[l];
+    const scalar xi = m_lx[l], yi = m_ly[l], ri = m_lr[l];
+    Vector2s g = Vector2s::Zero();
+    AABB box;
+    box.min = Vector2s( xi - ri, yi - ri );
+    box.max = Vector2s( xi + ri, yi + ri );
+    int xmin, ymin, xmax, ymax;
+    if( cellRange( box, xmin, ymin, xmax, ymax ) )
+    {
+      visitCells( xmin, ymin, xmax, ymax, [&]( int c )
+      {
+        for( int t = m_cellstart[c]; t < m_cellstart[c+1]; ++t ) gatherPair( i, xi, yi, ri, m_index[t], m_px[t], m_py[t], m_pr[t], k, h, g );
+      } );
+    }
+    for( int m = 0; m < nlarge; ++m )
+      if( m != l ) gatherPair( i, xi, yi, ri, m_large[m], m_lx[m], m_ly[m], m_lr[m], k, h, g );
+    gradE.segment<2>(2*i) += g;
+  }
+}
+
+void PenaltyGrid::findParticleEdgePairs( const TwoDScene& scene, const VectorXs& x, PEList& pepairs )
+{
+  const std::vector<std::pair<int,int> >& edges = scene.getEdges();
+  const std::vector<scalar>& edge_radii = scene.getEdgeRadii();
+  const int nlarge = (int) m_large.size();
+
+  pepairs.clear();
+  for( int e = 0; e < (int) edges.size(); ++e )
+  {
+    const AABB box = broadphase::edgeBox( x, x, edges[e], edge_radii[e] );
+    int xmin, ymin, xmax, ymax;
+    if( cellRange( box, xmin, ymin, xmax, ymax ) )
+    {
+      visitCells( xmin, ymin, xmax, ymax, [&]( int c )
+      {
+        for( int t = m_cellstart[c]; t < m_cellstart[c+1]; ++t )
+        {
+          AABB particle;
+          particle.min = Vector2s( m_px[t] - m_pr[t], m_py[t] - m_pr[t] );
+          particle.max = Vector2s( m_px[t] + m_pr[t], m_py[t] + m_pr[t] );
+          if( particle.overlaps(box) ) pepairs.push_back( std::make_pair( m_index[t], e ) );
+        }
+      } );
+    }
+    for( int l = 0; l < nlarge; ++l )
+      if( broadphase::particleBox( x, x, m_large[l], m_lr[l] ).overlaps(box) ) pepairs.push_back( std::make_pair( m_large[l], e ) );
+  }
+  broadphase::sortUnique( pepairs );
+  m_adjacency.update( scene );
+  broadphase::excludeNeighbours( m_adjacency, broadphase::exclusionRings(), pepairs );
+}
@@ -0,0 +1,123 @@
+#ifndef __PENALTY_GRID_H__
+#define __PENALTY_GRID_H__
+
+#include <vector>
+
+#include "MathDefs.h"
+#include "BroadPhase.h"
+#include "EdgeAdjacency.h"
+
+class TwoDScene;
+
+// The penalty force's particle contacts found and summed in one pass over a
+// grid, rather than listed by the contest detector, sorted, filtered and
+// handed to PenaltyForce a pair at a time. On the timing scenes most of a
+// step went to building and sorting that list, of which only a fraction
+// touch. Used by PenaltyForce when built with USE_FUSED_PENALTY_GRID.
+//
+// Each build keys the particles by the Morton code of their cell and sorts
+// them by key with a radix sort, each of the pool's threads counting and
+// scattering a chunk, so that each cell's particles are contiguous and
+// neighbouring cells mostly near each other. Occupied cells are then found
+// through a table over the span they occupy, or by key where that span is
+// sparse. Each particle gathers the penalty gradient of its contacts in the
+// 3x3 cells around its own, in a fixed order, and adds it to gradE itself:
+// no pair list is built, and the sums do not depend on the thread count.
+//
+// The contacts are those the contest detector's candidates give: pairs
+// whose boxes overlap and that are within thickness of touching, with
+// PenaltyForce's per-pair formulas, so forces agree with the detector
+// path's to rounding. As in DeviceStepper, particles of more than twice the
+// median radius, such as the corners of a box, are not binned. Every binned
+// particle tests each of them, each of them queries the cells its box
+// covers, and they test each other pair by pair. Particle-edge candidates
+// come from the cells each edge's box covers.
+class PenaltyGrid
+{
+public:
+  PenaltyGrid();
+
+  // Bins the scene's particles at x, for the queries below.
+  void build( const TwoDScene& scene, const VectorXs& x );
+
+  // Adds the particle-particle penalty gradient at the built positions to
+  // gradE.
+  void addParticleParticleGradEToTotal( scalar stiffness, scalar thickness, VectorXs& gradE ) const;
+
+  // The particle-edge candidates at the built positions as the contest
+  // detector reports them: sorted, and filtered by
+  // broadphase::excludeNeighbours.
+  void findParticleEdgePairs( const TwoDScene& scene, const VectorXs& x, PEList& pepairs );
+
+  int getNumCells() const { return (int) m_cellkeys.size(); }
+  scalar getCellSize() const { return m_cellsize; }
+
+private:
+  typedef unsigned long long Key;
+
+  // Splits the particles into binned and large ones and sizes the cells.
+  void split( const std::vector<scalar>& radii );
+
+  // Stable radix sort of m_keys, carrying m_order.
+  void sortByKey();
+
+  // The occupied cell at (cx, cy), within the span, or -1.
+  int findCell( int cx, int cy ) const;
+
+  // Calls f(cell) for every occupied cell within the cell range, each once.
+  template<class F>
+  void visitCells( int xmin, int ymin, int xmax, int ymax, const F& f ) const;
+
+  // The cell range of a box grown by the largest binned radius, relative to
+  // the origin; false if it misses every occupied cell.
+  bool cellRange( const AABB& box, int& xmin, int& ymin, int& xmax, int& ymax ) const;
+
+  // The radii the split was made for.
+  std::vector<scalar> m_radii;
+  std::vector<int> m_binned;
+  std::vector<int> m_large;
+  scalar m_cellsize;
+  scalar m_maxbinned;
+
+  // The lowest cell of a binned particle, and how many cells past it the
+  // highest is. Cell coordinates below are relative to the lowest.
+  int m_xmin;
+  int m_ymin;
+  int m_xspan;
+  int m_yspan;
+
+  // Each binned particle's cell, in the order of m_binned.
+  std::vector<int> m_ux;
+  std::vector<int> m_uy;
+
+  // Binned particles by key: the keys, where in m_binned each came from,
+  // the particles, their positions and radii.
+  std::vector<Key> m_keys;
+  std::vector<int> m_order;
+  std::vector<Key> m_scratchkeys;
+  std::vector<int> m_scratchorder;
+  std::vector<int> m_index;
+  std::vector<scalar> m_px;
+  std::vector<scalar> m_py;
+  std::vector<scalar> m_pr;
+
+  // The large particles' positions and radii, in the order of m_large.
+  std::vector<scalar> m_lx;
+  std::vector<scalar> m_ly;
+  std::vector<scalar> m_lr;
+
+  // Occupied cells in key order, where each starts in the sorted particles
+  // (with the particle count last), and their coordinates.
+  std::vector<Key> m_cellkeys;
+  std::vector<int> m_cellstart;
+  std::vector<int> m_cellx;
+  std::vector<int> m_celly;
+
+  // The occupied cell or -1 at each coordinate of the span, row by row,
+  // when the span is small enough to tabulate; empty otherwise.
+  std::vector<int> m_celltable;
+
+  EdgeAdjacency m_adjacency;
+};
+
+#endif
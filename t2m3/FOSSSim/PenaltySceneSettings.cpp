@@ -0,0 +1,219 @@
+#include "PenaltySceneSettings.h"
+
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+#include "DetectorRegistry.h"
+#include "FirstTouch.h"
+#include "PenaltyForce.h"
+#include "PeriodicDomain.h"
+#include "PhaseTimes.h"
+#include "SpringForce.h"
+
+namespace
+{
+
+void complain( const std::string& what )
+{
+  std::cerr << "\033[31;1mERROR IN PENALTYSCENESETTINGS:\033[m " << what << std::endl;
+}
+
+// Reads attribute name of record into value, if it has it. Returns false,
+// having said why, if it has it but it is not a number.
+bool readAttribute( const SceneRecord& record, const char* name, scalar& value )
+{
+  const std::string* text = record.findAttribute(name);
+  if( text == NULL ) return true;
+  char* end;
+  value = std::strtod(text->c_str(), &end);
+  if( end == text->c_str() || *end != '\0' )
+  {
+    complain("Attribute " + std::string(name) + " of <" + record.name + "> is not a number.");
+    return false;
+  }
+  return true;
+}
+
+bool endsWith( const std::string& text, const std::string& suffix )
+{
+  return text.size() >= suffix.size() && text.compare(text.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+}
+
+PenaltySceneSettings::PenaltySceneSettings()
+: dt(0.0)
+, duration(0.0)
+// The base library's defaults.
+, stiffness(100.0)
+, thickness(0.0)
+, detector()
+, drag(0.0)
+, maxsimfreq(0.0)
+, springs()
+{
+  gravity[0] = gravity[1] = 0.0;
+  periodic[0] = periodic[1] = false;
+  domainmin[0] = domainmin[1] = domainmax[0] = domainmax[1] = 0.0;
+}
+
+bool readPenaltySceneSettings( const std::vector<SceneRecord>& records, int numedges, PenaltySceneSettings& settings )
+{
+  bool penalty = false, detection = false;
+  for( std::vector<SceneRecord>::size_type i = 0; i < records.size(); ++i )
+  {
+    const SceneRecord& record = records[i];
+    const std::string* type = record.findAttribute("type");
+    bool ok = true;
+    if( record.name == "integrator" )
+    {
+      if( type == NULL || *type != "forward-backward-euler" )
+      {
+        complain("Only the forward-backward-euler integrator is supported.");
+        return false;
+      }
+      ok = readAttribute(record, "dt", settings.dt);
+    }
+    else if( record.name == "duration" )
+    {
+      ok = readAttribute(record, "time", settings.duration);
+    }
+    else if( record.name == "collision" )
+    {
+      if( type == NULL || *type != "penalty" )
+      {
+        complain("Only penalty collisions are supported.");
+        return false;
+      }
+      penalty = true;
+      ok = readAttribute(record, "k", settings.stiffness) && readAttribute(record, "thickness", settings.thickness);
+    }
+    else if( record.name == "collisiondetection" )
+    {
+      if( type == NULL || !detectors::isRegistered(*type) )
+      {
+        std::string types;
+        const std::vector<std::string> registered = detectors::registeredTypes();
+        for( std::vector<std::string>::size_type t = 0; t < registered.size(); ++t ) types += (t == 0 ? "" : ", ") + registered[t];
+        complain("Only the registered collision detectors are supported: " + types + ".");
+        return false;
+      }
+      settings.detector = *type;
+      detection = true;
+    }
+    else if( record.name == "simplegravity" )
+    {
+      scalar fx = 0.0, fy = 0.0;
+      ok = readAttribute(record, "fx", fx) && readAttribute(record, "fy", fy);
+      settings.gravity[0] += fx;
+      settings.gravity[1] += fy;
+    }
+    else if( record.name == "dragdamping" )
+    {
+      scalar b = 0.0;
+      ok = readAttribute(record, "b", b);
+      settings.drag += b;
+    }
+    else if( record.name == "springforce" )
+    {
+      PenaltySceneSettings::Spring spring;
+      scalar edge = -1.0;
+      spring.k = spring.l0 = spring.b = 0.0;
+      ok = readAttribute(record, "edge", edge) && readAttribute(record, "k", spring.k) && readAttribute(record, "l0", spring.l0) && readAttribute(record, "b", spring.b);
+      spring.edge = (int) edge;
+      if( ok && ( spring.edge < 0 || spring.edge >= numedges ) )
+      {
+        complain("A <springforce> names an edge the scene does not have.");
+        return false;
+      }
+      settings.springs.push_back(spring);
+    }
+    else if( record.name == "maxsimfreq" )
+    {
+      ok = readAttribute(record, "max", settings.maxsimfreq);
+    }
+    else if( record.name == "periodicdomain" )
+    {
+      static const char* const bounds[2][2] = { { "xmin", "xmax" }, { "ymin", "ymax" } };
+      for( int d = 0; d < 2 && ok; ++d )
+      {
+        const bool lower = record.findAttribute(bounds[d][0]) != NULL;
+        const bool upper = record.findAttribute(bounds[d][1]) != NULL;
+        ok = readAttribute(record, bounds[d][0], settings.domainmin[d]) && readAttribute(record, bounds[d][1], settings.domainmax[d]);
+        settings.periodic[d] = lower && upper;
+        if( ok && lower != upper )
+        {
+          complain("A <periodicdomain> gives only one bound along an axis.");
+          return false;
+        }
+        if( ok && settings.periodic[d] && !( settings.domainmax[d] > settings.domainmin[d] ) )
+        {
+          complain("A <periodicdomain> is empty along an axis.");
+          return false;
+        }
+      }
+    }
+    else if( record.name != "scene" && record.name != "description" && record.name != "viewport" && !endsWith(record.name, "color") )
+    {
+      complain("<" + record.name + "> is not supported.");
+      return false;
+    }
+    if( !ok ) return false;
+  }
+
+  if( !penalty || !detection )
+  {
+    complain("The scene must have penalty collisions with a collision detector.");
+    return false;
+  }
+  if( !( settings.dt > 0.0 ) || !( settings.duration > 0.0 ) )
+  {
+    complain("The scene needs a positive integrator dt and duration.");
+    return false;
+  }
+  return true;
+}
+
+void insertPenaltySceneForces( TwoDScene& scene, CollisionDetector& detector, const PenaltySceneSettings& settings )
+{
+  scene.insertForce(new PenaltyForce(scene, detector, settings.stiffness, settings.thickness));
+  for( std::vector<PenaltySceneSettings::Spring>::size_type s = 0; s < settings.springs.size(); ++s )
+  {
+    const PenaltySceneSettings::Spring& spring = settings.springs[s];
+    scene.insertForce(new SpringForce(scene.getEdge(spring.edge), spring.k, spring.l0, spring.b));
+  }
+  if( settings.hasPeriodicDomain() )
+    periodic::setDomain(scene, PeriodicDomain(Vector2s(settings.domainmin[0], settings.domainmin[1]), Vector2s(settings.domainmax[0], settings.domainmax[1]), settings.periodic[0], settings.periodic[1]));
+}
+
+void stepPenaltyScene( TwoDScene& scene, const PenaltySceneSettings& settings, VectorXs& gradE )
+{
+#ifdef PARALLEL_FIRST_TOUCH
+  firsttouch::placeSceneArrays(scene);
+#endif
+  VectorXs& x = scene.getX();
+  VectorXs& v = scene.getV();
+  const VectorXs& m = scene.getM();
+  const scalar dt = settings.dt;
+
+  {
+    phasetimes::ScopedPhase forces(phasetimes::FORCES);
+    gradE.setZero(x.size());
+    // The contest detector cannot take a scene without particles.
+    if( scene.getNumParticles() > 0 ) scene.accumulateGradU(gradE);
+  }
+
+  phasetimes::ScopedPhase integration(phasetimes::INTEGRATION);
+  for( int i = 0; i < scene.getNumParticles(); ++i )
+  {
+    if( scene.isFixed(i) ) continue;
+    for( int d = 0; d < 2; ++d )
+    {
+      const scalar g = gradE(2*i + d) + settings.drag*v(2*i + d) - m(2*i + d)*settings.gravity[d];
+      v(2*i + d) -= dt*g/m(2*i + d);
+      x(2*i + d) += dt*v(2*i + d);
+    }
+  }
+  periodic::wrapPositions(scene);
+}
@@ -0,0 +1,67 @@
+#ifndef __PENALTY_SCENE_SETTINGS_H__
+#define __PENALTY_SCENE_SETTINGS_H__
+
+#include <string>
+#include <vector>
+
+#include "MathDefs.h"
+#include "SceneBinary.h"
+
+class CollisionDetector;
+
+// The scene-wide settings and forces of a penalty-contact scene, read from
+// the records loadXMLScene and loadBinaryScene return, for the tools that
+// step such scenes without the base library's parser: FOSSSimMPI,
+// FOSSSimViewer's live mode and FOSSSimEmbed. Those step forward-backward
+// Euler with penalty collisions, through the contest detector or any other
+// registered with detectors::registerDetector, under simplegravity,
+// dragdamping and springforce forces, and nothing else.
+struct PenaltySceneSettings
+{
+  PenaltySceneSettings();
+
+  scalar dt;
+  scalar duration;
+  scalar stiffness;
+  scalar thickness;
+  // The registered type of the scene's <collisiondetection>.
+  std::string detector;
+  scalar gravity[2];
+  scalar drag;
+  // Steps per second at most, or 0 without a <maxsimfreq>.
+  scalar maxsimfreq;
+  // The bounds of a <periodicdomain>, along each axis it gives both of.
+  bool periodic[2];
+  scalar domainmin[2];
+  scalar domainmax[2];
+
+  bool hasPeriodicDomain() const { return periodic[0] || periodic[1]; }
+
+  struct Spring
+  {
+    int edge;
+    scalar k;
+    scalar l0;
+    scalar b;
+  };
+  std::vector<Spring> springs;
+};
+
+// Returns false, having said why, if the records ask for anything else.
+bool readPenaltySceneSettings( const std::vector<SceneRecord>& records, int numedges, PenaltySceneSettings& settings );
+
+// Gives the scene its penalty force, through detector, which the caller
+// makes with detectors::createDetector(settings.detector) and keeps for as
+// long as the scene, its springs and its periodic domain, if any, which the
+// caller clears before the scene goes.
+// The scene takes ownership of the forces; gravity and drag are applied by
+// stepPenaltyScene instead.
+void insertPenaltySceneForces( TwoDScene& scene, CollisionDetector& detector, const PenaltySceneSettings& settings );
+
+// Takes one forward-backward Euler step of settings.dt in place, as
+// SemiImplicitEuler takes them, wrapping the positions into any periodic
+// domain and, built with PARALLEL_FIRST_TOUCH, placing the scene's arrays
+// first. gradE is scratch space.
+void stepPenaltyScene( TwoDScene& scene, const PenaltySceneSettings& settings, VectorXs& gradE );
+
+#endif
@@ -0,0 +1,80 @@
+#include "PeriodicDomain.h"
+
+#include <cassert>
+#include <utility>
+#include <vector>
+
+#include "TwoDScene.h"
+
+namespace
+{
+
+// Scenes rarely number more than one, so a list searched in order beats a
+// map, and an empty one is a single test on the penalty force's every pair.
+typedef std::pair<const TwoDScene*, PeriodicDomain> SceneDomain;
+typedef std::vector<SceneDomain, Eigen::aligned_allocator<SceneDomain> > SceneDomains;
+SceneDomains g_domains;
+
+}
+
+PeriodicDomain::PeriodicDomain( const Vector2s& lower, const Vector2s& upper, bool periodicx, bool periodicy )
+: min( lower )
+, extent( upper - lower )
+{
+  assert( !periodicx || extent.x() > 0.0 );
+  assert( !periodicy || extent.y() > 0.0 );
+  periodic[0] = periodicx;
+  periodic[1] = periodicy;
+}
+
+void PeriodicDomain::wrap( VectorXs& x ) const
+{
+  for( int d = 0; d < 2; ++d )
+  {
+    if( !periodic[d] ) continue;
+    const scalar lower = min(d);
+    const scalar length = extent(d);
+    for( int k = d; k < x.size(); k += 2 )
+    {
+      const scalar u = x(k) - lower;
+      if( u >= 0.0 && u < length ) continue;
+      scalar w = u - length*std::floor( u/length );
+      // Rounding can land a tiny negative u on the upper side.
+      if( w >= length ) w -= length;
+      x(k) = lower + w;
+    }
+  }
+}
+
+namespace periodic
+{
+
+const PeriodicDomain* findDomain( const TwoDScene& scene )
+{
+  for( SceneDomains::size_type k = 0; k < g_domains.size(); ++k )
+    if( g_domains[k].first == &scene ) return &g_domains[k].second;
+  return NULL;
+}
+
+void setDomain( const TwoDScene& scene, const PeriodicDomain& domain )
+{
+  clearDomain( scene );
+  g_domains.push_back( std::make_pair( &scene, domain ) );
+}
+
+void clearDomain( const TwoDScene& scene )
+{
+  for( SceneDomains::size_type k = 0; k < g_domains.size(); ++k )
+  {
+    if( g_domains[k].first != &scene ) continue;
+    g_domains.erase( g_domains.begin() + k );
+    return;
+  }
+}
+
+void wrapPositions( TwoDScene& scene )
+{
+  if( const PeriodicDomain* domain = findDomain( scene ) ) domain->wrap( scene.getX() );
+}
+
+}
@@ -0,0 +1,65 @@
+#ifndef PERIODIC_DOMAIN_H
+#define PERIODIC_DOMAIN_H
+
+#include <cmath>
+
+#include "MathDefs.h"
+
+class TwoDScene;
+
+// A rectangular cell the scene repeats in, along either axis or both, so
+// that bulk statistics can be taken from a small cell without walls: a
+// particle leaving through one side comes back through the other, and
+// particles near opposite sides touch. TwoDScene is compiled into the base
+// library and cannot hold the domain, so it is registered per scene through
+// periodic::setDomain, and the contest detector, the narrow phase and the
+// penalty force look it up.
+//
+// Separations are minimum-image ones, each periodic axis's taken to the
+// nearest copy, which is exact while every contact reach is under half the
+// period. Particle-edge contacts image the particle and the far endpoint to
+// the near one, but the base library's SpringForce does not image, so
+// springs must not straddle a periodic side. Halfplanes are never imaged.
+struct PeriodicDomain
+{
+  PeriodicDomain( const Vector2s& lower, const Vector2s& upper, bool periodicx = true, bool periodicy = true );
+
+  Vector2s min;
+  Vector2s extent;
+  bool periodic[2];
+
+  scalar minimumImage( int axis, scalar d ) const
+  {
+    if( !periodic[axis] ) return d;
+    return d - extent(axis)*std::floor( d/extent(axis) + 0.5 );
+  }
+
+  Vector2s minimumImage( const Vector2s& d ) const
+  {
+    return Vector2s( minimumImage( 0, d.x() ), minimumImage( 1, d.y() ) );
+  }
+
+  // Moves the positions in x into the domain along its periodic axes.
+  void wrap( VectorXs& x ) const;
+
+  EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+};
+
+namespace periodic
+{
+  // The scene's domain, or NULL if it has none. Looking up a scene costs
+  // nothing while no domain is set.
+  const PeriodicDomain* findDomain( const TwoDScene& scene );
+
+  // Gives the scene a domain, replacing any it had, until cleared. Not to be
+  // called while the scene steps.
+  void setDomain( const TwoDScene& scene, const PeriodicDomain& domain );
+
+  // Must be called before a scene with a domain is destroyed.
+  void clearDomain( const TwoDScene& scene );
+
+  // Wraps the scene's positions if it has a domain.
+  void wrapPositions( TwoDScene& scene );
+}
+
+#endif
@@ -0,0 +1,59 @@
+#include "PhaseTimes.h"
+
+#include <atomic>
+#include <chrono>
+
+namespace
+{
+
+typedef std::chrono::steady_clock Clock;
+
+const char* const NAMES[phasetimes::NUM_PHASES] = { "broad phase", "contacts", "forces", "integration", "loading" };
+
+std::atomic<long long> g_nanoseconds[phasetimes::NUM_PHASES];
+
+// The phase running on this thread, and since when it has been.
+thread_local phasetimes::Phase t_current = phasetimes::NUM_PHASES;
+thread_local Clock::time_point t_since;
+
+// Adds the time since t_since to the current phase, and restarts it.
+void charge( const Clock::time_point& now )
+{
+  if( t_current != phasetimes::NUM_PHASES ) g_nanoseconds[t_current] += std::chrono::duration_cast<std::chrono::nanoseconds>(now - t_since).count();
+  t_since = now;
+}
+
+}
+
+namespace phasetimes
+{
+
+const char* getName( Phase phase )
+{
+  return NAMES[phase];
+}
+
+double getSeconds( Phase phase )
+{
+  return 1.0e-9*g_nanoseconds[phase].load();
+}
+
+void reset()
+{
+  for( int p = 0; p < NUM_PHASES; ++p ) g_nanoseconds[p] = 0;
+}
+
+ScopedPhase::ScopedPhase( Phase phase )
+: m_outer(t_current)
+{
+  charge(Clock::now());
+  t_current = phase;
+}
+
+ScopedPhase::~ScopedPhase()
+{
+  charge(Clock::now());
+  t_current = m_outer;
+}
+
+}
@@ -0,0 +1,50 @@
+#ifndef __PHASE_TIMES_H__
+#define __PHASE_TIMES_H__
+
+// Wall-clock time spent in each phase of a step, summed over the steps taken
+// since the last reset, for FOSSSimBench's scaling study. A phase is timed
+// by a ScopedPhase on the thread that runs it, and a phase opened inside
+// another pauses the outer one, so that the phases' times add up to the
+// step's rather than overlapping: the forces' time is that of the forces
+// other than the penalty contacts, whose broad phase and contacts have
+// phases of their own. Work a phase hands to the task pool counts towards
+// it through the thread waiting for it.
+//
+// The penalty force's broad phase and contacts are timed wherever they run;
+// the forces, the integration and loading only by the tools that step
+// penalty scenes themselves, through stepPenaltyScene and FOSSSimEmbed.
+namespace phasetimes
+{
+  enum Phase
+  {
+    BROAD_PHASE,
+    CONTACTS,
+    FORCES,
+    INTEGRATION,
+    LOADING,
+    NUM_PHASES
+  };
+
+  const char* getName( Phase phase );
+
+  // Seconds spent in phase since the last reset, over every thread.
+  double getSeconds( Phase phase );
+
+  void reset();
+
+  class ScopedPhase
+  {
+  public:
+    explicit ScopedPhase( Phase phase );
+    ~ScopedPhase();
+
+  private:
+    ScopedPhase( const ScopedPhase& );
+    ScopedPhase& operator=( const ScopedPhase& );
+
+    // The phase this one paused, or NUM_PHASES.
+    Phase m_outer;
+  };
+}
+
+#endif
@@ -0,0 +1,271 @@
+#include "SVGWriter.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+namespace
+{
+
+// Flushed to the file whenever it fills.
+const std::vector<char>::size_type BUFFER_BYTES = 1 << 16;
+
+// Room for any one primitive, so that put never has to check mid-number.
+const std::vector<char>::size_type PRIMITIVE_BYTES = 256;
+
+// Pixel values beyond this are clamped; they are off any image anyway.
+const double MAX_PIXELS = 1.0e12;
+
+void complain( const std::string& what )
+{
+  std::cerr << "\033[31;1mERROR IN SVGWRITER:\033[m " << what << std::endl;
+}
+
+// Whether any of the box [ xmin, xmax ] x [ ymin, ymax ] lies within the
+// image.
+bool overlapsImage( double xmin, double xmax, double ymin, double ymax, const SVGFrameOptions& options )
+{
+  return xmax >= 0.0 && ymax >= 0.0 && xmin <= options.width && ymin <= options.height;
+}
+
+bool sameColor( const SceneColor& a, const SceneColor& b )
+{
+  return a.r == b.r && a.g == b.g && a.b == b.b;
+}
+
+void drawParticles( SVGWriter& svg, const TwoDScene& scene, const VectorXs& x, const SceneAppearance& appearance, const SimToImageMap& map, const SVGFrameOptions& options )
+{
+  bool grouped = false;
+  SceneColor fill = { 0.0f, 0.0f, 0.0f };
+  for( int i = 0; i < scene.getNumParticles(); ++i )
+  {
+    const double r = map.scale*scene.getRadius(i);
+    if( r < options.lodradius ) continue;
+    const double px = map.imageX(x(2*i));
+    const double py = map.imageY(x(2*i+1));
+    if( !overlapsImage(px - r, px + r, py - r, py + r, options) ) continue;
+
+    const SceneColor& color = appearance.particlecolors[i];
+    if( !grouped || !sameColor(color, fill) )
+    {
+      if( grouped ) svg.endGroup();
+      svg.beginFillGroup(color);
+      fill = color;
+      grouped = true;
+    }
+    svg.circle(px, py, r);
+  }
+  if( grouped ) svg.endGroup();
+}
+
+void drawEdges( SVGWriter& svg, const TwoDScene& scene, const VectorXs& x, const SceneAppearance& appearance, const SimToImageMap& map, const SVGFrameOptions& options )
+{
+  bool grouped = false;
+  scalar radius = 0.0;
+  for( int e = 0; e < scene.getNumEdges(); ++e )
+  {
+    const std::pair<int,int>& edge = scene.getEdge(e);
+    const scalar r = scene.getEdgeRadii()[e];
+    const double halfwidth = map.scale*r;
+    const double x0 = map.imageX(x(2*edge.first));
+    const double y0 = map.imageY(x(2*edge.first+1));
+    const double x1 = map.imageX(x(2*edge.second));
+    const double y1 = map.imageY(x(2*edge.second+1));
+    if( !overlapsImage(std::min(x0, x1) - halfwidth, std::max(x0, x1) + halfwidth, std::min(y0, y1) - halfwidth, std::max(y0, y1) + halfwidth, options) ) continue;
+
+    if( !grouped || r != radius )
+    {
+      if( grouped ) svg.endGroup();
+      svg.beginStrokeGroup(appearance.edgecolor, 2.0*halfwidth);
+      radius = r;
+      grouped = true;
+    }
+    svg.line(x0, y0, x1, y1);
+  }
+  if( grouped ) svg.endGroup();
+}
+
+void drawHalfplanes( SVGWriter& svg, const TwoDScene& scene, const SceneAppearance& appearance, const SimToImageMap& map, const SVGFrameOptions& options )
+{
+  // Long enough to cross the image from any point on it.
+  const double extent = 2.0*( options.width + options.height );
+  for( int h = 0; h < scene.getNumHalfplanes(); ++h )
+  {
+    const std::pair<VectorXs,VectorXs>& halfplane = scene.getHalfplane(h);
+    Vector2s t( -halfplane.second(1), halfplane.second(0) );
+    if( t.norm() == 0.0 ) continue;
+    t.normalize();
+    const double px = map.imageX(halfplane.first(0));
+    const double py = map.imageY(halfplane.first(1));
+    svg.beginStrokeGroup(appearance.halfplanecolors[h], 1.0);
+    svg.line(px - extent*t.x(), py + extent*t.y(), px + extent*t.x(), py - extent*t.y());
+    svg.endGroup();
+  }
+}
+
+}
+
+SVGWriter::SVGWriter()
+: m_filename()
+, m_file(NULL)
+, m_buffer(BUFFER_BYTES + PRIMITIVE_BYTES)
+, m_used(0)
+, m_failed(false)
+{}
+
+SVGWriter::~SVGWriter()
+{
+  if( m_file != NULL ) close();
+}
+
+bool SVGWriter::open( const std::string& filename, int width, int height, const SceneColor& background )
+{
+  if( m_file != NULL ) close();
+  m_file = std::fopen(filename.c_str(), "wb");
+  if( m_file == NULL )
+  {
+    complain("Failed to create " + filename + ".");
+    return false;
+  }
+  m_filename = filename;
+  m_used = 0;
+  m_failed = false;
+
+  put("<?xml version=\"1.0\" encoding=\"UTF-8\" standalone=\"no\"?>\n<svg xmlns=\"http://www.w3.org/2000/svg\" version=\"1.1\" width=\"");
+  putNumber(width);
+  put("\" height=\"");
+  putNumber(height);
+  put("\">\n<rect width=\"100%\" height=\"100%\" fill=\"");
+  putColor(background);
+  put("\"/>\n");
+  return true;
+}
+
+bool SVGWriter::close()
+{
+  if( m_file == NULL ) return false;
+  put("</svg>\n");
+  flush();
+  m_failed = std::fclose(m_file) != 0 || m_failed;
+  m_file = NULL;
+  if( m_failed ) complain("Failed to write " + m_filename + ".");
+  return !m_failed;
+}
+
+void SVGWriter::beginFillGroup( const SceneColor& fill )
+{
+  put("<g fill=\"");
+  putColor(fill);
+  put("\">\n");
+}
+
+void SVGWriter::beginStrokeGroup( const SceneColor& stroke, double width )
+{
+  put("<g stroke=\"");
+  putColor(stroke);
+  put("\" stroke-width=\"");
+  putNumber(width);
+  put("\" stroke-linecap=\"round\">\n");
+}
+
+void SVGWriter::endGroup()
+{
+  put("</g>\n");
+}
+
+void SVGWriter::circle( double x, double y, double r )
+{
+  put("<circle cx=\"");
+  putNumber(x);
+  put("\" cy=\"");
+  putNumber(y);
+  put("\" r=\"");
+  putNumber(r);
+  put("\"/>\n");
+}
+
+void SVGWriter::line( double x0, double y0, double x1, double y1 )
+{
+  put("<line x1=\"");
+  putNumber(x0);
+  put("\" y1=\"");
+  putNumber(y0);
+  put("\" x2=\"");
+  putNumber(x1);
+  put("\" y2=\"");
+  putNumber(y1);
+  put("\"/>\n");
+}
+
+void SVGWriter::put( char c )
+{
+  m_buffer[m_used++] = c;
+}
+
+void SVGWriter::put( const char* text )
+{
+  while( *text != '\0' ) put(*text++);
+  if( m_used >= BUFFER_BYTES ) flush();
+}
+
+// Two decimals, without trailing zeros: 12.5, -3, 0.07.
+void SVGWriter::putNumber( double value )
+{
+  if( !( value == value ) ) value = 0.0;
+  value = std::max(-MAX_PIXELS, std::min(value, MAX_PIXELS));
+  long long hundredths = (long long) std::floor(std::abs(value)*100.0 + 0.5);
+  if( value < 0.0 && hundredths > 0 ) put('-');
+
+  char digits[24];
+  int count = 0;
+  long long whole = hundredths/100;
+  do
+  {
+    digits[count++] = (char) ( '0' + whole%10 );
+    whole /= 10;
+  }
+  while( whole > 0 );
+  while( count > 0 ) put(digits[--count]);
+
+  const int fraction = (int) ( hundredths%100 );
+  if( fraction == 0 ) return;
+  put('.');
+  put((char) ( '0' + fraction/10 ));
+  if( fraction%10 != 0 ) put((char) ( '0' + fraction%10 ));
+}
+
+void SVGWriter::putColor( const SceneColor& color )
+{
+  static const char HEX[] = "0123456789abcdef";
+  const float channels[] = { color.r, color.g, color.b };
+  put('#');
+  for( int c = 0; c < 3; ++c )
+  {
+    const int level = (int) std::floor(255.0f*std::max(0.0f, std::min(channels[c], 1.0f)) + 0.5f);
+    put(HEX[level >> 4]);
+    put(HEX[level & 15]);
+  }
+}
+
+void SVGWriter::flush()
+{
+  if( m_used > 0 && std::fwrite(&m_buffer[0], 1, m_used, m_file) != m_used ) m_failed = true;
+  m_used = 0;
+}
+
+SVGFrameOptions::SVGFrameOptions()
+: width(512)
+, height(512)
+, lodradius(0.5)
+{}
+
+bool writeSceneSVG( const std::string& filename, const TwoDScene& scene, const VectorXs& x, const SceneAppearance& appearance, const SVGFrameOptions& options )
+{
+  SVGWriter svg;
+  if( !svg.open(filename, options.width, options.height, appearance.background) ) return false;
+  const SimToImageMap map = computeSimToImageMap(appearance, options.width, options.height);
+  drawHalfplanes(svg, scene, appearance, map, options);
+  drawEdges(svg, scene, x, appearance, map, options);
+  drawParticles(svg, scene, x, appearance, map, options);
+  return svg.close();
+}
@@ -0,0 +1,77 @@
+#ifndef SVG_WRITER_H
+#define SVG_WRITER_H
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "SceneAppearance.h"
+
+// Writes an SVG document straight to a file as it is drawn, through a buffer
+// of its own, so that a frame of 100k particles is never held as strings.
+// Coordinates go out with two decimals, formatted by hand rather than
+// through a stream, and colours through a table of hex digits.
+//
+// Circles and lines take the fill or stroke of the group they are drawn in,
+// so that runs of particles of one colour, and all the edges, share a single
+// element's attributes instead of repeating them.
+class SVGWriter
+{
+public:
+  SVGWriter();
+
+  // Closes the document if still open.
+  ~SVGWriter();
+
+  // Starts a width by height document filled with background. Returns false,
+  // after printing why, if filename cannot be created.
+  bool open( const std::string& filename, int width, int height, const SceneColor& background );
+
+  // Ends the document and closes the file. Returns false, after printing why,
+  // if any of it failed to write.
+  bool close();
+
+  // Circles drawn until endGroup are filled with fill.
+  void beginFillGroup( const SceneColor& fill );
+
+  // Lines drawn until endGroup are stroked with stroke, width pixels wide.
+  void beginStrokeGroup( const SceneColor& stroke, double width );
+
+  void endGroup();
+
+  void circle( double x, double y, double r );
+  void line( double x0, double y0, double x1, double y1 );
+
+private:
+  SVGWriter( const SVGWriter& );
+  SVGWriter& operator=( const SVGWriter& );
+
+  void put( char c );
+  void put( const char* text );
+  void putNumber( double value );
+  void putColor( const SceneColor& color );
+  void flush();
+
+  std::string m_filename;
+  FILE* m_file;
+  std::vector<char> m_buffer;
+  std::vector<char>::size_type m_used;
+  bool m_failed;
+};
+
+struct SVGFrameOptions
+{
+  SVGFrameOptions();
+
+  int width;
+  int height;
+  // Particles whose radius is less than this many pixels are left out, as
+  // are particles and edges wholly outside the image; 0 keeps every one.
+  double lodradius;
+};
+
+// Writes scene with its particles at x as one SVG frame. Returns false, after
+// printing why, if the file could not be written.
+bool writeSceneSVG( const std::string& filename, const TwoDScene& scene, const VectorXs& x, const SceneAppearance& appearance, const SVGFrameOptions& options );
+
+#endif
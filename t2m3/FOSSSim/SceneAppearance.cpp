@@ -0,0 +1,78 @@
+#include "SceneAppearance.h"
+
+#include <algorithm>
+#include <sstream>
+
+namespace
+{
+
+bool readNumber( const SceneRecord& record, const char* name, double& value )
+{
+  const std::string* attribute = record.findAttribute(name);
+  if( attribute == NULL ) return false;
+  std::istringstream is(*attribute);
+  return (bool) ( is >> value );
+}
+
+bool readColor( const SceneRecord& record, SceneColor& color )
+{
+  double r, g, b;
+  if( !readNumber(record, "r", r) || !readNumber(record, "g", g) || !readNumber(record, "b", b) ) return false;
+  color.r = (float) r;
+  color.g = (float) g;
+  color.b = (float) b;
+  return true;
+}
+
+}
+
+void readSceneAppearance( const std::vector<SceneRecord>& records, const TwoDScene& scene, SceneAppearance& appearance )
+{
+  const SceneColor black = { 0.0f, 0.0f, 0.0f };
+  const SceneColor white = { 1.0f, 1.0f, 1.0f };
+  appearance.background = white;
+  appearance.edgecolor = black;
+  appearance.particlecolors.assign(scene.getNumParticles(), black);
+  appearance.halfplanecolors.assign(scene.getNumHalfplanes(), black);
+  appearance.paths.clear();
+  appearance.cx = 0.0;
+  appearance.cy = 0.0;
+  appearance.size = 1.0;
+
+  for( std::vector<SceneRecord>::size_type k = 0; k < records.size(); ++k )
+  {
+    const SceneRecord& record = records[k];
+    double index = -1.0;
+    SceneColor color;
+    if( record.name == "viewport" )
+    {
+      readNumber(record, "cx", appearance.cx);
+      readNumber(record, "cy", appearance.cy);
+      readNumber(record, "size", appearance.size);
+    }
+    else if( record.name == "backgroundcolor" && readColor(record, color) ) appearance.background = color;
+    else if( record.name == "edgecolor" && readColor(record, color) ) appearance.edgecolor = color;
+    else if( record.name == "particlecolor" && readNumber(record, "i", index) && readColor(record, color) )
+    {
+      if( index >= 0 && index < appearance.particlecolors.size() ) appearance.particlecolors[(int) index] = color;
+    }
+    else if( record.name == "halfplanecolor" && readNumber(record, "i", index) && readColor(record, color) )
+    {
+      if( index >= 0 && index < appearance.halfplanecolors.size() ) appearance.halfplanecolors[(int) index] = color;
+    }
+    else if( record.name == "particlepath" && readNumber(record, "i", index) && readColor(record, color) )
+    {
+      ScenePath path = { (int) index, 0.0, color };
+      if( index >= 0 && index < scene.getNumParticles() && readNumber(record, "duration", path.duration) && path.duration > 0.0 ) appearance.paths.push_back(path);
+    }
+  }
+}
+
+SimToImageMap computeSimToImageMap( const SceneAppearance& appearance, int width, int height )
+{
+  SimToImageMap map;
+  map.scale = 0.5*std::min(width, height)/appearance.size;
+  map.x0 = 0.5*width - map.scale*appearance.cx;
+  map.y0 = 0.5*height + map.scale*appearance.cy;
+  return map;
+}
@@ -0,0 +1,54 @@
+#ifndef SCENE_APPEARANCE_H
+#define SCENE_APPEARANCE_H
+
+#include <vector>
+
+#include "SceneBinary.h"
+
+// How a scene asks to be drawn: its <viewport> and its colours, read from the
+// records loadXMLScene and loadBinaryScene return, for the tools that draw
+// scenes without the base library's renderer.
+struct SceneColor
+{
+  float r, g, b;
+};
+
+// A particle whose track is drawn behind it, for duration seconds back.
+struct ScenePath
+{
+  int particle;
+  double duration;
+  SceneColor color;
+};
+
+struct SceneAppearance
+{
+  SceneColor background;
+  SceneColor edgecolor;
+  std::vector<SceneColor> particlecolors;
+  std::vector<SceneColor> halfplanecolors;
+  std::vector<ScenePath> paths;
+
+  // Center of the view and half the extent of its shorter side, in scene
+  // units.
+  double cx, cy, size;
+};
+
+// The scale and offsets that take scene coordinates to an image's pixels,
+// y down, for the view appearance asks for.
+struct SimToImageMap
+{
+  double scale;
+  double x0, y0;
+
+  double imageX( double x ) const { return x0 + scale*x; }
+  double imageY( double y ) const { return y0 - scale*y; }
+};
+
+SimToImageMap computeSimToImageMap( const SceneAppearance& appearance, int width, int height );
+
+// Reads the appearance of scene from its records. Anything the records do not
+// give is the base library's default: black on white, around the origin.
+void readSceneAppearance( const std::vector<SceneRecord>& records, const TwoDScene& scene, SceneAppearance& appearance );
+
+#endif
@@ -0,0 +1,459 @@
+#include "SceneBinary.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+#include <unistd.h>
+
+#include "TaskPool.h"
+#include "TwoDSceneBuilder.h"
+
+namespace
+{
+
+const char FSB_MAGIC[4] = { 'F', 'S', 'B', '1' };
+
+bool parseScalar( const XMLElement& element, const char* name, scalar& value )
+{
+  const std::string* attribute = element.findAttribute(name);
+  if( attribute == NULL ) return false;
+  const char* begin = attribute->c_str();
+  char* end = NULL;
+  errno = 0;
+  value = strtod(begin, &end);
+  return end != begin && *end == '\0' && errno == 0;
+}
+
+bool parseInt( const XMLElement& element, const char* name, int& value )
+{
+  const std::string* attribute = element.findAttribute(name);
+  if( attribute == NULL ) return false;
+  const char* begin = attribute->c_str();
+  char* end = NULL;
+  errno = 0;
+  const long parsed = strtol(begin, &end, 10);
+  value = (int) parsed;
+  return end != begin && *end == '\0' && errno == 0 && parsed == value;
+}
+
+void complain( const std::string& what, int index )
+{
+  std::cerr << "\033[31;1mERROR IN SCENEBINARY:\033[m Failed to parse " << what << " " << index << "." << std::endl;
+}
+
+template<class T>
+void writeArray( std::ofstream& ofs, const T* data, std::size_t count )
+{
+  if( count > 0 ) ofs.write(reinterpret_cast<const char*>(data), count*sizeof(T));
+}
+
+template<class T>
+void writeVector( std::ofstream& ofs, const std::vector<T>& data )
+{
+  if( !data.empty() ) writeArray(ofs, &data[0], data.size());
+}
+
+template<class T>
+bool readArray( std::ifstream& ifs, T* data, std::size_t count )
+{
+  if( count > 0 ) ifs.read(reinterpret_cast<char*>(data), count*sizeof(T));
+  return bool(ifs);
+}
+
+// Fills data, which is sized already.
+template<class T>
+bool readVector( std::ifstream& ifs, std::vector<T>& data )
+{
+  return readArray(ifs, data.empty() ? NULL : &data[0], data.size());
+}
+
+void writeString( std::ofstream& ofs, const std::string& s )
+{
+  const int length = (int) s.size();
+  writeArray(ofs, &length, 1);
+  writeArray(ofs, s.data(), s.size());
+}
+
+bool readString( std::ifstream& ifs, std::string& s )
+{
+  int length = 0;
+  if( !readArray(ifs, &length, 1) || length < 0 ) return false;
+  s.resize(length);
+  return length == 0 || readArray(ifs, &s[0], length);
+}
+
+// A scene's contents as flat arrays, and its other elements. The format
+// has no springs of its own; they are records.
+struct SceneArrays : public TwoDSceneBuilder
+{
+  std::vector<SceneRecord> records;
+};
+
+// Particles are parsed in batches of this many elements. Converting their
+// attributes to numbers is most of the work of reading a scene, so a batch
+// is split across the task pool's threads, PARTICLE_GRAIN at a time unless
+// FOSSSIM_GRAIN sets scene.particles; a batch at a time keeps the stream's
+// memory bounded.
+const int PARTICLE_BATCH_SIZE = 4096;
+const int PARTICLE_GRAIN = 256;
+
+// Appends the particles of elements to arrays and clears elements. Each
+// element is parsed into its own preallocated slot, so the order and the
+// values do not depend on the thread count.
+bool parseParticles( std::vector<XMLElement>& elements, SceneArrays& arrays )
+{
+  const int base = (int) arrays.m.size();
+  const int count = (int) elements.size();
+  arrays.x.resize(2*(base + count));
+  arrays.v.resize(2*(base + count));
+  arrays.m.resize(base + count);
+  arrays.radii.resize(base + count);
+  arrays.fixed.resize(base + count);
+
+  std::vector<unsigned char> valid(count);
+  TaskPool::shared().parallelFor( 0, count, TaskPool::grainSize("scene.particles", PARTICLE_GRAIN), [&]( int lo, int hi )
+  {
+    for( int k = lo; k < hi; ++k )
+    {
+      const XMLElement& element = elements[k];
+      const int i = base + k;
+      int isfixed = 0;
+      valid[k] = parseScalar(element, "px", arrays.x[2*i]) && parseScalar(element, "py", arrays.x[2*i+1]) &&
+                 parseScalar(element, "vx", arrays.v[2*i]) && parseScalar(element, "vy", arrays.v[2*i+1]) &&
+                 parseScalar(element, "m", arrays.m[i]) && parseInt(element, "fixed", isfixed) && parseScalar(element, "radius", arrays.radii[i]);
+      arrays.fixed[i] = isfixed != 0;
+    }
+  } );
+  elements.clear();
+
+  for( int k = 0; k < count; ++k )
+  {
+    if( valid[k] ) continue;
+    complain("particle", base + k);
+    return false;
+  }
+  return true;
+}
+
+// Streams the children of an XML scene's root into arrays; the vectors grow
+// geometrically as elements arrive.
+bool readXMLScene( const std::string& xmlfile, SceneArrays& arrays, SceneRecords which )
+{
+  XMLElementStream stream(xmlfile);
+  if( !stream.isOpen() )
+  {
+    std::cerr << "\033[31;1mERROR IN SCENEBINARY:\033[m Failed to open " << xmlfile << "." << std::endl;
+    return false;
+  }
+
+  XMLElement element;
+  int depth = 0;
+  std::vector<XMLElement> pending;
+  pending.reserve(PARTICLE_BATCH_SIZE);
+  if( !stream.next(element, depth) || element.name != "scene" )
+  {
+    std::cerr << "\033[31;1mERROR IN SCENEBINARY:\033[m " << xmlfile << " has no <scene> element." << std::endl;
+    return false;
+  }
+  while( stream.next(element, depth) )
+  {
+    if( depth == 0 ) break;
+    if( depth > 1 ) continue;
+    if( element.name == "particle" )
+    {
+      pending.push_back(XMLElement());
+      std::swap(pending.back(), element);
+      if( (int) pending.size() == PARTICLE_BATCH_SIZE && !parseParticles(pending, arrays) ) return false;
+    }
+    else if( element.name == "edge" )
+    {
+      int i, j;
+      scalar radius;
+      if( !parseInt(element, "i", i) || !parseInt(element, "j", j) || !parseScalar(element, "radius", radius) )
+      {
+        complain("edge", (int) arrays.edgeradii.size());
+        return false;
+      }
+      arrays.edges.push_back(i); arrays.edges.push_back(j);
+      arrays.edgeradii.push_back(radius);
+    }
+    else if( element.name == "halfplane" )
+    {
+      scalar px, py, nx, ny;
+      if( !parseScalar(element, "px", px) || !parseScalar(element, "py", py) || !parseScalar(element, "nx", nx) || !parseScalar(element, "ny", ny) )
+      {
+        complain("halfplane", (int) arrays.halfplanes.size()/4);
+        return false;
+      }
+      arrays.halfplanes.push_back(px); arrays.halfplanes.push_back(py);
+      arrays.halfplanes.push_back(nx); arrays.halfplanes.push_back(ny);
+    }
+    else if( which == ALL_RECORDS || !isAppearanceRecord(element.name) )
+    {
+      arrays.records.push_back(element);
+    }
+  }
+  if( !parseParticles(pending, arrays) ) return false;
+  if( stream.failed() )
+  {
+    std::cerr << "\033[31;1mERROR IN SCENEBINARY:\033[m Failed to parse " << xmlfile << "." << std::endl;
+    return false;
+  }
+
+  // Endpoints are checked once every particle is known, as in the XML parser.
+  const int numparticles = (int) arrays.m.size();
+  for( std::vector<int>::size_type k = 0; k < arrays.edges.size(); ++k )
+  {
+    if( arrays.edges[k] < 0 || arrays.edges[k] >= numparticles )
+    {
+      complain("edge", (int) k/2);
+      return false;
+    }
+  }
+  return true;
+}
+
+// Writes arrays as a binary scene. Returns false if the file cannot be
+// written.
+bool writeBinaryScene( SceneArrays& arrays, const std::string& fsbfile )
+{
+  const std::vector<SceneRecord>& records = arrays.records;
+  std::ofstream ofs(fsbfile.c_str(), std::ios::binary);
+  if( !ofs ) return false;
+
+  FSBHeader header;
+  memcpy(header.magic, FSB_MAGIC, sizeof(header.magic));
+  header.numparticles = (int) arrays.m.size();
+  header.numedges = (int) arrays.edgeradii.size();
+  header.numhalfplanes = (int) arrays.halfplanes.size()/4;
+  header.numrecords = (int) records.size();
+  header.padding = 0;
+  writeArray(ofs, &header, 1);
+
+  arrays.fixed.resize((arrays.fixed.size() + 7)/8*8, 0);
+  writeVector(ofs, arrays.x);
+  writeVector(ofs, arrays.v);
+  writeVector(ofs, arrays.m);
+  writeVector(ofs, arrays.radii);
+  writeVector(ofs, arrays.fixed);
+  writeVector(ofs, arrays.edges);
+  writeVector(ofs, arrays.edgeradii);
+  writeVector(ofs, arrays.halfplanes);
+  for( std::vector<SceneRecord>::size_type r = 0; r < records.size(); ++r )
+  {
+    writeString(ofs, records[r].name);
+    const int numattributes = (int) records[r].attributes.size();
+    writeArray(ofs, &numattributes, 1);
+    for( int a = 0; a < numattributes; ++a )
+    {
+      writeString(ofs, records[r].attributes[a].first);
+      writeString(ofs, records[r].attributes[a].second);
+    }
+  }
+  ofs.close();
+  return bool(ofs);
+}
+
+// Moves arrays into scene and records, keeping the records which asks for.
+void takeSceneArrays( SceneArrays& arrays, TwoDScene& scene, std::vector<SceneRecord>& records, SceneRecords which )
+{
+  arrays.build(scene);
+  records.clear();
+  if( which == ALL_RECORDS )
+  {
+    records.swap(arrays.records);
+    return;
+  }
+  for( std::vector<SceneRecord>::size_type r = 0; r < arrays.records.size(); ++r )
+  {
+    if( isAppearanceRecord(arrays.records[r].name) ) continue;
+    records.push_back(SceneRecord());
+    std::swap(records.back(), arrays.records[r]);
+  }
+}
+
+bool endsWith( const std::string& s, const std::string& suffix )
+{
+  return s.size() >= suffix.size() && s.compare(s.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+}
+
+bool sceneCacheEnabled()
+{
+  const char* value = getenv("FOSSSIM_SCENE_CACHE");
+  return value != NULL && *value != '\0' && std::string(value) != "0";
+}
+
+bool isAppearanceRecord( const std::string& name )
+{
+  return name == "viewport" || name == "particlepath" || endsWith(name, "color");
+}
+
+bool convertXMLSceneToBinary( const std::string& xmlfile, const std::string& fsbfile )
+{
+  SceneArrays arrays;
+  if( !readXMLScene(xmlfile, arrays, ALL_RECORDS) ) return false;
+  if( !writeBinaryScene(arrays, fsbfile) )
+  {
+    std::cerr << "\033[31;1mERROR IN SCENEBINARY:\033[m Failed to write " << fsbfile << "." << std::endl;
+    return false;
+  }
+  return true;
+}
+
+bool loadBinaryScene( const std::string& fsbfile, TwoDScene& scene, std::vector<SceneRecord>& records, SceneRecords which )
+{
+  std::ifstream ifs(fsbfile.c_str(), std::ios::binary);
+  FSBHeader header;
+  if( !ifs || !readArray(ifs, &header, 1) || memcmp(header.magic, FSB_MAGIC, sizeof(header.magic)) != 0 ||
+      header.numparticles < 0 || header.numedges < 0 || header.numhalfplanes < 0 || header.numrecords < 0 )
+  {
+    std::cerr << "\033[31;1mERROR IN SCENEBINARY:\033[m " << fsbfile << " is not a binary scene." << std::endl;
+    return false;
+  }
+
+  const int n = header.numparticles;
+  records.clear();
+
+  // Each array is read whole into the builder, sized to fit.
+  TwoDSceneBuilder arrays;
+  arrays.x.resize(2*n);
+  arrays.v.resize(2*n);
+  arrays.m.resize(n);
+  arrays.radii.resize(n);
+  arrays.fixed.resize((n + 7)/8*8);
+  arrays.edges.resize(2*header.numedges);
+  arrays.edgeradii.resize(header.numedges);
+  arrays.halfplanes.resize(4*header.numhalfplanes);
+  bool ok = readVector(ifs, arrays.x) && readVector(ifs, arrays.v) && readVector(ifs, arrays.m) && readVector(ifs, arrays.radii) &&
+            readVector(ifs, arrays.fixed) && readVector(ifs, arrays.edges) && readVector(ifs, arrays.edgeradii) && readVector(ifs, arrays.halfplanes);
+  for( int r = 0; ok && r < header.numrecords; ++r )
+  {
+    SceneRecord record;
+    int numattributes = 0;
+    ok = readString(ifs, record.name) && readArray(ifs, &numattributes, 1) && numattributes >= 0;
+    for( int a = 0; ok && a < numattributes; ++a )
+    {
+      std::pair<std::string, std::string> attribute;
+      ok = readString(ifs, attribute.first) && readString(ifs, attribute.second);
+      record.attributes.push_back(attribute);
+    }
+    if( which == ALL_RECORDS || !isAppearanceRecord(record.name) ) records.push_back(record);
+  }
+  if( !ok || !arrays.endpointsValid() )
+  {
+    std::cerr << "\033[31;1mERROR IN SCENEBINARY:\033[m " << fsbfile << " is truncated or corrupt." << std::endl;
+    return false;
+  }
+
+  arrays.build(scene);
+  return true;
+}
+
+bool loadXMLScene( const std::string& xmlfile, TwoDScene& scene, std::vector<SceneRecord>& records, SceneRecords which )
+{
+  SceneArrays arrays;
+  if( !readXMLScene(xmlfile, arrays, which) ) return false;
+  takeSceneArrays(arrays, scene, records, ALL_RECORDS);
+  return true;
+}
+
+std::string sceneCacheFile( const std::string& xmlfile )
+{
+  std::ifstream ifs(xmlfile.c_str(), std::ios::binary);
+  if( !ifs ) return "";
+
+  // 64-bit FNV-1a of the format's magic and the XML's bytes.
+  unsigned long long hash = 14695981039346656037ULL;
+  const unsigned long long prime = 1099511628211ULL;
+  for( std::size_t k = 0; k < sizeof(FSB_MAGIC); ++k ) hash = ( hash ^ (unsigned char) FSB_MAGIC[k] )*prime;
+  std::vector<char> buffer(1 << 16);
+  while( ifs )
+  {
+    ifs.read(&buffer[0], buffer.size());
+    const std::streamsize count = ifs.gcount();
+    for( std::streamsize k = 0; k < count; ++k ) hash = ( hash ^ (unsigned char) buffer[k] )*prime;
+  }
+  if( !ifs.eof() ) return "";
+
+  char name[17];
+  snprintf(name, sizeof(name), "%016llx", hash);
+  return xmlfile + "." + name + ".fsb";
+}
+
+bool loadScene( const std::string& scenefile, TwoDScene& scene, std::vector<SceneRecord>& records, SceneRecords which )
+{
+  if( endsWith(scenefile, ".fsb") ) return loadBinaryScene(scenefile, scene, records, which);
+  if( !sceneCacheEnabled() ) return loadXMLScene(scenefile, scene, records, which);
+
+  const std::string cachefile = sceneCacheFile(scenefile);
+  if( cachefile.empty() ) return loadXMLScene(scenefile, scene, records, which);
+  if( std::ifstream(cachefile.c_str()) && loadBinaryScene(cachefile, scene, records, which) ) return true;
+
+  // Parsed once, then written to a file of this process's own and renamed,
+  // so that runs sharing the scene never read a partly written copy.
+  SceneArrays arrays;
+  if( !readXMLScene(scenefile, arrays, ALL_RECORDS) ) return false;
+  std::ostringstream partial;
+  partial << cachefile << "." << getpid();
+  if( !writeBinaryScene(arrays, partial.str()) || rename(partial.str().c_str(), cachefile.c_str()) != 0 ) remove(partial.str().c_str());
+  takeSceneArrays(arrays, scene, records, which);
+  return true;
+}
+
+bool parseSceneOverride( const std::string& text, SceneOverride& setting )
+{
+  const std::string::size_type equals = text.find('=');
+  const std::string::size_type dot = text.find('.');
+  if( equals == std::string::npos || dot == std::string::npos || dot == 0 || dot + 1 >= equals )
+  {
+    std::cerr << "\033[31;1mERROR IN SCENEBINARY:\033[m Override " << text << " is not of the form element.attribute=value." << std::endl;
+    return false;
+  }
+  setting.element = text.substr(0, dot);
+  setting.attribute = text.substr(dot + 1, equals - dot - 1);
+  setting.value = text.substr(equals + 1);
+  return true;
+}
+
+bool applySceneOverrides( const std::vector<SceneOverride>& overrides, std::vector<SceneRecord>& records )
+{
+  for( std::vector<SceneOverride>::size_type o = 0; o < overrides.size(); ++o )
+  {
+    const SceneOverride& setting = overrides[o];
+    bool found = false;
+    for( std::vector<SceneRecord>::size_type r = 0; r < records.size(); ++r )
+    {
+      if( records[r].name != setting.element ) continue;
+      found = true;
+      std::vector<std::pair<std::string, std::string> >& attributes = records[r].attributes;
+      std::vector<std::pair<std::string, std::string> >::size_type a = 0;
+      while( a < attributes.size() && attributes[a].first != setting.attribute ) ++a;
+      if( a == attributes.size() ) attributes.push_back(std::make_pair(setting.attribute, setting.value));
+      else attributes[a].second = setting.value;
+    }
+    if( !found )
+    {
+      std::cerr << "\033[31;1mERROR IN SCENEBINARY:\033[m Override " << setting.element << "." << setting.attribute << " names no <" << setting.element << "> in the scene." << std::endl;
+      return false;
+    }
+  }
+  return true;
+}
+
+bool applySceneOverrides( const std::vector<std::string>& texts, std::vector<SceneRecord>& records )
+{
+  std::vector<SceneOverride> overrides(texts.size());
+  for( std::vector<std::string>::size_type t = 0; t < texts.size(); ++t )
+  {
+    if( !parseSceneOverride(texts[t], overrides[t]) ) return false;
+  }
+  return applySceneOverrides(overrides, records);
+}
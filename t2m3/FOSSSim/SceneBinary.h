@@ -0,0 +1,114 @@
+#ifndef SCENE_BINARY_H
+#define SCENE_BINARY_H
+
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "TwoDScene.h"
+#include "XMLElementStream.h"
+
+// Compact binary scenes (.fsb), for scenes such as TimingScenes/test00.xml
+// whose 100k <particle> elements take seconds to read as XML. A file is
+//
+//   header    FSBHeader
+//   x, v      2*numparticles doubles each
+//   m         numparticles doubles, one per particle
+//   radii     numparticles doubles
+//   fixed     numparticles bytes, padded to a multiple of 8
+//   edges     2*numedges int32 endpoint indices
+//   edge radii numedges doubles
+//   halfplanes 4*numhalfplanes doubles, px py nx ny per halfplane
+//   records   numrecords SceneRecords
+//
+// in native byte order. The records are every other top-level element of the
+// XML scene, in document order, with its attributes kept as strings: forces,
+// the integrator, collision handling and so on. They are parsed once each,
+// so keeping them as text costs nothing, and the format does not have to
+// change whenever the parser learns a new element.
+struct FSBHeader
+{
+  // "FSB" followed by the format version.
+  char magic[4];
+  int numparticles;
+  int numedges;
+  int numhalfplanes;
+  int numrecords;
+  int padding;
+};
+
+typedef XMLElement SceneRecord;
+
+// Which records the loaders return. Tools that never draw the scene ask for
+// SIMULATION_RECORDS, and the records only drawing reads, the <viewport>,
+// colours and <particlepath>s, are dropped as they are read rather than
+// kept for the rest of the run; a scene colouring every particle has a
+// record per particle.
+enum SceneRecords
+{
+  ALL_RECORDS,
+  SIMULATION_RECORDS
+};
+
+// True for the records SIMULATION_RECORDS drops.
+bool isAppearanceRecord( const std::string& name );
+
+// Converts an XML scene to a binary one. Returns false, after printing why, if
+// the XML cannot be read or a particle, edge or halfplane is malformed. The
+// XML is streamed, so only the scene's arrays are ever held in memory.
+bool convertXMLSceneToBinary( const std::string& xmlfile, const std::string& fsbfile );
+
+// Streams the particles, edges and halfplanes of an XML scene into scene,
+// which is resized to fit and loses its previous edges and halfplanes, and
+// returns the other elements in records, as loadBinaryScene does.
+bool loadXMLScene( const std::string& xmlfile, TwoDScene& scene, std::vector<SceneRecord>& records, SceneRecords which = ALL_RECORDS );
+
+// Loads the arrays of a binary scene straight into scene, which is resized
+// to fit and loses its previous edges and halfplanes, and returns the other
+// elements in records. Returns false, after printing why, on a missing,
+// truncated or foreign file.
+bool loadBinaryScene( const std::string& fsbfile, TwoDScene& scene, std::vector<SceneRecord>& records, SceneRecords which = ALL_RECORDS );
+
+// Loads a binary scene if the name ends in .fsb, and an XML one otherwise.
+//
+// With FOSSSIM_SCENE_CACHE set to anything but 0, an XML scene is read from a
+// binary copy beside it, sceneCacheFile(xmlfile), which the first load of
+// that XML writes. Later runs of the same scene, such as the runs of a sweep
+// or of CI, then parse nothing. A copy is named for the XML's contents and
+// the binary format's version, so editing the scene or changing the format
+// makes a new one; old copies are left for the user to delete.
+bool loadScene( const std::string& scenefile, TwoDScene& scene, std::vector<SceneRecord>& records, SceneRecords which = ALL_RECORDS );
+
+// An attribute of a scene's records to replace, given on the command line as
+// --set element.attribute=value, such as --set integrator.dt=0.002 or --set
+// collision.k=500. Overrides are applied to the records the loaders return,
+// so a sweep over a parameter runs every point from the one scene file, or
+// its cached binary copy, rather than from a generated XML each.
+struct SceneOverride
+{
+  std::string element;
+  std::string attribute;
+  std::string value;
+};
+
+// Parses element.attribute=value. Returns false, after printing why, if text
+// is not of that form.
+bool parseSceneOverride( const std::string& text, SceneOverride& setting );
+
+// Gives every record named setting.element the attribute, replacing its
+// value or adding it, in the order the overrides are given. The value is
+// checked by whatever reads the record. Returns false, after printing why,
+// if no record has the name.
+bool applySceneOverrides( const std::vector<SceneOverride>& overrides, std::vector<SceneRecord>& records );
+
+// Parses the --set arguments texts and applies them to records.
+bool applySceneOverrides( const std::vector<std::string>& texts, std::vector<SceneRecord>& records );
+
+// Whether FOSSSIM_SCENE_CACHE is set to anything but 0.
+bool sceneCacheEnabled();
+
+// xmlfile.<hash>.fsb, for a 64-bit hash of the binary format's magic and the
+// XML's bytes, or "" if xmlfile cannot be read.
+std::string sceneCacheFile( const std::string& xmlfile );
+
+#endif
@@ -0,0 +1,159 @@
+#include "SceneGenerator.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <random>
+#include <sstream>
+
+#include "TwoDSceneBuilder.h"
+
+namespace
+{
+
+const int NUM_CORNERS = 4;
+const scalar WALL_RADIUS = 0.5;
+
+void complain( const std::string& what )
+{
+  std::cerr << "\033[31;1mERROR IN SCENEGENERATOR:\033[m " << what << std::endl;
+}
+
+std::string toString( scalar value )
+{
+  std::ostringstream oss;
+  oss.precision(17);
+  oss << value;
+  return oss.str();
+}
+
+SceneRecord makeRecord( const char* name )
+{
+  SceneRecord record;
+  record.name = name;
+  return record;
+}
+
+void addAttribute( SceneRecord& record, const char* name, const std::string& value )
+{
+  record.attributes.push_back(std::make_pair(std::string(name), value));
+}
+
+}
+
+SceneGeneratorOptions::SceneGeneratorOptions()
+: numparticles(1000)
+, numsprings(0)
+, seed(0)
+, density(0.2)
+, minradius(0.02)
+, maxradius(0.02)
+, maxspeed(0.5)
+, springstiffness(10000.0)
+, springdamping(0.5)
+, penaltystiffness(100.0)
+, dt(0.005)
+, duration(0.1)
+{}
+
+bool generateBoxScene( const SceneGeneratorOptions& options, TwoDScene& scene, std::vector<SceneRecord>& records, GeneratedSprings& springs )
+{
+  const int n = options.numparticles;
+  if( n < 1 || options.numsprings < 0 || !( options.minradius > 0.0 ) || options.maxradius < options.minradius || !( options.density > 0.0 ) || !( options.dt > 0.0 ) )
+  {
+    complain("The particle count, radii, density and time step must be positive and the spring count non-negative.");
+    return false;
+  }
+
+  // Cells of side h in rows of columns; the last row may be short.
+  const int columns = (int) std::ceil(std::sqrt((double) n));
+  const int rows = ( n + columns - 1 )/columns;
+  const scalar a = options.minradius;
+  const scalar b = options.maxradius;
+  const scalar meanarea = M_PI*( a*a + a*b + b*b )/3.0;
+  const scalar h = std::sqrt(n*meanarea/( options.density*columns*rows ));
+  if( 2.0*b > h )
+  {
+    complain("A density of " + toString(options.density) + " leaves no room for particles of radius " + toString(b) + ".");
+    return false;
+  }
+
+  const int rightneighbours = n - rows;
+  const int belowneighbours = n - columns;
+  if( options.numsprings > rightneighbours + belowneighbours )
+  {
+    complain("The lattice of " + toString(n) + " particles has room for only " + toString(rightneighbours + belowneighbours) + " springs.");
+    return false;
+  }
+
+  std::mt19937 generator(options.seed);
+  std::uniform_real_distribution<scalar> unit(0.0, 1.0);
+
+  TwoDSceneBuilder builder;
+  builder.reserve(NUM_CORNERS + n, NUM_CORNERS + options.numsprings);
+
+  const scalar halfwidth = 0.5*columns*h;
+  const scalar halfheight = 0.5*rows*h;
+  const scalar cx = halfwidth + WALL_RADIUS;
+  const scalar cy = halfheight + WALL_RADIUS;
+  const Vector2s corners[NUM_CORNERS] = { Vector2s(-cx, cy), Vector2s(-cx, -cy), Vector2s(cx, -cy), Vector2s(cx, cy) };
+  for( int c = 0; c < NUM_CORNERS; ++c ) builder.addParticle(corners[c], Vector2s::Zero(), 1.0, WALL_RADIUS, true);
+  for( int c = 0; c < NUM_CORNERS; ++c ) builder.addEdge(c, ( c + 1 )%NUM_CORNERS, WALL_RADIUS);
+
+  for( int i = 0; i < n; ++i )
+  {
+    const scalar radius = a + ( b - a )*unit(generator);
+    const scalar slack = 0.5*h - radius;
+    const Vector2s centre(-halfwidth + ( i%columns + 0.5 )*h, halfheight - ( i/columns + 0.5 )*h);
+    const Vector2s jitter(slack*( 2.0*unit(generator) - 1.0 ), slack*( 2.0*unit(generator) - 1.0 ));
+    const Vector2s velocity(options.maxspeed*( 2.0*unit(generator) - 1.0 ), options.maxspeed*( 2.0*unit(generator) - 1.0 ));
+    builder.addParticle(centre + jitter, velocity, 1.0, radius, false);
+  }
+
+  springs.firstedge = builder.getNumEdges();
+  springs.stiffness = options.springstiffness;
+  springs.damping = options.springdamping;
+  springs.restlengths.clear();
+  springs.restlengths.reserve(options.numsprings);
+  const std::vector<scalar>& x = builder.x;
+  const std::vector<scalar>& radii = builder.radii;
+  for( int pass = 0; pass < 2 && (int) springs.restlengths.size() < options.numsprings; ++pass )
+  {
+    for( int i = 0; i < n && (int) springs.restlengths.size() < options.numsprings; ++i )
+    {
+      const int j = pass == 0 ? i + 1 : i + columns;
+      if( j >= n || ( pass == 0 && j%columns == 0 ) ) continue;
+      const int p = NUM_CORNERS + i;
+      const int q = NUM_CORNERS + j;
+      builder.addEdge(p, q, std::min(radii[p], radii[q]));
+      springs.restlengths.push_back(( Vector2s(x[2*q], x[2*q+1]) - Vector2s(x[2*p], x[2*p+1]) ).norm());
+    }
+  }
+  builder.build(scene);
+
+  records.clear();
+  SceneRecord description = makeRecord("description");
+  addAttribute(description, "text", "A box of " + toString(n) + " generated particles with random initial position and velocity.");
+  records.push_back(description);
+  SceneRecord duration = makeRecord("duration");
+  addAttribute(duration, "time", toString(options.duration));
+  records.push_back(duration);
+  SceneRecord viewport = makeRecord("viewport");
+  addAttribute(viewport, "cx", "0");
+  addAttribute(viewport, "cy", "0");
+  addAttribute(viewport, "size", toString(std::max(cx, cy)));
+  records.push_back(viewport);
+  SceneRecord integrator = makeRecord("integrator");
+  addAttribute(integrator, "type", "forward-backward-euler");
+  addAttribute(integrator, "dt", toString(options.dt));
+  records.push_back(integrator);
+  SceneRecord collision = makeRecord("collision");
+  addAttribute(collision, "type", "penalty");
+  addAttribute(collision, "k", toString(options.penaltystiffness));
+  addAttribute(collision, "thickness", "0.0");
+  records.push_back(collision);
+  SceneRecord detection = makeRecord("collisiondetection");
+  addAttribute(detection, "type", "contest");
+  records.push_back(detection);
+  return true;
+}
@@ -0,0 +1,60 @@
+#ifndef SCENE_GENERATOR_H
+#define SCENE_GENERATOR_H
+
+#include <vector>
+
+#include "TwoDScene.h"
+#include "SceneBinary.h"
+
+// Synthetic scenes of any size, built straight into a TwoDScene, for
+// measuring how the simulation scales without writing the scene out as XML
+// first. A box scene is the layout of TimingScenes/test00.xml: particles
+// moving at random inside a square whose walls are four edges between fixed
+// corner particles. The moving particles sit one to a cell of a square
+// lattice, jittered within their cell, so the box is as large as the
+// requested density needs and no two particles start out overlapping. The
+// spring network joins lattice neighbours, right neighbours first and then
+// those below, in row order, until there are as many springs as asked for.
+struct SceneGeneratorOptions
+{
+  SceneGeneratorOptions();
+
+  // Moving particles; the four corner particles come on top.
+  int numparticles;
+  // Springs, at most about twice numparticles.
+  int numsprings;
+  unsigned seed;
+
+  // Fraction of the box's area the particles cover. At most pi/4, where the
+  // largest particles fill their cells.
+  scalar density;
+  // Radii are uniform in [minradius, maxradius].
+  scalar minradius;
+  scalar maxradius;
+  // Velocity components are uniform in [-maxspeed, maxspeed].
+  scalar maxspeed;
+
+  scalar springstiffness;
+  scalar springdamping;
+  scalar penaltystiffness;
+  scalar dt;
+  scalar duration;
+};
+
+// The springs of a generated scene, one for each edge from firstedge on,
+// at rest at the lengths the scene starts with.
+struct GeneratedSprings
+{
+  int firstedge;
+  scalar stiffness;
+  scalar damping;
+  std::vector<scalar> restlengths;
+};
+
+// Replaces scene with a box scene and returns its integrator, collision
+// handling and other scene-wide settings in records, as loadBinaryScene
+// does, but without a record per spring; those are in springs instead.
+// Returns false, after printing why, if the options cannot be met.
+bool generateBoxScene( const SceneGeneratorOptions& options, TwoDScene& scene, std::vector<SceneRecord>& records, GeneratedSprings& springs );
+
+#endif
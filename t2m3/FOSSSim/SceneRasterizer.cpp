@@ -0,0 +1,139 @@
+#include "SceneRasterizer.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+
+struct Pixel
+{
+  unsigned char r, g, b;
+};
+
+Pixel toPixel( const SceneColor& color )
+{
+  const float channels[] = { color.r, color.g, color.b };
+  unsigned char levels[3];
+  for( int c = 0; c < 3; ++c ) levels[c] = (unsigned char) std::floor(255.0f*std::max(0.0f, std::min(channels[c], 1.0f)) + 0.5f);
+  const Pixel pixel = { levels[0], levels[1], levels[2] };
+  return pixel;
+}
+
+void fillSpan( FrameImage& image, int row, int first, int last, const Pixel& pixel )
+{
+  unsigned char* out = &image.rgb[3*( row*image.width + first )];
+  for( int i = first; i <= last; ++i, out += 3 )
+  {
+    out[0] = pixel.r;
+    out[1] = pixel.g;
+    out[2] = pixel.b;
+  }
+}
+
+// The first and last row or column whose pixel centre lies in [ lo, hi ].
+int firstCentre( double lo ) { return (int) std::ceil(lo - 0.5); }
+int lastCentre( double hi ) { return (int) std::floor(hi - 0.5); }
+
+void fillCircle( FrameImage& image, double cx, double cy, double r, const Pixel& pixel )
+{
+  if( cx + r < 0.0 || cy + r < 0.0 || cx - r > image.width || cy - r > image.height ) return;
+  const int jmin = std::max(0, firstCentre(cy - r));
+  const int jmax = std::min(image.height - 1, lastCentre(cy + r));
+  for( int j = jmin; j <= jmax; ++j )
+  {
+    const double dy = j + 0.5 - cy;
+    const double w2 = r*r - dy*dy;
+    if( w2 < 0.0 ) continue;
+    const double w = std::sqrt(w2);
+    const int imin = std::max(0, firstCentre(cx - w));
+    const int imax = std::min(image.width - 1, lastCentre(cx + w));
+    if( imin <= imax ) fillSpan(image, j, imin, imax, pixel);
+  }
+
+  // The pixel a particle is in, however small it is.
+  const int i = (int) std::floor(cx);
+  const int j = (int) std::floor(cy);
+  if( i >= 0 && j >= 0 && i < image.width && j < image.height ) fillSpan(image, j, i, i, pixel);
+}
+
+// The pixels within halfwidth of the segment from ( x0, y0 ) to ( x1, y1 ),
+// at least half a pixel.
+void fillCapsule( FrameImage& image, double x0, double y0, double x1, double y1, double halfwidth, const Pixel& pixel )
+{
+  halfwidth = std::max(halfwidth, 0.5);
+  const int imin = std::max(0, firstCentre(std::min(x0, x1) - halfwidth));
+  const int imax = std::min(image.width - 1, lastCentre(std::max(x0, x1) + halfwidth));
+  const int jmin = std::max(0, firstCentre(std::min(y0, y1) - halfwidth));
+  const int jmax = std::min(image.height - 1, lastCentre(std::max(y0, y1) + halfwidth));
+  const double dx = x1 - x0;
+  const double dy = y1 - y0;
+  const double length2 = dx*dx + dy*dy;
+  const double h2 = halfwidth*halfwidth;
+  for( int j = jmin; j <= jmax; ++j )
+  {
+    const double py = j + 0.5 - y0;
+    int first = -1, last = -2;
+    for( int i = imin; i <= imax; ++i )
+    {
+      const double px = i + 0.5 - x0;
+      const double t = length2 > 0.0 ? std::max(0.0, std::min(( px*dx + py*dy )/length2, 1.0)) : 0.0;
+      const double ex = px - t*dx;
+      const double ey = py - t*dy;
+      if( ex*ex + ey*ey > h2 )
+      {
+        if( first >= 0 ) break;
+        continue;
+      }
+      if( first < 0 ) first = i;
+      last = i;
+    }
+    if( first >= 0 ) fillSpan(image, j, first, last, pixel);
+  }
+}
+
+}
+
+FrameImage::FrameImage()
+: width(0)
+, height(0)
+, rgb()
+{}
+
+void FrameImage::resize( int width, int height )
+{
+  this->width = width;
+  this->height = height;
+  rgb.resize(3*width*height);
+}
+
+void rasterizeScene( const TwoDScene& scene, const VectorXs& x, const SceneAppearance& appearance, FrameImage& image )
+{
+  const Pixel background = toPixel(appearance.background);
+  if( image.width > 0 )
+    for( int j = 0; j < image.height; ++j ) fillSpan(image, j, 0, image.width - 1, background);
+  const SimToImageMap map = computeSimToImageMap(appearance, image.width, image.height);
+
+  // Long enough to cross the image from any point on it.
+  const double extent = 2.0*( image.width + image.height );
+  for( int h = 0; h < scene.getNumHalfplanes(); ++h )
+  {
+    const std::pair<VectorXs,VectorXs>& halfplane = scene.getHalfplane(h);
+    Vector2s t( -halfplane.second(1), halfplane.second(0) );
+    if( t.norm() == 0.0 ) continue;
+    t.normalize();
+    const double px = map.imageX(halfplane.first(0));
+    const double py = map.imageY(halfplane.first(1));
+    fillCapsule(image, px - extent*t.x(), py + extent*t.y(), px + extent*t.x(), py - extent*t.y(), 0.5, toPixel(appearance.halfplanecolors[h]));
+  }
+
+  const Pixel edgecolor = toPixel(appearance.edgecolor);
+  for( int e = 0; e < scene.getNumEdges(); ++e )
+  {
+    const std::pair<int,int>& edge = scene.getEdge(e);
+    fillCapsule(image, map.imageX(x(2*edge.first)), map.imageY(x(2*edge.first+1)), map.imageX(x(2*edge.second)), map.imageY(x(2*edge.second+1)), map.scale*scene.getEdgeRadii()[e], edgecolor);
+  }
+
+  for( int i = 0; i < scene.getNumParticles(); ++i )
+    fillCircle(image, map.imageX(x(2*i)), map.imageY(x(2*i+1)), map.scale*scene.getRadius(i), toPixel(appearance.particlecolors[i]));
+}
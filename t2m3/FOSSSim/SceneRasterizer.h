@@ -0,0 +1,27 @@
+#ifndef SCENE_RASTERIZER_H
+#define SCENE_RASTERIZER_H
+
+#include <vector>
+
+#include "SceneAppearance.h"
+
+// An 8-bit RGB image, rows top to bottom.
+struct FrameImage
+{
+  FrameImage();
+
+  void resize( int width, int height );
+
+  int width;
+  int height;
+  std::vector<unsigned char> rgb;
+};
+
+// Draws scene with its particles at x into image, at image's size, without
+// OpenGL: halfplanes, then edges, then particles, each covering the pixels
+// whose centres it contains, as the base library's renderer draws them.
+// Particles smaller than a pixel still cover the one they are in, so that
+// zoomed-out frames of huge scenes do not come out empty.
+void rasterizeScene( const TwoDScene& scene, const VectorXs& x, const SceneAppearance& appearance, FrameImage& image );
+
+#endif
@@ -0,0 +1,374 @@
+#include "SemiImplicitEuler.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <utility>
+#include <vector>
+
+#include "PeriodicDomain.h"
+
+#ifdef PARALLEL_FIRST_TOUCH
+#include "FirstTouch.h"
+#endif
+
+#ifdef SLEEP_KINETIC_ENERGY
+#include "ParticleSleep.h"
+#endif
+
+#ifdef BLOCK_SUBSTEPS
+#include "BlockStepping.h"
+#endif
+
+#ifdef XPBD_ITERATIONS
+#include "XPBDSolver.h"
+#endif
+
+#ifdef DEVICE_STEPPING
+#include "DeviceStepper.h"
+#endif
+
+#ifdef CONTACT_SUBSTEPS
+#include "PenaltyForce.h"
+#endif
+
+#ifdef SHARED_STATE_NAME
+#include "SharedState.h"
+#endif
+
+#ifdef STEP_BUDGET_MILLISECONDS
+#include "StepBudget.h"
+#endif
+
+// Forward-backward Euler: v += dt*F(x,v)/m, then x += dt*v with the new
+// velocity. Fixed particles do not move; the update runs over the stretches
+// of free particles between them.
+//
+// Replaces the base library's stepper so that collision scenes can substep.
+// Built with CFL_SUBSTEP_FRACTION > 0, each step is split into as many equal
+// substeps as it takes for no particle to move more than that fraction of its
+// own radius in one, up to CFL_MAX_SUBSTEPS. The distance is the whole step's
+// dt*|v + dt*F/m| at the start of the step, so it sees the velocity the
+// contact forces are about to give a particle as well as the one it has.
+// Penalty forces are then evaluated often enough that a particle cannot pass
+// through another, or through an edge, between evaluations, without every step
+// of the scene paying for the smallest dt its fastest moment needs.
+//
+// Built with USE_BLOCK_SUBSTEPS as well, each particle instead takes its own
+// power-of-two share of the substeps, by its speed and its neighbours'; see
+// BlockStepping.h.
+//
+// Built with SLEEP_KINETIC_ENERGY > 0, sleeping particles are not integrated,
+// and islands are regrouped and put to sleep after each step; see
+// ParticleSleep.h.
+//
+// Built with CONTACT_SUBSTEPS > 0, each step of a scene with penalty forces
+// is instead split into that many equal substeps in which only the penalty
+// forces are evaluated again; the others, springs, gravity and drag, are
+// evaluated once at the start of the step and applied in every substep. The
+// penalty forces hold their candidates for the whole step, found once with a
+// margin for the step's motion under the other forces, rather than running
+// the detector at every substep; see contactsubsteps in PenaltyForce.h.
+//
+// Built with XPBD_ITERATIONS > 0, each step is instead taken by position-based
+// dynamics with that many constraint sweeps, and neither substepping nor
+// sleeping applies; see XPBDSolver.h.
+//
+// Built with USE_OPENMP_OFFLOAD, scenes of penalty contacts, gravity and drag
+// are stepped on an offload device instead; see DeviceStepper.h. Other scenes
+// are stepped here.
+//
+// Built with SHARED_STATE_NAME, every step's x and v are published in the
+// shared memory segment of that name for monitors to read; see SharedState.h.
+//
+// Built with PARALLEL_FIRST_TOUCH, the scene's arrays are spread over the
+// NUMA nodes of the task pool's threads before the first step and after any
+// reallocation; see FirstTouch.h.
+//
+// Built with STEP_BUDGET_MILLISECONDS > 0, a step over that much wall-clock
+// time has its next ones take fewer XPBD sweeps, or fewer CFL substeps than
+// their particles' speeds ask for, down to one; see StepBudget.h.
+
+namespace
+{
+
+#ifdef XPBD_ITERATIONS
+// The base library constructs the stepper, so the solver lives here.
+XPBDSolver g_xpbd(XPBD_ITERATIONS);
+#endif
+
+#ifdef DEVICE_STEPPING
+// Likewise the device's copy of the scene.
+DeviceStepper g_device;
+#endif
+
+#ifdef SHARED_STATE_NAME
+SharedStatePublisher g_shared(SHARED_STATE_NAME);
+#endif
+
+#ifdef STEP_BUDGET_MILLISECONDS
+StepBudget g_budget(STEP_BUDGET_MILLISECONDS*1.0e-3);
+#endif
+
+// The runs of consecutive free particles, [first, second), for the fixed
+// flags they were found for. The loops below go over the runs, so fixed
+// particles, usually a few at the start of a scene, are left out rather than
+// tested one by one, and a run's DoFs are one contiguous stretch.
+class FreeRuns
+{
+public:
+  const std::vector<std::pair<int,int> >& update( const TwoDScene& scene )
+  {
+    const int n = scene.getNumParticles();
+    bool changed = (int) m_fixed.size() != n;
+    m_fixed.resize(n);
+    for( int i = 0; i < n; ++i )
+    {
+      const char fixed = scene.isFixed(i);
+      changed = changed || fixed != m_fixed[i];
+      m_fixed[i] = fixed;
+    }
+    if( !changed ) return m_runs;
+
+    m_runs.clear();
+    for( int i = 0; i < n; )
+    {
+      while( i < n && m_fixed[i] ) ++i;
+      const int first = i;
+      while( i < n && !m_fixed[i] ) ++i;
+      if( i > first ) m_runs.push_back(std::make_pair(first, i));
+    }
+    return m_runs;
+  }
+
+private:
+  std::vector<char> m_fixed;
+  std::vector<std::pair<int,int> > m_runs;
+};
+
+// The base library constructs the stepper, so the runs live here too.
+FreeRuns g_free;
+
+// Applies one substep of h with F, the force at the current state.
+void advance( TwoDScene& scene, const VectorXs& F, scalar h )
+{
+  const std::vector<std::pair<int,int> >& runs = g_free.update(scene);
+  scalar* x = scene.getX().data();
+  scalar* v = scene.getV().data();
+  const scalar* m = scene.getM().data();
+  const scalar* f = F.data();
+  for( std::vector<std::pair<int,int> >::size_type r = 0; r < runs.size(); ++r )
+  {
+#ifdef SLEEP_KINETIC_ENERGY
+    for( int i = runs[r].first; i < runs[r].second; ++i )
+    {
+      if( sleeping::isAsleep(i) ) continue;
+      for( int k = 2*i; k < 2*i + 2; ++k )
+      {
+        v[k] += h*( f[k]/m[k] );
+        x[k] += h*v[k];
+      }
+    }
+#else
+    for( int k = 2*runs[r].first; k < 2*runs[r].second; ++k )
+    {
+      v[k] += h*( f[k]/m[k] );
+      x[k] += h*v[k];
+    }
+#endif
+  }
+}
+
+void computeForce( TwoDScene& scene, VectorXs& F )
+{
+  F.setZero(scene.getX().size());
+  scene.accumulateGradU(F);
+  F *= -1.0;
+}
+
+#if defined(CFL_SUBSTEP_FRACTION) && !defined(BLOCK_SUBSTEPS)
+// Substeps needed for no particle to move more than CFL_SUBSTEP_FRACTION of
+// its radius in each.
+int countSubsteps( const TwoDScene& scene, const VectorXs& F, scalar dt )
+{
+  const VectorXs& v = scene.getV();
+  const VectorXs& m = scene.getM();
+  const std::vector<scalar>& radii = scene.getRadii();
+  const std::vector<std::pair<int,int> >& runs = g_free.update(scene);
+  scalar worst = 0.0;
+  for( std::vector<std::pair<int,int> >::size_type r = 0; r < runs.size(); ++r )
+    for( int i = runs[r].first; i < runs[r].second; ++i )
+    {
+      if( !( radii[i] > 0.0 ) ) continue;
+      const Vector2s vnext = v.segment<2>(2*i) + dt*F.segment<2>(2*i).cwiseQuotient(m.segment<2>(2*i));
+      worst = std::max(worst, dt*vnext.norm()/radii[i]);
+    }
+  const scalar substeps = std::ceil(worst/CFL_SUBSTEP_FRACTION);
+  return (int) std::min<scalar>(CFL_MAX_SUBSTEPS, std::max<scalar>(1.0, substeps));
+}
+#endif
+
+#ifdef BLOCK_SUBSTEPS
+// The base library constructs the stepper, so the schedule lives here too.
+BlockSchedule g_schedule;
+std::vector<std::pair<int,int> > g_contacts;
+
+// Takes the step of dt with each particle substepping at its own level, from
+// F, the force at the start of the step with every particle active.
+void blockSubstep( TwoDScene& scene, VectorXs& F, scalar dt )
+{
+  int maxlevel = 0;
+  while( ( 2 << maxlevel ) <= CFL_MAX_SUBSTEPS ) ++maxlevel;
+  blockstepping::takeContacts(g_contacts);
+  g_schedule.assign(scene, F, dt, CFL_SUBSTEP_FRACTION, maxlevel, g_contacts);
+
+  const int finest = g_schedule.getFinestLevel();
+  const scalar h = dt/( 1 << finest );
+  const std::vector<std::pair<int,int> >& runs = g_free.update(scene);
+  for( int s = 0; s < ( 1 << finest ); ++s )
+  {
+    if( s > 0 )
+    {
+      blockstepping::activate(g_schedule, s);
+      computeForce(scene, F);
+    }
+    scalar* x = scene.getX().data();
+    scalar* v = scene.getV().data();
+    const scalar* m = scene.getM().data();
+    const scalar* f = F.data();
+    for( std::vector<std::pair<int,int> >::size_type r = 0; r < runs.size(); ++r )
+      for( int i = runs[r].first; i < runs[r].second; ++i )
+      {
+#ifdef SLEEP_KINETIC_ENERGY
+        if( sleeping::isAsleep(i) ) continue;
+#endif
+        if( g_schedule.startsSubstep(i, s) )
+        {
+          const scalar hi = h*( 1 << ( finest - g_schedule.getLevel(i) ) );
+          for( int k = 2*i; k < 2*i + 2; ++k ) v[k] += hi*( f[k]/m[k] );
+        }
+        for( int k = 2*i; k < 2*i + 2; ++k ) x[k] += h*v[k];
+      }
+  }
+  blockstepping::activateAll();
+}
+#endif
+
+#ifdef CONTACT_SUBSTEPS
+// Takes the step of dt in CONTACT_SUBSTEPS substeps of the penalty forces,
+// or in one if the scene has none.
+void substepContacts( TwoDScene& scene, scalar dt )
+{
+  VectorXs smooth;
+  smooth.setZero(scene.getX().size());
+  contactsubsteps::accumulateSmoothGradU(scene, smooth);
+  smooth *= -1.0;
+  // The contest detector cannot take a scene without particles.
+  if( scene.getNumParticles() == 0 || !contactsubsteps::holdCandidates(scene, smooth, dt) )
+  {
+    advance(scene, smooth, dt);
+    return;
+  }
+
+  const scalar h = dt/CONTACT_SUBSTEPS;
+  VectorXs gradE;
+  VectorXs F;
+  for( int s = 0; s < CONTACT_SUBSTEPS; ++s )
+  {
+    gradE.setZero(scene.getX().size());
+    contactsubsteps::accumulateContactGradU(scene, gradE);
+    F = smooth - gradE;
+    advance(scene, F, h);
+  }
+  contactsubsteps::releaseCandidates(scene);
+}
+#endif
+
+}
+
+SemiImplicitEuler::SemiImplicitEuler()
+: SceneStepper()
+{}
+
+SemiImplicitEuler::~SemiImplicitEuler()
+{}
+
+bool SemiImplicitEuler::stepScene( TwoDScene& scene, scalar dt )
+{
+  assert(scene.getX().size() == scene.getV().size());
+  assert(scene.getX().size() == scene.getM().size());
+
+#ifdef PARALLEL_FIRST_TOUCH
+  firsttouch::placeSceneArrays(scene);
+#endif
+
+#ifdef DEVICE_STEPPING
+  // The device's copy of the positions does not wrap.
+  if( periodic::findDomain(scene) == NULL && g_device.step(scene, dt) )
+  {
+#ifdef SHARED_STATE_NAME
+    g_shared.publish(scene.getX(), scene.getV(), dt);
+#endif
+    return true;
+  }
+#endif
+
+#if defined(XPBD_ITERATIONS) && defined(STEP_BUDGET_MILLISECONDS)
+  g_xpbd.step(scene, dt, &g_budget);
+#elif defined(XPBD_ITERATIONS)
+  g_xpbd.step(scene, dt);
+#elif defined(CONTACT_SUBSTEPS)
+  substepContacts(scene, dt);
+#ifdef SLEEP_KINETIC_ENERGY
+  sleeping::update(scene);
+#endif
+#else
+#if defined(CFL_SUBSTEP_FRACTION) && defined(STEP_BUDGET_MILLISECONDS)
+  // Every substep costs a force evaluation, the first one included, and an
+  // update; counting them is the fixed phase.
+  typedef std::chrono::steady_clock Clock;
+  const Clock::time_point start = Clock::now();
+#endif
+  VectorXs F;
+  computeForce(scene, F);
+
+#if defined(BLOCK_SUBSTEPS)
+  blockSubstep(scene, F, dt);
+#elif defined(CFL_SUBSTEP_FRACTION)
+#ifdef STEP_BUDGET_MILLISECONDS
+  const Clock::time_point forced = Clock::now();
+  const int substeps = g_budget.allow(countSubsteps(scene, F, dt), 1);
+  const Clock::time_point counted = Clock::now();
+#else
+  const int substeps = countSubsteps(scene, F, dt);
+#endif
+  const scalar h = dt/substeps;
+  for( int s = 0; s < substeps; ++s )
+  {
+    if( s > 0 ) computeForce(scene, F);
+    advance(scene, F, h);
+  }
+#ifdef STEP_BUDGET_MILLISECONDS
+  g_budget.record(std::chrono::duration<double>(counted - forced).count(), std::chrono::duration<double>(( forced - start ) + ( Clock::now() - counted )).count(), substeps);
+#endif
+#else
+  advance(scene, F, dt);
+#endif
+
+#ifdef SLEEP_KINETIC_ENERGY
+  sleeping::update(scene);
+#endif
+#endif
+  periodic::wrapPositions(scene);
+
+#ifdef SHARED_STATE_NAME
+  g_shared.publish(scene.getX(), scene.getV(), dt);
+#endif
+
+  return true;
+}
+
+std::string SemiImplicitEuler::getName() const
+{
+  return "Forward-Backward Euler";
+}
@@ -0,0 +1,204 @@
+#include "SharedState.h"
+
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <thread>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#if ATOMIC_LLONG_LOCK_FREE != 2 || ATOMIC_INT_LOCK_FREE != 2
+#error "Shared state needs lock-free atomics to share them between processes"
+#endif
+
+struct SharedStateHeader
+{
+  // "FSS" followed by the format version.
+  char magic[4];
+  int numparticles;
+  // Odd while a frame is being written.
+  std::atomic<std::uint64_t> sequence;
+  // Set once the segment has been replaced or removed.
+  std::atomic<int> retired;
+  int padding;
+  std::int64_t step;
+  double time;
+};
+
+namespace
+{
+
+const char MAGIC[4] = { 'F', 'S', 'S', '1' };
+
+size_t segmentSize( int numparticles )
+{
+  return sizeof(SharedStateHeader) + 4*numparticles*sizeof(double);
+}
+
+double* positions( SharedStateHeader* header )
+{
+  return reinterpret_cast<double*>(header + 1);
+}
+
+double* velocities( SharedStateHeader* header )
+{
+  return positions(header) + 2*header->numparticles;
+}
+
+}
+
+SharedStatePublisher::SharedStatePublisher( const std::string& name )
+: m_name(name)
+, m_failed(false)
+, m_header(NULL)
+, m_size(0)
+, m_step(0)
+, m_time(0.0)
+{}
+
+SharedStatePublisher::~SharedStatePublisher()
+{
+  remove();
+}
+
+void SharedStatePublisher::publish( const VectorXs& x, const VectorXs& v, scalar dt )
+{
+  ++m_step;
+  m_time += dt;
+  if( m_failed ) return;
+
+  const int numparticles = (int) x.size()/2;
+  if( m_header == NULL || m_header->numparticles != numparticles )
+  {
+    remove();
+    if( !create(numparticles) )
+    {
+      m_failed = true;
+      return;
+    }
+  }
+
+  const std::uint64_t sequence = m_header->sequence.load(std::memory_order_relaxed);
+  m_header->sequence.store(sequence + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  m_header->step = m_step;
+  m_header->time = m_time;
+  std::memcpy(positions(m_header), x.data(), 2*numparticles*sizeof(double));
+  std::memcpy(velocities(m_header), v.data(), 2*numparticles*sizeof(double));
+  m_header->sequence.store(sequence + 2, std::memory_order_release);
+}
+
+bool SharedStatePublisher::create( int numparticles )
+{
+  // A segment left behind by a run that did not finish is replaced.
+  shm_unlink(m_name.c_str());
+  const int fd = shm_open(m_name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+  if( fd < 0 )
+  {
+    std::cerr << "Unable to create shared memory segment " << m_name << ": " << std::strerror(errno) << std::endl;
+    return false;
+  }
+  const size_t size = segmentSize(numparticles);
+  void* segment = ftruncate(fd, size) == 0 ? mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0) : MAP_FAILED;
+  const int error = errno;
+  ::close(fd);
+  if( segment == MAP_FAILED )
+  {
+    std::cerr << "Unable to map shared memory segment " << m_name << ": " << std::strerror(error) << std::endl;
+    shm_unlink(m_name.c_str());
+    return false;
+  }
+
+  // ftruncate zeroes the segment, so the sequence starts at 0 and the
+  // segment is not retired.
+  m_header = static_cast<SharedStateHeader*>(segment);
+  m_size = size;
+  m_header->numparticles = numparticles;
+  std::memcpy(m_header->magic, MAGIC, sizeof(MAGIC));
+  return true;
+}
+
+void SharedStatePublisher::remove()
+{
+  if( m_header == NULL ) return;
+  m_header->retired.store(1, std::memory_order_release);
+  munmap(m_header, m_size);
+  shm_unlink(m_name.c_str());
+  m_header = NULL;
+  m_size = 0;
+}
+
+SharedStateReader::SharedStateReader( const std::string& name )
+: m_name(name)
+, m_header(NULL)
+, m_size(0)
+{}
+
+SharedStateReader::~SharedStateReader()
+{
+  close();
+}
+
+bool SharedStateReader::read( SharedStateFrame& frame )
+{
+  if( m_header != NULL && m_header->retired.load(std::memory_order_acquire) ) close();
+  if( m_header == NULL && !open() ) return false;
+
+  const int numparticles = m_header->numparticles;
+  frame.x.resize(2*numparticles);
+  frame.v.resize(2*numparticles);
+  for( ;; )
+  {
+    const std::uint64_t before = m_header->sequence.load(std::memory_order_acquire);
+    if( before == 0 ) return false;
+    if( before & 1 )
+    {
+      std::this_thread::yield();
+      continue;
+    }
+    frame.step = (long) m_header->step;
+    frame.time = m_header->time;
+    std::memcpy(frame.x.data(), positions(m_header), 2*numparticles*sizeof(double));
+    std::memcpy(frame.v.data(), velocities(m_header), 2*numparticles*sizeof(double));
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if( m_header->sequence.load(std::memory_order_relaxed) == before ) return true;
+  }
+}
+
+bool SharedStateReader::open()
+{
+  const int fd = shm_open(m_name.c_str(), O_RDONLY, 0);
+  if( fd < 0 ) return false;
+  struct stat status;
+  void* segment = MAP_FAILED;
+  // The segment may not have been sized yet.
+  if( fstat(fd, &status) == 0 && (size_t) status.st_size >= sizeof(SharedStateHeader) )
+  {
+    segment = mmap(NULL, status.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  }
+  ::close(fd);
+  if( segment == MAP_FAILED ) return false;
+
+  SharedStateHeader* header = static_cast<SharedStateHeader*>(segment);
+  if( std::memcmp(header->magic, MAGIC, sizeof(MAGIC)) != 0 || segmentSize(header->numparticles) != (size_t) status.st_size )
+  {
+    munmap(segment, status.st_size);
+    return false;
+  }
+  m_header = header;
+  m_size = status.st_size;
+  return true;
+}
+
+void SharedStateReader::close()
+{
+  if( m_header == NULL ) return;
+  munmap(m_header, m_size);
+  m_header = NULL;
+  m_size = 0;
+}
@@ -0,0 +1,85 @@
+#ifndef __SHARED_STATE_H__
+#define __SHARED_STATE_H__
+
+#include <string>
+
+#include "MathDefs.h"
+
+struct SharedStateHeader;
+
+// The latest x and v of a running simulation, published in a POSIX shared
+// memory segment for monitors in other processes, which read it at whatever
+// rate they like without ever holding up the simulation. The segment is
+//
+//   header    SharedStateHeader
+//   x, v      2*numparticles doubles each
+//
+// and is guarded by a sequence lock: the writer makes the sequence number
+// odd, copies the frame in and makes it even again, and a reader copies the
+// frame out and retries if the number was odd or changed meanwhile. A step
+// pays for one copy of x and v, and never waits.
+//
+// A scene that changes its number of particles gets a new segment of the
+// same name, and readers move to it on their next read.
+
+// Publishes frames under one name. The segment is made on the first publish
+// and removed when the publisher is destroyed.
+class SharedStatePublisher
+{
+public:
+  // name is as shm_open takes it, such as "/fosssim".
+  explicit SharedStatePublisher( const std::string& name );
+  ~SharedStatePublisher();
+
+  // Publishes x and v as the state after a step of dt. Prints why, once, and
+  // publishes nothing more if the segment cannot be made.
+  void publish( const VectorXs& x, const VectorXs& v, scalar dt );
+
+private:
+  SharedStatePublisher( const SharedStatePublisher& );
+  SharedStatePublisher& operator=( const SharedStatePublisher& );
+
+  bool create( int numparticles );
+  void remove();
+
+  std::string m_name;
+  bool m_failed;
+  SharedStateHeader* m_header;
+  size_t m_size;
+  long m_step;
+  scalar m_time;
+};
+
+// A frame as a reader sees it: the state after step steps, at time time.
+struct SharedStateFrame
+{
+  long step;
+  scalar time;
+  VectorXs x;
+  VectorXs v;
+};
+
+// Reads the frames published under one name.
+class SharedStateReader
+{
+public:
+  explicit SharedStateReader( const std::string& name );
+  ~SharedStateReader();
+
+  // Copies the latest frame into frame. Returns false if nothing has been
+  // published under the name yet, or it has been removed.
+  bool read( SharedStateFrame& frame );
+
+private:
+  SharedStateReader( const SharedStateReader& );
+  SharedStateReader& operator=( const SharedStateReader& );
+
+  bool open();
+  void close();
+
+  std::string m_name;
+  SharedStateHeader* m_header;
+  size_t m_size;
+};
+
+#endif
@@ -0,0 +1,40 @@
+#ifndef __SPRING_FORCE_H__
+#define __SPRING_FORCE_H__
+
+#include <Eigen/Core>
+#include "Force.h"
+#include <iostream>
+
+// The base library's spring. Declared here, with its layout, so that steppers
+// can read the springs the XML parser inserted into the scene.
+class SpringForce : public Force
+{
+public:
+
+  SpringForce( const std::pair<int,int>& endpoints, const scalar& k, const scalar& l0, const scalar& b = 0.0 );
+
+  virtual ~SpringForce();
+
+  virtual void addEnergyToTotal( const VectorXs& x, const VectorXs& v, const VectorXs& m, scalar& E );
+
+  virtual void addGradEToTotal( const VectorXs& x, const VectorXs& v, const VectorXs& m, VectorXs& gradE );
+
+  virtual void addHessXToTotal( const VectorXs& x, const VectorXs& v, const VectorXs& m, MatrixXs& hessE );
+
+  virtual void addHessVToTotal( const VectorXs& x, const VectorXs& v, const VectorXs& m, MatrixXs& hessE );
+
+  virtual Force* createNewCopy();
+
+  const std::pair<int,int>& getEndpoints() const { return m_endpoints; }
+  const scalar& getStiffness() const { return m_k; }
+  const scalar& getRestLength() const { return m_l0; }
+  const scalar& getDamping() const { return m_b; }
+
+private:
+  std::pair<int,int> m_endpoints;
+  scalar m_k;
+  scalar m_l0;
+  scalar m_b;
+};
+
+#endif
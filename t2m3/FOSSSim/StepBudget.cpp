@@ -0,0 +1,56 @@
+#include "StepBudget.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+namespace
+{
+
+// Weight of the latest step in the smoothed timings. One slow step, as when
+// the machine is briefly busy, moves the allowance by a quarter of what a
+// lasting slowdown does.
+const double SMOOTHING = 0.25;
+
+}
+
+StepBudget::StepBudget( double seconds )
+: m_seconds(seconds)
+, m_timed(false)
+, m_fixed(0.0)
+, m_perunit(0.0)
+, m_allowed(0)
+, m_cut(false)
+{
+  assert( seconds > 0.0 );
+}
+
+int StepBudget::allow( int wanted, int minimum )
+{
+  assert( minimum >= 1 && minimum <= wanted );
+  int units = wanted;
+  if( m_timed && m_perunit > 0.0 )
+  {
+    const double affordable = std::floor(( m_seconds - m_fixed )/m_perunit);
+    if( affordable < wanted ) units = (int) std::max<double>(minimum, affordable);
+    if( m_cut ) units = std::min(units, 2*m_allowed);
+  }
+  m_allowed = std::max(units, minimum);
+  m_cut = m_allowed < wanted;
+  return m_allowed;
+}
+
+void StepBudget::record( double fixedseconds, double scalableseconds, int units )
+{
+  assert( units > 0 );
+  const double perunit = scalableseconds/units;
+  if( !m_timed )
+  {
+    m_fixed = fixedseconds;
+    m_perunit = perunit;
+    m_timed = true;
+    return;
+  }
+  m_fixed += SMOOTHING*( fixedseconds - m_fixed );
+  m_perunit += SMOOTHING*( perunit - m_perunit );
+}
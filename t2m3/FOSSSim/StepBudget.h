@@ -0,0 +1,38 @@
+#ifndef __STEP_BUDGET_H__
+#define __STEP_BUDGET_H__
+
+// A wall-clock budget per step, for interactive and demo runs that must keep
+// up with their maxsimfreq whatever the scene does; the cap only stops a step
+// from starting early, not one from running late. Each step is timed in two
+// phases: a fixed one, such as finding the contacts, and a scalable one of
+// some number of units, constraint sweeps or substeps, whose count the stepper
+// may cut. From smoothed per-phase timings the budget works out how many
+// units the next step can afford, so a heavy moment degrades the solution
+// rather than the frame rate, and once the scene eases off the units cut come
+// back, at most doubling per step.
+class StepBudget
+{
+public:
+  explicit StepBudget( double seconds );
+
+  // Units the next step may take, from minimum to wanted. Wanted until a
+  // step has been recorded.
+  int allow( int wanted, int minimum );
+
+  // The timings of the step just taken, which took units of the scalable
+  // phase.
+  void record( double fixedseconds, double scalableseconds, int units );
+
+  double getSeconds() const { return m_seconds; }
+
+private:
+  double m_seconds;
+  bool m_timed;
+  double m_fixed;
+  double m_perunit;
+  int m_allowed;
+  // Whether m_allowed was fewer units than wanted.
+  bool m_cut;
+};
+
+#endif
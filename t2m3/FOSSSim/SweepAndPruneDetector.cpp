@@ -0,0 +1,93 @@
+#include "SweepAndPruneDetector.h"
+#include "TwoDScene.h"
+#include "BroadPhaseTuning.h"
+#include <algorithm>
+
+namespace
+{
+
+struct LowerLess
+{
+  const std::vector<AABB>& boxes;
+  int axis;
+
+  LowerLess( const std::vector<AABB>& b, int a ) : boxes(b), axis(a) {}
+
+  bool operator()( int a, int b ) const { return boxes[a].min(axis) < boxes[b].min(axis); }
+};
+
+}
+
+SweepAndPruneDetector::SweepAndPruneDetector()
+: m_order()
+, m_boxes()
+, m_axis(0)
+, m_adjacency()
+{}
+
+void SweepAndPruneDetector::performCollisionDetection(const TwoDScene &scene, const VectorXs &qs, const VectorXs &qe, DetectionCallback &dc)
+{
+  PPList pppairs;
+  PEList pepairs;
+  PHList phpairs;
+
+  findCollidingPairs(scene, qs, qe, pppairs, pepairs, phpairs);
+  broadphase::reportPairs(scene, pppairs, pepairs, phpairs, dc);
+}
+
+void SweepAndPruneDetector::findCollidingPairs(const TwoDScene &scene, const VectorXs &qs, const VectorXs &qe, PPList &pppairs, PEList &pepairs, PHList &phpairs)
+{
+  const int nparticles = scene.getNumParticles();
+  const int nedges = scene.getNumEdges();
+  const int nobjects = nparticles + nedges;
+
+  m_boxes.resize( nobjects );
+  for( int i = 0; i < nparticles; ++i ) m_boxes[i] = broadphase::particleBox( qs, qe, i, scene.getRadius(i) );
+  for( int e = 0; e < nedges; ++e ) m_boxes[nparticles+e] = broadphase::edgeBox( qs, qe, scene.getEdge(e), scene.getEdgeRadii()[e] );
+
+  const int axis = broadphase::tuning().sweepaxis;
+  LowerLess less( m_boxes, axis );
+  if( (int) m_order.size() != nobjects || axis != m_axis )
+  {
+    // Topology or axis changed (or first call): sort from scratch.
+    m_axis = axis;
+    m_order.resize( nobjects );
+    for( int i = 0; i < nobjects; ++i ) m_order[i] = i;
+    std::sort( m_order.begin(), m_order.end(), less );
+  }
+  else
+  {
+    // Insertion sort from the previous step's order.
+    for( int i = 1; i < nobjects; ++i )
+    {
+      int object = m_order[i];
+      int j = i;
+      for( ; j > 0 && less( object, m_order[j-1] ); --j ) m_order[j] = m_order[j-1];
+      m_order[j] = object;
+    }
+  }
+
+  for( int i = 0; i < nobjects; ++i )
+  {
+    const int a = m_order[i];
+    const AABB& boxa = m_boxes[a];
+    for( int j = i+1; j < nobjects && m_boxes[m_order[j]].min(axis) <= boxa.max(axis); ++j )
+    {
+      const int b = m_order[j];
+      if( a >= nparticles && b >= nparticles ) continue;
+      if( !boxa.overlaps( m_boxes[b] ) ) continue;
+      if( a < nparticles && b < nparticles ) pppairs.push_back( std::make_pair( std::min(a,b), std::max(a,b) ) );
+      else if( a < nparticles ) pepairs.push_back( std::make_pair( a, b-nparticles ) );
+      else pepairs.push_back( std::make_pair( b, a-nparticles ) );
+    }
+  }
+
+  broadphase::findHalfplanePairs( scene, qs, qe, phpairs );
+
+  // The sweep reports each pair once; sorting makes the callback order
+  // independent of the sweep order.
+  broadphase::sortUnique( pppairs );
+  broadphase::sortUnique( pepairs );
+  m_adjacency.update( scene );
+  broadphase::excludeNeighbours( m_adjacency, broadphase::exclusionRings(), pepairs );
+}
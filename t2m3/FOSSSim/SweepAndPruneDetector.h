@@ -0,0 +1,33 @@
+#ifndef SWEEP_AND_PRUNE_DETECTOR_H
+#define SWEEP_AND_PRUNE_DETECTOR_H
+
+#include "CollisionDetector.h"
+#include "BroadPhase.h"
+#include "EdgeAdjacency.h"
+#include <vector>
+
+// Sort-and-sweep broad phase along the x axis, or the y axis if tuned to.
+// Particles and edges are kept sorted by the lower bound of their boxes along
+// it. The order persists between
+// calls and is repaired by insertion sort, which is close to linear time
+// when objects move little per step. Boxes are swept between qs and qe, so
+// the detector also serves continuous-time collision handling.
+class SweepAndPruneDetector : public CollisionDetector
+{
+ public:
+  SweepAndPruneDetector();
+
+  virtual void performCollisionDetection(const TwoDScene &scene, const VectorXs &qs, const VectorXs &qe, DetectionCallback &dc);
+
+  void findCollidingPairs(const TwoDScene &scene, const VectorXs &qs, const VectorXs &qe, PPList &pppairs, PEList &pepairs, PHList &phpairs);
+
+ private:
+  // Object ids: particles are [0, nparticles), edge e is nparticles+e.
+  std::vector<int> m_order;
+  std::vector<AABB> m_boxes;
+  // The axis m_order is sorted along.
+  int m_axis;
+  EdgeAdjacency m_adjacency;
+};
+
+#endif
@@ -0,0 +1,253 @@
+#include "TaskPool.h"
+
+#include <cerrno>
+#include <cstdlib>
+#include <iostream>
+#include <map>
+#include <sstream>
+
+namespace
+{
+
+// The pool whose worker the calling thread is, if any, and its queue.
+thread_local const TaskPool* t_pool = NULL;
+thread_local int t_index = 0;
+
+void complain( const std::string& variable, const std::string& value )
+{
+  std::cerr << "\033[31;1mERROR IN TASKPOOL:\033[m Ignoring " << variable << "=" << value << "." << std::endl;
+}
+
+bool parseCount( const std::string& text, int& value )
+{
+  const char* begin = text.c_str();
+  char* end = NULL;
+  errno = 0;
+  const long parsed = strtol(begin, &end, 10);
+  value = (int) parsed;
+  return end != begin && *end == '\0' && errno == 0 && parsed == value && value >= 0;
+}
+
+int threadsFromEnvironment()
+{
+  const char* value = getenv("FOSSSIM_THREADS");
+  if( value == NULL ) return 0;
+  int nthreads = 0;
+  if( !parseCount(value, nthreads) ) complain("FOSSSIM_THREADS", value);
+  return nthreads;
+}
+
+// FOSSSIM_GRAIN as phase=grain pairs separated by commas.
+std::map<std::string,int> grainsFromEnvironment()
+{
+  std::map<std::string,int> grains;
+  const char* value = getenv("FOSSSIM_GRAIN");
+  if( value == NULL ) return grains;
+  std::istringstream entries(value);
+  std::string entry;
+  while( std::getline(entries, entry, ',') )
+  {
+    const std::string::size_type equals = entry.find('=');
+    int grain = 0;
+    if( equals == std::string::npos || !parseCount(entry.substr(equals+1), grain) || grain == 0 )
+    {
+      complain("FOSSSIM_GRAIN", entry);
+      continue;
+    }
+    grains[entry.substr(0, equals)] = grain;
+  }
+  return grains;
+}
+
+}
+
+TaskPool& TaskPool::shared()
+{
+  static TaskPool pool( threadsFromEnvironment() );
+  return pool;
+}
+
+int TaskPool::grainSize( const std::string& phase, int fallback )
+{
+  static const std::map<std::string,int> grains = grainsFromEnvironment();
+  std::map<std::string,int>::const_iterator grain = grains.find(phase);
+  return grain == grains.end() ? fallback : grain->second;
+}
+
+bool TaskPool::deterministic()
+{
+  static const char* value = getenv("FOSSSIM_DETERMINISTIC");
+  static const bool deterministic = value != NULL && *value != '\0' && std::string(value) != "0";
+  return deterministic;
+}
+
+TaskPool::TaskPool( int nthreads )
+: m_nthreads(1)
+, m_queues()
+, m_workers()
+, m_queued(0)
+, m_stopping(false)
+, m_sleep()
+, m_wake()
+{
+  start(nthreads);
+}
+
+TaskPool::~TaskPool()
+{
+  stop();
+}
+
+void TaskPool::setNumThreads( int nthreads )
+{
+  stop();
+  start(nthreads);
+}
+
+int TaskPool::getNumThreads() const
+{
+  return m_nthreads;
+}
+
+void TaskPool::start( int nthreads )
+{
+  if( nthreads <= 0 ) nthreads = std::max( (int) std::thread::hardware_concurrency(), 1 );
+  m_nthreads = nthreads;
+  m_stopping = false;
+  m_queues.clear();
+  for( int i = 0; i < nthreads; ++i ) m_queues.push_back( std::unique_ptr<Queue>( new Queue ) );
+  for( int i = 1; i < nthreads; ++i ) m_workers.push_back( std::thread( &TaskPool::work, this, i ) );
+}
+
+void TaskPool::stop()
+{
+  {
+    std::lock_guard<std::mutex> lock(m_sleep);
+    m_stopping = true;
+  }
+  m_wake.notify_all();
+  for( std::size_t i = 0; i < m_workers.size(); ++i ) m_workers[i].join();
+  m_workers.clear();
+}
+
+int TaskPool::queueIndex() const
+{
+  return t_pool == this ? t_index : 0;
+}
+
+void TaskPool::spawn( Group& group, const std::function<void()>& task )
+{
+  if( m_nthreads <= 1 )
+  {
+    task();
+    return;
+  }
+
+  group.m_pending.fetch_add(1);
+  Queue& queue = *m_queues[queueIndex()];
+  {
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    Task queued = { task, &group };
+    queue.tasks.push_back(queued);
+  }
+  m_queued.fetch_add(1);
+  // Taking the lock orders the wake-up after a sleeping worker's check.
+  {
+    std::lock_guard<std::mutex> lock(m_sleep);
+  }
+  m_wake.notify_one();
+}
+
+void TaskPool::wait( Group& group )
+{
+  const int index = queueIndex();
+  while( group.m_pending.load() > 0 )
+    if( !runOne(index) ) std::this_thread::yield();
+}
+
+bool TaskPool::runOne( int index )
+{
+  Task task;
+  bool found = false;
+  {
+    Queue& own = *m_queues[index];
+    std::lock_guard<std::mutex> lock(own.mutex);
+    if( !own.tasks.empty() )
+    {
+      task = own.tasks.back();
+      own.tasks.pop_back();
+      found = true;
+    }
+  }
+  for( int k = 1; !found && k < m_nthreads; ++k )
+  {
+    Queue& other = *m_queues[( index + k )%m_nthreads];
+    std::lock_guard<std::mutex> lock(other.mutex);
+    if( !other.tasks.empty() )
+    {
+      task = other.tasks.front();
+      other.tasks.pop_front();
+      found = true;
+    }
+  }
+  if( !found ) return false;
+
+  m_queued.fetch_sub(1);
+  task.run();
+  task.group->m_pending.fetch_sub(1);
+  return true;
+}
+
+void TaskPool::work( int index )
+{
+  t_pool = this;
+  t_index = index;
+  while( true )
+  {
+    if( runOne(index) ) continue;
+    std::unique_lock<std::mutex> lock(m_sleep);
+    m_wake.wait( lock, [this]() { return m_stopping || m_queued.load() > 0; } );
+    if( m_stopping ) return;
+  }
+}
+
+TaskGraph::TaskGraph( TaskPool& pool )
+: m_pool(pool)
+, m_nodes()
+, m_group()
+, m_waiting()
+{}
+
+int TaskGraph::add( const std::function<void()>& task )
+{
+  Node node = { task, std::vector<int>(), 0 };
+  m_nodes.push_back(node);
+  return (int) m_nodes.size() - 1;
+}
+
+void TaskGraph::precede( int before, int after )
+{
+  m_nodes[before].successors.push_back(after);
+  ++m_nodes[after].npredecessors;
+}
+
+void TaskGraph::run()
+{
+  const int nnodes = (int) m_nodes.size();
+  m_waiting.reset( new std::atomic<int>[nnodes] );
+  for( int i = 0; i < nnodes; ++i ) m_waiting[i].store( m_nodes[i].npredecessors );
+  for( int i = 0; i < nnodes; ++i )
+    if( m_nodes[i].npredecessors == 0 ) spawnNode(i);
+  m_pool.wait(m_group);
+}
+
+void TaskGraph::spawnNode( int node )
+{
+  m_pool.spawn( m_group, [this, node]()
+  {
+    m_nodes[node].task();
+    const std::vector<int>& successors = m_nodes[node].successors;
+    for( std::size_t k = 0; k < successors.size(); ++k )
+      if( m_waiting[successors[k]].fetch_sub(1) == 1 ) spawnNode( successors[k] );
+  } );
+}
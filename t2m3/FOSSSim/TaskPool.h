@@ -0,0 +1,199 @@
+#ifndef __TASK_POOL_H__
+#define __TASK_POOL_H__
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// One pool of worker threads shared by every parallel part of the simulator,
+// so that the broad phase, the contact callbacks and scene loading never
+// start more threads than the machine has between them.
+//
+// Every thread has its own queue of tasks. A thread runs the newest task of
+// its own queue, and when that is empty steals the oldest from another's.
+// parallelFor splits its range in halves, leaving the upper half for others
+// to steal, until a piece is no larger than the grain, so idle threads take
+// the largest pieces and the owner works through the smallest. A thread
+// waiting for tasks runs tasks meanwhile, including the one that called
+// parallelFor, which makes nested parallel loops safe.
+//
+// The base library owns the command line, so the simulator sizes the shared
+// pool from FOSSSIM_THREADS, the number of threads counting the one that
+// steps, or one per processor if unset or 0. FOSSSIM_GRAIN tunes each
+// phase's grain, as in FOSSSIM_GRAIN=contest.buckets=128,callbacks=4096; the
+// phases are the names passed to grainSize. FOSSSIM_DETERMINISTIC=1 asks for
+// results that do not depend on the thread count, for oracle comparisons.
+class TaskPool
+{
+public:
+  // Tasks spawned together, waited for together.
+  class Group
+  {
+  public:
+    Group() : m_pending(0) {}
+
+  private:
+    friend class TaskPool;
+    Group( const Group& );
+    Group& operator=( const Group& );
+
+    std::atomic<int> m_pending;
+  };
+
+  // The pool the simulator's parallel code uses.
+  static TaskPool& shared();
+
+  // The grain of the named phase: FOSSSIM_GRAIN's if it names the phase,
+  // otherwise fallback.
+  static int grainSize( const std::string& phase, int fallback );
+
+  // Whether FOSSSIM_DETERMINISTIC is set, to anything but 0. Parallel code
+  // whose results would depend on the schedule, such as sums in whatever
+  // order tasks finish, runs in a fixed order instead.
+  static bool deterministic();
+
+  // nthreads counts the threads that wait on the pool; 0 is one per
+  // processor.
+  explicit TaskPool( int nthreads = 0 );
+  ~TaskPool();
+
+  // Stops the workers and starts nthreads-1 new ones. Not while tasks run.
+  void setNumThreads( int nthreads );
+  int getNumThreads() const;
+
+  // Queues task on the calling thread's queue. With a single thread the task
+  // runs before spawn returns.
+  void spawn( Group& group, const std::function<void()>& task );
+
+  // Runs tasks until every task of group has finished.
+  void wait( Group& group );
+
+  // Runs tasks until done() returns true, for waits on work that finishes
+  // by other means than a group, such as a future set by a task.
+  template<class Done>
+  void waitUntil( const Done& done );
+
+  // Calls f(lo, hi) on disjoint ranges covering [ begin, end ), none longer
+  // than grain, and returns once all have returned. Ranges no longer than
+  // grain are not split at all.
+  template<class F>
+  void parallelFor( int begin, int end, int grain, const F& f );
+
+private:
+  TaskPool( const TaskPool& );
+  TaskPool& operator=( const TaskPool& );
+
+  struct Task
+  {
+    std::function<void()> run;
+    Group* group;
+  };
+
+  struct Queue
+  {
+    std::mutex mutex;
+    std::deque<Task> tasks;
+  };
+
+  void start( int nthreads );
+  void stop();
+
+  // The calling thread's queue: a worker's own, or the first for every
+  // thread outside the pool.
+  int queueIndex() const;
+
+  // Runs one task, the newest of queue index or else one stolen from
+  // another queue. Returns false if every queue was empty.
+  bool runOne( int index );
+
+  void work( int index );
+
+  template<class F>
+  void split( Group& group, int begin, int end, int grain, const F& f );
+
+  int m_nthreads;
+  std::vector<std::unique_ptr<Queue> > m_queues;
+  std::vector<std::thread> m_workers;
+
+  // Tasks queued and not yet taken, for idle workers to sleep on.
+  std::atomic<int> m_queued;
+  bool m_stopping;
+  std::mutex m_sleep;
+  std::condition_variable m_wake;
+};
+
+// Tasks that each start once the tasks they follow have finished.
+class TaskGraph
+{
+public:
+  explicit TaskGraph( TaskPool& pool = TaskPool::shared() );
+
+  // Returns the task's index.
+  int add( const std::function<void()>& task );
+
+  // Task after starts once task before has finished.
+  void precede( int before, int after );
+
+  // Runs every task once and waits for them. The dependencies must not form
+  // a cycle.
+  void run();
+
+private:
+  struct Node
+  {
+    std::function<void()> task;
+    std::vector<int> successors;
+    int npredecessors;
+  };
+
+  void spawnNode( int node );
+
+  TaskPool& m_pool;
+  std::vector<Node> m_nodes;
+  TaskPool::Group m_group;
+  // Predecessors of each node still running, during run.
+  std::unique_ptr<std::atomic<int>[]> m_waiting;
+};
+
+template<class F>
+void TaskPool::parallelFor( int begin, int end, int grain, const F& f )
+{
+  grain = std::max( grain, 1 );
+  if( end - begin <= grain || m_nthreads <= 1 )
+  {
+    if( begin < end ) f( begin, end );
+    return;
+  }
+  Group group;
+  split( group, begin, end, grain, f );
+  wait( group );
+}
+
+template<class Done>
+void TaskPool::waitUntil( const Done& done )
+{
+  const int index = queueIndex();
+  while( !done() )
+    if( !runOne(index) ) std::this_thread::yield();
+}
+
+template<class F>
+void TaskPool::split( Group& group, int begin, int end, int grain, const F& f )
+{
+  while( end - begin > grain )
+  {
+    const int middle = begin + ( end - begin )/2;
+    spawn( group, [this, &group, middle, end, grain, &f]() { split( group, middle, end, grain, f ); } );
+    end = middle;
+  }
+  f( begin, end );
+}
+
+#endif
@@ -0,0 +1,377 @@
+#include "Trajectory.h"
+
+#include <cassert>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+
+namespace
+{
+
+// Bytes buffered before the writer goes to the file.
+const std::size_t TRAJECTORY_BUFFER_SIZE = 1 << 22;
+
+// Frames between the keyframes of a compressed trajectory.
+const int TRAJECTORY_KEYFRAME_INTERVAL = 32;
+
+const char INDEX_MAGIC[4] = { 'F', 'T', 'I', '1' };
+
+std::string indexName( const std::string& filename )
+{
+  return filename + ".idx";
+}
+
+void putVarint( unsigned long long u, std::vector<char>& out )
+{
+  while( u >= 0x80 )
+  {
+    out.push_back(char( ( u & 0x7f ) | 0x80 ));
+    u >>= 7;
+  }
+  out.push_back(char(u));
+}
+
+bool getVarint( const char*& p, const char* end, unsigned long long& u )
+{
+  u = 0;
+  for( int shift = 0; p != end && shift < 64; shift += 7 )
+  {
+    const unsigned char byte = (unsigned char) *p++;
+    u |= (unsigned long long) ( byte & 0x7f ) << shift;
+    if( byte < 0x80 ) return true;
+  }
+  return false;
+}
+
+unsigned long long zigzag( long long d )
+{
+  return ( (unsigned long long) d << 1 ) ^ (unsigned long long) ( d >> 63 );
+}
+
+long long unzigzag( unsigned long long u )
+{
+  return (long long) ( u >> 1 ) ^ -(long long) ( u & 1 );
+}
+
+}
+
+TrajectoryWriter::TrajectoryWriter()
+: m_filename()
+, m_ofs()
+, m_buffer()
+, m_used(0)
+, m_offsets()
+, m_numparticles()
+, m_failed(false)
+, m_tolerance(0.0)
+, m_previous()
+, m_encoded()
+{}
+
+TrajectoryWriter::~TrajectoryWriter()
+{
+  if( isOpen() ) close();
+}
+
+bool TrajectoryWriter::open( const std::string& filename, scalar tolerance )
+{
+  assert( tolerance >= 0.0 );
+  if( isOpen() ) close();
+  m_ofs.open(filename.c_str(), std::ios::binary | std::ios::trunc);
+  if( !m_ofs.is_open() ) return false;
+  m_filename = filename;
+  m_buffer.resize(TRAJECTORY_BUFFER_SIZE);
+  m_used = 0;
+  m_offsets.assign(1, 0);
+  m_numparticles.clear();
+  m_failed = false;
+  m_tolerance = tolerance;
+  m_previous.clear();
+  return true;
+}
+
+bool TrajectoryWriter::isOpen() const
+{
+  return m_ofs.is_open();
+}
+
+void TrajectoryWriter::writeFrame( const TwoDScene& scene )
+{
+  writeFrame(scene.getX(), scene.getV());
+}
+
+void TrajectoryWriter::writeFrame( const VectorXs& x, const VectorXs& v )
+{
+  assert( isOpen() );
+  assert( x.size() == v.size() );
+  const int n = (int) x.size()/2;
+  std::size_t size = ( x.size() + v.size() )*sizeof(scalar);
+
+  if( m_tolerance > 0.0 )
+  {
+    const bool keyframe = getNumFrames()%TRAJECTORY_KEYFRAME_INTERVAL == 0 || m_numparticles.back() != n;
+    m_previous.resize(4*n);
+    m_encoded.clear();
+    encode(x, 0, keyframe);
+    encode(v, 2*n, keyframe);
+    append(m_encoded.empty() ? NULL : &m_encoded[0], m_encoded.size());
+    size = m_encoded.size();
+  }
+  else
+  {
+    append(reinterpret_cast<const char*>(x.data()), x.size()*sizeof(scalar));
+    append(reinterpret_cast<const char*>(v.data()), v.size()*sizeof(scalar));
+  }
+  m_offsets.push_back(m_offsets.back() + (long long) size);
+  m_numparticles.push_back(n);
+}
+
+void TrajectoryWriter::encode( const VectorXs& q, std::size_t first, bool keyframe )
+{
+  const scalar step = 2.0*m_tolerance;
+  for( int k = 0; k < q.size(); ++k )
+  {
+    assert( fabs(q(k)/step) < 4.0e18 );
+    const long long rounded = llround(q(k)/step);
+    putVarint(zigzag(keyframe ? rounded : rounded - m_previous[first+k]), m_encoded);
+    m_previous[first+k] = rounded;
+  }
+}
+
+int TrajectoryWriter::getNumFrames() const
+{
+  return (int) m_numparticles.size();
+}
+
+void TrajectoryWriter::append( const char* bytes, std::size_t size )
+{
+  if( m_used + size > m_buffer.size() && !flush() ) return;
+  // Frames larger than the buffer gain nothing from a copy.
+  if( size >= m_buffer.size() )
+  {
+    m_ofs.write(bytes, size);
+    m_failed = m_failed || !m_ofs;
+    return;
+  }
+  if( size > 0 ) memcpy(&m_buffer[m_used], bytes, size);
+  m_used += size;
+}
+
+bool TrajectoryWriter::flush()
+{
+  if( m_used > 0 ) m_ofs.write(&m_buffer[0], m_used);
+  m_used = 0;
+  m_failed = m_failed || !m_ofs;
+  return !m_failed;
+}
+
+bool TrajectoryWriter::close()
+{
+  if( !isOpen() ) return false;
+  flush();
+  m_ofs.close();
+  m_failed = m_failed || m_ofs.fail();
+
+  std::ofstream index(indexName(m_filename).c_str(), std::ios::binary | std::ios::trunc);
+  const long long numframes = getNumFrames();
+  index.write(INDEX_MAGIC, sizeof(INDEX_MAGIC));
+  index.write(reinterpret_cast<const char*>(&numframes), sizeof(numframes));
+  index.write(reinterpret_cast<const char*>(&m_tolerance), sizeof(m_tolerance));
+  index.write(reinterpret_cast<const char*>(&m_offsets[0]), m_offsets.size()*sizeof(long long));
+  if( numframes > 0 ) index.write(reinterpret_cast<const char*>(&m_numparticles[0]), m_numparticles.size()*sizeof(int));
+  m_failed = m_failed || !index;
+
+  std::vector<char>().swap(m_buffer);
+  std::vector<long long>().swap(m_previous);
+  std::vector<char>().swap(m_encoded);
+  return !m_failed;
+}
+
+OutputCadence::OutputCadence( int stride, double interval )
+: m_stride(stride < 1 ? 1 : stride)
+, m_interval(interval)
+, m_steps(0)
+, m_frames(0)
+, m_last(0.0)
+{}
+
+bool OutputCadence::due()
+{
+  const int step = m_steps++;
+  if( step%m_stride != 0 ) return false;
+  if( m_interval > 0.0 )
+  {
+    const double now = std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    if( m_frames > 0 && now - m_last < m_interval ) return false;
+    m_last = now;
+  }
+  ++m_frames;
+  return true;
+}
+
+int OutputCadence::getNumSteps() const
+{
+  return m_steps;
+}
+
+int OutputCadence::getNumFrames() const
+{
+  return m_frames;
+}
+
+TrajectoryReader::TrajectoryReader()
+: m_file()
+, m_offsets()
+, m_numparticles()
+, m_tolerance(0.0)
+, m_decoded()
+, m_decoded_frame(-1)
+{}
+
+bool TrajectoryReader::open( const std::string& filename, int numparticles )
+{
+  m_offsets.clear();
+  m_numparticles.clear();
+  m_tolerance = 0.0;
+  m_decoded_frame = -1;
+  if( !m_file.open(filename) ) return false;
+
+  std::ifstream index(indexName(filename).c_str(), std::ios::binary);
+  char magic[4];
+  long long numframes = 0;
+  if( index.read(magic, sizeof(magic)) && memcmp(magic, INDEX_MAGIC, sizeof(magic)) == 0 &&
+      index.read(reinterpret_cast<char*>(&numframes), sizeof(numframes)) && numframes >= 0 )
+  {
+    m_offsets.resize(numframes + 1);
+    m_numparticles.resize(numframes);
+    if( index.read(reinterpret_cast<char*>(&m_tolerance), sizeof(m_tolerance)) && m_tolerance >= 0.0 &&
+        index.read(reinterpret_cast<char*>(&m_offsets[0]), m_offsets.size()*sizeof(long long)) &&
+        ( numframes == 0 || index.read(reinterpret_cast<char*>(&m_numparticles[0]), m_numparticles.size()*sizeof(int)) ) )
+      return true;
+    m_offsets.clear();
+    m_numparticles.clear();
+    return false;
+  }
+
+  // No index: fixed-size raw frames of x and v.
+  if( numparticles < 0 ) return false;
+  const long long size = (long long) m_file.size();
+  const long long framesize = 4*numparticles*(long long) sizeof(scalar);
+  numframes = framesize > 0 ? size/framesize : 0;
+  m_offsets.resize(numframes + 1);
+  for( long long f = 0; f <= numframes; ++f ) m_offsets[f] = f*framesize;
+  m_numparticles.assign(numframes, numparticles);
+  return true;
+}
+
+int TrajectoryReader::getNumFrames() const
+{
+  return (int) m_numparticles.size();
+}
+
+int TrajectoryReader::getNumParticles( int frame ) const
+{
+  assert( frame >= 0 ); assert( frame < getNumFrames() );
+  return m_numparticles[frame];
+}
+
+bool TrajectoryReader::readFrame( int frame, VectorXs& x, VectorXs& v )
+{
+  if( frame < 0 || frame >= getNumFrames() ) return false;
+  return readParticles(frame, 0, getNumParticles(frame), x, v);
+}
+
+bool TrajectoryReader::readParticles( int frame, int first, int count, VectorXs& x, VectorXs& v )
+{
+  if( frame < 0 || frame >= getNumFrames() || !isMapped(frame) ) return false;
+  const int n = getNumParticles(frame);
+  if( first < 0 || count < 0 || first > n - count ) return false;
+  x.resize(2*count);
+  v.resize(2*count);
+
+  if( m_tolerance > 0.0 )
+  {
+    if( !decodeFrame(frame) ) return false;
+    const scalar step = 2.0*m_tolerance;
+    for( int k = 0; k < 2*count; ++k )
+    {
+      x(k) = step*m_decoded[2*first+k];
+      v(k) = step*m_decoded[2*n+2*first+k];
+    }
+    return true;
+  }
+
+  const scalar* data = rawFrame(frame, first, count);
+  if( data == NULL ) return false;
+  if( count > 0 )
+  {
+    memcpy(x.data(), data + 2*first, 2*count*sizeof(scalar));
+    memcpy(v.data(), data + 2*n + 2*first, 2*count*sizeof(scalar));
+  }
+  return true;
+}
+
+bool TrajectoryReader::isRaw() const
+{
+  return m_tolerance == 0.0;
+}
+
+TrajectoryView TrajectoryReader::mapPositions( int frame, int first, int count ) const
+{
+  const scalar* data = rawFrame(frame, first, count);
+  return data == NULL ? TrajectoryView(NULL, 0) : TrajectoryView(data + 2*first, 2*count);
+}
+
+TrajectoryView TrajectoryReader::mapVelocities( int frame, int first, int count ) const
+{
+  const scalar* data = rawFrame(frame, first, count);
+  return data == NULL ? TrajectoryView(NULL, 0) : TrajectoryView(data + 2*getNumParticles(frame) + 2*first, 2*count);
+}
+
+const scalar* TrajectoryReader::rawFrame( int frame, int first, int count ) const
+{
+  if( m_tolerance > 0.0 || frame < 0 || frame >= getNumFrames() || !isMapped(frame) ) return NULL;
+  const int n = getNumParticles(frame);
+  if( first < 0 || count < 0 || first > n - count ) return NULL;
+  if( (std::size_t) ( m_offsets[frame+1] - m_offsets[frame] ) < 4*n*sizeof(scalar) ) return NULL;
+  return reinterpret_cast<const scalar*>(m_file.data() + m_offsets[frame]);
+}
+
+bool TrajectoryReader::isMapped( int frame ) const
+{
+  return m_offsets[frame] >= 0 && m_offsets[frame] <= m_offsets[frame+1] && m_offsets[frame+1] <= (long long) m_file.size();
+}
+
+bool TrajectoryReader::isKeyframe( int frame ) const
+{
+  return frame%TRAJECTORY_KEYFRAME_INTERVAL == 0 || m_numparticles[frame] != m_numparticles[frame-1];
+}
+
+// Leaves frame's rounded values in m_decoded. Decoding starts at the last
+// keyframe at or before frame, or right after the frame decoded last if that
+// comes later.
+bool TrajectoryReader::decodeFrame( int frame )
+{
+  if( frame == m_decoded_frame ) return true;
+  int start = frame;
+  while( !isKeyframe(start) && start - 1 != m_decoded_frame ) --start;
+
+  for( int f = start; f <= frame; ++f )
+  {
+    if( !isMapped(f) ) { m_decoded_frame = -1; return false; }
+
+    const bool keyframe = isKeyframe(f);
+    const std::size_t count = 4*(std::size_t) m_numparticles[f];
+    m_decoded.resize(count);
+    const char* p = m_file.data() + m_offsets[f];
+    const char* end = m_file.data() + m_offsets[f+1];
+    for( std::size_t k = 0; k < count; ++k )
+    {
+      unsigned long long u;
+      if( !getVarint(p, end, u) ) { m_decoded_frame = -1; return false; }
+      m_decoded[k] = keyframe ? unzigzag(u) : m_decoded[k] + unzigzag(u);
+    }
+    m_decoded_frame = f;
+  }
+  return true;
+}
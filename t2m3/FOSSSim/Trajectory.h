@@ -0,0 +1,177 @@
+#ifndef TRAJECTORY_H
+#define TRAJECTORY_H
+
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "MappedFile.h"
+#include "TwoDScene.h"
+
+// Trajectory files as written by TwoDSceneSerializer::serializeScene, x then
+// v of each frame as raw doubles, plus an index in a sidecar file,
+// filename + ".idx":
+//
+//   magic         "FTI1"
+//   numframes     int64
+//   tolerance     double, 0 for raw frames
+//   offsets       numframes + 1 int64 byte offsets, the last one the data size
+//   numparticles  numframes int32 particle counts
+//
+// Raw frame data is byte for byte what the serializer writes, so the oracle
+// and the grader read the trajectory as before; the index lets other readers
+// seek to frame N in O(1) even if the particle count changes between frames.
+//
+// With a tolerance > 0 frames are compressed instead, and need the index to
+// be read back. Each value is rounded to a multiple of 2*tolerance, so it is
+// off by at most tolerance, and stored as the zigzag varint of its
+// difference to the same value in the previous frame. Particles move little
+// per frame, so most differences fit in a byte or two. Every
+// TRAJECTORY_KEYFRAME_INTERVAL-th frame, and every frame whose particle count
+// changes, is a keyframe holding the rounded values themselves, so a seek
+// decodes at most that many frames.
+
+// Appends frames through a large buffer, so that the simulation issues one
+// write per TRAJECTORY_BUFFER_SIZE bytes rather than two per frame.
+class TrajectoryWriter
+{
+public:
+  TrajectoryWriter();
+
+  // Closes the trajectory if still open.
+  ~TrajectoryWriter();
+
+  // tolerance = 0 writes lossless raw frames, which grading needs.
+  bool open( const std::string& filename, scalar tolerance = 0.0 );
+
+  bool isOpen() const;
+
+  void writeFrame( const TwoDScene& scene );
+
+  void writeFrame( const VectorXs& x, const VectorXs& v );
+
+  int getNumFrames() const;
+
+  // Flushes the frames and writes the index. Returns false if a write failed.
+  bool close();
+
+private:
+  TrajectoryWriter( const TrajectoryWriter& );
+  TrajectoryWriter& operator=( const TrajectoryWriter& );
+
+  void encode( const VectorXs& q, std::size_t first, bool keyframe );
+
+  void append( const char* bytes, std::size_t size );
+
+  bool flush();
+
+  std::string m_filename;
+  std::ofstream m_ofs;
+  std::vector<char> m_buffer;
+  std::size_t m_used;
+  std::vector<long long> m_offsets;
+  std::vector<int> m_numparticles;
+  bool m_failed;
+
+  scalar m_tolerance;
+  // The previous frame's rounded values, x then v, and the frame being
+  // encoded.
+  std::vector<long long> m_previous;
+  std::vector<char> m_encoded;
+};
+
+// Decides which steps of a run get an output frame: every stride-th step,
+// and among those only once interval seconds of wall-clock time have passed
+// since the last frame. The first step is always due. A run at 200 Hz that
+// needs 30 fps output would use a stride of 7 and let the frames through a
+// TrajectoryWriter only when due() says so.
+class OutputCadence
+{
+public:
+  explicit OutputCadence( int stride = 1, double interval = 0.0 );
+
+  // Call once per step; true if this step's frame should be written.
+  bool due();
+
+  // Steps seen and frames passed so far.
+  int getNumSteps() const;
+  int getNumFrames() const;
+
+private:
+  int m_stride;
+  double m_interval;
+  int m_steps;
+  int m_frames;
+  double m_last;
+};
+
+// A view of part of a raw frame where it lies in a mapped trajectory, x and y
+// of each particle interleaved.
+typedef Eigen::Map<const VectorXs> TrajectoryView;
+
+// Random access to the frames of a trajectory. The trajectory is mapped into
+// memory, so that a raw frame is one copy out of the page cache and a
+// compressed one is decoded where it lies, and seeking about a trajectory
+// already read, as a viewer does, touches no disk at all.
+//
+// Analyses of a few particles over a long run of many need not read whole
+// frames: readParticles copies out only the particles asked for, and on a
+// raw trajectory mapPositions and mapVelocities copy nothing, so only the
+// pages holding those particles are ever read from disk.
+class TrajectoryReader
+{
+public:
+  TrajectoryReader();
+
+  // Opens filename and its index. Without an index every frame is taken to
+  // be raw and hold numparticles particles, which is all a plain serializer
+  // output allows; numparticles < 0 then fails.
+  bool open( const std::string& filename, int numparticles = -1 );
+
+  int getNumFrames() const;
+
+  // Number of particles in frame.
+  int getNumParticles( int frame ) const;
+
+  // Reads frame into x and v, resizing them to fit, and decoding it if the
+  // trajectory is compressed.
+  bool readFrame( int frame, VectorXs& x, VectorXs& v );
+
+  // readFrame for particles first up to first + count of frame only. A
+  // compressed frame is still decoded whole.
+  bool readParticles( int frame, int first, int count, VectorXs& x, VectorXs& v );
+
+  // Whether the frames are raw, and so can be viewed in place.
+  bool isRaw() const;
+
+  // x, or v, of particles first up to first + count of frame, in place in
+  // the mapped file; valid until the reader is opened again or destroyed.
+  // Empty if the trajectory is compressed or the particles are not all in
+  // the frame.
+  TrajectoryView mapPositions( int frame, int first, int count ) const;
+  TrajectoryView mapVelocities( int frame, int first, int count ) const;
+
+private:
+  bool isKeyframe( int frame ) const;
+
+  bool decodeFrame( int frame );
+
+  // Whether frame's bytes lie within the file.
+  bool isMapped( int frame ) const;
+
+  // x of raw frame, followed by its v, or NULL if the frame does not hold
+  // particles first up to first + count in full.
+  const scalar* rawFrame( int frame, int first, int count ) const;
+
+  MappedFile m_file;
+  std::vector<long long> m_offsets;
+  std::vector<int> m_numparticles;
+  scalar m_tolerance;
+
+  // Rounded values of the last frame decoded, so that reading frames in
+  // order decodes each once.
+  std::vector<long long> m_decoded;
+  int m_decoded_frame;
+};
+
+#endif
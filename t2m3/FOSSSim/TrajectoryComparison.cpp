@@ -0,0 +1,116 @@
+#include "TrajectoryComparison.h"
+
+#include <algorithm>
+#include <vector>
+
+#include "TaskPool.h"
+#include "Trajectory.h"
+
+namespace
+{
+
+// Frames per run. Long enough that opening a run's readers and decoding
+// from its keyframe cost little beside grading it, short enough that a
+// trajectory of a few hundred frames keeps every thread busy.
+const int FRAMES_PER_RUN = 64;
+
+// What grading one run of frames found.
+struct RunGrade
+{
+  RunGrade()
+  : grader()
+  , read(true)
+  , counts_match(true)
+  {}
+
+  TwoDSceneGrader grader;
+  bool read;
+  bool counts_match;
+};
+
+void gradeRun( const std::string& reference, const std::string& candidate, int numparticles, int begin, int end, RunGrade& run )
+{
+  TrajectoryReader referencereader, candidatereader;
+  if( !referencereader.open(reference, numparticles) || !candidatereader.open(candidate, numparticles) )
+  {
+    run.read = false;
+    return;
+  }
+  VectorXs referencex, referencev, candidatex, candidatev;
+  for( int frame = begin; frame < end; ++frame )
+  {
+    if( referencereader.getNumParticles(frame) != candidatereader.getNumParticles(frame) )
+    {
+      run.counts_match = false;
+      return;
+    }
+    if( !referencereader.readFrame(frame, referencex, referencev) || !candidatereader.readFrame(frame, candidatex, candidatev) )
+    {
+      run.read = false;
+      return;
+    }
+    run.grader.addToAccumulatedResidual(referencex, referencev, candidatex, candidatev);
+  }
+}
+
+}
+
+TrajectoryComparison::TrajectoryComparison()
+: m_grader()
+, m_numframes(0)
+, m_read(false)
+, m_counts_match(true)
+{}
+
+bool TrajectoryComparison::grade( const std::string& reference, const std::string& candidate, int numparticles )
+{
+  m_grader = TwoDSceneGrader();
+  m_numframes = 0;
+  m_counts_match = true;
+
+  TrajectoryReader referencereader, candidatereader;
+  m_read = referencereader.open(reference, numparticles) && candidatereader.open(candidate, numparticles);
+  if( !m_read ) return false;
+  m_numframes = std::min(referencereader.getNumFrames(), candidatereader.getNumFrames());
+  m_counts_match = referencereader.getNumFrames() == candidatereader.getNumFrames();
+
+  // Fixed runs rather than the pool's own split, which depends on the
+  // number of threads, so that the sums always round the same way.
+  const int framesperrun = std::max(TaskPool::grainSize("grading.frames", FRAMES_PER_RUN), 1);
+  const int numruns = ( m_numframes + framesperrun - 1 )/framesperrun;
+  std::vector<RunGrade> runs(numruns);
+  TaskPool::shared().parallelFor(0, numruns, 1, [&]( int lo, int hi )
+  {
+    for( int r = lo; r < hi; ++r )
+      gradeRun(reference, candidate, numparticles, r*framesperrun, std::min(( r + 1 )*framesperrun, m_numframes), runs[r]);
+  } );
+
+  for( int r = 0; r < numruns; ++r )
+  {
+    m_grader.merge(runs[r].grader);
+    m_read = m_read && runs[r].read;
+    m_counts_match = m_counts_match && runs[r].counts_match;
+  }
+  return passed();
+}
+
+bool TrajectoryComparison::passed() const
+{
+  return m_read && m_counts_match && m_grader.accumulatedPositionResidualPassed() && m_grader.accumulatedVelocityResidualPassed() &&
+         m_grader.maxPositionResidualPassed() && m_grader.maxVelocityResidualPassed() && m_grader.collisionsPassed();
+}
+
+bool TrajectoryComparison::wasRead() const
+{
+  return m_read;
+}
+
+int TrajectoryComparison::getNumFrames() const
+{
+  return m_numframes;
+}
+
+const TwoDSceneGrader& TrajectoryComparison::getGrader() const
+{
+  return m_grader;
+}
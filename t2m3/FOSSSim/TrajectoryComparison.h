@@ -0,0 +1,44 @@
+#ifndef TRAJECTORY_COMPARISON_H
+#define TRAJECTORY_COMPARISON_H
+
+#include <string>
+
+#include "TwoDSceneGrader.h"
+
+// Grades a candidate trajectory against a reference one, both as written by
+// FOSSSim -o or FOSSSimMPI -o, without replaying either. The oracle grades a
+// trajectory a frame at a time as it reads it; here the frames are split into
+// fixed runs of consecutive frames, and the shared task pool grades the runs
+// at once, each with its own readers seeking straight to its first frame and
+// its own TwoDSceneGrader. The runs' graders are merged in frame order, so
+// the result does not depend on the number of threads.
+class TrajectoryComparison
+{
+public:
+  TrajectoryComparison();
+
+  // Grades every frame of reference against the same frame of candidate.
+  // numparticles is the scene's number of particles, which trajectories
+  // without an index need. Returns passed().
+  bool grade( const std::string& reference, const std::string& candidate, int numparticles = -1 );
+
+  // Both trajectories were read whole, have as many frames as each other
+  // and the same particles in each, and every residual is within its
+  // threshold.
+  bool passed() const;
+
+  // Whether both trajectories could be opened and their frames read.
+  bool wasRead() const;
+
+  int getNumFrames() const;
+
+  const TwoDSceneGrader& getGrader() const;
+
+private:
+  TwoDSceneGrader m_grader;
+  int m_numframes;
+  bool m_read;
+  bool m_counts_match;
+};
+
+#endif
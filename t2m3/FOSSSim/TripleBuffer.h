@@ -0,0 +1,58 @@
+#ifndef __TRIPLE_BUFFER_H__
+#define __TRIPLE_BUFFER_H__
+
+#include <atomic>
+
+// Hands the latest of a stream of values from one writing thread to one
+// reading thread without either ever waiting for the other. Of three
+// buffers the writer owns one, the reader another, and the third is the
+// latest the writer has finished; publishing and taking swap a thread's
+// buffer for the third with a single atomic exchange. The reader skips any
+// values it was too slow to see, and sees the same value again until a new
+// one is published.
+template<class T>
+class TripleBuffer
+{
+public:
+  TripleBuffer()
+  : m_back(0)
+  , m_middle(1)
+  , m_front(2)
+  {}
+
+  // The buffer the writer fills.
+  T& back() { return m_buffers[m_back]; }
+
+  // Makes the back buffer the latest, and hands the writer the previous one.
+  void publish()
+  {
+    m_back = m_middle.exchange( m_back | FRESH ) & INDEX;
+  }
+
+  // Takes the latest buffer, if there is one newer than front(). Returns
+  // true if front() changed.
+  bool update()
+  {
+    if( !( m_middle.load() & FRESH ) ) return false;
+    m_front = m_middle.exchange( m_front ) & INDEX;
+    return true;
+  }
+
+  // The buffer the reader holds.
+  const T& front() const { return m_buffers[m_front]; }
+
+private:
+  TripleBuffer( const TripleBuffer& );
+  TripleBuffer& operator=( const TripleBuffer& );
+
+  // The middle buffer's index, and whether the reader has yet to take it.
+  static const int INDEX = 3;
+  static const int FRESH = 4;
+
+  T m_buffers[3];
+  int m_back;
+  std::atomic<int> m_middle;
+  int m_front;
+};
+
+#endif
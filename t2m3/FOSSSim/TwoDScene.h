@@ -73,6 +73,9 @@ public:
   
   void insertForce( Force* newforce );
 
+  // Inline, since TwoDScene.cpp is in the base library.
+  const std::vector<Force*>& getForces() const { return m_forces; }
+
   void accumulateGradU( VectorXs& F, const VectorXs& dx = VectorXs(), const VectorXs& dv = VectorXs() );
 
   void accumulateddUdxdx( MatrixXs& A, const VectorXs& dx = VectorXs(), const VectorXs& dv = VectorXs() );
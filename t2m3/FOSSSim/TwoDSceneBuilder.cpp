@@ -0,0 +1,131 @@
+#include "TwoDSceneBuilder.h"
+
+#include <algorithm>
+#include <cassert>
+
+#include "SpringForce.h"
+#include "TwoDScene.h"
+
+void TwoDSceneBuilder::reserve( int numparticles, int numedges, int numhalfplanes, int numsprings )
+{
+  x.reserve(2*numparticles);
+  v.reserve(2*numparticles);
+  m.reserve(numparticles);
+  radii.reserve(numparticles);
+  fixed.reserve(( numparticles + 7 )/8*8);
+  edges.reserve(2*numedges);
+  edgeradii.reserve(numedges);
+  halfplanes.reserve(4*numhalfplanes);
+  springends.reserve(2*numsprings);
+  springparams.reserve(3*numsprings);
+}
+
+void TwoDSceneBuilder::clear()
+{
+  x.clear(); v.clear(); m.clear(); radii.clear(); fixed.clear();
+  edges.clear(); edgeradii.clear(); halfplanes.clear();
+  springends.clear(); springparams.clear();
+}
+
+int TwoDSceneBuilder::addParticle( const Vector2s& position, const Vector2s& velocity, scalar mass, scalar radius, bool isfixed )
+{
+  const unsigned char f = isfixed;
+  return addParticles(1, position.data(), velocity.data(), &mass, &radius, &f);
+}
+
+int TwoDSceneBuilder::addParticles( int count, const scalar* positions, const scalar* velocities, const scalar* masses, const scalar* newradii, const unsigned char* isfixed )
+{
+  assert( count >= 0 );
+  const int first = getNumParticles();
+  // Drops any padding, which would otherwise sit between the particles.
+  fixed.resize(first);
+  x.insert(x.end(), positions, positions + 2*count);
+  v.insert(v.end(), velocities, velocities + 2*count);
+  m.insert(m.end(), masses, masses + count);
+  radii.insert(radii.end(), newradii, newradii + count);
+  fixed.insert(fixed.end(), isfixed, isfixed + count);
+  return first;
+}
+
+int TwoDSceneBuilder::addEdge( int i, int j, scalar radius )
+{
+  const int endpoints[2] = { i, j };
+  return addEdges(1, endpoints, &radius);
+}
+
+int TwoDSceneBuilder::addEdges( int count, const int* endpoints, const scalar* newradii )
+{
+  assert( count >= 0 );
+  const int first = getNumEdges();
+  edges.insert(edges.end(), endpoints, endpoints + 2*count);
+  edgeradii.insert(edgeradii.end(), newradii, newradii + count);
+  return first;
+}
+
+int TwoDSceneBuilder::addHalfplane( const Vector2s& point, const Vector2s& normal )
+{
+  const int first = getNumHalfplanes();
+  halfplanes.push_back(point.x()); halfplanes.push_back(point.y());
+  halfplanes.push_back(normal.x()); halfplanes.push_back(normal.y());
+  return first;
+}
+
+int TwoDSceneBuilder::addSpring( int i, int j, scalar k, scalar l0, scalar b )
+{
+  const int endpoints[2] = { i, j };
+  return addSprings(1, endpoints, &k, &l0, &b);
+}
+
+int TwoDSceneBuilder::addSprings( int count, const int* endpoints, const scalar* k, const scalar* l0, const scalar* b )
+{
+  assert( count >= 0 );
+  const int first = getNumSprings();
+  springends.insert(springends.end(), endpoints, endpoints + 2*count);
+  for( int s = 0; s < count; ++s )
+  {
+    springparams.push_back(k[s]);
+    springparams.push_back(l0[s]);
+    springparams.push_back(b[s]);
+  }
+  return first;
+}
+
+bool TwoDSceneBuilder::endpointsValid() const
+{
+  const int n = getNumParticles();
+  for( std::vector<int>::size_type k = 0; k < edges.size(); ++k ) if( edges[k] < 0 || edges[k] >= n ) return false;
+  for( std::vector<int>::size_type k = 0; k < springends.size(); ++k ) if( springends[k] < 0 || springends[k] >= n ) return false;
+  return true;
+}
+
+void TwoDSceneBuilder::build( TwoDScene& scene ) const
+{
+  assert( endpointsValid() );
+  const int n = getNumParticles();
+  scene.resizeSystem(n);
+  scene.clearEdges();
+  scene.clearHalfplanes();
+
+  // TwoDScene keeps a mass per DoF; the radii and fixed flags are only
+  // reachable through the setters.
+  std::copy(x.begin(), x.end(), scene.getX().data());
+  std::copy(v.begin(), v.end(), scene.getV().data());
+  scalar* masses = scene.getM().data();
+  for( int i = 0; i < n; ++i )
+  {
+    masses[2*i] = masses[2*i+1] = m[i];
+    scene.setRadius(i, radii[i]);
+    scene.setFixed(i, fixed[i] != 0);
+  }
+
+  for( int e = 0; e < getNumEdges(); ++e ) scene.insertEdge(std::make_pair(edges[2*e], edges[2*e+1]), edgeradii[e]);
+  for( int h = 0; h < getNumHalfplanes(); ++h )
+  {
+    VectorXs p(2), nhat(2);
+    p << halfplanes[4*h], halfplanes[4*h+1];
+    nhat << halfplanes[4*h+2], halfplanes[4*h+3];
+    scene.insertHalfplane(std::make_pair(p, nhat));
+  }
+  for( int s = 0; s < getNumSprings(); ++s )
+    scene.insertForce(new SpringForce(std::make_pair(springends[2*s], springends[2*s+1]), springparams[3*s], springparams[3*s+1], springparams[3*s+2]));
+}
@@ -0,0 +1,62 @@
+#ifndef TWO_D_SCENE_BUILDER_H
+#define TWO_D_SCENE_BUILDER_H
+
+#include <vector>
+
+#include "MathDefs.h"
+
+class TwoDScene;
+
+// A scene's particles, edges, halfplanes and springs as flat arrays, built
+// into a TwoDScene in one pass. TwoDScene is compiled into the base library
+// and has only per-element setters and inserts, each checking its index and
+// growing its arrays; building a large scene through them one element at a
+// time is most of the cost of loading it. The builder's arrays are reserved
+// up front and appended to whole, and build() resizes the scene once and
+// copies positions, velocities and masses straight into its storage.
+//
+// The XML and binary loaders parse and read straight into the arrays, which
+// are public for that, and the scene generator fills them element by
+// element. Particle i has x[2*i], x[2*i+1], v likewise, m[i], radii[i] and
+// fixed[i]; edge e joins edges[2*e] and edges[2*e+1]; halfplane h is px, py,
+// nx, ny at halfplanes[4*h]; spring s joins springends[2*s] and
+// springends[2*s+1] with springparams[3*s] the stiffness, then the rest
+// length and the damping. fixed may be padded past the particle count,
+// which is that of m.
+struct TwoDSceneBuilder
+{
+  std::vector<scalar> x, v, m, radii;
+  std::vector<unsigned char> fixed;
+  std::vector<int> edges;
+  std::vector<scalar> edgeradii;
+  std::vector<scalar> halfplanes;
+  std::vector<int> springends;
+  std::vector<scalar> springparams;
+
+  void reserve( int numparticles, int numedges, int numhalfplanes = 0, int numsprings = 0 );
+
+  void clear();
+
+  int getNumParticles() const { return (int) m.size(); }
+  int getNumEdges() const { return (int) edgeradii.size(); }
+  int getNumHalfplanes() const { return (int) halfplanes.size()/4; }
+  int getNumSprings() const { return (int) springparams.size()/3; }
+
+  // Each returns the index of the first element it added.
+  int addParticle( const Vector2s& position, const Vector2s& velocity, scalar mass, scalar radius, bool isfixed );
+  int addParticles( int count, const scalar* positions, const scalar* velocities, const scalar* masses, const scalar* radii, const unsigned char* isfixed );
+  int addEdge( int i, int j, scalar radius );
+  int addEdges( int count, const int* endpoints, const scalar* radii );
+  int addHalfplane( const Vector2s& point, const Vector2s& normal );
+  int addSpring( int i, int j, scalar k, scalar l0, scalar b );
+  int addSprings( int count, const int* endpoints, const scalar* k, const scalar* l0, const scalar* b );
+
+  // True if every edge and spring joins particles that exist.
+  bool endpointsValid() const;
+
+  // Replaces scene's particles, edges and halfplanes with these and inserts
+  // a SpringForce per spring; scene keeps its other forces.
+  void build( TwoDScene& scene ) const;
+};
+
+#endif
@@ -0,0 +1,122 @@
+#include "TwoDSceneGrader.h"
+
+namespace
+{
+
+typedef Eigen::Array<scalar, Eigen::Dynamic, 1> ArrayXs;
+
+// Sets r(i) to the distance between the i-th 2D points of a and b. The
+// differences and roots are taken a packet at a time over the whole state,
+// and each distance is still the root of dx*dx + dy*dy, so it is the same
+// to the last bit as one computed particle by particle.
+void computeDistances( const VectorXs& a, const VectorXs& b, int numparticles, ArrayXs& r )
+{
+  ArrayXs squares = ( a.head(2*numparticles) - b.head(2*numparticles) ).array().square();
+  const Eigen::Map<Eigen::Array<scalar, 2, Eigen::Dynamic> > pairs(squares.data(), 2, numparticles);
+  r = pairs.colwise().sum().transpose().sqrt();
+}
+
+}
+
+TwoDSceneGrader::TwoDSceneGrader()
+: m_accumulated_position_residual(0.0)
+, m_accumulated_velocity_residual(0.0)
+, m_max_position_residual(0.0)
+, m_max_velocity_residual(0.0)
+, m_accumulated_position_residual_threshold(1.0e-6)
+, m_accumulated_velocity_residual_threshold(1.0e-6)
+, m_max_position_residual_threshold(1.0e-10)
+, m_max_velocity_residual_threshold(1.0e-10)
+, m_collisions_passed(true)
+{}
+
+void TwoDSceneGrader::addToAccumulatedResidual( const TwoDScene& oracle_scene, const TwoDScene& testing_scene )
+{
+  addToAccumulatedResidual(oracle_scene.getX(), oracle_scene.getV(), testing_scene.getX(), testing_scene.getV());
+}
+
+void TwoDSceneGrader::addToAccumulatedResidual( const VectorXs& oracle_x, const VectorXs& oracle_v, const VectorXs& testing_x, const VectorXs& testing_v )
+{
+  const int numparticles = (int) ( oracle_x.size()/2 );
+  ArrayXs position_residuals;
+  ArrayXs velocity_residuals;
+  computeDistances(oracle_x, testing_x, numparticles, position_residuals);
+  computeDistances(oracle_v, testing_v, numparticles, velocity_residuals);
+
+  // One pass for the sums and maxima of both, in particle order, so the sums
+  // round as they always have.
+  scalar accumulated_position = m_accumulated_position_residual;
+  scalar accumulated_velocity = m_accumulated_velocity_residual;
+  scalar max_position = m_max_position_residual;
+  scalar max_velocity = m_max_velocity_residual;
+  for( int i = 0; i < numparticles; ++i )
+  {
+    accumulated_position += position_residuals(i);
+    accumulated_velocity += velocity_residuals(i);
+    if( position_residuals(i) > max_position ) max_position = position_residuals(i);
+    if( velocity_residuals(i) > max_velocity ) max_velocity = velocity_residuals(i);
+  }
+  m_accumulated_position_residual = accumulated_position;
+  m_accumulated_velocity_residual = accumulated_velocity;
+  m_max_position_residual = max_position;
+  m_max_velocity_residual = max_velocity;
+}
+
+void TwoDSceneGrader::merge( const TwoDSceneGrader& later )
+{
+  m_accumulated_position_residual += later.m_accumulated_position_residual;
+  m_accumulated_velocity_residual += later.m_accumulated_velocity_residual;
+  if( later.m_max_position_residual > m_max_position_residual ) m_max_position_residual = later.m_max_position_residual;
+  if( later.m_max_velocity_residual > m_max_velocity_residual ) m_max_velocity_residual = later.m_max_velocity_residual;
+  if( !later.m_collisions_passed ) m_collisions_passed = false;
+}
+
+double TwoDSceneGrader::getAccumulatedPositionResidual() const
+{
+  return m_accumulated_position_residual;
+}
+
+double TwoDSceneGrader::getAccumulatedVelocityResidual() const
+{
+  return m_accumulated_velocity_residual;
+}
+
+double TwoDSceneGrader::getMaxPositionResidual() const
+{
+  return m_max_position_residual;
+}
+
+double TwoDSceneGrader::getMaxVelocityResidual() const
+{
+  return m_max_velocity_residual;
+}
+
+bool TwoDSceneGrader::accumulatedPositionResidualPassed() const
+{
+  return m_accumulated_position_residual < m_accumulated_position_residual_threshold;
+}
+
+bool TwoDSceneGrader::accumulatedVelocityResidualPassed() const
+{
+  return m_accumulated_velocity_residual < m_accumulated_velocity_residual_threshold;
+}
+
+bool TwoDSceneGrader::maxPositionResidualPassed() const
+{
+  return m_max_position_residual < m_max_position_residual_threshold;
+}
+
+bool TwoDSceneGrader::maxVelocityResidualPassed() const
+{
+  return m_max_velocity_residual < m_max_velocity_residual_threshold;
+}
+
+bool TwoDSceneGrader::collisionsPassed() const
+{
+  return m_collisions_passed;
+}
+
+void TwoDSceneGrader::setCollisionsFailed()
+{
+  m_collisions_passed = false;
+}
@@ -0,0 +1,204 @@
+#include "XMLElementStream.h"
+
+#include <cstdlib>
+#include <cstring>
+
+namespace
+{
+
+// Bytes read from the file at a time.
+const std::size_t CHUNK_SIZE = 1 << 16;
+
+bool isSpace( int c )
+{
+  return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+bool endsName( int c )
+{
+  return c < 0 || isSpace(c) || c == '=' || c == '/' || c == '>';
+}
+
+// Decodes the predefined entities and character references in place; any
+// other '&' is kept as it is, as rapidxml does.
+void decodeEntities( std::string& s )
+{
+  if( s.find('&') == std::string::npos ) return;
+
+  static const char* names[5] = { "&lt;", "&gt;", "&amp;", "&quot;", "&apos;" };
+  static const char chars[5] = { '<', '>', '&', '"', '\'' };
+  std::string out;
+  out.reserve(s.size());
+  for( std::string::size_type i = 0; i < s.size(); )
+  {
+    if( s[i] != '&' ) { out += s[i++]; continue; }
+    bool decoded = false;
+    for( int k = 0; k < 5 && !decoded; ++k )
+    {
+      const std::string::size_type len = strlen(names[k]);
+      if( s.compare(i, len, names[k]) == 0 ) { out += chars[k]; i += len; decoded = true; }
+    }
+    if( !decoded && i + 2 < s.size() && s[i+1] == '#' )
+    {
+      const std::string::size_type semi = s.find(';', i);
+      if( semi != std::string::npos )
+      {
+        const bool hex = s[i+2] == 'x';
+        const unsigned long code = strtoul(s.c_str() + i + ( hex ? 3 : 2 ), NULL, hex ? 16 : 10);
+        if( code > 0 && code < 128 ) { out += char(code); i = semi + 1; decoded = true; }
+      }
+    }
+    if( !decoded ) out += s[i++];
+  }
+  s.swap(out);
+}
+
+}
+
+const std::string* XMLElement::findAttribute( const char* name ) const
+{
+  for( std::vector<std::pair<std::string, std::string> >::size_type a = 0; a < attributes.size(); ++a )
+    if( attributes[a].first == name ) return &attributes[a].second;
+  return NULL;
+}
+
+XMLElementStream::XMLElementStream( const std::string& filename )
+: m_ifs(filename.c_str(), std::ios::binary)
+, m_buffer(CHUNK_SIZE)
+, m_pos(0)
+, m_end(0)
+, m_depth(0)
+, m_failed(false)
+{}
+
+bool XMLElementStream::isOpen() const
+{
+  return m_ifs.is_open();
+}
+
+bool XMLElementStream::failed() const
+{
+  return m_failed;
+}
+
+bool XMLElementStream::fill()
+{
+  if( !m_ifs ) return false;
+  m_ifs.read(&m_buffer[0], m_buffer.size());
+  m_pos = 0;
+  m_end = (std::size_t) m_ifs.gcount();
+  return m_end > 0;
+}
+
+int XMLElementStream::peek()
+{
+  if( m_pos == m_end && !fill() ) return -1;
+  return (unsigned char) m_buffer[m_pos];
+}
+
+int XMLElementStream::get()
+{
+  const int c = peek();
+  if( c >= 0 ) ++m_pos;
+  return c;
+}
+
+bool XMLElementStream::skipPast( const char* terminator )
+{
+  // Compares the last strlen(terminator) characters read, so that overlapping
+  // prefixes such as the dashes of "--->" still end a comment.
+  const std::string end(terminator);
+  std::string window;
+  while( window != end )
+  {
+    const int c = get();
+    if( c < 0 ) return false;
+    window += char(c);
+    if( window.size() > end.size() ) window.erase(0, 1);
+  }
+  return true;
+}
+
+void XMLElementStream::skipSpace()
+{
+  while( isSpace(peek()) ) get();
+}
+
+bool XMLElementStream::readName( std::string& name )
+{
+  name.clear();
+  while( !endsName(peek()) ) name += char(get());
+  return !name.empty();
+}
+
+bool XMLElementStream::readValue( std::string& value )
+{
+  const int quote = get();
+  if( quote != '"' && quote != '\'' ) return false;
+  value.clear();
+  for( int c = get(); c != quote; c = get() )
+  {
+    if( c < 0 ) return false;
+    value += char(c);
+  }
+  decodeEntities(value);
+  return true;
+}
+
+bool XMLElementStream::next( XMLElement& element, int& depth )
+{
+  while( true )
+  {
+    int c = get();
+    while( c >= 0 && c != '<' ) c = get();
+    if( c < 0 ) return false;
+
+    c = peek();
+    if( c == '?' )
+    {
+      if( !skipPast("?>") ) { m_failed = true; return false; }
+      continue;
+    }
+    if( c == '!' )
+    {
+      get();
+      const bool comment = peek() == '-';
+      if( !skipPast(comment ? "-->" : ">") ) { m_failed = true; return false; }
+      continue;
+    }
+    if( c == '/' )
+    {
+      if( !skipPast(">") ) { m_failed = true; return false; }
+      --m_depth;
+      continue;
+    }
+
+    element.name.clear();
+    element.attributes.clear();
+    if( !readName(element.name) ) { m_failed = true; return false; }
+    while( true )
+    {
+      skipSpace();
+      c = peek();
+      if( c == '/' || c == '>' ) break;
+      std::pair<std::string, std::string> attribute;
+      if( !readName(attribute.first) ) { m_failed = true; return false; }
+      skipSpace();
+      if( get() != '=' ) { m_failed = true; return false; }
+      skipSpace();
+      if( !readValue(attribute.second) ) { m_failed = true; return false; }
+      element.attributes.push_back(attribute);
+    }
+
+    depth = m_depth;
+    if( get() == '/' )
+    {
+      if( get() != '>' ) { m_failed = true; return false; }
+    }
+    else
+    {
+      ++m_depth;
+    }
+    return true;
+  }
+}
@@ -0,0 +1,58 @@
+#ifndef XML_ELEMENT_STREAM_H
+#define XML_ELEMENT_STREAM_H
+
+#include <fstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+// An element's name and its attributes, with entities decoded, in document
+// order.
+struct XMLElement
+{
+  std::string name;
+  std::vector<std::pair<std::string, std::string> > attributes;
+
+  // The value of attribute name, or NULL if the element has none.
+  const std::string* findAttribute( const char* name ) const;
+};
+
+// Streaming reader of the start tags of an XML file. rapidxml parses a
+// scene in place, so the whole file and its DOM are held at once, several
+// times the size of the scene itself; this reads the file in fixed-size
+// chunks and hands out one element at a time, so a large scene can be
+// converted straight into flat arrays. Text, comments, processing
+// instructions and declarations are skipped, and closing tags only track
+// the depth.
+class XMLElementStream
+{
+public:
+  explicit XMLElementStream( const std::string& filename );
+
+  bool isOpen() const;
+
+  // Reads the next start or empty-element tag into element and sets depth to
+  // its nesting depth, 0 for the root. Returns false at the end of the file
+  // or on malformed markup, which failed() tells apart.
+  bool next( XMLElement& element, int& depth );
+
+  bool failed() const;
+
+private:
+  int get();
+  int peek();
+  bool fill();
+  bool skipPast( const char* terminator );
+  void skipSpace();
+  bool readName( std::string& name );
+  bool readValue( std::string& value );
+
+  std::ifstream m_ifs;
+  std::vector<char> m_buffer;
+  std::size_t m_pos;
+  std::size_t m_end;
+  int m_depth;
+  bool m_failed;
+};
+
+#endif
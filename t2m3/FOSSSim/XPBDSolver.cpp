@@ -0,0 +1,272 @@
+#include "XPBDSolver.h"
+
+#include <algorithm>
+#include <chrono>
+
+#include "ContestDetector.h"
+#include "PenaltyForce.h"
+#include "SpringForce.h"
+#include "StepBudget.h"
+
+namespace
+{
+
+// Fraction of a contact's overlap at the start of a step pushed out in it.
+const scalar RECOVERY = 0.1;
+
+class ContactCollector : public DetectionCallback, public PairListDetectionCallback
+{
+public:
+  ContactCollector( PPList& pppairs, PEList& pepairs, PHList& phpairs )
+  : m_pppairs(pppairs)
+  , m_pepairs(pepairs)
+  , m_phpairs(phpairs)
+  {}
+
+  virtual void ParticleParticleCallback( int idx1, int idx2 ) { m_pppairs.push_back(std::make_pair(idx1, idx2)); }
+  virtual void ParticleEdgeCallback( int vidx, int eidx ) { m_pepairs.push_back(std::make_pair(vidx, eidx)); }
+  virtual void ParticleHalfplaneCallback( int vidx, int hidx ) { m_phpairs.push_back(std::make_pair(vidx, hidx)); }
+
+  virtual void PairListsCallback( const PPList& pppairs, const PEList& pepairs, const PHList& phpairs )
+  {
+    m_pppairs.insert(m_pppairs.end(), pppairs.begin(), pppairs.end());
+    m_pepairs.insert(m_pepairs.end(), pepairs.begin(), pepairs.end());
+    m_phpairs.insert(m_phpairs.end(), phpairs.begin(), phpairs.end());
+  }
+
+private:
+  PPList& m_pppairs;
+  PEList& m_pepairs;
+  PHList& m_phpairs;
+};
+
+}
+
+XPBDSolver::XPBDSolver( int iterations )
+: m_iterations(iterations)
+, m_thickness(0.0)
+{
+  assert( m_iterations > 0 );
+}
+
+bool XPBDSolver::gatherForces( const TwoDScene& scene, const VectorXs& winv, VectorXs& a )
+{
+  const VectorXs& x = scene.getX();
+  const VectorXs& v = scene.getV();
+  const VectorXs& m = scene.getM();
+  const std::vector<Force*>& forces = scene.getForces();
+
+  m_distances.clear();
+  bool contacts = false;
+  VectorXs gradE = VectorXs::Zero(x.size());
+  for( std::vector<Force*>::size_type f = 0; f < forces.size(); ++f )
+  {
+    if( const SpringForce* spring = dynamic_cast<const SpringForce*>(forces[f]) )
+    {
+      if( !( spring->getStiffness() > 0.0 ) ) continue;
+      DistanceConstraint c;
+      c.i = spring->getEndpoints().first;
+      c.j = spring->getEndpoints().second;
+      c.l0 = spring->getRestLength();
+      c.compliance = 1.0/spring->getStiffness();
+      c.lambda = 0.0;
+      m_distances.push_back(c);
+    }
+    else if( const PenaltyForce* penalty = dynamic_cast<const PenaltyForce*>(forces[f]) )
+    {
+      m_thickness = contacts ? std::max(m_thickness, penalty->getThickness()) : penalty->getThickness();
+      contacts = true;
+    }
+    else
+    {
+      forces[f]->addGradEToTotal(x, v, m, gradE);
+    }
+  }
+  a = -gradE.cwiseProduct(winv);
+  return contacts;
+}
+
+void XPBDSolver::detectContacts( const TwoDScene& scene, const VectorXs& x, scalar thickness )
+{
+  m_pppairs.clear();
+  m_pepairs.clear();
+  m_phpairs.clear();
+
+  // The detector reports overlapping radii, so pad them by the thickness.
+  TwoDScene padded;
+  padded.resizeSystem( scene.getNumParticles() );
+  for( int i = 0; i < scene.getNumParticles(); ++i ) padded.setRadius( i, scene.getRadius(i) + thickness );
+  for( int e = 0; e < scene.getNumEdges(); ++e ) padded.insertEdge( scene.getEdge(e), scene.getEdgeRadii()[e] + thickness );
+  for( int h = 0; h < scene.getNumHalfplanes(); ++h ) padded.insertHalfplane( scene.getHalfplane(h) );
+
+  ContestDetector detector;
+  ContactCollector collector(m_pppairs, m_pepairs, m_phpairs);
+  detector.performCollisionDetection(padded, x, x, collector);
+}
+
+// dlambda = (-C - alphatilde*lambda)/(wi + wj + alphatilde), with
+// alphatilde = compliance/dt^2, and x moves along the constraint gradient.
+void XPBDSolver::projectDistance( DistanceConstraint& c, scalar alphatilde, const VectorXs& winv, VectorXs& x ) const
+{
+  const scalar wi = winv(2*c.i);
+  const scalar wj = winv(2*c.j);
+  const Vector2s n = x.segment<2>(2*c.i) - x.segment<2>(2*c.j);
+  const scalar len = n.norm();
+  const scalar denominator = wi + wj + alphatilde;
+  if( len < 1e-10 || !( denominator > 0.0 ) ) return;
+  const Vector2s nhat = n/len;
+
+  const scalar dlambda = ( -( len - c.l0 ) - alphatilde*c.lambda )/denominator;
+  c.lambda += dlambda;
+  x.segment<2>(2*c.i) += wi*dlambda*nhat;
+  x.segment<2>(2*c.j) -= wj*dlambda*nhat;
+}
+
+// The gap of a contact is its distance less the combined radius and the
+// thickness, and nhat the direction it grows in for the first particle's
+// partner. Returns false where the direction is undefined.
+bool XPBDSolver::particleParticleGap( const TwoDScene& scene, const VectorXs& x, int i, int j, scalar& gap, Vector2s& nhat ) const
+{
+  const Vector2s n = x.segment<2>(2*j) - x.segment<2>(2*i);
+  const scalar len = n.norm();
+  if( len < 1e-10 ) return false;
+  gap = len - scene.getRadius(i) - scene.getRadius(j) - m_thickness;
+  nhat = n/len;
+  return true;
+}
+
+bool XPBDSolver::particleEdgeGap( const TwoDScene& scene, const VectorXs& x, int i, int e, scalar& gap, Vector2s& nhat, scalar& alpha ) const
+{
+  const std::pair<int,int>& edge = scene.getEdge(e);
+  const Vector2s x1 = x.segment<2>(2*i);
+  const Vector2s x2 = x.segment<2>(2*edge.first);
+  const Vector2s x3 = x.segment<2>(2*edge.second);
+
+  alpha = std::min(1.0, std::max(0.0, (x1-x2).dot(x3-x2)/(x3-x2).squaredNorm()));
+  const Vector2s n = x2 + alpha*(x3-x2) - x1;
+  const scalar len = n.norm();
+  if( len < 1e-10 ) return false;
+  gap = len - scene.getRadius(i) - scene.getEdgeRadii()[e] - m_thickness;
+  nhat = n/len;
+  return true;
+}
+
+scalar XPBDSolver::particleHalfplaneGap( const TwoDScene& scene, const VectorXs& x, int i, int h, Vector2s& nhat ) const
+{
+  nhat = scene.getHalfplane(h).second.segment<2>(0).normalized();
+  return ( x.segment<2>(2*i) - scene.getHalfplane(h).first.segment<2>(0) ).dot(nhat) - scene.getRadius(i) - m_thickness;
+}
+
+// A contact whose gap is already negative at the start of the step is only
+// kept from closing further, less a fraction RECOVERY of its overlap, so that
+// an overlapping scene is pushed apart over several steps instead of being
+// resolved, and turned into velocity, all in one.
+void XPBDSolver::recordSlack( const TwoDScene& scene, const VectorXs& x )
+{
+  scalar gap, alpha;
+  Vector2s nhat;
+  m_ppslack.resize(m_pppairs.size());
+  for( PPList::size_type c = 0; c < m_pppairs.size(); ++c )
+    m_ppslack[c] = particleParticleGap(scene, x, m_pppairs[c].first, m_pppairs[c].second, gap, nhat) ? std::min(0.0, ( 1.0 - RECOVERY )*gap) : 0.0;
+  m_peslack.resize(m_pepairs.size());
+  for( PEList::size_type c = 0; c < m_pepairs.size(); ++c )
+    m_peslack[c] = particleEdgeGap(scene, x, m_pepairs[c].first, m_pepairs[c].second, gap, nhat, alpha) ? std::min(0.0, ( 1.0 - RECOVERY )*gap) : 0.0;
+  m_phslack.resize(m_phpairs.size());
+  for( PHList::size_type c = 0; c < m_phpairs.size(); ++c )
+    m_phslack[c] = std::min(0.0, ( 1.0 - RECOVERY )*particleHalfplaneGap(scene, x, m_phpairs[c].first, m_phpairs[c].second, nhat));
+}
+
+void XPBDSolver::projectParticleParticle( const TwoDScene& scene, int i, int j, scalar slack, const VectorXs& winv, VectorXs& x ) const
+{
+  const scalar wi = winv(2*i);
+  const scalar wj = winv(2*j);
+  scalar gap;
+  Vector2s nhat;
+  if( !( wi + wj > 0.0 ) || !particleParticleGap(scene, x, i, j, gap, nhat) || !( gap < slack ) ) return;
+
+  const scalar s = ( slack - gap )/( wi + wj );
+  x.segment<2>(2*i) -= wi*s*nhat;
+  x.segment<2>(2*j) += wj*s*nhat;
+}
+
+// The gradient of the gap with respect to the particle, the edge's first and
+// its second endpoint is -nhat, (1-alpha)*nhat and alpha*nhat, as in the
+// penalty force.
+void XPBDSolver::projectParticleEdge( const TwoDScene& scene, int i, int e, scalar slack, const VectorXs& winv, VectorXs& x ) const
+{
+  scalar gap, alpha;
+  Vector2s nhat;
+  if( !particleEdgeGap(scene, x, i, e, gap, nhat, alpha) || !( gap < slack ) ) return;
+
+  const std::pair<int,int>& edge = scene.getEdge(e);
+  const scalar w1 = winv(2*i);
+  const scalar w2 = winv(2*edge.first);
+  const scalar w3 = winv(2*edge.second);
+  const scalar denominator = w1 + (1.0-alpha)*(1.0-alpha)*w2 + alpha*alpha*w3;
+  if( !( denominator > 0.0 ) ) return;
+
+  const scalar s = ( slack - gap )/denominator;
+  x.segment<2>(2*i) -= w1*s*nhat;
+  x.segment<2>(2*edge.first) += (1.0-alpha)*w2*s*nhat;
+  x.segment<2>(2*edge.second) += alpha*w3*s*nhat;
+}
+
+void XPBDSolver::projectParticleHalfplane( const TwoDScene& scene, int i, int h, scalar slack, const VectorXs& winv, VectorXs& x ) const
+{
+  if( !( winv(2*i) > 0.0 ) ) return;
+  Vector2s nhat;
+  const scalar gap = particleHalfplaneGap(scene, x, i, h, nhat);
+  if( gap < slack ) x.segment<2>(2*i) += ( slack - gap )*nhat;
+}
+
+void XPBDSolver::step( TwoDScene& scene, scalar dt, StepBudget* budget )
+{
+  typedef std::chrono::steady_clock Clock;
+  const Clock::time_point start = Clock::now();
+  VectorXs& x = scene.getX();
+  VectorXs& v = scene.getV();
+  const VectorXs& m = scene.getM();
+  const int nparticles = scene.getNumParticles();
+
+  VectorXs winv(x.size());
+  for( int i = 0; i < nparticles; ++i )
+  {
+    const bool fixed = scene.isFixed(i);
+    winv(2*i) = fixed ? 0.0 : 1.0/m(2*i);
+    winv(2*i+1) = fixed ? 0.0 : 1.0/m(2*i+1);
+  }
+
+  VectorXs a;
+  const bool contacts = gatherForces(scene, winv, a);
+
+  VectorXs xstar = x + dt*( v + dt*a );
+  for( int i = 0; i < nparticles; ++i ) if( scene.isFixed(i) ) xstar.segment<2>(2*i) = x.segment<2>(2*i);
+
+  if( contacts )
+  {
+    detectContacts(scene, xstar, m_thickness);
+    recordSlack(scene, x);
+  }
+
+  const int sweeps = budget != NULL ? budget->allow(m_iterations, 1) : m_iterations;
+  const Clock::time_point detected = Clock::now();
+  const scalar invdt2 = 1.0/( dt*dt );
+  for( int k = 0; k < sweeps; ++k )
+  {
+    for( std::vector<DistanceConstraint>::size_type c = 0; c < m_distances.size(); ++c )
+      projectDistance(m_distances[c], m_distances[c].compliance*invdt2, winv, xstar);
+    for( PPList::size_type c = 0; c < m_pppairs.size(); ++c ) projectParticleParticle(scene, m_pppairs[c].first, m_pppairs[c].second, m_ppslack[c], winv, xstar);
+    for( PEList::size_type c = 0; c < m_pepairs.size(); ++c ) projectParticleEdge(scene, m_pepairs[c].first, m_pepairs[c].second, m_peslack[c], winv, xstar);
+    for( PHList::size_type c = 0; c < m_phpairs.size(); ++c ) projectParticleHalfplane(scene, m_phpairs[c].first, m_phpairs[c].second, m_phslack[c], winv, xstar);
+  }
+  const Clock::time_point swept = Clock::now();
+
+  for( int i = 0; i < nparticles; ++i )
+  {
+    if( scene.isFixed(i) ) continue;
+    v.segment<2>(2*i) = ( xstar.segment<2>(2*i) - x.segment<2>(2*i) )/dt;
+    x.segment<2>(2*i) = xstar.segment<2>(2*i);
+  }
+
+  if( budget != NULL ) budget->record(std::chrono::duration<double>(( detected - start ) + ( Clock::now() - swept )).count(), std::chrono::duration<double>(swept - detected).count(), sweeps);
+}
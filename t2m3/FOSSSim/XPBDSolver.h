@@ -0,0 +1,79 @@
+#ifndef __XPBD_SOLVER_H__
+#define __XPBD_SOLVER_H__
+
+#include <vector>
+
+#include "BroadPhase.h"
+#include "MathDefs.h"
+#include "TwoDScene.h"
+
+class StepBudget;
+
+// Extended position-based dynamics, used by forward-backward Euler when built
+// with XPBD_ITERATIONS > 0. Each step predicts x* = x + dt*(v + dt*F/m) from
+// the forces that are neither springs nor penalty forces, then moves x* by a
+// fixed number of Gauss-Seidel sweeps over
+//
+//   - one distance constraint |xi - xj| = l0 per spring, with compliance 1/k,
+//     so that a stiff spring costs no more than a soft one, and
+//   - one inequality constraint per contact the contest detector finds at x*,
+//     keeping particles, edges and halfplanes the penalty force's thickness
+//     apart. Contacts are hard; the penalty stiffness is not used. Scenes
+//     without a penalty force have no contacts. Contacts already overlapping
+//     at the start of the step are only pushed out by a tenth of it, so an
+//     overlapping scene comes apart over several steps rather than at once.
+//
+// and sets v = (x* - x)/dt, x = x*. Fixed particles have zero inverse mass and
+// are not moved. Spring damping is not modelled. The cost per step is linear
+// in the number of springs and contacts for any stiffness, at the price of
+// springs that soften as the iteration count drops.
+//
+// Given a StepBudget, a step takes only as many sweeps as the budget allows,
+// at least one, and the detection and the sweeps are timed for it.
+class XPBDSolver
+{
+public:
+  explicit XPBDSolver( int iterations );
+
+  void step( TwoDScene& scene, scalar dt, StepBudget* budget = NULL );
+
+private:
+  struct DistanceConstraint
+  {
+    int i;
+    int j;
+    scalar l0;
+    scalar compliance;
+    scalar lambda;
+  };
+
+  // Reads the springs, the external forces and the contact thickness from
+  // the scene's forces. Returns false if the scene has no penalty force.
+  bool gatherForces( const TwoDScene& scene, const VectorXs& winv, VectorXs& a );
+
+  void detectContacts( const TwoDScene& scene, const VectorXs& x, scalar thickness );
+
+  bool particleParticleGap( const TwoDScene& scene, const VectorXs& x, int i, int j, scalar& gap, Vector2s& nhat ) const;
+  bool particleEdgeGap( const TwoDScene& scene, const VectorXs& x, int i, int e, scalar& gap, Vector2s& nhat, scalar& alpha ) const;
+  scalar particleHalfplaneGap( const TwoDScene& scene, const VectorXs& x, int i, int h, Vector2s& nhat ) const;
+
+  // Sets the smallest gap each contact is allowed from its gap at x.
+  void recordSlack( const TwoDScene& scene, const VectorXs& x );
+
+  void projectDistance( DistanceConstraint& c, scalar alphatilde, const VectorXs& winv, VectorXs& x ) const;
+  void projectParticleParticle( const TwoDScene& scene, int i, int j, scalar slack, const VectorXs& winv, VectorXs& x ) const;
+  void projectParticleEdge( const TwoDScene& scene, int i, int e, scalar slack, const VectorXs& winv, VectorXs& x ) const;
+  void projectParticleHalfplane( const TwoDScene& scene, int i, int h, scalar slack, const VectorXs& winv, VectorXs& x ) const;
+
+  int m_iterations;
+  scalar m_thickness;
+  std::vector<DistanceConstraint> m_distances;
+  PPList m_pppairs;
+  PEList m_pepairs;
+  PHList m_phpairs;
+  std::vector<scalar> m_ppslack;
+  std::vector<scalar> m_peslack;
+  std::vector<scalar> m_phslack;
+};
+
+#endif
@@ -0,0 +1,522 @@
+// Times FOSSSim on a set of scenes for a fixed number of steps each and
+// compares the results against a stored baseline.
+//
+// The simulation loop lives in the base library, so each scene is run by the
+// FOSSSim executable itself, headless, from a copy whose duration has been
+// cut to the requested number of steps. A run of the same copy with no steps
+// at all times loading the scene, and that is taken off, so what is left is
+// the cost of stepping. Scenes of a handful of particles step in less time
+// than a process takes to start, so they take enough extra steps to make up
+// a minimum number of particle-steps.
+//
+// With --scaling it measures instead where threading stops paying, in
+// process through FOSSSimEmbed, so that each phase of the step can be timed
+// on its own; see FOSSSim/PhaseTimes.h. The scene given, or a synthetic box
+// scene of --generate particles, is loaded and stepped on 1, 2, 4, ... up to
+// --threads threads (strong scaling), and a box scene of --generate
+// particles per thread likewise (weak scaling). For each thread count it
+// reports the time per step and every phase's parallel efficiency against
+// one thread: T1/(p Tp) for strong scaling and T1/Tp for weak, 100% being
+// perfect. The phase that falls furthest short at the most threads, of
+// those taking a noticeable share of the step, is named as the limit.
+// Scenes are stepped as FOSSSimEmbed steps them, with penalty contacts; the
+// hybrid handler's continuous-time detection and impact zones are not part
+// of these scenes.
+
+#include <dirent.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <tclap/CmdLine.h>
+
+#include "BenchTimer.h"
+#include "FOSSSim/PhaseTimes.h"
+#include "FOSSSim/SceneGenerator.h"
+#include "FOSSSim/TaskPool.h"
+#include "FOSSSim/XMLElementStream.h"
+#include "FOSSSimEmbed/FOSSSimEmbed.h"
+
+namespace
+{
+
+const char* DEFAULT_SCENE_DIRECTORIES[] = { "assets/t2m3/TimingScenes", "assets/t2m3/TestingScenes" };
+
+// Share of the step below which a phase is not named as the limit, however
+// poorly it scales.
+const double LIMITING_SHARE = 0.05;
+
+struct SceneTiming
+{
+  int numparticles;
+  int numsteps;
+  double steps_per_second;
+  double ns_per_particle_step;
+};
+
+// One run of the scaling study: seconds per step, and spent in each phase
+// per step, except loading, which is the seconds the scene took to load.
+// Step time no phase accounts for is left in other.
+struct ScalingRun
+{
+  int numthreads;
+  int numparticles;
+  double step;
+  double phases[phasetimes::NUM_PHASES];
+  double other;
+};
+
+void complain( const std::string& what )
+{
+  std::cerr << "\033[31;1mERROR IN FOSSSIMBENCH:\033[m " << what << std::endl;
+}
+
+// The particle count and time step of a scene.
+bool readScene( const std::string& xmlfile, int& numparticles, double& dt )
+{
+  XMLElementStream stream(xmlfile);
+  if( !stream.isOpen() )
+  {
+    complain("Failed to open " + xmlfile + ".");
+    return false;
+  }
+
+  numparticles = 0;
+  dt = 0.0;
+  XMLElement element;
+  int depth = 0;
+  while( stream.next(element, depth) )
+  {
+    if( depth != 1 ) continue;
+    if( element.name == "particle" ) ++numparticles;
+    else if( element.name == "integrator" )
+    {
+      const std::string* value = element.findAttribute("dt");
+      if( value != NULL ) dt = strtod(value->c_str(), NULL);
+    }
+  }
+  if( stream.failed() )
+  {
+    complain("Failed to parse " + xmlfile + ".");
+    return false;
+  }
+  if( !( dt > 0.0 ) )
+  {
+    complain(xmlfile + " has no integrator time step.");
+    return false;
+  }
+  return true;
+}
+
+bool readFile( const std::string& filename, std::string& contents )
+{
+  std::ifstream ifs(filename.c_str(), std::ios::binary);
+  if( !ifs ) return false;
+  std::ostringstream oss;
+  oss << ifs.rdbuf();
+  contents = oss.str();
+  return bool(ifs);
+}
+
+// The scene with its <duration> time set to duration. Only the attribute's
+// value changes, so the copy parses exactly as the original did.
+bool setDuration( const std::string& scene, double duration, std::string& copy )
+{
+  const std::string::size_type tag = scene.find("<duration");
+  if( tag == std::string::npos ) return false;
+  const std::string::size_type end = scene.find('>', tag);
+  const std::string::size_type attribute = scene.find("time=\"", tag);
+  if( attribute == std::string::npos || attribute > end ) return false;
+  const std::string::size_type begin = attribute + 6;
+  const std::string::size_type quote = scene.find('"', begin);
+  if( quote == std::string::npos ) return false;
+
+  std::ostringstream value;
+  value << std::setprecision(17) << duration;
+  copy = scene.substr(0, begin) + value.str() + scene.substr(quote);
+  return true;
+}
+
+bool writeTemporaryScene( const std::string& contents, std::string& filename )
+{
+  char name[] = "/tmp/fosssimbenchXXXXXX.xml";
+  const int fd = mkstemps(name, 4);
+  if( fd < 0 ) return false;
+  close(fd);
+  filename = name;
+  std::ofstream ofs(filename.c_str(), std::ios::binary);
+  ofs << contents;
+  return bool(ofs);
+}
+
+// The best wall-clock time of repeats headless runs of a scene.
+bool timeRun( const std::string& executable, const std::string& xmlfile, int repeats, double& seconds )
+{
+  const std::string command = "\"" + executable + "\" -s \"" + xmlfile + "\" -d 0 > /dev/null 2>&1";
+  Eigen::BenchTimer timer;
+  for( int r = 0; r < repeats; ++r )
+  {
+    timer.start();
+    const int status = system(command.c_str());
+    timer.stop();
+    if( status != 0 )
+    {
+      complain("FOSSSim failed on " + xmlfile + ".");
+      return false;
+    }
+  }
+  seconds = timer.best(Eigen::REAL_TIMER);
+  return true;
+}
+
+bool benchmarkScene( const std::string& executable, const std::string& xmlfile, int numsteps, double minparticlesteps, int repeats, SceneTiming& timing )
+{
+  double dt;
+  if( !readScene(xmlfile, timing.numparticles, dt) ) return false;
+  numsteps = std::max(numsteps, (int) std::ceil(minparticlesteps/std::max(timing.numparticles, 1)));
+  std::string scene;
+  if( !readFile(xmlfile, scene) )
+  {
+    complain("Failed to read " + xmlfile + ".");
+    return false;
+  }
+
+  // Ending half a step past the last one keeps the step count from hanging
+  // on how the accumulated time rounds.
+  std::string stepping, loading;
+  if( !setDuration(scene, ( numsteps - 0.5 )*dt, stepping ) || !setDuration(scene, 0.0, loading) )
+  {
+    complain(xmlfile + " has no duration.");
+    return false;
+  }
+
+  std::string steppingfile, loadingfile;
+  bool succeeded = writeTemporaryScene(stepping, steppingfile) && writeTemporaryScene(loading, loadingfile);
+  if( !succeeded ) complain("Failed to write a copy of " + xmlfile + ".");
+
+  double steppingtime = 0.0, loadingtime = 0.0;
+  succeeded = succeeded && timeRun(executable, steppingfile, repeats, steppingtime) && timeRun(executable, loadingfile, repeats, loadingtime);
+  if( !steppingfile.empty() ) remove(steppingfile.c_str());
+  if( !loadingfile.empty() ) remove(loadingfile.c_str());
+  if( !succeeded ) return false;
+
+  const double seconds = std::max(steppingtime - loadingtime, 1.0e-9);
+  timing.numsteps = numsteps;
+  timing.steps_per_second = numsteps/seconds;
+  timing.ns_per_particle_step = 1.0e9*seconds/( (double) numsteps*std::max(timing.numparticles, 1) );
+  return true;
+}
+
+// Every .xml file in a directory, sorted by name.
+void listScenes( const std::string& directory, std::vector<std::string>& scenes )
+{
+  DIR* dir = opendir(directory.c_str());
+  if( dir == NULL ) return;
+  std::vector<std::string> names;
+  for( dirent* entry = readdir(dir); entry != NULL; entry = readdir(dir) )
+  {
+    const std::string name = entry->d_name;
+    if( name.size() > 4 && name.compare(name.size() - 4, 4, ".xml") == 0 ) names.push_back(name);
+  }
+  closedir(dir);
+  std::sort(names.begin(), names.end());
+  for( std::vector<std::string>::size_type i = 0; i < names.size(); ++i ) scenes.push_back(directory + "/" + names[i]);
+}
+
+// Baselines are written one scene per line, as
+//
+//   "assets/t2m3/TimingScenes/test00.xml": {"steps_per_second": 12.5, "ns_per_particle_step": 800},
+//
+// inside a single JSON object, and read back the same way, so hand edits
+// have to keep a scene to a line.
+bool readBaseline( const std::string& filename, std::map<std::string, double>& baseline )
+{
+  std::ifstream ifs(filename.c_str());
+  if( !ifs ) return false;
+  std::string line;
+  while( std::getline(ifs, line) )
+  {
+    const std::string::size_type open = line.find('"');
+    const std::string::size_type close = open == std::string::npos ? open : line.find('"', open + 1);
+    const std::string::size_type field = line.find("\"ns_per_particle_step\":");
+    if( close == std::string::npos || field == std::string::npos ) continue;
+    const char* begin = line.c_str() + field + 23;
+    char* end = NULL;
+    errno = 0;
+    const double value = strtod(begin, &end);
+    if( end != begin && errno == 0 ) baseline[line.substr(open + 1, close - open - 1)] = value;
+  }
+  return true;
+}
+
+bool writeBaseline( const std::string& filename, const std::vector<std::string>& scenes, const std::vector<SceneTiming>& timings )
+{
+  std::ofstream ofs(filename.c_str());
+  if( !ofs ) return false;
+  ofs << "{\n";
+  for( std::vector<std::string>::size_type i = 0; i < scenes.size(); ++i )
+  {
+    ofs << "  \"" << scenes[i] << "\": {\"steps_per_second\": " << std::setprecision(6) << timings[i].steps_per_second
+        << ", \"ns_per_particle_step\": " << timings[i].ns_per_particle_step << "}" << ( i + 1 < scenes.size() ? "," : "" ) << "\n";
+  }
+  ofs << "}\n";
+  return bool(ofs);
+}
+
+// Loads the scene, or generates a box scene of numparticles if scenefile is
+// empty, and steps it numsteps times on numthreads threads, repeats times;
+// the fastest run counts.
+bool runScaling( const std::string& scenefile, int numparticles, int numthreads, int numsteps, int repeats, ScalingRun& run )
+{
+  typedef std::chrono::steady_clock Clock;
+  TaskPool::shared().setNumThreads(numthreads);
+  run.numthreads = numthreads;
+  run.step = 0.0;
+  for( int r = 0; r < repeats; ++r )
+  {
+    phasetimes::reset();
+    FOSSSimScene* scene = NULL;
+    if( scenefile.empty() )
+    {
+      SceneGeneratorOptions options;
+      options.numparticles = numparticles;
+      options.numsprings = 0;
+      scene = fosssimGenerateBoxScene(options);
+    }
+    else scene = fosssim_load(scenefile.c_str());
+    if( scene == NULL )
+    {
+      complain("Failed to load " + ( scenefile.empty() ? std::string("the generated scene") : scenefile ) + ".");
+      return false;
+    }
+    const double loading = phasetimes::getSeconds(phasetimes::LOADING);
+    phasetimes::reset();
+
+    const Clock::time_point start = Clock::now();
+    fosssim_step(scene, numsteps);
+    const double step = std::chrono::duration<double>(Clock::now() - start).count()/numsteps;
+    run.numparticles = fosssim_num_particles(scene);
+    fosssim_free(scene);
+    if( r > 0 && step >= run.step ) continue;
+
+    run.step = step;
+    run.other = step;
+    for( int p = 0; p < phasetimes::NUM_PHASES; ++p )
+    {
+      run.phases[p] = phasetimes::getSeconds((phasetimes::Phase) p)/numsteps;
+      run.other -= run.phases[p];
+    }
+    run.phases[phasetimes::LOADING] = loading;
+    run.other = std::max(run.other, 0.0);
+  }
+  return true;
+}
+
+// Parallel efficiency of a time against one thread's, as a percentage.
+double efficiency( double single, double parallel, int numthreads, bool weak )
+{
+  if( !( parallel > 0.0 ) ) return 100.0;
+  return 100.0*single/( weak ? parallel : numthreads*parallel );
+}
+
+void printEfficiency( double single, double parallel, int numthreads, bool weak )
+{
+  // A phase that takes no measurable time scales as well as anything.
+  if( single < 1.0e-7 && parallel < 1.0e-7 ) std::cout << std::setw(13) << "-";
+  else std::cout << std::setw(12) << std::setprecision(0) << efficiency(single, parallel, numthreads, weak) << "%";
+}
+
+void reportScaling( const std::string& title, const std::vector<ScalingRun>& runs, bool weak )
+{
+  std::cout << "\n" << title << "\n" << std::setw(8) << "threads" << std::setw(11) << "particles" << std::setw(11) << "ms/step" << std::setw(13) << "step";
+  for( int p = 0; p < phasetimes::NUM_PHASES; ++p ) std::cout << std::setw(13) << phasetimes::getName((phasetimes::Phase) p);
+  std::cout << std::setw(13) << "other" << std::endl;
+
+  const ScalingRun& single = runs.front();
+  for( std::vector<ScalingRun>::size_type k = 0; k < runs.size(); ++k )
+  {
+    const ScalingRun& run = runs[k];
+    std::cout << std::fixed << std::setw(8) << run.numthreads << std::setw(11) << run.numparticles << std::setw(11) << std::setprecision(3) << 1.0e3*run.step;
+    printEfficiency(single.step, run.step, run.numthreads, weak);
+    for( int p = 0; p < phasetimes::NUM_PHASES; ++p ) printEfficiency(single.phases[p], run.phases[p], run.numthreads, weak);
+    printEfficiency(single.other, run.other, run.numthreads, weak);
+    std::cout << std::endl;
+  }
+
+  // The limit is a phase of the step, so loading is left out.
+  const ScalingRun& widest = runs.back();
+  int limit = -1;
+  double lowest = 0.0;
+  for( int p = 0; p < phasetimes::NUM_PHASES; ++p )
+  {
+    if( p == phasetimes::LOADING || widest.phases[p] < LIMITING_SHARE*widest.step ) continue;
+    const double e = efficiency(single.phases[p], widest.phases[p], widest.numthreads, weak);
+    if( limit < 0 || e < lowest )
+    {
+      limit = p;
+      lowest = e;
+    }
+  }
+  if( limit >= 0 && runs.size() > 1 )
+  {
+    std::cout << "Limited by " << phasetimes::getName((phasetimes::Phase) limit) << ": " << std::setprecision(0) << lowest << "% efficient at " << widest.numthreads
+              << " threads, " << 100.0*widest.phases[limit]/widest.step << "% of the step." << std::endl;
+  }
+}
+
+// Strong scaling of the scene, or of a generated one if scenefile is empty,
+// and weak scaling of generated ones, on 1, 2, 4, ... up to maxthreads
+// threads.
+bool studyScaling( const std::string& scenefile, int numparticles, int maxthreads, int numsteps, int repeats )
+{
+  std::vector<int> counts;
+  for( int n = 1; n < maxthreads; n *= 2 ) counts.push_back(n);
+  counts.push_back(maxthreads);
+
+  std::vector<ScalingRun> strong(counts.size()), weak;
+  for( std::vector<int>::size_type k = 0; k < counts.size(); ++k )
+    if( !runScaling(scenefile, numparticles, counts[k], numsteps, repeats, strong[k]) ) return false;
+  std::ostringstream title;
+  title << "Strong scaling of " << ( scenefile.empty() ? "a generated box scene" : scenefile ) << ", " << strong.front().numparticles << " particles, " << numsteps << " steps, efficiency against one thread:";
+  reportScaling(title.str(), strong, false);
+
+  if( numparticles > 0 )
+  {
+    weak.resize(counts.size());
+    for( std::vector<int>::size_type k = 0; k < counts.size(); ++k )
+      if( !runScaling("", numparticles*counts[k], counts[k], numsteps, repeats, weak[k]) ) return false;
+    std::ostringstream weaktitle;
+    weaktitle << "Weak scaling of generated box scenes, " << numparticles << " particles per thread, " << numsteps << " steps, efficiency against one thread:";
+    reportScaling(weaktitle.str(), weak, true);
+  }
+  else std::cout << "\nNo weak scaling: it needs --generate to size the scene by the threads." << std::endl;
+  return true;
+}
+
+}
+
+int main( int argc, char** argv )
+{
+  std::string executable, baselinefile, outputfile;
+  int numsteps, repeats, generate, maxthreads;
+  bool scaling;
+  double minparticlesteps, tolerance;
+  std::vector<std::string> scenes;
+  try
+  {
+    TCLAP::CmdLine cmd("Times FOSSSim on scenes and compares against a baseline.", ' ', "1.0");
+    TCLAP::ValueArg<std::string> executableArg("x", "executable", "FOSSSim executable to time", false, FOSSSIM_EXECUTABLE, "string", cmd);
+    TCLAP::ValueArg<int> stepsArg("n", "steps", "Steps to take in every scene", false, 50, "integer", cmd);
+    TCLAP::ValueArg<double> minimumArg("m", "min-particle-steps", "Particle-steps every scene takes at least, however few its particles", false, 1.0e5, "scalar", cmd);
+    TCLAP::ValueArg<int> repeatsArg("r", "repeats", "Runs of every scene, of which the fastest counts", false, 5, "integer", cmd);
+    TCLAP::ValueArg<std::string> baselineArg("b", "baseline", "Baseline JSON to compare against", false, FOSSSIM_BENCH_BASELINE, "string", cmd);
+    TCLAP::ValueArg<double> toleranceArg("t", "tolerance", "Fraction by which ns per particle-step may exceed the baseline", false, 0.25, "scalar", cmd);
+    TCLAP::ValueArg<std::string> outputArg("w", "write", "Writes the timings as a new baseline JSON", false, "", "string", cmd);
+    TCLAP::ValueArg<int> threadsArg("j", "threads", "Threads FOSSSim runs with, passed on as FOSSSIM_THREADS, or the most the scaling study runs with; 0 is one per processor", false, 0, "integer", cmd);
+    TCLAP::SwitchArg scalingArg("", "scaling", "Measures strong and weak scaling per phase, in process, instead of timing scenes against the baseline", cmd);
+    TCLAP::ValueArg<int> generateArg("g", "generate", "Particles of the synthetic box scene the scaling study steps instead of a scene, and per thread of its weak scaling", false, 0, "integer", cmd);
+    TCLAP::UnlabeledMultiArg<std::string> scenesArg("scenes", "Scenes to time, by default the t2m3 timing and testing scenes", false, "string", cmd);
+    cmd.parse(argc, argv);
+    executable = executableArg.getValue();
+    numsteps = stepsArg.getValue();
+    minparticlesteps = minimumArg.getValue();
+    repeats = repeatsArg.getValue();
+    baselinefile = baselineArg.getValue();
+    tolerance = toleranceArg.getValue();
+    outputfile = outputArg.getValue();
+    scenes = scenesArg.getValue();
+    scaling = scalingArg.getValue();
+    generate = generateArg.getValue();
+    maxthreads = threadsArg.getValue();
+    if( threadsArg.isSet() && !scaling )
+    {
+      std::ostringstream threads;
+      threads << threadsArg.getValue();
+      setenv("FOSSSIM_THREADS", threads.str().c_str(), 1);
+    }
+  }
+  catch( TCLAP::ArgException& e )
+  {
+    std::cerr << "error: " << e.what() << std::endl;
+    return 1;
+  }
+
+  if( numsteps < 1 || repeats < 1 )
+  {
+    complain("The step and repeat counts must be positive.");
+    return 1;
+  }
+  if( scaling )
+  {
+    if( ( generate > 0 ) == !scenes.empty() || scenes.size() > 1 || generate < 0 )
+    {
+      complain("The scaling study takes either one scene or --generate.");
+      return 1;
+    }
+    if( maxthreads <= 0 ) maxthreads = std::max(1, (int) std::thread::hardware_concurrency());
+    return studyScaling(scenes.empty() ? std::string() : scenes.front(), generate, maxthreads, numsteps, repeats) ? 0 : 1;
+  }
+
+  if( scenes.empty() )
+  {
+    for( std::size_t d = 0; d < sizeof(DEFAULT_SCENE_DIRECTORIES)/sizeof(DEFAULT_SCENE_DIRECTORIES[0]); ++d )
+      listScenes(DEFAULT_SCENE_DIRECTORIES[d], scenes);
+  }
+  if( scenes.empty() )
+  {
+    complain("No scenes to time.");
+    return 1;
+  }
+
+  std::map<std::string, double> baseline;
+  const bool comparing = readBaseline(baselinefile, baseline);
+  if( !comparing ) std::cout << "\033[33;1mFOSSSimBench message:\033[m No baseline at " << baselinefile << ", nothing to compare against." << std::endl;
+
+  std::vector<SceneTiming> timings(scenes.size());
+  int regressions = 0;
+  int failures = 0;
+  for( std::vector<std::string>::size_type i = 0; i < scenes.size(); ++i )
+  {
+    SceneTiming& timing = timings[i];
+    if( !benchmarkScene(executable, scenes[i], numsteps, minparticlesteps, repeats, timing) )
+    {
+      ++failures;
+      continue;
+    }
+
+    std::cout << std::fixed << std::setprecision(1) << scenes[i] << ": " << timing.numparticles << " particles, " << timing.numsteps << " steps, "
+              << timing.steps_per_second << " steps/s, " << timing.ns_per_particle_step << " ns per particle-step";
+    std::map<std::string, double>::const_iterator reference = baseline.find(scenes[i]);
+    if( reference != baseline.end() )
+    {
+      const double change = timing.ns_per_particle_step/reference->second - 1.0;
+      const bool regressed = change > tolerance;
+      if( regressed ) ++regressions;
+      std::cout << " (" << std::showpos << 100.0*change << std::noshowpos << "% against the baseline"
+                << ( regressed ? ", \033[31;1mregression\033[m)" : ")" );
+    }
+    std::cout << std::endl;
+  }
+
+  if( !outputfile.empty() && failures == 0 && !writeBaseline(outputfile, scenes, timings) )
+  {
+    complain("Failed to write " + outputfile + ".");
+    return 1;
+  }
+
+  if( comparing ) std::cout << regressions << " of " << scenes.size() << " scenes regressed by more than " << 100.0*tolerance << "%." << std::endl;
+  return ( failures > 0 || regressions > 0 ) ? 1 : 0;
+}
@@ -0,0 +1,245 @@
+#include "FOSSSimEmbed.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "FOSSSim/BroadPhaseTuning.h"
+#include "FOSSSim/CollisionDetector.h"
+#include "FOSSSim/DetectorRegistry.h"
+#include "FOSSSim/PenaltySceneSettings.h"
+#include "FOSSSim/PeriodicDomain.h"
+#include "FOSSSim/PhaseTimes.h"
+#include "FOSSSim/SceneBinary.h"
+#include "FOSSSim/SceneGenerator.h"
+#include "FOSSSim/TaskPool.h"
+#include "FOSSSim/TwoDScene.h"
+
+struct FOSSSimScene
+{
+  TwoDScene scene;
+  PenaltySceneSettings settings;
+  // The penalty force holds on to the detector, so it lives as long as the
+  // scene does.
+  std::unique_ptr<CollisionDetector> detector;
+  VectorXs gradE;
+  // The scene's last step queued by fosssimStepAsync, which its next one
+  // follows.
+  FOSSSimStepFuture last;
+};
+
+namespace
+{
+
+// Steps queued by fosssimStepAsync.
+struct AsyncStep
+{
+  FOSSSimScene* scene;
+  int steps;
+  std::vector<FOSSSimStepFuture> after;
+  std::shared_ptr<std::promise<FOSSSimStepResult> > promise;
+
+  bool ready() const
+  {
+    for( std::size_t k = 0; k < after.size(); ++k )
+      if( after[k].wait_for(std::chrono::seconds(0)) != std::future_status::ready ) return false;
+    return true;
+  }
+};
+
+// Steps whose dependencies have completed, in the order they did, and the
+// rest. A step completing moves those it released from one to the other, so
+// no thread ever blocks on a dependency.
+struct AsyncSteps
+{
+  std::mutex mutex;
+  std::deque<AsyncStep> ready;
+  std::vector<AsyncStep> waiting;
+  // Whether a task is taking the ready steps.
+  bool running;
+  TaskPool::Group group;
+
+  AsyncSteps() : running(false) {}
+};
+
+AsyncSteps g_async;
+
+// Moves the waiting steps whose dependencies have completed to the ready
+// ones, in the order they were queued. Called with the mutex held.
+void releaseWaiting()
+{
+  std::vector<AsyncStep>::size_type kept = 0;
+  for( std::vector<AsyncStep>::size_type k = 0; k < g_async.waiting.size(); ++k )
+  {
+    if( g_async.waiting[k].ready() ) g_async.ready.push_back(g_async.waiting[k]);
+    else g_async.waiting[kept++] = g_async.waiting[k];
+  }
+  g_async.waiting.resize(kept);
+}
+
+// Takes the ready steps one at a time until there are none.
+void takeReadySteps()
+{
+  typedef std::chrono::steady_clock Clock;
+  while( true )
+  {
+    AsyncStep step;
+    {
+      std::lock_guard<std::mutex> lock(g_async.mutex);
+      if( g_async.ready.empty() )
+      {
+        g_async.running = false;
+        return;
+      }
+      step = g_async.ready.front();
+      g_async.ready.pop_front();
+    }
+
+    const Clock::time_point start = Clock::now();
+    fosssim_step(step.scene, step.steps);
+    const FOSSSimStepResult result = { step.scene, step.steps, std::chrono::duration<double>(Clock::now() - start).count() };
+    step.promise->set_value(result);
+
+    std::lock_guard<std::mutex> lock(g_async.mutex);
+    releaseWaiting();
+  }
+}
+
+bool isReady( const FOSSSimStepFuture& step )
+{
+  return step.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+}
+
+}
+
+FOSSSimScene* fosssim_load( const char* scenefile )
+{
+  return fosssim_load_with(scenefile, NULL, 0);
+}
+
+FOSSSimScene* fosssim_load_with( const char* scenefile, const char* const* overrides, int count )
+{
+  FOSSSimScene* embedded = new FOSSSimScene;
+  std::vector<SceneRecord> records;
+  const std::vector<std::string> texts(overrides, overrides + std::max(count, 0));
+  phasetimes::ScopedPhase loading(phasetimes::LOADING);
+  if( !loadScene(scenefile, embedded->scene, records, SIMULATION_RECORDS) || !applySceneOverrides(texts, records) || !readPenaltySceneSettings(records, embedded->scene.getNumEdges(), embedded->settings) )
+  {
+    delete embedded;
+    return NULL;
+  }
+  embedded->detector.reset(detectors::createDetector(embedded->settings.detector));
+  insertPenaltySceneForces(embedded->scene, *embedded->detector, embedded->settings);
+  broadphase::tuneForScene(embedded->scene, scenefile);
+  return embedded;
+}
+
+FOSSSimScene* fosssimGenerateBoxScene( const SceneGeneratorOptions& options )
+{
+  FOSSSimScene* embedded = new FOSSSimScene;
+  std::vector<SceneRecord> records;
+  GeneratedSprings springs;
+  if( !generateBoxScene(options, embedded->scene, records, springs) || !readPenaltySceneSettings(records, embedded->scene.getNumEdges(), embedded->settings) )
+  {
+    delete embedded;
+    return NULL;
+  }
+  for( std::vector<scalar>::size_type k = 0; k < springs.restlengths.size(); ++k )
+  {
+    PenaltySceneSettings::Spring spring;
+    spring.edge = springs.firstedge + (int) k;
+    spring.k = springs.stiffness;
+    spring.l0 = springs.restlengths[k];
+    spring.b = springs.damping;
+    embedded->settings.springs.push_back(spring);
+  }
+  embedded->detector.reset(detectors::createDetector(embedded->settings.detector));
+  insertPenaltySceneForces(embedded->scene, *embedded->detector, embedded->settings);
+  return embedded;
+}
+
+void fosssim_free( FOSSSimScene* scene )
+{
+  if( scene != NULL )
+  {
+    fosssimFinish(scene);
+    periodic::clearDomain(scene->scene);
+  }
+  delete scene;
+}
+
+int fosssim_num_particles( const FOSSSimScene* scene )
+{
+  return scene->scene.getNumParticles();
+}
+
+double* fosssim_positions( FOSSSimScene* scene )
+{
+  return scene->scene.getX().data();
+}
+
+double* fosssim_velocities( FOSSSimScene* scene )
+{
+  return scene->scene.getV().data();
+}
+
+double* fosssim_masses( FOSSSimScene* scene )
+{
+  return scene->scene.getM().data();
+}
+
+double fosssim_timestep( const FOSSSimScene* scene )
+{
+  return scene->settings.dt;
+}
+
+int fosssim_num_steps( const FOSSSimScene* scene )
+{
+  // As many steps as the base library takes.
+  return (int) std::ceil(scene->settings.duration/scene->settings.dt - 1.0e-9);
+}
+
+void fosssim_step( FOSSSimScene* scene, int steps )
+{
+  for( int s = 0; s < steps; ++s ) stepPenaltyScene(scene->scene, scene->settings, scene->gradE);
+}
+
+FOSSSimStepFuture fosssimStepAsync( FOSSSimScene* scene, int steps, const std::vector<FOSSSimStepFuture>& after )
+{
+  AsyncStep step;
+  step.scene = scene;
+  step.steps = steps;
+  step.after = after;
+  if( scene->last.valid() ) step.after.push_back(scene->last);
+  step.promise.reset( new std::promise<FOSSSimStepResult> );
+  const FOSSSimStepFuture future = step.promise->get_future().share();
+  scene->last = future;
+
+  bool start = false;
+  {
+    // The dependencies are checked under the mutex, so a step completing
+    // meanwhile either is seen complete here or releases this one.
+    std::lock_guard<std::mutex> lock(g_async.mutex);
+    if( step.ready() ) g_async.ready.push_back(step);
+    else g_async.waiting.push_back(step);
+    if( !g_async.running && !g_async.ready.empty() ) start = g_async.running = true;
+  }
+  if( start ) TaskPool::shared().spawn(g_async.group, takeReadySteps);
+  return future;
+}
+
+FOSSSimStepResult fosssimWait( const FOSSSimStepFuture& step )
+{
+  TaskPool::shared().waitUntil( [&step]() { return isReady(step); } );
+  return step.get();
+}
+
+void fosssimFinish( FOSSSimScene* scene )
+{
+  if( scene->last.valid() ) fosssimWait(scene->last);
+}
@@ -0,0 +1,123 @@
+#ifndef FOSSSIM_EMBED_H
+#define FOSSSIM_EMBED_H
+
+// A C interface for stepping a penalty-contact scene from host code, with no
+// copies per frame. The base library's TwoDScene owns its arrays and cannot
+// take storage from outside, so the host works on the scene's own instead:
+// fosssim_positions, fosssim_velocities and fosssim_masses return pointers
+// straight into them, which stay valid for the life of the scene, and
+// fosssim_step advances them in place. Whatever the host writes through the
+// pointers between steps is what the next step starts from.
+//
+// Positions and velocities are 2*n doubles, x and y interleaved per particle,
+// and masses are 2*n doubles too, one per degree of freedom, as TwoDScene
+// keeps them. Scenes are the ones FOSSSimMPI and the viewer's live
+// simulation step: penalty contacts, springs, gravity and drag. C++ hosts
+// with a collision detector of their own register it with
+// detectors::registerDetector, from FOSSSim/DetectorRegistry.h, before
+// loading the scenes whose <collisiondetection> names it.
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct FOSSSimScene FOSSSimScene;
+
+// Loads an XML scene, or a binary one if the name ends in .fsb. Returns NULL,
+// after printing why, if the file cannot be read or the scene asks for
+// anything a penalty-contact scene cannot do.
+FOSSSimScene* fosssim_load( const char* scenefile );
+
+// fosssim_load with count overrides of the scene's attributes, each
+// "element.attribute=value" as FOSSSimMPI's --set takes them, applied once
+// the scene is loaded. A sweep over, say, the time step loads one scene file
+// at every point, parsed once with FOSSSIM_SCENE_CACHE set.
+FOSSSimScene* fosssim_load_with( const char* scenefile, const char* const* overrides, int count );
+
+void fosssim_free( FOSSSimScene* scene );
+
+int fosssim_num_particles( const FOSSSimScene* scene );
+
+double* fosssim_positions( FOSSSimScene* scene );
+double* fosssim_velocities( FOSSSimScene* scene );
+double* fosssim_masses( FOSSSimScene* scene );
+
+// The scene's time step, and the number of steps it asks to be run for.
+double fosssim_timestep( const FOSSSimScene* scene );
+int fosssim_num_steps( const FOSSSimScene* scene );
+
+// Takes steps time steps in place.
+void fosssim_step( FOSSSimScene* scene, int steps );
+
+#ifdef __cplusplus
+}
+
+#include <Eigen/Core>
+#include <future>
+#include <vector>
+
+struct SceneGeneratorOptions;
+
+// A synthetic box scene, as FOSSSim/SceneGenerator.h lays them out, stepped
+// like a loaded one, for C++ hosts measuring how stepping scales without
+// writing scenes out. Returns NULL, after printing why, if the options cannot
+// be met.
+FOSSSimScene* fosssimGenerateBoxScene( const SceneGeneratorOptions& options );
+
+// The same arrays as Eigen matrices with a column per particle, for C++ hosts.
+typedef Eigen::Map<Eigen::Matrix<double, 2, Eigen::Dynamic> > FOSSSimStateMap;
+
+inline FOSSSimStateMap fosssimPositions( FOSSSimScene* scene )
+{
+  return FOSSSimStateMap(fosssim_positions(scene), 2, fosssim_num_particles(scene));
+}
+
+inline FOSSSimStateMap fosssimVelocities( FOSSSimScene* scene )
+{
+  return FOSSSimStateMap(fosssim_velocities(scene), 2, fosssim_num_particles(scene));
+}
+
+inline FOSSSimStateMap fosssimMasses( FOSSSimScene* scene )
+{
+  return FOSSSimStateMap(fosssim_masses(scene), 2, fosssim_num_particles(scene));
+}
+
+// Asynchronous steps, for C++ hosts that step several scenes and do other
+// work meanwhile. fosssimStepAsync queues steps time steps of scene on the
+// simulator's shared task pool and returns at once, with a future that is
+// set when they have been taken. They start once the scene's previously
+// queued steps and every step in after have completed, so hosts chain steps
+// of different scenes, or fan them in, by passing the futures along; after
+// takes only futures fosssimStepAsync returned.
+//
+// The contact detector and the penalty force keep state per process, so
+// queued steps are taken one at a time, in the order they become ready, by
+// a single task on the pool, each parallel across the pool as fosssim_step
+// is. With FOSSSIM_THREADS=1 the pool has no workers and steps whose
+// dependencies have completed are taken before fosssimStepAsync returns.
+//
+// A scene's arrays belong to its queued steps until they complete. Load
+// scenes, and step them with fosssim_step, only while no steps are queued.
+struct FOSSSimStepResult
+{
+  FOSSSimScene* scene;
+  // Time steps taken.
+  int steps;
+  // Wall-clock seconds they took once started.
+  double seconds;
+};
+
+typedef std::shared_future<FOSSSimStepResult> FOSSSimStepFuture;
+
+FOSSSimStepFuture fosssimStepAsync( FOSSSimScene* scene, int steps, const std::vector<FOSSSimStepFuture>& after = std::vector<FOSSSimStepFuture>() );
+
+// Waits for step, running the pool's tasks meanwhile, and returns its
+// result. Unlike step.get(), the waiting thread helps take the steps.
+FOSSSimStepResult fosssimWait( const FOSSSimStepFuture& step );
+
+// Waits for every step queued on scene. fosssim_free does this first.
+void fosssimFinish( FOSSSimScene* scene );
+
+#endif
+
+#endif
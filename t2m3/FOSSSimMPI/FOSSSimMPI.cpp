@@ -0,0 +1,756 @@
+// Runs a penalty-contact scene, such as a scaled-up TimingScenes/test00.xml,
+// on several MPI ranks, each owning the particles in one strip of it.
+//
+// The scene is cut along x into one strip per rank, at the quantiles of the
+// particles' x, so that every strip starts out with as many particles. Each
+// step
+//
+//   - every rank sends the particles it owns within the halo of another
+//     rank's strip to it, as ghosts, the halo being the widest a contact can
+//     be, twice the largest radius plus the penalty thickness;
+//   - every rank finds the contacts among its own particles and ghosts, and
+//     integrates its own particles by forward-backward Euler, as
+//     SemiImplicitEuler does;
+//   - particles that have left their rank's strip migrate to the rank whose
+//     strip they are now in.
+//
+// Every rebalance-th step the strips are moved back to the quantiles, and
+// the particles migrate accordingly.
+//
+// Fixed particles and the endpoints of edges are replicated on every rank
+// rather than owned, as an edge or a spring can reach across any number of
+// strips. Their forces are summed on rank 0, which integrates them and sends
+// out their new state. The scenes this is for have a few such particles, the
+// walls of the box, among very many moving ones.
+//
+// Each contact is counted on exactly one rank for every particle it pushes:
+// on the rank owning each moving particle in it, and for the replicated
+// particles on the rank owning its moving particle, or on rank 0 if it has
+// none. Springs, gravity and drag on replicated particles are counted on
+// rank 0.
+//
+// Forces are summed in a different order than in a single process, so a run
+// agrees with FOSSSim to rounding rather than bit for bit. Rank 0 gathers
+// every frame and writes it as TwoDSceneSerializer does, so the output is
+// graded and replayed like FOSSSim's own. The frame is written on an I/O
+// thread while every rank takes the next step, so that no rank waits on rank
+// 0's disk at the next exchange of ghosts.
+//
+// Only forward-backward Euler with penalty collisions is supported, through
+// the contest detector or any other registered with
+// detectors::registerDetector, with simplegravity, springforce and
+// dragdamping forces. Every rank reads the scene, so a large one is best
+// converted to a binary .fsb scene first.
+//
+// Each rank's broad phase runs on its own task pool of --threads threads,
+// one by default, as a rank per processor already keeps them all busy.
+//
+// Every --checkpoint-every steps rank 0 snapshots the run to --checkpoint,
+// on a thread of its own as it does frames, and --resume takes a run up
+// from such a snapshot of the same scene: from its step, with its x and v,
+// and cut into the same strips if run on as many ranks. The trajectory of a
+// resumed run starts at the step it resumed from, and goes on as the run it
+// was taken from would have: bit for bit on one rank, and to rounding on
+// more, where a rank may hold its particles in another order than before.
+//
+// Each --set element.attribute=value replaces an attribute of the scene as
+// read, so a sweep over, say, --set integrator.dt=0.002 or --set
+// collision.k=500 runs from the one scene, or its cached binary copy.
+
+#include <mpi.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <tclap/CmdLine.h>
+
+#include "FOSSSim/AsyncTrajectoryWriter.h"
+#include "FOSSSim/BroadPhase.h"
+#include "FOSSSim/Checkpoint.h"
+#include "FOSSSim/CollisionDetector.h"
+#include "FOSSSim/DetectorRegistry.h"
+#include "FOSSSim/PenaltyForce.h"
+#include "FOSSSim/PenaltySceneSettings.h"
+#include "FOSSSim/SceneBinary.h"
+#include "FOSSSim/SpringForce.h"
+#include "FOSSSim/TaskPool.h"
+#include "FOSSSim/TwoDScene.h"
+
+namespace
+{
+
+void complain( const std::string& what )
+{
+  std::cerr << "\033[31;1mERROR IN FOSSSIMMPI:\033[m " << what << std::endl;
+}
+
+// A particle as sent between ranks: its index in the scene, x, v, the mass of
+// each DoF and its radius.
+struct Particle
+{
+  int id;
+  scalar x[2];
+  scalar v[2];
+  scalar m[2];
+  scalar radius;
+};
+
+const int PARTICLE_SCALARS = 8;
+
+void pack( const Particle& particle, std::vector<scalar>& buffer )
+{
+  buffer.push_back(particle.id);
+  buffer.insert(buffer.end(), particle.x, particle.x + 2);
+  buffer.insert(buffer.end(), particle.v, particle.v + 2);
+  buffer.insert(buffer.end(), particle.m, particle.m + 2);
+  buffer.push_back(particle.radius);
+}
+
+void unpack( const std::vector<scalar>& buffer, std::vector<Particle>& particles )
+{
+  for( std::vector<scalar>::size_type p = 0; p + PARTICLE_SCALARS <= buffer.size(); p += PARTICLE_SCALARS )
+  {
+    Particle particle;
+    particle.id = (int) buffer[p];
+    std::copy(&buffer[p + 1], &buffer[p + 3], particle.x);
+    std::copy(&buffer[p + 3], &buffer[p + 5], particle.v);
+    std::copy(&buffer[p + 5], &buffer[p + 7], particle.m);
+    particle.radius = buffer[p + 7];
+    particles.push_back(particle);
+  }
+}
+
+// Sends outgoing[r] to rank r and returns what every rank sent this one,
+// in rank order.
+void exchange( const std::vector<std::vector<scalar> >& outgoing, std::vector<scalar>& incoming )
+{
+  const int numranks = (int) outgoing.size();
+  std::vector<int> sendcounts(numranks), recvcounts(numranks), senddispls(numranks), recvdispls(numranks);
+  std::vector<scalar> sendbuffer;
+  for( int r = 0; r < numranks; ++r )
+  {
+    sendcounts[r] = (int) outgoing[r].size();
+    senddispls[r] = (int) sendbuffer.size();
+    sendbuffer.insert(sendbuffer.end(), outgoing[r].begin(), outgoing[r].end());
+  }
+  MPI_Alltoall(&sendcounts[0], 1, MPI_INT, &recvcounts[0], 1, MPI_INT, MPI_COMM_WORLD);
+  int total = 0;
+  for( int r = 0; r < numranks; ++r )
+  {
+    recvdispls[r] = total;
+    total += recvcounts[r];
+  }
+  incoming.resize(total);
+  // Neither buffer may be empty, since &v[0] of an empty vector is undefined.
+  sendbuffer.push_back(0.0);
+  incoming.push_back(0.0);
+  MPI_Alltoallv(&sendbuffer[0], &sendcounts[0], &senddispls[0], MPI_DOUBLE, &incoming[0], &recvcounts[0], &recvdispls[0], MPI_DOUBLE, MPI_COMM_WORLD);
+  incoming.pop_back();
+}
+
+// Reports to the penalty force only the contacts this rank counts, taking
+// the sorted candidates whole.
+class StripPenaltyCallback : public DetectionCallback, public PairListDetectionCallback
+{
+public:
+  StripPenaltyCallback( PenaltyForce& force, const VectorXs& x, int numreplicated, int numowned, bool root, VectorXs& gradE )
+  : m_force(force)
+  , m_x(x)
+  , m_numreplicated(numreplicated)
+  , m_numowned(numowned)
+  , m_root(root)
+  , m_gradE(gradE)
+  , m_hits()
+  {}
+
+  virtual void ParticleParticleCallback( int idx1, int idx2 )
+  {
+    if( replicated(idx1) && replicated(idx2) ? m_root : owned(idx1) || owned(idx2) ) m_force.addParticleParticleGradEToTotal(m_x, idx1, idx2, m_gradE);
+  }
+
+  virtual void ParticleEdgeCallback( int vidx, int eidx )
+  {
+    if( replicated(vidx) ? m_root : owned(vidx) ) m_force.addParticleEdgeGradEToTotal(m_x, vidx, eidx, m_gradE);
+  }
+
+  virtual void ParticleHalfplaneCallback( int vidx, int pidx )
+  {
+    if( replicated(vidx) ? m_root : owned(vidx) ) m_force.addParticleHalfplaneGradEToTotal(m_x, vidx, pidx, m_gradE);
+  }
+
+  virtual void PairListsCallback( const PPList& pppairs, const PEList& pepairs, const PHList& phpairs )
+  {
+    m_force.findTouchingParticlePairs(m_x, pppairs, m_hits);
+    for( PPList::size_type k = 0; k < m_hits.size(); ++k ) StripPenaltyCallback::ParticleParticleCallback(m_hits[k].first, m_hits[k].second);
+    for( PEList::size_type k = 0; k < pepairs.size(); ++k ) StripPenaltyCallback::ParticleEdgeCallback(pepairs[k].first, pepairs[k].second);
+    for( PHList::size_type k = 0; k < phpairs.size(); ++k ) StripPenaltyCallback::ParticleHalfplaneCallback(phpairs[k].first, phpairs[k].second);
+  }
+
+private:
+  bool replicated( int i ) const { return i < m_numreplicated; }
+  bool owned( int i ) const { return i >= m_numreplicated && i < m_numreplicated + m_numowned; }
+
+  PenaltyForce& m_force;
+  const VectorXs& m_x;
+  int m_numreplicated;
+  int m_numowned;
+  bool m_root;
+  VectorXs& m_gradE;
+  PPList m_hits;
+};
+
+// One rank's share of the scene. Its local scene holds the replicated
+// particles first, then the particles it owns, then its ghosts.
+class StripSimulation
+{
+public:
+  StripSimulation( int rank, int numranks );
+  ~StripSimulation();
+
+  // Takes this rank's particles of scene, which every rank has read in full,
+  // cut into strips at bounds if there are as many as there are ranks less
+  // one, or else at the quantiles.
+  void setup( const TwoDScene& scene, const PenaltySceneSettings& settings, const std::vector<scalar>& bounds );
+
+  void step();
+
+  // Moves the strips back to the quantiles of the particles' x.
+  void rebalance();
+
+  // Gathers the state of every particle, in scene order, on rank 0.
+  void gather( VectorXs& x, VectorXs& v ) const;
+
+  int getNumParticles() const { return m_numparticles; }
+
+  const std::vector<scalar>& getBounds() const { return m_bounds; }
+
+private:
+  StripSimulation( const StripSimulation& );
+  StripSimulation& operator=( const StripSimulation& );
+
+  int findStrip( scalar x ) const;
+
+  // Strip bounds at the quantiles of xs, which is reordered.
+  void placeStrips( std::vector<scalar>& xs );
+
+  void exchangeHalo();
+
+  void buildLocalScene();
+
+  void accumulateGradE( VectorXs& gradE );
+
+  void advance( const VectorXs& gradE );
+
+  void migrate();
+
+  int m_rank;
+  int m_numranks;
+  int m_numparticles;
+  PenaltySceneSettings m_settings;
+  scalar m_halo;
+
+  // Strip r is [ m_bounds[r-1], m_bounds[r] ), the first and last unbounded.
+  std::vector<scalar> m_bounds;
+
+  std::vector<int> m_replicated;
+  VectorXs m_replicatedx;
+  VectorXs m_replicatedv;
+  VectorXs m_replicatedm;
+  std::vector<scalar> m_replicatedradii;
+  std::vector<bool> m_replicatedfixed;
+
+  std::vector<Particle> m_owned;
+  std::vector<Particle> m_ghosts;
+
+  TwoDScene m_local;
+  std::unique_ptr<CollisionDetector> m_detector;
+  PenaltyForce* m_penalty;
+  // In local indices; rank 0 evaluates them.
+  std::vector<SpringForce*> m_springs;
+};
+
+StripSimulation::StripSimulation( int rank, int numranks )
+: m_rank(rank)
+, m_numranks(numranks)
+, m_numparticles(0)
+, m_settings()
+, m_halo(0.0)
+, m_bounds()
+, m_replicated()
+, m_replicatedx()
+, m_replicatedv()
+, m_replicatedm()
+, m_replicatedradii()
+, m_replicatedfixed()
+, m_owned()
+, m_ghosts()
+, m_local()
+, m_detector()
+, m_penalty(NULL)
+, m_springs()
+{}
+
+StripSimulation::~StripSimulation()
+{
+  delete m_penalty;
+  for( std::vector<SpringForce*>::size_type s = 0; s < m_springs.size(); ++s ) delete m_springs[s];
+}
+
+int StripSimulation::findStrip( scalar x ) const
+{
+  return (int) ( std::upper_bound(m_bounds.begin(), m_bounds.end(), x) - m_bounds.begin() );
+}
+
+void StripSimulation::placeStrips( std::vector<scalar>& xs )
+{
+  m_bounds.assign(m_numranks - 1, 0.0);
+  if( xs.empty() ) return;
+  for( int r = 1; r < m_numranks; ++r )
+  {
+    std::vector<scalar>::iterator quantile = xs.begin() + (std::vector<scalar>::size_type) r*xs.size()/m_numranks;
+    std::nth_element(xs.begin(), quantile, xs.end());
+    m_bounds[r - 1] = *quantile;
+  }
+}
+
+void StripSimulation::setup( const TwoDScene& scene, const PenaltySceneSettings& settings, const std::vector<scalar>& bounds )
+{
+  m_settings = settings;
+  m_numparticles = scene.getNumParticles();
+
+  std::vector<bool> replicated(m_numparticles, false);
+  for( int i = 0; i < m_numparticles; ++i ) replicated[i] = scene.isFixed(i);
+  for( int e = 0; e < scene.getNumEdges(); ++e ) replicated[scene.getEdge(e).first] = replicated[scene.getEdge(e).second] = true;
+
+  std::vector<int> local(m_numparticles, -1);
+  std::vector<scalar> xs;
+  scalar maxradius = 0.0;
+  for( int i = 0; i < m_numparticles; ++i )
+  {
+    if( replicated[i] )
+    {
+      local[i] = (int) m_replicated.size();
+      m_replicated.push_back(i);
+    }
+    else
+    {
+      xs.push_back(scene.getX()(2*i));
+      maxradius = std::max(maxradius, scene.getRadius(i));
+    }
+  }
+  m_halo = 2.0*maxradius + m_settings.thickness;
+  if( (int) bounds.size() == m_numranks - 1 ) m_bounds = bounds;
+  else placeStrips(xs);
+
+  const int numreplicated = (int) m_replicated.size();
+  m_replicatedx.resize(2*numreplicated);
+  m_replicatedv.resize(2*numreplicated);
+  m_replicatedm.resize(2*numreplicated);
+  for( int g = 0; g < numreplicated; ++g )
+  {
+    const int i = m_replicated[g];
+    m_replicatedx.segment<2>(2*g) = scene.getX().segment<2>(2*i);
+    m_replicatedv.segment<2>(2*g) = scene.getV().segment<2>(2*i);
+    m_replicatedm.segment<2>(2*g) = scene.getM().segment<2>(2*i);
+    m_replicatedradii.push_back(scene.getRadius(i));
+    m_replicatedfixed.push_back(scene.isFixed(i));
+  }
+
+  for( int i = 0; i < m_numparticles; ++i )
+  {
+    if( replicated[i] || findStrip(scene.getX()(2*i)) != m_rank ) continue;
+    Particle particle;
+    particle.id = i;
+    for( int d = 0; d < 2; ++d )
+    {
+      particle.x[d] = scene.getX()(2*i + d);
+      particle.v[d] = scene.getV()(2*i + d);
+      particle.m[d] = scene.getM()(2*i + d);
+    }
+    particle.radius = scene.getRadius(i);
+    m_owned.push_back(particle);
+  }
+
+  // Edges and halfplanes only ever join replicated particles, so the local
+  // scene keeps them from step to step.
+  m_local.resizeSystem(numreplicated);
+  for( int e = 0; e < scene.getNumEdges(); ++e )
+  {
+    const std::pair<int,int>& edge = scene.getEdge(e);
+    m_local.insertEdge(std::make_pair(local[edge.first], local[edge.second]), scene.getEdgeRadii()[e]);
+  }
+  for( int h = 0; h < scene.getNumHalfplanes(); ++h ) m_local.insertHalfplane(scene.getHalfplane(h));
+
+  m_detector.reset(detectors::createDetector(m_settings.detector));
+  m_penalty = new PenaltyForce(m_local, *m_detector, m_settings.stiffness, m_settings.thickness);
+  if( m_rank == 0 )
+  {
+    for( std::vector<PenaltySceneSettings::Spring>::size_type s = 0; s < m_settings.springs.size(); ++s )
+    {
+      const PenaltySceneSettings::Spring& spring = m_settings.springs[s];
+      const std::pair<int,int>& edge = scene.getEdge(spring.edge);
+      m_springs.push_back(new SpringForce(std::make_pair(local[edge.first], local[edge.second]), spring.k, spring.l0, spring.b));
+    }
+  }
+}
+
+void StripSimulation::exchangeHalo()
+{
+  std::vector<std::vector<scalar> > outgoing(m_numranks);
+  for( std::vector<Particle>::size_type p = 0; p < m_owned.size(); ++p )
+  {
+    const scalar x = m_owned[p].x[0];
+    const int last = findStrip(x + m_halo);
+    for( int r = findStrip(x - m_halo); r <= last; ++r )
+    {
+      if( r != m_rank ) pack(m_owned[p], outgoing[r]);
+    }
+  }
+  std::vector<scalar> incoming;
+  exchange(outgoing, incoming);
+  m_ghosts.clear();
+  unpack(incoming, m_ghosts);
+}
+
+void StripSimulation::buildLocalScene()
+{
+  const int numreplicated = (int) m_replicated.size();
+  const int numowned = (int) m_owned.size();
+  m_local.resizeSystem(numreplicated + numowned + (int) m_ghosts.size());
+  VectorXs& x = m_local.getX();
+  VectorXs& v = m_local.getV();
+  VectorXs& m = m_local.getM();
+  x.head(2*numreplicated) = m_replicatedx;
+  v.head(2*numreplicated) = m_replicatedv;
+  m.head(2*numreplicated) = m_replicatedm;
+  for( int g = 0; g < numreplicated; ++g )
+  {
+    m_local.setRadius(g, m_replicatedradii[g]);
+    m_local.setFixed(g, m_replicatedfixed[g]);
+  }
+  for( int i = numreplicated; i < m_local.getNumParticles(); ++i )
+  {
+    const Particle& particle = i < numreplicated + numowned ? m_owned[i - numreplicated] : m_ghosts[i - numreplicated - numowned];
+    for( int d = 0; d < 2; ++d )
+    {
+      x(2*i + d) = particle.x[d];
+      v(2*i + d) = particle.v[d];
+      m(2*i + d) = particle.m[d];
+    }
+    m_local.setRadius(i, particle.radius);
+    m_local.setFixed(i, false);
+  }
+}
+
+// The gradient of every force this rank counts, over the local scene.
+void StripSimulation::accumulateGradE( VectorXs& gradE )
+{
+  const int numreplicated = (int) m_replicated.size();
+  const int numowned = (int) m_owned.size();
+  const VectorXs& x = m_local.getX();
+  const VectorXs& v = m_local.getV();
+  const VectorXs& m = m_local.getM();
+
+  gradE.setZero(x.size());
+  StripPenaltyCallback callback(*m_penalty, x, numreplicated, numowned, m_rank == 0, gradE);
+  // The contest detector cannot take a scene without particles.
+  if( m_local.getNumParticles() > 0 ) m_detector->performCollisionDetection(m_local, x, x, callback);
+
+  for( std::vector<SpringForce*>::size_type s = 0; s < m_springs.size(); ++s ) m_springs[s]->addGradEToTotal(x, v, m, gradE);
+
+  const int first = m_rank == 0 ? 0 : numreplicated;
+  for( int i = first; i < numreplicated + numowned; ++i )
+  {
+    for( int d = 0; d < 2; ++d ) gradE(2*i + d) += m_settings.drag*v(2*i + d) - m(2*i + d)*m_settings.gravity[d];
+  }
+}
+
+// Integrates the owned particles, and the replicated ones on rank 0, which
+// sums their gradient over the ranks and sends out their new state.
+void StripSimulation::advance( const VectorXs& gradE )
+{
+  const int numreplicated = (int) m_replicated.size();
+  const scalar dt = m_settings.dt;
+  for( std::vector<Particle>::size_type p = 0; p < m_owned.size(); ++p )
+  {
+    Particle& particle = m_owned[p];
+    const int i = numreplicated + (int) p;
+    for( int d = 0; d < 2; ++d )
+    {
+      particle.v[d] -= dt*gradE(2*i + d)/particle.m[d];
+      particle.x[d] += dt*particle.v[d];
+    }
+  }
+
+  if( numreplicated == 0 ) return;
+  VectorXs total(2*numreplicated);
+  MPI_Reduce(const_cast<scalar*>(gradE.data()), total.data(), 2*numreplicated, MPI_DOUBLE, MPI_SUM, 0, MPI_COMM_WORLD);
+  if( m_rank == 0 )
+  {
+    for( int g = 0; g < numreplicated; ++g )
+    {
+      if( m_replicatedfixed[g] ) continue;
+      m_replicatedv.segment<2>(2*g) -= dt*total.segment<2>(2*g).cwiseQuotient(m_replicatedm.segment<2>(2*g));
+      m_replicatedx.segment<2>(2*g) += dt*m_replicatedv.segment<2>(2*g);
+    }
+  }
+  MPI_Bcast(m_replicatedx.data(), 2*numreplicated, MPI_DOUBLE, 0, MPI_COMM_WORLD);
+  MPI_Bcast(m_replicatedv.data(), 2*numreplicated, MPI_DOUBLE, 0, MPI_COMM_WORLD);
+}
+
+void StripSimulation::migrate()
+{
+  std::vector<std::vector<scalar> > outgoing(m_numranks);
+  std::vector<Particle> staying;
+  for( std::vector<Particle>::size_type p = 0; p < m_owned.size(); ++p )
+  {
+    const int r = findStrip(m_owned[p].x[0]);
+    if( r == m_rank ) staying.push_back(m_owned[p]);
+    else pack(m_owned[p], outgoing[r]);
+  }
+  std::vector<scalar> incoming;
+  exchange(outgoing, incoming);
+  m_owned.swap(staying);
+  unpack(incoming, m_owned);
+}
+
+void StripSimulation::step()
+{
+  exchangeHalo();
+  buildLocalScene();
+  VectorXs gradE;
+  accumulateGradE(gradE);
+  advance(gradE);
+  migrate();
+}
+
+void StripSimulation::rebalance()
+{
+  std::vector<scalar> mine;
+  for( std::vector<Particle>::size_type p = 0; p < m_owned.size(); ++p ) mine.push_back(m_owned[p].x[0]);
+  int count = (int) mine.size();
+  std::vector<int> counts(m_numranks), displs(m_numranks);
+  MPI_Gather(&count, 1, MPI_INT, &counts[0], 1, MPI_INT, 0, MPI_COMM_WORLD);
+  int total = 0;
+  for( int r = 0; r < m_numranks; ++r )
+  {
+    displs[r] = total;
+    total += counts[r];
+  }
+  std::vector<scalar> xs(m_rank == 0 ? total + 1 : 1);
+  mine.push_back(0.0);
+  MPI_Gatherv(&mine[0], count, MPI_DOUBLE, &xs[0], &counts[0], &displs[0], MPI_DOUBLE, 0, MPI_COMM_WORLD);
+  if( m_rank == 0 )
+  {
+    xs.pop_back();
+    placeStrips(xs);
+  }
+  m_bounds.resize(m_numranks - 1);
+  if( m_numranks > 1 ) MPI_Bcast(&m_bounds[0], m_numranks - 1, MPI_DOUBLE, 0, MPI_COMM_WORLD);
+  migrate();
+}
+
+void StripSimulation::gather( VectorXs& x, VectorXs& v ) const
+{
+  std::vector<scalar> mine;
+  for( std::vector<Particle>::size_type p = 0; p < m_owned.size(); ++p ) pack(m_owned[p], mine);
+  int count = (int) mine.size();
+  std::vector<int> counts(m_numranks), displs(m_numranks);
+  MPI_Gather(&count, 1, MPI_INT, &counts[0], 1, MPI_INT, 0, MPI_COMM_WORLD);
+  int total = 0;
+  for( int r = 0; r < m_numranks; ++r )
+  {
+    displs[r] = total;
+    total += counts[r];
+  }
+  std::vector<scalar> all(m_rank == 0 ? total + 1 : 1);
+  mine.push_back(0.0);
+  MPI_Gatherv(&mine[0], count, MPI_DOUBLE, &all[0], &counts[0], &displs[0], MPI_DOUBLE, 0, MPI_COMM_WORLD);
+  if( m_rank != 0 ) return;
+
+  all.pop_back();
+  std::vector<Particle> particles;
+  unpack(all, particles);
+  x.resize(2*m_numparticles);
+  v.resize(2*m_numparticles);
+  for( std::vector<int>::size_type g = 0; g < m_replicated.size(); ++g )
+  {
+    x.segment<2>(2*m_replicated[g]) = m_replicatedx.segment<2>(2*g);
+    v.segment<2>(2*m_replicated[g]) = m_replicatedv.segment<2>(2*g);
+  }
+  for( std::vector<Particle>::size_type p = 0; p < particles.size(); ++p )
+  {
+    const Particle& particle = particles[p];
+    for( int d = 0; d < 2; ++d )
+    {
+      x(2*particle.id + d) = particle.x[d];
+      v(2*particle.id + d) = particle.v[d];
+    }
+  }
+}
+
+// Reads the scene on every rank, with the --set overrides applied. Returns
+// false, having said why on rank 0, if any rank could not.
+bool loadScene( const std::string& filename, const std::vector<std::string>& overrides, int rank, TwoDScene& scene, PenaltySceneSettings& settings )
+{
+  std::vector<SceneRecord> records;
+  // Every rank reads the file, but only rank 0 says what is wrong with it.
+  std::streambuf* errors = std::cerr.rdbuf();
+  if( rank != 0 ) std::cerr.rdbuf(NULL);
+  int ok = ::loadScene(filename, scene, records, SIMULATION_RECORDS) && applySceneOverrides(overrides, records) && readPenaltySceneSettings(records, scene.getNumEdges(), settings);
+  // The strips' halos do not wrap around.
+  if( ok && settings.hasPeriodicDomain() )
+  {
+    complain("A <periodicdomain> is not supported across ranks.");
+    ok = 0;
+  }
+  std::cerr.rdbuf(errors);
+  int allok = 0;
+  MPI_Allreduce(&ok, &allok, 1, MPI_INT, MPI_MIN, MPI_COMM_WORLD);
+  return allok != 0;
+}
+
+// Reads a checkpoint of scene on every rank and puts its x and v in scene.
+// Returns false, having said why on rank 0, if any rank could not.
+bool resumeScene( const std::string& filename, int rank, TwoDScene& scene, const PenaltySceneSettings& settings, Checkpoint& checkpoint )
+{
+  std::streambuf* errors = std::cerr.rdbuf();
+  if( rank != 0 ) std::cerr.rdbuf(NULL);
+  int ok = readCheckpoint(filename, checkpoint) && checkpointMatches(checkpoint, scene, settings);
+  std::cerr.rdbuf(errors);
+  int allok = 0;
+  MPI_Allreduce(&ok, &allok, 1, MPI_INT, MPI_MIN, MPI_COMM_WORLD);
+  if( allok == 0 ) return false;
+  scene.getX() = checkpoint.x;
+  scene.getV() = checkpoint.v;
+  return true;
+}
+
+}
+
+int main( int argc, char** argv )
+{
+  MPI_Init(&argc, &argv);
+  int rank, numranks;
+  MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+  MPI_Comm_size(MPI_COMM_WORLD, &numranks);
+
+  std::string scenefile, outputfile, checkpointfile, resumefile;
+  std::vector<std::string> overrides;
+  int rebalanceinterval, nthreads, checkpointinterval;
+  try
+  {
+    TCLAP::CmdLine cmd("Runs a penalty-contact scene over MPI, each rank owning a strip of it.", ' ', "1.0");
+    TCLAP::ValueArg<std::string> sceneArg("s", "scene", "Simulation to run; an xml scene file, or a binary .fsb one", true, "", "string", cmd);
+    TCLAP::ValueArg<std::string> outputArg("o", "outputfile", "Binary file to save simulation state to", false, "", "string", cmd);
+    TCLAP::ValueArg<int> rebalanceArg("b", "rebalance", "Steps between moving the strips back to the particles' quantiles; 0 never does", false, 100, "integer", cmd);
+    TCLAP::ValueArg<int> threadsArg("t", "threads", "Threads of each rank's task pool; 0 is one per processor", false, 1, "integer", cmd);
+    TCLAP::ValueArg<int> checkpointintervalArg("c", "checkpoint-every", "Steps between snapshots of the run to resume from; 0 never takes one", false, 0, "integer", cmd);
+    TCLAP::ValueArg<std::string> checkpointArg("k", "checkpoint", "Binary file each snapshot replaces the last in", false, "FOSSSimMPI.fck", "string", cmd);
+    TCLAP::ValueArg<std::string> resumeArg("r", "resume", "Snapshot of a run of the same scene to resume from", false, "", "string", cmd);
+    TCLAP::MultiArg<std::string> setArg("", "set", "Replaces an attribute of the scene once it is loaded, such as integrator.dt=0.002; may be given more than once", false, "element.attribute=value", cmd);
+    cmd.parse(argc, argv);
+    scenefile = sceneArg.getValue();
+    outputfile = outputArg.getValue();
+    rebalanceinterval = rebalanceArg.getValue();
+    nthreads = threadsArg.getValue();
+    checkpointinterval = checkpointintervalArg.getValue();
+    checkpointfile = checkpointArg.getValue();
+    resumefile = resumeArg.getValue();
+    overrides = setArg.getValue();
+  }
+  catch( TCLAP::ArgException& e )
+  {
+    if( rank == 0 ) std::cerr << "error: " << e.what() << std::endl;
+    MPI_Finalize();
+    return 1;
+  }
+  TaskPool::shared().setNumThreads(nthreads);
+
+  PenaltySceneSettings settings;
+  StripSimulation simulation(rank, numranks);
+  // Everything but the step, x, v and bounds of the checkpoints rank 0
+  // takes, or the checkpoint resumed from.
+  Checkpoint checkpoint;
+  {
+    TwoDScene scene;
+    if( !loadScene(scenefile, overrides, rank, scene, settings) || ( !resumefile.empty() && !resumeScene(resumefile, rank, scene, settings, checkpoint) ) )
+    {
+      MPI_Finalize();
+      return 1;
+    }
+    simulation.setup(scene, settings, checkpoint.bounds);
+    if( rank == 0 && checkpointinterval > 0 )
+    {
+      checkpoint.fixed.resize(scene.getNumParticles());
+      for( int i = 0; i < scene.getNumParticles(); ++i ) checkpoint.fixed[i] = scene.isFixed(i);
+      checkpoint.settings = settings;
+    }
+  }
+  const int firststep = checkpoint.step;
+
+  AsyncTrajectoryWriter writer;
+  int failed = 0;
+  if( rank == 0 && !outputfile.empty() && !writer.open(outputfile) )
+  {
+    complain("Failed to open " + outputfile + ".");
+    failed = 1;
+  }
+  MPI_Bcast(&failed, 1, MPI_INT, 0, MPI_COMM_WORLD);
+  if( failed )
+  {
+    MPI_Finalize();
+    return 1;
+  }
+
+  // As many steps as the base library takes.
+  const int numsteps = (int) std::ceil(settings.duration/settings.dt - 1.0e-9);
+  const bool output = !outputfile.empty();
+  VectorXs x, v;
+  if( output )
+  {
+    simulation.gather(x, v);
+    if( rank == 0 ) writer.writeFrame(x, v);
+  }
+
+  AsyncCheckpointWriter checkpoints;
+  const double start = MPI_Wtime();
+  for( int s = firststep + 1; s <= numsteps; ++s )
+  {
+    simulation.step();
+    if( rebalanceinterval > 0 && s%rebalanceinterval == 0 ) simulation.rebalance();
+    const bool snapshot = checkpointinterval > 0 && s%checkpointinterval == 0;
+    if( output || snapshot ) simulation.gather(x, v);
+    if( rank != 0 ) continue;
+    if( output ) writer.writeFrame(x, v);
+    if( snapshot )
+    {
+      checkpoint.step = s;
+      checkpoint.x.swap(x);
+      checkpoint.v.swap(v);
+      checkpoint.bounds = simulation.getBounds();
+      checkpoints.write(checkpointfile, checkpoint);
+      checkpoint.x.swap(x);
+      checkpoint.v.swap(v);
+    }
+  }
+  const double elapsed = MPI_Wtime() - start;
+
+  if( rank == 0 )
+  {
+    if( output && !writer.close() )
+    {
+      complain("Failed to write " + outputfile + ".");
+      failed = 1;
+    }
+    if( !checkpoints.finish() ) failed = 1;
+    std::cout << simulation.getNumParticles() << " particles, " << std::max(numsteps - firststep, 0) << " steps on " << numranks << ( numranks == 1 ? " rank" : " ranks" ) << " in " << elapsed << " s." << std::endl;
+  }
+  MPI_Finalize();
+  return failed;
+}
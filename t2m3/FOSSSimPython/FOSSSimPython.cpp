@@ -0,0 +1,120 @@
+// A Python interpreter with FOSSSim built in, for driving penalty-contact
+// scenes from analysis scripts without spawning a simulator per run or
+// going through trajectory files. Run as
+//
+//   FOSSSimPython script.py [arguments...]
+//
+// and the script can
+//
+//   import fosssim
+//   scene = fosssim.Scene("assets/t2m3/TimingScenes/test00.xml")
+//   for s in range(scene.num_steps):
+//       scene.step()
+//       analyse(scene.x, scene.v)
+//
+// Scene.x, v and m are NumPy arrays of shape (particles, 2) over the scene's
+// own storage, through FOSSSimEmbed, so reading them copies nothing and
+// writing them changes what the next step starts from. They stay valid for
+// as long as they are referenced, holding on to their scene.
+//
+// The base library is not position independent, which rules out an
+// extension module that a stock python could import; hence the interpreter.
+
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <pybind11/embed.h>
+#include <pybind11/numpy.h>
+
+#include "FOSSSimEmbed/FOSSSimEmbed.h"
+
+namespace py = pybind11;
+
+namespace
+{
+
+class PythonScene
+{
+public:
+  explicit PythonScene( const std::string& scenefile )
+  : m_scene(fosssim_load(scenefile.c_str()))
+  {
+    if( m_scene == NULL ) throw std::runtime_error("unable to load " + scenefile);
+  }
+
+  ~PythonScene()
+  {
+    fosssim_free(m_scene);
+  }
+
+  FOSSSimScene* get() const
+  {
+    return m_scene;
+  }
+
+private:
+  PythonScene( const PythonScene& );
+  PythonScene& operator=( const PythonScene& );
+
+  FOSSSimScene* m_scene;
+};
+
+// One of the scene's per-particle arrays, viewed in place. The array keeps
+// owner, and with it the scene, alive.
+py::array_t<double> view( const py::object& owner, double* data, int numparticles )
+{
+  const std::vector<py::ssize_t> shape = { numparticles, 2 };
+  const std::vector<py::ssize_t> strides = { (py::ssize_t) (2*sizeof(double)), (py::ssize_t) sizeof(double) };
+  return py::array_t<double>(shape, strides, data, owner);
+}
+
+}
+
+PYBIND11_EMBEDDED_MODULE(fosssim, m)
+{
+  py::class_<PythonScene>(m, "Scene")
+    .def(py::init<const std::string&>(), py::arg("scenefile"))
+    .def("step", []( PythonScene& scene, int steps ) { fosssim_step(scene.get(), steps); }, py::arg("steps") = 1,
+         py::call_guard<py::gil_scoped_release>())
+    .def_property_readonly("num_particles", []( const PythonScene& scene ) { return fosssim_num_particles(scene.get()); })
+    .def_property_readonly("dt", []( const PythonScene& scene ) { return fosssim_timestep(scene.get()); })
+    .def_property_readonly("num_steps", []( const PythonScene& scene ) { return fosssim_num_steps(scene.get()); })
+    .def_property_readonly("x", []( const py::object& self ) {
+      FOSSSimScene* scene = self.cast<const PythonScene&>().get();
+      return view(self, fosssim_positions(scene), fosssim_num_particles(scene)); })
+    .def_property_readonly("v", []( const py::object& self ) {
+      FOSSSimScene* scene = self.cast<const PythonScene&>().get();
+      return view(self, fosssim_velocities(scene), fosssim_num_particles(scene)); })
+    .def_property_readonly("m", []( const py::object& self ) {
+      FOSSSimScene* scene = self.cast<const PythonScene&>().get();
+      return view(self, fosssim_masses(scene), fosssim_num_particles(scene)); });
+}
+
+int main( int argc, char** argv )
+{
+  if( argc < 2 )
+  {
+    std::cerr << "Usage: " << argv[0] << " script.py [arguments...]" << std::endl;
+    return 1;
+  }
+
+  py::scoped_interpreter interpreter;
+  try
+  {
+    py::list args;
+    for( int a = 1; a < argc; ++a ) args.append(argv[a]);
+    py::module_::import("sys").attr("argv") = args;
+
+    py::object scope = py::module_::import("__main__").attr("__dict__");
+    scope["__file__"] = argv[1];
+    py::eval_file(argv[1], scope);
+  }
+  catch( const py::error_already_set& error )
+  {
+    std::cerr << error.what() << std::endl;
+    return 1;
+  }
+  return 0;
+}
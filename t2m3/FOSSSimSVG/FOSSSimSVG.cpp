@@ -0,0 +1,197 @@
+// Writes the frames of a trajectory written by FOSSSim -o or FOSSSimMPI -o as
+// SVG images, for scenes too large for FOSSSim's own -m. The base library's
+// renderer formats every circle through a string stream and builds each
+// colour as a string of its own, which for the 100k particles of
+// TimingScenes/test00 takes longer to write a frame than to step it. Here
+// each frame streams straight to its file through SVGWriter, with particles
+// of one colour and edges of one width sharing a group's attributes.
+//
+// Particles smaller than --lod pixels across their radius are left out, and
+// particles and edges off the image altogether, so that zoomed-out views of
+// huge scenes stay a manageable size.
+//
+// With --png the frames are drawn by SceneRasterizer instead, in software,
+// needing neither a display nor OpenGL, and PNGFrameWriter compresses them
+// on --threads threads of their own while the next frame is read and drawn.
+// FOSSSim's own -p reads every frame back from its window and compresses it
+// before taking the next step.
+//
+// The frames are written to moviedir/frame00000.svg or .png and on, as
+// FOSSSim -m and -p name them; without a trajectory the scene's initial
+// state is the only frame. --first and --last pick a range of frames, which
+// the trajectory's index lets the reader seek to directly, so a render farm
+// can split one trajectory between its machines with no simulation at all;
+// the frames keep their numbers in the trajectory.
+
+#include <algorithm>
+#include <cstdio>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <tclap/CmdLine.h>
+
+#include "FOSSSim/PNGFrameWriter.h"
+#include "FOSSSim/SceneAppearance.h"
+#include "FOSSSim/SceneBinary.h"
+#include "FOSSSim/SVGWriter.h"
+#include "FOSSSim/Trajectory.h"
+#include "FOSSSim/TwoDScene.h"
+
+namespace
+{
+
+void complain( const std::string& what )
+{
+  std::cerr << "\033[31;1mERROR IN FOSSSIMSVG:\033[m " << what << std::endl;
+}
+
+std::string frameFilename( const std::string& moviedir, int frame, const char* extension )
+{
+  char name[32];
+  std::snprintf(name, sizeof(name), "/frame%05d.%s", frame, extension);
+  return moviedir + name;
+}
+
+// Writes the frames as SVG, or as PNG through pngs if it is not NULL.
+class FrameOutput
+{
+public:
+  FrameOutput( const TwoDScene& scene, const SceneAppearance& appearance, const SVGFrameOptions& options, const std::string& moviedir, PNGFrameWriter* pngs )
+  : m_scene(scene)
+  , m_appearance(appearance)
+  , m_options(options)
+  , m_moviedir(moviedir)
+  , m_pngs(pngs)
+  {}
+
+  bool write( int frame, const VectorXs& x )
+  {
+#ifdef PNGOUT
+    if( m_pngs != NULL )
+    {
+      rasterizeScene(m_scene, x, m_appearance, m_pngs->beginFrame(m_options.width, m_options.height));
+      m_pngs->endFrame(frameFilename(m_moviedir, frame, "png"));
+      return true;
+    }
+#endif
+    return writeSceneSVG(frameFilename(m_moviedir, frame, "svg"), m_scene, x, m_appearance, m_options);
+  }
+
+  // Waits for the frames still being written.
+  bool finish()
+  {
+#ifdef PNGOUT
+    if( m_pngs != NULL ) return m_pngs->finish();
+#endif
+    return true;
+  }
+
+private:
+  const TwoDScene& m_scene;
+  const SceneAppearance& m_appearance;
+  const SVGFrameOptions& m_options;
+  const std::string& m_moviedir;
+  PNGFrameWriter* m_pngs;
+};
+
+}
+
+int main( int argc, char** argv )
+{
+  std::string scenefile, trajectoryfile, moviedir;
+  SVGFrameOptions options;
+  int stride;
+  int first, last;
+  bool png;
+  int nthreads;
+  try
+  {
+    TCLAP::CmdLine cmd("Writes the frames of a FOSSSim trajectory as SVG or PNG images.", ' ', "1.0");
+    TCLAP::ValueArg<std::string> sceneArg("s", "scene", "Scene the trajectory was run from; an xml scene file, or a binary .fsb one", true, "", "string", cmd);
+    TCLAP::ValueArg<std::string> trajectoryArg("t", "trajectory", "Binary trajectory written with -o; without one the scene's initial state is written", false, "", "string", cmd);
+    TCLAP::ValueArg<std::string> moviedirArg("m", "moviedir", "Existing directory to write the frames to", true, "", "string", cmd);
+    TCLAP::ValueArg<int> widthArg("W", "width", "Width of the images in pixels", false, options.width, "integer", cmd);
+    TCLAP::ValueArg<int> heightArg("H", "height", "Height of the images in pixels", false, options.height, "integer", cmd);
+    TCLAP::ValueArg<double> lodArg("l", "lod", "Radius in pixels below which particles are left out; 0 draws every one", false, options.lodradius, "scalar", cmd);
+    TCLAP::ValueArg<int> strideArg("k", "stride", "Writes every stride-th frame", false, 1, "integer", cmd);
+    TCLAP::ValueArg<int> firstArg("F", "first", "First frame written", false, 0, "integer", cmd);
+    TCLAP::ValueArg<int> lastArg("L", "last", "Last frame written; -1 is the trajectory's last", false, -1, "integer", cmd);
+    TCLAP::SwitchArg pngArg("p", "png", "Draws the frames in software and writes them as PNG images instead", cmd, false);
+    TCLAP::ValueArg<int> threadsArg("j", "threads", "Threads compressing PNG images; 0 is one per processor", false, 0, "integer", cmd);
+    cmd.parse(argc, argv);
+    scenefile = sceneArg.getValue();
+    trajectoryfile = trajectoryArg.getValue();
+    moviedir = moviedirArg.getValue();
+    options.width = widthArg.getValue();
+    options.height = heightArg.getValue();
+    options.lodradius = lodArg.getValue();
+    stride = strideArg.getValue();
+    first = firstArg.getValue();
+    last = lastArg.getValue();
+    png = pngArg.getValue();
+    nthreads = threadsArg.getValue();
+  }
+  catch( TCLAP::ArgException& e )
+  {
+    std::cerr << "error: " << e.what() << std::endl;
+    return 1;
+  }
+  if( options.width <= 0 || options.height <= 0 || stride <= 0 )
+  {
+    complain("The width, the height and the stride must be positive.");
+    return 1;
+  }
+  if( first < 0 || ( last >= 0 && last < first ) )
+  {
+    complain("The first frame must be at least 0, and no later than the last.");
+    return 1;
+  }
+#ifndef PNGOUT
+  if( png )
+  {
+    complain("FOSSSimSVG was built without PNG support.");
+    return 1;
+  }
+#endif
+
+  TwoDScene scene;
+  std::vector<SceneRecord> records;
+  if( !loadScene(scenefile, scene, records) ) return 1;
+  SceneAppearance appearance;
+  readSceneAppearance(records, scene, appearance);
+
+#ifdef PNGOUT
+  std::unique_ptr<PNGFrameWriter> pngs( png ? new PNGFrameWriter(nthreads) : NULL );
+  FrameOutput output(scene, appearance, options, moviedir, pngs.get());
+#else
+  FrameOutput output(scene, appearance, options, moviedir, NULL);
+#endif
+  if( trajectoryfile.empty() ) return output.write(0, scene.getX()) && output.finish() ? 0 : 1;
+
+  const int numparticles = scene.getNumParticles();
+  TrajectoryReader reader;
+  if( !reader.open(trajectoryfile, numparticles) )
+  {
+    complain("Failed to open " + trajectoryfile + ".");
+    return 1;
+  }
+  const int end = last < 0 ? reader.getNumFrames() : std::min(last + 1, reader.getNumFrames());
+  VectorXs x, v;
+  for( int frame = first; frame < end; frame += stride )
+  {
+    if( reader.getNumParticles(frame) != numparticles )
+    {
+      complain(trajectoryfile + " does not have the scene's particles in every frame.");
+      return 1;
+    }
+    if( !reader.readFrame(frame, x, v) )
+    {
+      complain("Failed to read a frame of the trajectory.");
+      return 1;
+    }
+    if( !output.write(frame, x) ) return 1;
+  }
+  return output.finish() ? 0 : 1;
+}
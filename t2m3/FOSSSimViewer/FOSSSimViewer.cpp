@@ -0,0 +1,706 @@
+// Plays back a trajectory written by FOSSSim -o or FOSSSimMPI -o over its
+// scene, for scenes too large for FOSSSim's own display. The base library's
+// renderer draws each particle as its own immediate-mode circle, which at
+// the 100k particles of TimingScenes/test00 manages about a frame a second.
+// Here every frame is a few uploads and three draw calls:
+//
+//   - the positions go into a vertex buffer, which also feeds the edges;
+//   - every particle in view at least a pixel across is one instance of a
+//     square, drawn in a single instanced call, and a fragment shader cuts
+//     the circle out of it;
+//   - every smaller particle in view is one point of a single point batch;
+//   - every edge in view is one line of a single indexed line batch;
+//   - the tracks of the scene's <particlepath>s are one batch of line strips,
+//     from fixed rings of their latest points; see ParticlePaths.
+//
+// The particles in view are found through a ParticleGrid of the frame, so a
+// view zoomed in on a corner of a huge scene costs what the corner does.
+// Halfplanes, a handful per scene, are drawn directly, if they cross the
+// view.
+//
+// With --live the scene is stepped instead, on a thread of its own, and each
+// redraw shows the latest step finished; see LiveSimulation. Only the
+// penalty-contact scenes FOSSSimMPI runs can be stepped live, with --set
+// overriding their attributes as FOSSSimMPI's does.
+//
+// A path takes a point every --pathstride frames, by default as many as keep
+// it within ParticlePaths::MAX_POINTS points, so the paths of a long run
+// cost no more to keep or to draw than those of a short one. Seeking back
+// in a trajectory starts them over.
+//
+// The trajectory is read through a TrajectoryReader, which maps it into
+// memory, so that seeking about a trajectory already played costs no disk
+// reads.
+//
+// Space plays and pauses, . and , step a frame, r rewinds, 1 to 9 seek to
+// that tenth of the trajectory and 0 to its last frame, > and < double and
+// halve the frames played per tick for fast-forwarding, + and - zoom, the
+// arrow keys or a drag pan, and q or Escape quits.
+
+#define GL_GLEXT_PROTOTYPES
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#ifdef __APPLE__
+#include <GLUT/glut.h>
+#else
+#include <GL/glut.h>
+#include <GL/glext.h>
+#endif
+
+#include <tclap/CmdLine.h>
+
+#include "FOSSSim/BroadPhaseTuning.h"
+#include "FOSSSim/PenaltySceneSettings.h"
+#include "FOSSSim/SceneAppearance.h"
+#include "FOSSSim/SceneBinary.h"
+#include "FOSSSim/Trajectory.h"
+#include "FOSSSim/TwoDScene.h"
+#include "LiveSimulation.h"
+#include "ParticleGrid.h"
+#include "ParticlePaths.h"
+
+namespace
+{
+
+const char* CIRCLE_VERTEX_SHADER =
+  "#version 120\n"
+  "attribute vec2 corner;\n"
+  "attribute vec2 center;\n"
+  "attribute float radius;\n"
+  "attribute vec3 color;\n"
+  "varying vec2 offset;\n"
+  "varying vec3 fill;\n"
+  "void main()\n"
+  "{\n"
+  "  offset = corner;\n"
+  "  fill = color;\n"
+  "  gl_Position = gl_ModelViewProjectionMatrix*vec4( center + radius*corner, 0.0, 1.0 );\n"
+  "}\n";
+
+const char* CIRCLE_FRAGMENT_SHADER =
+  "#version 120\n"
+  "varying vec2 offset;\n"
+  "varying vec3 fill;\n"
+  "void main()\n"
+  "{\n"
+  "  if( dot( offset, offset ) > 1.0 ) discard;\n"
+  "  gl_FragColor = vec4( fill, 1.0 );\n"
+  "}\n";
+
+// Pixels a drag or an arrow key moves the view by, and the factor a zoom
+// key scales it by.
+const double PAN_PIXELS = 20.0;
+const double ZOOM_FACTOR = 1.25;
+
+// Particles with a radius under this many pixels are drawn as points.
+const double POINT_RADIUS_PIXELS = 0.5;
+
+// The most frames fast-forwarding plays per tick.
+const int MAX_FRAMES_PER_TICK = 1024;
+
+struct Viewer
+{
+  TwoDScene scene;
+  TrajectoryReader reader;
+  int numframes;
+  int frame;
+  bool playing;
+  int framemilliseconds;
+  // Frames each tick of playback advances by.
+  int framespertick;
+  // The scene being stepped, with --live.
+  LiveSimulation* live;
+
+  // The current frame's positions, and as floats for the vertex buffer and
+  // the grid of the particles in it.
+  VectorXs x;
+  VectorXs v;
+  std::vector<float> positions;
+  ParticleGrid grid;
+
+  // Every particle's radius and colour, and what is in view of them as
+  // drawn last: the particles, their instances as center, radius and
+  // colour, the points as position and colour, and the edges' endpoints.
+  std::vector<float> radii;
+  std::vector<float> colors;
+  std::vector<int> visible;
+  std::vector<float> circles;
+  std::vector<float> points;
+  std::vector<GLuint> edges;
+  ParticlePaths paths;
+
+  // The colours, and the center of the window and half the extent of its
+  // shorter side, starting from the scene's <viewport>.
+  SceneAppearance appearance;
+  int width, height;
+  int dragx, dragy;
+  bool dragging;
+
+  GLuint program;
+  GLint corner, center, radius, color;
+  GLuint quadbuffer, positionbuffer, circlebuffer, pointbuffer, edgebuffer, pathbuffer, pathcolorbuffer;
+};
+
+Viewer g_viewer;
+
+void complain( const std::string& what )
+{
+  std::cerr << "\033[31;1mERROR IN FOSSSIMVIEWER:\033[m " << what << std::endl;
+}
+
+// The integrator's time step, which separates the frames of a trajectory
+// and the steps of a live run, or 0 if the scene has none.
+double frameTime( const std::vector<SceneRecord>& records )
+{
+  for( std::vector<SceneRecord>::size_type k = 0; k < records.size(); ++k )
+  {
+    const std::string* dt = records[k].name == "integrator" ? records[k].findAttribute("dt") : NULL;
+    if( dt != NULL ) return std::strtod(dt->c_str(), NULL);
+  }
+  return 0.0;
+}
+
+GLuint compileShader( GLenum type, const char* source )
+{
+  GLuint shader = glCreateShader(type);
+  glShaderSource(shader, 1, &source, NULL);
+  glCompileShader(shader);
+  GLint compiled = GL_FALSE;
+  glGetShaderiv(shader, GL_COMPILE_STATUS, &compiled);
+  if( compiled != GL_TRUE )
+  {
+    char log[1024];
+    glGetShaderInfoLog(shader, sizeof(log), NULL, log);
+    complain(std::string("Failed to compile a shader: ") + log);
+    exit(1);
+  }
+  return shader;
+}
+
+template<class T>
+GLuint createBuffer( GLenum target, const std::vector<T>& data, GLenum usage )
+{
+  GLuint buffer = 0;
+  glGenBuffers(1, &buffer);
+  glBindBuffer(target, buffer);
+  glBufferData(target, data.size()*sizeof(T), data.empty() ? NULL : &data[0], usage);
+  return buffer;
+}
+
+// The instanced draw needs OpenGL 3.3 or ARB_instanced_arrays.
+bool hasInstancing()
+{
+  const char* version = (const char*) glGetString(GL_VERSION);
+  int major = 0, minor = 0;
+  if( version != NULL && std::sscanf(version, "%d.%d", &major, &minor) == 2 && ( major > 3 || ( major == 3 && minor >= 3 ) ) ) return true;
+  const char* extensions = (const char*) glGetString(GL_EXTENSIONS);
+  return extensions != NULL && std::string(extensions).find("GL_ARB_instanced_arrays") != std::string::npos;
+}
+
+void createBuffers( Viewer& viewer )
+{
+  GLuint vertexshader = compileShader(GL_VERTEX_SHADER, CIRCLE_VERTEX_SHADER);
+  GLuint fragmentshader = compileShader(GL_FRAGMENT_SHADER, CIRCLE_FRAGMENT_SHADER);
+  viewer.program = glCreateProgram();
+  glAttachShader(viewer.program, vertexshader);
+  glAttachShader(viewer.program, fragmentshader);
+  glLinkProgram(viewer.program);
+  GLint linked = GL_FALSE;
+  glGetProgramiv(viewer.program, GL_LINK_STATUS, &linked);
+  if( linked != GL_TRUE )
+  {
+    complain("Failed to link the circle shader.");
+    exit(1);
+  }
+  viewer.corner = glGetAttribLocation(viewer.program, "corner");
+  viewer.center = glGetAttribLocation(viewer.program, "center");
+  viewer.radius = glGetAttribLocation(viewer.program, "radius");
+  viewer.color = glGetAttribLocation(viewer.program, "color");
+
+  const int numparticles = viewer.scene.getNumParticles();
+  const float quad[] = { -1.0f, -1.0f, 1.0f, -1.0f, -1.0f, 1.0f, 1.0f, 1.0f };
+  viewer.quadbuffer = createBuffer(GL_ARRAY_BUFFER, std::vector<float>(quad, quad + 8), GL_STATIC_DRAW);
+  viewer.positionbuffer = createBuffer(GL_ARRAY_BUFFER, std::vector<float>(2*numparticles), GL_STREAM_DRAW);
+  viewer.circlebuffer = createBuffer(GL_ARRAY_BUFFER, std::vector<float>(), GL_STREAM_DRAW);
+  viewer.pointbuffer = createBuffer(GL_ARRAY_BUFFER, std::vector<float>(), GL_STREAM_DRAW);
+  viewer.edgebuffer = createBuffer(GL_ELEMENT_ARRAY_BUFFER, std::vector<GLuint>(), GL_STREAM_DRAW);
+  viewer.pathbuffer = createBuffer(GL_ARRAY_BUFFER, viewer.paths.getVertices(), GL_DYNAMIC_DRAW);
+  viewer.pathcolorbuffer = createBuffer(GL_ARRAY_BUFFER, viewer.paths.getColors(), GL_STATIC_DRAW);
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+
+  viewer.radii.resize(numparticles);
+  viewer.colors.resize(3*numparticles);
+  for( int i = 0; i < numparticles; ++i )
+  {
+    viewer.radii[i] = (float) viewer.scene.getRadius(i);
+    viewer.colors[3*i] = viewer.appearance.particlecolors[i].r;
+    viewer.colors[3*i+1] = viewer.appearance.particlecolors[i].g;
+    viewer.colors[3*i+2] = viewer.appearance.particlecolors[i].b;
+  }
+}
+
+// Replaces the contents of buffer with data.
+template<class T>
+void streamBuffer( GLenum target, GLuint buffer, const std::vector<T>& data )
+{
+  glBindBuffer(target, buffer);
+  // Orphaning the buffer lets the driver keep drawing the previous frame.
+  glBufferData(target, data.size()*sizeof(T), NULL, GL_STREAM_DRAW);
+  if( !data.empty() ) glBufferSubData(target, 0, data.size()*sizeof(T), &data[0]);
+  glBindBuffer(target, 0);
+}
+
+// Uploads the viewer's positions, those of frame, finds the particles in
+// the grid and extends the paths.
+void updatePositions( Viewer& viewer, int frame )
+{
+  streamBuffer(GL_ARRAY_BUFFER, viewer.positionbuffer, viewer.positions);
+  viewer.grid.build(viewer.positions, viewer.radii);
+
+  viewer.paths.record(viewer.positions, frame);
+  const std::vector<int>& written = viewer.paths.getWritten();
+  if( written.empty() ) return;
+  glBindBuffer(GL_ARRAY_BUFFER, viewer.pathbuffer);
+  for( std::vector<int>::size_type k = 0; k < written.size(); ++k )
+    glBufferSubData(GL_ARRAY_BUFFER, 2*written[k]*sizeof(float), 2*sizeof(float), &viewer.paths.getVertices()[2*written[k]]);
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void setTitle( const char* what, int index, int last, int speed = 1 )
+{
+  std::ostringstream title;
+  title << "FOSSSimViewer: " << what << " " << index << " of " << last;
+  if( speed > 1 ) title << " at " << speed << "x";
+  glutSetWindowTitle(title.str().c_str());
+}
+
+// Reads frame into the viewer and the position buffer.
+bool loadFrame( Viewer& viewer, int frame )
+{
+  if( viewer.numframes > 0 && !viewer.reader.readFrame(frame, viewer.x, viewer.v) )
+  {
+    complain("Failed to read a frame of the trajectory.");
+    return false;
+  }
+  viewer.frame = frame;
+  viewer.positions.resize(viewer.x.size());
+  for( int k = 0; k < viewer.x.size(); ++k ) viewer.positions[k] = (float) viewer.x(k);
+  updatePositions(viewer, frame);
+  setTitle("frame", frame, std::max(viewer.numframes - 1, 0), viewer.framespertick);
+  return true;
+}
+
+// Scene units per pixel.
+double pixelSize( const Viewer& viewer )
+{
+  return 2.0*viewer.appearance.size/std::min(viewer.width, viewer.height);
+}
+
+// The part of the scene in the window.
+AABB viewBox( const Viewer& viewer )
+{
+  const double halfpixel = 0.5*pixelSize(viewer);
+  const Vector2s center( viewer.appearance.cx, viewer.appearance.cy );
+  const Vector2s half( halfpixel*viewer.width, halfpixel*viewer.height );
+  AABB view = { center - half, center + half };
+  return view;
+}
+
+void setProjection( const Viewer& viewer )
+{
+  const AABB view = viewBox(viewer);
+  glMatrixMode(GL_PROJECTION);
+  glLoadIdentity();
+  glOrtho(view.min.x(), view.max.x(), view.min.y(), view.max.y(), -1.0, 1.0);
+  glMatrixMode(GL_MODELVIEW);
+  glLoadIdentity();
+}
+
+void drawHalfplanes( const Viewer& viewer, const AABB& view )
+{
+  const Vector2s center = 0.5*( view.min + view.max );
+  const double halfdiagonal = 0.5*( view.max - view.min ).norm();
+  // Long enough to cross the view from anywhere on it.
+  const double extent = 2.0*halfdiagonal;
+  glBegin(GL_LINES);
+  for( int h = 0; h < viewer.scene.getNumHalfplanes(); ++h )
+  {
+    const std::pair<VectorXs,VectorXs>& halfplane = viewer.scene.getHalfplane(h);
+    Vector2s n = halfplane.second.segment<2>(0);
+    if( n.norm() == 0.0 ) continue;
+    n.normalize();
+    // The boundary's point nearest the view's center.
+    const Vector2s p = center - n*n.dot(center - halfplane.first.segment<2>(0));
+    if( ( p - center ).norm() > halfdiagonal ) continue;
+    const Vector2s t( -n.y(), n.x() );
+    const SceneColor& color = viewer.appearance.halfplanecolors[h];
+    glColor3f(color.r, color.g, color.b);
+    glVertex2d(p.x() - extent*t.x(), p.y() - extent*t.y());
+    glVertex2d(p.x() + extent*t.x(), p.y() + extent*t.y());
+  }
+  glEnd();
+}
+
+// Gathers the edges and particles in view, the particles split into
+// circles and points.
+void cull( Viewer& viewer, const AABB& view )
+{
+  viewer.edges.clear();
+  for( int e = 0; e < viewer.scene.getNumEdges(); ++e )
+  {
+    const std::pair<int,int>& edge = viewer.scene.getEdge(e);
+    const float* a = &viewer.positions[2*edge.first];
+    const float* b = &viewer.positions[2*edge.second];
+    if( std::max(a[0], b[0]) < view.min.x() || std::min(a[0], b[0]) > view.max.x() ) continue;
+    if( std::max(a[1], b[1]) < view.min.y() || std::min(a[1], b[1]) > view.max.y() ) continue;
+    viewer.edges.push_back(edge.first);
+    viewer.edges.push_back(edge.second);
+  }
+
+  viewer.visible.clear();
+  viewer.grid.query(view, viewer.visible);
+  viewer.circles.clear();
+  viewer.points.clear();
+  const float pointradius = (float) ( POINT_RADIUS_PIXELS*pixelSize(viewer) );
+  for( std::vector<int>::size_type k = 0; k < viewer.visible.size(); ++k )
+  {
+    const int i = viewer.visible[k];
+    const float* x = &viewer.positions[2*i];
+    const float* color = &viewer.colors[3*i];
+    if( viewer.radii[i] < pointradius )
+    {
+      viewer.points.insert(viewer.points.end(), x, x + 2);
+      viewer.points.insert(viewer.points.end(), color, color + 3);
+      continue;
+    }
+    viewer.circles.insert(viewer.circles.end(), x, x + 2);
+    viewer.circles.push_back(viewer.radii[i]);
+    viewer.circles.insert(viewer.circles.end(), color, color + 3);
+  }
+}
+
+void display()
+{
+  Viewer& viewer = g_viewer;
+  glClearColor(viewer.appearance.background.r, viewer.appearance.background.g, viewer.appearance.background.b, 1.0f);
+  glClear(GL_COLOR_BUFFER_BIT);
+  setProjection(viewer);
+
+  const AABB view = viewBox(viewer);
+  drawHalfplanes(viewer, view);
+  cull(viewer, view);
+
+  // The edges, one line batch over the particles' positions.
+  if( !viewer.edges.empty() )
+  {
+    streamBuffer(GL_ELEMENT_ARRAY_BUFFER, viewer.edgebuffer, viewer.edges);
+    glColor3f(viewer.appearance.edgecolor.r, viewer.appearance.edgecolor.g, viewer.appearance.edgecolor.b);
+    glBindBuffer(GL_ARRAY_BUFFER, viewer.positionbuffer);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, viewer.edgebuffer);
+    glEnableClientState(GL_VERTEX_ARRAY);
+    glVertexPointer(2, GL_FLOAT, 0, NULL);
+    glDrawElements(GL_LINES, (GLsizei) viewer.edges.size(), GL_UNSIGNED_INT, NULL);
+    glDisableClientState(GL_VERTEX_ARRAY);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+  }
+
+  // The paths, one strip each.
+  if( viewer.paths.getNumPaths() > 0 )
+  {
+    glBindBuffer(GL_ARRAY_BUFFER, viewer.pathbuffer);
+    glEnableClientState(GL_VERTEX_ARRAY);
+    glVertexPointer(2, GL_FLOAT, 0, NULL);
+    glBindBuffer(GL_ARRAY_BUFFER, viewer.pathcolorbuffer);
+    glEnableClientState(GL_COLOR_ARRAY);
+    glColorPointer(3, GL_FLOAT, 0, NULL);
+    glMultiDrawArrays(GL_LINE_STRIP, &viewer.paths.getFirsts()[0], &viewer.paths.getCounts()[0], viewer.paths.getNumPaths());
+    glDisableClientState(GL_COLOR_ARRAY);
+    glDisableClientState(GL_VERTEX_ARRAY);
+  }
+
+  // The particles too small for a circle, one point each.
+  if( !viewer.points.empty() )
+  {
+    const GLsizei stride = 5*sizeof(float);
+    streamBuffer(GL_ARRAY_BUFFER, viewer.pointbuffer, viewer.points);
+    glBindBuffer(GL_ARRAY_BUFFER, viewer.pointbuffer);
+    glEnableClientState(GL_VERTEX_ARRAY);
+    glEnableClientState(GL_COLOR_ARRAY);
+    glVertexPointer(2, GL_FLOAT, stride, NULL);
+    glColorPointer(3, GL_FLOAT, stride, (const GLvoid*) ( 2*sizeof(float) ));
+    glPointSize(1.0f);
+    glDrawArrays(GL_POINTS, 0, (GLsizei) viewer.points.size()/5);
+    glDisableClientState(GL_COLOR_ARRAY);
+    glDisableClientState(GL_VERTEX_ARRAY);
+  }
+
+  // The other particles, one instance of the quad each.
+  if( !viewer.circles.empty() )
+  {
+    const GLsizei stride = 6*sizeof(float);
+    streamBuffer(GL_ARRAY_BUFFER, viewer.circlebuffer, viewer.circles);
+    glUseProgram(viewer.program);
+    glBindBuffer(GL_ARRAY_BUFFER, viewer.quadbuffer);
+    glEnableVertexAttribArray(viewer.corner);
+    glVertexAttribPointer(viewer.corner, 2, GL_FLOAT, GL_FALSE, 0, NULL);
+    glBindBuffer(GL_ARRAY_BUFFER, viewer.circlebuffer);
+    glEnableVertexAttribArray(viewer.center);
+    glVertexAttribPointer(viewer.center, 2, GL_FLOAT, GL_FALSE, stride, NULL);
+    glVertexAttribDivisor(viewer.center, 1);
+    glEnableVertexAttribArray(viewer.radius);
+    glVertexAttribPointer(viewer.radius, 1, GL_FLOAT, GL_FALSE, stride, (const GLvoid*) ( 2*sizeof(float) ));
+    glVertexAttribDivisor(viewer.radius, 1);
+    glEnableVertexAttribArray(viewer.color);
+    glVertexAttribPointer(viewer.color, 3, GL_FLOAT, GL_FALSE, stride, (const GLvoid*) ( 3*sizeof(float) ));
+    glVertexAttribDivisor(viewer.color, 1);
+
+    glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, (GLsizei) viewer.circles.size()/6);
+
+    glVertexAttribDivisor(viewer.center, 0);
+    glVertexAttribDivisor(viewer.radius, 0);
+    glVertexAttribDivisor(viewer.color, 0);
+    glDisableVertexAttribArray(viewer.corner);
+    glDisableVertexAttribArray(viewer.center);
+    glDisableVertexAttribArray(viewer.radius);
+    glDisableVertexAttribArray(viewer.color);
+    glUseProgram(0);
+  }
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+  glutSwapBuffers();
+}
+
+void reshape( int width, int height )
+{
+  g_viewer.width = std::max(width, 1);
+  g_viewer.height = std::max(height, 1);
+  glViewport(0, 0, g_viewer.width, g_viewer.height);
+}
+
+void showFrame( int frame )
+{
+  frame = std::max(0, std::min(frame, g_viewer.numframes - 1));
+  if( frame != g_viewer.frame && !loadFrame(g_viewer, frame) ) exit(1);
+  glutPostRedisplay();
+}
+
+void pan( double dx, double dy )
+{
+  const double scale = pixelSize(g_viewer);
+  g_viewer.appearance.cx -= scale*dx;
+  g_viewer.appearance.cy += scale*dy;
+  glutPostRedisplay();
+}
+
+// Shows the simulation's latest step, if it has taken one since the last.
+void liveTick( int )
+{
+  TripleBuffer<LiveSimulation::Frame>& frames = g_viewer.live->getFrames();
+  if( frames.update() )
+  {
+    g_viewer.positions = frames.front().positions;
+    updatePositions(g_viewer, frames.front().step);
+    setTitle("step", frames.front().step, g_viewer.live->getNumSteps());
+    glutPostRedisplay();
+  }
+  glutTimerFunc(g_viewer.framemilliseconds, liveTick, 0);
+}
+
+void quit()
+{
+  // Stops the stepping thread before the scene goes.
+  delete g_viewer.live;
+  g_viewer.live = NULL;
+  exit(0);
+}
+
+void tick( int )
+{
+  if( !g_viewer.playing ) return;
+  if( g_viewer.frame + 1 >= g_viewer.numframes )
+  {
+    g_viewer.playing = false;
+    return;
+  }
+  showFrame(g_viewer.frame + g_viewer.framespertick);
+  glutTimerFunc(g_viewer.framemilliseconds, tick, 0);
+}
+
+void setFramesPerTick( int framespertick )
+{
+  g_viewer.framespertick = std::max(1, std::min(framespertick, MAX_FRAMES_PER_TICK));
+  setTitle("frame", g_viewer.frame, std::max(g_viewer.numframes - 1, 0), g_viewer.framespertick);
+}
+
+void keyboard( unsigned char key, int, int )
+{
+  if( g_viewer.live != NULL )
+  {
+    if( key == ' ' ) g_viewer.live->setPaused(!g_viewer.live->isPaused());
+    if( key == '.' || key == ',' || key == 'r' || key == '<' || key == '>' || ( key >= '0' && key <= '9' ) ) return;
+  }
+
+  switch( key )
+  {
+    case ' ':
+      if( g_viewer.live != NULL ) break;
+      g_viewer.playing = !g_viewer.playing;
+      if( g_viewer.playing ) glutTimerFunc(g_viewer.framemilliseconds, tick, 0);
+      break;
+    case '.': showFrame(g_viewer.frame + 1); break;
+    case ',': showFrame(g_viewer.frame - 1); break;
+    case 'r': showFrame(0); break;
+    case '0': showFrame(g_viewer.numframes - 1); break;
+    case '1': case '2': case '3': case '4': case '5': case '6': case '7': case '8': case '9':
+      showFrame((int) ( (long long) ( key - '0' )*g_viewer.numframes/10 ));
+      break;
+    case '>': setFramesPerTick(2*g_viewer.framespertick); break;
+    case '<': setFramesPerTick(g_viewer.framespertick/2); break;
+    case '+': case '=': g_viewer.appearance.size /= ZOOM_FACTOR; glutPostRedisplay(); break;
+    case '-': g_viewer.appearance.size *= ZOOM_FACTOR; glutPostRedisplay(); break;
+    case 'q': case 27: quit();
+  }
+}
+
+void special( int key, int, int )
+{
+  switch( key )
+  {
+    case GLUT_KEY_LEFT: pan(PAN_PIXELS, 0.0); break;
+    case GLUT_KEY_RIGHT: pan(-PAN_PIXELS, 0.0); break;
+    case GLUT_KEY_UP: pan(0.0, PAN_PIXELS); break;
+    case GLUT_KEY_DOWN: pan(0.0, -PAN_PIXELS); break;
+  }
+}
+
+void mouse( int button, int state, int x, int y )
+{
+  if( button != GLUT_LEFT_BUTTON ) return;
+  g_viewer.dragging = state == GLUT_DOWN;
+  g_viewer.dragx = x;
+  g_viewer.dragy = y;
+}
+
+void motion( int x, int y )
+{
+  if( !g_viewer.dragging ) return;
+  pan(x - g_viewer.dragx, y - g_viewer.dragy);
+  g_viewer.dragx = x;
+  g_viewer.dragy = y;
+}
+
+}
+
+int main( int argc, char** argv )
+{
+  glutInit(&argc, argv);
+
+  std::string scenefile, trajectoryfile;
+  std::vector<std::string> overrides;
+  double fps;
+  bool live;
+  int pathstride;
+  try
+  {
+    TCLAP::CmdLine cmd("Plays back a FOSSSim trajectory, drawing every frame in one batch.", ' ', "1.0");
+    TCLAP::ValueArg<std::string> sceneArg("s", "scene", "Scene the trajectory was run from; an xml scene file, or a binary .fsb one", true, "", "string", cmd);
+    TCLAP::ValueArg<std::string> trajectoryArg("t", "trajectory", "Binary trajectory written with -o; without one the scene's initial state is shown", false, "", "string", cmd);
+    TCLAP::ValueArg<double> fpsArg("f", "fps", "Frames played per second", false, 60.0, "scalar", cmd);
+    TCLAP::SwitchArg liveArg("l", "live", "Steps the scene on a thread of its own and shows the latest step, instead of playing a trajectory", cmd, false);
+    TCLAP::ValueArg<int> pathstrideArg("k", "pathstride", "Frames between the points of a particle path; 0 picks enough to keep paths short", false, 0, "integer", cmd);
+    TCLAP::MultiArg<std::string> setArg("", "set", "Replaces an attribute of the scene once it is loaded, such as integrator.dt=0.002; may be given more than once", false, "element.attribute=value", cmd);
+    cmd.parse(argc, argv);
+    scenefile = sceneArg.getValue();
+    trajectoryfile = trajectoryArg.getValue();
+    fps = fpsArg.getValue();
+    live = liveArg.getValue();
+    pathstride = pathstrideArg.getValue();
+    overrides = setArg.getValue();
+  }
+  catch( TCLAP::ArgException& e )
+  {
+    std::cerr << "error: " << e.what() << std::endl;
+    return 1;
+  }
+
+  Viewer& viewer = g_viewer;
+  std::vector<SceneRecord> records;
+  if( !loadScene(scenefile, viewer.scene, records) || !applySceneOverrides(overrides, records) ) return 1;
+  readSceneAppearance(records, viewer.scene, viewer.appearance);
+  viewer.paths.reset(viewer.appearance.paths, frameTime(records), std::max(pathstride, 0));
+
+  viewer.live = NULL;
+  if( live )
+  {
+    PenaltySceneSettings settings;
+    if( !trajectoryfile.empty() )
+    {
+      complain("A trajectory cannot be played --live.");
+      return 1;
+    }
+    if( !readPenaltySceneSettings(records, viewer.scene.getNumEdges(), settings) ) return 1;
+    broadphase::tuneForScene(viewer.scene, scenefile);
+    viewer.live = new LiveSimulation(viewer.scene, settings);
+  }
+
+  const int numparticles = viewer.scene.getNumParticles();
+  viewer.numframes = 0;
+  if( !trajectoryfile.empty() )
+  {
+    if( !viewer.reader.open(trajectoryfile, numparticles) )
+    {
+      complain("Failed to open " + trajectoryfile + ".");
+      return 1;
+    }
+    viewer.numframes = viewer.reader.getNumFrames();
+    for( int f = 0; f < viewer.numframes; ++f )
+    {
+      if( viewer.reader.getNumParticles(f) == numparticles ) continue;
+      complain(trajectoryfile + " does not have the scene's particles in every frame.");
+      return 1;
+    }
+  }
+  viewer.x = viewer.scene.getX();
+  viewer.v = viewer.scene.getV();
+  viewer.playing = false;
+  viewer.framespertick = 1;
+  viewer.framemilliseconds = std::max(1, (int) ( 1000.0/std::max(fps, 1.0e-3) ));
+  viewer.width = 512;
+  viewer.height = 512;
+  viewer.dragging = false;
+
+  glutInitDisplayMode(GLUT_DOUBLE | GLUT_RGBA);
+  glutInitWindowSize(viewer.width, viewer.height);
+  glutCreateWindow("FOSSSimViewer");
+  if( !hasInstancing() )
+  {
+    complain("The viewer needs OpenGL 3.3 or ARB_instanced_arrays.");
+    return 1;
+  }
+  createBuffers(viewer);
+  viewer.frame = -1;
+  if( !loadFrame(viewer, 0) ) return 1;
+
+  glutDisplayFunc(display);
+  glutReshapeFunc(reshape);
+  glutKeyboardFunc(keyboard);
+  glutSpecialFunc(special);
+  glutMouseFunc(mouse);
+  glutMotionFunc(motion);
+  if( viewer.live != NULL )
+  {
+    viewer.live->start();
+    glutTimerFunc(viewer.framemilliseconds, liveTick, 0);
+  }
+  glutMainLoop();
+  return 0;
+}
@@ -0,0 +1,117 @@
+#include "LiveSimulation.h"
+
+#include <chrono>
+#include <cmath>
+
+#include "FOSSSim/DetectorRegistry.h"
+#include "FOSSSim/PeriodicDomain.h"
+
+namespace
+{
+
+// How often a paused simulation looks to see whether it has been resumed.
+const int PAUSED_POLL_MILLISECONDS = 10;
+
+}
+
+LiveSimulation::LiveSimulation( const TwoDScene& scene, const PenaltySceneSettings& settings )
+: m_scene()
+, m_settings(settings)
+, m_detector(detectors::createDetector(settings.detector))
+// As many steps as the base library takes.
+, m_numsteps((int) std::ceil(settings.duration/settings.dt - 1.0e-9))
+, m_gradE()
+, m_frames()
+, m_paused(false)
+, m_stopping(false)
+, m_thread()
+{
+  // TwoDScene's copy constructor leaves out the radii, edges and halfplanes.
+  m_scene.resizeSystem(scene.getNumParticles());
+  m_scene.getX() = scene.getX();
+  m_scene.getV() = scene.getV();
+  m_scene.getM() = scene.getM();
+  for( int i = 0; i < scene.getNumParticles(); ++i )
+  {
+    m_scene.setFixed(i, scene.isFixed(i));
+    m_scene.setRadius(i, scene.getRadius(i));
+  }
+  for( int e = 0; e < scene.getNumEdges(); ++e ) m_scene.insertEdge(scene.getEdge(e), scene.getEdgeRadii()[e]);
+  for( int h = 0; h < scene.getNumHalfplanes(); ++h ) m_scene.insertHalfplane(scene.getHalfplane(h));
+
+  insertPenaltySceneForces(m_scene, *m_detector, m_settings);
+}
+
+LiveSimulation::~LiveSimulation()
+{
+  m_stopping = true;
+  if( m_thread.joinable() ) m_thread.join();
+  periodic::clearDomain(m_scene);
+}
+
+void LiveSimulation::start()
+{
+  publish(0);
+  m_thread = std::thread(&LiveSimulation::run, this);
+}
+
+void LiveSimulation::setPaused( bool paused )
+{
+  m_paused = paused;
+}
+
+bool LiveSimulation::isPaused() const
+{
+  return m_paused;
+}
+
+int LiveSimulation::getNumSteps() const
+{
+  return m_numsteps;
+}
+
+TripleBuffer<LiveSimulation::Frame>& LiveSimulation::getFrames()
+{
+  return m_frames;
+}
+
+void LiveSimulation::run()
+{
+  typedef std::chrono::steady_clock Clock;
+  const bool capped = m_settings.maxsimfreq > 0.0;
+  const Clock::duration period = capped ? std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0/m_settings.maxsimfreq)) : Clock::duration::zero();
+  Clock::time_point next = Clock::now();
+
+  for( int s = 1; s <= m_numsteps && !m_stopping; )
+  {
+    if( m_paused )
+    {
+      std::this_thread::sleep_for(std::chrono::milliseconds(PAUSED_POLL_MILLISECONDS));
+      next = Clock::now();
+      continue;
+    }
+    if( capped )
+    {
+      std::this_thread::sleep_until(next);
+      next += period;
+    }
+    step();
+    publish(s);
+    ++s;
+  }
+}
+
+void LiveSimulation::step()
+{
+  stepPenaltyScene(m_scene, m_settings, m_gradE);
+}
+
+void LiveSimulation::publish( int step )
+{
+  Frame& frame = m_frames.back();
+  const VectorXs& x = m_scene.getX();
+  frame.positions.resize(x.size());
+  for( int k = 0; k < x.size(); ++k ) frame.positions[k] = (float) x(k);
+  frame.step = step;
+  m_frames.publish();
+}
@@ -0,0 +1,70 @@
+#ifndef __LIVE_SIMULATION_H__
+#define __LIVE_SIMULATION_H__
+
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "FOSSSim/CollisionDetector.h"
+#include "FOSSSim/PenaltySceneSettings.h"
+#include "FOSSSim/TripleBuffer.h"
+#include "FOSSSim/TwoDScene.h"
+
+// A penalty-contact scene stepped on a thread of its own, for FOSSSimViewer
+// to draw while it runs. After every step the positions go into a triple
+// buffer, from which the viewer takes the latest whenever it draws, so a
+// slow display never holds up the stepping nor the stepping the display.
+// Steps are forward-backward Euler, as SemiImplicitEuler takes them, for
+// the scene's duration, and no faster than its maxsimfreq if it has one.
+class LiveSimulation
+{
+public:
+  struct Frame
+  {
+    // x of every particle, as floats for the vertex buffer.
+    std::vector<float> positions;
+    int step;
+  };
+
+  // Takes a copy of scene. Nothing is stepped until start.
+  LiveSimulation( const TwoDScene& scene, const PenaltySceneSettings& settings );
+
+  // Stops the stepping thread.
+  ~LiveSimulation();
+
+  void start();
+
+  // Pausing stops stepping after the step under way.
+  void setPaused( bool paused );
+  bool isPaused() const;
+
+  int getNumSteps() const;
+
+  // Read from the viewer's thread only.
+  TripleBuffer<Frame>& getFrames();
+
+private:
+  LiveSimulation( const LiveSimulation& );
+  LiveSimulation& operator=( const LiveSimulation& );
+
+  void run();
+
+  void step();
+
+  void publish( int step );
+
+  TwoDScene m_scene;
+  PenaltySceneSettings m_settings;
+  std::unique_ptr<CollisionDetector> m_detector;
+  int m_numsteps;
+
+  VectorXs m_gradE;
+  TripleBuffer<Frame> m_frames;
+
+  std::atomic<bool> m_paused;
+  std::atomic<bool> m_stopping;
+  std::thread m_thread;
+};
+
+#endif
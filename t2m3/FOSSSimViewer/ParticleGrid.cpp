@@ -0,0 +1,104 @@
+#include "ParticleGrid.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+
+// Particles per cell the grid is sized for.
+const double PARTICLES_PER_CELL = 4.0;
+
+// Cells along a side at most, whatever the spread of the particles.
+const int MAX_CELLS_PER_SIDE = 4096;
+
+}
+
+ParticleGrid::ParticleGrid()
+: m_positions(NULL)
+, m_radii(NULL)
+, m_xmin(0.0)
+, m_ymin(0.0)
+, m_invcellsize(1.0)
+, m_nx(1)
+, m_ny(1)
+, m_maxradius(0.0f)
+, m_start(2, 0)
+, m_particles()
+{}
+
+void ParticleGrid::build( const std::vector<float>& positions, const std::vector<float>& radii )
+{
+  m_positions = &positions;
+  m_radii = &radii;
+  const int numparticles = (int) radii.size();
+
+  double xmax = 0.0, ymax = 0.0;
+  m_xmin = m_ymin = 0.0;
+  m_maxradius = 0.0f;
+  for( int p = 0; p < numparticles; ++p )
+  {
+    const double x = positions[2*p];
+    const double y = positions[2*p+1];
+    if( p == 0 || x < m_xmin ) m_xmin = x;
+    if( p == 0 || y < m_ymin ) m_ymin = y;
+    if( p == 0 || x > xmax ) xmax = x;
+    if( p == 0 || y > ymax ) ymax = y;
+    m_maxradius = std::max(m_maxradius, radii[p]);
+  }
+
+  const double width = std::max(xmax - m_xmin, 1.0e-9);
+  const double height = std::max(ymax - m_ymin, 1.0e-9);
+  double cellsize = std::sqrt(PARTICLES_PER_CELL*width*height/std::max(numparticles, 1));
+  cellsize = std::max(cellsize, std::max(width, height)/MAX_CELLS_PER_SIDE);
+  m_invcellsize = 1.0/cellsize;
+  m_nx = std::max(1, std::min((int) std::ceil(width*m_invcellsize), MAX_CELLS_PER_SIDE));
+  m_ny = std::max(1, std::min((int) std::ceil(height*m_invcellsize), MAX_CELLS_PER_SIDE));
+
+  m_start.assign(m_nx*m_ny + 1, 0);
+  std::vector<int> cells(numparticles);
+  for( int p = 0; p < numparticles; ++p )
+  {
+    int i, j;
+    cellOf(positions[2*p], positions[2*p+1], i, j);
+    cells[p] = i + m_nx*j;
+    ++m_start[cells[p] + 1];
+  }
+  for( int c = 0; c < m_nx*m_ny; ++c ) m_start[c+1] += m_start[c];
+  m_particles.resize(numparticles);
+  std::vector<int> next(m_start.begin(), m_start.end() - 1);
+  for( int p = 0; p < numparticles; ++p ) m_particles[next[cells[p]]++] = p;
+}
+
+void ParticleGrid::query( const AABB& view, std::vector<int>& visible ) const
+{
+  if( m_radii == NULL || m_particles.empty() ) return;
+  // A particle overlaps the view if its center is within its radius of it,
+  // and its center is in its cell.
+  int imin, jmin, imax, jmax;
+  cellOf(view.min.x() - m_maxradius, view.min.y() - m_maxradius, imin, jmin);
+  cellOf(view.max.x() + m_maxradius, view.max.y() + m_maxradius, imax, jmax);
+  const std::vector<float>& positions = *m_positions;
+  const std::vector<float>& radii = *m_radii;
+  for( int j = jmin; j <= jmax; ++j )
+    for( int i = imin; i <= imax; ++i )
+    {
+      const int c = i + m_nx*j;
+      for( int k = m_start[c]; k < m_start[c+1]; ++k )
+      {
+        const int p = m_particles[k];
+        const float r = radii[p];
+        if( positions[2*p] + r < view.min.x() || positions[2*p] - r > view.max.x() ) continue;
+        if( positions[2*p+1] + r < view.min.y() || positions[2*p+1] - r > view.max.y() ) continue;
+        visible.push_back(p);
+      }
+    }
+}
+
+void ParticleGrid::cellOf( double x, double y, int& i, int& j ) const
+{
+  // Clamped before the conversion, as a view far off the scene would
+  // overflow an int.
+  i = (int) std::max(0.0, std::min(std::floor(( x - m_xmin )*m_invcellsize), m_nx - 1.0));
+  j = (int) std::max(0.0, std::min(std::floor(( y - m_ymin )*m_invcellsize), m_ny - 1.0));
+}
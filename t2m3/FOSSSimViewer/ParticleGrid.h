@@ -0,0 +1,39 @@
+#ifndef __PARTICLE_GRID_H__
+#define __PARTICLE_GRID_H__
+
+#include <vector>
+
+#include "FOSSSim/BroadPhase.h"
+
+// The particles of one frame bucketed into a uniform grid over their
+// bounds, so that the viewer finds the ones in view by visiting the cells
+// the view overlaps rather than every particle. Rebuilt for every frame, by
+// a counting sort over about four particles per cell.
+class ParticleGrid
+{
+public:
+  ParticleGrid();
+
+  // positions holds x and y of each particle, radii its radius.
+  void build( const std::vector<float>& positions, const std::vector<float>& radii );
+
+  // Appends to visible, in no particular order, every particle whose box
+  // overlaps view.
+  void query( const AABB& view, std::vector<int>& visible ) const;
+
+private:
+  void cellOf( double x, double y, int& i, int& j ) const;
+
+  const std::vector<float>* m_positions;
+  const std::vector<float>* m_radii;
+  double m_xmin, m_ymin;
+  double m_invcellsize;
+  int m_nx, m_ny;
+  float m_maxradius;
+  // The particles of cell i + m_nx*j are m_particles[m_start[c]], ... up to
+  // m_start[c+1].
+  std::vector<int> m_start;
+  std::vector<int> m_particles;
+};
+
+#endif
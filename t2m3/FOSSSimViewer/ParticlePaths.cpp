@@ -0,0 +1,125 @@
+#include "ParticlePaths.h"
+
+#include <algorithm>
+#include <cmath>
+
+ParticlePaths::ParticlePaths()
+: m_particles()
+, m_capacities()
+, m_bases()
+, m_heads()
+, m_vertices()
+, m_colors()
+, m_firsts()
+, m_counts()
+, m_written()
+, m_stride(1)
+, m_lastframe(-1)
+{}
+
+void ParticlePaths::reset( const std::vector<ScenePath>& paths, double framedt, int stride )
+{
+  const int numpaths = (int) paths.size();
+  // A path of duration spans this many frames.
+  std::vector<double> frames(numpaths);
+  double longest = 0.0;
+  for( int p = 0; p < numpaths; ++p )
+  {
+    frames[p] = framedt > 0.0 ? paths[p].duration/framedt : 1.0;
+    longest = std::max(longest, frames[p]);
+  }
+  m_stride = stride > 0 ? stride : std::max(1, (int) std::ceil(longest/MAX_POINTS - 1.0e-9));
+
+  m_particles.resize(numpaths);
+  m_capacities.resize(numpaths);
+  m_bases.resize(numpaths);
+  int numvertices = 0;
+  for( int p = 0; p < numpaths; ++p )
+  {
+    m_particles[p] = paths[p].particle;
+    // One more point than the frames span, for both ends.
+    m_capacities[p] = std::max(2, (int) std::ceil(frames[p]/m_stride - 1.0e-9) + 1);
+    m_bases[p] = numvertices;
+    numvertices += 2*m_capacities[p];
+  }
+  m_vertices.assign(2*numvertices, 0.0f);
+  m_colors.resize(3*numvertices);
+  for( int p = 0; p < numpaths; ++p )
+    for( int k = m_bases[p]; k < m_bases[p] + 2*m_capacities[p]; ++k )
+    {
+      m_colors[3*k] = paths[p].color.r;
+      m_colors[3*k+1] = paths[p].color.g;
+      m_colors[3*k+2] = paths[p].color.b;
+    }
+  clear();
+}
+
+void ParticlePaths::record( const std::vector<float>& positions, int frame )
+{
+  m_written.clear();
+  if( frame < m_lastframe ) clear();
+  if( m_lastframe >= 0 && frame - m_lastframe < m_stride ) return;
+  m_lastframe = frame;
+
+  for( int p = 0; p < getNumPaths(); ++p )
+  {
+    const int capacity = m_capacities[p];
+    const int slot = m_heads[p];
+    for( int copy = 0; copy < 2; ++copy )
+    {
+      const int k = m_bases[p] + slot + copy*capacity;
+      m_vertices[2*k] = positions[2*m_particles[p]];
+      m_vertices[2*k+1] = positions[2*m_particles[p]+1];
+      m_written.push_back(k);
+    }
+    m_heads[p] = ( slot + 1 )%capacity;
+    m_counts[p] = std::min(m_counts[p] + 1, capacity);
+    // Oldest first: the slot after the newest once the ring is full.
+    m_firsts[p] = m_bases[p] + ( m_counts[p] < capacity ? 0 : m_heads[p] );
+  }
+}
+
+void ParticlePaths::clear()
+{
+  const int numpaths = getNumPaths();
+  m_heads.assign(numpaths, 0);
+  m_counts.assign(numpaths, 0);
+  m_firsts = m_bases;
+  m_written.clear();
+  m_lastframe = -1;
+}
+
+int ParticlePaths::getStride() const
+{
+  return m_stride;
+}
+
+int ParticlePaths::getNumPaths() const
+{
+  return (int) m_particles.size();
+}
+
+const std::vector<float>& ParticlePaths::getVertices() const
+{
+  return m_vertices;
+}
+
+const std::vector<float>& ParticlePaths::getColors() const
+{
+  return m_colors;
+}
+
+const std::vector<int>& ParticlePaths::getFirsts() const
+{
+  return m_firsts;
+}
+
+const std::vector<int>& ParticlePaths::getCounts() const
+{
+  return m_counts;
+}
+
+const std::vector<int>& ParticlePaths::getWritten() const
+{
+  return m_written;
+}
@@ -0,0 +1,65 @@
+#ifndef __PARTICLE_PATHS_H__
+#define __PARTICLE_PATHS_H__
+
+#include <vector>
+
+#include "FOSSSim/SceneAppearance.h"
+
+// The recent positions of the scene's <particlepath> particles, for the
+// viewer to draw as one batch of line strips. Each path keeps a fixed
+// number of points in a ring, so a run of any length costs the same memory
+// and the same time to draw. A point goes in every stride-th frame, the
+// decimation, and a path holds its duration's worth of them.
+//
+// Every ring is stored twice over, each point written at its slot and again
+// at its slot plus the capacity, so that the points of a path are always
+// one contiguous run of vertices, oldest first, whichever slot is oldest.
+class ParticlePaths
+{
+public:
+  // Without a stride asked for, points are taken every as many frames as
+  // keeps each path within about this many.
+  static const int MAX_POINTS = 4096;
+
+  ParticlePaths();
+
+  // framedt is the time between frames. A stride of 0 picks the smallest
+  // that keeps every path within MAX_POINTS points.
+  void reset( const std::vector<ScenePath>& paths, double framedt, int stride );
+
+  // Adds positions of frame to the paths, if stride frames have passed since
+  // the last one added. A frame before the last one starts the paths over.
+  void record( const std::vector<float>& positions, int frame );
+
+  void clear();
+
+  int getStride() const;
+  int getNumPaths() const;
+
+  // x and y of every vertex, rings one after the other, and their colours.
+  const std::vector<float>& getVertices() const;
+  const std::vector<float>& getColors() const;
+
+  // The first vertex and the number of vertices of each path's strip.
+  const std::vector<int>& getFirsts() const;
+  const std::vector<int>& getCounts() const;
+
+  // The vertices the last record wrote, for the viewer to upload.
+  const std::vector<int>& getWritten() const;
+
+private:
+  std::vector<int> m_particles;
+  std::vector<int> m_capacities;
+  // The first vertex of each path's doubled ring, and its next slot.
+  std::vector<int> m_bases;
+  std::vector<int> m_heads;
+  std::vector<float> m_vertices;
+  std::vector<float> m_colors;
+  std::vector<int> m_firsts;
+  std::vector<int> m_counts;
+  std::vector<int> m_written;
+  int m_stride;
+  int m_lastframe;
+};
+
+#endif
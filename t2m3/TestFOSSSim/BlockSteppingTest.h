@@ -0,0 +1,66 @@
+#ifndef __BLOCK_STEPPING_TEST_H__
+#define __BLOCK_STEPPING_TEST_H__
+
+#include <gtest/gtest.h>
+
+#include "FOSSSim/BlockStepping.h"
+
+// A particle moving 8 radii in a step of a row at rest needs 16 substeps of
+// half a radius each; its contacts down the row take one level fewer each,
+// down to the single step of the rest, and the fixed one at the end stays
+// there.
+TEST(BlockStepping, BinsBySpeedAndBalancesAcrossContacts)
+{
+  const int n = 6;
+  TwoDScene scene;
+  scene.resizeSystem(n);
+  for( int i = 0; i < n; ++i )
+  {
+    scene.setPosition(i, Vector2s(0.2*i, 0.0));
+    scene.setMass(i, 1.0);
+    scene.setRadius(i, 0.1);
+  }
+  scene.setVelocity(0, Vector2s(8.0, 0.0));
+  scene.setFixed(n - 1, true);
+  std::vector<std::pair<int,int> > contacts;
+  for( int i = 0; i + 1 < n; ++i ) contacts.push_back(std::make_pair(i, i + 1));
+  const VectorXs F = VectorXs::Zero(2*n);
+
+  BlockSchedule schedule;
+  schedule.assign(scene, F, 0.1, 0.5, 6, contacts);
+  ASSERT_EQ(n, schedule.getNumParticles());
+  EXPECT_EQ(4, schedule.getFinestLevel());
+  const int levels[n] = { 4, 3, 2, 1, 0, 0 };
+  for( int i = 0; i < n; ++i ) EXPECT_EQ(levels[i], schedule.getLevel(i)) << "particle " << i;
+  EXPECT_EQ(16 + 8 + 4 + 2 + 1 + 1, schedule.countParticleSubsteps());
+
+  for( int s = 0; s < 16; ++s )
+  {
+    EXPECT_TRUE(schedule.startsSubstep(0, s));
+    EXPECT_EQ(s%4 == 0, schedule.startsSubstep(2, s)) << "substep " << s;
+    EXPECT_EQ(s == 0, schedule.startsSubstep(4, s)) << "substep " << s;
+  }
+
+  // The penalty force skips contacts among the particles a substep leaves
+  // out, and only records them while all are active.
+  blockstepping::activate(schedule, 2);
+  EXPECT_TRUE(blockstepping::isActive(0));
+  EXPECT_TRUE(blockstepping::isActive(1));
+  EXPECT_FALSE(blockstepping::isActive(2));
+  blockstepping::recordContact(0, 1);
+  blockstepping::activateAll();
+  EXPECT_TRUE(blockstepping::isActive(2));
+  blockstepping::recordContact(2, 3);
+  std::vector<std::pair<int,int> > recorded;
+  blockstepping::takeContacts(recorded);
+  ASSERT_EQ(1u, recorded.size());
+  EXPECT_EQ(std::make_pair(2, 3), recorded[0]);
+
+  // Capped at 2^3 substeps, the fast particle pulls its neighbours up less.
+  schedule.assign(scene, F, 0.1, 0.5, 3, contacts);
+  EXPECT_EQ(3, schedule.getFinestLevel());
+  EXPECT_EQ(2, schedule.getLevel(1));
+  EXPECT_EQ(0, schedule.getLevel(3));
+}
+
+#endif
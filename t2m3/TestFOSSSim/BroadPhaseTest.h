@@ -0,0 +1,386 @@
+#ifndef __BROAD_PHASE_TEST_H__
+#define __BROAD_PHASE_TEST_H__
+
+#include <gtest/gtest.h>
+#include <random>
+
+#include "TestUtilities.h"
+#include "FOSSSim/AABBTreeDetector.h"
+#include "FOSSSim/BroadPhaseTuning.h"
+#include "FOSSSim/ContestDetector.h"
+#include "FOSSSim/EdgeAdjacency.h"
+#include "FOSSSim/HierarchicalGridDetector.h"
+#include "FOSSSim/KineticSweepAndPruneDetector.h"
+#include "FOSSSim/SceneGenerator.h"
+#include "FOSSSim/SweepAndPruneDetector.h"
+
+// Every broad phase has to report exactly the pairs whose boxes overlap,
+// once each. Scenes up to this size are checked against testing every pair;
+// larger ones against each other, since all pairs would take minutes.
+const int BRUTE_FORCE_MAX_PARTICLES = 5000;
+
+// Compares the contest detector, sweep and prune and the AABB tree on one
+// configuration. The contest detector only takes static configurations.
+void expectSamePairs( const TwoDScene& scene, const VectorXs& qs, const VectorXs& qe, const std::string& what )
+{
+  SCOPED_TRACE(what);
+  testutils::PairCollector sap, tree, contest, reference;
+
+  SweepAndPruneDetector sapdetector;
+  sapdetector.performCollisionDetection(scene, qs, qe, sap);
+  EXPECT_EQ(0, sap.sort()) << "sweep and prune repeated pairs";
+
+  AABBTreeDetector treedetector;
+  treedetector.performCollisionDetection(scene, qs, qe, tree);
+  EXPECT_EQ(0, tree.sort()) << "the AABB tree repeated pairs";
+
+  testutils::PairCollector kinetic;
+  KineticSweepAndPruneDetector kineticdetector;
+  kineticdetector.performCollisionDetection(scene, qs, qe, kinetic);
+  EXPECT_EQ(0, kinetic.sort()) << "kinetic sweep and prune repeated pairs";
+
+  testutils::PairCollector hgrid;
+  HierarchicalGridDetector hgriddetector;
+  hgriddetector.performCollisionDetection(scene, qs, qe, hgrid);
+  EXPECT_EQ(0, hgrid.sort()) << "the hierarchical grid repeated pairs";
+
+  const bool static_configuration = ( qs - qe ).norm() == 0.0;
+  if( static_configuration )
+  {
+    ContestDetector contestdetector;
+    contestdetector.performCollisionDetection(scene, qs, qe, contest);
+    EXPECT_EQ(0, contest.sort()) << "the contest detector repeated pairs";
+  }
+
+  const testutils::PairCollector* expected = &sap;
+  if( scene.getNumParticles() <= BRUTE_FORCE_MAX_PARTICLES )
+  {
+    testutils::bruteForcePairs(scene, qs, qe, reference);
+    expected = &reference;
+    EXPECT_TRUE(sap.pppairs == expected->pppairs && sap.pepairs == expected->pepairs && sap.phpairs == expected->phpairs) << "sweep and prune";
+  }
+  EXPECT_TRUE(tree.pppairs == expected->pppairs && tree.pepairs == expected->pepairs && tree.phpairs == expected->phpairs) << "the AABB tree";
+  EXPECT_TRUE(kinetic.pppairs == expected->pppairs && kinetic.pepairs == expected->pepairs && kinetic.phpairs == expected->phpairs) << "kinetic sweep and prune";
+  EXPECT_TRUE(hgrid.pppairs == expected->pppairs && hgrid.pepairs == expected->pepairs && hgrid.phpairs == expected->phpairs) << "the hierarchical grid";
+  if( static_configuration )
+  {
+    EXPECT_TRUE(contest.pppairs == expected->pppairs && contest.pepairs == expected->pepairs && contest.phpairs == expected->phpairs) << "the contest detector";
+  }
+}
+
+void expectSamePairsInScene( const TwoDScene& scene, const std::string& name )
+{
+  const VectorXs& x = scene.getX();
+  expectSamePairs(scene, x, x, name + " as loaded");
+  const VectorXs perturbed = testutils::perturbedPositions(scene, 0.5, 1);
+  expectSamePairs(scene, perturbed, perturbed, name + " perturbed");
+  const VectorXs swept = x + 0.05*scene.getV();
+  expectSamePairs(scene, x, swept, name + " swept");
+}
+
+TEST(BroadPhase, MatchesReferenceOnAssetScenes)
+{
+  const std::vector<std::string> scenes = testutils::assetScenes();
+  ASSERT_FALSE(scenes.empty());
+  for( std::vector<std::string>::size_type s = 0; s < scenes.size(); ++s )
+  {
+    const TwoDScene& scene = testutils::loadScene(scenes[s]);
+    ASSERT_GT(scene.getNumParticles(), 0) << scenes[s];
+    expectSamePairsInScene(scene, scenes[s]);
+  }
+}
+
+TEST(BroadPhase, MatchesReferenceOnGeneratedScenes)
+{
+  SceneGeneratorOptions options;
+  options.numparticles = 4000;
+  options.numsprings = 6000;
+  options.minradius = 0.02;
+  options.maxradius = 0.05;
+  options.density = 0.3;
+  TwoDScene scene;
+  std::vector<SceneRecord> records;
+  GeneratedSprings springs;
+  ASSERT_TRUE(generateBoxScene(options, scene, records, springs));
+  expectSamePairsInScene(scene, "generated box");
+}
+
+// Tuning only changes how fast the broad phases are: with the least and most
+// of every parameter the calibration tries, and the calibration's own choice,
+// each has to find what testing every pair does.
+TEST(BroadPhase, TunedSettingsFindTheSamePairs)
+{
+  SceneGeneratorOptions options;
+  options.numparticles = 3000;
+  options.numsprings = 3000;
+  options.minradius = 0.01;
+  options.maxradius = 0.05;
+  options.density = 0.3;
+  TwoDScene scene;
+  std::vector<SceneRecord> records;
+  GeneratedSprings springs;
+  ASSERT_TRUE(generateBoxScene(options, scene, records, springs));
+
+  BroadPhaseTuning settings[3];
+  settings[0].cellscale = 0.5;
+  settings[0].sweepaxis = 1;
+  settings[0].rebuildratio = 1.1;
+  settings[1].cellscale = 3.0;
+  settings[1].rebuildratio = 3.0;
+  settings[2] = broadphase::calibrate(scene);
+  for( int k = 0; k < 3; ++k )
+  {
+    SCOPED_TRACE(k);
+    broadphase::setTuning(settings[k]);
+    const VectorXs perturbed = testutils::perturbedPositions(scene, 0.5, 2);
+    expectSamePairs(scene, perturbed, perturbed, "generated box");
+  }
+  broadphase::setTuning(BroadPhaseTuning());
+}
+
+// Counts the swaps a KineticSortedList reports and checks each is between
+// neighbours.
+class SwapCounter : public KineticSortedList::SwapCallback
+{
+public:
+  SwapCounter( const KineticSortedList& l ) : list(l), swaps(0) {}
+
+  virtual void swapped( int passing, int passed )
+  {
+    EXPECT_EQ(list.rank(passed) + 1, list.rank(passing));
+    ++swaps;
+  }
+
+  const KineticSortedList& list;
+  int swaps;
+};
+
+// Keys moving in straight lines pass each other at most once, so an update
+// swaps exactly the pairs whose order it reverses, and ends sorted.
+TEST(BroadPhase, KineticSortedListSwapsOncePerReversedPair)
+{
+  std::mt19937 generator(11);
+  std::uniform_real_distribution<scalar> unit(0.0, 1.0);
+  const int n = 400;
+  std::vector<scalar> values(n);
+  std::vector<char> tiers(n, 0);
+  for( int k = 0; k < n; ++k ) values[k] = unit(generator);
+  KineticSortedList list;
+  list.reset(values, tiers);
+
+  for( int step = 0; step < 10; ++step )
+  {
+    std::vector<scalar> next(n);
+    for( int k = 0; k < n; ++k ) next[k] = values[k] + 0.05*( unit(generator) - 0.5 );
+    int reversed = 0;
+    for( int a = 0; a < n; ++a )
+      for( int b = 0; b < n; ++b )
+        if( values[a] < values[b] && next[a] > next[b] ) ++reversed;
+
+    SwapCounter counter(list);
+    EXPECT_EQ(reversed, list.update(next, counter));
+    EXPECT_EQ(reversed, counter.swaps);
+    for( int p = 1; p < n; ++p ) EXPECT_LE(next[list.order()[p-1]], next[list.order()[p]]);
+    values = next;
+  }
+}
+
+// A kinetic detector kept across a sequence of configurations reports the
+// same pairs as sorting from scratch each time.
+TEST(BroadPhase, KineticSweepAndPruneFollowsMotion)
+{
+  SceneGeneratorOptions options;
+  options.numparticles = 2000;
+  options.numsprings = 3000;
+  options.minradius = 0.02;
+  options.maxradius = 0.05;
+  options.density = 0.3;
+  TwoDScene scene;
+  std::vector<SceneRecord> records;
+  GeneratedSprings springs;
+  ASSERT_TRUE(generateBoxScene(options, scene, records, springs));
+
+  KineticSweepAndPruneDetector kinetic;
+  int swaps = 0;
+  VectorXs qs = scene.getX();
+  for( unsigned step = 0; step < 8; ++step )
+  {
+    SCOPED_TRACE(step);
+    const VectorXs qe = testutils::perturbedPositions(scene, 0.5, step + 1);
+    testutils::PairCollector moving, reference;
+    kinetic.performCollisionDetection(scene, qs, qe, moving);
+    swaps += kinetic.getNumSwaps();
+    SweepAndPruneDetector sap;
+    sap.performCollisionDetection(scene, qs, qe, reference);
+    EXPECT_TRUE(moving.pppairs == reference.pppairs);
+    EXPECT_TRUE(moving.pepairs == reference.pepairs);
+    EXPECT_TRUE(moving.phpairs == reference.phpairs);
+    qs = qe;
+  }
+  EXPECT_GT(swaps, 0);
+}
+
+// The candidates a detector hands over whole.
+class PairListCollector : public DetectionCallback, public PairListDetectionCallback
+{
+public:
+  PairListCollector() : calls(0) {}
+
+  virtual void ParticleParticleCallback( int idx1, int idx2 ) { ADD_FAILURE() << "called back per pair"; }
+  virtual void ParticleEdgeCallback( int vidx, int eidx ) { ADD_FAILURE() << "called back per pair"; }
+  virtual void ParticleHalfplaneCallback( int vidx, int hidx ) { ADD_FAILURE() << "called back per pair"; }
+
+  virtual void PairListsCallback( const PPList& pp, const PEList& pe, const PHList& ph )
+  {
+    pppairs = pp;
+    pepairs = pe;
+    phpairs = ph;
+    ++calls;
+  }
+
+  PPList pppairs;
+  PEList pepairs;
+  PHList phpairs;
+  int calls;
+};
+
+// Every detector reports its pairs sorted, one call per pair or in one call
+// of whole lists alike.
+void expectSortedLists( CollisionDetector& detector, const TwoDScene& scene, const VectorXs& x, const std::string& what )
+{
+  SCOPED_TRACE(what);
+  testutils::PairCollector pairs;
+  detector.performCollisionDetection(scene, x, x, pairs);
+  EXPECT_TRUE(std::is_sorted(pairs.pppairs.begin(), pairs.pppairs.end()));
+  EXPECT_TRUE(std::is_sorted(pairs.pepairs.begin(), pairs.pepairs.end()));
+  EXPECT_TRUE(std::is_sorted(pairs.phpairs.begin(), pairs.phpairs.end()));
+  EXPECT_FALSE(pairs.pppairs.empty());
+  EXPECT_FALSE(pairs.pepairs.empty());
+
+  PairListCollector lists;
+  detector.performCollisionDetection(scene, x, x, lists);
+  EXPECT_EQ(1, lists.calls);
+  EXPECT_TRUE(lists.pppairs == pairs.pppairs);
+  EXPECT_TRUE(lists.pepairs == pairs.pepairs);
+  EXPECT_TRUE(lists.phpairs == pairs.phpairs);
+}
+
+TEST(BroadPhase, ReportsSortedListsWhole)
+{
+  SceneGeneratorOptions options;
+  options.numparticles = 2000;
+  options.numsprings = 3000;
+  options.minradius = 0.02;
+  options.maxradius = 0.05;
+  options.density = 0.3;
+  TwoDScene scene;
+  std::vector<SceneRecord> records;
+  GeneratedSprings springs;
+  ASSERT_TRUE(generateBoxScene(options, scene, records, springs));
+  // Shaken enough that particles touch each other and the edges; the
+  // generated box has no halfplanes.
+  const VectorXs x = testutils::perturbedPositions(scene, 0.5, 1);
+
+  ContestDetector contest;
+  expectSortedLists(contest, scene, x, "the contest detector");
+  SweepAndPruneDetector sap;
+  expectSortedLists(sap, scene, x, "sweep and prune");
+  AABBTreeDetector tree;
+  expectSortedLists(tree, scene, x, "the AABB tree");
+  KineticSweepAndPruneDetector kinetic;
+  expectSortedLists(kinetic, scene, x, "kinetic sweep and prune");
+  HierarchicalGridDetector hgrid;
+  expectSortedLists(hgrid, scene, x, "the hierarchical grid");
+}
+
+// Walls of radius 0.5 around particles of radius 0.02 would cover hundreds
+// of particle-sized cells each; on their own level they cover a few.
+TEST(BroadPhase, HierarchicalGridKeepsThickEdgesInFewCells)
+{
+  std::mt19937 generator(11);
+  std::uniform_real_distribution<scalar> coordinate(-2.0, 2.0);
+  const int n = 2000;
+  TwoDScene scene;
+  scene.resizeSystem(n + 4);
+  for( int i = 0; i < n; ++i )
+  {
+    scene.setPosition(i, Vector2s(coordinate(generator), coordinate(generator)));
+    scene.setRadius(i, 0.02);
+  }
+  const scalar corners[4][2] = { { -2.5, -2.5 }, { 2.5, -2.5 }, { 2.5, 2.5 }, { -2.5, 2.5 } };
+  for( int c = 0; c < 4; ++c )
+  {
+    scene.setPosition(n + c, Vector2s(corners[c][0], corners[c][1]));
+    scene.setRadius(n + c, 0.5);
+    scene.insertEdge(std::make_pair(n + c, n + ( c + 1 )%4), 0.5);
+  }
+
+  const VectorXs& x = scene.getX();
+  testutils::PairCollector pairs, reference;
+  HierarchicalGridDetector hgrid;
+  hgrid.performCollisionDetection(scene, x, x, pairs);
+  testutils::bruteForcePairs(scene, x, x, reference);
+  EXPECT_EQ(0, pairs.sort());
+  EXPECT_FALSE(reference.pepairs.empty());
+  EXPECT_TRUE(pairs.pppairs == reference.pppairs);
+  EXPECT_TRUE(pairs.pepairs == reference.pepairs);
+  EXPECT_LE(hgrid.getNumEntries(), 4*( scene.getNumParticles() + scene.getNumEdges() ));
+}
+
+// The contest detector finds the pairs among fixed particles and the edges
+// between them once. As free particles move, and when a fixed one is moved,
+// it still reports what testing every pair does. Thin walls cover fewer
+// cells than there are free particles, so the walls scan the free
+// particles' grid; thick ones don't, so the free particles look up the
+// walls instead.
+void expectContestFollowsStaticGeometry( scalar wallradius )
+{
+  SCOPED_TRACE(wallradius);
+  std::mt19937 generator(13);
+  std::uniform_real_distribution<scalar> coordinate(-2.0, 2.0);
+  const int n = 1000;
+  TwoDScene scene;
+  scene.resizeSystem(n + 5);
+  for( int i = 0; i < n; ++i )
+  {
+    scene.setPosition(i, Vector2s(coordinate(generator), coordinate(generator)));
+    scene.setRadius(i, 0.03);
+  }
+  const scalar corners[4][2] = { { -2.0, -2.0 }, { 2.0, -2.0 }, { 2.0, 2.0 }, { -2.0, 2.0 } };
+  for( int c = 0; c < 4; ++c )
+  {
+    scene.setPosition(n + c, Vector2s(corners[c][0], corners[c][1]));
+    scene.setRadius(n + c, wallradius);
+    scene.setFixed(n + c, true);
+    scene.insertEdge(std::make_pair(n + c, n + ( c + 1 )%4), wallradius);
+  }
+  // A fixed post with a free particle tied to it.
+  scene.setPosition(n + 4, Vector2s(0.0, 0.0));
+  scene.setRadius(n + 4, 0.03);
+  scene.setFixed(n + 4, true);
+  scene.insertEdge(std::make_pair(n + 4, 0), 0.02);
+
+  ContestDetector contest;
+  VectorXs x = scene.getX();
+  for( int step = 0; step < 4; ++step )
+  {
+    SCOPED_TRACE(step);
+    if( step == 3 ) x(2*(n + 1)) -= 0.5;
+    else for( int i = 0; i < n; ++i ) x.segment<2>(2*i) += 0.05*Vector2s(coordinate(generator), coordinate(generator));
+    testutils::PairCollector pairs, reference;
+    contest.performCollisionDetection(scene, x, x, pairs);
+    testutils::bruteForcePairs(scene, x, x, reference);
+    EXPECT_EQ(0, pairs.sort());
+    EXPECT_FALSE(reference.pepairs.empty());
+    EXPECT_TRUE(pairs.pppairs == reference.pppairs);
+    EXPECT_TRUE(pairs.pepairs == reference.pepairs);
+  }
+}
+
+TEST(BroadPhase, ContestDetectorFollowsStaticGeometry)
+{
+  expectContestFollowsStaticGeometry(0.02);
+  expectContestFollowsStaticGeometry(0.3);
+}
+
+#endif
@@ -0,0 +1,112 @@
+#ifndef __CHECKPOINT_TEST_H__
+#define __CHECKPOINT_TEST_H__
+
+#include <gtest/gtest.h>
+#include <cstdio>
+#include <string>
+#include <unistd.h>
+
+#include "FOSSSim/Checkpoint.h"
+
+namespace
+{
+
+Checkpoint sampleCheckpoint()
+{
+  Checkpoint checkpoint;
+  checkpoint.step = 42;
+  checkpoint.x.resize(6);
+  checkpoint.v.resize(6);
+  for( int i = 0; i < 6; ++i )
+  {
+    checkpoint.x(i) = 0.1*i - 0.25;
+    checkpoint.v(i) = 1.0/( i + 3.0 );
+  }
+  checkpoint.fixed.push_back(1);
+  checkpoint.fixed.push_back(0);
+  checkpoint.fixed.push_back(0);
+  checkpoint.settings.dt = 0.01;
+  checkpoint.settings.stiffness = 100.0;
+  checkpoint.settings.thickness = 0.05;
+  checkpoint.settings.gravity[1] = -9.81;
+  checkpoint.settings.drag = 0.5;
+  const PenaltySceneSettings::Spring spring = { 0, 10.0, 1.5, 0.2 };
+  checkpoint.settings.springs.push_back(spring);
+  checkpoint.bounds.push_back(-0.125);
+  return checkpoint;
+}
+
+}
+
+TEST(Checkpoint, RoundTripsAndMatchesItsScene)
+{
+  const std::string filename = "checkpoint_test_roundtrip.fck";
+  const Checkpoint written = sampleCheckpoint();
+  ASSERT_TRUE(writeCheckpoint(filename, written));
+
+  Checkpoint read;
+  ASSERT_TRUE(readCheckpoint(filename, read));
+  std::remove(filename.c_str());
+  EXPECT_EQ(42, read.step);
+  EXPECT_EQ(written.x, read.x);
+  EXPECT_EQ(written.v, read.v);
+  EXPECT_EQ(written.fixed, read.fixed);
+  EXPECT_EQ(written.bounds, read.bounds);
+  ASSERT_EQ(1u, read.settings.springs.size());
+  EXPECT_EQ(1.5, read.settings.springs[0].l0);
+
+  TwoDScene scene;
+  scene.resizeSystem(3);
+  scene.insertEdge(std::make_pair(0, 1), 0.01);
+  scene.setFixed(0, true);
+  PenaltySceneSettings settings = written.settings;
+  // The duration may differ, so that a run can resume for longer.
+  settings.duration = 100.0;
+  EXPECT_TRUE(checkpointMatches(read, scene, settings));
+  settings.springs[0].k = 11.0;
+  EXPECT_FALSE(checkpointMatches(read, scene, settings));
+  scene.setFixed(0, false);
+  EXPECT_FALSE(checkpointMatches(read, scene, written.settings));
+}
+
+TEST(Checkpoint, RejectsTruncatedAndForeignFiles)
+{
+  const std::string filename = "checkpoint_test_truncated.fck";
+  ASSERT_TRUE(writeCheckpoint(filename, sampleCheckpoint()));
+  std::FILE* file = std::fopen(filename.c_str(), "rb+");
+  ASSERT_TRUE(file != NULL);
+  std::fseek(file, 0, SEEK_END);
+  const long size = std::ftell(file);
+  std::fclose(file);
+
+  Checkpoint read;
+  ASSERT_EQ(0, truncate(filename.c_str(), size - 8));
+  EXPECT_FALSE(readCheckpoint(filename, read));
+  file = std::fopen(filename.c_str(), "wb");
+  std::fputs("<scene></scene>", file);
+  std::fclose(file);
+  EXPECT_FALSE(readCheckpoint(filename, read));
+  std::remove(filename.c_str());
+  EXPECT_FALSE(readCheckpoint(filename, read));
+}
+
+// A checkpoint written in the background replaces the previous one whole.
+TEST(Checkpoint, WritesAsynchronously)
+{
+  const std::string filename = "checkpoint_test_async.fck";
+  Checkpoint checkpoint = sampleCheckpoint();
+  AsyncCheckpointWriter writer;
+  writer.write(filename, checkpoint);
+  checkpoint.step = 43;
+  checkpoint.x.setZero();
+  writer.write(filename, checkpoint);
+  ASSERT_TRUE(writer.finish());
+
+  Checkpoint read;
+  ASSERT_TRUE(readCheckpoint(filename, read));
+  std::remove(filename.c_str());
+  EXPECT_EQ(43, read.step);
+  EXPECT_EQ(0.0, read.x.norm());
+}
+
+#endif
@@ -0,0 +1,68 @@
+#ifndef __EDGE_ADJACENCY_TEST_H__
+#define __EDGE_ADJACENCY_TEST_H__
+
+#include <gtest/gtest.h>
+
+#include "FOSSSim/EdgeAdjacency.h"
+#include "FOSSSim/TwoDScene.h"
+
+// Every edge appears in the rows of both its endpoints, in increasing order,
+// and in no other row.
+TEST(EdgeAdjacency, ListsEachEdgeAtBothEndpoints)
+{
+  TwoDScene scene;
+  scene.resizeSystem(5);
+  scene.insertEdge(std::make_pair(0, 1), 0.01);
+  scene.insertEdge(std::make_pair(1, 2), 0.01);
+  scene.insertEdge(std::make_pair(3, 1), 0.01);
+  scene.insertEdge(std::make_pair(2, 3), 0.01);
+
+  EdgeAdjacency adjacency;
+  EXPECT_TRUE(adjacency.update(scene));
+  EXPECT_FALSE(adjacency.update(scene));
+
+  ASSERT_EQ(1, adjacency.degree(0));
+  EXPECT_EQ(0, adjacency.edges(0)[0]);
+  ASSERT_EQ(3, adjacency.degree(1));
+  EXPECT_EQ(0, adjacency.edges(1)[0]);
+  EXPECT_EQ(1, adjacency.edges(1)[1]);
+  EXPECT_EQ(2, adjacency.edges(1)[2]);
+  ASSERT_EQ(2, adjacency.degree(3));
+  EXPECT_EQ(2, adjacency.edges(3)[0]);
+  EXPECT_EQ(3, adjacency.edges(3)[1]);
+  EXPECT_EQ(0, adjacency.degree(4));
+
+  EXPECT_EQ(3, adjacency.opposite(2, 1));
+  EXPECT_EQ(1, adjacency.opposite(2, 3));
+  EXPECT_TRUE(adjacency.isEndpoint(2, 3));
+  EXPECT_FALSE(adjacency.isEndpoint(0, 3));
+}
+
+// Inserting or clearing edges, or adding particles, is picked up by the next
+// update; nothing else rebuilds.
+TEST(EdgeAdjacency, RebuildsWhenTheSceneChanges)
+{
+  TwoDScene scene;
+  scene.resizeSystem(3);
+  scene.insertEdge(std::make_pair(0, 1), 0.01);
+
+  EdgeAdjacency adjacency;
+  ASSERT_TRUE(adjacency.update(scene));
+  EXPECT_EQ(0, adjacency.degree(2));
+
+  scene.insertEdge(std::make_pair(1, 2), 0.01);
+  EXPECT_TRUE(adjacency.update(scene));
+  EXPECT_EQ(1, adjacency.degree(2));
+  EXPECT_EQ(2, adjacency.degree(1));
+
+  scene.clearEdges();
+  EXPECT_TRUE(adjacency.update(scene));
+  EXPECT_EQ(0, adjacency.getNumEdges());
+  EXPECT_EQ(0, adjacency.degree(1));
+
+  adjacency.invalidate();
+  EXPECT_TRUE(adjacency.update(scene));
+  EXPECT_FALSE(adjacency.update(scene));
+}
+
+#endif
@@ -0,0 +1,153 @@
+#ifndef __EMBED_TEST_H__
+#define __EMBED_TEST_H__
+
+#include <gtest/gtest.h>
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "FOSSSim/ContestDetector.h"
+#include "FOSSSim/DetectorRegistry.h"
+#include "FOSSSim/PenaltySceneSettings.h"
+#include "FOSSSim/SceneBinary.h"
+#include "FOSSSim/SweepAndPruneDetector.h"
+#include "FOSSSimEmbed/FOSSSimEmbed.h"
+
+// Stepping through the C interface has to step the scene's own arrays in
+// place, as stepPenaltyScene steps a scene loaded by hand, and what the host
+// writes through the pointers has to be what the next step starts from.
+TEST(Embed, StepsSceneArraysInPlace)
+{
+  const std::string scenefile = std::string(FOSSSIM_ASSETS_DIR) + "/t2m3/TestingScenes/test03.xml";
+  const int steps = 50;
+
+  FOSSSimScene* embedded = fosssim_load(scenefile.c_str());
+  ASSERT_TRUE(embedded != NULL);
+  const int n = fosssim_num_particles(embedded);
+  double* x = fosssim_positions(embedded);
+  double* v = fosssim_velocities(embedded);
+  EXPECT_EQ(x, fosssimPositions(embedded).data());
+  EXPECT_EQ(v, fosssimVelocities(embedded).data());
+
+  fosssim_step(embedded, steps);
+  EXPECT_EQ(x, fosssim_positions(embedded));
+  EXPECT_EQ(v, fosssim_velocities(embedded));
+
+  TwoDScene scene;
+  std::vector<SceneRecord> records;
+  PenaltySceneSettings settings;
+  ASSERT_TRUE(loadXMLScene(scenefile, scene, records));
+  ASSERT_TRUE(readPenaltySceneSettings(records, scene.getNumEdges(), settings));
+  EXPECT_EQ(settings.dt, fosssim_timestep(embedded));
+  ContestDetector detector;
+  insertPenaltySceneForces(scene, detector, settings);
+  VectorXs gradE;
+  for( int s = 0; s < steps; ++s ) stepPenaltyScene(scene, settings, gradE);
+
+  ASSERT_EQ(scene.getNumParticles(), n);
+  for( int i = 0; i < 2*n; ++i )
+  {
+    EXPECT_EQ(scene.getX()(i), x[i]);
+    EXPECT_EQ(scene.getV()(i), v[i]);
+  }
+
+  // A free particle the host stops and moves carries on from there.
+  int free = 0;
+  while( free < n && scene.isFixed(free) ) ++free;
+  ASSERT_LT(free, n);
+  fosssimPositions(embedded).col(free) += Eigen::Vector2d(0.25, -0.5);
+  fosssimVelocities(embedded).col(free).setZero();
+  scene.getX().segment<2>(2*free) += Vector2s(0.25, -0.5);
+  scene.getV().segment<2>(2*free).setZero();
+  fosssim_step(embedded, 1);
+  stepPenaltyScene(scene, settings, gradE);
+  for( int i = 0; i < 2*n; ++i ) EXPECT_EQ(scene.getX()(i), x[i]);
+
+  fosssim_free(embedded);
+}
+
+// Steps queued asynchronously, chained across scenes, have to leave each
+// scene where the same steps taken synchronously do, and a step has to
+// complete only after the steps it follows.
+TEST(Embed, AsyncStepsMatchSynchronousSteps)
+{
+  const std::string scenefiles[2] = { std::string(FOSSSIM_ASSETS_DIR) + "/t2m3/TestingScenes/test03.xml", std::string(FOSSSIM_ASSETS_DIR) + "/t2m3/TestingScenes/test00.xml" };
+  FOSSSimScene* async[2];
+  FOSSSimScene* sync[2];
+  for( int k = 0; k < 2; ++k )
+  {
+    async[k] = fosssim_load(scenefiles[k].c_str());
+    sync[k] = fosssim_load(scenefiles[k].c_str());
+    ASSERT_TRUE(async[k] != NULL && sync[k] != NULL);
+  }
+
+  const FOSSSimStepFuture first = fosssimStepAsync(async[0], 20);
+  const FOSSSimStepFuture second = fosssimStepAsync(async[1], 30, std::vector<FOSSSimStepFuture>(1, first));
+  const FOSSSimStepFuture third = fosssimStepAsync(async[0], 10);
+  const FOSSSimStepResult result = fosssimWait(second);
+  EXPECT_EQ(async[1], result.scene);
+  EXPECT_EQ(30, result.steps);
+  EXPECT_EQ(std::future_status::ready, first.wait_for(std::chrono::seconds(0)));
+  fosssimFinish(async[0]);
+  EXPECT_EQ(std::future_status::ready, third.wait_for(std::chrono::seconds(0)));
+  EXPECT_EQ(10, third.get().steps);
+
+  fosssim_step(sync[0], 30);
+  fosssim_step(sync[1], 30);
+  for( int k = 0; k < 2; ++k )
+  {
+    const int n = fosssim_num_particles(sync[k]);
+    ASSERT_EQ(n, fosssim_num_particles(async[k]));
+    for( int i = 0; i < 2*n; ++i )
+    {
+      EXPECT_EQ(fosssim_positions(sync[k])[i], fosssim_positions(async[k])[i]);
+      EXPECT_EQ(fosssim_velocities(sync[k])[i], fosssim_velocities(async[k])[i]);
+    }
+    fosssim_free(async[k]);
+    fosssim_free(sync[k]);
+  }
+}
+
+namespace
+{
+
+CollisionDetector* createSweepAndPruneDetector()
+{
+  return new SweepAndPruneDetector;
+}
+
+}
+
+// A detector registered by the host has to be the one a scene naming it is
+// stepped through, and a scene naming no registered detector must not load.
+TEST(Embed, StepsThroughRegisteredDetector)
+{
+  const std::string scenefile = std::string(FOSSSIM_ASSETS_DIR) + "/t2m3/TestingScenes/test03.xml";
+  const char* sap[] = { "collisiondetection.type=testsweepandprune" };
+  const int steps = 50;
+
+  EXPECT_TRUE(fosssim_load_with(scenefile.c_str(), sap, 1) == NULL);
+  detectors::registerDetector("testsweepandprune", createSweepAndPruneDetector);
+  FOSSSimScene* embedded = fosssim_load_with(scenefile.c_str(), sap, 1);
+  ASSERT_TRUE(embedded != NULL);
+  fosssim_step(embedded, steps);
+
+  TwoDScene scene;
+  std::vector<SceneRecord> records;
+  PenaltySceneSettings settings;
+  ASSERT_TRUE(loadXMLScene(scenefile, scene, records));
+  ASSERT_TRUE(applySceneOverrides(std::vector<std::string>(sap, sap + 1), records));
+  ASSERT_TRUE(readPenaltySceneSettings(records, scene.getNumEdges(), settings));
+  EXPECT_EQ("testsweepandprune", settings.detector);
+  SweepAndPruneDetector detector;
+  insertPenaltySceneForces(scene, detector, settings);
+  VectorXs gradE;
+  for( int s = 0; s < steps; ++s ) stepPenaltyScene(scene, settings, gradE);
+
+  ASSERT_EQ(scene.getNumParticles(), fosssim_num_particles(embedded));
+  for( int i = 0; i < 2*scene.getNumParticles(); ++i ) EXPECT_EQ(scene.getX()(i), fosssim_positions(embedded)[i]);
+
+  fosssim_free(embedded);
+}
+
+#endif
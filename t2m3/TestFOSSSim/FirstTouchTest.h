@@ -0,0 +1,45 @@
+#ifndef __FIRST_TOUCH_TEST_H__
+#define __FIRST_TOUCH_TEST_H__
+
+#include <gtest/gtest.h>
+
+#include "FOSSSim/FirstTouch.h"
+
+// Placing moves the arrays to new storage with the same contents, leaves
+// them alone once placed, and places them again after they are reallocated.
+TEST(FirstTouch, PlacesArraysOnceAndAfterReallocation)
+{
+  TwoDScene scene;
+  scene.resizeSystem(20000);
+  for( int i = 0; i < scene.getNumParticles(); ++i )
+  {
+    scene.setPosition(i, Vector2s(i, -i));
+    scene.setVelocity(i, Vector2s(0.5*i, 1.0));
+    scene.setMass(i, 1.0 + i);
+  }
+  const VectorXs x = scene.getX();
+  const VectorXs v = scene.getV();
+  const VectorXs m = scene.getM();
+  const scalar* before = scene.getX().data();
+
+  firsttouch::placeSceneArrays(scene);
+  EXPECT_NE(before, scene.getX().data());
+  EXPECT_TRUE(scene.getX() == x);
+  EXPECT_TRUE(scene.getV() == v);
+  EXPECT_TRUE(scene.getM() == m);
+
+  const scalar* placed = scene.getX().data();
+  firsttouch::placeSceneArrays(scene);
+  EXPECT_EQ(placed, scene.getX().data());
+
+  // Keeps a copy alive so that the reallocation cannot get the same address.
+  VectorXs old;
+  old.swap(scene.getX());
+  scene.getX() = x;
+  const scalar* reallocated = scene.getX().data();
+  firsttouch::placeSceneArrays(scene);
+  EXPECT_NE(reallocated, scene.getX().data());
+  EXPECT_TRUE(scene.getX() == x);
+}
+
+#endif
@@ -0,0 +1,57 @@
+#ifndef __NARROW_PHASE_TEST_H__
+#define __NARROW_PHASE_TEST_H__
+
+#include <gtest/gtest.h>
+#include <random>
+
+#include "FOSSSim/NarrowPhase.h"
+
+// The batched test has to keep exactly the pairs the per-pair test in
+// PenaltyForce would act on, in their order, so that skipping the rest
+// changes no force.
+TEST(NarrowPhase, MatchesPerPairTest)
+{
+  const int numparticles = 200;
+  const scalar thickness = 0.01;
+  std::mt19937 generator(3);
+  std::uniform_real_distribution<scalar> position(0.0, 1.0);
+  std::uniform_real_distribution<scalar> radius(0.005, 0.05);
+  std::uniform_int_distribution<int> particle(0, numparticles - 1);
+
+  VectorXs x(2*numparticles);
+  std::vector<scalar> radii(numparticles);
+  for( int i = 0; i < numparticles; ++i )
+  {
+    x(2*i) = position(generator);
+    x(2*i+1) = position(generator);
+    radii[i] = radius(generator);
+  }
+  // Particles just touching and just not, along an axis.
+  x(0) = 0.5; x(1) = 0.5;
+  x(2) = 0.5 + radii[0] + radii[1] + thickness; x(3) = 0.5;
+
+  // Lengths of every remainder of the blocks.
+  for( int numpairs = 0; numpairs < 4000; numpairs += 997 )
+  {
+    PPList pppairs;
+    pppairs.push_back(std::make_pair(0, 1));
+    for( int k = 1; k < numpairs; ++k ) pppairs.push_back(std::make_pair(particle(generator), particle(generator)));
+
+    PPList expected;
+    for( PPList::size_type k = 0; k < pppairs.size(); ++k )
+    {
+      const int i = pppairs[k].first, j = pppairs[k].second;
+      const scalar reach = radii[i] + radii[j] + thickness;
+      if( ( x.segment<2>(2*i) - x.segment<2>(2*j) ).squaredNorm() < reach*reach ) expected.push_back(pppairs[k]);
+    }
+    PPList hits(3, std::make_pair(-1, -1));
+    narrowphase::findTouchingParticlePairs(x, radii, thickness, pppairs, hits);
+    EXPECT_TRUE(hits == expected) << numpairs << " pairs";
+    if( numpairs > 0 )
+    {
+      EXPECT_LT(hits.size(), pppairs.size());
+    }
+  }
+}
+
+#endif
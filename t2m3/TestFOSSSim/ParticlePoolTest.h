@@ -0,0 +1,125 @@
+#ifndef __PARTICLE_POOL_TEST_H__
+#define __PARTICLE_POOL_TEST_H__
+
+#include <gtest/gtest.h>
+
+#include "FOSSSim/ParticlePool.h"
+#include "FOSSSim/SpringForce.h"
+#include "FOSSSim/TwoDScene.h"
+
+namespace
+{
+
+Vector2s spawnPosition( int k )
+{
+  return Vector2s( 0.1*k, -0.05*k );
+}
+
+}
+
+TEST(ParticlePool, SpawnsIntoFreeSlotsAndGrowsByDoubling)
+{
+  TwoDScene scene;
+  scene.resizeSystem(3);
+  for( int i = 0; i < 3; ++i ) scene.setPosition(i, Vector2s(i, 1.0));
+  ParticlePool pool(scene);
+
+  int growths = 0;
+  int capacity = pool.getCapacity();
+  std::vector<int> spawned;
+  for( int k = 0; k < 1000; ++k )
+  {
+    spawned.push_back(pool.spawn(spawnPosition(k), Vector2s(k, 0.0), 1.0 + k, 0.01));
+    if( pool.getCapacity() != capacity ) ++growths;
+    capacity = pool.getCapacity();
+  }
+  EXPECT_LE(growths, 7);
+  EXPECT_EQ(1003, pool.getNumLive());
+  EXPECT_EQ(pool.getCapacity(), scene.getNumParticles());
+
+  // Growing kept every particle's state.
+  for( int i = 0; i < 3; ++i ) EXPECT_EQ(Vector2s(i, 1.0), scene.getX().segment<2>(2*i));
+  for( int k = 0; k < 1000; ++k )
+  {
+    const int i = spawned[k];
+    EXPECT_EQ(spawnPosition(k), scene.getX().segment<2>(2*i));
+    EXPECT_EQ(k, scene.getV()(2*i));
+    EXPECT_EQ(1.0 + k, scene.getM()(2*i));
+    EXPECT_FALSE(scene.isFixed(i));
+  }
+
+  // A killed particle is parked, and its slot is the next one spawned into.
+  pool.kill(spawned[10]);
+  EXPECT_FALSE(pool.isLive(spawned[10]));
+  EXPECT_TRUE(scene.isFixed(spawned[10]));
+  EXPECT_EQ(0.0, scene.getRadius(spawned[10]));
+  EXPECT_GT(scene.getX()(2*spawned[10]), 1000.0);
+  capacity = pool.getCapacity();
+  EXPECT_EQ(spawned[10], pool.spawn(Vector2s::Zero(), Vector2s::Zero(), 1.0, 0.01));
+  EXPECT_EQ(capacity, pool.getCapacity());
+}
+
+TEST(ParticlePool, KillDropsEdgesAndEmptiesSprings)
+{
+  TwoDScene scene;
+  scene.resizeSystem(4);
+  for( int i = 0; i < 4; ++i ) scene.setPosition(i, Vector2s(i, 0.0));
+  scene.insertEdge(std::make_pair(0, 1), 0.01);
+  scene.insertEdge(std::make_pair(2, 3), 0.01);
+  SpringForce* spring = new SpringForce(std::make_pair(1, 2), 100.0, 0.5, 1.0);
+  scene.insertForce(spring);
+  ParticlePool pool(scene);
+
+  pool.kill(1);
+  ASSERT_EQ(1, scene.getNumEdges());
+  EXPECT_EQ(std::make_pair(2, 3), scene.getEdge(0));
+  EXPECT_EQ(0.0, spring->getStiffness());
+  EXPECT_EQ(0.0, spring->getDamping());
+  EXPECT_FALSE(pool.isLive(spring->getEndpoints().first));
+  EXPECT_FALSE(pool.isLive(spring->getEndpoints().second));
+
+  // The emptied spring pulls on nothing.
+  VectorXs gradE = VectorXs::Zero(scene.getX().size());
+  spring->addGradEToTotal(scene.getX(), scene.getV(), scene.getM(), gradE);
+  EXPECT_EQ(0.0, gradE.norm());
+}
+
+TEST(ParticlePool, CompactionRemapsEdgesAndSprings)
+{
+  TwoDScene scene;
+  ParticlePool pool(scene);
+  std::vector<int> spawned;
+  for( int k = 0; k < 400; ++k ) spawned.push_back(pool.spawn(spawnPosition(k), Vector2s(0.0, k), 1.0, 0.01));
+  scene.insertEdge(std::make_pair(spawned[300], spawned[399]), 0.02);
+  SpringForce* spring = new SpringForce(std::make_pair(spawned[299], spawned[300]), 10.0, 0.3, 0.1);
+  scene.insertForce(spring);
+
+  for( int k = 0; k < 299; ++k ) pool.kill(spawned[k]);
+  ASSERT_TRUE(pool.compactIfFragmented());
+  EXPECT_EQ(101, pool.getNumLive());
+  EXPECT_EQ(202, pool.getCapacity());
+  EXPECT_EQ(pool.getCapacity(), scene.getNumParticles());
+
+  const std::vector<int>& remap = pool.getRemap();
+  for( int k = 0; k < 299; ++k ) EXPECT_EQ(-1, remap[spawned[k]]);
+  for( int k = 299; k < 400; ++k )
+  {
+    const int i = remap[spawned[k]];
+    EXPECT_EQ(k - 299, i);
+    EXPECT_EQ(spawnPosition(k), scene.getX().segment<2>(2*i));
+    EXPECT_EQ(k, scene.getV()(2*i + 1));
+    EXPECT_TRUE(pool.isLive(i));
+  }
+  ASSERT_EQ(1, scene.getNumEdges());
+  EXPECT_EQ(std::make_pair(1, 100), scene.getEdge(0));
+  EXPECT_EQ(0.02, scene.getEdgeRadii()[0]);
+  EXPECT_EQ(std::make_pair(0, 1), spring->getEndpoints());
+  EXPECT_EQ(10.0, spring->getStiffness());
+  EXPECT_EQ(0.3, spring->getRestLength());
+
+  // Nothing is left to move.
+  EXPECT_FALSE(pool.compactIfFragmented());
+  EXPECT_FALSE(pool.compact());
+}
+
+#endif
@@ -0,0 +1,53 @@
+#ifndef __PARTICLE_SLEEP_TEST_H__
+#define __PARTICLE_SLEEP_TEST_H__
+
+#include <gtest/gtest.h>
+
+#include "FOSSSim/ParticleSleep.h"
+#include "FOSSSim/PenaltyForce.h"
+#include "FOSSSim/SweepAndPruneDetector.h"
+
+// Only built into the simulator's sources with SLEEP_KINETIC_ENERGY set.
+#ifdef SLEEP_KINETIC_ENERGY
+
+// A resting stack held together by contacts alone falls asleep as one
+// island, and stays one while asleep: a particle hitting its bottom wakes
+// all of it, not just the particle it touches.
+TEST(ParticleSleep, WakingTheBottomOfAStackWakesItAll)
+{
+  TwoDScene scene;
+  scene.resizeSystem(4);
+  for( int i = 0; i < 4; ++i )
+  {
+    scene.setMass(i, 1.0);
+    scene.setRadius(i, 0.1);
+    scene.setVelocity(i, Vector2s::Zero());
+    scene.setFixed(i, false);
+  }
+  for( int i = 0; i < 3; ++i ) scene.setPosition(i, Vector2s(0.0, 0.2*i));
+  // Far off to start with, and never quiet.
+  scene.setPosition(3, Vector2s(5.0, 0.0));
+  scene.setVelocity(3, Vector2s(-1000.0, 0.0));
+
+  SweepAndPruneDetector detector;
+  PenaltyForce penalty(scene, detector, 100.0, 0.01);
+  VectorXs gradE(8);
+  for( int step = 0; step <= SLEEP_STEPS; ++step )
+  {
+    gradE.setZero();
+    penalty.addGradEToTotal(scene.getX(), scene.getV(), scene.getM(), gradE);
+    sleeping::update(scene);
+  }
+  for( int i = 0; i < 3; ++i ) EXPECT_TRUE(sleeping::isAsleep(i)) << "particle " << i;
+  EXPECT_FALSE(sleeping::isAsleep(3));
+
+  scene.setPosition(3, Vector2s(-0.2, 0.0));
+  gradE.setZero();
+  penalty.addGradEToTotal(scene.getX(), scene.getV(), scene.getM(), gradE);
+  sleeping::update(scene);
+  for( int i = 0; i < 4; ++i ) EXPECT_FALSE(sleeping::isAsleep(i)) << "particle " << i;
+}
+
+#endif
+
+#endif
@@ -0,0 +1,65 @@
+#ifndef __PENALTY_GRID_TEST_H__
+#define __PENALTY_GRID_TEST_H__
+
+#include <gtest/gtest.h>
+
+#include "TestUtilities.h"
+#include "FOSSSim/ContestDetector.h"
+#include "FOSSSim/PenaltyForce.h"
+#include "FOSSSim/PenaltyGrid.h"
+#include "FOSSSim/SceneGenerator.h"
+
+// The grid has to find the contacts the contest detector's candidates give,
+// so the gradient may only differ by the order its terms are summed in, and
+// the particle-edge candidates have to be the detector's exactly.
+void expectGridMatchesDetector( const TwoDScene& scene, const VectorXs& x, const std::string& what )
+{
+  SCOPED_TRACE(what);
+  ContestDetector detector;
+  PenaltyForce force(scene, detector, 100.0, 0.01);
+  const VectorXs v = VectorXs::Zero(x.size());
+  const VectorXs m = VectorXs::Ones(x.size());
+
+  VectorXs expected = VectorXs::Zero(x.size());
+  force.addGradEToTotal(x, v, m, expected);
+  PenaltyGrid grid;
+  VectorXs fused = VectorXs::Zero(x.size());
+  force.addGradEToTotal(x, grid, fused);
+  EXPECT_GT(expected.norm(), 0.0);
+  EXPECT_LE(( fused - expected ).norm(), 1e-12*expected.norm());
+
+  testutils::PairCollector candidates;
+  detector.performCollisionDetection(scene, x, x, candidates);
+  candidates.sort();
+  PEList pepairs;
+  grid.findParticleEdgePairs(scene, x, pepairs);
+  EXPECT_TRUE(pepairs == candidates.pepairs);
+}
+
+TEST(PenaltyGrid, MatchesContestDetectorPath)
+{
+  SceneGeneratorOptions options;
+  options.numparticles = 4000;
+  options.numsprings = 6000;
+  options.minradius = 0.01;
+  options.maxradius = 0.05;
+  options.density = 0.3;
+  TwoDScene scene;
+  std::vector<SceneRecord> records;
+  GeneratedSprings springs;
+  ASSERT_TRUE(generateBoxScene(options, scene, records, springs));
+
+  expectGridMatchesDetector(scene, testutils::perturbedPositions(scene, 0.5, 1), "generated box");
+
+  // Particles too large to bin, among the others.
+  for( int i = 100; i < 4000; i += 1000 ) scene.setRadius(i, 0.3);
+  expectGridMatchesDetector(scene, testutils::perturbedPositions(scene, 0.5, 2), "with large particles");
+
+  // Half the particles far off, so the occupied cells are too sparse to
+  // tabulate.
+  VectorXs apart = testutils::perturbedPositions(scene, 0.5, 3);
+  for( int i = 0; i < scene.getNumParticles(); i += 2 ) apart(2*i) += 50.0;
+  expectGridMatchesDetector(scene, apart, "spread apart");
+}
+
+#endif
@@ -0,0 +1,112 @@
+#ifndef __PERIODIC_DOMAIN_TEST_H__
+#define __PERIODIC_DOMAIN_TEST_H__
+
+#include <gtest/gtest.h>
+#include <random>
+
+#include "TestUtilities.h"
+#include "FOSSSim/ContestDetector.h"
+#include "FOSSSim/NarrowPhase.h"
+#include "FOSSSim/PenaltyForce.h"
+#include "FOSSSim/PeriodicDomain.h"
+
+namespace
+{
+
+// Particles scattered over the unit square, which is periodic in x alone or
+// in both, with a chain of edges across its left and right sides.
+void makePeriodicScene( TwoDScene& scene, int n, unsigned seed )
+{
+  std::mt19937 generator(seed);
+  std::uniform_real_distribution<scalar> position(0.0, 1.0);
+  std::uniform_real_distribution<scalar> radius(0.005, 0.02);
+  scene.resizeSystem(n);
+  for( int i = 0; i < n; ++i )
+  {
+    scene.setPosition(i, Vector2s(position(generator), position(generator)));
+    scene.setVelocity(i, Vector2s::Zero());
+    scene.setMass(i, 1.0);
+    scene.setRadius(i, radius(generator));
+  }
+  scene.setPosition(0, Vector2s(0.995, 0.5));
+  scene.setPosition(1, Vector2s(0.015, 0.5));
+  scene.setPosition(2, Vector2s(0.03, 0.51));
+  scene.insertEdge(std::make_pair(0, 1), 0.01);
+  scene.insertEdge(std::make_pair(1, 2), 0.01);
+}
+
+}
+
+// With a periodic domain the contest detector and the narrow phase have to
+// keep exactly the particle pairs within reach of each other's nearest image.
+// The detector's boxes are not padded by the thickness, so there is none.
+TEST(PeriodicDomain, ContestDetectorFindsPairsAcrossSides)
+{
+  const scalar thickness = 0.0;
+  for( int axes = 1; axes <= 2; ++axes )
+  {
+    SCOPED_TRACE(axes);
+    TwoDScene scene;
+    makePeriodicScene(scene, 3000, 7);
+    const PeriodicDomain domain(Vector2s(0.0, 0.0), Vector2s(1.0, 1.0), true, axes == 2);
+    periodic::setDomain(scene, domain);
+
+    testutils::PairCollector pairs;
+    ContestDetector detector;
+    detector.performCollisionDetection(scene, scene.getX(), scene.getX(), pairs);
+    EXPECT_EQ(0, pairs.sort());
+    PPList hits;
+    narrowphase::findTouchingParticlePairs(scene.getX(), scene.getRadii(), thickness, pairs.pppairs, hits, &domain);
+
+    PPList expected;
+    int across = 0;
+    for( int i = 0; i < scene.getNumParticles(); ++i )
+      for( int j = i + 1; j < scene.getNumParticles(); ++j )
+      {
+        const Vector2s d = scene.getX().segment<2>(2*i) - scene.getX().segment<2>(2*j);
+        const scalar reach = scene.getRadius(i) + scene.getRadius(j) + thickness;
+        if( !( domain.minimumImage(d).squaredNorm() < reach*reach ) ) continue;
+        expected.push_back(std::make_pair(i, j));
+        if( !( d.squaredNorm() < reach*reach ) ) ++across;
+      }
+    EXPECT_GT(across, 0);
+    EXPECT_TRUE(hits == expected);
+
+    // The edge from the right side to the left one is near particle 2 only
+    // across the sides, and the particles by the left end of the other edge.
+    EXPECT_TRUE(std::binary_search(pairs.pepairs.begin(), pairs.pepairs.end(), std::make_pair(2, 0)));
+    for( PEList::size_type k = 0; k < pairs.pepairs.size(); ++k ) EXPECT_FALSE(scene.getEdge(pairs.pepairs[k].second).first == pairs.pepairs[k].first);
+    periodic::clearDomain(scene);
+  }
+}
+
+// Shifting every particle and wrapping them back into the domain has to
+// leave each one's penalty force as it was, to rounding.
+TEST(PeriodicDomain, PenaltyForceIsTranslationInvariant)
+{
+  TwoDScene scene;
+  makePeriodicScene(scene, 2000, 11);
+  const PeriodicDomain domain(Vector2s(0.0, 0.0), Vector2s(1.0, 1.0));
+  periodic::setDomain(scene, domain);
+  ContestDetector detector;
+  PenaltyForce force(scene, detector, 100.0, 0.002);
+
+  VectorXs gradE = VectorXs::Zero(scene.getX().size());
+  force.addGradEToTotal(scene.getX(), scene.getV(), scene.getM(), gradE);
+  EXPECT_GT(gradE.norm(), 0.0);
+
+  VectorXs shifted = scene.getX();
+  for( int i = 0; i < scene.getNumParticles(); ++i ) shifted.segment<2>(2*i) += Vector2s(0.37, 0.61);
+  domain.wrap(shifted);
+  for( int k = 0; k < shifted.size(); ++k )
+  {
+    EXPECT_GE(shifted(k), 0.0);
+    EXPECT_LT(shifted(k), 1.0);
+  }
+  VectorXs shiftedgradE = VectorXs::Zero(shifted.size());
+  force.addGradEToTotal(shifted, scene.getV(), scene.getM(), shiftedgradE);
+  EXPECT_LT((shiftedgradE - gradE).lpNorm<Eigen::Infinity>(), 1.0e-9*gradE.lpNorm<Eigen::Infinity>());
+  periodic::clearDomain(scene);
+}
+
+#endif
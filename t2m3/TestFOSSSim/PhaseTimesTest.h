@@ -0,0 +1,42 @@
+#ifndef __PHASE_TIMES_TEST_H__
+#define __PHASE_TIMES_TEST_H__
+
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <thread>
+
+#include "FOSSSim/PhaseTimes.h"
+
+// A phase opened inside another pauses it, so the broad phase's time leaves
+// out the contacts nested in it and the two add up to the time spent in
+// both.
+TEST(PhaseTimes, NestedPhasesAreExclusive)
+{
+  typedef std::chrono::steady_clock Clock;
+  const std::chrono::milliseconds nap(20);
+  phasetimes::reset();
+  const Clock::time_point start = Clock::now();
+  {
+    phasetimes::ScopedPhase search(phasetimes::BROAD_PHASE);
+    std::this_thread::sleep_for(nap);
+    {
+      phasetimes::ScopedPhase contacts(phasetimes::CONTACTS);
+      std::this_thread::sleep_for(nap);
+    }
+  }
+  const double elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+
+  const double broadphase = phasetimes::getSeconds(phasetimes::BROAD_PHASE);
+  const double contacts = phasetimes::getSeconds(phasetimes::CONTACTS);
+  EXPECT_GE(broadphase, 0.02);
+  EXPECT_GE(contacts, 0.02);
+  EXPECT_LE(broadphase + contacts, elapsed);
+  EXPECT_LT(broadphase, elapsed - 0.02);
+  EXPECT_EQ(0.0, phasetimes::getSeconds(phasetimes::FORCES));
+
+  phasetimes::reset();
+  EXPECT_EQ(0.0, phasetimes::getSeconds(phasetimes::BROAD_PHASE));
+}
+
+#endif
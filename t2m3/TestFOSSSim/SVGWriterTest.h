@@ -0,0 +1,95 @@
+#ifndef __SVG_WRITER_TEST_H__
+#define __SVG_WRITER_TEST_H__
+
+#include <gtest/gtest.h>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <string>
+
+#include "FOSSSim/SVGWriter.h"
+
+namespace
+{
+
+std::string readSVG( const std::string& filename )
+{
+  std::ifstream file(filename.c_str());
+  std::ostringstream contents;
+  contents << file.rdbuf();
+  return contents.str();
+}
+
+int countOf( const std::string& text, const std::string& what )
+{
+  int count = 0;
+  for( std::string::size_type at = text.find(what); at != std::string::npos; at = text.find(what, at + 1) ) ++count;
+  return count;
+}
+
+}
+
+TEST(SVGWriter, FormatsNumbersWithTwoDecimals)
+{
+  const std::string filename = "svg_writer_test_numbers.svg";
+  const SceneColor white = { 1.0f, 1.0f, 1.0f };
+  const SceneColor orange = { 1.0f, 0.5f, 0.0f };
+  SVGWriter svg;
+  ASSERT_TRUE(svg.open(filename, 64, 32, white));
+  svg.beginFillGroup(orange);
+  svg.circle(12.5, -3.0, 0.074);
+  svg.circle(1234567.891, -0.001, 7.005);
+  svg.endGroup();
+  ASSERT_TRUE(svg.close());
+
+  const std::string contents = readSVG(filename);
+  std::remove(filename.c_str());
+  EXPECT_NE(std::string::npos, contents.find("width=\"64\" height=\"32\""));
+  EXPECT_NE(std::string::npos, contents.find("fill=\"#ffffff\""));
+  EXPECT_NE(std::string::npos, contents.find("<g fill=\"#ff8000\">"));
+  EXPECT_NE(std::string::npos, contents.find("<circle cx=\"12.5\" cy=\"-3\" r=\"0.07\"/>"));
+  EXPECT_NE(std::string::npos, contents.find("<circle cx=\"1234567.89\" cy=\"0\" r=\"7.01\"/>"));
+  EXPECT_EQ(contents.size() - 7, contents.rfind("</svg>\n"));
+}
+
+// Particles below the level of detail and off the image are left out, and
+// neighbours of one colour share a group.
+TEST(SVGWriter, CullsSubPixelAndOffImageParticles)
+{
+  TwoDScene scene;
+  scene.resizeSystem(4);
+  scene.setPosition(0, Vector2s(0.0, 0.0));
+  scene.setPosition(1, Vector2s(0.5, 0.5));
+  scene.setPosition(2, Vector2s(-0.5, 0.0));
+  scene.setPosition(3, Vector2s(5.0, 0.0));
+  scene.setRadius(0, 0.1);
+  scene.setRadius(1, 0.1);
+  scene.setRadius(2, 0.001);
+  scene.setRadius(3, 0.1);
+  SceneAppearance appearance;
+  readSceneAppearance(std::vector<SceneRecord>(), scene, appearance);
+
+  SVGFrameOptions options;
+  options.width = 100;
+  options.height = 100;
+  options.lodradius = 0.5;
+  const SimToImageMap map = computeSimToImageMap(appearance, options.width, options.height);
+  EXPECT_DOUBLE_EQ(50.0, map.imageX(0.0));
+  EXPECT_DOUBLE_EQ(25.0, map.imageY(0.5));
+  EXPECT_DOUBLE_EQ(50.0, map.scale);
+
+  const std::string filename = "svg_writer_test_scene.svg";
+  ASSERT_TRUE(writeSceneSVG(filename, scene, scene.getX(), appearance, options));
+  std::string contents = readSVG(filename);
+  EXPECT_EQ(2, countOf(contents, "<circle"));
+  EXPECT_EQ(1, countOf(contents, "<g fill"));
+  EXPECT_NE(std::string::npos, contents.find("<circle cx=\"75\" cy=\"25\" r=\"5\"/>"));
+
+  options.lodradius = 0.0;
+  ASSERT_TRUE(writeSceneSVG(filename, scene, scene.getX(), appearance, options));
+  contents = readSVG(filename);
+  std::remove(filename.c_str());
+  EXPECT_EQ(3, countOf(contents, "<circle"));
+}
+
+#endif
@@ -0,0 +1,243 @@
+#ifndef __SCENE_LOADING_TEST_H__
+#define __SCENE_LOADING_TEST_H__
+
+#include <gtest/gtest.h>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "TestUtilities.h"
+#include "FOSSSim/PenaltySceneSettings.h"
+#include "FOSSSim/SceneBinary.h"
+#include "FOSSSim/SpringForce.h"
+#include "FOSSSim/TwoDSceneBuilder.h"
+
+// A binary scene has to load into the same scene, and the same records, as
+// the XML it was converted from.
+TEST(SceneLoading, BinaryMatchesXMLOnAssetScenes)
+{
+  const std::vector<std::string> scenes = testutils::assetScenes();
+  ASSERT_FALSE(scenes.empty());
+  char fsbfile[] = "/tmp/testfosssimXXXXXX";
+  const int fd = mkstemp(fsbfile);
+  ASSERT_GE(fd, 0);
+  close(fd);
+
+  for( std::vector<std::string>::size_type s = 0; s < scenes.size(); ++s )
+  {
+    SCOPED_TRACE(scenes[s]);
+    TwoDScene xmlscene, binaryscene;
+    std::vector<SceneRecord> xmlrecords, binaryrecords;
+    ASSERT_TRUE(loadXMLScene(scenes[s], xmlscene, xmlrecords));
+    ASSERT_TRUE(convertXMLSceneToBinary(scenes[s], fsbfile));
+    ASSERT_TRUE(loadBinaryScene(fsbfile, binaryscene, binaryrecords));
+
+    ASSERT_EQ(xmlscene.getNumParticles(), binaryscene.getNumParticles());
+    EXPECT_TRUE(xmlscene.getX() == binaryscene.getX());
+    EXPECT_TRUE(xmlscene.getV() == binaryscene.getV());
+    EXPECT_TRUE(xmlscene.getM() == binaryscene.getM());
+    EXPECT_TRUE(xmlscene.getRadii() == binaryscene.getRadii());
+    for( int i = 0; i < xmlscene.getNumParticles(); ++i ) EXPECT_EQ(xmlscene.isFixed(i), binaryscene.isFixed(i));
+    EXPECT_TRUE(xmlscene.getEdges() == binaryscene.getEdges());
+    EXPECT_TRUE(xmlscene.getEdgeRadii() == binaryscene.getEdgeRadii());
+    ASSERT_EQ(xmlscene.getNumHalfplanes(), binaryscene.getNumHalfplanes());
+    for( int h = 0; h < xmlscene.getNumHalfplanes(); ++h )
+    {
+      EXPECT_TRUE(xmlscene.getHalfplane(h).first == binaryscene.getHalfplane(h).first);
+      EXPECT_TRUE(xmlscene.getHalfplane(h).second == binaryscene.getHalfplane(h).second);
+    }
+    ASSERT_EQ(xmlrecords.size(), binaryrecords.size());
+    for( std::vector<SceneRecord>::size_type r = 0; r < xmlrecords.size(); ++r )
+    {
+      EXPECT_EQ(xmlrecords[r].name, binaryrecords[r].name);
+      EXPECT_TRUE(xmlrecords[r].attributes == binaryrecords[r].attributes);
+    }
+  }
+  remove(fsbfile);
+}
+
+// With FOSSSIM_SCENE_CACHE set, the first load of an XML scene writes its
+// binary copy, later loads read that copy, and an edited scene gets a new one.
+TEST(SceneLoading, CacheIsWrittenOnceAndReused)
+{
+  char dir[] = "/tmp/testfosssimXXXXXX";
+  ASSERT_TRUE(mkdtemp(dir) != NULL);
+  const std::string xmlfile = std::string(dir) + "/scene.xml";
+  {
+    std::ifstream ifs((std::string(FOSSSIM_ASSETS_DIR) + "/t2m3/TestingScenes/test03.xml").c_str());
+    std::ofstream ofs(xmlfile.c_str());
+    ofs << ifs.rdbuf();
+  }
+  setenv("FOSSSIM_SCENE_CACHE", "1", 1);
+
+  TwoDScene expected, first, second;
+  std::vector<SceneRecord> expectedrecords, firstrecords, secondrecords;
+  ASSERT_TRUE(loadXMLScene(xmlfile, expected, expectedrecords));
+  const std::string cachefile = sceneCacheFile(xmlfile);
+  ASSERT_FALSE(cachefile.empty());
+  struct stat status;
+  EXPECT_NE(0, stat(cachefile.c_str(), &status));
+
+  ASSERT_TRUE(loadScene(xmlfile, first, firstrecords));
+  ASSERT_EQ(0, stat(cachefile.c_str(), &status));
+  const ino_t inode = status.st_ino;
+  ASSERT_TRUE(loadScene(xmlfile, second, secondrecords));
+  ASSERT_EQ(0, stat(cachefile.c_str(), &status));
+  EXPECT_EQ(inode, status.st_ino);
+
+  const TwoDScene* loaded[] = { &first, &second };
+  for( int k = 0; k < 2; ++k )
+  {
+    EXPECT_TRUE(loaded[k]->getX() == expected.getX());
+    EXPECT_TRUE(loaded[k]->getV() == expected.getV());
+    EXPECT_TRUE(loaded[k]->getM() == expected.getM());
+    EXPECT_TRUE(loaded[k]->getEdges() == expected.getEdges());
+  }
+  ASSERT_EQ(expectedrecords.size(), secondrecords.size());
+  for( std::vector<SceneRecord>::size_type r = 0; r < expectedrecords.size(); ++r ) EXPECT_TRUE(expectedrecords[r].attributes == secondrecords[r].attributes);
+
+  {
+    std::ofstream ofs(xmlfile.c_str(), std::ios::app);
+    ofs << "<!-- edited -->" << std::endl;
+  }
+  const std::string editedfile = sceneCacheFile(xmlfile);
+  EXPECT_NE(cachefile, editedfile);
+  ASSERT_TRUE(loadScene(xmlfile, second, secondrecords));
+  EXPECT_EQ(0, stat(editedfile.c_str(), &status));
+
+  unsetenv("FOSSSIM_SCENE_CACHE");
+  remove(cachefile.c_str());
+  remove(editedfile.c_str());
+  remove(xmlfile.c_str());
+  rmdir(dir);
+}
+
+// --set overrides replace attributes of every record of their element, or add
+// them, and are read back by the scene's settings like the scene's own.
+TEST(SceneLoading, OverridesReplaceAndAddAttributes)
+{
+  const std::string scenefile = std::string(FOSSSIM_ASSETS_DIR) + "/t2m3/TestingScenes/test02.xml";
+  TwoDScene scene;
+  std::vector<SceneRecord> records;
+  ASSERT_TRUE(loadScene(scenefile, scene, records, SIMULATION_RECORDS));
+
+  std::vector<std::string> texts;
+  texts.push_back("integrator.dt=0.002");
+  texts.push_back("collision.k=500");
+  texts.push_back("collision.k=750");
+  ASSERT_TRUE(applySceneOverrides(texts, records));
+  PenaltySceneSettings settings;
+  ASSERT_TRUE(readPenaltySceneSettings(records, scene.getNumEdges(), settings));
+  EXPECT_EQ(0.002, settings.dt);
+  EXPECT_EQ(750.0, settings.stiffness);
+  for( std::vector<SceneRecord>::size_type r = 0; r < records.size(); ++r )
+  {
+    if( records[r].name != "integrator" ) continue;
+    ASSERT_TRUE(records[r].findAttribute("type") != NULL);
+    EXPECT_EQ("forward-backward-euler", *records[r].findAttribute("type"));
+  }
+
+  SceneOverride setting;
+  EXPECT_FALSE(parseSceneOverride("integrator.dt", setting));
+  EXPECT_FALSE(parseSceneOverride("dt=0.002", setting));
+  EXPECT_FALSE(parseSceneOverride(".dt=0.002", setting));
+  ASSERT_TRUE(parseSceneOverride("springforce.l0=1.5", setting));
+  EXPECT_EQ("springforce", setting.element);
+  EXPECT_EQ("l0", setting.attribute);
+  EXPECT_EQ("1.5", setting.value);
+  EXPECT_FALSE(applySceneOverrides(std::vector<std::string>(1, "nosuchelement.x=1"), records));
+}
+
+// Asked for SIMULATION_RECORDS, both loaders drop the records only drawing
+// reads and keep the rest in order.
+TEST(SceneLoading, SimulationRecordsLeaveOutAppearance)
+{
+  const std::string scenefile = std::string(FOSSSIM_ASSETS_DIR) + "/t2m3/TestingScenes/test02.xml";
+  char fsbfile[] = "/tmp/testfosssimXXXXXX";
+  const int fd = mkstemp(fsbfile);
+  ASSERT_GE(fd, 0);
+  close(fd);
+  ASSERT_TRUE(convertXMLSceneToBinary(scenefile, fsbfile));
+
+  TwoDScene scene;
+  std::vector<SceneRecord> all, xmlrecords, binaryrecords;
+  ASSERT_TRUE(loadXMLScene(scenefile, scene, all));
+  ASSERT_TRUE(loadXMLScene(scenefile, scene, xmlrecords, SIMULATION_RECORDS));
+  ASSERT_TRUE(loadBinaryScene(fsbfile, scene, binaryrecords, SIMULATION_RECORDS));
+  remove(fsbfile);
+
+  std::vector<std::string> expected;
+  int dropped = 0;
+  for( std::vector<SceneRecord>::size_type r = 0; r < all.size(); ++r )
+  {
+    if( isAppearanceRecord(all[r].name) ) ++dropped;
+    else expected.push_back(all[r].name);
+  }
+  EXPECT_GT(dropped, 0);
+  ASSERT_EQ(expected.size(), xmlrecords.size());
+  ASSERT_EQ(expected.size(), binaryrecords.size());
+  for( std::vector<std::string>::size_type r = 0; r < expected.size(); ++r )
+  {
+    EXPECT_EQ(expected[r], xmlrecords[r].name);
+    EXPECT_EQ(expected[r], binaryrecords[r].name);
+  }
+}
+
+// The loaders build scenes through TwoDSceneBuilder, which has to give the
+// scene TwoDScene's own setters would.
+TEST(SceneLoading, BuilderMatchesPerElementConstruction)
+{
+  const int n = 5;
+  const scalar x[2*n] = { 0.0, 0.0, 1.0, 0.5, -2.0, 1.5, 0.25, -1.0, 3.0, 3.0 };
+  const scalar v[2*n] = { 1.0, -1.0, 0.0, 0.0, 0.5, 0.5, -0.25, 2.0, 0.0, 1.0 };
+  const scalar m[n] = { 1.0, 2.0, 0.5, 4.0, 1.5 };
+  const scalar radii[n] = { 0.1, 0.2, 0.05, 0.1, 0.3 };
+  const unsigned char fixed[n] = { 1, 0, 0, 1, 0 };
+  const int edges[4] = { 0, 1, 3, 4 };
+  const scalar edgeradii[2] = { 0.05, 0.02 };
+
+  TwoDSceneBuilder builder;
+  builder.reserve(n, 2, 1, 1);
+  EXPECT_EQ(0, builder.addParticles(n - 1, x, v, m, radii, fixed));
+  EXPECT_EQ(n - 1, builder.addParticle(Vector2s(x[2*n-2], x[2*n-1]), Vector2s(v[2*n-2], v[2*n-1]), m[n-1], radii[n-1], fixed[n-1]));
+  EXPECT_EQ(0, builder.addEdges(2, edges, edgeradii));
+  EXPECT_EQ(0, builder.addHalfplane(Vector2s(0.0, -5.0), Vector2s(0.0, 1.0)));
+  EXPECT_EQ(0, builder.addSpring(1, 2, 10.0, 0.75, 0.5));
+  EXPECT_TRUE(builder.endpointsValid());
+  TwoDScene built;
+  builder.build(built);
+
+  TwoDScene expected;
+  expected.resizeSystem(n);
+  for( int i = 0; i < n; ++i )
+  {
+    expected.setPosition(i, Vector2s(x[2*i], x[2*i+1]));
+    expected.setVelocity(i, Vector2s(v[2*i], v[2*i+1]));
+    expected.setMass(i, m[i]);
+    expected.setRadius(i, radii[i]);
+    expected.setFixed(i, fixed[i] != 0);
+  }
+
+  EXPECT_TRUE(expected.getX() == built.getX());
+  EXPECT_TRUE(expected.getV() == built.getV());
+  EXPECT_TRUE(expected.getM() == built.getM());
+  EXPECT_TRUE(expected.getRadii() == built.getRadii());
+  for( int i = 0; i < n; ++i ) EXPECT_EQ(expected.isFixed(i), built.isFixed(i));
+  ASSERT_EQ(2, built.getNumEdges());
+  EXPECT_EQ(std::make_pair(3, 4), built.getEdge(1));
+  EXPECT_EQ(0.02, built.getEdgeRadii()[1]);
+  ASSERT_EQ(1, built.getNumHalfplanes());
+  EXPECT_EQ(-5.0, built.getHalfplane(0).first(1));
+  ASSERT_EQ(1u, built.getForces().size());
+  const SpringForce* spring = dynamic_cast<const SpringForce*>(built.getForces()[0]);
+  ASSERT_TRUE(spring != NULL);
+  EXPECT_EQ(std::make_pair(1, 2), spring->getEndpoints());
+  EXPECT_EQ(0.75, spring->getRestLength());
+
+  builder.addEdge(0, n, 0.1);
+  EXPECT_FALSE(builder.endpointsValid());
+}
+
+#endif
@@ -0,0 +1,52 @@
+#ifndef __SCENE_RASTERIZER_TEST_H__
+#define __SCENE_RASTERIZER_TEST_H__
+
+#include <gtest/gtest.h>
+
+#include "FOSSSim/SceneRasterizer.h"
+
+namespace
+{
+
+bool isPixel( const FrameImage& image, int i, int j, unsigned char r, unsigned char g, unsigned char b )
+{
+  const unsigned char* pixel = &image.rgb[3*( j*image.width + i )];
+  return pixel[0] == r && pixel[1] == g && pixel[2] == b;
+}
+
+}
+
+// A particle covers the pixels whose centres it contains, and one smaller
+// than a pixel still covers the pixel it is in.
+TEST(SceneRasterizer, CoversPixelCentresAndKeepsTinyParticles)
+{
+  TwoDScene scene;
+  scene.resizeSystem(2);
+  scene.setPosition(0, Vector2s(0.0, 0.0));
+  scene.setPosition(1, Vector2s(0.51, 0.51));
+  scene.setRadius(0, 0.1);
+  scene.setRadius(1, 0.001);
+  SceneAppearance appearance;
+  readSceneAppearance(std::vector<SceneRecord>(), scene, appearance);
+  appearance.particlecolors[0].r = 1.0f;
+
+  FrameImage image;
+  image.resize(100, 100);
+  rasterizeScene(scene, scene.getX(), appearance, image);
+
+  // Particle 0 is centred on the image with a radius of 5 pixels.
+  EXPECT_TRUE(isPixel(image, 50, 50, 255, 0, 0));
+  EXPECT_TRUE(isPixel(image, 54, 49, 255, 0, 0));
+  EXPECT_TRUE(isPixel(image, 45, 50, 255, 0, 0));
+  EXPECT_TRUE(isPixel(image, 55, 50, 255, 255, 255));
+  EXPECT_TRUE(isPixel(image, 54, 54, 255, 255, 255));
+  int covered = 0;
+  for( int j = 0; j < image.height; ++j )
+    for( int i = 0; i < image.width; ++i ) covered += isPixel(image, i, j, 255, 0, 0);
+  EXPECT_NEAR(3.14159*25.0, covered, 10.0);
+
+  EXPECT_TRUE(isPixel(image, 75, 24, 0, 0, 0));
+  EXPECT_TRUE(isPixel(image, 74, 24, 255, 255, 255));
+}
+
+#endif
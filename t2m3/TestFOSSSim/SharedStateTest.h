@@ -0,0 +1,93 @@
+#ifndef __SHARED_STATE_TEST_H__
+#define __SHARED_STATE_TEST_H__
+
+#include <gtest/gtest.h>
+#include <sstream>
+#include <thread>
+#include <unistd.h>
+
+#include "FOSSSim/SharedState.h"
+
+namespace
+{
+
+std::string sharedStateTestName()
+{
+  std::ostringstream name;
+  name << "/testfosssim" << getpid();
+  return name.str();
+}
+
+}
+
+// A reader sees the latest frame, follows the publisher to a new segment
+// when the number of particles changes, and sees nothing once it is gone.
+TEST(SharedState, ReaderFollowsPublisher)
+{
+  const std::string name = sharedStateTestName();
+  SharedStateReader reader(name);
+  SharedStateFrame frame;
+  EXPECT_FALSE(reader.read(frame));
+
+  {
+    SharedStatePublisher publisher(name);
+    VectorXs x = VectorXs::LinSpaced(6, 0.0, 5.0);
+    VectorXs v = -x;
+    publisher.publish(x, v, 0.5);
+    x *= 2.0;
+    publisher.publish(x, v, 0.5);
+    ASSERT_TRUE(reader.read(frame));
+    EXPECT_EQ(2, frame.step);
+    EXPECT_EQ(1.0, frame.time);
+    EXPECT_TRUE(frame.x == x);
+    EXPECT_TRUE(frame.v == v);
+
+    x = VectorXs::Constant(10, 3.0);
+    v = VectorXs::Constant(10, -3.0);
+    publisher.publish(x, v, 0.5);
+    ASSERT_TRUE(reader.read(frame));
+    EXPECT_EQ(3, frame.step);
+    EXPECT_TRUE(frame.x == x);
+    EXPECT_TRUE(frame.v == v);
+  }
+  EXPECT_FALSE(reader.read(frame));
+}
+
+// A reader polling while frames are published must only ever see whole ones,
+// newest last.
+TEST(SharedState, ReaderNeverSeesTornFrames)
+{
+  const std::string name = sharedStateTestName();
+  const int numframes = 20000;
+  SharedStatePublisher publisher(name);
+  VectorXs x = VectorXs::Zero(2000);
+  publisher.publish(x, -x, 1.0);
+
+  std::thread writer([&publisher, &x, numframes]()
+  {
+    for( int k = 1; k <= numframes; ++k )
+    {
+      x.setConstant(k);
+      publisher.publish(x, -x, 1.0);
+    }
+  });
+
+  SharedStateReader reader(name);
+  SharedStateFrame frame;
+  long last = 0;
+  int torn = 0, backwards = 0;
+  while( last < numframes + 1 )
+  {
+    ASSERT_TRUE(reader.read(frame));
+    const scalar k = frame.step - 1;
+    torn += !( frame.x.array() == k ).all() || !( frame.v.array() == -k ).all();
+    backwards += frame.step < last;
+    last = frame.step;
+  }
+  writer.join();
+
+  EXPECT_EQ(0, torn);
+  EXPECT_EQ(0, backwards);
+}
+
+#endif
@@ -0,0 +1,34 @@
+#ifndef __STEP_BUDGET_TEST_H__
+#define __STEP_BUDGET_TEST_H__
+
+#include <gtest/gtest.h>
+
+#include "FOSSSim/StepBudget.h"
+
+// Steps timed at 2 ms fixed and 1 ms a unit under a 10 ms budget can afford
+// 8 units; the budget has to settle there, never go below the minimum, and
+// give the units back gradually once they get cheaper.
+TEST(StepBudget, CutsUnitsToFitAndRecovers)
+{
+  StepBudget budget(10.0e-3);
+  EXPECT_EQ(32, budget.allow(32, 1));
+  budget.record(2.0e-3, 32.0e-3, 32);
+  EXPECT_EQ(8, budget.allow(32, 1));
+  budget.record(2.0e-3, 8.0e-3, 8);
+  EXPECT_EQ(8, budget.allow(32, 1));
+  EXPECT_EQ(4, budget.allow(4, 1));
+
+  // A fixed phase over the whole budget leaves the minimum.
+  for( int s = 0; s < 20; ++s ) budget.record(20.0e-3, 1.0e-3, 1);
+  EXPECT_EQ(2, budget.allow(32, 2));
+
+  // Cheap units come back at most doubling per step.
+  for( int s = 0; s < 40; ++s ) budget.record(1.0e-3, 0.1e-3, 1);
+  EXPECT_EQ(4, budget.allow(32, 1));
+  EXPECT_EQ(8, budget.allow(32, 1));
+  EXPECT_EQ(16, budget.allow(32, 1));
+  EXPECT_EQ(32, budget.allow(32, 1));
+  EXPECT_EQ(32, budget.allow(32, 1));
+}
+
+#endif
@@ -0,0 +1,111 @@
+#ifndef __TASK_POOL_TEST_H__
+#define __TASK_POOL_TEST_H__
+
+#include <gtest/gtest.h>
+#include <atomic>
+#include <vector>
+
+#include "TestUtilities.h"
+#include "FOSSSim/ContestDetector.h"
+#include "FOSSSim/SceneGenerator.h"
+#include "FOSSSim/TaskPool.h"
+
+// More threads than the machine may have, so that the tests steal whatever
+// it has.
+const int TASK_POOL_TEST_THREADS = 4;
+
+TEST(TaskPool, ParallelForCoversEveryIndexOnce)
+{
+  TaskPool pool(TASK_POOL_TEST_THREADS);
+  const int n = 100003;
+  std::vector<std::atomic<int> > visits(n);
+  for( int i = 0; i < n; ++i ) visits[i].store(0);
+  std::atomic<int> toolong(0);
+  pool.parallelFor(0, n, 100, [&]( int lo, int hi )
+  {
+    if( hi - lo > 100 ) ++toolong;
+    for( int i = lo; i < hi; ++i ) ++visits[i];
+  });
+  EXPECT_EQ(0, toolong.load());
+  int wrong = 0;
+  for( int i = 0; i < n; ++i ) wrong += visits[i].load() != 1;
+  EXPECT_EQ(0, wrong);
+}
+
+TEST(TaskPool, NestedParallelForsFinish)
+{
+  TaskPool pool(TASK_POOL_TEST_THREADS);
+  std::atomic<long long> sum(0);
+  pool.parallelFor(0, 64, 1, [&]( int lo, int hi )
+  {
+    for( int i = lo; i < hi; ++i )
+      pool.parallelFor(0, 1000, 10, [&]( int l, int h )
+      {
+        long long partial = 0;
+        for( int j = l; j < h; ++j ) partial += j;
+        sum += partial;
+      });
+  });
+  EXPECT_EQ(64LL*999*1000/2, sum.load());
+}
+
+TEST(TaskPool, GraphRunsTasksAfterTheirPredecessors)
+{
+  for( int nthreads = 1; nthreads <= TASK_POOL_TEST_THREADS; nthreads += TASK_POOL_TEST_THREADS-1 )
+  {
+    SCOPED_TRACE(nthreads);
+    TaskPool pool(nthreads);
+    std::atomic<int> clock(0);
+    std::vector<int> finished(6, -1);
+    TaskGraph graph(pool);
+    std::vector<int> tasks;
+    for( int t = 0; t < 6; ++t ) tasks.push_back(graph.add([&clock, &finished, t]() { finished[t] = clock++; }));
+    // A diamond 0 -> 1, 2 -> 3, a chain 4 -> 5 beside it.
+    graph.precede(tasks[0], tasks[1]);
+    graph.precede(tasks[0], tasks[2]);
+    graph.precede(tasks[1], tasks[3]);
+    graph.precede(tasks[2], tasks[3]);
+    graph.precede(tasks[4], tasks[5]);
+    graph.run();
+    for( int t = 0; t < 6; ++t ) EXPECT_GE(finished[t], 0) << "task " << t;
+    EXPECT_LT(finished[0], finished[1]);
+    EXPECT_LT(finished[0], finished[2]);
+    EXPECT_LT(finished[1], finished[3]);
+    EXPECT_LT(finished[2], finished[3]);
+    EXPECT_LT(finished[4], finished[5]);
+  }
+}
+
+// The contest detector's candidates must not depend on the number of threads
+// or on how its loops are split.
+TEST(TaskPool, ContestPairsIndependentOfThreads)
+{
+  SceneGeneratorOptions options;
+  options.numparticles = 20000;
+  options.numsprings = 0;
+  options.minradius = 0.02;
+  options.maxradius = 0.05;
+  options.density = 0.3;
+  TwoDScene scene;
+  std::vector<SceneRecord> records;
+  GeneratedSprings springs;
+  ASSERT_TRUE(generateBoxScene(options, scene, records, springs));
+  const VectorXs x = testutils::perturbedPositions(scene, 0.5, 3);
+
+  TaskPool& pool = TaskPool::shared();
+  const int nthreads = pool.getNumThreads();
+  testutils::PairCollector serial, parallel;
+  ContestDetector detector;
+  pool.setNumThreads(1);
+  detector.performCollisionDetection(scene, x, x, serial);
+  pool.setNumThreads(TASK_POOL_TEST_THREADS);
+  detector.performCollisionDetection(scene, x, x, parallel);
+  pool.setNumThreads(nthreads);
+
+  EXPECT_GT(serial.pppairs.size(), 0u);
+  EXPECT_TRUE(serial.pppairs == parallel.pppairs);
+  EXPECT_TRUE(serial.pepairs == parallel.pepairs);
+  EXPECT_TRUE(serial.phpairs == parallel.phpairs);
+}
+
+#endif
@@ -0,0 +1,138 @@
+#ifndef __TEST_UTILITIES_H__
+#define __TEST_UTILITIES_H__
+
+#include <dirent.h>
+
+#include <algorithm>
+#include <map>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "FOSSSim/BroadPhase.h"
+#include "FOSSSim/SceneBinary.h"
+#include "FOSSSim/TwoDScene.h"
+
+// Scenes, positions and reference implementations shared by the tests.
+namespace testutils
+{
+
+// Every .xml scene under assets/t2m3, sorted by path.
+inline std::vector<std::string> assetScenes()
+{
+  std::vector<std::string> scenes;
+  const std::string root = std::string(FOSSSIM_ASSETS_DIR) + "/t2m3";
+  DIR* top = opendir(root.c_str());
+  if( top == NULL ) return scenes;
+  for( dirent* group = readdir(top); group != NULL; group = readdir(top) )
+  {
+    const std::string groupname = group->d_name;
+    if( groupname[0] == '.' ) continue;
+    DIR* dir = opendir(( root + "/" + groupname ).c_str());
+    if( dir == NULL ) continue;
+    for( dirent* entry = readdir(dir); entry != NULL; entry = readdir(dir) )
+    {
+      const std::string name = entry->d_name;
+      if( name.size() > 4 && name.compare(name.size() - 4, 4, ".xml") == 0 ) scenes.push_back(root + "/" + groupname + "/" + name);
+    }
+    closedir(dir);
+  }
+  closedir(top);
+  std::sort(scenes.begin(), scenes.end());
+  return scenes;
+}
+
+// The scene at path, read once and kept for the rest of the run; the timing
+// scenes take a while to read.
+inline const TwoDScene& loadScene( const std::string& path )
+{
+  static std::map<std::string, TwoDScene> scenes;
+  std::map<std::string, TwoDScene>::iterator found = scenes.find(path);
+  if( found == scenes.end() )
+  {
+    found = scenes.insert(std::make_pair(path, TwoDScene())).first;
+    std::vector<SceneRecord> records;
+    loadXMLScene(path, found->second, records);
+  }
+  return found->second;
+}
+
+// The positions moved by up to fraction of each particle's radius in each
+// direction, which creates and removes contacts.
+inline VectorXs perturbedPositions( const TwoDScene& scene, scalar fraction, unsigned seed )
+{
+  std::mt19937 generator(seed);
+  std::uniform_real_distribution<scalar> unit(-1.0, 1.0);
+  VectorXs x = scene.getX();
+  for( int i = 0; i < scene.getNumParticles(); ++i )
+  {
+    x(2*i) += fraction*scene.getRadius(i)*unit(generator);
+    x(2*i+1) += fraction*scene.getRadius(i)*unit(generator);
+  }
+  return x;
+}
+
+// The candidates a detector reports, in the order reported.
+class PairCollector : public DetectionCallback
+{
+public:
+  virtual void ParticleParticleCallback( int idx1, int idx2 ) { pppairs.push_back(std::make_pair(std::min(idx1, idx2), std::max(idx1, idx2))); }
+  virtual void ParticleEdgeCallback( int vidx, int eidx ) { pepairs.push_back(std::make_pair(vidx, eidx)); }
+  virtual void ParticleHalfplaneCallback( int vidx, int hidx ) { phpairs.push_back(std::make_pair(vidx, hidx)); }
+
+  // Sorts the candidates, and reports how many were repeated.
+  int sort()
+  {
+    return sortList(pppairs) + sortList(pepairs) + sortList(phpairs);
+  }
+
+  PPList pppairs;
+  PEList pepairs;
+  PHList phpairs;
+
+private:
+  static int sortList( std::vector<std::pair<int,int> >& pairs )
+  {
+    std::sort(pairs.begin(), pairs.end());
+    const int size = (int) pairs.size();
+    pairs.erase(std::unique(pairs.begin(), pairs.end()), pairs.end());
+    return size - (int) pairs.size();
+  }
+};
+
+// Every pair of swept boxes that overlap, tested one pair at a time, as the
+// broad phases report them: particle-edge pairs skip the edge's endpoints.
+inline void bruteForcePairs( const TwoDScene& scene, const VectorXs& qs, const VectorXs& qe, PairCollector& pairs )
+{
+  const int n = scene.getNumParticles();
+  std::vector<AABB> boxes(n);
+  for( int i = 0; i < n; ++i ) boxes[i] = broadphase::particleBox(qs, qe, i, scene.getRadius(i));
+  for( int i = 0; i < n; ++i )
+    for( int j = i + 1; j < n; ++j )
+      if( boxes[i].overlaps(boxes[j]) ) pairs.pppairs.push_back(std::make_pair(i, j));
+
+  for( int e = 0; e < scene.getNumEdges(); ++e )
+  {
+    const AABB box = broadphase::edgeBox(qs, qe, scene.getEdge(e), scene.getEdgeRadii()[e]);
+    for( int i = 0; i < n; ++i )
+      if( i != scene.getEdge(e).first && i != scene.getEdge(e).second && boxes[i].overlaps(box) ) pairs.pepairs.push_back(std::make_pair(i, e));
+  }
+
+  for( int h = 0; h < scene.getNumHalfplanes(); ++h )
+  {
+    Vector2s nhat = scene.getHalfplane(h).second.segment<2>(0);
+    nhat.normalize();
+    const scalar offset = nhat.dot(scene.getHalfplane(h).first.segment<2>(0));
+    for( int i = 0; i < n; ++i )
+    {
+      const scalar ds = nhat.dot(qs.segment<2>(2*i)) - offset;
+      const scalar de = nhat.dot(qe.segment<2>(2*i)) - offset;
+      if( std::min(ds, de) <= scene.getRadius(i) ) pairs.phpairs.push_back(std::make_pair(i, h));
+    }
+  }
+  pairs.sort();
+}
+
+}
+
+#endif
@@ -0,0 +1,151 @@
+#ifndef __TIMING_BUDGET_TEST_H__
+#define __TIMING_BUDGET_TEST_H__
+
+#include <gtest/gtest.h>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <map>
+#include <unistd.h>
+
+#include "BenchTimer.h"
+#include "TestUtilities.h"
+#include "FOSSSim/AABBTreeDetector.h"
+#include "FOSSSim/ContestDetector.h"
+#include "FOSSSim/SweepAndPruneDetector.h"
+
+// Each kernel is timed on the 100000 particle timing scene and fails when its
+// best time is more than the tolerance over its budget in timing_budgets.json.
+// The budgets are one kernel per line, "name": seconds. Running with
+// FOSSSIM_TIMING_RECORD set writes the times measured instead of the budgets,
+// after the tests are run; FOSSSIM_TIMING_TOLERANCE changes the tolerance from
+// 0.25, meaning 25% slower.
+namespace timingbudget
+{
+
+const int REPEATS = 10;
+
+inline std::map<std::string, double>& measured()
+{
+  static std::map<std::string, double> times;
+  return times;
+}
+
+inline std::map<std::string, double> readBudgets()
+{
+  std::map<std::string, double> budgets;
+  std::ifstream file(FOSSSIM_TIMING_BUDGETS);
+  std::string line;
+  while( std::getline(file, line) )
+  {
+    const std::string::size_type open = line.find('"');
+    const std::string::size_type close = line.find('"', open + 1);
+    const std::string::size_type colon = line.find(':', close);
+    if( open == std::string::npos || close == std::string::npos || colon == std::string::npos ) continue;
+    budgets[line.substr(open + 1, close - open - 1)] = atof(line.c_str() + colon + 1);
+  }
+  return budgets;
+}
+
+inline double tolerance()
+{
+  const char* value = getenv("FOSSSIM_TIMING_TOLERANCE");
+  return value == NULL ? 0.25 : atof(value);
+}
+
+inline bool recording()
+{
+  return getenv("FOSSSIM_TIMING_RECORD") != NULL;
+}
+
+// Writes the times measured as the new budgets, if asked to.
+inline bool writeBudgets()
+{
+  if( !recording() ) return true;
+  std::ofstream file(FOSSSIM_TIMING_BUDGETS);
+  if( !file ) return false;
+  file << "{" << std::endl;
+  for( std::map<std::string, double>::const_iterator kernel = measured().begin(); kernel != measured().end(); ++kernel )
+  {
+    file << "  \"" << kernel->first << "\": " << std::setprecision(6) << kernel->second;
+    if( kernel != --measured().end() ) file << ",";
+    file << std::endl;
+  }
+  file << "}" << std::endl;
+  return (bool) file;
+}
+
+inline void expectWithinBudget( const std::string& kernel, double seconds )
+{
+  measured()[kernel] = seconds;
+  if( recording() ) return;
+  const std::map<std::string, double> budgets = readBudgets();
+  const std::map<std::string, double>::const_iterator budget = budgets.find(kernel);
+  if( budget == budgets.end() ) GTEST_SKIP() << "No budget for " << kernel << "; run with FOSSSIM_TIMING_RECORD=1 to write one.";
+  EXPECT_LE(seconds, budget->second*( 1.0 + tolerance() )) << kernel << " took " << seconds << " s against a budget of " << budget->second << " s";
+}
+
+inline std::string timingScene()
+{
+  return std::string(FOSSSIM_ASSETS_DIR) + "/t2m3/TimingScenes/test00.xml";
+}
+
+template<typename Detector>
+double timeDetector( const TwoDScene& scene )
+{
+  Eigen::BenchTimer timer;
+  for( int r = 0; r < REPEATS; ++r )
+  {
+    Detector detector;
+    testutils::PairCollector pairs;
+    timer.start();
+    detector.performCollisionDetection(scene, scene.getX(), scene.getX(), pairs);
+    timer.stop();
+  }
+  return timer.best(Eigen::REAL_TIMER);
+}
+
+}
+
+TEST(TimingBudget, ContestDetector)
+{
+  timingbudget::expectWithinBudget("contest_detector", timingbudget::timeDetector<ContestDetector>(testutils::loadScene(timingbudget::timingScene())));
+}
+
+TEST(TimingBudget, SweepAndPrune)
+{
+  timingbudget::expectWithinBudget("sweep_and_prune", timingbudget::timeDetector<SweepAndPruneDetector>(testutils::loadScene(timingbudget::timingScene())));
+}
+
+TEST(TimingBudget, AABBTree)
+{
+  timingbudget::expectWithinBudget("aabb_tree", timingbudget::timeDetector<AABBTreeDetector>(testutils::loadScene(timingbudget::timingScene())));
+}
+
+TEST(TimingBudget, SceneLoading)
+{
+  char fsbfile[] = "/tmp/testfosssimXXXXXX";
+  const int fd = mkstemp(fsbfile);
+  ASSERT_GE(fd, 0);
+  close(fd);
+  ASSERT_TRUE(convertXMLSceneToBinary(timingbudget::timingScene(), fsbfile));
+
+  Eigen::BenchTimer xmltimer, binarytimer;
+  for( int r = 0; r < timingbudget::REPEATS; ++r )
+  {
+    TwoDScene scene;
+    std::vector<SceneRecord> records;
+    xmltimer.start();
+    loadXMLScene(timingbudget::timingScene(), scene, records);
+    xmltimer.stop();
+    binarytimer.start();
+    loadBinaryScene(fsbfile, scene, records);
+    binarytimer.stop();
+  }
+  remove(fsbfile);
+  timingbudget::expectWithinBudget("load_xml_scene", xmltimer.best(Eigen::REAL_TIMER));
+  timingbudget::expectWithinBudget("load_binary_scene", binarytimer.best(Eigen::REAL_TIMER));
+}
+
+#endif
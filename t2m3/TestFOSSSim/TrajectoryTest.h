@@ -0,0 +1,224 @@
+#ifndef __TRAJECTORY_TEST_H__
+#define __TRAJECTORY_TEST_H__
+
+#include <gtest/gtest.h>
+#include <cstdio>
+#include <random>
+#include <sstream>
+#include <unistd.h>
+
+#include "FOSSSim/TaskPool.h"
+#include "FOSSSim/Trajectory.h"
+#include "FOSSSim/TrajectoryComparison.h"
+
+namespace
+{
+
+std::string trajectoryTestName()
+{
+  std::ostringstream name;
+  name << "/tmp/testfosssim" << getpid() << ".bin";
+  return name.str();
+}
+
+// Writes numframes frames of n particles drifting from random positions, the
+// candidate's off from the reference's by about error.
+void writeTrajectoryPair( const std::string& reference, const std::string& candidate, int numframes, int n, scalar error )
+{
+  std::mt19937 generator(9);
+  std::uniform_real_distribution<scalar> value(-1.0, 1.0);
+  TrajectoryWriter referencewriter, candidatewriter;
+  ASSERT_TRUE(referencewriter.open(reference));
+  ASSERT_TRUE(candidatewriter.open(candidate));
+  VectorXs x(2*n), v(2*n);
+  for( int k = 0; k < 2*n; ++k ) x(k) = value(generator);
+  for( int f = 0; f < numframes; ++f )
+  {
+    for( int k = 0; k < 2*n; ++k )
+    {
+      v(k) = value(generator);
+      x(k) += 0.01*v(k);
+    }
+    referencewriter.writeFrame(x, v);
+    VectorXs candidatex = x, candidatev = v;
+    for( int k = 0; k < 2*n; ++k )
+    {
+      candidatex(k) += error*value(generator);
+      candidatev(k) += error*value(generator);
+    }
+    candidatewriter.writeFrame(candidatex, candidatev);
+  }
+  ASSERT_TRUE(referencewriter.close());
+  ASSERT_TRUE(candidatewriter.close());
+}
+
+}
+
+// Frames read back in any order are those written, exactly when raw and to
+// the tolerance when compressed, across keyframes and a change in the number
+// of particles; and a trajectory cut short fails its missing frames.
+TEST(Trajectory, ReaderSeeksToWrittenFrames)
+{
+  const std::string filename = trajectoryTestName();
+  const scalar tolerances[] = { 0.0, 1.0e-6 };
+  for( int t = 0; t < 2; ++t )
+  {
+    SCOPED_TRACE(tolerances[t]);
+    std::mt19937 generator(5);
+    std::uniform_real_distribution<scalar> value(-1.0, 1.0);
+    std::vector<VectorXs> xs, vs;
+    TrajectoryWriter writer;
+    ASSERT_TRUE(writer.open(filename, tolerances[t]));
+    for( int f = 0; f < 70; ++f )
+    {
+      const int n = f < 50 ? 100 : 120;
+      VectorXs x(2*n), v(2*n);
+      for( int k = 0; k < 2*n; ++k )
+      {
+        x(k) = f == 0 || f == 50 ? value(generator) : xs.back()(k) + 0.01*value(generator);
+        v(k) = value(generator);
+      }
+      writer.writeFrame(x, v);
+      xs.push_back(x);
+      vs.push_back(v);
+    }
+    ASSERT_TRUE(writer.close());
+
+    TrajectoryReader reader;
+    ASSERT_TRUE(reader.open(filename));
+    ASSERT_EQ(70, reader.getNumFrames());
+    const int frames[] = { 69, 3, 40, 41, 0, 50, 33, 69 };
+    VectorXs x, v;
+    for( int k = 0; k < 8; ++k )
+    {
+      const int f = frames[k];
+      ASSERT_TRUE(reader.readFrame(f, x, v));
+      ASSERT_EQ(xs[f].size(), x.size());
+      EXPECT_LE((x - xs[f]).lpNorm<Eigen::Infinity>(), tolerances[t]);
+      EXPECT_LE((v - vs[f]).lpNorm<Eigen::Infinity>(), tolerances[t]);
+    }
+    EXPECT_FALSE(reader.readFrame(70, x, v));
+
+    std::FILE* file = std::fopen(filename.c_str(), "rb");
+    ASSERT_TRUE(file != NULL);
+    std::fseek(file, 0, SEEK_END);
+    const long size = std::ftell(file);
+    std::fclose(file);
+    ASSERT_EQ(0, truncate(filename.c_str(), size/2));
+    ASSERT_TRUE(reader.open(filename));
+    EXPECT_TRUE(reader.readFrame(0, x, v));
+    EXPECT_FALSE(reader.readFrame(69, x, v));
+  }
+  std::remove(filename.c_str());
+  std::remove(( filename + ".idx" ).c_str());
+}
+
+// A range of particles read, or viewed in place, is that range of the whole
+// frame, and a view is taken only of raw frames holding all of the range.
+TEST(Trajectory, ReaderTakesParticleRanges)
+{
+  const std::string filename = trajectoryTestName();
+  const scalar tolerances[] = { 0.0, 1.0e-6 };
+  for( int t = 0; t < 2; ++t )
+  {
+    SCOPED_TRACE(tolerances[t]);
+    std::mt19937 generator(7);
+    std::uniform_real_distribution<scalar> value(-1.0, 1.0);
+    TrajectoryWriter writer;
+    ASSERT_TRUE(writer.open(filename, tolerances[t]));
+    for( int f = 0; f < 20; ++f )
+    {
+      VectorXs x(2*60), v(2*60);
+      for( int k = 0; k < 2*60; ++k )
+      {
+        x(k) = value(generator);
+        v(k) = value(generator);
+      }
+      writer.writeFrame(x, v);
+    }
+    ASSERT_TRUE(writer.close());
+
+    TrajectoryReader reader;
+    ASSERT_TRUE(reader.open(filename));
+    EXPECT_EQ(tolerances[t] == 0.0, reader.isRaw());
+    VectorXs x, v, partx, partv;
+    for( int f = 19; f >= 0; f -= 3 )
+    {
+      ASSERT_TRUE(reader.readFrame(f, x, v));
+      ASSERT_TRUE(reader.readParticles(f, 10, 25, partx, partv));
+      EXPECT_TRUE(partx == x.segment(20, 50));
+      EXPECT_TRUE(partv == v.segment(20, 50));
+      const TrajectoryView viewx = reader.mapPositions(f, 10, 25);
+      const TrajectoryView viewv = reader.mapVelocities(f, 10, 25);
+      if( reader.isRaw() )
+      {
+        ASSERT_EQ(50, viewx.size());
+        ASSERT_EQ(50, viewv.size());
+        EXPECT_TRUE(viewx == x.segment(20, 50));
+        EXPECT_TRUE(viewv == v.segment(20, 50));
+      }
+      else
+      {
+        EXPECT_EQ(0, viewx.size());
+        EXPECT_EQ(0, viewv.size());
+      }
+    }
+    EXPECT_FALSE(reader.readParticles(0, 50, 11, partx, partv));
+    EXPECT_FALSE(reader.readParticles(20, 0, 1, partx, partv));
+    EXPECT_EQ(0, reader.mapPositions(0, -1, 10).size());
+    EXPECT_EQ(0, reader.mapVelocities(20, 0, 1).size());
+  }
+  std::remove(filename.c_str());
+  std::remove(( filename + ".idx" ).c_str());
+}
+
+// Grading the runs of frames in parallel finds the maxima one grader going
+// through every frame does, and sums to within rounding of its, the same
+// whatever the number of threads.
+TEST(Trajectory, ComparisonMatchesSerialGrading)
+{
+  const std::string reference = trajectoryTestName();
+  const std::string candidate = reference + ".candidate";
+  writeTrajectoryPair(reference, candidate, 300, 50, 1.0e-15);
+
+  TwoDSceneGrader serial;
+  TrajectoryReader referencereader, candidatereader;
+  ASSERT_TRUE(referencereader.open(reference));
+  ASSERT_TRUE(candidatereader.open(candidate));
+  VectorXs rx, rv, cx, cv;
+  for( int f = 0; f < 300; ++f )
+  {
+    ASSERT_TRUE(referencereader.readFrame(f, rx, rv));
+    ASSERT_TRUE(candidatereader.readFrame(f, cx, cv));
+    serial.addToAccumulatedResidual(rx, rv, cx, cv);
+  }
+  EXPECT_GT(serial.getMaxPositionResidual(), 0.0);
+
+  TaskPool& pool = TaskPool::shared();
+  const int nthreads = pool.getNumThreads();
+  TrajectoryComparison one, four;
+  pool.setNumThreads(1);
+  EXPECT_TRUE(one.grade(reference, candidate));
+  pool.setNumThreads(4);
+  EXPECT_TRUE(four.grade(reference, candidate));
+  pool.setNumThreads(nthreads);
+
+  EXPECT_EQ(300, four.getNumFrames());
+  EXPECT_EQ(serial.getMaxPositionResidual(), four.getGrader().getMaxPositionResidual());
+  EXPECT_EQ(serial.getMaxVelocityResidual(), four.getGrader().getMaxVelocityResidual());
+  EXPECT_NEAR(serial.getAccumulatedPositionResidual(), four.getGrader().getAccumulatedPositionResidual(), 1.0e-12*serial.getAccumulatedPositionResidual());
+  EXPECT_NEAR(serial.getAccumulatedVelocityResidual(), four.getGrader().getAccumulatedVelocityResidual(), 1.0e-12*serial.getAccumulatedVelocityResidual());
+  EXPECT_EQ(one.getGrader().getAccumulatedPositionResidual(), four.getGrader().getAccumulatedPositionResidual());
+  EXPECT_EQ(one.getGrader().getAccumulatedVelocityResidual(), four.getGrader().getAccumulatedVelocityResidual());
+
+  // A candidate cut short fails, however close its frames.
+  writeTrajectoryPair(reference + ".short", candidate + ".short", 200, 50, 1.0e-15);
+  EXPECT_FALSE(four.grade(reference, candidate + ".short"));
+  EXPECT_TRUE(four.wasRead());
+  EXPECT_EQ(200, four.getNumFrames());
+
+  const char* files[] = { "", ".idx", ".candidate", ".candidate.idx", ".short", ".short.idx", ".candidate.short", ".candidate.short.idx" };
+  for( int k = 0; k < 8; ++k ) std::remove(( reference + files[k] ).c_str());
+}
+
+#endif
@@ -0,0 +1,44 @@
+#ifndef __TRIPLE_BUFFER_TEST_H__
+#define __TRIPLE_BUFFER_TEST_H__
+
+#include <gtest/gtest.h>
+#include <thread>
+
+#include "FOSSSim/TripleBuffer.h"
+
+// The reader must only ever see whole values the writer published, newest
+// last, and at the end the last one.
+TEST(TripleBuffer, ReaderSeesPublishedValuesInOrder)
+{
+  const int numvalues = 200000;
+  TripleBuffer<std::pair<int,int> > buffer;
+  buffer.back() = std::make_pair(0, 0);
+  buffer.publish();
+
+  std::thread writer([&buffer, numvalues]()
+  {
+    for( int k = 1; k <= numvalues; ++k )
+    {
+      buffer.back() = std::make_pair(k, -k);
+      buffer.publish();
+    }
+  });
+
+  int last = -1, torn = 0, backwards = 0;
+  while( last < numvalues )
+  {
+    if( !buffer.update() ) continue;
+    const std::pair<int,int>& value = buffer.front();
+    torn += value.first != -value.second;
+    backwards += value.first <= last;
+    last = value.first;
+  }
+  writer.join();
+
+  EXPECT_EQ(0, torn);
+  EXPECT_EQ(0, backwards);
+  EXPECT_FALSE(buffer.update());
+  EXPECT_EQ(numvalues, buffer.front().first);
+}
+
+#endif
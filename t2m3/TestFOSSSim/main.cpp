@@ -2,10 +2,33 @@
 #include <string>
 
 #include "SampleTest.h"
+#include "BroadPhaseTest.h"
+#include "NarrowPhaseTest.h"
+#include "PenaltyGridTest.h"
+#include "ParticlePoolTest.h"
+#include "PeriodicDomainTest.h"
+#include "SceneLoadingTest.h"
+#include "TimingBudgetTest.h"
+#include "TaskPoolTest.h"
+#include "TripleBufferTest.h"
+#include "SVGWriterTest.h"
+#include "SceneRasterizerTest.h"
+#include "CheckpointTest.h"
+#include "EdgeAdjacencyTest.h"
+#include "EmbedTest.h"
+#include "SharedStateTest.h"
+#include "StepBudgetTest.h"
+#include "FirstTouchTest.h"
+#include "TrajectoryTest.h"
+#include "BlockSteppingTest.h"
+#include "PhaseTimesTest.h"
+#include "ParticleSleepTest.h"
 
 
 int main( int argc, char **argv ) 
 {
   ::testing::InitGoogleTest(&argc, argv);
-  return RUN_ALL_TESTS();
+  const int status = RUN_ALL_TESTS();
+  if( !timingbudget::writeBudgets() ) return 1;
+  return status;
 }
\ No newline at end of file
@@ -2,6 +2,9 @@ import os
 import subprocess
 import sys
 import argparse
+import tempfile
+import time
+from concurrent.futures import ThreadPoolExecutor
 
 def find_tests(theme):
     """Find all of the test files in the assets directory."""
@@ -10,7 +13,7 @@ def find_tests(theme):
     if theme.omit:
         exclude = set(theme.omit)
     
-    for dirpath, dirnames, filenames in os.walk("/home/codio/workspace/assets/{}/" .format(theme.dir)):
+    for dirpath, dirnames, filenames in os.walk("{}/assets/{}/" .format(theme.workspace, theme.dir)):
         dirnames[:] = [d for d in dirnames if d not in exclude] 
         for filename in filenames:
             fullname = dirpath.split('/')[-1] + '/' + filename
@@ -21,6 +24,45 @@ def find_tests(theme):
     return test_files
 
 
+def run_test(test, simulator, oracle):
+    """Run one scene through FOSSSim and the oracle, returning the verdict and the seconds taken.
+
+    The simulation is piped straight into the oracle, which grades each frame as it
+    arrives, so the two run side by side and nothing is written to disk.
+    """
+    start = time.time()
+    scratch = None
+    if os.path.isdir('/dev/fd'):
+        read_fd, write_fd = os.pipe()
+        output, fds = '/dev/fd/{}' .format(write_fd), (write_fd,)
+        grade, oracle_fds = '/dev/fd/{}' .format(read_fd), (read_fd,)
+    else:
+        handle, scratch = tempfile.mkstemp(suffix='.bin')
+        os.close(handle)
+        output, fds, grade, oracle_fds = scratch, (), scratch, ()
+
+    sim = subprocess.Popen([simulator, '-s', test, '-d', '0', '-o', output],
+                           stdout=subprocess.DEVNULL, pass_fds=fds)
+    if scratch is not None:
+        sim.wait()
+    grader = subprocess.Popen([oracle, '-s', test, '-d', '0', '-i', grade],
+                              stdout=subprocess.PIPE, universal_newlines=True, pass_fds=oracle_fds)
+    for fd in fds + oracle_fds:
+        os.close(fd)
+    verdict = grader.communicate()[0]
+    sim.wait()
+    if scratch is not None:
+        os.remove(scratch)
+
+    if 'Overall success: Passed.' in verdict:
+        result = 'Passed.'
+    elif 'Overall success: Failed.' in verdict:
+        result = 'Failed.'
+    else:
+        result = 'Error.'
+    return result, time.time() - start
+
+
 def main():
     """Collect the tests for the current milestone and run them against the oracle.
 
@@ -31,18 +73,23 @@ def main():
     --specific -s
     --extra -e
     --omit -o
+    --jobs -j        number of tests run at once, one per core by default
+    --workspace -w   directory holding assets/, build/ and oracle/
 
     Examples
     --------
     $  python3 run_tests.py t4m1
         $  python3 run_tests.py t4m1 -e
     $  python3 run_tests.py t4m1 -s SpringTests
+    $  python3 run_tests.py t4m1 -j 8 -w ~/FOSSSim
     """
     
     parser = argparse.ArgumentParser(description='Run Oracle tests')
     parser.add_argument('-s', '--specific', nargs='*')
     parser.add_argument('-e', '--extra', action='store_true')
     parser.add_argument('-o', '--omit', nargs='*')
+    parser.add_argument('-j', '--jobs', type=int, default=os.cpu_count() or 1)
+    parser.add_argument('-w', '--workspace', type=str, default='/home/codio/workspace')
     parser.add_argument('dir', type=str, help='Name of the theme')
     args = parser.parse_args();
     
@@ -51,29 +98,25 @@ def main():
     if args.extra:
         args.dir += "_extracredit" 
         
-    tests = find_tests(args)
-    successful_tests = 0
-    failed_tests = 0
-
-    for test in sorted(tests):
-        print('Running test {}: ' .format(test), end='')
-        subprocess.check_output(['/home/codio/workspace/build/FOSSSim/FOSSSim', '-s', '{}' .format(test),
-                                 '-d', '0', '-o', '/home/codio/workspace/test_output.bin'])
-
-        oracle = subprocess.check_output(['/home/codio/workspace/oracle/FOSSSimOracle{}' .format(theme.upper()),
-                                          '-s', '{}' .format(test), '-d', '0', '-i', '/home/codio/workspace/test_output.bin'],
-                                          universal_newlines=True)
+    tests = sorted(find_tests(args))
+    simulator = '{}/build/FOSSSim/FOSSSim' .format(args.workspace)
+    oracle = '{}/oracle/FOSSSimOracle{}' .format(args.workspace, theme.upper())
+    counts = {'Passed.': 0, 'Failed.': 0, 'Error.': 0}
+    start = time.time()
 
-        if 'Overall success: Passed.' in oracle:
-            successful_tests += 1
-            print('Passed.')
-        elif 'Overall success: Failed.' in oracle:
-            failed_tests += 1
-            print('Failed.')
+    with ThreadPoolExecutor(max_workers=max(args.jobs, 1)) as pool:
+        results = [pool.submit(run_test, test, simulator, oracle) for test in tests]
+        for test, future in zip(tests, results):
+            result, seconds = future.result()
+            counts[result] += 1
+            print('Running test {}: {} ({:.2f} s)' .format(test, result, seconds))
 
     print('------------------------------------------------')
-    print('Successful Tests: {}' .format(successful_tests))
-    print('Failed Tests: {}' .format(failed_tests))
+    print('Successful Tests: {}' .format(counts['Passed.']))
+    print('Failed Tests: {}' .format(counts['Failed.']))
+    if counts['Error.']:
+        print('Tests Without a Verdict: {}' .format(counts['Error.']))
+    print('Total Time: {:.2f} s with {} jobs' .format(time.time() - start, max(args.jobs, 1)))
     print('------------------------------------------------')
 
 